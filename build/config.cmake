@@ -34,6 +34,10 @@ constant(PLUMBER_VERSION "\"${PLUMBER_VERSION_SHORT}.${SRC_VERSION} ${BUILD_TIME
 ##Logging
 constant(LOG_DEFAULT_CONFIG_FILE \"log.cfg\")
 constant(CONFIG_PATH \"${CMAKE_INSTALL_PREFIX}/etc/plumber\")
+constant(LOG_ASYNC_RING_SIZE 65536)
+constant(LOG_ASYNC_RECORD_SIZE_LIMIT 4096)
+constant(LOG_ASYNC_FLUSH_INTERVAL 5)
+constant(LOG_RATE_LIMIT 10)
 
 ##OpenSSL
 constant(MODULE_TLS_ENABLED 1)
@@ -49,6 +53,9 @@ endif("${MODULE_TLS_ENABLED}" EQUAL "1")
 constant(DO_NOT_COMPILE_ITC_MODULE_TEST 0)
 
 constant(UTILS_THREAD_GENERIC_ALLOC_UNIT 8)
+constant(UTILS_MEMPOOL_PAGE_CHUNK_SIZE 0x200000)
+constant(UTILS_MEMPOOL_PAGE_HUGE_REGION_SIZE 0x20000000)
+constant(UTILS_MEMPOOL_PAGE_MAX_NUMA_NODES 8)
 
 constant(RUNTIME_SERVLET_DEFINE_SYM __servdef__)
 constant(RUNTIME_ADDRESS_TABLE_SYM __plumber_address_table)
@@ -61,17 +68,32 @@ constant(RUNTIME_SERVLET_DEFAULT_SEARCH_PATH \"${CMAKE_INSTALL_PREFIX}/lib/plumb
 constant(RUNTIME_SERVLET_NS1_PREFIX \"/tmp/plumber-servlet.\")
 
 constant(MODULE_TCP_MAX_ASYNC_BUF_SIZE 4096)
+constant(MODULE_TCP_MAX_ASYNC_IOV 1024)
+constant(MODULE_TCP_POOL_MAX_TIMER_WHEEL_SIZE 4096)
+
+constant(MODULE_HTTP2_MAX_CONCURRENT_STREAMS 128)
+constant(MODULE_HTTP2_MAX_HEADER_LIST_SIZE 16384)
+constant(MODULE_HTTP2_MAX_BODY_SIZE 0x100000)
+constant(MODULE_HTTP2_HPACK_TABLE_SIZE 4096)
+
+constant(MODULE_HTTP1_MAX_PIPELINE 16)
+constant(MODULE_HTTP1_MAX_REQUEST_SIZE 0x100000)
 
 constant(SCHED_SERVICE_BUFFER_NODE_LIST_INIT_SIZE 32)
 constant(SCHED_SERVICE_BUFFER_OUT_GOING_LIST_INIT_SIZE 8)
 constant(SCHED_SERVICE_MAX_NUM_NODES 0x100000ul)
 constant(SCHED_SERVICE_MAX_NUM_EDGES 0x1000000ul)
-constant(SCHED_TASK_TABLE_SLOT_SIZE 37813)
+constant(SCHED_TASK_TABLE_INIT_SIZE 4096)
+constant(SCHED_TASK_REQUEST_TABLE_INIT_SIZE 512)
+constant(SCHED_TASK_QUEUE_INIT_SIZE 256)
 constant(SCHED_LOOP_EVENT_QUEUE_SIZE 4096)
 constant(SCHED_LOOP_MAX_PENDING_TASKS 0x100000)
 constant(SCHED_CNODE_BOUNDARY_INIT_SIZE 8)
 constant(SCHED_PROF_INIT_THREAD_CAPACITY 1)
-constant(SCHED_RSCOPE_ENTRY_TABLE_INIT_SIZE  4096)
+constant(SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS 3)
+constant(SCHED_PROF_HISTOGRAM_MAX_BITS 40)
+constant(SCHED_PROF_HISTOGRAM_EXPORT_INTERVAL 5)
+constant(SCHED_TRACE_RING_SIZE 65536)
 constant(SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT 0x100000)
 constant(SCHED_TYPE_ENV_HASH_SIZE 97)
 constant(SCHED_TYPE_MAX 65536)
@@ -84,6 +106,8 @@ constant(SCHED_DAEMON_LOCK_SUFFIX \".lock\")
 constant(ITC_MODULE_EVENT_QUEUE_SIZE 128)
 constant(ITC_MODULE_CALLBACK_READ_BUF_SIZE 4096)
 constant(ITC_EQUEUE_VEC_INIT_SIZE 4)
+constant(ITC_EQUEUE_LEGACY 0)
+constant(ITC_EQUEUE_MAX_NUM_QUEUES 1024)
 constant(ITC_MODTAB_MAX_PATH 4096)
 
 constant(LANG_LEX_SEARCH_LIST_INIT_SIZE 4)
@@ -100,6 +124,7 @@ constant(LANG_VM_PARAM_INIT_SIZE 32)
 constant(LANG_PROP_CALLBACK_VEC_INIT_SIZE 32)
 
 constant(PSCRIPT_GLOBAL_MODULE_PATH "\"${CMAKE_INSTALL_PREFIX}/lib/plumber/pss\"")
+constant(PBENCH_GRAPH_PATH "\"${CMAKE_INSTALL_PREFIX}/lib/plumber/pbench\"")
 
 #LibPSTD Configurations
 constant(LIB_PSTD_TYPE_MODEL_PIPE_VEC_INIT_CAP 32)
@@ -16,6 +16,7 @@ foreach(servlet_cmake ${servlet_cmakes})
 		set(LOCAL_LIBS )
 		set(LOCAL_INCLUDE )
 		set(LOCAL_SOURCE )
+		set(TEST_SOURCE )
 		include(${CMAKE_SOURCE_DIR}/${SERVLET_DIR}/${servlet_cmake})
 		if(NOT "${build_${servlet_config_name}}" STREQUAL "no")
 			set(package_status "${package_status} -Dbuild_${servlet_config_name}=yes")
@@ -49,6 +50,30 @@ foreach(servlet_cmake ${servlet_cmakes})
 						     python ${CMAKE_CURRENT_BINARY_DIR}/servlet-test-driver.py ${servlet_test_name} ${servlet_test_case})
 				endforeach(case_dir in ${servlet_tests})
 			endif(NOT "${servlet_tests}" STREQUAL "")
+			file(GLOB servlet_unit_tests RELATIVE "${SOURCE_PATH}/test" "${SOURCE_PATH}/test/test_*.c")
+			if(NOT "${build_testenv}" STREQUAL "no")
+				foreach(test ${servlet_unit_tests})
+					get_filename_component(test_name ${test} NAME_WE)
+					string(REGEX REPLACE "^test_" "" test_name "${test_name}")
+					set(test_name "servlet_${servlet_config_name}_${test_name}")
+					set(outdir ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${TEST_DIR}/servlet/${NAMESPACE}/${servlet})
+					set(test_source ${SOURCE_PATH}/test/${test})
+					foreach(source_file ${TEST_SOURCE})
+						list(APPEND test_source ${SOURCE_PATH}/${source_file})
+					endforeach(source_file ${TEST_SOURCE})
+					file(MAKE_DIRECTORY ${outdir})
+					set_source_files_properties(${SOURCE_PATH}/test/${test} PROPERTIES COMPILE_FLAGS ${CFLAGS})
+					add_executable(${test_name} ${test_source})
+					set_target_properties(${test_name} PROPERTIES RUNTIME_OUTPUT_DIRECTORY ${outdir})
+					target_compile_definitions(${test_name} PRIVATE TESTDIR=\"${outdir}\" TESTING_CODE=1 TEST_NAME=\"${test_name}\")
+					target_include_directories(${test_name} PUBLIC ${LOCAL_INCLUDE} "${CMAKE_CURRENT_SOURCE_DIR}/${TOOL_DIR}/testenv/include")
+					foreach(lib ${LOCAL_LIBS})
+						target_include_directories(${test_name} PUBLIC $<TARGET_PROPERTY:${lib},INTERFACE_INCLUDE_DIRECTORIES>)
+					endforeach(lib ${LOCAL_LIBS})
+					target_link_libraries(${test_name} testenv plumber dl ${GLOBAL_LIBS} ${EXEC_LIBS})
+					add_binary_test(${test_name} ${outdir}/${test_name} 30)
+				endforeach(test ${servlet_unit_tests})
+			endif(NOT "${build_testenv}" STREQUAL "no")
 		else(NOT "${build_${servlet_config_name}}" STREQUAL "no")
 			set(package_status "${package_status} -Dbuild_${servlet_config_name}=no")
 			set(build_${servlet_config_name} "no")
@@ -204,7 +204,8 @@ int itc_equeue_empty(itc_equeue_token_t token);
  *       somebody elses calls itc_equeue_wait_interrupt, the function will
  *       call the given callback (if it's not NULL) and then go back to waiting mode
  * @param token The token
- * @param killed If thread gets killed
+ * @param killed If thread gets killed, this is also checked right after the interrupt callback returns,
+ *        so that the callback is able to stop the wait by setting it
  * @param interrupt The interrupt callback
  * @return status code
  **/
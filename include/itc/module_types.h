@@ -78,6 +78,29 @@ typedef struct {
 	int32_t      timeout;       /*!< The promise the data source will gets notified in this amount of time (in seconds) */
 } itc_module_data_source_event_t;
 
+/**
+ * @brief The data structure used to describe a region of a regular file which holds all the remaining data of a data source
+ * @note This is returned by the optional data_source.file_region callback, once the module gets the region, it's responsible
+ *       for transmitting the region and the data source should be closed without being read anymore.
+ **/
+typedef struct {
+	int          fd;            /*!< The FD of the regular file */
+	uint64_t     offset;        /*!< The offset in the file where the remaining data begins */
+	size_t       size;          /*!< The number of bytes remaining in the region */
+} itc_module_data_source_region_t;
+
+/**
+ * @brief The data structure used to describe the memory that holds the next piece of data of a data source
+ * @note This is returned by the optional data_source.donate callback, once the module gets the memory, it owns
+ *       the memory and should release it with the free function when the data is no longer used
+ **/
+typedef struct {
+	void*        base;          /*!< The memory the free function takes */
+	const char*  data;          /*!< The first byte of the data */
+	size_t       size;          /*!< The number of bytes of the data */
+	int        (*free_func)(void* base);  /*!< The function used to release the memory */
+} itc_module_data_source_page_t;
+
 
 /**
  * @brief represent a data source that provides data for the write_callback module call
@@ -107,6 +130,22 @@ typedef struct {
 	 * @return status code
 	 **/
 	int    (*close)(void* __restrict handle);
+	/**
+	 * @brief get the file region that holds the remaining data of the data source, this is optional and
+	 *        makes the module able to send the data with the zero-copy system calls, such as sendfile
+	 * @param handle the data handle
+	 * @param region_buf the buffer used to return the file region
+	 * @return 1 if the region is returned, 0 if the data source is not backed by a file region, or error code
+	 **/
+	int    (*file_region)(void* __restrict handle, itc_module_data_source_region_t* region_buf);
+	/**
+	 * @brief take the memory that holds the next piece of data of the data source, this is optional and makes
+	 *        the module able to link the memory to the pipe rather than copying the data
+	 * @param handle the data handle
+	 * @param page_buf the buffer used to return the memory
+	 * @return 1 if the memory is returned, 0 if the next piece of data should be read instead, or error code
+	 **/
+	int    (*donate)(void* __restrict handle, itc_module_data_source_page_t* page_buf);
 } itc_module_data_source_t;
 
 /**
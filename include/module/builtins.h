@@ -19,6 +19,8 @@
 #include <module/simulate/module.h>
 #include <module/legacy_file/module.h>
 #include <module/text_file/module.h>
+#include <module/http2/module.h>
+#include <module/http1/module.h>
 
 #if MODULE_TLS_ENABLED
 #	define _TLS_MODULE_DEF {"tls_pipe", &module_tls_module_def},
@@ -32,6 +34,8 @@
 	{"test_pipe",&module_test_module_def},\
 	{"legacy_file_pipe", &module_legacy_file_module_def},\
 	_TLS_MODULE_DEF \
+	{"http2_pipe", &module_http2_module_def},\
+	{"http1_pipe", &module_http1_module_def},\
 	{"pssm",      &module_pssm_module_def},\
 	{"simulate",  &module_simulate_module_def},\
 	{"legacy_file",  &module_legacy_file_module_def}, \
@@ -0,0 +1,17 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+
+/**
+ * @brief the module header that declares the HTTP/1.1 pipelining module
+ * @details The HTTP/1.1 module is a wrapper module on top of a transportation layer module, it
+ *          splits the pipelined requests of a HTTP/1.1 connection and each request becomes an
+ *          event of the scheduler, while the responses are written in the order of the requests
+ * @file http1/module.h
+ **/
+#ifndef __MODULE_HTTP1_MODULE_H__
+#define __MODULE_HTTP1_MODULE_H__
+
+extern itc_module_t module_http1_module_def;
+
+#endif /* __MODULE_HTTP1_MODULE_H__ */
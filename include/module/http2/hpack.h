@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+/**
+ * @brief The HPACK header compression used by the HTTP/2 module (RFC 7541)
+ * @details The decoder implements the full HPACK decoding, including the dynamic table and the Huffman code.
+ *          The encoder only produces the literal representations without indexing, which doesn't need to
+ *          maintain any encoder state and thus can be used by multiple streams concurrently.
+ * @file module/http2/hpack.h
+ **/
+#ifndef __MODULE_HTTP2_HPACK_H__
+#define __MODULE_HTTP2_HPACK_H__
+
+/**
+ * @brief The entry of the dynamic table
+ **/
+typedef struct _module_http2_hpack_entry_t module_http2_hpack_entry_t;
+
+/**
+ * @brief The HPACK decoding context, which holds the dynamic table
+ **/
+typedef struct {
+	uint32_t                     size;      /*!< The size of the table, as RFC 7541 section 4.1 defines */
+	uint32_t                     max_size;  /*!< The current max size of the table */
+	uint32_t                     limit;     /*!< The limit of the max size, which is the SETTINGS_HEADER_TABLE_SIZE we advertised */
+	uint32_t                     count;     /*!< The number of entries in the table */
+	uint32_t                     capacity;  /*!< The capacity of the entry ring buffer */
+	uint32_t                     first;     /*!< The index of the oldest entry in the ring buffer */
+	module_http2_hpack_entry_t** entries;   /*!< The entry ring buffer */
+} module_http2_hpack_table_t;
+
+/**
+ * @brief The callback function that receives a decoded header field
+ * @param name The field name
+ * @param name_len The length of the name
+ * @param value The field value
+ * @param value_len The length of the value
+ * @param data The additional data
+ * @return status code
+ **/
+typedef int (*module_http2_hpack_field_func_t)(const char* name, size_t name_len, const char* value, size_t value_len, void* data);
+
+/**
+ * @brief Initialize a HPACK decoding context
+ * @param table The context to initialize
+ * @param limit The max size of the dynamic table we allow the peer to use
+ * @return status code
+ **/
+int module_http2_hpack_table_init(module_http2_hpack_table_t* table, uint32_t limit);
+
+/**
+ * @brief Finalize a used HPACK decoding context
+ * @param table The context to finalize
+ * @return status code
+ **/
+int module_http2_hpack_table_finalize(module_http2_hpack_table_t* table);
+
+/**
+ * @brief Decode a complete header block
+ * @param table The decoding context
+ * @param data The header block
+ * @param size The size of the header block
+ * @param func The callback function for each decoded field
+ * @param cbdata The additional data passed to the callback
+ * @note  Any error code returned by this function should be treated as a COMPRESSION_ERROR, since the
+ *        dynamic table may be out of sync with the peer
+ * @return status code
+ **/
+int module_http2_hpack_decode(module_http2_hpack_table_t* table, const uint8_t* data, size_t size, module_http2_hpack_field_func_t func, void* cbdata);
+
+/**
+ * @brief Encode the :status pseudo header field
+ * @param buf The output buffer
+ * @param size The size of the output buffer
+ * @param status The status code
+ * @return The number of bytes has been written, or error code when the buffer is too small
+ **/
+size_t module_http2_hpack_encode_status(uint8_t* buf, size_t size, uint32_t status);
+
+/**
+ * @brief Encode a header field as a literal field without indexing
+ * @param buf The output buffer
+ * @param size The size of the output buffer
+ * @param name The field name, which should be in lower case already
+ * @param name_len The length of the field name
+ * @param value The field value
+ * @param value_len The length of the field value
+ * @return The number of bytes has been written, or error code when the buffer is too small
+ **/
+size_t module_http2_hpack_encode_field(uint8_t* buf, size_t size, const char* name, size_t name_len, const char* value, size_t value_len);
+
+#endif /* __MODULE_HTTP2_HPACK_H__ */
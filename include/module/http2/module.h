@@ -0,0 +1,17 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+
+/**
+ * @brief the module header that declares the HTTP/2 module
+ * @details The HTTP/2 module is a wrapper module on top of a transportation layer module, it
+ *          splits a HTTP/2 connection into streams and each stream becomes an event of the
+ *          scheduler, which carries an equivalent HTTP/1.1 request
+ * @file http2/module.h
+ **/
+#ifndef __MODULE_HTTP2_MODULE_H__
+#define __MODULE_HTTP2_MODULE_H__
+
+extern itc_module_t module_http2_module_def;
+
+#endif /* __MODULE_HTTP2_MODULE_H__ */
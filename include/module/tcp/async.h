@@ -40,6 +40,47 @@ typedef struct _module_tcp_async_loop_t module_tcp_async_loop_t;
  **/
 typedef size_t (*module_tcp_async_write_data_func_t)(uint32_t conn_id, void* buffer, size_t size, module_tcp_async_loop_t* caller);
 
+/**
+ * @brief the previous declaration of the IO vector, see sys/uio.h
+ **/
+struct iovec;
+
+/**
+ * @brief the callback function that exposes the pending data as IO vectors without copying it
+ * @details this is the optional vectored version of the data source callback. The async loop uses
+ *          the IO vectors to flush all the pending data with a single writev call. The data referred by
+ *          the IO vectors must remain valid until the consume callback is called. If the pending data
+ *          can not be exposed (for example, it's produced by a data source callback), this function
+ *          should return 0 and the async loop falls back to the data source callback
+ * @param conn_id the id of connection object invokes this function
+ * @param iov the IO vector buffer
+ * @param iovcnt the size of the IO vector buffer
+ * @param caller the caller async object
+ * @return the number of IO vectors that has been filled, or error code
+ **/
+typedef int (*module_tcp_async_write_gather_func_t)(uint32_t conn_id, struct iovec* iov, int iovcnt, module_tcp_async_loop_t* caller);
+
+/**
+ * @brief the callback function that marks the data previously exposed by the gather callback as written
+ * @param conn_id the id of connection object invokes this function
+ * @param nbytes the number of bytes has been written
+ * @param caller the caller async object
+ * @return status code
+ **/
+typedef int (*module_tcp_async_write_consume_func_t)(uint32_t conn_id, size_t nbytes, module_tcp_async_loop_t* caller);
+
+/**
+ * @brief the callback function that exposes the head of the pending data as a region of a regular file
+ * @details this is the optional zero-copy version of the data source callback. Once all the data buffered
+ *          before the region has been written, the async loop sends the region with sendfile and reports the
+ *          number of bytes has been sent with the consume callback
+ * @param conn_id the id of connection object invokes this function
+ * @param region the buffer used to return the file region
+ * @param caller the caller async object
+ * @return 1 if the file region has been returned, 0 if the head of pending data is not a file region, or error code
+ **/
+typedef int (*module_tcp_async_write_file_func_t)(uint32_t conn_id, itc_module_data_source_region_t* region, module_tcp_async_loop_t* caller);
+
 /**
  * @brief the callback function to dispose an asnyc write handle
  * @param conn_id the id of connection object invokes this function
@@ -95,6 +136,9 @@ int module_tcp_async_loop_free(module_tcp_async_loop_t* loop);
  * @param fd the underlying socket fd
  * @param buf_size the async write buffer size
  * @param get_data the callback function that feeds data
+ * @param gather   the callback function that exposes the pending data as IO vectors, NULL if the data can only be copied
+ * @param consume  the callback function that marks the gathered data as written, must be given if gather or file is given
+ * @param file     the callback function that exposes the pending data as a file region, NULL if the data can only be copied
  * @param cleanup  the callback function that do cleanup
  * @param onerror  the error handler
  * @param handle   the caller-defined handle for this async
@@ -103,6 +147,9 @@ int module_tcp_async_loop_free(module_tcp_async_loop_t* loop);
 int module_tcp_async_write_register(module_tcp_async_loop_t* loop,
                                     uint32_t conn_id, int fd, size_t buf_size,
                                     module_tcp_async_write_data_func_t get_data,
+                                    module_tcp_async_write_gather_func_t gather,
+                                    module_tcp_async_write_consume_func_t consume,
+                                    module_tcp_async_write_file_func_t file,
                                     module_tcp_async_write_empty_func_t empty,
                                     module_tcp_async_write_cleanup_func_t cleanup,
                                     module_tcp_async_write_error_func_t onerror,
@@ -36,6 +36,16 @@
  **/
 #define MODULE_TCP_POOL_RELEASE_MODE_WAIT_FOR_DATA 3
 
+/**
+ * @brief indicates we don't attach any steering program to the reuseport group, the kernel distributes
+ *        the connections by the hash of the 4-tuple
+ **/
+#define MODULE_TCP_POOL_STEER_NONE 0
+/**
+ * @brief indicates the connection is steered to the listener whose index in the reuseport group is
+ *        the CPU id that handles the packet modulo the number of the listeners
+ **/
+#define MODULE_TCP_POOL_STEER_CPU 1
 /**
  * @brief the TCP connection pool object
  **/
@@ -50,12 +60,17 @@ typedef struct {
 	time_t      min_timeout;/*!< the minimum time out vlaue */
 	int         tcp_backlog;/*!< the backlog value for the tcp connection */
 	int         reuseaddr;  /*!< indicates if we want to reuse the binding address */
+	int         reuseport;  /*!< indicates each forked pool listens to its own SO_REUSEPORT socket instead of sharing the master socket */
+	int         nodelay;    /*!< indicates if we want to disable the Nagle's algorithm on the accepted connections */
+	int         steer;      /*!< the steering program attached to the reuseport group, see MODULE_TCP_POOL_STEER_* */
+	const char* cpuset;     /*!< the list of CPUs the event loops are pinned to, e.g "0-3,8", NULL if we don't pin the event loop */
 	int         ipv6;       /*!< indicates we want to bind to a ipv6 address */
 	uint32_t    size;       /*!< the maximum number of connections the pool can hold*/
 	const char* bind_addr;  /*!< the bind address */
 	size_t      event_size; /*!< the size for the event array */
 	uint32_t    accept_retry_interval;  /*!< The most time we sleep if we can not accept the socket (This is useful when we used up the FD) */
 	int         (*dispose_data)(void*); /* the callback function used to dispose the unused data */
+	time_t      (*time)(time_t*);       /*!< the mocked time function (only for testing purpose, otherwise pass NULL) */
 } module_tcp_pool_configure_t;
 
 /**
@@ -77,7 +92,9 @@ module_tcp_pool_t* module_tcp_pool_new(void);
  * @brief Fork an existing TCP pool.
  * @details This will create another connection pool listening to the same TCP port.
  *          This is used when the event loop becomes a bottelneck, thus we want to
- *          use multiple event loop for the same socket FD
+ *          use multiple event loop for the same socket FD. <br/>
+ *          If the reuseport is enabled, each forked pool gets its own listening socket
+ *          in the same SO_REUSEPORT group instead of sharing the socket FD
  * @return the newly created connection pool object, or NULL on error
  **/
 module_tcp_pool_t* module_tcp_pool_fork(module_tcp_pool_t* pool);
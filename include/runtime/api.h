@@ -387,6 +387,35 @@ typedef struct {
 	int32_t   timeout; /*!< The time limit for the RLS token not gets ready */
 } runtime_api_scope_ready_event_t;
 
+/**
+ * @brief Describe a region of a regular file that contains all the remaining bytes of a RLS byte stream
+ * @details This is used to let the module transmit the stream content from the file to the socket
+ *          inside the kernel (for example, with sendfile) rather than copying it in the user-space
+ **/
+typedef struct {
+	int       fd;     /*!< The FD of the regular file */
+	uint64_t  offset; /*!< The offset of the first remaining byte in the file */
+	size_t    size;   /*!< The number of remaining bytes in the stream */
+} runtime_api_scope_file_region_t;
+
+/**
+ * @brief Describe a piece of memory that holds the next bytes of a RLS byte stream, and the ownership of the
+ *        memory is given to the stream consumer
+ * @details This is used to let the consumer link the memory to the pipe rather than copying the bytes
+ **/
+typedef struct {
+	void*        base;    /*!< The memory the free function takes */
+	const char*  data;    /*!< The first byte of the data in the memory */
+	size_t       size;    /*!< The number of bytes of the data */
+	/**
+	 * @brief Release the memory once the consumer is done with the data
+	 * @note The memory may outlive the stream handle, and this may be called by any thread
+	 * @param base The memory
+	 * @return status code
+	 **/
+	int (*free_func)(void* base);
+} runtime_api_scope_page_t;
+
 /**
  * @brief Represent an entity in the scope. It's actually a group of callback function for the opeartion
  *        that is supported by the scope entity and a memory address which represent the entity data
@@ -462,6 +491,29 @@ typedef struct {
 	 * @return status code
 	 **/
 	 int (*close_func)(void* handle);
+
+	/**
+	 * @brief Get the file region that holds all the remaining bytes of the stream
+	 * @details This is an optional callback. Once the caller gets the region, it takes over the transmission
+	 *          of the remaining bytes and the stream should be treated as consumed, which means the caller
+	 *          won't call the read_func anymore. The FD should stay valid until the close_func is called
+	 * @param handle The stream handle
+	 * @param region_buf The buffer used to return the file region
+	 * @return 1 if the region has been returned, 0 if the stream is not backed by a file region (for example
+	 *         the content is served from the memory) and error code for all the error cases
+	 **/
+	int (*file_region_func)(void* __restrict handle, runtime_api_scope_file_region_t* region_buf);
+
+	/**
+	 * @brief Give the memory that holds the next bytes of the stream to the caller
+	 * @details This is an optional callback. The stream skips the bytes that have been returned, and the caller
+	 *          owns the memory, which should be released with the free function in the page description
+	 * @param handle The stream handle
+	 * @param page_buf The buffer used to return the memory
+	 * @return 1 if the memory has been returned, 0 if the next bytes can not be given away (the caller should
+	 *         use the read_func then) and error code for all the error cases
+	 **/
+	int (*donate_func)(void* __restrict handle, runtime_api_scope_page_t* page_buf);
 } runtime_api_scope_entity_t;
 
 /**
@@ -85,4 +85,23 @@ int sched_daemon_read_control_sock(void);
  **/
 int sched_daemon_reload(const char* daemon_name, const sched_service_t* service);
 
+/**
+ * @brief Get the memory accounting report of the daemon
+ * @param daemon_name The name of the daemon
+ * @param delta If we want the delta report, otherwise the snapshot report
+ * @param result The buffer used to return the report string, the caller should free it
+ * @return status code
+ **/
+int sched_daemon_memory(const char* daemon_name, int delta, char** result);
+
+/**
+ * @brief Get the profiler histogram report of the daemon
+ * @details The report is the p50/p99/p999 table of each node, see sched_prof_report for the format. If the daemon
+ *          doesn't enable the profiler, only the column names are returned
+ * @param daemon_name The name of the daemon
+ * @param result The buffer used to return the report string, the caller should free it
+ * @return status code
+ **/
+int sched_daemon_profile(const char* daemon_name, char** result);
+
 #endif /* __SCHED_DAEMON_H__ */
@@ -5,10 +5,25 @@
  * @brief The plumber built-in profiler utilies
  * @note the profiler utilities will be controlled by the
  *       variable scheduler.prof.enabled = 0 / 1
+ * @details Besides the total time and execution count, the profiler tracks the wall time, the CPU time of the
+ *          executing thread and the time the task has been waiting in the ready queue for each node with
+ *          log-linear histograms. Each thread owns its histograms, so recording a sample doesn't need any
+ *          lock. When profiler.histogram is set, the histograms of all the threads are merged periodically
+ *          and the p50/p99/p999 of each node is written to the file. The same table can be read at any time
+ *          with sched_prof_report, which is how a running daemon exposes it through the control socket
  * @file sched/prof.h
  **/
 #ifndef __PLUMBER_SCHED_PROF_H__
 #define __PLUMBER_SCHED_PROF_H__
+
+/**
+ * @brief the number of buckets in a profiler histogram
+ * @details the values less than 2^SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS have a bucket for each value, and each of the power
+ *          of two ranges [2^k, 2^(k+1)) for k >= SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS is splitted into
+ *          2^SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS buckets. The values no less than 2^SCHED_PROF_HISTOGRAM_MAX_BITS
+ *          fall into the last bucket
+ **/
+#define SCHED_PROF_HIST_NUM_BUCKETS ((SCHED_PROF_HISTOGRAM_MAX_BITS - SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS + 1) << SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS)
 /**
  * @brief the data structure used in the profiler file
  **/
@@ -54,13 +69,21 @@ int sched_prof_new(const sched_service_t* service, sched_prof_t** result);
 int sched_prof_free(sched_prof_t* prof);
 
 
+/**
+ * @brief get the timestamp used by the profiler
+ * @note this is the monotonic time in nanoseconds, which is used to mark the time when a task gets ready
+ * @return the timestamp, 0 on error
+ **/
+uint64_t sched_prof_timestamp(void);
+
 /**
  * @brief start the timer for the node
  * @param prof the profiler
  * @param node current node
+ * @param ready_ts the timestamp when the task gets ready, see sched_prof_timestamp. 0 if it's unknown
  * @return status code
  **/
-int sched_prof_start_timer(sched_prof_t* prof, sched_service_node_id_t node);
+int sched_prof_start_timer(sched_prof_t* prof, sched_service_node_id_t node, uint64_t ready_ts);
 
 /**
  * @brief stop the timer for the node
@@ -71,9 +94,42 @@ int sched_prof_stop_timer(sched_prof_t* prof);
 
 /**
  * @brief flush the profiling data and reset the accumulator for current thread
+ * @note  the histograms are not reset, and they will be exported to the histogram file if it's time to do so
  * @param prof the profiler
  * @return status code
  **/
 int sched_prof_flush(sched_prof_t* prof);
 
+/**
+ * @brief get the p50/p99/p999 table of the most recently created profiler which is not disposed yet
+ * @details the report is in the same format as the histogram file: a TSV table, the first line is the column names
+ *          which starts with '#', and then a line for each node. If there's no profiler, only the column names
+ *          are returned
+ * @return the report string, the caller should free it. NULL on error
+ **/
+char* sched_prof_report(void);
+
+/**
+ * @brief get the index of the histogram bucket the value falls into
+ * @param value the value in ns
+ * @return the bucket index
+ **/
+uint32_t sched_prof_hist_bucket(uint64_t value);
+
+/**
+ * @brief get the largest value that falls into the histogram bucket
+ * @param bucket the bucket index
+ * @return the value
+ **/
+uint64_t sched_prof_hist_bucket_value(uint32_t bucket);
+
+/**
+ * @brief get the percentile from the histogram
+ * @param count the sample counters of the buckets, which has SCHED_PROF_HIST_NUM_BUCKETS elements
+ * @param total the total number of samples in the histogram
+ * @param permille the percentile in 1/1000
+ * @return the largest value of the bucket where the percentile falls into, 0 if there's no sample
+ **/
+uint64_t sched_prof_hist_percentile(const uint64_t* count, uint64_t total, uint32_t permille);
+
 #endif /* __PLUMBER_SCHED_PROF_H__ */
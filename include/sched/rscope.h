@@ -68,6 +68,17 @@ sched_rscope_t* sched_rscope_new(void);
  **/
 int sched_rscope_free(sched_rscope_t* scope);
 
+/**
+ * @brief allocate memory from the request arena of the scope
+ * @details The request arena is a group of pages owned by the request scope, the memory is bump allocated
+ *          from the pages and there's no way to free a single allocation. All the memory will be released
+ *          at once when the scope is disposed (or when the last stream opened from the scope gets closed)
+ * @param scope the request scope
+ * @param size the number of bytes to allocate
+ * @return the allocated memory, NULL on error
+ **/
+void* sched_rscope_arena_alloc(sched_rscope_t* scope, size_t size);
+
 /**
  * @brief add a new pointer to the request scope
  * @param scope the request scope
@@ -137,4 +148,22 @@ size_t sched_rscope_stream_read(sched_rscope_stream_t* stream, void* buffer, siz
  * @return The number of events has been returned, or error code
  **/
 int sched_rscope_stream_get_event(sched_rscope_stream_t* stream, runtime_api_scope_ready_event_t* buf);
+
+/**
+ * @brief Get the file region that holds the remaining bytes of the stream
+ * @note Once the region is returned, the stream should not be read anymore
+ * @param stream The stream object
+ * @param buf The buffer used to return the file region
+ * @return 1 if the region has been returned, 0 if the stream is not backed by a file, or error code
+ **/
+int sched_rscope_stream_get_file_region(sched_rscope_stream_t* stream, runtime_api_scope_file_region_t* buf);
+
+/**
+ * @brief Take the memory that holds the next bytes of the stream
+ * @note Once the memory is returned, the stream skips those bytes and the caller owns the memory
+ * @param stream The stream object
+ * @param buf The buffer used to return the memory
+ * @return 1 if the memory has been returned, 0 if the next bytes can not be given away, or error code
+ **/
+int sched_rscope_stream_donate(sched_rscope_stream_t* stream, runtime_api_scope_page_t* buf);
 #endif /* __SCHED_RSCOPE_H__ */
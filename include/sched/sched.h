@@ -11,6 +11,7 @@
 #define __PLUMBER_SCHED_H__
 #include <sched/service.h>
 #include <sched/rscope.h>
+#include <sched/trace.h>
 #include <sched/task.h>
 #include <sched/step.h>
 #include <sched/loop.h>
@@ -39,6 +39,15 @@ typedef struct {
 	runtime_api_pipe_id_t destination_pipe_desc; /*!< the pipe descriptor for the output end*/
 } sched_service_pipe_descriptor_t;
 
+/**
+ * @brief the precompiled wiring of an outgoing pipe, which is everything we need to allocate the pipe
+ * @note  this is built after the type checker finishes, because the header size is only known at that time
+ **/
+typedef struct {
+	sched_service_pipe_descriptor_t desc;   /*!< the pipe descriptor */
+	itc_module_pipe_param_t         param;  /*!< the param used to allocate the pipe */
+} sched_service_pipe_wiring_t;
+
 /**
  * @brief convert a service to a pipe descriptor, which means treat the entire service as a pipe
  *        which is a input node, input pipe end; a output node, a output pipe end
@@ -148,6 +157,18 @@ const sched_service_pipe_descriptor_t* sched_service_get_incoming_pipes(const sc
  **/
 const sched_service_pipe_descriptor_t* sched_service_get_outgoing_pipes(const sched_service_t* service, sched_service_node_id_t nid, uint32_t* nresult);
 
+/**
+ * @brief get the precompiled wiring table of all outgoing pipes
+ * @details the wiring table is in the same order as the list returned by sched_service_get_outgoing_pipes,
+ *          and it carries the pipe flags and the header sizes, so that the scheduler can allocate the
+ *          pipes without querying the service
+ * @param service the target service
+ * @param nid the node id
+ * @param nresult the buffer that used to return how many pipe is returned
+ * @return the pointer to the head of the table, NULL if error happens
+ **/
+const sched_service_pipe_wiring_t* sched_service_get_outgoing_wiring(const sched_service_t* service, sched_service_node_id_t nid, uint32_t* nresult);
+
 /**
  * @brief set the input pipe of this service buffer
  * @param buffer the target service buffer
@@ -217,9 +238,10 @@ const sched_cnode_info_t* sched_service_get_cnode_info(const sched_service_t* se
  * @brief get the profiler for this service
  * @param service the target service
  * @param node the node to start profiler
+ * @param ready_ts the timestamp when the task gets ready, 0 if it's unknown
  * @return status code
  **/
-int sched_service_profiler_timer_start(const sched_service_t* service, sched_service_node_id_t node);
+int sched_service_profiler_timer_start(const sched_service_t* service, sched_service_node_id_t node, uint64_t ready_ts);
 
 /**
  * @brief stop the profiler timer
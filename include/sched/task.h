@@ -42,8 +42,12 @@ struct _sched_task_t {
 	sched_rscope_t*          scope;   /*!< the request local scope for this task */
 	sched_service_node_id_t  node;    /*!< the node id for this task */
 	sched_task_request_t     request; /*!< the request id for this task */
+	sched_trace_id_t         trace_id; /*!< the trace id of the request, 0 if the request is not traced */
 	runtime_task_t*          exec_task; /*!< the actual runtime task, for an async task, this is the async init task<br/>
 	                                     *   And we are able to get related task based on this */
+#ifdef ENABLE_PROFILER
+	uint64_t                 ready_ts; /*!< the timestamp when the task goes into the ready queue, see sched_prof_timestamp */
+#endif
 };
 
 /**
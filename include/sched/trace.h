@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+
+/**
+ * @brief The request level tracer
+ * @details The tracer samples one request out of every tracer.sample_rate requests and assigns a trace id to it.
+ *          Then all the servlet executions, async task stages, pipe allocations/deallocations and the module writes
+ *          performed on behalf of the sampled request are recorded as spans. Each thread records the spans to its own
+ *          ring buffer, so recording doesn't need any lock. When the tracer is finalized, all the spans are dumped to
+ *          the file specified by tracer.output in Chrome trace-event JSON format, in which each traced request is shown
+ *          as a process. <br/>
+ *          For the request that is not sampled, the trace id is 0 and the only overhead is testing the trace id
+ * @file sched/trace.h
+ **/
+#ifndef __PLUMBER_SCHED_TRACE_H__
+#define __PLUMBER_SCHED_TRACE_H__
+
+/**
+ * @brief the trace id, 0 means the request is not traced
+ **/
+typedef uint64_t sched_trace_id_t;
+
+/**
+ * @brief the type of a span
+ **/
+typedef enum {
+	SCHED_TRACE_SPAN_REQUEST,          /*!< the entire life cycle of the request, the argument is the request id */
+	SCHED_TRACE_SPAN_EXEC,             /*!< the servlet exec call, the argument is the node id */
+	SCHED_TRACE_SPAN_ASYNC_SETUP,      /*!< the async servlet async_setup call, the argument is the node id */
+	SCHED_TRACE_SPAN_ASYNC_EXEC,       /*!< the async servlet async_exec call, the argument is the node id */
+	SCHED_TRACE_SPAN_ASYNC_CLEANUP,    /*!< the async servlet async_cleanup call, the argument is the node id */
+	SCHED_TRACE_SPAN_PIPE_ALLOCATE,    /*!< the pipe allocation, the argument is the module type code */
+	SCHED_TRACE_SPAN_PIPE_DEALLOCATE,  /*!< the pipe deallocation, the argument is the module type code */
+	SCHED_TRACE_SPAN_MODULE_WRITE,     /*!< the module completes the write in the background, the argument is module specified */
+	SCHED_TRACE_SPAN_COUNT             /*!< the number of span types */
+} sched_trace_span_t;
+
+/**
+ * @brief initialize the tracer
+ * @return status code
+ **/
+int sched_trace_init(void);
+
+/**
+ * @brief finalize the tracer and dump the recorded spans to the output file
+ * @return status code
+ **/
+int sched_trace_finalize(void);
+
+/**
+ * @brief decide if the new request should be traced
+ * @return the trace id for the new request, 0 if the request is not sampled
+ **/
+sched_trace_id_t sched_trace_sample(void);
+
+/**
+ * @brief get the timestamp used by the tracer
+ * @return the monotonic time in nanoseconds
+ **/
+uint64_t sched_trace_timestamp(void);
+
+/**
+ * @brief record a span which starts at the given time and ends now to the ring buffer of current thread
+ * @param id the trace id, must not be 0
+ * @param type the type of the span
+ * @param arg the argument of the span, see sched_trace_span_t for details
+ * @param begin the timestamp when the span begins
+ * @return status code
+ **/
+int sched_trace_record(sched_trace_id_t id, sched_trace_span_t type, uint64_t arg, uint64_t begin);
+
+/**
+ * @brief set the trace id of the request current thread is working on
+ * @param id the trace id, 0 if current thread isn't working on a traced request
+ * @return nothing
+ **/
+void sched_trace_set_current(sched_trace_id_t id);
+
+/**
+ * @brief get the trace id of the request current thread is working on
+ * @return the trace id, 0 if the request is not traced
+ **/
+sched_trace_id_t sched_trace_current(void);
+
+/**
+ * @brief begin a span
+ * @param id the trace id
+ * @return the begin timestamp, 0 if the request is not traced
+ **/
+static inline uint64_t sched_trace_begin(sched_trace_id_t id)
+{
+	return id == 0 ? 0 : sched_trace_timestamp();
+}
+
+/**
+ * @brief end a span and record it if the request is traced
+ * @param id the trace id
+ * @param type the type of the span
+ * @param arg the argument of the span
+ * @param begin the timestamp returned by sched_trace_begin
+ * @return nothing
+ **/
+static inline void sched_trace_end(sched_trace_id_t id, sched_trace_span_t type, uint64_t arg, uint64_t begin)
+{
+	if(id != 0) sched_trace_record(id, type, arg, begin);
+}
+
+#endif /* __PLUMBER_SCHED_TRACE_H__ */
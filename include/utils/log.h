@@ -23,6 +23,7 @@
 #define __LOG_H__
 
 #include <stdarg.h>
+#include <stdint.h>
 
 /** @brief initlaization
  *  @return nothing
@@ -42,6 +43,55 @@ int log_finalize(void);
  **/
 int log_redirect(int level, const char* dest, const char* mode);
 
+/**
+ * @brief the policy of the asynchronous logging
+ * @details In asynchronous mode, the log record is formatted into the ring buffer of the calling thread and a dedicated
+ *          flusher thread writes the records to the log files in batch. The policy determines what happens when the
+ *          ring buffer is full.
+ * @note the FATAL records are always written synchronously
+ **/
+typedef enum {
+	LOG_ASYNC_OFF,    /*!< the log is written synchronously */
+	LOG_ASYNC_DROP,   /*!< the record is dropped if the ring buffer is full */
+	LOG_ASYNC_BLOCK   /*!< the thread waits for the flusher if the ring buffer is full */
+} log_async_policy_t;
+
+/**
+ * @brief the counters of the asynchronous logging
+ **/
+typedef struct {
+	uint64_t written;   /*!< the number of records written by the flusher */
+	uint64_t dropped;   /*!< the number of records dropped because the ring buffer is full */
+	uint64_t blocked;   /*!< the number of times a thread waits for the flusher because the ring buffer is full */
+} log_async_stat_t;
+
+/**
+ * @brief set the asynchronous logging policy
+ * @note this can be also set with the "async <off|drop|block>" line in the log config file
+ * @param policy the policy
+ * @return status code
+ **/
+int log_set_async(log_async_policy_t policy);
+
+/**
+ * @brief get current asynchronous logging policy
+ * @return the policy
+ **/
+log_async_policy_t log_get_async(void);
+
+/**
+ * @brief get the counters of the asynchronous logging
+ * @param buf the result buffer
+ * @return status code
+ **/
+int log_async_stat(log_async_stat_t* buf);
+
+/**
+ * @brief wait until all the records queued before this call are written to the log files
+ * @return status code
+ **/
+int log_flush(void);
+
 /** @brief	the implementation of write a log
  *  @param	level	the log level
  *  @param	file	the file name of the source code
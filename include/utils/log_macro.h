@@ -10,6 +10,8 @@
 
 #ifndef __LOG_MACRO_H__
 #include <config.h>
+#include <stdint.h>
+#include <time.h>
 #define __LOG_MACRO_H__
 /** @brief log levels */
 enum{
@@ -38,6 +40,60 @@ enum{
 
 #define __LOG_ERRNO__(LEVEL, fmt, arg...) LOG_##LEVEL(fmt": %s", ##arg, strerror(errno))
 
+/**
+ * @brief the state of a rate limited log site, do not use it directly
+ * @note the high 32 bits of the state is the current second and the low 32 bits is the
+ *       number of messages we have written in this second
+ **/
+typedef struct {
+	volatile uint64_t state;       /*!< the current second and the message counter */
+	volatile uint32_t suppressed;  /*!< the number of messages suppressed since the last message we have written */
+} __log_rate_t;
+
+/**
+ * @brief check if the rate limited log site can write the message now, do not use it directly
+ * @param site the state of the log site
+ * @param limit the max number of messages per second
+ * @param suppressed the buffer used to return how many messages has been suppressed before this one
+ * @return if we should write the message
+ **/
+static inline int __log_rate_check(__log_rate_t* site, uint32_t limit, uint32_t* suppressed)
+{
+	uint64_t now = (uint64_t)(uint32_t)time(NULL);
+	uint64_t old, next;
+	*suppressed = 0;
+	do {
+		old = site->state;
+		if((old >> 32) != now) next = (now << 32) | 1;
+		else if((uint32_t)old < limit) next = old + 1;
+		else
+		{
+			__sync_fetch_and_add(&site->suppressed, 1);
+			return 0;
+		}
+	} while(!__sync_bool_compare_and_swap(&site->state, old, next));
+
+	if(site->suppressed > 0)
+		*suppressed = __sync_lock_test_and_set(&site->suppressed, 0);
+
+	return 1;
+}
+
+/** @brief helper macros for write a rate limited log, do not use it directly */
+#define __LOG_RATE__(level, limit, fmt, arg...) do {\
+	static __log_rate_t __log_rate_site__;\
+	uint32_t __log_rate_suppressed__;\
+	if(__log_rate_check(&__log_rate_site__, (uint32_t)(limit), &__log_rate_suppressed__))\
+	{\
+		if(__log_rate_suppressed__ > 0)\
+		    __LOG__(level, fmt" (%u similar messages suppressed)", ##arg, __log_rate_suppressed__);\
+		else\
+		    __LOG__(level, fmt, ##arg);\
+	}\
+}while(0)
+
+#define __LOG_RATE_ERRNO__(LEVEL, limit, fmt, arg...) LOG_##LEVEL##_RATE(limit, fmt": %s", ##arg, strerror(errno))
+
 #ifndef LOG_LEVEL
 #   define LOG_LEVEL 6
 #endif
@@ -70,9 +126,18 @@ enum{
 *  @return nothing
 */
 #	define LOG_ERROR(fmt,arg...) __LOG__(ERROR,fmt,##arg)
+/** @brief print a error log at most limit times per second at this call site, the number of the
+*          suppressed messages is appended to the next message
+*  @param limit the max number of messages per second
+*  @param fmt	formating string
+*  @param arg arguments
+*  @return nothing
+*/
+#	define LOG_ERROR_RATE(limit,fmt,arg...) __LOG_RATE__(ERROR,limit,fmt,##arg)
 #	define LOG_ERROR_ENABLED
 #else
 #	define LOG_ERROR(...) __LOG_NOP__
+#	define LOG_ERROR_RATE(...) __LOG_NOP__
 #endif
 /**
  * @brief print an errno message in error level
@@ -82,6 +147,15 @@ enum{
  **/
 #define LOG_ERROR_ERRNO(fmt, arg...) __LOG_ERRNO__(ERROR, fmt, ##arg)
 
+/**
+ * @brief print an errno message in error level at most limit times per second at this call site
+ * @param limit the max number of messages per second
+ * @param fmt the formating string
+ * @param arg the arguments
+ * @return nothing
+ **/
+#define LOG_ERROR_RATE_ERRNO(limit, fmt, arg...) __LOG_RATE_ERRNO__(ERROR, limit, fmt, ##arg)
+
 #if LOG_LEVEL >= 2
 /** @brief print a warning log
 *  @param fmt	formating string
@@ -89,9 +163,18 @@ enum{
 *  @return nothing
 */
 #	define LOG_WARNING(fmt,arg...) __LOG__(WARNING,fmt,##arg)
+/** @brief print a warning log at most limit times per second at this call site, the number of the
+*          suppressed messages is appended to the next message
+*  @param limit the max number of messages per second
+*  @param fmt	formating string
+*  @param arg arguments
+*  @return nothing
+*/
+#	define LOG_WARNING_RATE(limit,fmt,arg...) __LOG_RATE__(WARNING,limit,fmt,##arg)
 #	define LOG_WARNING_ENABLED
 #else
 #	define LOG_WARNING(...) __LOG_NOP__
+#	define LOG_WARNING_RATE(...) __LOG_NOP__
 #endif
 
 /**
@@ -102,6 +185,15 @@ enum{
  **/
 #define LOG_WARNING_ERRNO(fmt, arg...) __LOG_ERRNO__(WARNING, fmt, ##arg)
 
+/**
+ * @brief print an errno message in warning level at most limit times per second at this call site
+ * @param limit the max number of messages per second
+ * @param fmt the formating string
+ * @param arg the arguments
+ * @return nothing
+ **/
+#define LOG_WARNING_RATE_ERRNO(limit, fmt, arg...) __LOG_RATE_ERRNO__(WARNING, limit, fmt, ##arg)
+
 #if LOG_LEVEL >= 3
 /** @brief print a notice log
 *  @param fmt	formating string
@@ -109,9 +201,18 @@ enum{
 *  @return nothing
 */
 #	define LOG_NOTICE(fmt,arg...) __LOG__(NOTICE,fmt,##arg)
+/** @brief print a notice log at most limit times per second at this call site, the number of the
+*          suppressed messages is appended to the next message
+*  @param limit the max number of messages per second
+*  @param fmt	formating string
+*  @param arg arguments
+*  @return nothing
+*/
+#	define LOG_NOTICE_RATE(limit,fmt,arg...) __LOG_RATE__(NOTICE,limit,fmt,##arg)
 #	define LOG_NOTICE_ENABLED
 #else
 #	define LOG_NOTICE(...) __LOG_NOP__
+#	define LOG_NOTICE_RATE(...) __LOG_NOP__
 #endif
 
 /**
@@ -122,6 +223,15 @@ enum{
  **/
 #define LOG_NOTICE_ERRNO(fmt, arg...) __LOG_ERRNO__(NOTICE, fmt, ##arg)
 
+/**
+ * @brief print an errno message in notice level at most limit times per second at this call site
+ * @param limit the max number of messages per second
+ * @param fmt the formating string
+ * @param arg the arguments
+ * @return nothing
+ **/
+#define LOG_NOTICE_RATE_ERRNO(limit, fmt, arg...) __LOG_RATE_ERRNO__(NOTICE, limit, fmt, ##arg)
+
 #if LOG_LEVEL >= 4
 /** @brief print a info log
 *  @param fmt	formating string
@@ -129,9 +239,18 @@ enum{
 *  @return nothing
 */
 #	define LOG_INFO(fmt,arg...) __LOG__(INFO,fmt,##arg)
+/** @brief print a info log at most limit times per second at this call site, the number of the
+*          suppressed messages is appended to the next message
+*  @param limit the max number of messages per second
+*  @param fmt	formating string
+*  @param arg arguments
+*  @return nothing
+*/
+#	define LOG_INFO_RATE(limit,fmt,arg...) __LOG_RATE__(INFO,limit,fmt,##arg)
 #	define LOG_INFO_ENABLED
 #else
 #	define LOG_INFO(...) __LOG_NOP__
+#	define LOG_INFO_RATE(...) __LOG_NOP__
 #endif
 
 /**
@@ -142,6 +261,15 @@ enum{
  **/
 #define LOG_INFO_ERRNO(fmt, arg...) __LOG_ERRNO__(INFO, fmt, ##arg)
 
+/**
+ * @brief print an errno message in info level at most limit times per second at this call site
+ * @param limit the max number of messages per second
+ * @param fmt the formating string
+ * @param arg the arguments
+ * @return nothing
+ **/
+#define LOG_INFO_RATE_ERRNO(limit, fmt, arg...) __LOG_RATE_ERRNO__(INFO, limit, fmt, ##arg)
+
 #if LOG_LEVEL >= 5
 /** @brief print a trace log
 *  @param fmt	formating string
@@ -149,9 +277,18 @@ enum{
 *  @return nothing
 */
 #	define LOG_TRACE(fmt,arg...) __LOG__(TRACE,fmt,##arg)
+/** @brief print a trace log at most limit times per second at this call site, the number of the
+*          suppressed messages is appended to the next message
+*  @param limit the max number of messages per second
+*  @param fmt	formating string
+*  @param arg arguments
+*  @return nothing
+*/
+#	define LOG_TRACE_RATE(limit,fmt,arg...) __LOG_RATE__(TRACE,limit,fmt,##arg)
 #	define LOG_TRACE_ENABLED
 #else
 #	define LOG_TRACE(...) __LOG_NOP__
+#	define LOG_TRACE_RATE(...) __LOG_NOP__
 #endif
 
 /**
@@ -162,6 +299,15 @@ enum{
  **/
 #define LOG_TRACE_ERRNO(fmt, arg...) __LOG_ERRNO__(TRACE, fmt, ##arg)
 
+/**
+ * @brief print an errno message in trace level at most limit times per second at this call site
+ * @param limit the max number of messages per second
+ * @param fmt the formating string
+ * @param arg the arguments
+ * @return nothing
+ **/
+#define LOG_TRACE_RATE_ERRNO(limit, fmt, arg...) __LOG_RATE_ERRNO__(TRACE, limit, fmt, ##arg)
+
 #if LOG_LEVEL >= 6
 /** @brief print a debug log
 *  @param fmt	formating string
@@ -169,9 +315,18 @@ enum{
 *  @return nothing
 */
 #	define LOG_DEBUG(fmt,arg...) __LOG__(DEBUG,fmt,##arg)
+/** @brief print a debug log at most limit times per second at this call site, the number of the
+*          suppressed messages is appended to the next message
+*  @param limit the max number of messages per second
+*  @param fmt	formating string
+*  @param arg arguments
+*  @return nothing
+*/
+#	define LOG_DEBUG_RATE(limit,fmt,arg...) __LOG_RATE__(DEBUG,limit,fmt,##arg)
 #	define LOG_DEBUG_ENABLED
 #else
 #	define LOG_DEBUG(...) __LOG_NOP__
+#	define LOG_DEBUG_RATE(...) __LOG_NOP__
 #endif
 
 /**
@@ -182,4 +337,13 @@ enum{
  **/
 #define LOG_DEBUG_ERRNO(fmt, arg...) __LOG_ERRNO__(DEBUG, fmt, ##arg)
 
+/**
+ * @brief print an errno message in debug level at most limit times per second at this call site
+ * @param limit the max number of messages per second
+ * @param fmt the formating string
+ * @param arg the arguments
+ * @return nothing
+ **/
+#define LOG_DEBUG_RATE_ERRNO(limit, fmt, arg...) __LOG_RATE_ERRNO__(DEBUG, limit, fmt, ##arg)
+
 #endif /*__LOG_MACRO_H__*/
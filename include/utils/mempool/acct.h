@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+
+/**
+ * @brief The memory accounting registry
+ * @details Each memory pool registers an accounting entry with an unique name, and the registry is able to produce
+ *          a report of all the pools, so that we know which subsystem holds the memory. <br/>
+ *          There are two kinds of entries: <br/>
+ *          1. The query entry, which calls the query function of the pool when the statistics is needed. This is used
+ *             by the pools which already have their own counters, so that the allocation path doesn't pay anything. <br/>
+ *          2. The counter entry, which is owned by the registry and updated by the pool with mempool_acct_update.
+ *             Since the counter outlives the pool, it's also safe to use from the code that can be unloaded,
+ *             for example, a servlet library. <br/>
+ *          The registry also keeps the snapshot of the previous delta report, so that the delta report shows how
+ *          much each pool changed and the allocation and deallocation rates since then.
+ * @file mempool/acct.h
+ * @note all the functions are thread-safe
+ **/
+#ifndef __PLUMBER_UTILS_MEMPOOL_ACCT_H__
+#define __PLUMBER_UTILS_MEMPOOL_ACCT_H__
+
+/**
+ * @brief the incomplete type for an accounting entry
+ **/
+typedef struct _mempool_acct_t mempool_acct_t;
+
+/**
+ * @brief the memory statistics of a pool
+ **/
+typedef struct {
+	uint64_t   in_use;           /*!< the number of bytes currently used by the pool's clients */
+	uint64_t   cached;           /*!< the number of bytes the pool holds but not used by anyone */
+	uint64_t   high_watermark;   /*!< the max in_use ever seen, 0 if the pool doesn't track it */
+	uint64_t   allocs;           /*!< the number of allocations */
+	uint64_t   frees;            /*!< the number of deallocations */
+} mempool_acct_stat_t;
+
+/**
+ * @brief the query function of a query entry
+ * @param data the additional data passed to mempool_acct_register
+ * @param buf the buffer used to return the statistics
+ * @return status code
+ **/
+typedef int (*mempool_acct_query_func_t)(const void* data, mempool_acct_stat_t* buf);
+
+/**
+ * @brief initialize the accounting registry
+ * @return status code
+ **/
+int mempool_acct_init(void);
+
+/**
+ * @brief finalize the accounting registry, all the remaining entries will be disposed
+ * @return status code
+ **/
+int mempool_acct_finalize(void);
+
+/**
+ * @brief register a query entry
+ * @param name the name of the pool, which should be unique
+ * @param query the query function
+ * @param data the additional data passed to the query function
+ * @return the newly registered entry, NULL on error
+ **/
+mempool_acct_t* mempool_acct_register(const char* name, mempool_acct_query_func_t query, const void* data);
+
+/**
+ * @brief unregister a query entry
+ * @param acct the entry to unregister
+ * @return status code
+ **/
+int mempool_acct_unregister(mempool_acct_t* acct);
+
+/**
+ * @brief get the counter entry with the given name, if the entry doesn't exist, create a new one
+ * @note the counter entry is never disposed until the registry is finalized
+ * @param name the name of the pool
+ * @return the counter entry, NULL on error
+ **/
+mempool_acct_t* mempool_acct_counter(const char* name);
+
+/**
+ * @brief update a counter entry
+ * @param acct the counter entry
+ * @param bytes the number of bytes allocated, negative value for deallocation
+ * @return status code
+ **/
+int mempool_acct_update(mempool_acct_t* acct, int64_t bytes);
+
+/**
+ * @brief get the statistics of the pool with the given name
+ * @param name the name of the pool
+ * @param buf the result buffer
+ * @return 1 if the pool is found, 0 if not found, or error code
+ **/
+int mempool_acct_query(const char* name, mempool_acct_stat_t* buf);
+
+/**
+ * @brief produce the report of all the registered pools
+ * @details In snapshot mode, each line is "<name> <in-use> <cached> <high-watermark> <allocs> <frees>". <br/>
+ *          In delta mode, each line is "<name> <in-use-change> <cached-change> <high-watermark> <alloc-rate> <free-rate>"
+ *          where the changes and rates are measured since the previous delta report.
+ * @param delta if we want the delta report
+ * @return the report string which should be freed by the caller, NULL on error
+ **/
+char* mempool_acct_report(int delta);
+
+#endif /* __PLUMBER_UTILS_MEMPOOL_ACCT_H__ */
@@ -0,0 +1,143 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+
+/**
+ * @brief The lock-free depot used by the memory pools to exchange the free memory between threads
+ * @details The depot is a Treiber stack. The head pointer is packed with a modification tag in a single 64 bit word, and
+ *          the tag is bumped by every successful push and pop. So a thread that has read a head which is popped and
+ *          pushed back by other threads in the middle (the ABA problem) will fail the CAS, rather than installing a
+ *          stale next pointer. <br/>
+ *          The node type is opaque to the depot: the caller gives the byte offset of the pointer field inside the node
+ *          that the depot can use as the link. A node which is pushed to the depot may be the head of a longer list the
+ *          caller maintains through other fields, so the depot can carry a whole batch of objects with one CAS.
+ * @note    On 64 bit platforms we only have 16 bits for the tag, since we assume the user space address is at most 48
+ *          bits wide, which is true for all the x86_64 and aarch64 Linux configurations we support. The tag wraps around
+ *          after 65536 operations, and a thread would have to be preempted for exactly a multiple of that between its
+ *          load and its CAS to get confused.
+ * @note    The memory of a node must remain readable even after it has been popped by another thread, because a
+ *          concurrent pop may still read its link field before it finds out the CAS is going to fail. A caller which
+ *          returns the popped nodes to the system allocator must serialize the pops with a lock.
+ * @file mempool/depot.h
+ **/
+#ifndef __PLUMBER_UTILS_MEMPOOL_DEPOT_H__
+#define __PLUMBER_UTILS_MEMPOOL_DEPOT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief a lock-free depot
+ * @note the zero initialized depot is an empty depot
+ **/
+typedef struct {
+	volatile uint64_t  head;   /*!< the tagged head pointer */
+} mempool_depot_t;
+
+#if UINTPTR_MAX > 0xfffffffful
+#	define __MEMPOOL_DEPOT_TAG_SHIFT 48
+#else
+#	define __MEMPOOL_DEPOT_TAG_SHIFT 32
+#endif
+
+/**
+ * @brief get the pointer part of a tagged head
+ * @param head the tagged head
+ * @return the pointer
+ **/
+static inline void* __mempool_depot_ptr(uint64_t head)
+{
+	return (void*)(uintptr_t)(head & ((1ull << __MEMPOOL_DEPOT_TAG_SHIFT) - 1));
+}
+
+/**
+ * @brief make a new tagged head which points to the given node, and has a tag different from the previous head
+ * @param ptr the new head node
+ * @param prev the previous tagged head
+ * @return the new tagged head
+ **/
+static inline uint64_t __mempool_depot_next_head(void* ptr, uint64_t prev)
+{
+	uint64_t tag = (prev >> __MEMPOOL_DEPOT_TAG_SHIFT) + 1;
+	return (uint64_t)(uintptr_t)ptr | (tag << __MEMPOOL_DEPOT_TAG_SHIFT);
+}
+
+/**
+ * @brief get the address of the link field of the node
+ * @param node the node
+ * @param link_offset the offset of the link field
+ * @return the address of the link field
+ **/
+static inline void* volatile* __mempool_depot_link(void* node, size_t link_offset)
+{
+	return (void* volatile*)(((char*)node) + link_offset);
+}
+
+/**
+ * @brief initialize a depot
+ * @param depot the depot to initialize
+ * @return nothing
+ **/
+static inline void mempool_depot_init(mempool_depot_t* depot)
+{
+	depot->head = 0;
+}
+
+/**
+ * @brief push a list of nodes to the depot
+ * @param depot the target depot
+ * @param first the first node of the list
+ * @param last the last node of the list, the nodes between first and last must be already linked with the link field
+ * @param link_offset the offset of the link field inside the node
+ * @return nothing
+ **/
+static inline void mempool_depot_push(mempool_depot_t* depot, void* first, void* last, size_t link_offset)
+{
+	void* volatile* link = __mempool_depot_link(last, link_offset);
+	for(;;)
+	{
+		uint64_t old_head = depot->head;
+		*link = __mempool_depot_ptr(old_head);
+		if(__sync_bool_compare_and_swap(&depot->head, old_head, __mempool_depot_next_head(first, old_head)))
+			return;
+	}
+}
+
+/**
+ * @brief pop one node from the depot
+ * @param depot the source depot
+ * @param link_offset the offset of the link field inside the node
+ * @return the popped node, NULL if the depot is empty
+ **/
+static inline void* mempool_depot_pop(mempool_depot_t* depot, size_t link_offset)
+{
+	for(;;)
+	{
+		uint64_t old_head = depot->head;
+		void* node = __mempool_depot_ptr(old_head);
+		if(NULL == node) return NULL;
+
+		void* next = *__mempool_depot_link(node, link_offset);
+
+		if(__sync_bool_compare_and_swap(&depot->head, old_head, __mempool_depot_next_head(next, old_head)))
+			return node;
+	}
+}
+
+/**
+ * @brief take all the nodes from the depot at once
+ * @note this is used when the owner of the depot is disposing it
+ * @param depot the depot
+ * @return the first node of the list linked with the link field
+ **/
+static inline void* mempool_depot_take_all(mempool_depot_t* depot)
+{
+	for(;;)
+	{
+		uint64_t old_head = depot->head;
+		if(__sync_bool_compare_and_swap(&depot->head, old_head, __mempool_depot_next_head(NULL, old_head)))
+			return __mempool_depot_ptr(old_head);
+	}
+}
+
+#endif /* __PLUMBER_UTILS_MEMPOOL_DEPOT_H__ */
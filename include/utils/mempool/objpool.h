@@ -11,6 +11,8 @@
 #ifndef __PLUMBER_UTILS_MEMPOOL_OBJECT_H__
 #define __PLUMBER_UTILS_MEMPOOL_OBJECT_H__
 
+#include <utils/mempool/acct.h>
+
 /**
  * @brief The thread local pool policy
  * @note This is the description of the behavior of the thread local object memory pool,
@@ -121,4 +123,13 @@ uint32_t mempool_objpool_get_page_count(const mempool_objpool_t* pool);
  * @return status code
  **/
 int mempool_objpool_set_thread_policy(mempool_objpool_t* pool, unsigned thread_mask, mempool_objpool_tlp_policy_t policy);
+
+/**
+ * @brief the accounting query function for all the object pools
+ * @note the objects cached by the thread local pools are counted as cached memory
+ * @param data not used
+ * @param buf the result buffer
+ * @return status code
+ **/
+int mempool_objpool_acct_query(const void* data, mempool_acct_stat_t* buf);
 #endif /* __PLUMBER_UTILS_MEMPOOL_BLOCK_H__ */
@@ -9,6 +9,23 @@
 #ifndef __PLUMBER_UTILS_MEMPOOL_PAGE_H__
 #define __PLUMBER_UTILS_MEMPOOL_PAGE_H__
 
+#include <utils/mempool/acct.h>
+
+/**
+ * @brief the backing memory of the newly allocated pages
+ * @details For the huge page backings, the pages are carved from the chunks of UTILS_MEMPOOL_PAGE_CHUNK_SIZE bytes inside
+ *          a virtual memory region which is reserved when the backing is selected for the first time. Each chunk is
+ *          assigned to the NUMA node of the thread which carves it, and the free pages of a chunk are only cached by
+ *          the threads on the same node. <br/>
+ *          The pages of a chunk are never returned to the operating system, so the free page limit doesn't apply.
+ *          Once the region is used up, the allocator falls back to the system pages.
+ **/
+typedef enum {
+	MEMPOOL_PAGE_BACKING_SYSTEM,   /*!< the pages are allocated from the system allocator one by one */
+	MEMPOOL_PAGE_BACKING_THP,      /*!< the pages are carved from the chunks that are advised to use transparent huge pages */
+	MEMPOOL_PAGE_BACKING_HUGETLB   /*!< the pages are carved from the chunks mapped from hugetlbfs, uses THP when failed */
+} mempool_page_backing_t;
+
 /**
  * @brief initialize the page allocator
  * @return the status code
@@ -40,6 +57,30 @@ int mempool_page_dealloc(void* page);
  **/
 int mempool_page_set_free_page_limit(size_t npages);
 
+/**
+ * @brief change the backing memory of the pages allocated afterwards
+ * @note the pages which are already allocated are not affected
+ * @param backing the new backing
+ * @return status code
+ **/
+int mempool_page_set_backing(mempool_page_backing_t backing);
+
+/**
+ * @brief get current backing memory of the page allocator
+ * @return the backing
+ **/
+mempool_page_backing_t mempool_page_get_backing(void);
+
+/**
+ * @brief the accounting query function for the page allocator
+ * @note the pages cached by the thread local pools, the global free list and the unused pages of the huge page
+ *       chunks are counted as cached memory
+ * @param data not used
+ * @param buf the result buffer
+ * @return status code
+ **/
+int mempool_page_acct_query(const void* data, mempool_acct_stat_t* buf);
+
 /**
  * @brief disable the memory pool
  **/
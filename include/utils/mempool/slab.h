@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+
+/**
+ * @brief The size-class slab allocator for variable sized memory chunks
+ * @details The requested size is rounded up to a size class, and each size class is backed by a fix-sized object
+ *          pool, so the per-thread object cache of the object pool is used as the magazine of the size class, and
+ *          the global pool mutex is only touched when the thread cache is empty or full. <br/>
+ *          The size classes are spaced in the same way as jemalloc: 8, 16, then a multiple of 16 up to 128, then
+ *          four classes between each power of 2. So the internal fragmentation is at most 25% for any size. <br/>
+ *          The chunks which are too large to fit two of them in one page are allocated from the system allocator
+ *          directly.
+ * @file mempool/slab.h
+ * @note all the functions are thread-safe
+ **/
+
+#ifndef __PLUMBER_UTILS_MEMPOOL_SLAB_H__
+#define __PLUMBER_UTILS_MEMPOOL_SLAB_H__
+
+/**
+ * @brief the incomplete type for a slab allocator
+ **/
+typedef struct _mempool_slab_t mempool_slab_t;
+
+/**
+ * @brief the occupancy statistics of a size class
+ **/
+typedef struct {
+	uint32_t   size;        /*!< the size of the chunk in this size class, 0 for the system allocated chunks */
+	uint32_t   obj_size;    /*!< the actual memory the chunk occupies, including the chunk header and the padding */
+	uint32_t   pages;       /*!< the number of pages the size class holds */
+	uint64_t   in_use;      /*!< the number of chunks currently in use */
+	uint64_t   total;       /*!< the total number of chunks has been allocated from the size class */
+} mempool_slab_class_stat_t;
+
+/**
+ * @brief create a new slab allocator
+ * @return the newly created allocator, NULL on error
+ **/
+mempool_slab_t* mempool_slab_new(void);
+
+/**
+ * @brief dispose a used slab allocator
+ * @param slab the slab allocator
+ * @return status code
+ **/
+int mempool_slab_free(mempool_slab_t* slab);
+
+/**
+ * @brief allocate a memory chunk from the slab allocator
+ * @param slab the slab allocator
+ * @param size the size of the chunk
+ * @return the allocated memory, NULL on error
+ **/
+void* mempool_slab_alloc(mempool_slab_t* slab, uint32_t size);
+
+/**
+ * @brief return a used memory chunk to the slab allocator
+ * @param slab the slab allocator
+ * @param mem the memory chunk, which must be allocated by the same slab allocator
+ * @return status code
+ **/
+int mempool_slab_dealloc(mempool_slab_t* slab, void* mem);
+
+/**
+ * @brief get the number of size classes, include the one for the system allocated chunks
+ * @param slab the slab allocator
+ * @return the number of size classes, or error code
+ **/
+uint32_t mempool_slab_num_classes(const mempool_slab_t* slab);
+
+/**
+ * @brief get the occupancy statistics of a size class
+ * @param slab the slab allocator
+ * @param idx the index of the size class, the last one is the system allocated chunks
+ * @param buf the buffer used to return the statistics
+ * @return status code
+ **/
+int mempool_slab_class_stat(const mempool_slab_t* slab, uint32_t idx, mempool_slab_class_stat_t* buf);
+
+#endif /* __PLUMBER_UTILS_MEMPOOL_SLAB_H__ */
@@ -39,6 +39,12 @@ typedef runtime_api_async_handle_t async_handle_t;
 /** @brief The type used to describe the scope stream ready event */
 typedef runtime_api_scope_ready_event_t scope_ready_event_t;
 
+/** @brief The type used to describe the file region that holds the remaining bytes of a scope stream */
+typedef runtime_api_scope_file_region_t scope_file_region_t;
+
+/** @brief The type used to describe the memory that holds the next bytes of a scope stream */
+typedef runtime_api_scope_page_t scope_page_t;
+
 /** @brief flag indicates that this is an input pipe */
 #define PIPE_INPUT RUNTIME_API_PIPE_INPUT
 
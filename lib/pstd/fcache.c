@@ -173,6 +173,26 @@ static void _clean_cache(void* cache_table)
 	free(table);
 }
 
+/**
+ * @brief report the change of the cached data size to the memory accounting registry
+ * @note the accounting is not critical, so the failure doesn't affect the cache
+ * @param nbytes the number of bytes added to the cache, negative if the bytes are evicted
+ * @return nothing
+ **/
+static inline void _acct_update(int64_t nbytes)
+{
+	static pipe_t pipe = ERROR_CODE(pipe_t);
+
+	if(ERROR_CODE(pipe_t) == pipe && ERROR_CODE(pipe_t) == (pipe = module_require_function("plumber.std", "acct_update")))
+	{
+		LOG_WARNING("Cannot get the service module method reference for plumber.std.acct_update, PSSM may not be loaded");
+		return;
+	}
+
+	if(ERROR_CODE(int) == pipe_cntl(pipe, PIPE_CNTL_INVOKE, "fcache", nbytes))
+		LOG_WARNING("Cannot update the memory accounting counter for the file cache");
+}
+
 /**
  * @brief ensure the thread local cache is initialized
  * @return status code
@@ -379,7 +399,10 @@ static inline int _invalidate_cache(_cache_entry_t* entry)
 	_data_size -= entry->size;
 
 	if(entry->data != NULL)
+	{
 		free(entry->data);
+		_acct_update(-(int64_t)entry->size);
+	}
 
 #ifdef PSTD_FILE_CACHE_STRICT_KEY_COMP
 	if(entry->filename != NULL)
@@ -633,6 +656,7 @@ READ_ERR:
 
 	_lru_add(entry->idx);
 	_data_size += entry->size;
+	_acct_update((int64_t)entry->size);
 
 
 	LOG_DEBUG("File  %s is in cache, return the cached file", filename);
@@ -713,11 +737,30 @@ int pstd_fcache_seek(pstd_fcache_file_t* file, size_t offset)
 	{
 		if(-1 == fseek(file->file, (off_t)offset, SEEK_SET))
 			ERROR_RETURN_LOG_ERRNO(int, "Cannot seek the file");
+		file->offset = offset;
 	}
 
 	return 0;
 }
 
+int pstd_fcache_get_fd(const pstd_fcache_file_t* file, int* fd_buf, size_t* offset_buf)
+{
+	if(NULL == file || NULL == fd_buf || NULL == offset_buf)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	/* The cached file only lives in the memory */
+	if(file->cached) return 0;
+
+	int fd = fileno(file->file);
+	if(fd < 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot get the FD for the file pointer");
+
+	*fd_buf = fd;
+	*offset_buf = file->offset;
+
+	return 1;
+}
+
 size_t pstd_fcache_read(pstd_fcache_file_t* file, void* buf, size_t bufsize)
 {
 	if(NULL == file || NULL == buf)
@@ -75,4 +75,16 @@ int pstd_fcache_stat(const char* filename, struct stat* buf);
  **/
 int pstd_fcache_seek(pstd_fcache_file_t* file, size_t offset);
 
+/**
+ * @brief Get the FD of the file which is read from the disk directly, so that the remaining content
+ *        can be sent by the kernel without copying it to the user-space
+ * @note The FD is owned by the file reference and it's valid until the reference is closed. Also the caller
+ *       shouldn't change the file offset of the FD
+ * @param file The reference to the file
+ * @param fd_buf The buffer used to return the FD
+ * @param offset_buf The buffer used to return the current offset of the reference
+ * @return 1 if the FD has been returned, 0 if the file is served from the cache, or error code
+ **/
+int pstd_fcache_get_fd(const pstd_fcache_file_t* file, int* fd_buf, size_t* offset_buf);
+
 #endif /*__PSTD_FCACHE_H__ */
@@ -35,4 +35,16 @@ void* pstd_mempool_page_alloc(void);
  **/
 int pstd_mempool_page_dealloc(void* page);
 
+/**
+ * @brief allocate memory from the arena of current request
+ * @details The memory is owned by the request local scope, and it will be released all at once when the
+ *          request is done. So there's no way to free the memory allocated by this function, and the memory
+ *          must not be used after the request is done. This is useful for the small objects we create for
+ *          each request, since we don't need to pay for the allocator traffic anymore.
+ * @param size the number of bytes to allocate
+ * @return the allocated memory, NULL if there's an error or the function is not called from a request,
+ *         for example, the servlet init function
+ **/
+void* pstd_arena_alloc(size_t size);
+
 #endif /* __PSTD_MEMPOOL_H__ */
@@ -82,6 +82,18 @@ extern "C" {
 	**/
 	pstd_string_t* pstd_string_new(size_t initcap);
 
+	/**
+	* @brief create a new pstd string buffer, the string object is allocated from the request arena
+	* @details This is the faster version of pstd_string_new for the strings that lives within the request,
+	*          which is the common case of the string that is commited to the RLS. The string buffer
+	*          should be either commited or disposed before the request is done.
+	*          If this function is not called from a request, the string will be allocated from the memory
+	*          pool as pstd_string_new does
+	* @param initcap the initial capacity of the string bufer
+	* @return the newly created pstd string buffer, NULL on error case
+	**/
+	pstd_string_t* pstd_string_new_arena(size_t initcap);
+
 	/**
 	* @brief dispose a used string buffer
 	* @param str the used string buffer
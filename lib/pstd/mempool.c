@@ -5,20 +5,50 @@
 #include <pservlet.h>
 #include <pstd/mempool.h>
 
-void* pstd_mempool_alloc(uint32_t size)
+/**
+ * @brief the allocate function of the PSSM memory pool
+ **/
+static void* (*_pool_alloc)(uint32_t size) = NULL;
+
+/**
+ * @brief the deallocate function of the PSSM memory pool
+ **/
+static int (*_pool_dealloc)(void* mem) = NULL;
+
+/**
+ * @brief resolve the function pointers of the PSSM memory pool, so that we don't need to go through the
+ *        pipe_cntl call for each allocation
+ * @return status code
+ **/
+static inline int _ensure_pool_allocator(void)
 {
-	static pipe_t allocator = ERROR_CODE(pipe_t);
+	if(NULL != _pool_alloc) return 0;
 
-	if(allocator == ERROR_CODE(pipe_t))
-	{
-		allocator = module_require_function("plumber.std", "pool_allocate");
-		if(ERROR_CODE(pipe_t) == allocator)
-			ERROR_PTR_RETURN_LOG("Cannot get the service module method reference for plumber.std.pool_allocate, PSSM is not installed?");
-	}
+	pipe_t pipe = module_require_function("plumber.std", "pool_allocator");
+	if(ERROR_CODE(pipe_t) == pipe)
+		ERROR_RETURN_LOG(int, "Cannot get the service module method reference for plumber.std.pool_allocator, PSSM is not installed?");
 
-	void* ret;
-	int rc = pipe_cntl(allocator, PIPE_CNTL_INVOKE, size, &ret);
-	if(ERROR_CODE(int) == rc)
+	void* (*alloc)(uint32_t) = NULL;
+	int (*dealloc)(void*) = NULL;
+
+	if(ERROR_CODE(int) == pipe_cntl(pipe, PIPE_CNTL_INVOKE, &alloc, &dealloc) || NULL == alloc || NULL == dealloc)
+		ERROR_RETURN_LOG(int, "Cannot get the memory pool allocator functions");
+
+	/* Make sure the deallocator is visible once the allocator is set */
+	_pool_dealloc = dealloc;
+	__sync_synchronize();
+	_pool_alloc = alloc;
+
+	return 0;
+}
+
+void* pstd_mempool_alloc(uint32_t size)
+{
+	if(ERROR_CODE(int) == _ensure_pool_allocator())
+		ERROR_PTR_RETURN_LOG("Cannot resolve the memory pool allocator");
+
+	void* ret = _pool_alloc(size);
+	if(NULL == ret)
 		ERROR_PTR_RETURN_LOG("Cannot allocate memory from memory pool");
 
 	return ret;
@@ -28,17 +58,10 @@ int pstd_mempool_free(void* mem)
 {
 	if(NULL == mem) ERROR_RETURN_LOG(int, "Invalid arguments");
 
-	static pipe_t deallocator = ERROR_CODE(pipe_t);
-
-	if(deallocator == ERROR_CODE(pipe_t))
-	{
-		deallocator = module_require_function("plumber.std", "pool_deallocate");
+	if(ERROR_CODE(int) == _ensure_pool_allocator())
+		ERROR_RETURN_LOG(int, "Cannot resolve the memory pool allocator");
 
-		if(ERROR_CODE(pipe_t) == deallocator)
-			ERROR_RETURN_LOG(int, "Cannot get the service module method reference for plumber.std.pool_deallocate, PSSM is not installed?");
-	}
-
-	return pipe_cntl(deallocator, PIPE_CNTL_INVOKE, mem);
+	return _pool_dealloc(mem);
 }
 
 void* pstd_mempool_page_alloc()
@@ -64,3 +87,17 @@ int pstd_mempool_page_dealloc(void* page)
 
 	return pipe_cntl(pipe, PIPE_CNTL_INVOKE, page);
 }
+
+void* pstd_arena_alloc(size_t size)
+{
+	static pipe_t pipe = ERROR_CODE(pipe_t);
+
+	if(ERROR_CODE(pipe_t) == pipe && ERROR_CODE(pipe_t) == (pipe = module_require_function("plumber.std", "scope_arena_alloc")))
+		ERROR_PTR_RETURN_LOG("Cannot get the service module method reference for plumber.std.scope_arena_alloc, PSSM may not be loaded");
+
+	void* ret;
+	if(ERROR_CODE(int) == pipe_cntl(pipe, PIPE_CNTL_INVOKE, size, &ret))
+		ERROR_PTR_RETURN_LOG("Cannot allocate memory from the request arena");
+
+	return ret;
+}
@@ -233,7 +233,9 @@ scope_token_t pstd_scope_gc_add(const scope_entity_t* entity, pstd_scope_gc_obj_
 		.read_func = entity->read_func,
 		.eos_func  = entity->eos_func,
 		.event_func = entity->event_func,
-		.close_func = entity->close_func
+		.close_func = entity->close_func,
+		.file_region_func = entity->file_region_func,
+		.donate_func = entity->donate_func
 	};
 
 	if(NULL != objbuf)
@@ -358,6 +358,56 @@ static inline size_t _read(void* __restrict stream_mem, void* __restrict buf, si
 #endif
 }
 
+/**
+ * @brief the callback that exposes the remaining bytes of the stream as a file region, called by the RLS infrastructure
+ * @param stream_mem the stream handle
+ * @param region_buf the buffer used to return the file region
+ * @return 1 if the region has been returned, 0 if the file is served from the memory, or error code
+ **/
+static inline int _file_region(void* __restrict stream_mem, scope_file_region_t* region_buf)
+{
+	_stream_t* s = (_stream_t*)stream_mem;
+
+	int fd;
+	size_t offset, size;
+#ifdef PSTD_FILE_NO_CACHE
+	if((fd = fileno(s->file)) < 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot get the FD of the RLS file stream");
+
+	long pos = ftell(s->file);
+	if(pos < 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot get the current offset of the RLS file stream");
+
+	struct stat st;
+	if(fstat(fd, &st) < 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot get the size of the RLS file stream");
+
+	offset = (size_t)pos;
+	size = (size_t)st.st_size;
+#else
+	int rc = pstd_fcache_get_fd(s->file, &fd, &offset);
+	if(ERROR_CODE(int) == rc)
+		ERROR_RETURN_LOG(int, "Cannot get the FD of the RLS file stream");
+
+	if(rc == 0) return 0;
+
+	if(ERROR_CODE(size_t) == (size = pstd_fcache_size(s->file)))
+		ERROR_RETURN_LOG(int, "Cannot get the size of the RLS file stream");
+#endif
+
+	size = size > offset ? size - offset : 0;
+	if(s->remaining != (size_t)-1 && size > s->remaining)
+		size = s->remaining;
+
+	region_buf->fd = fd;
+	region_buf->offset = offset;
+	region_buf->size = size;
+
+	LOG_DEBUG("RLS file stream has been exposed as file region [%zu, %zu)", offset, offset + size);
+
+	return 1;
+}
+
 scope_token_t pstd_file_commit(pstd_file_t* file)
 {
 	if(NULL == file || file->committed)
@@ -370,7 +420,8 @@ scope_token_t pstd_file_commit(pstd_file_t* file)
 		.open_func = _open,
 		.close_func = _close,
 		.eos_func = _eos,
-		.read_func = _read
+		.read_func = _read,
+		.file_region_func = _file_region
 	};
 
 	scope_token_t ret = pstd_scope_add(&ent);
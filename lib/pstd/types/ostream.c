@@ -505,6 +505,44 @@ static int _event(void* __restrict stream_mem, runtime_api_scope_ready_event_t*
 	return ERROR_CODE(int);
 }
 
+static int _donated_block_free(void* block)
+{
+	return _block_free((_block_t*)block);
+}
+
+static int _donate(void* __restrict stream_mem, scope_page_t* page_buf)
+{
+	pstd_ostream_t* stream = (pstd_ostream_t*)stream_mem;
+
+	_block_t* block = stream->list_begin;
+
+	if(NULL == block) return 0;
+
+	/* The data page and the memory buffer is given to the reader as it is, so that it doesn't need to copy them */
+	switch(block->type)
+	{
+		case _BLOCK_TYPE_PAGE:
+			page_buf->data = block->page->data + block->page->read;
+			page_buf->size = block->page->size - block->page->read;
+			break;
+		case _BLOCK_TYPE_MEMORY:
+			page_buf->data = ((const char*)block->memory->data) + block->memory->read;
+			page_buf->size = block->memory->size - block->memory->read;
+			break;
+		case _BLOCK_TYPE_STREAM:
+			/* The inner RLS stream should be read, since we don't know who owns its memory */
+			return 0;
+	}
+
+	page_buf->base = block;
+	page_buf->free_func = _donated_block_free;
+
+	if(NULL == (stream->list_begin = block->next))
+		stream->list_end = NULL;
+	block->next = NULL;
+
+	return 1;
+}
 
 scope_token_t pstd_ostream_commit(pstd_ostream_t* stream)
 {
@@ -519,7 +557,8 @@ scope_token_t pstd_ostream_commit(pstd_ostream_t* stream)
 		.close_func = _close,
 		.eos_func = _eos,
 		.read_func = _read,
-		.event_func = _event
+		.event_func = _event,
+		.donate_func = _donate
 	};
 
 	return pstd_scope_add(&ent);
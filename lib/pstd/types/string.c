@@ -22,6 +22,7 @@ struct _pstd_string_t {
 	size_t capacity;          /*!< the capacity of the string buffer */
 	size_t length;            /*!< the length of the string */
 	uint32_t commited:1;      /*!< if this string has been commited */
+	uint32_t arena:1;         /*!< if the string object is allocated from the request arena */
 	uintpad_t __padding__;
 	union {
 		char     _def_buf[128];   /*!< the default initial buffer */
@@ -88,15 +89,28 @@ pstd_string_t* pstd_string_new_immutable(const char* data, size_t sz)
 	return ret;
 }
 
-pstd_string_t* pstd_string_new(size_t initcap)
+/**
+ * @brief create a new string object
+ * @param initcap the initial capacity
+ * @param use_arena if we should try to allocate the string object from the request arena
+ * @return the newly created string object
+ **/
+static inline pstd_string_t* _string_new(size_t initcap, int use_arena)
 {
 	/* Of course, even if the initcap larger than 128, the default buffer is a waste of memory
 	 * But most of the string is smaller than 128 bytes, and this also makes the object fixed size
 	 * which is good for memory allocation performance */
-	pstd_string_t* ret = pstd_mempool_alloc(sizeof(*ret));
-	if(NULL == ret)
+	pstd_string_t* ret = NULL;
+	uint32_t arena = 0;
+
+	/* If we are not in a request, the arena allocation returns NULL, then we just use the memory pool */
+	if(use_arena && NULL != (ret = pstd_arena_alloc(sizeof(*ret))))
+		arena = 1;
+	else if(NULL == (ret = pstd_mempool_alloc(sizeof(*ret))))
 		ERROR_PTR_RETURN_LOG("Cannot allocate string object");
 
+	ret->arena = arena & 1;
+
 	if(initcap <= sizeof(ret->_def_buf))
 	{
 		LOG_DEBUG("The required buffer size is smaller than 128 bytes, use the pooled memory");
@@ -115,9 +129,19 @@ pstd_string_t* pstd_string_new(size_t initcap)
 	ret->buffer_offset = 0;
 	return ret;
 ERR:
-	if(NULL != ret) pstd_mempool_free(ret);
+	if(NULL != ret && !ret->arena) pstd_mempool_free(ret);
 	return NULL;
 }
+
+pstd_string_t* pstd_string_new(size_t initcap)
+{
+	return _string_new(initcap, 0);
+}
+
+pstd_string_t* pstd_string_new_arena(size_t initcap)
+{
+	return _string_new(initcap, 1);
+}
 /**
  * @brief the implementation for disposing a string buffer
  * @param str the str to dispose
@@ -140,7 +164,8 @@ static inline int _free_impl(pstd_string_t* str, int user_space_call)
 			free(str->buffer - str->buffer_offset);
 	}
 
-	if(ERROR_CODE(int) == pstd_mempool_free(str))
+	/* The arena string object is released with the request arena */
+	if(!str->arena && ERROR_CODE(int) == pstd_mempool_free(str))
 		rc = ERROR_CODE(int);
 
 	return rc;
@@ -208,7 +233,8 @@ static inline void* _copy(const void* mem)
 	const pstd_string_t* ptr = (const pstd_string_t*)mem;
 
 	LOG_DEBUG("RLS string duplicated");
-	pstd_string_t* ret = pstd_string_new(ptr->buffer != NULL ? ptr->length + 1 : 0);
+	/* The copy is commited to the scope immediately, so it's safe to put it in the request arena */
+	pstd_string_t* ret = _string_new(ptr->buffer != NULL ? ptr->length + 1 : 0, 1);
 
 	if(NULL == ret)
 		ERROR_PTR_RETURN_LOG("Cannot create new string object for the duplication");
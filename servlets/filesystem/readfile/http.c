@@ -57,6 +57,7 @@ struct _http_ctx_t {
 	uint32_t                    BODY_CAN_COMPRESS;  /*!< The constant indicates that the body can be compressed */
 	uint32_t                    BODY_SEEKABLE;      /*!< The constant indicates that the body can be seeked */
 	uint32_t                    BODY_RANGED;        /*!< Indicates the body is ranged */
+	uint32_t                    BODY_FILE;          /*!< Indicates the body is a file RLS */
 
 	uint16_t                    HTTP_STATUS_OK;           /*!< OK */
 	uint16_t                    HTTP_STATUS_PARTIAL;      /*!< The partial content */
@@ -112,7 +113,8 @@ http_ctx_t* http_ctx_new(const options_t* options, pstd_type_model_t* type_model
 		PSTD_TYPE_MODEL_CONST(ret->p_file,  status.METHOD_NOT_ALLOWED,ret->HTTP_STATUS_METHOD_NOT_ALLOWED),
 		PSTD_TYPE_MODEL_CONST(ret->p_file,  status.RANGE_NOT_SATISFIABLE, ret->HTTP_STATUS_RANGE_NOT_SATISFIABLE),
 		PSTD_TYPE_MODEL_CONST(ret->p_file,  BODY_SEEKABLE,            ret->BODY_SEEKABLE),
-		PSTD_TYPE_MODEL_CONST(ret->p_file,  BODY_RANGED,              ret->BODY_RANGED)
+		PSTD_TYPE_MODEL_CONST(ret->p_file,  BODY_RANGED,              ret->BODY_RANGED),
+		PSTD_TYPE_MODEL_CONST(ret->p_file,  BODY_FILE,                ret->BODY_FILE)
 	};
 
 	if(NULL == PSTD_TYPE_MODEL_BATCH_INIT(output_model, type_model))
@@ -162,7 +164,7 @@ static inline int _write_file_body(const http_ctx_t* ctx, pstd_type_instance_t*
 		ERROR_RETURN_LOG(int, "Cannot commit the file object to scope");
 	}
 
-	uint32_t body_flags = 0;
+	uint32_t body_flags = ctx->BODY_FILE;
 	if(compress) body_flags |= ctx->BODY_CAN_COMPRESS;
 	if(seekable) body_flags |= ctx->BODY_SEEKABLE;
 
@@ -244,7 +246,7 @@ static inline int _write_default_index(const http_ctx_t* ctx, pstd_type_instance
 	if(NULL == (dp = opendir(path)))
 		ERROR_RETURN_LOG_ERRNO(int, "Cannot open directory %s", path);
 
-	if(NULL == (result_str = pstd_string_new(1024)))
+	if(NULL == (result_str = pstd_string_new_arena(1024)))
 		ERROR_LOG_GOTO(ERR, "Cannot create new string object");
 
 	if(ERROR_CODE(size_t) == pstd_string_printf(result_str, "<html><head><title>Directory Listing of %s</title></head>"
@@ -1,2 +1,3 @@
 list(APPEND LOCAL_LIBS pstd proto)
+set(TEST_SOURCE parser.c)
 set(INSTALL yes)
@@ -13,6 +13,8 @@
  **/
 typedef struct {
 	routing_map_t*          routing_map;        /*!< The HTTP routing map */
+	parser_capture_t        capture;            /*!< The header fields we want to capture */
+	uint64_t                max_body_size;      /*!< The max size of the request body */
 } options_t;
 
 /**
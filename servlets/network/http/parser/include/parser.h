@@ -16,15 +16,50 @@ typedef struct {
 	size_t        length;    /*!< The length of the string */
 } parser_string_t;
 
+/**
+ * @brief The max number of header fields we can capture
+ * @note This should be the same as the size of the headers array in RequestData
+ **/
+#define PARSER_CAPTURE_MAX 8
+
+/**
+ * @brief The max length of the field name we can capture
+ **/
+#define PARSER_CAPTURE_NAME_MAX 64
+
+/**
+ * @brief The list of header fields we want to capture
+ **/
+typedef struct {
+	uint32_t      count;                         /*!< The number of fields to capture */
+	char*         names[PARSER_CAPTURE_MAX];     /*!< The field names in lower case */
+	size_t        sizes[PARSER_CAPTURE_MAX];     /*!< The length of the field names */
+} parser_capture_t;
+
 /**
  * @brief The method of the request
  **/
 typedef enum {
 	PARSER_METHOD_GET,   /*!< GET method */
 	PARSER_METHOD_POST,  /*!< POST method */
-	PARSER_METHOD_HEAD   /*!< HEAD method */
+	PARSER_METHOD_HEAD,  /*!< HEAD method */
+	PARSER_METHOD_PUT,   /*!< PUT method */
+	PARSER_METHOD_DELETE,/*!< DELETE method */
+	PARSER_METHOD_PATCH  /*!< PATCH method */
 } parser_method_t;
 
+/**
+ * @brief A decoded chunk of the chunked body
+ * @note The data section is allocated along with the chunk, use parser_chunk_free to dispose it by the
+ *       pointer to the data section
+ **/
+typedef struct _parser_chunk_t {
+	struct _parser_chunk_t*  next;      /*!< The next chunk in the body */
+	size_t                   size;      /*!< The size of the chunk */
+	uintpad_t __padding__[0];
+	char                     data[0];   /*!< The decoded data */
+} parser_chunk_t;
+
 /**
  * @brief The PARSER parser state
  **/
@@ -33,25 +68,31 @@ typedef struct {
 	uint32_t             empty:1;             /*!< If the request don't have any data */
 	uint32_t             keep_alive:1;        /*!< If the client ask to keep this connection */
 	uint32_t             has_range:1;         /*!< Indicates if the request contains a range reuqest */
+	uint32_t             chunked:1;           /*!< Indicates if the body uses the chunked transfer encoding */
 	parser_method_t      method;              /*!< The HTTP method */
 	parser_string_t      path;                /*!< The path buffer (MAX: 2048 Bytes) */
 	parser_string_t      host;                /*!< The host name buffer (MAX: 64 Bytes) */
 	parser_string_t      query;               /*!< The query parameter (MAX: 2048 Bytes) */
 	parser_string_t      accept_encoding;     /*!< The accept encoding buffer (MAX: 32 Bytes) */
-	parser_string_t      body;                /*!< The body data (MAX: 2048) (TODO: we probably need a RLS token that wraps the pipe data directly) */
+	parser_string_t      body;                /*!< The body data specified by the content length */
+	parser_chunk_t*      body_chunks;         /*!< The decoded chunks of the chunked body, in the order they are received */
 	parser_string_t      range_text;          /*!< The text for the range */
 	uint64_t             range_begin;         /*!< The beginging of the range */
 	uint64_t             range_end;           /*!< The end of the range */
 	uint64_t             content_length;      /*!< The content length */
+	parser_string_t      captured[PARSER_CAPTURE_MAX];  /*!< The captured header fields, the index is the same as the capture list (MAX: 2048 Bytes) */
 	uintpad_t __padding__[0];
 	char                 internal_state[0];   /*!< The internal state */
 } parser_state_t;
 
 /**
  * @brief Create a new PARSER parser state
+ * @param capture The header fields we want to capture, NULL if we don't capture anything
+ * @param max_body_size The max size of the request body, the request with a larger body is a bad request
+ * @note The capture list should be valid until the state is disposed
  * @return The newly created parser state
  **/
-parser_state_t* parser_state_new(void);
+parser_state_t* parser_state_new(const parser_capture_t* capture, uint64_t max_body_size);
 
 /**
  * @brief Dispose a used parser state
@@ -60,6 +101,13 @@ parser_state_t* parser_state_new(void);
  **/
 int parser_state_free(parser_state_t* state);
 
+/**
+ * @brief Dispose a decoded chunk which has been detached from the parser state
+ * @param data The data section of the chunk
+ * @return status code
+ **/
+int parser_chunk_free(void* data);
+
 /**
  * @brief Process the next buffer of bytes
  * @param state The parser state variable
@@ -40,6 +40,8 @@ typedef struct {
 	pstd_type_accessor_t   a_range_begin;  /*!< The beginging of the range */
 	pstd_type_accessor_t   a_range_end;    /*!< The end of the range */
 	pstd_type_accessor_t   a_body;         /*!< The accessor for the body data */
+	pstd_type_accessor_t   a_body_stream;  /*!< The accessor for the decoded chunked body stream */
+	pstd_type_accessor_t   a_headers[PARSER_CAPTURE_MAX];  /*!< The accessors for the captured header fields */
 } routing_output_t;
 
 /**
@@ -102,10 +104,11 @@ int routing_map_free(routing_map_t* map);
  * @note This function will finally get the accessors and constants from the type model.
  *       This call is the last step before we can actually use the routing map
  * @param map The routing map
- * @param param The intialization param
+ * @param type_model The type model
+ * @param n_headers The number of captured header fields
  * @return status code
  **/
-int routing_map_initialize(routing_map_t* map, pstd_type_model_t* type_model);
+int routing_map_initialize(routing_map_t* map, pstd_type_model_t* type_model, uint32_t n_headers);
 
 /**
  * @brief Add a new routing rule to the routing map
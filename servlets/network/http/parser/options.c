@@ -11,8 +11,71 @@
 #include <pstd.h>
 
 #include <trie.h>
+#include <parser.h>
 #include <routing.h>
 #include <options.h>
+
+static int _header(pstd_option_data_t data)
+{
+	options_t* options = (options_t*)data.cb_data;
+
+	if(data.param_array_size < 1)
+		ERROR_RETURN_LOG(int, "Unexpected number of parameters");
+
+	const char* name = data.param_array[0].strval;
+	size_t size = strlen(name);
+	parser_capture_t* capture = &options->capture;
+
+	if(capture->count >= PARSER_CAPTURE_MAX)
+		ERROR_RETURN_LOG(int, "Too many header fields to capture, at most %u fields are allowed", PARSER_CAPTURE_MAX);
+
+	if(size == 0 || size > PARSER_CAPTURE_NAME_MAX)
+		ERROR_RETURN_LOG(int, "Invalid header field name %s", name);
+
+	static const char* const handled[] = {"host", "accept-encoding", "range", "connection", "content-length", "transfer-encoding"};
+
+	char* lower = strdup(name);
+	if(NULL == lower)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot duplicate the header field name");
+
+	size_t i;
+	for(i = 0; i < size; i ++)
+		if(lower[i] >= 'A' && lower[i] <= 'Z')
+			lower[i] |= 0x20;
+
+	for(i = 0; i < sizeof(handled) / sizeof(handled[0]); i ++)
+		if(strcmp(lower, handled[i]) == 0)
+			ERROR_LOG_GOTO(ERR, "The header field %s is handled by the parser and can not be captured", name);
+
+	for(i = 0; i < capture->count; i ++)
+		if(strcmp(lower, capture->names[i]) == 0)
+			ERROR_LOG_GOTO(ERR, "The header field %s has been captured already", name);
+
+	capture->names[capture->count] = lower;
+	capture->sizes[capture->count] = size;
+	capture->count ++;
+
+	return 0;
+ERR:
+	free(lower);
+	return ERROR_CODE(int);
+}
+
+static int _max_body_size(pstd_option_data_t data)
+{
+	options_t* options = (options_t*)data.cb_data;
+
+	if(data.param_array_size != 1)
+		ERROR_RETURN_LOG(int, "Unexpected number of parameters");
+
+	if(data.param_array[0].intval < 0)
+		ERROR_RETURN_LOG(int, "Invalid max body size");
+
+	options->max_body_size = (uint64_t)data.param_array[0].intval;
+
+	return 0;
+}
+
 static int _upgrade_default(pstd_option_data_t data)
 {
 	options_t* options = (options_t*)data.cb_data;
@@ -97,6 +160,20 @@ static pstd_option_t _options[] = {
 		.description  = "Upgrade default connection for HTTP",
 		.pattern      = "?S",
 		.handler      = _upgrade_default
+	},
+	{
+		.short_opt    = 'H',
+		.long_opt     = "header",
+		.description  = "Capture the header field to the headers array of the request data, the N-th field goes to headers[N]",
+		.pattern      = "S",
+		.handler      = _header
+	},
+	{
+		.short_opt    = 'M',
+		.long_opt     = "max-body-size",
+		.description  = "The max size of the request body in bytes, the request with a larger body is a bad request",
+		.pattern      = "I",
+		.handler      = _max_body_size
 	}
 };
 
@@ -110,6 +187,8 @@ int options_parse(uint32_t argc, char const* const* argv, options_t* buf)
 	if(NULL == (buf->routing_map = routing_map_new()))
 		ERROR_RETURN_LOG(int, "Cannot create routing map");
 
+	buf->max_body_size = 0x1000000;
+
 
 	if(ERROR_CODE(int) == pstd_option_sort(_options, sizeof(_options) / sizeof(_options[0])))
 		ERROR_RETURN_LOG(int, "Cannot sort the opts array");
@@ -125,6 +204,10 @@ int options_free(const options_t* options)
 	if(NULL == options)
 		ERROR_RETURN_LOG(int, "Invalid arguments");
 
+	uint32_t i;
+	for(i = 0; i < options->capture.count; i ++)
+		free(options->capture.names[i]);
+
 	if(NULL != options->routing_map)
 		return routing_map_free(options->routing_map);
 
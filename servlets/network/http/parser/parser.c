@@ -2,11 +2,17 @@
  * Copyright (C) 2018, Hao Hou
  **/
 #include <stdint.h>
+#include <stddef.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 
+#if defined(__SSE2__) || defined(__AVX2__)
+#	include <immintrin.h>
+#endif
+
 #include <pservlet.h>
 #include <pstd.h>
 
@@ -19,7 +25,11 @@ typedef enum {
 	_STATE_INIT,            /*!< The state when we initialize the request parser */
 	_STATE_METHOD_GET,      /*!< The method phrase is determined and we need to match the method */
 	_STATE_METHOD_HEAD,     /*!< The method phrase is determined and we need to match the method */
+	_STATE_METHOD_P,        /*!< We have seen a P, and we need to determine which method it is */
 	_STATE_METHOD_POST,     /*!< The method phrase is determined and we need to match the method */
+	_STATE_METHOD_PUT,      /*!< The method phrase is determined and we need to match the method */
+	_STATE_METHOD_PATCH,    /*!< The method phrase is determined and we need to match the method */
+	_STATE_METHOD_DELETE,   /*!< The method phrase is determined and we need to match the method */
 	_STATE_METHOD_PATH_SEP, /*!< The state for we are in the middle of method phrase and server path */
 	_STATE_URI,             /*!< We are parsing the URI */
 	_STATE_URI_SCHEME,      /*!< We are parsing the URL scheme (Based on the RFC the URL can be a full URI*/
@@ -30,21 +40,28 @@ typedef enum {
 	_STATE_URI_VERSION_SEP, /*!< The space between URI and HTTP version identifer */
 	_STATE_VERSION,         /*!< The HTTP version */
 	_STATE_REQ_LINE_END,    /*!< We are parsing the \r\n */
-	_STATE_FIELD_NAME_INIT, /*!< We are parsing a field name */
-	_STATE_FIELD_NAME_ACCEPT_ENC,   /*!< We are parsering the Accept-Encoding field name */
-	_STATE_FIELD_NAME_RANGE,        /*!< We are parsing the Range field name */
-	_STATE_FIELD_NAME_HOST,         /*!< We are parsing the Host field name */
-	_STATE_FIELD_NAME_CONTENT_LEN,  /*!< We are parsing the content-length name */
-	_STATE_FIELD_NAME_CONNECT,      /*!< We are parsing the connection field name */
+	_STATE_FIELD_NAME_INIT, /*!< We are about to parse a field name */
+	_STATE_FIELD_NAME,      /*!< We are parsing a field name */
 	_STATE_FIELD_KV_SEP,    /*!< We are parsing the field name - field value delimitor */
 	_STATE_FIELD_VALUE,     /*!< We are parsing the content of the value */
 	_STATE_FIELD_VAL_HOST,
 	_STATE_FIELD_VAL_ACCEPT_ENC,
 	_STATE_FIELD_VAL_RANGE,
+	_STATE_FIELD_VAL_CAPTURE,  /*!< We are copying the value of a captured field */
+	_STATE_FIELD_VAL_TE,    /*!< We are parsing the transfer encoding */
 	_STATE_FIELD_LINE_END,  /*!< We are parsing the end of the field line */
 	_STATE_FIELD_NOT_INST,  /*!< The field we are not interested */
 	_STATE_BODY_BEGIN,      /*!< We are reading the last \r\n */
 	_STATE_BODY_DATA,       /*!< We are parsing the data */
+	_STATE_CHUNK_SIZE,      /*!< We are parsing the size of the chunk */
+	_STATE_CHUNK_EXT,       /*!< We are ignoring the chunk extension */
+	_STATE_CHUNK_SIZE_END,  /*!< We are parsing the \r\n after the chunk size */
+	_STATE_CHUNK_DATA,      /*!< We are copying the chunk data */
+	_STATE_CHUNK_DATA_END,  /*!< We are parsing the \r\n after the chunk data */
+	_STATE_CHUNK_TRAILER,   /*!< We need to determine if we have a trailer field or the body ends */
+	_STATE_CHUNK_TRAILER_LINE, /*!< We are ignoring the trailer field */
+	_STATE_CHUNK_TRAILER_END,  /*!< We are parsing the end of the trailer field line */
+	_STATE_CHUNK_END,       /*!< We are parsing the last \r\n of the chunked body */
 	_STATE_BODY_END,        /*!< We are parsing the body end */
 	_STATE_DONE,            /*!< We have parsed everything */
 	_STATE_COUNT,           /*!< The number of states */
@@ -59,7 +76,6 @@ typedef enum {
 typedef enum {
 	_STATE_TYPE_GENERIC = 0,   /*!< Indicates this is not a predefined state */
 	_STATE_TYPE_LITER,         /*!< Indicates in this state we need to match a literal constant, if failed goto error */
-	_STATE_TYPE_LITER_IC,      /*!< Liternal constant but ignore the case */
 	_STATE_TYPE_COPY,          /*!< Indicates in this state we want to copy the data into a buffer, util we see a char */
 	_STATE_TYPE_WS,            /*!< Indicates in this state we want to trip the white spaces */
 	_STATE_TYPE_IGNORE         /*!< We want to ignore the data until we see the char */
@@ -71,12 +87,11 @@ typedef enum {
 typedef struct {
 	_state_type_t type;     /*!< The type of the state */
 	_state_code_t next;     /*!< The next state */
-	_state_code_t fail;     /*!< What we do when we failed */
 	union {
 		struct {
 			const char* str;/*!< The literal we want to match */
 			size_t      size; /*!< The size of the string */
-		} liter, liter_ic;   /*!< The literal and literal case insensitive */
+		} liter;            /*!< The literal */
 		struct {
 			uint32_t off;   /*!< The offset for the buffer */
 			char     term;  /*!< The ending string we want to terminate the copy */
@@ -89,17 +104,6 @@ typedef struct {
 
 #define _GENERIC(name)                 [_STATE_##name] = {.type = _STATE_TYPE_GENERIC}
 #define _LITERAL(name, ns, lit)        [_STATE_##name] = {.type = _STATE_TYPE_LITER, .next = _STATE_##ns, .param = {.liter = {.str = lit, .size = sizeof(lit) - 1}}}
-#define _LITERAL_IC(name, ns, fs, lit) [_STATE_##name] = {\
-	.type = _STATE_TYPE_LITER_IC, \
-	.next = _STATE_##ns, \
-	.fail = _STATE_##fs, \
-	.param = {\
-		.liter = {\
-			.str = lit,\
-			.size = sizeof(lit) - 1\
-		}\
-	}\
-}
 #define _COPY(name, ns, tr, sz, ofs)   [_STATE_##name] = {\
 	.type = _STATE_TYPE_COPY,  \
 	.next = _STATE_##ns, \
@@ -124,8 +128,16 @@ static _state_desc_t _state_info[_STATE_COUNT] = {
 	_LITERAL(METHOD_GET, METHOD_PATH_SEP,  "ET "),
 	/* We are going to match HEAD */
 	_LITERAL(METHOD_HEAD, METHOD_PATH_SEP, "EAD "),
+	/* We need to determine if this is POST, PUT or PATCH */
+	_GENERIC(METHOD_P),
 	/* We are going to match POST */
-	_LITERAL(METHOD_POST, METHOD_PATH_SEP, "OST "),
+	_LITERAL(METHOD_POST, METHOD_PATH_SEP, "ST "),
+	/* We are going to match PUT */
+	_LITERAL(METHOD_PUT, METHOD_PATH_SEP, "T "),
+	/* We are going to match PATCH */
+	_LITERAL(METHOD_PATCH, METHOD_PATH_SEP, "TCH "),
+	/* We are going to match DELETE */
+	_LITERAL(METHOD_DELETE, METHOD_PATH_SEP, "ELETE "),
 	/* Strip the extra white space between method and URI */
 	_WS(METHOD_PATH_SEP, URI, 0),
 	/* In this state we need to determine if we got a full URI or relative path */
@@ -146,18 +158,10 @@ static _state_desc_t _state_info[_STATE_COUNT] = {
 	_IGNORE(VERSION, REQ_LINE_END, '\r'),
 	/* Finally we need a sign to complete the first line */
 	_LITERAL(REQ_LINE_END, FIELD_NAME_INIT, "\r\n"),
-	/* In this state we need to determine which state we are goging to parse */
+	/* In this state we need to determine if we have another field or the header ends */
 	_GENERIC(FIELD_NAME_INIT),
-	/* We are matching the accept-encoding field */
-	_LITERAL_IC(FIELD_NAME_ACCEPT_ENC, FIELD_KV_SEP, FIELD_NOT_INST, "ccept-encoding:"),
-	/* We are matching range field */
-	_LITERAL_IC(FIELD_NAME_RANGE, FIELD_KV_SEP, FIELD_NOT_INST, "ange:"),
-	/* We are matching host field */
-	_LITERAL_IC(FIELD_NAME_HOST, FIELD_KV_SEP, FIELD_NOT_INST, "ost:"),
-	/* We are matching connection field */
-	_LITERAL_IC(FIELD_NAME_CONNECT, FIELD_KV_SEP, FIELD_NOT_INST, "ection:"),
-	/* We are matching content-length field */
-	_LITERAL_IC(FIELD_NAME_CONTENT_LEN, FIELD_KV_SEP, FIELD_NOT_INST, "ent-length:"),
+	/* We collect the field name and determine which field it is */
+	_GENERIC(FIELD_NAME),
 	/* In this state we handle each of the state differently */
 	_WS(FIELD_KV_SEP, FIELD_VALUE, 0),
 	/* All the non-copy header */
@@ -168,6 +172,10 @@ static _state_desc_t _state_info[_STATE_COUNT] = {
 	_COPY(FIELD_VAL_ACCEPT_ENC, FIELD_LINE_END, '\r', 64, accept_encoding),
 	/* All the non-copy header */
 	_COPY(FIELD_VAL_RANGE, FIELD_LINE_END, '\r', 64, range_text),
+	/* The captured field, the target buffer depends on which field it is */
+	_GENERIC(FIELD_VAL_CAPTURE),
+	/* We need to check if the transfer encoding is chunked */
+	_GENERIC(FIELD_VAL_TE),
 	/* We are going to ignore this field */
 	_IGNORE(FIELD_NOT_INST, FIELD_LINE_END, '\r'),
 	/* We should check if we really come to the end of the field line */
@@ -176,21 +184,44 @@ static _state_desc_t _state_info[_STATE_COUNT] = {
 	_LITERAL(BODY_BEGIN, BODY_DATA, "\r\n"),
 	/* Read all body data */
 	_GENERIC(BODY_DATA),
+	/* The hex size of the chunk */
+	_GENERIC(CHUNK_SIZE),
+	/* We don't support any chunk extension, so just ignore it */
+	_IGNORE(CHUNK_EXT, CHUNK_SIZE_END, '\r'),
+	/* The end of the chunk size line */
+	_LITERAL(CHUNK_SIZE_END, CHUNK_DATA, "\r\n"),
+	/* Decode the chunk data to the body buffer */
+	_GENERIC(CHUNK_DATA),
+	/* The chunk data should be followed by a \r\n */
+	_LITERAL(CHUNK_DATA_END, CHUNK_SIZE, "\r\n"),
+	/* After the last chunk, we may have some trailer fields */
+	_GENERIC(CHUNK_TRAILER),
+	/* We don't care about the trailer fields */
+	_IGNORE(CHUNK_TRAILER_LINE, CHUNK_TRAILER_END, '\r'),
+	/* The end of the trailer field line */
+	_LITERAL(CHUNK_TRAILER_END, CHUNK_TRAILER, "\r\n"),
+	/* The last \r\n of the chunked body */
+	_LITERAL(CHUNK_END, DONE, "\r\n"),
 	/* Finally we are done */
 	_GENERIC(DONE)
 };
 
 typedef enum {
-	_FIELD_NAME_UNKNOWN,
-	_FIELD_NAME_CON_OR_CL,
-	_FIELD_NAME_N_DETERMINED,      /*!< Number of determined */
+	_FIELD_NAME_UNKNOWN,           /*!< The field we are not interested */
 	_FIELD_NAME_HOST,              /*!< Host */
 	_FIELD_NAME_ACCEPT_ENCODING,   /*!< Accept encoding */
 	_FIELD_NAME_RANGE,             /*!< Range */
 	_FIELD_NAME_CONN,              /*!< Connection */
 	_FIELD_NAME_CL,                /*!< Content Length */
+	_FIELD_NAME_TE,                /*!< Transfer Encoding */
+	_FIELD_NAME_CAPTURE            /*!< The field in the capture list */
 } _field_name_state_t;
 
+/**
+ * @brief The size limit of a captured field value
+ **/
+#define _CAPTURE_LIMIT 2048
+
 /**
  * @brief The internal state
  **/
@@ -200,8 +231,149 @@ typedef struct {
 	_field_name_state_t fn_state;   /*!< The field name state */
 	parser_string_t*    buffer;     /*!< The string buffer */
 	size_t              buffer_cap; /*!< The buffer capacity */
+	const parser_capture_t* capture;/*!< The fields we want to capture */
+	uint32_t            capture_idx;/*!< The index of the captured field we are parsing */
+	size_t              token_len;  /*!< The length of the token */
+	char                token[PARSER_CAPTURE_NAME_MAX];  /*!< The field name or the short field value we are parsing */
+	uint64_t            chunk_size; /*!< The number of bytes remaining in current chunk */
+	parser_chunk_t*     body_tail;  /*!< The last decoded chunk of the chunked body */
+	uint64_t            body_size;  /*!< The number of bytes of the chunked body we have decoded */
+	uint64_t            body_limit; /*!< The max size of the body we accept */
 } _state_t;
 
+/**
+ * @brief Find the first byte which is either a or b in the given range
+ * @details This is the delimiter scanner used by the parser, it compares 32 bytes at a time when AVX2 is available,
+ *          16 bytes with SSE2 and 8 bytes with the portable SWAR code on other platforms
+ * @param begin The begining of the range
+ * @param end The end of the range
+ * @param a The first delimiter
+ * @param b The second delimiter, pass the same value as a if we only look for one char
+ * @return The position of the delimiter, or end if it is not found
+ **/
+static inline const char* _scan(const char* begin, const char* end, char a, char b)
+{
+#if defined(__AVX2__)
+	const __m256i ya = _mm256_set1_epi8(a), yb = _mm256_set1_epi8(b);
+	for(; end - begin >= 32; begin += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)begin);
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, ya), _mm256_cmpeq_epi8(v, yb)));
+		if(mask) return begin + __builtin_ctz(mask);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i xa = _mm_set1_epi8(a), xb = _mm_set1_epi8(b);
+	for(; end - begin >= 16; begin += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)begin);
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, xa), _mm_cmpeq_epi8(v, xb)));
+		if(mask) return begin + __builtin_ctz(mask);
+	}
+#else
+	/* The SWAR fallback, a byte in the mask is 0x80 iff the byte in x is zero. Unlike the well known (x - 1) & ~x trick,
+	 * this one doesn't have the false positive caused by the borrow, thus it works for both byte orders */
+	const uint64_t low7 = 0x7f7f7f7f7f7f7f7full;
+	const uint64_t pa = 0x0101010101010101ull * (uint8_t)a, pb = 0x0101010101010101ull * (uint8_t)b;
+	for(; end - begin >= 8; begin += 8)
+	{
+		uint64_t v, xa, xb;
+		memcpy(&v, begin, sizeof(v));
+		xa = v ^ pa;
+		xb = v ^ pb;
+		uint64_t mask = ~((((xa & low7) + low7) | xa | low7) & (((xb & low7) + low7) | xb | low7));
+		if(mask)
+#	if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			return begin + (__builtin_ctzll(mask) >> 3);
+#	else
+			return begin + (__builtin_clzll(mask) >> 3);
+#	endif
+	}
+#endif
+	for(; begin < end && *begin != a && *begin != b; begin ++);
+	return begin;
+}
+
+/**
+ * @brief A range in the input buffer
+ **/
+typedef struct {
+	const char*   begin;   /*!< The begining of the range, NULL if we haven't seen it */
+	const char*   end;     /*!< The end of the range */
+} _range_t;
+
+/**
+ * @brief Compare the field name with the expected lower case name, ignoring the case
+ * @param name The field name
+ * @param expected The expected name in lower case
+ * @param size The size of the expected name
+ * @return If the field name matches
+ **/
+static inline int _name_is(const _range_t* name, const char* expected, size_t size)
+{
+	if((size_t)(name->end - name->begin) != size) return 0;
+
+	size_t i;
+	for(i = 0; i < size; i ++)
+	{
+		char ch = name->begin[i];
+		if(ch >= 'A' && ch <= 'Z')
+			ch |= 0x20;
+		if(ch != expected[i]) return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Determine which field it is by the field name
+ * @param internal The internal state
+ * @param name The field name
+ * @param capture_idx The buffer used to return the index in the capture list if this is a captured field
+ * @return The field name state
+ **/
+static inline _field_name_state_t _field_name_lookup(const _state_t* internal, const _range_t* name, uint32_t* capture_idx)
+{
+	if(_name_is(name, "host", 4)) return _FIELD_NAME_HOST;
+	if(_name_is(name, "accept-encoding", 15)) return _FIELD_NAME_ACCEPT_ENCODING;
+	if(_name_is(name, "range", 5)) return _FIELD_NAME_RANGE;
+	if(_name_is(name, "connection", 10)) return _FIELD_NAME_CONN;
+	if(_name_is(name, "content-length", 14)) return _FIELD_NAME_CL;
+	if(_name_is(name, "transfer-encoding", 17)) return _FIELD_NAME_TE;
+
+	if(NULL != internal->capture)
+	{
+		uint32_t i;
+		for(i = 0; i < internal->capture->count; i ++)
+			if(_name_is(name, internal->capture->names[i], internal->capture->sizes[i]))
+			{
+				*capture_idx = i;
+				return _FIELD_NAME_CAPTURE;
+			}
+	}
+
+	return _FIELD_NAME_UNKNOWN;
+}
+
+/**
+ * @brief Check if the transfer encoding is chunked
+ * @note Based on the RFC, the chunked encoding must be the last one
+ * @param value The value of the transfer encoding field
+ * @param size The size of the value
+ * @return If the body is chunked
+ **/
+static inline int _is_chunked(const char* value, size_t size)
+{
+	for(;size > 0 && (value[size - 1] == ' ' || value[size - 1] == '\t'); size --);
+
+	if(size < 7) return 0;
+
+	_range_t last = {.begin = value + size - 7, .end = value + size};
+	if(!_name_is(&last, "chunked", 7)) return 0;
+
+	return size == 7 || last.begin[-1] == ',' || last.begin[-1] == ' ' || last.begin[-1] == '\t';
+}
+
 static inline void _transite_state(parser_state_t* state, _state_code_t next)
 {
 	_state_t* internal = (_state_t*)state->internal_state;
@@ -250,30 +422,21 @@ static inline int _ensure_buffer(parser_state_t* state, size_t new_bytes, size_t
 	return 1;
 }
 
-static inline const char* _copy(parser_state_t* state, const char* data, const char* end)
+static inline const char* _copy_data(parser_state_t* state, const char* data, const char* end, char term, size_t limit, _state_code_t next)
 {
 	_state_t* internal = (_state_t*)state->internal_state;
-	const _state_desc_t* si = _state_info + (internal->code & _STATE_CODE_MASK);
-
-	if(_STATE_PENDING & internal->code)
-	{
-		if(ERROR_CODE(int) == _init_buffer(state, (uintptr_t)si->param.copy.off, (size_t)si->param.copy.lim))
-			return NULL;
-		internal->code ^= _STATE_PENDING;
-	}
-
 
 	const char* termpos = data;
 	int last = 0;
 
-	termpos = memchr(data, si->param.copy.term, (size_t)(end - data));
+	termpos = memchr(data, term, (size_t)(end - data));
 
 	if(NULL == termpos)
 		termpos = end;
 	else
 		last = 1;
 
-	int ensure_rc = _ensure_buffer(state, (size_t)(termpos - data), (size_t)si->param.copy.lim);
+	int ensure_rc = _ensure_buffer(state, (size_t)(termpos - data), limit);
 	if(ensure_rc == 0) return data;
 	if(ensure_rc == ERROR_CODE(int)) return NULL;
 
@@ -283,12 +446,42 @@ static inline const char* _copy(parser_state_t* state, const char* data, const c
 	if(last)
 	{
 		internal->buffer->value[internal->buffer->length] = 0;
-		_transite_state(state, si->next);
+		_transite_state(state, next);
 	}
 
 	return termpos;
 }
 
+static inline const char* _copy(parser_state_t* state, const char* data, const char* end)
+{
+	_state_t* internal = (_state_t*)state->internal_state;
+	const _state_desc_t* si = _state_info + (internal->code & _STATE_CODE_MASK);
+
+	if(_STATE_PENDING & internal->code)
+	{
+		if(ERROR_CODE(int) == _init_buffer(state, (uintptr_t)si->param.copy.off, (size_t)si->param.copy.lim))
+			return NULL;
+		internal->code ^= _STATE_PENDING;
+	}
+
+	return _copy_data(state, data, end, si->param.copy.term, (size_t)si->param.copy.lim, si->next);
+}
+
+static inline const char* _field_val_capture(parser_state_t* state, const char* data, const char* end)
+{
+	_state_t* internal = (_state_t*)state->internal_state;
+
+	if(_STATE_PENDING & internal->code)
+	{
+		uintptr_t offset = (uintptr_t)(state->captured + internal->capture_idx) - (uintptr_t)state;
+		if(ERROR_CODE(int) == _init_buffer(state, offset, _CAPTURE_LIMIT))
+			return NULL;
+		internal->code ^= _STATE_PENDING;
+	}
+
+	return _copy_data(state, data, end, '\r', _CAPTURE_LIMIT, _STATE_FIELD_LINE_END);
+}
+
 static inline const char* _uri_path(parser_state_t* state, const char* data, const char* end)
 {
 	_state_t* internal = (_state_t*)state->internal_state;
@@ -300,13 +493,15 @@ static inline const char* _uri_path(parser_state_t* state, const char* data, con
 		internal->code ^= _STATE_PENDING;
 	}
 
-	for(;data < end && data[0] != '?' && data[0] != ' '; data ++)
-	{
-		int ensure_rc = _ensure_buffer(state, 1, 2048);
-		if(ensure_rc == 0) return data;
-		if(ensure_rc == ERROR_CODE(int)) return NULL;
-		internal->buffer->value[internal->buffer->length++] = data[0];
-	}
+	const char* termpos = _scan(data, end, '?', ' ');
+
+	int ensure_rc = _ensure_buffer(state, (size_t)(termpos - data), 2048);
+	if(ensure_rc == 0) return data;
+	if(ensure_rc == ERROR_CODE(int)) return NULL;
+
+	memcpy(internal->buffer->value + internal->buffer->length, data, (size_t)(termpos - data));
+	internal->buffer->length += (size_t)(termpos - data);
+	data = termpos;
 
 	if(data < end && data[0] == '?')
 	{
@@ -331,6 +526,19 @@ static inline const char* _body_data(parser_state_t* state, const char* data, co
 
 	if(internal->code & _STATE_PENDING)
 	{
+		if(state->chunked)
+		{
+			_transite_state(state, _STATE_CHUNK_SIZE);
+			return data;
+		}
+
+		if(state->content_length > internal->body_limit)
+		{
+			LOG_NOTICE("Rejecting the request body of %"PRIu64" bytes, which is larger than the limit", state->content_length);
+			_transite_state(state, _STATE_ERROR);
+			return data;
+		}
+
 		if(state->content_length > 0)
 		{
 			if(NULL == (state->body.value = (char*)malloc(state->content_length + 1)))
@@ -355,6 +563,115 @@ static inline const char* _body_data(parser_state_t* state, const char* data, co
 	return data + bytes_to_copy;
 }
 
+static inline const char* _chunk_size(parser_state_t* state, const char* data, const char* end)
+{
+	_state_t* internal = (_state_t*)state->internal_state;
+
+	if(internal->code & _STATE_PENDING)
+	{
+		internal->chunk_size = 0;
+		internal->sub_state = 0;
+		internal->code ^= _STATE_PENDING;
+	}
+
+	for(;data < end; data ++)
+	{
+		char ch = data[0];
+		uint64_t digit;
+		if(ch >= '0' && ch <= '9')
+			digit = (uint64_t)(ch - '0');
+		else if((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f')
+			digit = (uint64_t)((ch | 0x20) - 'a' + 10);
+		else break;
+
+		/* We don't accept any chunk which is larger than 2^60 bytes */
+		if(internal->sub_state ++ >= 15)
+		{
+			_transite_state(state, _STATE_ERROR);
+			return data;
+		}
+
+		internal->chunk_size = (internal->chunk_size << 4) | digit;
+
+		/* Reject the chunk as soon as the decoded body can not fit the limit, before anything is allocated for it */
+		if(internal->chunk_size > internal->body_limit - internal->body_size)
+		{
+			LOG_NOTICE("Rejecting the chunked request body, which is larger than the limit");
+			_transite_state(state, _STATE_ERROR);
+			return data;
+		}
+	}
+
+	if(data == end) return data;
+
+	if(internal->sub_state == 0)
+		_transite_state(state, _STATE_ERROR);
+	else if(data[0] == '\r')
+		_transite_state(state, _STATE_CHUNK_SIZE_END);
+	else if(data[0] == ';' || data[0] == ' ' || data[0] == '\t')
+		_transite_state(state, _STATE_CHUNK_EXT);
+	else
+		_transite_state(state, _STATE_ERROR);
+
+	return data;
+}
+
+static inline const char* _chunk_data(parser_state_t* state, const char* data, const char* end)
+{
+	_state_t* internal = (_state_t*)state->internal_state;
+
+	if(internal->code & _STATE_PENDING)
+	{
+		/* The zero sized chunk is the last chunk */
+		if(internal->chunk_size == 0)
+		{
+			_transite_state(state, _STATE_CHUNK_TRAILER);
+			return data;
+		}
+
+		/* Each chunk is decoded to its own buffer, thus the decoded body is never copied once it's received */
+		parser_chunk_t* chunk = (parser_chunk_t*)malloc(sizeof(parser_chunk_t) + internal->chunk_size);
+		if(NULL == chunk)
+			ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the body chunk");
+
+		chunk->next = NULL;
+		chunk->size = 0;
+
+		if(NULL == internal->body_tail) state->body_chunks = chunk;
+		else internal->body_tail->next = chunk;
+		internal->body_tail = chunk;
+
+		internal->code ^= _STATE_PENDING;
+	}
+
+	size_t bytes_to_copy = (size_t)(end - data);
+	if(bytes_to_copy > internal->chunk_size)
+		bytes_to_copy = (size_t)internal->chunk_size;
+
+	memcpy(internal->body_tail->data + internal->body_tail->size, data, bytes_to_copy);
+	internal->body_tail->size += bytes_to_copy;
+	internal->body_size += bytes_to_copy;
+	internal->chunk_size -= bytes_to_copy;
+
+	if(internal->chunk_size == 0)
+		_transite_state(state, _STATE_CHUNK_DATA_END);
+
+	return data + bytes_to_copy;
+}
+
+static inline const char* _chunk_trailer(parser_state_t* state, const char* data, const char* end)
+{
+	(void)end;
+
+	/* The empty line ends the body, otherwise it's a trailer field which we don't care about */
+	if(data[0] == '\r')
+		_transite_state(state, _STATE_CHUNK_END);
+	else
+		_transite_state(state, _STATE_CHUNK_TRAILER_LINE);
+
+	return data;
+}
+
 static inline const char* _ignore(parser_state_t* state, const char* data, const char* end)
 {
 	_state_t* internal = (_state_t*)state->internal_state;
@@ -420,55 +737,53 @@ static inline const char* _literal(parser_state_t* state, const char* data, cons
 	return data;
 }
 
-static inline const char* _literal_ci(parser_state_t* state, const char* data, const char* end)
+static inline const char* _init(parser_state_t* state, const char* data, const char* end)
 {
-	_state_t* internal = (_state_t*)state->internal_state;
-	const _state_desc_t* si = _state_info + (internal->code & _STATE_CODE_MASK);
+	(void)end;
+	_state_code_t next = _STATE_ERROR;
 
-	if(internal->code & _STATE_PENDING)
+	switch(data[0])
 	{
-		internal->sub_state = 0;
-		internal->code ^= _STATE_PENDING;
+		case 'G':
+			next = _STATE_METHOD_GET;
+			state->method = PARSER_METHOD_GET;
+			break;
+		case 'P':
+			next = _STATE_METHOD_P;
+			break;
+		case 'H':
+			next = _STATE_METHOD_HEAD;
+			state->method = PARSER_METHOD_HEAD;
+			break;
+		case 'D':
+			next = _STATE_METHOD_DELETE;
+			state->method = PARSER_METHOD_DELETE;
+			break;
 	}
 
-	const char* to_match = si->param.liter.str;
-
-	for(;data < end && to_match[internal->sub_state] != 0; data ++, internal->sub_state ++)
-	{
-		char ch = data[0];
-		if(ch >= 'A' && ch <= 'Z')
-			ch |= 0x20;
-		if(to_match[internal->sub_state] != ch)
-		{
-			_transite_state(state, si->fail);
-			return data;
-		}
-	}
-	if(to_match[internal->sub_state] == 0)
-		_transite_state(state, si->next);
+	_transite_state(state, next);
 
-	return data;
+	return data + 1;
 }
 
-static inline const char* _init(parser_state_t* state, const char* data, const char* end)
+static inline const char* _method_p(parser_state_t* state, const char* data, const char* end)
 {
 	(void)end;
 	_state_code_t next = _STATE_ERROR;
 
 	switch(data[0])
 	{
-		case 'G':
-			next = _STATE_METHOD_GET;
-			state->method = PARSER_METHOD_GET;
-			break;
-		case 'P':
-			/* TODO: We also needs to handle PUT method later */
+		case 'O':
 			next = _STATE_METHOD_POST;
 			state->method = PARSER_METHOD_POST;
 			break;
-		case 'H':
-			next = _STATE_METHOD_HEAD;
-			state->method = PARSER_METHOD_HEAD;
+		case 'U':
+			next = _STATE_METHOD_PUT;
+			state->method = PARSER_METHOD_PUT;
+			break;
+		case 'A':
+			next = _STATE_METHOD_PATCH;
+			state->method = PARSER_METHOD_PATCH;
 			break;
 	}
 
@@ -558,99 +873,299 @@ static inline const char* _field_value(parser_state_t* state, const char* data,
 			return _connection(state, data, end);
 		case _FIELD_NAME_CL:
 			return _content_length(state, data, end, reset);
+		case _FIELD_NAME_TE:
+			_transite_state(state, _STATE_FIELD_VAL_TE);
+			return data;
+		case _FIELD_NAME_CAPTURE:
+			/* Like the host field, we only take the first one */
+			if(state->captured[internal->capture_idx].value != NULL)
+				_transite_state(state, _STATE_FIELD_NOT_INST);
+			else
+				_transite_state(state, _STATE_FIELD_VAL_CAPTURE);
+			return data;
 		default:
-			_transite_state(state, _STATE_FIELD_VAL_HOST);
+			_transite_state(state, _STATE_FIELD_NOT_INST);
 			return data;
 	}
 }
 
-static inline const char* _field_name_init(parser_state_t* state, const char* data, const char* end)
+static inline const char* _field_val_te(parser_state_t* state, const char* data, const char* end)
 {
 	_state_t* internal = (_state_t*)state->internal_state;
 
 	if(internal->code & _STATE_PENDING)
 	{
-		internal->fn_state = _FIELD_NAME_UNKNOWN;
+		internal->token_len = 0;
 		internal->code ^= _STATE_PENDING;
 	}
 
-	if(internal->fn_state == _FIELD_NAME_UNKNOWN)
+	const char* termpos = _scan(data, end, '\r', '\r');
+	size_t size = (size_t)(termpos - data);
+
+	if(internal->token_len + size > sizeof(internal->token))
 	{
-		if(data[0] == 'r' || data[0] == 'R')
-		{
-			_transite_state(state, _STATE_FIELD_NAME_RANGE);
-			internal->fn_state = _FIELD_NAME_RANGE;
-			return data + 1;
-		}
-		else if(data[0] == 'a' || data[0] == 'A')
-		{
-			_transite_state(state, _STATE_FIELD_NAME_ACCEPT_ENC);
-			internal->fn_state = _FIELD_NAME_ACCEPT_ENCODING;
-			return data + 1;
-		}
-		else if(data[0] == 'h' || data[0] == 'H')
-		{
-			_transite_state(state, _STATE_FIELD_NAME_HOST);
-			internal->fn_state = _FIELD_NAME_HOST;
-			return data + 1;
-		}
-		else if(data[0] == 'c' || data[0] == 'C')
-		{
-			internal->fn_state = _FIELD_NAME_CON_OR_CL;
-			internal->sub_state = 0;
-		}
-		else if(data[0] == '\r')
-		{
-			/* If we just see another \r, this means we are going to parse the body */
-			_transite_state(state, _STATE_BODY_BEGIN);
-			return data;
-		}
-		else
+		_transite_state(state, _STATE_ERROR);
+		return data;
+	}
+
+	memcpy(internal->token + internal->token_len, data, size);
+	internal->token_len += size;
+
+	if(termpos < end)
+	{
+		/* We are not able to determine the body size if the body is encoded but not chunked */
+		if(!_is_chunked(internal->token, internal->token_len))
 		{
-			/* This means we just in some field that we do not interested in */
-			_transite_state(state, _STATE_FIELD_NOT_INST);
-			return data + 1;
+			_transite_state(state, _STATE_ERROR);
+			return termpos;
 		}
+
+		state->chunked = 1;
+		_transite_state(state, _STATE_FIELD_LINE_END);
+	}
+
+	return termpos;
+}
+
+static inline const char* _field_name_init(parser_state_t* state, const char* data, const char* end)
+{
+	(void)end;
+
+	/* If we just see another \r, this means we are going to parse the body */
+	if(data[0] == '\r')
+		_transite_state(state, _STATE_BODY_BEGIN);
+	else
+		_transite_state(state, _STATE_FIELD_NAME);
+
+	return data;
+}
+
+static inline const char* _field_name(parser_state_t* state, const char* data, const char* end)
+{
+	_state_t* internal = (_state_t*)state->internal_state;
+
+	if(internal->code & _STATE_PENDING)
+	{
+		internal->token_len = 0;
+		internal->code ^= _STATE_PENDING;
 	}
 
-	if(internal->fn_state == _FIELD_NAME_CON_OR_CL)
+	const char* termpos = _scan(data, end, ':', '\r');
+	size_t size = (size_t)(termpos - data);
+
+	/* If the name is longer than the token buffer, it can not be any field we are interested */
+	if(internal->token_len + size <= sizeof(internal->token))
+		memcpy(internal->token + internal->token_len, data, size);
+	internal->token_len += size;
+
+	if(termpos == end) return end;
+
+	/* The line without the delimiter is a field we are not interested */
+	if(termpos[0] == '\r')
 	{
-		for(;data < end && internal->sub_state < 3; data++)
-		{
-			static const char common[] = "con";
-			char ch = data[0];
-			if(ch >= 'A' && ch <= 'Z')
-				ch |= 0x20;
+		_transite_state(state, _STATE_FIELD_LINE_END);
+		return termpos;
+	}
 
-			if(common[internal->sub_state] == ch)
-				internal->sub_state ++;
-			else
-			{
-				_transite_state(state, _STATE_FIELD_NOT_INST);
-				return data + 1;
-			}
+	internal->fn_state = _FIELD_NAME_UNKNOWN;
+	if(internal->token_len <= sizeof(internal->token))
+	{
+		_range_t name = {.begin = internal->token, .end = internal->token + internal->token_len};
+		internal->fn_state = _field_name_lookup(internal, &name, &internal->capture_idx);
+	}
+
+	_transite_state(state, _STATE_FIELD_KV_SEP);
+
+	return termpos + 1;
+}
+
+/**
+ * @brief Copy the range to a newly allocated string
+ * @param str The target string
+ * @param range The range to copy
+ * @return status code
+ **/
+static inline int _fast_copy(parser_string_t* str, const _range_t* range)
+{
+	if(NULL == range->begin) return 0;
+
+	size_t size = (size_t)(range->end - range->begin);
+
+	if(NULL == (str->value = (char*)malloc(size + 1)))
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the string");
+
+	memcpy(str->value, range->begin, size);
+	str->value[size] = 0;
+	str->length = size;
+
+	return 0;
+}
+
+/**
+ * @brief The single pass parser for the request which has the complete header in the buffer
+ * @details This is the fast path of the parser, instead of running the state machine byte by byte, we find the
+ *          delimiters with the vectorized scanner and parse the entire request line and the fields in one pass. <br/>
+ *          We only handle the common case here, the full URI, the invalid request and the request which is
+ *          not complete in this buffer are left to the state machine, and we don't touch the parser state
+ *          until we know the fast path is able to handle the request, thus the state machine can always
+ *          start over if the fast path gives up.
+ * @param state The parser state, which should be a newly created one
+ * @param data The data buffer
+ * @param end The end of the data buffer
+ * @param next The buffer used to return where the header ends
+ * @return 1 if the header has been parsed, 0 if we should use the state machine, error code on error
+ **/
+static inline int _parse_header_fast(parser_state_t* state, const char* data, const char* end, const char** next)
+{
+	_state_t* internal = (_state_t*)state->internal_state;
+	parser_method_t method;
+	_range_t path = {}, query = {}, host = {}, accept_encoding = {}, range = {};
+	_range_t captured[PARSER_CAPTURE_MAX] = {};
+	uint64_t content_length = 0;
+	int keep_alive = 1, chunked = 0;
+
+	if(end - data >= 4 && memcmp(data, "GET ", 4) == 0)
+		method = PARSER_METHOD_GET, data += 4;
+	else if(end - data >= 5 && memcmp(data, "POST ", 5) == 0)
+		method = PARSER_METHOD_POST, data += 5;
+	else if(end - data >= 5 && memcmp(data, "HEAD ", 5) == 0)
+		method = PARSER_METHOD_HEAD, data += 5;
+	else if(end - data >= 4 && memcmp(data, "PUT ", 4) == 0)
+		method = PARSER_METHOD_PUT, data += 4;
+	else if(end - data >= 7 && memcmp(data, "DELETE ", 7) == 0)
+		method = PARSER_METHOD_DELETE, data += 7;
+	else if(end - data >= 6 && memcmp(data, "PATCH ", 6) == 0)
+		method = PARSER_METHOD_PATCH, data += 6;
+	else return 0;
+
+	for(;data < end && (data[0] == ' ' || data[0] == '\t'); data ++);
+
+	if(data >= end || data[0] != '/') return 0;
+
+	path.begin = data;
+	path.end = data = _scan(data, end, '?', ' ');
+	if(data >= end || path.end - path.begin > 2047) return 0;
+
+	if(data[0] == '?')
+	{
+		query.begin = ++ data;
+		query.end = data = _scan(data, end, ' ', ' ');
+		if(data >= end || query.end - query.begin > 2047) return 0;
+	}
+
+	/* We don't care about the HTTP version, so just skip to the end of the request line */
+	data = _scan(data, end, '\r', '\r');
+	if(end - data < 2 || data[1] != '\n') return 0;
+	data += 2;
+
+	for(;;)
+	{
+		if(data >= end) return 0;
+
+		if(data[0] == '\r')
+		{
+			if(end - data < 2 || data[1] != '\n') return 0;
+			data += 2;
+			break;
 		}
 
-		if(data == end) return end;
-		switch(data[0])
+		_range_t name = {.begin = data};
+		name.end = data = _scan(data, end, ':', '\r');
+		if(data >= end) return 0;
+
+		const char* value = data;
+		if(data[0] == ':')
+			for(value = data + 1; value < end && (value[0] == ' ' || value[0] == '\t'); value ++);
+
+		const char* line_end = _scan(value, end, '\r', '\r');
+		if(end - line_end < 2 || line_end[1] != '\n') return 0;
+		data = line_end + 2;
+
+		/* The line without the delimiter is a field we are not interested */
+		if(name.end[0] != ':') continue;
+
+		size_t value_size = (size_t)(line_end - value);
+		uint32_t idx;
+
+		switch(_field_name_lookup(internal, &name, &idx))
 		{
-			case 'n':
-				internal->fn_state = _FIELD_NAME_CONN;
-				_transite_state(state, _STATE_FIELD_NAME_CONNECT);
-				return data + 1;
-			case 't':
-				internal->fn_state = _FIELD_NAME_CL;
-				_transite_state(state, _STATE_FIELD_NAME_CONTENT_LEN);
-				return data + 1;
+			case _FIELD_NAME_HOST:
+				if(NULL != host.begin) continue;
+				if(value_size > 63) return 0;
+				host.begin = value;
+				host.end = line_end;
+				break;
+			case _FIELD_NAME_ACCEPT_ENCODING:
+				if(value_size > 63) return 0;
+				accept_encoding.begin = value;
+				accept_encoding.end = line_end;
+				break;
+			case _FIELD_NAME_RANGE:
+				if(value_size > 63) return 0;
+				range.begin = value;
+				range.end = line_end;
+				break;
+			case _FIELD_NAME_CONN:
+				if(value_size >= 5 && memcmp(value, "close", 5) == 0)
+				{
+					if(value_size != 5) return 0;
+					keep_alive = 0;
+				}
+				break;
+			case _FIELD_NAME_CL:
+				content_length = 0;
+				for(;value < line_end && value[0] >= '0' && value[0] <= '9'; value ++)
+					content_length = content_length * 10ull + (unsigned)(value[0] - '0');
+				if(value != line_end) return 0;
+				break;
+			case _FIELD_NAME_TE:
+				/* Let the state machine reject the encoding we don't support */
+				if(value_size > sizeof(internal->token) || !_is_chunked(value, value_size)) return 0;
+				chunked = 1;
+				break;
+			case _FIELD_NAME_CAPTURE:
+				if(NULL != captured[idx].begin) continue;
+				if(value_size > _CAPTURE_LIMIT - 1) return 0;
+				captured[idx].begin = value;
+				captured[idx].end = line_end;
+				break;
 			default:
-				_transite_state(state, _STATE_FIELD_NOT_INST);
-				return data + 1;
+				break;
 		}
 	}
 
-	return NULL;
-}
+	/* At this point, we know this is a valid request header, so we can fill the parser state */
+	if(ERROR_CODE(int) == _fast_copy(&state->path, &path) ||
+	   ERROR_CODE(int) == _fast_copy(&state->query, &query) ||
+	   ERROR_CODE(int) == _fast_copy(&state->host, &host) ||
+	   ERROR_CODE(int) == _fast_copy(&state->accept_encoding, &accept_encoding) ||
+	   ERROR_CODE(int) == _fast_copy(&state->range_text, &range))
+		ERROR_RETURN_LOG(int, "Cannot copy the parsed string");
 
+	if(NULL != internal->capture)
+	{
+		uint32_t i;
+		for(i = 0; i < internal->capture->count; i ++)
+			if(ERROR_CODE(int) == _fast_copy(state->captured + i, captured + i))
+				ERROR_RETURN_LOG(int, "Cannot copy the captured field");
+	}
+
+	state->method = method;
+	state->keep_alive = (keep_alive != 0);
+	state->content_length = content_length;
+	state->chunked = (chunked != 0);
+
+	if(chunked)
+		_transite_state(state, _STATE_CHUNK_SIZE);
+	else if(content_length > 0)
+		_transite_state(state, _STATE_BODY_DATA);
+	else
+		internal->code = _STATE_DONE;
+
+	*next = data;
+
+	return 1;
+}
 
 static inline size_t _parse_next_buf(parser_state_t* state, const char* data, size_t size)
 {
@@ -658,6 +1173,15 @@ static inline size_t _parse_next_buf(parser_state_t* state, const char* data, si
 	const char* end = data + size;
 	_state_t* internal = (_state_t*)state->internal_state;
 
+	/* If this is the begining of the request, try the single pass parser first */
+	if(internal->code == _STATE_INIT)
+	{
+		int rc = _parse_header_fast(state, data, end, &data);
+		if(ERROR_CODE(int) == rc) return ERROR_CODE(size_t);
+		if(rc == 1 && internal->code == _STATE_DONE)
+			return (size_t)(data - begin);
+	}
+
 	while(data < end)
 	{
 		_state_type_t type = _state_info[internal->code & _STATE_CODE_MASK].type;
@@ -670,9 +1194,6 @@ static inline size_t _parse_next_buf(parser_state_t* state, const char* data, si
 				case _STATE_TYPE_LITER:
 					ret = _literal(state, data, end);
 					break;
-				case _STATE_TYPE_LITER_IC:
-					ret = _literal_ci(state, data, end);
-					break;
 				case _STATE_TYPE_COPY:
 					ret = _copy(state, data, end);
 					break;
@@ -709,6 +1230,27 @@ static inline size_t _parse_next_buf(parser_state_t* state, const char* data, si
 				case _STATE_FIELD_NAME_INIT:
 					ret = _field_name_init(state, data, end);
 					break;
+				case _STATE_FIELD_NAME:
+					ret = _field_name(state, data, end);
+					break;
+				case _STATE_FIELD_VAL_CAPTURE:
+					ret = _field_val_capture(state, data, end);
+					break;
+				case _STATE_FIELD_VAL_TE:
+					ret = _field_val_te(state, data, end);
+					break;
+				case _STATE_METHOD_P:
+					ret = _method_p(state, data, end);
+					break;
+				case _STATE_CHUNK_SIZE:
+					ret = _chunk_size(state, data, end);
+					break;
+				case _STATE_CHUNK_DATA:
+					ret = _chunk_data(state, data, end);
+					break;
+				case _STATE_CHUNK_TRAILER:
+					ret = _chunk_trailer(state, data, end);
+					break;
 				default:
 					(void)0;
 			}
@@ -716,7 +1258,7 @@ static inline size_t _parse_next_buf(parser_state_t* state, const char* data, si
 
 		data = ret;
 
-		if((internal->code & _STATE_CODE_MASK) == _STATE_BODY_DATA && state->content_length == state->body.length)
+		if((internal->code & _STATE_CODE_MASK) == _STATE_BODY_DATA && !state->chunked && state->content_length == state->body.length)
 			internal->code = _STATE_DONE;
 
 		if((internal->code & _STATE_CODE_MASK) == _STATE_DONE ||
@@ -730,7 +1272,7 @@ static inline size_t _parse_next_buf(parser_state_t* state, const char* data, si
 	return (size_t)(data - begin);
 }
 
-parser_state_t* parser_state_new()
+parser_state_t* parser_state_new(const parser_capture_t* capture, uint64_t max_body_size)
 {
 	(void)_state_info;
 	parser_state_t* ret = (parser_state_t*)calloc(sizeof(parser_state_t) + sizeof(_state_t), 1);
@@ -741,6 +1283,11 @@ parser_state_t* parser_state_new()
 	ret->empty = 1;
 	ret->keep_alive = 1;
 
+	_state_t* internal = (_state_t*)ret->internal_state;
+	if(NULL != capture && capture->count > 0)
+		internal->capture = capture;
+	internal->body_limit = max_body_size;
+
 	return ret;
 }
 
@@ -762,11 +1309,32 @@ int parser_state_free(parser_state_t* state)
 	_free_string(&state->body);
 	_free_string(&state->range_text);
 
+	uint32_t i;
+	for(i = 0; i < PARSER_CAPTURE_MAX; i ++)
+		_free_string(state->captured + i);
+
+	while(NULL != state->body_chunks)
+	{
+		parser_chunk_t* chunk = state->body_chunks;
+		state->body_chunks = chunk->next;
+		free(chunk);
+	}
+
 	free(state);
 
 	return 0;
 }
 
+int parser_chunk_free(void* data)
+{
+	if(NULL == data)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	free((char*)data - offsetof(parser_chunk_t, data));
+
+	return 0;
+}
+
 static inline uint64_t _parse_u64(const char* s)
 {
 	int empty = 1;
@@ -803,6 +1371,8 @@ size_t parser_process_next_buf(parser_state_t* state, const void* buf, size_t sz
 	}
 	else if((internal->code & _STATE_CODE_MASK) == _STATE_DONE)
 	{
+		internal->code = _STATE_DONE;
+
 		if(state->range_text.value != NULL)
 		{
 			char* unit = state->range_text.value;
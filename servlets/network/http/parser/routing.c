@@ -12,6 +12,7 @@
 #include <pstd.h>
 
 #include <trie.h>
+#include <parser.h>
 #include <routing.h>
 
 /**
@@ -167,7 +168,7 @@ int routing_map_set_default_http_upgrade(routing_map_t* map, uint32_t upgrade_en
 	return 0;
 }
 
-static inline int _init_rule_data(_rule_data_t* rd, pstd_type_model_t* type_model)
+static inline int _init_rule_data(_rule_data_t* rd, pstd_type_model_t* type_model, uint32_t n_headers)
 {
 	if(ERROR_CODE(pstd_type_accessor_t) == (rd->accessors.a_method = pstd_type_model_get_accessor(type_model, rd->p_out, "method")))
 		ERROR_RETURN_LOG(int, "Cannot get the type accessor for method");
@@ -193,12 +194,24 @@ static inline int _init_rule_data(_rule_data_t* rd, pstd_type_model_t* type_mode
 	if(ERROR_CODE(pstd_type_accessor_t) == (rd->accessors.a_body = pstd_type_model_get_accessor(type_model, rd->p_out, "body.token")))
 		ERROR_RETURN_LOG(int, "Cannot get the type accessor for body");
 
+	if(ERROR_CODE(pstd_type_accessor_t) == (rd->accessors.a_body_stream = pstd_type_model_get_accessor(type_model, rd->p_out, "body_stream.token")))
+		ERROR_RETURN_LOG(int, "Cannot get the type accessor for body stream");
+
+	uint32_t i;
+	for(i = 0; i < n_headers; i ++)
+	{
+		char field[32];
+		snprintf(field, sizeof(field), "headers[%u].token", i);
+		if(ERROR_CODE(pstd_type_accessor_t) == (rd->accessors.a_headers[i] = pstd_type_model_get_accessor(type_model, rd->p_out, field)))
+			ERROR_RETURN_LOG(int, "Cannot get the type accessor for %s", field);
+	}
+
 	return 0;
 }
 
-int routing_map_initialize(routing_map_t* map, pstd_type_model_t* type_model)
+int routing_map_initialize(routing_map_t* map, pstd_type_model_t* type_model, uint32_t n_headers)
 {
-	if(NULL == map || NULL == type_model)
+	if(NULL == map || NULL == type_model || n_headers > PARSER_CAPTURE_MAX)
 		ERROR_RETURN_LOG(int, "Invalid arguments");
 
 	if(map->index != NULL)
@@ -208,14 +221,14 @@ int routing_map_initialize(routing_map_t* map, pstd_type_model_t* type_model)
 	for(i = 0; i < map->n_rules; i ++)
 	{
 		_rule_data_t* rd = &map->rules[i].data;
-		if(ERROR_CODE(int) == _init_rule_data(rd, type_model))
+		if(ERROR_CODE(int) == _init_rule_data(rd, type_model, n_headers))
 			ERROR_RETURN_LOG(int, "Cannot initialize the rule data");
 	}
 
 	if(ERROR_CODE(pipe_t) == (map->default_rule.p_out = pipe_define("default", PIPE_OUTPUT, "plumber/std_servlet/network/http/parser/v0/RequestData")))
 		ERROR_RETURN_LOG(int, "Cannot create the default routing");
 
-	if(ERROR_CODE(int) == _init_rule_data(&map->default_rule, type_model))
+	if(ERROR_CODE(int) == _init_rule_data(&map->default_rule, type_model, n_headers))
 		ERROR_RETURN_LOG(int, "Cannot initialize the rule data");
 
 	trie_kv_pair_t* index_buf = (trie_kv_pair_t*)malloc(sizeof(trie_kv_pair_t) * map->n_rules);
@@ -11,11 +11,12 @@
 #include <pservlet.h>
 #include <pstd.h>
 #include <pstd/types/string.h>
+#include <pstd/types/ostream.h>
 
 #include <trie.h>
+#include <parser.h>
 #include <routing.h>
 #include <options.h>
-#include <parser.h>
 
 #define _TYPE_ROOT "plumber/std_servlet/network/http/parser/v0/"
 
@@ -31,8 +32,11 @@ typedef struct {
 	pstd_type_accessor_t a_error;                /*!< THe protocol error bits */
 
 	uint32_t           METHOD_GET;      /*!< The method code for GET */
-	uint32_t           METHOD_POST;     /*!< The method code for GET */
-	uint32_t           METHOD_HEAD;     /*!< The method code for GET */
+	uint32_t           METHOD_POST;     /*!< The method code for POST */
+	uint32_t           METHOD_HEAD;     /*!< The method code for HEAD */
+	uint32_t           METHOD_PUT;      /*!< The method code for PUT */
+	uint32_t           METHOD_DELETE;   /*!< The method code for DELETE */
+	uint32_t           METHOD_PATCH;    /*!< The method code for PATCH */
 
 	uint64_t           RANGE_SEEK_SET;  /*!< The constant used to represent the head of the file */
 	uint64_t           RANGE_SEEK_END;  /*!< THe constant used to represent the tail of the file */
@@ -71,12 +75,19 @@ static inline int _read_const_unsigned(const char* field, void* result, size_t s
 static int _init(uint32_t argc, char const* const* argv, void* ctxmem)
 {
 	uint32_t i;
-	static char const * const const_names[] = {"METHOD_GET", "METHOD_POST", "METHOD_HEAD", "SEEK_SET", "SEEK_END"};
-	static size_t const const_sizes[] = {sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint64_t), sizeof(uint64_t)};
+	static char const * const const_names[] = {
+		"METHOD_GET", "METHOD_POST", "METHOD_HEAD", "METHOD_PUT", "METHOD_DELETE", "METHOD_PATCH", "SEEK_SET", "SEEK_END"
+	};
+	static size_t const const_sizes[] = {
+		sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint64_t), sizeof(uint64_t)
+	};
 
 	ctx_t* ctx = (ctx_t*)ctxmem;
 
-	void* const_bufs[] = {&ctx->METHOD_GET, &ctx->METHOD_POST, &ctx->METHOD_HEAD, &ctx->RANGE_SEEK_SET, &ctx->RANGE_SEEK_END};
+	void* const_bufs[] = {
+		&ctx->METHOD_GET, &ctx->METHOD_POST, &ctx->METHOD_HEAD, &ctx->METHOD_PUT, &ctx->METHOD_DELETE, &ctx->METHOD_PATCH,
+		&ctx->RANGE_SEEK_SET, &ctx->RANGE_SEEK_END
+	};
 
 	memset(ctx, 0, sizeof(ctx_t));
 
@@ -101,7 +112,7 @@ static int _init(uint32_t argc, char const* const* argv, void* ctxmem)
 	if(NULL == (ctx->type_model = PSTD_TYPE_MODEL_BATCH_INIT(type_model)))
 		ERROR_RETURN_LOG(int, "Cannot create type model for the servlet");
 
-	if(ERROR_CODE(int) == routing_map_initialize(ctx->options.routing_map, ctx->type_model))
+	if(ERROR_CODE(int) == routing_map_initialize(ctx->options.routing_map, ctx->type_model, ctx->options.capture.count))
 		ERROR_RETURN_LOG(int, "Cannot initailize the routing map");
 
 	if(ERROR_CODE(int) == proto_init())
@@ -109,7 +120,7 @@ static int _init(uint32_t argc, char const* const* argv, void* ctxmem)
 
 	for(i = 0; i < sizeof(const_sizes) / sizeof(const_sizes[0]); i ++)
 		if(_read_const_unsigned(const_names[i], const_bufs[i], const_sizes[i]) == ERROR_CODE(int))
-			ERROR_LOG_GOTO(ERR, "Cannot read constant for GET method");
+			ERROR_LOG_GOTO(ERR, "Cannot read constant %s", const_names[i]);
 
 	int rc = ERROR_CODE(int);
 
@@ -177,6 +188,43 @@ static inline int _determine_routing(const ctx_t* ctx, const char* host, size_t
 	return state.done;
 }
 
+/**
+ * @brief Hand the decoded chunks of the chunked body to a RLS stream and write the stream token to the output
+ * @details The chunks are given to the stream as they are, thus the decoded body is never concatenated
+ * @param type_inst The type instance
+ * @param acc The accessor for the stream token
+ * @param state The parser state, the chunks are detached from the state once the stream takes them
+ * @return status code
+ **/
+static inline int _write_body_stream(pstd_type_instance_t* type_inst, pstd_type_accessor_t acc, parser_state_t* state)
+{
+	pstd_ostream_t* stream = pstd_ostream_new();
+	if(NULL == stream) ERROR_RETURN_LOG(int, "Cannot create the body stream");
+
+	while(NULL != state->body_chunks)
+	{
+		parser_chunk_t* chunk = state->body_chunks;
+		parser_chunk_t* next = chunk->next;
+
+		if(ERROR_CODE(int) == pstd_ostream_write_owner_pointer(stream, chunk->data, parser_chunk_free, chunk->size))
+			ERROR_LOG_GOTO(ERR, "Cannot write the body chunk to the stream");
+
+		state->body_chunks = next;
+	}
+
+	scope_token_t tok = pstd_ostream_commit(stream);
+	if(ERROR_CODE(scope_token_t) == tok)
+		ERROR_LOG_GOTO(ERR, "Cannot commit the body stream to RLS");
+
+	if(ERROR_CODE(int) == PSTD_TYPE_INST_WRITE_PRIMITIVE(type_inst, acc, tok))
+		ERROR_RETURN_LOG(int, "Cannot write the body stream token to the result pipe");
+
+	return 0;
+ERR:
+	pstd_ostream_free(stream);
+	return ERROR_CODE(int);
+}
+
 static int _exec(void* ctxmem)
 {
 	char _buffer[4096];
@@ -195,7 +243,7 @@ static int _exec(void* ctxmem)
 	int new_state = 0;
 	if(NULL == state)
 	{
-		if(NULL == (state = parser_state_new()))
+		if(NULL == (state = parser_state_new(&ctx->options.capture, ctx->options.max_body_size)))
 			ERROR_RETURN_LOG(int, "Cannot allocate memory for the new parser state");
 		new_state = 1;
 	}
@@ -228,7 +276,7 @@ static int _exec(void* ctxmem)
 		if(rc == 0)
 		{
 			buffer = _buffer;
-			if(ERROR_CODE(size_t) == (sz = pipe_read(ctx->p_input, buffer, sizeof(buffer))))
+			if(ERROR_CODE(size_t) == (sz = pipe_read(ctx->p_input, buffer, sizeof(_buffer))))
 				ERROR_LOG_GOTO(ERR, "Cannot read request data from pipe");
 		}
 
@@ -329,6 +377,15 @@ PARSER_DONE:
 		case PARSER_METHOD_HEAD:
 			method_code = ctx->METHOD_HEAD;
 			break;
+		case PARSER_METHOD_PUT:
+			method_code = ctx->METHOD_PUT;
+			break;
+		case PARSER_METHOD_DELETE:
+			method_code = ctx->METHOD_DELETE;
+			break;
+		case PARSER_METHOD_PATCH:
+			method_code = ctx->METHOD_PATCH;
+			break;
 		default:
 			ERROR_LOG_GOTO(ERR, "Code bug: Invalid method");
 	}
@@ -352,7 +409,7 @@ PARSER_DONE:
 		if(strncmp(modpath, tcp_prefix, sizeof(tcp_prefix) - 1) == 0)
 		{
 			/* If we got a plain HTTP requeset */
-			pstd_string_t* target_obj = pstd_string_new(32);
+			pstd_string_t* target_obj = pstd_string_new_arena(32);
 			if(NULL == target_obj)
 				ERROR_LOG_GOTO(ERR, "Cannot create target URL object");
 
@@ -408,6 +465,18 @@ UPGRADE_ERR:
 		ERROR_LOG_GOTO(ERR, "Cannot write the data body to the result pipe");
 	state->body.value = NULL;
 
+	if(state->chunked && ERROR_CODE(int) == _write_body_stream(type_inst, result.out->a_body_stream, state))
+		ERROR_LOG_GOTO(ERR, "Cannot write the body stream to the result pipe");
+
+	uint32_t i;
+	for(i = 0; i < ctx->options.capture.count; i ++)
+	{
+		if(state->captured[i].value != NULL &&
+		   ERROR_CODE(int) == pstd_string_transfer_commit_write(type_inst, result.out->a_headers[i], state->captured[i].value, state->captured[i].length))
+			ERROR_LOG_GOTO(ERR, "Cannot write the captured header field to the result pipe");
+		state->captured[i].value = NULL;
+	}
+
 	uint64_t begin = ctx->RANGE_SEEK_SET;
 	uint64_t end   = ctx->RANGE_SEEK_END;
 
@@ -0,0 +1,194 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <testenv.h>
+#include <parser.h>
+
+/**
+ * @brief The requests we feed to the parser
+ **/
+static const char* requests[] = {
+	"GET / HTTP/1.1\r\nHost: plumberserver.com\r\nAccept-Encoding: gzip, deflate, br\r\nConnection: keep-alive\r\n\r\n",
+	"GET /?a=3 HTTP/1.1\r\nhosT: abc.com\r\nAccept-Encoding: gzip\r\ncontent-length: 1\r\nConnection: keep-alive\r\n\r\n0\r\n",
+	"GET http://p.com/ HTTP/1.1\r\nUser-Agent: x\r\n\r\n",
+	"POST /upload/some/long/path/name/here.txt?x=1&y=2 HTTP/1.1\r\nHost: a\r\nContent-Length: 11\r\n\r\nhello worldGET / HTTP/1.1\r\n",
+	"HEAD /a HTTP/1.1\r\nHost: a\r\nHost: b\r\nRange: bytes=0-100\r\nConnection: close\r\n\r\n",
+	"HEAD /a HTTP/1.1\r\nHost: a\r\nConnection: closed\r\n\r\n",
+	"GET /a HTTP/1.1\r\nHost: a\r\nContent-Length: 12 \r\n\r\n",
+	"GET /a HTTP/1.1\r\nHost: a\r\nCONNECTION: close\r\n\r\n",
+	"GET    /b   HTTP/1.1\r\nX-Weird\r\n:\r\nHost:\t  x.com  \r\n\r\n",
+	"GET /a HTTP/1.1\r\nHost: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\r\n\r\n",
+	"PUT /a HTTP/1.1\r\nHost: a\r\n\r\n",
+	"GET /a HTTP/1.1\nHost: a\r\n\r\n",
+	"GET /a HTTP/1.1\r\nHost: a\r\nAccept-Encoding: br\r\nAccept-encoding: gzip\r\nRange: bytes=5-\r\n\r\n",
+	"GET /a HTTP/1.1\r\nHost: a\r\nContent-Length: 0\r\n\r\nGET /b HTTP/1.1\r\n",
+	"GET /a HTTP/1.1\r\nHost: a\r\n",
+	"GET /a HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\nab",
+	"GET /a\r\n\r\n",
+	"GET /ab?c HTTP/1.1\r\nHost: a\r\nConnection: Close\r\n\r\n",
+	"DELETE /a/b HTTP/1.1\r\nHost: a\r\nUser-Agent: curl/7.0\r\nuser-agent: dup\r\nX-Token: abc\r\n\r\n",
+	"PATCH /a HTTP/1.1\r\nHost: a\r\nContent-Length: 3\r\n\r\nxyz",
+	"PUT /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\nB;ext=1\r\n, chunked!!\r\n0\r\nX-Trailer: 1\r\n\r\nGET / HTTP/1.1\r\n",
+	"POST /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: gzip, Chunked \r\nContent-Length: 100\r\n\r\n0\r\n\r\n",
+	"POST /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: gzip\r\n\r\n0\r\n\r\n",
+	"POST /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n\r\n",
+	"POST /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcX\r\n",
+	"POST /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n1000000000000000\r\n",
+	"PUSH /a HTTP/1.1\r\nHost: a\r\n\r\n",
+	"DELETe /a HTTP/1.1\r\nHost: a\r\n\r\n",
+	"GET /a HTTP/1.1\r\nHost: a\r\nX-Token-Longer: no\r\nX-Token:\r\nUser-Agentx: no\r\n\r\n"
+};
+
+static char name_user_agent[] = "user-agent";
+static char name_token[] = "x-token";
+static parser_capture_t capture = {
+	.count = 2,
+	.names = {name_user_agent, name_token},
+	.sizes = {sizeof(name_user_agent) - 1, sizeof(name_token) - 1}
+};
+
+#define _STR(s) ((s).value != NULL ? (int)(s).length : 6), ((s).value != NULL ? (s).value : "(null)")
+
+/**
+ * @brief Dump everything the parser has got from the request to a string
+ **/
+static void _dump(const parser_state_t* s, size_t consumed, char* out, size_t size)
+{
+	if(s->error)
+	{
+		snprintf(out, size, "done=%d error=1", parser_state_done(s));
+		return;
+	}
+
+	int len = snprintf(out, size, "done=%d keep_alive=%d method=%d path=%.*s query=%.*s host=%.*s accept_encoding=%.*s "
+	                              "range=%d %"PRIu64" %"PRIu64" content_length=%"PRIu64" chunked=%d body=%.*s "
+	                              "captured=%.*s,%.*s consumed=%zu chunks=",
+	                   parser_state_done(s), s->keep_alive, s->method, _STR(s->path), _STR(s->query), _STR(s->host),
+	                   _STR(s->accept_encoding), s->has_range, s->range_begin, s->range_end, s->content_length, s->chunked,
+	                   (int)s->body.length, s->body.value != NULL ? s->body.value : "", _STR(s->captured[0]), _STR(s->captured[1]),
+	                   consumed);
+
+	/* Each chunk of the chunked body should be decoded to its own buffer, no matter how the data is split */
+	const parser_chunk_t* chunk;
+	for(chunk = s->body_chunks; NULL != chunk && len > 0 && (size_t)len < size; chunk = chunk->next)
+		len += snprintf(out + len, size - (size_t)len, "[%.*s]", (int)chunk->size, chunk->data);
+}
+
+/**
+ * @brief Feed the request to the parser chunk by chunk, and dump the result
+ * @note  The request header only goes through the vectorized scanner when it's completely in one chunk,
+ *        thus the chunk size of 1 makes the parser falls back to the byte level state machine
+ **/
+static int _parse(const char* req, size_t len, size_t chunk, char* out, size_t size)
+{
+	parser_state_t* s = parser_state_new(&capture, 0x1000000);
+	if(NULL == s) return ERROR_CODE(int);
+
+	size_t off = 0;
+	while(off < len && !parser_state_done(s))
+	{
+		size_t sz = len - off < chunk ? len - off : chunk;
+		size_t rc = parser_process_next_buf(s, req + off, sz);
+		if(ERROR_CODE(size_t) == rc)
+		{
+			parser_state_free(s);
+			return ERROR_CODE(int);
+		}
+		off += rc;
+		if(rc < sz) break;
+	}
+
+	_dump(s, off, out, size);
+
+	return parser_state_free(s);
+}
+
+int chunk_split(void)
+{
+	static char expected[4096], actual[4096];
+	size_t i, chunk;
+	for(i = 0; i < sizeof(requests) / sizeof(requests[0]); i ++)
+	{
+		size_t len = strlen(requests[i]);
+		ASSERT_OK(_parse(requests[i], len, 1, expected, sizeof(expected)), CLEANUP_NOP);
+		for(chunk = 2; chunk <= len + 1; chunk ++)
+		{
+			ASSERT_OK(_parse(requests[i], len, chunk, actual, sizeof(actual)), CLEANUP_NOP);
+			if(strcmp(expected, actual) != 0)
+				LOG_ERROR("Request #%zu with chunk size %zu\nexpected: %s\nactual: %s", i, chunk, expected, actual);
+			ASSERT_STREQ(expected, actual, CLEANUP_NOP);
+		}
+	}
+
+	return 0;
+}
+
+int chunk_list(void)
+{
+	static const char req[] = "POST /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n1;x\r\n \r\n5\r\nworld\r\n0\r\n\r\n";
+	static const char* const expected[] = {"hello", " ", "world"};
+	parser_state_t* s = parser_state_new(&capture, 0x1000000);
+	ASSERT_PTR(s, CLEANUP_NOP);
+
+	ASSERT(sizeof(req) - 1 == parser_process_next_buf(s, req, sizeof(req) - 1), goto ERR);
+	ASSERT(1 == parser_state_done(s), goto ERR);
+	ASSERT(s->chunked && NULL == s->body.value, goto ERR);
+
+	/* The body is not concatenated, each chunk is a separate buffer */
+	const parser_chunk_t* chunk = s->body_chunks;
+	size_t i;
+	for(i = 0; i < sizeof(expected) / sizeof(expected[0]); i ++, chunk = chunk->next)
+	{
+		ASSERT_PTR(chunk, goto ERR);
+		ASSERT(chunk->size == strlen(expected[i]) && memcmp(chunk->data, expected[i], chunk->size) == 0, goto ERR);
+	}
+	ASSERT(NULL == chunk, goto ERR);
+
+	/* The chunk detached from the state is disposed by its data section */
+	parser_chunk_t* head = s->body_chunks;
+	s->body_chunks = head->next;
+	ASSERT_OK(parser_chunk_free(head->data), goto ERR);
+
+	return parser_state_free(s);
+ERR:
+	parser_state_free(s);
+	return ERROR_CODE(int);
+}
+
+int random_path(void)
+{
+	static char req[8192], expected[16384], actual[16384];
+	int i;
+	srand(1);
+	for(i = 0; i < 2000; i ++)
+	{
+		size_t len = (size_t)snprintf(req, sizeof(req), "GET /");
+		size_t k, path_len = (size_t)rand() % 2100;
+		for(k = 0; k < path_len; k ++)
+		{
+			/* Make sure we have the delimiters the scanner looks for at random places */
+			int r = rand() % 40;
+			req[len ++] = r == 0 ? '?' : r == 1 ? ':' : r == 2 ? '\t' : (char)('a' + r % 26);
+		}
+		len += (size_t)snprintf(req + len, sizeof(req) - len, " HTTP/1.1\r\nHost: h%d\r\nX-%d: %d\r\nConnection: %s\r\n\r\n",
+		                        rand(), rand(), rand(), rand() % 2 ? "close" : "keep-alive");
+
+		ASSERT_OK(_parse(req, len, 1, expected, sizeof(expected)), CLEANUP_NOP);
+		ASSERT_OK(_parse(req, len, len, actual, sizeof(actual)), CLEANUP_NOP);
+		ASSERT_STREQ(expected, actual, CLEANUP_NOP);
+	}
+
+	return 0;
+}
+
+DEFAULT_SETUP;
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(chunk_split),
+    TEST_CASE(chunk_list),
+    TEST_CASE(random_path)
+TEST_LIST_END;
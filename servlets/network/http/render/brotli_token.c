@@ -0,0 +1,163 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#ifdef HAS_BROTLI
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <brotli/encode.h>
+
+#include <pservlet.h>
+#include <pstd.h>
+
+#include <pstd/mempool.h>
+#include <pstd/types/trans.h>
+
+#include <brotli_token.h>
+
+typedef struct {
+	uint32_t             data_source_eos:1;   /*!< Indicates we see end-of-stream marker from the data source */
+
+	BrotliEncoderState*  encoder;             /*!< The brotli encoder we are dealing with */
+	char*                input_buf;           /*!< The input buffer */
+	const uint8_t*       next_in;             /*!< The next byte in the input buffer we should compress */
+	size_t               avail_in;            /*!< The number of bytes remaining in the input buffer */
+} _processor_t;
+
+static uint32_t _page_size = 0;
+
+static pstd_trans_inst_t* _init(void* data)
+{
+	BrotliEncoderState* encoder = (BrotliEncoderState*)data;
+	_processor_t* ret = (_processor_t*)pstd_mempool_alloc(sizeof(_processor_t));
+
+	if(NULL == ret)
+		ERROR_LOG_GOTO(ERR, "Cannot allocate memory for the processor");
+
+	memset(ret, 0, sizeof(*ret));
+
+	ret->encoder = encoder;
+
+	if(NULL == (ret->input_buf = (char*)pstd_mempool_page_alloc()))
+		ERROR_LOG_GOTO(ERR, "Cannot allocate memory for the input buffer");
+
+	return (pstd_trans_inst_t*)ret;
+ERR:
+	if(NULL != ret)
+	{
+		if(NULL != ret->input_buf)
+			pstd_mempool_page_dealloc(ret->input_buf);
+		pstd_mempool_free(ret);
+	}
+	if(NULL != encoder)
+		BrotliEncoderDestroyInstance(encoder);
+	return NULL;
+}
+
+static size_t _feed(pstd_trans_inst_t* __restrict stream_proc, const void* __restrict in, size_t size)
+{
+	_processor_t* proc = (_processor_t*)stream_proc;
+
+	if(NULL == in)
+	{
+		proc->data_source_eos = 1;
+		return 0;
+	}
+
+	/* The encoder hasn't consumed the previous input yet */
+	if(proc->avail_in > 0)
+		return 0;
+
+	size_t ret = size;
+	if(ret > _page_size)
+		ret = _page_size;
+
+	memcpy(proc->input_buf, in, ret);
+
+	proc->next_in = (const uint8_t*)proc->input_buf;
+	proc->avail_in = ret;
+
+	return ret;
+}
+
+static size_t _fetch(pstd_trans_inst_t* __restrict stream_proc, void* __restrict out, size_t size)
+{
+	_processor_t* proc = (_processor_t*)stream_proc;
+
+	if(proc->data_source_eos && BrotliEncoderIsFinished(proc->encoder))
+		return 0;
+
+	uint8_t* next_out = (uint8_t*)out;
+	size_t avail_out = size;
+
+	BrotliEncoderOperation op = proc->data_source_eos ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+
+	/* The encoder may take the input to its internal buffer without producing any output,
+	 * so we keep going until it either produces something or runs out of the input */
+	do {
+		if(BROTLI_FALSE == BrotliEncoderCompressStream(proc->encoder, op, &proc->avail_in, &proc->next_in, &avail_out, &next_out, NULL))
+			ERROR_RETURN_LOG(size_t, "Brotli encoder returns an error");
+	} while(avail_out == size && (proc->avail_in > 0 || (op == BROTLI_OPERATION_FINISH && !BrotliEncoderIsFinished(proc->encoder))));
+
+	return size - avail_out;
+}
+
+static int _cleanup(pstd_trans_inst_t* stream_proc)
+{
+	int ret = 0;
+	_processor_t* proc = (_processor_t*)stream_proc;
+	if(NULL != proc->input_buf && ERROR_CODE(int) == pstd_mempool_page_dealloc(proc->input_buf))
+		ret = ERROR_CODE(int);
+
+	if(NULL != proc->encoder)
+		BrotliEncoderDestroyInstance(proc->encoder);
+
+	if(ERROR_CODE(int) == pstd_mempool_free(proc))
+		ret = ERROR_CODE(int);
+
+	return ret;
+}
+
+scope_token_t brotli_token_encode(scope_token_t data_token, int level)
+{
+	if(_page_size == 0) _page_size = (uint32_t)getpagesize();
+
+	if(ERROR_CODE(scope_token_t) == data_token || 0 == data_token || level < 0)
+		ERROR_RETURN_LOG(scope_token_t, "Invalid arguments");
+
+	if(level > BROTLI_MAX_QUALITY) level = BROTLI_MAX_QUALITY;
+
+	BrotliEncoderState* encoder = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+	if(NULL == encoder)
+		ERROR_RETURN_LOG(scope_token_t, "Cannot create the brotli encoder");
+
+	if(BROTLI_FALSE == BrotliEncoderSetParameter(encoder, BROTLI_PARAM_QUALITY, (uint32_t)level))
+		ERROR_LOG_GOTO(ERR, "Cannot set the brotli quality");
+
+	pstd_trans_desc_t desc = {
+		.data = encoder,
+		.init_func = _init,
+		.feed_func = _feed,
+		.fetch_func = _fetch,
+		.cleanup_func = _cleanup
+	};
+
+	pstd_trans_t* trans = pstd_trans_new(data_token, desc);
+	if(NULL == trans)
+		ERROR_LOG_GOTO(ERR, "Cannot create stream processor object");
+
+	scope_token_t result = pstd_trans_commit(trans);
+
+	if(ERROR_CODE(scope_token_t) == result)
+	{
+		pstd_trans_free(trans);
+		return ERROR_CODE(scope_token_t);
+	}
+
+	return result;
+ERR:
+	BrotliEncoderDestroyInstance(encoder);
+	return ERROR_CODE(scope_token_t);
+}
+#endif
@@ -0,0 +1,22 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+/**
+ * @brief The brotli RLS token wrapper
+ * @file network/http/render/include/brotli_token.h
+ **/
+#ifndef __BROTLI_TOKEN_H__
+#define __BROTLI_TOKEN_H__
+
+#ifdef HAS_BROTLI
+
+/**
+ * @brief Encode an original token to a brotli compressed data
+ * @param data_token The data token to encode
+ * @param level The compression level, which is the brotli quality from 0 to 11
+ * @return The result token
+ **/
+scope_token_t brotli_token_encode(scope_token_t data_token, int level);
+#endif
+
+#endif
@@ -28,6 +28,10 @@ typedef struct {
 	uint8_t       compress_level:4;   /*!< The compression level */
 	uint8_t       max_chunk_size;     /*!< The max chunk size in number of pages for a chunked encoding */
 
+	/* Compressed Variants */
+	uint8_t       precompressed:1;    /*!< If we should serve the precompressed file, for example, index.html.gz */
+	size_t        variant_cache_size; /*!< The max number of bytes of the compressed variant cache, 0 means disabled */
+
 	/* Reverse Proxy */
 	uint8_t       reverse_proxy:1;    /*!< If this servlet should accept reverse proxy */
 
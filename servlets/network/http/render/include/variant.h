@@ -0,0 +1,78 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+/**
+ * @brief The compressed variants of the static files
+ * @details For a file body, we can avoid compressing the same content for each request, either
+ *          by serving the precompressed sibling file on the disk (for example, index.html.gz), or by
+ *          using the compressed content cached in memory. The cache is filled by the first compressed
+ *          response of the file, so the request that misses the cache doesn't wait for anything.
+ * @file network/http/render/include/variant.h
+ **/
+#ifndef __VARIANT_H__
+#define __VARIANT_H__
+
+/**
+ * @brief The content encoding of a variant
+ **/
+typedef enum {
+	VARIANT_ENCODING_GZIP,       /*!< The gzip encoding */
+	VARIANT_ENCODING_DEFLATE,    /*!< The deflate encoding */
+	VARIANT_ENCODING_BR          /*!< The brotli encoding */
+} variant_encoding_t;
+
+/**
+ * @brief The key of a compressed variant
+ * @note The file is identified by the device and inode number, and the variant is invalidated
+ *       once the modification time or the size of the file changes
+ **/
+typedef struct {
+	uint64_t           dev;         /*!< The device number of the file */
+	uint64_t           ino;         /*!< The inode number of the file */
+	int64_t            mtime_sec;   /*!< The modification time of the file */
+	int64_t            mtime_nsec;  /*!< The nanosecond part of the modification time */
+	uint64_t           size;        /*!< The size of the original file */
+	uint32_t           encoding;    /*!< The content encoding */
+	uint32_t           level;       /*!< The compression level */
+} variant_key_t;
+
+/**
+ * @brief The variant cache initialization function (Called from each servlet)
+ * @note The cache is a singleton shared between all the workers and servlets, and the memory
+ *       limit is the largest one requested by the servlets
+ * @param limit The max number of bytes the cache can hold
+ * @return status code
+ **/
+int variant_cache_init(size_t limit);
+
+/**
+ * @brief The variant cache finalization (Called from each servlet)
+ * @return status code
+ **/
+int variant_cache_finalize(void);
+
+/**
+ * @brief Find the compressed variant for the file body
+ * @param file_token The RLS token of the file body, which should be a file RLS object
+ * @param encoding The content encoding we want
+ * @param level The compression level
+ * @param precompressed If we should look for the precompressed sibling file on the disk
+ * @param cached If we should look for the variant in the cache
+ * @param key The buffer used to return the key of the variant, which is used to build the variant
+ *            when we can not find it
+ * @param size The buffer used to return the size of the variant
+ * @return The RLS token of the variant, 0 if there's no such variant, or error code
+ **/
+scope_token_t variant_find(scope_token_t file_token, variant_encoding_t encoding, uint32_t level,
+                           int precompressed, int cached, variant_key_t* key, size_t* size);
+
+/**
+ * @brief Wrap the compressed stream, so that the compressed content is put into the cache
+ *        once the stream is completely written
+ * @param compressed_token The RLS token of the compressed stream
+ * @param key The key of the variant returned by variant_find
+ * @return The RLS token of the wrapped stream, or error code
+ **/
+scope_token_t variant_build(scope_token_t compressed_token, const variant_key_t* key);
+
+#endif /* __VARIANT_H__ */
@@ -33,7 +33,7 @@ static int _opt_callback_no_val(pstd_option_data_t data)
 #endif
 
 #ifdef HAS_BROTLI
-		case 'b':
+		case 'B':
 			opt->br_enabled = 1;
 			opt->chunked_enabled = 1;
 			break;
@@ -44,6 +44,12 @@ static int _opt_callback_no_val(pstd_option_data_t data)
 		case 'P':
 			opt->reverse_proxy = 1;
 			break;
+		case 0:
+			if(strcmp("precompressed", data.current_option->long_opt) == 0)
+				opt->precompressed = 1;
+			else
+				ERROR_RETURN_LOG(int, "Invalid option");
+			break;
 		default:
 			ERROR_RETURN_LOG(int, "Invalid option");
 	}
@@ -65,9 +71,19 @@ static int _opt_callback_numeric(pstd_option_data_t data)
 		case 'L':
 			opt->compress_level = ((uint8_t)val & 0xfu);
 			break;
-		case 'S':
+		case 'C':
 			opt->max_chunk_size = ((uint8_t)val & 0xffu);
 			break;
+		case 0:
+			if(strcmp("variant-cache", data.current_option->long_opt) == 0)
+			{
+				if(val < 0)
+					ERROR_RETURN_LOG(int, "Invalid variant cache size");
+				opt->variant_cache_size = (size_t)val;
+			}
+			else
+				ERROR_RETURN_LOG(int, "Invalid option");
+			break;
 		default:
 			ERROR_RETURN_LOG(int, "Invalid option");
 	}
@@ -166,7 +182,7 @@ static pstd_option_t _options[] = {
 #ifdef HAS_BROTLI
 	{
 		.long_opt    = "br",
-		.short_opt   = 'b',
+		.short_opt   = 'B',
 		.pattern     = "",
 		.description = "Use BR compression",
 		.handler     = _opt_callback_no_val,
@@ -197,6 +213,20 @@ static pstd_option_t _options[] = {
 		.handler     = _opt_callback_numeric,
 		.args        = NULL
 	},
+	{
+		.long_opt    = "precompressed",
+		.pattern     = "",
+		.description = "Serve the precompressed file if it exists, for example, index.html.gz for index.html",
+		.handler     = _opt_callback_no_val,
+		.args        = NULL
+	},
+	{
+		.long_opt    = "variant-cache",
+		.pattern     = "I",
+		.description = "Cache the compressed file bodies in memory up to the given number of bytes",
+		.handler     = _opt_callback_numeric,
+		.args        = NULL
+	},
 	{
 		.long_opt    = "server-name",
 		.short_opt   = 's',
@@ -15,7 +15,9 @@
 
 #include <options.h>
 #include <zlib_token.h>
+#include <brotli_token.h>
 #include <chunked.h>
+#include <variant.h>
 
 enum {
 	_ENCODING_GZIP    = 1,
@@ -56,6 +58,7 @@ typedef struct {
 	uint32_t             BODY_CAN_COMPRESS;  /*!< Indicates if the body should be compressed */
 	uint32_t             BODY_SEEKABLE;      /*!< Indicates if we can seek the body */
 	uint32_t             BODY_RANGED;        /*!< Indicates if we got a ranged body */
+	uint32_t             BODY_FILE;          /*!< Indicates the body object is a file RLS */
 
 	uint32_t             PROTOCOL_ERROR_BAD_REQ;  /*!< Indicate we have got a bad request */
 } ctx_t;
@@ -95,6 +98,7 @@ static int _init(uint32_t argc, char const* const* argv, void* ctxmem)
 		PSTD_TYPE_MODEL_CONST(ctx->p_response,        BODY_CAN_COMPRESS,        ctx->BODY_CAN_COMPRESS),
 		PSTD_TYPE_MODEL_CONST(ctx->p_response,        BODY_SEEKABLE,            ctx->BODY_SEEKABLE),
 		PSTD_TYPE_MODEL_CONST(ctx->p_response,        BODY_RANGED,              ctx->BODY_RANGED),
+		PSTD_TYPE_MODEL_CONST(ctx->p_response,        BODY_FILE,                ctx->BODY_FILE),
 		PSTD_TYPE_MODEL_CONST(ctx->p_protocol_data,   ERROR_BAD_REQ,            ctx->PROTOCOL_ERROR_BAD_REQ)
 	};
 
@@ -109,6 +113,9 @@ static int _init(uint32_t argc, char const* const* argv, void* ctxmem)
 			ERROR_RETURN_LOG(int, "Cannot get the accessor for proxy.token");
 	}
 
+	if(ctx->opts.variant_cache_size > 0 && ERROR_CODE(int) == variant_cache_init(ctx->opts.variant_cache_size))
+		ERROR_RETURN_LOG(int, "Cannot initialize the compressed variant cache");
+
 	return 0;
 }
 
@@ -118,6 +125,9 @@ static int _unload(void* ctxmem)
 
 	int rc = 0;
 
+	if(ctx->opts.variant_cache_size > 0 && ERROR_CODE(int) == variant_cache_finalize())
+		rc = ERROR_CODE(int);
+
 	if(ERROR_CODE(int) == options_free(&ctx->opts))
 		rc = ERROR_CODE(int);
 
@@ -245,9 +255,8 @@ static inline int _write_string_field(pstd_bio_t* bio, pstd_type_instance_t* ins
  **/
 static inline uint32_t _determine_compression_algorithm(const ctx_t *ctx, pstd_type_instance_t* inst, int compress_enabled)
 {
-	if(pipe_eof(ctx->p_protocol_data) == 1)
-		return 0;
-
+	/* The protocol data header has been consumed by the protocol error check at this point, so pipe_eof
+	 * always returns true. For an empty protocol data pipe, we will get the default value anyway */
 	const char* accepts = pstd_string_get_data_from_accessor(inst, ctx->a_accept_enc, "");
 	if(NULL == accepts) ERROR_RETURN_LOG(uint32_t, "Cannot get the Accept-Encoding field");
 	const char* accepts_end = accepts + strlen(accepts);
@@ -568,7 +577,38 @@ static int _exec(void* ctxmem)
 	if(body_token != 0)
 	{
 #if defined(HAS_ZLIB) || defined(HAS_BROTLI)
-		if(0);
+		variant_key_t variant_key;
+		scope_token_t variant_token = 0;
+		size_t variant_size = 0;
+		int build_variant = 0;
+
+		/* For a file body, try the precompressed file or the cached compressed content first */
+		if((algorithm & _ENCODING_COMPRESSED) && (body_flags & ctx->BODY_FILE) && !(body_flags & ctx->BODY_RANGED) &&
+		   (ctx->opts.precompressed || ctx->opts.variant_cache_size > 0))
+		{
+			variant_encoding_t encoding = VARIANT_ENCODING_BR;
+			if((algorithm & _ENCODING_GZIP)) encoding = VARIANT_ENCODING_GZIP;
+			else if((algorithm & _ENCODING_DEFLATE)) encoding = VARIANT_ENCODING_DEFLATE;
+
+			variant_token = variant_find(body_token, encoding, ctx->opts.compress_level, ctx->opts.precompressed,
+			                             ctx->opts.variant_cache_size > 0, &variant_key, &variant_size);
+			if(ERROR_CODE(scope_token_t) == variant_token)
+			{
+				LOG_WARNING("Cannot find the compressed variant, compressing the body on the fly");
+				variant_token = 0;
+			}
+			else if(0 == variant_token)
+				build_variant = (ctx->opts.variant_cache_size > 0);
+		}
+
+		if(variant_token != 0)
+		{
+			/* The size of the variant is known, so we don't need the chunked encoding */
+			body_token = variant_token;
+			body_size = variant_size;
+			body_flags &= ~ctx->BODY_SIZE_UNKNOWN;
+			algorithm &= ~(uint32_t)_ENCODING_CHUNKED;
+		}
 #endif
 #ifdef HAS_ZLIB
 		else if((algorithm & _ENCODING_GZIP))
@@ -589,9 +629,17 @@ static int _exec(void* ctxmem)
 #ifdef HAS_BROTLI
 		else if((algorithm & _ENCODING_BR))
 		{
-			/* TODO: Brotli support */
+			if(ERROR_CODE(scope_token_t) == (body_token = brotli_token_encode(body_token, ctx->opts.compress_level)))
+				ERROR_LOG_GOTO(ERR, "Cannot encode the body with Brotli encoder");
+			else
+				body_flags |= ctx->BODY_SIZE_UNKNOWN;
 		}
 #endif
+#if defined(HAS_ZLIB) || defined(HAS_BROTLI)
+		/* Capture the compressed content while it's being written, so that the following requests can use it */
+		if(build_variant && ERROR_CODE(scope_token_t) == (body_token = variant_build(body_token, &variant_key)))
+			ERROR_LOG_GOTO(ERR, "Cannot build the compressed variant");
+#endif
 
 		if((body_flags & ctx->BODY_SIZE_UNKNOWN) && ctx->opts.chunked_enabled)
 			algorithm |= _ENCODING_CHUNKED;
@@ -607,7 +655,7 @@ static int _exec(void* ctxmem)
 
 	if(!(body_flags & ctx->BODY_SIZE_UNKNOWN))
 	{
-		if(ERROR_CODE(uint64_t) == (body_size = PSTD_TYPE_INST_READ_PRIMITIVE(uint64_t, type_inst, ctx->a_body_size)))
+		if(ERROR_CODE(uint64_t) == body_size && ERROR_CODE(uint64_t) == (body_size = PSTD_TYPE_INST_READ_PRIMITIVE(uint64_t, type_inst, ctx->a_body_size)))
 			ERROR_LOG_GOTO(ERR, "Cannot determine the size of the body");
 	}
 	else if(!(algorithm & _ENCODING_CHUNKED))
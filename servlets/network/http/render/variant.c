@@ -0,0 +1,610 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <utils/hash/murmurhash3.h>
+
+#include <pservlet.h>
+#include <pstd.h>
+
+#include <pstd/mempool.h>
+#include <pstd/fcache.h>
+#include <pstd/types/file.h>
+#include <pstd/types/trans.h>
+
+#include <variant.h>
+
+/**
+ * @brief The number of slots in the hash table
+ **/
+#define _HASH_SIZE 1021
+
+/**
+ * @brief A compressed variant in the cache
+ * @note The cache holds one reference to the entry, and each RLS object that serves the entry holds
+ *       another one. Thus an evicted entry is disposed when the last response using it is done.
+ **/
+typedef struct _entry_t {
+	variant_key_t       key;          /*!< The key of the variant */
+	uint64_t            hash[2];      /*!< The hash code of the file identity */
+	uint32_t            refcnt;       /*!< The reference counter */
+	size_t              size;         /*!< The size of the compressed content */
+	char*               data;         /*!< The compressed content */
+	struct _entry_t*    hash_next;    /*!< The next entry in the hash slot */
+	struct _entry_t*    lru_prev;     /*!< The previous entry in the LRU list */
+	struct _entry_t*    lru_next;     /*!< The next entry in the LRU list */
+} _entry_t;
+
+/**
+ * @brief The stream handle of a cached variant
+ **/
+typedef struct {
+	const _entry_t*     entry;        /*!< The entry we are reading */
+	size_t              offset;       /*!< The current read offset */
+} _stream_t;
+
+/**
+ * @brief The stream processor that captures the compressed content while it's being written
+ **/
+typedef struct {
+	uint32_t            overflow:1;   /*!< The content is too large to be cached */
+	variant_key_t*      key;          /*!< The key of the variant we are building */
+	char*               data;         /*!< The captured content */
+	size_t              size;         /*!< The size of the captured content */
+	size_t              capacity;     /*!< The capacity of the data buffer */
+	size_t              offset;       /*!< The number of bytes that has been fetched */
+} _builder_t;
+
+/**
+ * @brief The data for the cache structure
+ **/
+static struct {
+	size_t               limit;        /*!< The max number of bytes the cache can hold */
+	size_t               size;         /*!< The number of bytes the cache currently holds */
+	_entry_t*            lru_begin;    /*!< The most recently used entry */
+	_entry_t*            lru_end;      /*!< The least recently used entry */
+	_entry_t**           table;        /*!< The hash table */
+	uint32_t             init_count;   /*!< How many servlets are using the cache */
+	pthread_mutex_t      mutex;        /*!< The global cache mutex */
+} _cache;
+
+static uint32_t _page_size = 0;
+
+int variant_cache_init(size_t limit)
+{
+	if(_cache.limit < limit)
+		_cache.limit = limit;
+
+	if(_cache.init_count == 0)
+	{
+		if(NULL == (_cache.table = (_entry_t**)calloc(sizeof(_entry_t*), _HASH_SIZE)))
+			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the hash table");
+
+		if((errno = pthread_mutex_init(&_cache.mutex, NULL)) != 0)
+			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot initialize the variant cache mutex");
+
+		goto INIT_DONE;
+ERR:
+		if(NULL != _cache.table) free(_cache.table);
+		_cache.table = NULL;
+		return ERROR_CODE(int);
+	}
+INIT_DONE:
+
+	_cache.init_count ++;
+
+	return 0;
+}
+
+static inline void _entry_decref(_entry_t* entry)
+{
+	if(__sync_sub_and_fetch(&entry->refcnt, 1) > 0) return;
+
+	LOG_DEBUG("Compressed variant of inode %"PRIu64" has been disposed", entry->key.ino);
+
+	free(entry->data);
+	free(entry);
+}
+
+int variant_cache_finalize(void)
+{
+	int rc = 0;
+	if(_cache.init_count == 0) return 0;
+
+	if(0 == --_cache.init_count)
+	{
+		_entry_t* ptr;
+
+		for(ptr = _cache.lru_begin; ptr != NULL;)
+		{
+			_entry_t* this = ptr;
+			ptr = ptr->lru_next;
+			_entry_decref(this);
+		}
+
+		free(_cache.table);
+
+		_cache.table = NULL;
+		_cache.lru_begin = _cache.lru_end = NULL;
+		_cache.size = _cache.limit = 0;
+
+		if((errno = pthread_mutex_destroy(&_cache.mutex)) != 0)
+		{
+			LOG_ERROR_ERRNO("Cannot destroy the mutex");
+			rc = ERROR_CODE(int);
+		}
+	}
+	return rc;
+}
+
+static inline void _lru_remove(_entry_t* entry)
+{
+	if(entry->lru_prev == NULL)
+		_cache.lru_begin = entry->lru_next;
+	else
+		entry->lru_prev->lru_next = entry->lru_next;
+
+	if(entry->lru_next == NULL)
+		_cache.lru_end = entry->lru_prev;
+	else
+		entry->lru_next->lru_prev = entry->lru_prev;
+}
+
+static inline void _lru_add(_entry_t* entry)
+{
+	entry->lru_next = _cache.lru_begin;
+	entry->lru_prev = NULL;
+	if(_cache.lru_begin != NULL)
+		_cache.lru_begin->lru_prev = entry;
+	_cache.lru_begin = entry;
+	if(_cache.lru_end == NULL)
+		_cache.lru_end = entry;
+}
+
+/**
+ * @brief Compute the hash code of the file identity, which doesn't include the modification time and the size,
+ *        so that the outdated variant of the same file is always found and replaced
+ **/
+static inline uint32_t _hash(const variant_key_t* key, uint64_t* out)
+{
+	uint64_t identity[3] = {key->dev, key->ino, ((uint64_t)key->encoding << 32) | key->level};
+	murmurhash3_128(identity, sizeof(identity), 0x5d3f2a1bu, out);
+	return (uint32_t)((out[0] ^ out[1]) % _HASH_SIZE);
+}
+
+static inline int _same_file(const _entry_t* entry, const variant_key_t* key, const uint64_t* hash)
+{
+	return entry->hash[0] == hash[0] && entry->hash[1] == hash[1] &&
+	       entry->key.dev == key->dev && entry->key.ino == key->ino &&
+	       entry->key.encoding == key->encoding && entry->key.level == key->level;
+}
+
+static inline int _same_content(const _entry_t* entry, const variant_key_t* key)
+{
+	return entry->key.mtime_sec == key->mtime_sec && entry->key.mtime_nsec == key->mtime_nsec &&
+	       entry->key.size == key->size;
+}
+
+/**
+ * @brief Remove the entry from the cache, the caller should hold the cache mutex
+ * @param pos The pointer to the entry in the hash slot
+ **/
+static inline void _entry_remove(_entry_t** pos)
+{
+	_entry_t* entry = *pos;
+	*pos = entry->hash_next;
+	_lru_remove(entry);
+	_cache.size -= entry->size;
+	_entry_decref(entry);
+}
+
+/**
+ * @brief Find the entry that is for the same file, the caller should hold the cache mutex
+ **/
+static inline _entry_t** _entry_find(const variant_key_t* key, uint64_t* hash)
+{
+	_entry_t** pos;
+	for(pos = _cache.table + _hash(key, hash); NULL != *pos && !_same_file(*pos, key, hash); pos = &(*pos)->hash_next);
+	return pos;
+}
+
+/**
+ * @brief Put the captured content to the cache
+ * @param key The key of the variant
+ * @param data The captured content, the ownership is transferred to the cache
+ * @param size The size of the content
+ * @return status code
+ **/
+static inline int _cache_insert(const variant_key_t* key, char* data, size_t size)
+{
+	_entry_t* entry = (_entry_t*)malloc(sizeof(_entry_t));
+	if(NULL == entry)
+	{
+		free(data);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the cache entry");
+	}
+
+	entry->key = *key;
+	entry->refcnt = 1;
+	entry->size = size;
+	entry->data = data;
+
+	if((errno = pthread_mutex_lock(&_cache.mutex)) != 0)
+	{
+		_entry_decref(entry);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the cache mutex");
+	}
+
+	_entry_t** pos = _entry_find(key, entry->hash);
+
+	if(NULL != *pos && _same_content(*pos, key))
+	{
+		/* Another response has built the same variant already */
+		_entry_decref(entry);
+		entry = NULL;
+	}
+	else
+	{
+		if(NULL != *pos) _entry_remove(pos);
+
+		entry->hash_next = _cache.table[_hash(key, entry->hash)];
+		_cache.table[_hash(key, entry->hash)] = entry;
+		_lru_add(entry);
+		_cache.size += size;
+
+		while(_cache.size > _cache.limit && NULL != _cache.lru_end)
+		{
+			_entry_t* victim = _cache.lru_end;
+			uint64_t hash[2];
+			LOG_DEBUG("Evicting the compressed variant of inode %"PRIu64, victim->key.ino);
+			_entry_remove(_entry_find(&victim->key, hash));
+		}
+	}
+
+	if((errno = pthread_mutex_unlock(&_cache.mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the cache mutex");
+
+	return 0;
+}
+
+/**
+ * @brief Acquire the cached variant, the caller should hold the cache mutex
+ * @return The entry with its reference counter incremented, or NULL if the variant is not cached
+ **/
+static inline _entry_t* _cache_acquire(const variant_key_t* key)
+{
+	uint64_t hash[2];
+	_entry_t** pos = _entry_find(key, hash);
+
+	if(NULL == *pos) return NULL;
+
+	if(!_same_content(*pos, key))
+	{
+		LOG_DEBUG("The file of the compressed variant has been changed, removing the outdated one");
+		_entry_remove(pos);
+		return NULL;
+	}
+
+	_entry_t* ret = *pos;
+	__sync_fetch_and_add(&ret->refcnt, 1);
+
+	_lru_remove(ret);
+	_lru_add(ret);
+
+	return ret;
+}
+
+static int _entry_free(void* mem)
+{
+	_entry_decref((_entry_t*)mem);
+	return 0;
+}
+
+static void* _entry_open(const void* mem)
+{
+	_stream_t* ret = (_stream_t*)pstd_mempool_alloc(sizeof(_stream_t));
+	if(NULL == ret)
+		ERROR_PTR_RETURN_LOG("Cannot allocate memory for the stream");
+
+	ret->entry = (const _entry_t*)mem;
+	ret->offset = 0;
+
+	return ret;
+}
+
+static size_t _entry_read(void* __restrict handle, void* __restrict buf, size_t count)
+{
+	_stream_t* stream = (_stream_t*)handle;
+
+	size_t ret = stream->entry->size - stream->offset;
+	if(ret > count) ret = count;
+
+	memcpy(buf, stream->entry->data + stream->offset, ret);
+	stream->offset += ret;
+
+	return ret;
+}
+
+static int _entry_eos(const void* handle)
+{
+	const _stream_t* stream = (const _stream_t*)handle;
+	return stream->offset >= stream->entry->size;
+}
+
+static int _entry_close(void* handle)
+{
+	return pstd_mempool_free(handle);
+}
+
+/**
+ * @brief Serve the precompressed sibling file, for example, index.html.gz for index.html
+ * @return The RLS token for the sibling file, 0 if there's no such file, or error code
+ **/
+static inline scope_token_t _find_sibling(const char* filename, const struct stat* st, variant_encoding_t encoding, size_t* size)
+{
+	const char* suffix = NULL;
+	switch(encoding)
+	{
+		case VARIANT_ENCODING_GZIP:
+			suffix = ".gz";
+			break;
+		case VARIANT_ENCODING_BR:
+			suffix = ".br";
+			break;
+		default:
+			return 0;
+	}
+
+	char path[PATH_MAX];
+	size_t len = (size_t)snprintf(path, sizeof(path), "%s%s", filename, suffix);
+	if(len >= sizeof(path)) return 0;
+
+	struct stat sibling;
+	if(ERROR_CODE(int) == pstd_fcache_stat(path, &sibling) || !S_ISREG(sibling.st_mode))
+		return 0;
+
+	/* The sibling file which is older than the original file is outdated */
+	if(sibling.st_mtime < st->st_mtime)
+	{
+		LOG_DEBUG("Ignoring the outdated precompressed file %s", path);
+		return 0;
+	}
+
+	pstd_file_t* file = pstd_file_new(path);
+	if(NULL == file)
+		ERROR_RETURN_LOG(scope_token_t, "Cannot create the file object");
+
+	scope_token_t ret = pstd_file_commit(file);
+	if(ERROR_CODE(scope_token_t) == ret)
+	{
+		pstd_file_free(file);
+		ERROR_RETURN_LOG(scope_token_t, "Cannot commit the file object to scope");
+	}
+
+	*size = (size_t)sibling.st_size;
+
+	return ret;
+}
+
+scope_token_t variant_find(scope_token_t file_token, variant_encoding_t encoding, uint32_t level,
+                           int precompressed, int cached, variant_key_t* key, size_t* size)
+{
+	if(ERROR_CODE(scope_token_t) == file_token || 0 == file_token || NULL == key || NULL == size)
+		ERROR_RETURN_LOG(scope_token_t, "Invalid arguments");
+
+	const pstd_file_t* file = pstd_file_from_rls(file_token);
+	if(NULL == file)
+		ERROR_RETURN_LOG(scope_token_t, "Cannot get the file object from the RLS");
+
+	const char* filename = pstd_file_name(file);
+	if(NULL == filename)
+		ERROR_RETURN_LOG(scope_token_t, "Cannot get the file name");
+
+	struct stat st;
+	if(ERROR_CODE(int) == pstd_fcache_stat(filename, &st))
+		ERROR_RETURN_LOG(scope_token_t, "Cannot get the metadata of file %s", filename);
+
+	memset(key, 0, sizeof(*key));
+	key->dev = (uint64_t)st.st_dev;
+	key->ino = (uint64_t)st.st_ino;
+	key->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+	key->mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+	key->size = (uint64_t)st.st_size;
+	key->encoding = (uint32_t)encoding;
+	key->level = level;
+
+	if(precompressed)
+	{
+		scope_token_t ret = _find_sibling(filename, &st, encoding, size);
+		if(ret != 0) return ret;
+	}
+
+	if(!cached || _cache.init_count == 0) return 0;
+
+	if((errno = pthread_mutex_lock(&_cache.mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(scope_token_t, "Cannot acquire the cache mutex");
+
+	_entry_t* entry = _cache_acquire(key);
+
+	if((errno = pthread_mutex_unlock(&_cache.mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the cache mutex");
+
+	if(NULL == entry) return 0;
+
+	scope_entity_t ent = {
+		.data = entry,
+		.free_func = _entry_free,
+		.copy_func = NULL,
+		.open_func = _entry_open,
+		.close_func = _entry_close,
+		.eos_func = _entry_eos,
+		.read_func = _entry_read
+	};
+
+	scope_token_t ret = pstd_scope_add(&ent);
+	if(ERROR_CODE(scope_token_t) == ret)
+	{
+		_entry_decref(entry);
+		ERROR_RETURN_LOG(scope_token_t, "Cannot add the cached variant to the scope");
+	}
+
+	*size = entry->size;
+
+	return ret;
+}
+
+static pstd_trans_inst_t* _builder_init(void* data)
+{
+	_builder_t* ret = (_builder_t*)pstd_mempool_alloc(sizeof(_builder_t));
+	if(NULL == ret)
+	{
+		pstd_mempool_free(data);
+		ERROR_PTR_RETURN_LOG("Cannot allocate memory for the variant builder");
+	}
+
+	memset(ret, 0, sizeof(*ret));
+	ret->key = (variant_key_t*)data;
+
+	return (pstd_trans_inst_t*)ret;
+}
+
+static size_t _builder_feed(pstd_trans_inst_t* __restrict stream_proc, const void* __restrict in, size_t size)
+{
+	_builder_t* builder = (_builder_t*)stream_proc;
+
+	if(NULL == in)
+	{
+		if(builder->overflow || builder->offset < builder->size) return 0;
+
+		/* All the compressed content has been seen, so it's the time to put it into the cache */
+		char* data = builder->data;
+		if(builder->size > 0 && NULL != (data = (char*)realloc(builder->data, builder->size)))
+			builder->data = data;
+
+		LOG_DEBUG("The compressed variant of inode %"PRIu64" has been built, size = %zu", builder->key->ino, builder->size);
+
+		data = builder->data;
+		builder->data = NULL;
+		if(ERROR_CODE(int) == _cache_insert(builder->key, data, builder->size))
+			LOG_WARNING("Cannot put the compressed variant to the cache");
+
+		return 0;
+	}
+
+	/* The previous bytes haven't been fetched yet */
+	if(builder->offset < builder->size)
+		return 0;
+
+	/* When the content is too large to cache, we just use the buffer to pass the data through */
+	if(builder->overflow)
+		builder->offset = builder->size = 0;
+
+	if(size > _page_size) size = _page_size;
+
+	if(!builder->overflow && builder->size + size > _cache.limit)
+	{
+		LOG_DEBUG("The compressed variant of inode %"PRIu64" is too large to cache", builder->key->ino);
+		builder->overflow = 1;
+		builder->offset = builder->size = 0;
+	}
+
+	if(builder->size + size > builder->capacity)
+	{
+		size_t new_cap = builder->capacity == 0 ? _page_size : builder->capacity * 2;
+		while(new_cap < builder->size + size) new_cap *= 2;
+
+		char* new_data = (char*)realloc(builder->data, new_cap);
+		if(NULL == new_data)
+			ERROR_RETURN_LOG_ERRNO(size_t, "Cannot resize the capture buffer");
+
+		builder->data = new_data;
+		builder->capacity = new_cap;
+	}
+
+	memcpy(builder->data + builder->size, in, size);
+	builder->size += size;
+
+	return size;
+}
+
+static size_t _builder_fetch(pstd_trans_inst_t* __restrict stream_proc, void* __restrict out, size_t size)
+{
+	_builder_t* builder = (_builder_t*)stream_proc;
+
+	if(NULL == builder->data) return 0;
+
+	size_t ret = builder->size - builder->offset;
+	if(ret > size) ret = size;
+
+	memcpy(out, builder->data + builder->offset, ret);
+	builder->offset += ret;
+
+	return ret;
+}
+
+static int _builder_cleanup(pstd_trans_inst_t* stream_proc)
+{
+	_builder_t* builder = (_builder_t*)stream_proc;
+
+	if(NULL != builder->data) free(builder->data);
+
+	int rc = 0;
+	if(ERROR_CODE(int) == pstd_mempool_free(builder->key))
+		rc = ERROR_CODE(int);
+
+	if(ERROR_CODE(int) == pstd_mempool_free(builder))
+		rc = ERROR_CODE(int);
+
+	return rc;
+}
+
+scope_token_t variant_build(scope_token_t compressed_token, const variant_key_t* key)
+{
+	if(_page_size == 0) _page_size = (uint32_t)getpagesize();
+
+	if(ERROR_CODE(scope_token_t) == compressed_token || 0 == compressed_token || NULL == key)
+		ERROR_RETURN_LOG(scope_token_t, "Invalid arguments");
+
+	/* Nothing to do if the cache is disabled or the original file is too large */
+	if(_cache.init_count == 0 || key->size > _cache.limit)
+		return compressed_token;
+
+	variant_key_t* key_copy = (variant_key_t*)pstd_mempool_alloc(sizeof(variant_key_t));
+	if(NULL == key_copy)
+		ERROR_RETURN_LOG(scope_token_t, "Cannot allocate memory for the variant key");
+
+	*key_copy = *key;
+
+	pstd_trans_desc_t desc = {
+		.data = key_copy,
+		.init_func = _builder_init,
+		.feed_func = _builder_feed,
+		.fetch_func = _builder_fetch,
+		.cleanup_func = _builder_cleanup
+	};
+
+	pstd_trans_t* trans = pstd_trans_new(compressed_token, desc);
+	if(NULL == trans)
+	{
+		pstd_mempool_free(key_copy);
+		ERROR_RETURN_LOG(scope_token_t, "Cannot create stream processor object");
+	}
+
+	scope_token_t result = pstd_trans_commit(trans);
+
+	if(ERROR_CODE(scope_token_t) == result)
+	{
+		pstd_trans_free(trans);
+		return ERROR_CODE(scope_token_t);
+	}
+
+	return result;
+}
@@ -66,6 +66,8 @@ typedef struct {
 		uint32_t           METHOD_GET;             /*!< GET HTTP request */
 		uint32_t           METHOD_POST;            /*!< POST HTTP request */
 		uint32_t           METHOD_DELETE;          /*!< DELETE HTTP request */
+		uint32_t           METHOD_PUT;             /*!< PUT HTTP request */
+		uint32_t           METHOD_PATCH;           /*!< PATCH HTTP request */
 	}                      method_code;     /*!< The method code */
 	pstd_type_model_t*     model;           /*!< The type model */
 	pstd_type_accessor_t   method_acc;      /*!< The method accessor */
@@ -122,7 +124,9 @@ static int _init(uint32_t argc, char const* const* argv, void* ctxbuf)
 #define _READ_CONST_CHK(p, base, name) (ERROR_CODE(int) ==  _fill_const(ctx->model, ctx->p, #name, &ctx->base.name))
 	if(_READ_CONST_CHK(request, method_code, METHOD_GET) ||
 	   _READ_CONST_CHK(request, method_code, METHOD_POST) ||
-	   _READ_CONST_CHK(request, method_code, METHOD_DELETE))
+	   _READ_CONST_CHK(request, method_code, METHOD_DELETE) ||
+	   _READ_CONST_CHK(request, method_code, METHOD_PUT) ||
+	   _READ_CONST_CHK(request, method_code, METHOD_PATCH))
 		return ERROR_CODE(int);
 
 	if(ERROR_CODE(pstd_type_accessor_t) == (ctx->method_acc = pstd_type_model_get_accessor(ctx->model, ctx->request, "method")))
@@ -357,6 +361,15 @@ static int _exec(void* ctxbuf)
 		}
 
 	}
+	else if(method == ctx->method_code.METHOD_PUT || method == ctx->method_code.METHOD_PATCH)
+	{
+		/* Both of them modify an existing resource, we can not create a resource with a client specified id */
+		if(object_id != NULL)
+		{
+			storage_opcode = ctx->opcode.MODIFY;
+			parent_id = NULL;  /* we ignore the parent id in this case */
+		}
+	}
 	else if(method == ctx->method_code.METHOD_DELETE)
 	{
 		if(object_id != NULL)
@@ -414,7 +427,7 @@ static int _exec(void* ctxbuf)
 	if(path[0] != 0)
 	{
 		size_t len;
-		pstd_string_t* path_sfx = pstd_string_new(len = strlen(path));
+		pstd_string_t* path_sfx = pstd_string_new_arena(len = strlen(path));
 		if(NULL == path_sfx) ERROR_LOG_GOTO(EXIT, "Cannot create new PSTD string object for the suffix of the path");
 		if(ERROR_CODE(size_t) == pstd_string_write(path_sfx,  path, len))
 			ERROR_LOG_GOTO(PATH_SUFIX_ERR, "Cannot write the path suffix to the PSTD string object");
@@ -165,6 +165,8 @@ static int _traverse_type(proto_db_field_info_t info, void* data)
 		for(;d > 0; d /= 10, buf_size ++);
 	}
 
+	uint32_t first_op = td->json_model->nops;
+
 	if(ERROR_CODE(int) == _ensure_space(td->json_model))
 		ERROR_RETURN_LOG(int, "Cannot enough the output model has enough space");
 	td->json_model->ops[td->json_model->nops].opcode = JSON_MODEL_OPCODE_OPEN;
@@ -189,6 +191,19 @@ static int _traverse_type(proto_db_field_info_t info, void* data)
 	td->json_model->ops[td->json_model->nops].opcode = JSON_MODEL_OPCODE_CLOSE;
 	td->json_model->nops ++;
 
+	/* The field without anything we can write, for example a RLS object other than string, is dropped,
+	 * otherwise we produce a name without value */
+	for(i = first_op; i < td->json_model->nops && td->json_model->ops[i].opcode != JSON_MODEL_OPCODE_WRITE; i ++);
+	if(i == td->json_model->nops)
+	{
+		for(i = first_op; i < td->json_model->nops; i ++)
+		{
+			if(NULL != td->json_model->ops[i].field) free(td->json_model->ops[i].field);
+			memset(td->json_model->ops + i, 0, sizeof(json_model_op_t));
+		}
+		td->json_model->nops = first_op;
+	}
+
 	if(buf_size >= 256) free(buf);
 	return 0;
 ERR:
@@ -44,7 +44,7 @@ static int _exec(void* ctxbuf)
 	pstd_type_instance_t* inst = PSTD_TYPE_INSTANCE_LOCAL_NEW(ctx->type_model);
 	if(NULL == inst) ERROR_RETURN_LOG(int, "Cannot create the instance");
 
-	pstd_string_t* string = pstd_string_new(32);
+	pstd_string_t* string = pstd_string_new_arena(32);
 
 	for(;;)
 	{
@@ -2,116 +2,282 @@
  * Copyright (C) 2017, Hao Hou
  **/
 
+/**
+ * @brief The lock-free event queue implementation
+ * @details Each module token owns a single-producer single-consumer ring buffer, the producer and consumer
+ *          side of the ring are on different cache lines, so that the module thread and the scheduler won't
+ *          fight for the same cache line. <br/>
+ *          Instead of scanning all the queues, the scheduler side uses a readiness bitmap to find the
+ *          non-empty queues, each type of event has its own bitmap. <br/>
+ *          The thread which has nothing to do parks on a sequence number with futex (or a condition
+ *          variable emulation on the platform without futex), and the peer only issues the wake up syscall
+ *          when it knows somebody is parked.
+ * @note  The legacy implementation is still available when ITC_EQUEUE_LEGACY is set (see equeue_legacy.c)
+ * @file itc/equeue.c
+ **/
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <plumber.h>
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
 
 #include <error.h>
-#include <fallthrough.h>
 #include <barrier.h>
 #include <arch/arch.h>
 
-#include <utils/vector.h>
 #include <utils/static_assertion.h>
 #include <utils/log.h>
 
+#if !ITC_EQUEUE_LEGACY
 
+#ifdef __LINUX__
+#	include <unistd.h>
+#	include <sys/syscall.h>
+#	include <linux/futex.h>
+#endif
 
 /**
  * @brief the token used to identify the scheduler thread, which is 0xfffffffe, in order to distinguish with error code
  **/
 #define _SCHED_TOKEN (~(itc_equeue_token_t)(1))
 
+/**
+ * @brief The size of the cache line we assume
+ **/
+#define _CACHE_LINE_SIZE 64
+
+/**
+ * @brief The number of words in a readiness bitmap
+ **/
+#define _BITMAP_NWORDS ((ITC_EQUEUE_MAX_NUM_QUEUES + 63) / 64)
+
+/**
+ * @brief How long a thread can be parked before it recheck the state, in nanoseconds
+ **/
+#define _PARK_TIMEOUT_NS 1000000000l
+
 /** @brief the mutex used to lock the operation that change the equeue structure */
 static pthread_mutex_t _global_mutex;
 
-/** @brief what is the next thread token */
-static itc_equeue_token_t _next_token;
-
 /** @brief incidates if the scheduler token has been created, because we only allow call this function once */
 static int _sched_token_called;
 
 /**
  * @brief the queue for the single thread
+ * @note  The producer fields and the consumer fields are placed on different cache lines
  **/
 typedef struct {
-	itc_equeue_event_type_t type;        /*!< The event type in this queue (See the notes, although the event mask can
-	                                      *   describe multiple types, but we only allow 1 type set here) */
-	pthread_mutex_t   mutex;             /*!< the local mutex */
-	pthread_cond_t    put_cond;          /*!< the cond variable for equeue_put */
+	/******* The read-only part ********/
+	itc_equeue_event_type_t type;        /*!< The event type in this queue */
 	uint32_t          size;              /*!< the size of the queue */
-	uint32_t          front;             /*!< the next avaliable location to write, only module thread with that token can access this */
-	uint32_t          rear;              /*!< the next avaliable lication to read, only module thread with schudler token can access this */
+	uint32_t          token;             /*!< the token of this queue */
+	char              __pad0__[_CACHE_LINE_SIZE - 3 * sizeof(uint32_t)];
+	/******* The producer part *********/
+	uint32_t          rear;              /*!< the next avaliable location to write, only module thread with that token can modify this */
+	uint32_t          front_cache;       /*!< the producer's copy of front, so that we don't need to touch the consumer's cache line */
+	uint32_t          put_waiting;       /*!< indicates if the producer is parked because the queue is full */
+	uint32_t          space_seq;         /*!< the sequence number the producer parks on */
+	char              __pad1__[_CACHE_LINE_SIZE - 4 * sizeof(uint32_t)];
+	/******* The consumer part *********/
+	uint32_t          front;             /*!< the next avaliable location to read, only the thread with the scheudler token can modify this */
+	char              __pad2__[_CACHE_LINE_SIZE - sizeof(uint32_t)];
 	uintpad_t         __padding__[0];
 	itc_equeue_event_t events[0];        /*!< the event list */
 } _queue_t;
 
 STATIC_ASSERTION_LAST(_queue_t, events);
 STATIC_ASSERTION_SIZE(_queue_t, events, 0);
+STATIC_ASSERTION_EQ_ID(_queue_rear_cache_line, offsetof(_queue_t, rear) % _CACHE_LINE_SIZE, 0);
+STATIC_ASSERTION_EQ_ID(_queue_front_cache_line, offsetof(_queue_t, front) % _CACHE_LINE_SIZE, 0);
+
+/**
+ * @brief All the queues, indexed by the token
+ **/
+static _queue_t* _queues[ITC_EQUEUE_MAX_NUM_QUEUES];
+
+/**
+ * @brief The number of queues that has been created
+ **/
+static uint32_t _nqueues;
 
-static vector_t* _queues;
+/**
+ * @brief The readiness bitmap for each type of event, the bit is set when the queue *may* contain events
+ * @note  The bit is set by the producer after the event gets published, and it's only cleared by the
+ *        consumer when it finds the queue is empty. So a set bit with an empty queue is possible, but a
+ *        non-empty queue with a cleared bit is not
+ **/
+static uint64_t _ready[ITC_EQUEUE_EVENT_TYPE_COUNT][_BITMAP_NWORDS];
 
 /**
- * @brief The mutex used for the disptacher to take an item from the queue
+ * @brief The queue where the consumer starts looking for events, so that all the queues have the same chance
  **/
-static pthread_mutex_t _take_mutex;
+static uint32_t _cursor;
 
 /**
- * @brief The cond variable used to block the dispatcher when there's no event
+ * @brief The event mask the scheduler is currently parked with, 0 if the scheduler is not parked
  **/
-static pthread_cond_t  _take_cond;
+static volatile uint32_t _sched_waiting;
 
 /**
- * @biref Indicates if the scheduler is waiting
+ * @brief The sequence number the scheduler parks on
  **/
-volatile uint32_t _sched_waiting;
+static uint32_t _sched_seq;
 
+#ifndef __LINUX__
+/**
+ * @brief The mutex used to emulate the futex
+ **/
+static pthread_mutex_t _park_mutex;
+
+/**
+ * @brief The condition variable used to emulate the futex
+ **/
+static pthread_cond_t  _park_cond;
+#endif
 
 /**
- * @todo using larger initial size when there's such need for that
+ * @brief Park the caller thread if the sequence number hasn't been changed
+ * @param seq The sequence number
+ * @param expected The expected value of the sequence number
+ * @return nothing
  **/
+static inline void _park(uint32_t* seq, uint32_t expected)
+{
+#ifdef __LINUX__
+	struct timespec timeout = {
+		.tv_sec  = _PARK_TIMEOUT_NS / 1000000000l,
+		.tv_nsec = _PARK_TIMEOUT_NS % 1000000000l
+	};
+	if(syscall(SYS_futex, seq, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0) < 0 &&
+	   errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot wait for the futex");
+#else
+	struct timespec abstime;
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += _PARK_TIMEOUT_NS / 1000000000l;
+
+	if((errno = pthread_mutex_lock(&_park_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the park mutex");
+
+	if(*(volatile uint32_t*)seq == expected &&
+	   (errno = pthread_cond_timedwait(&_park_cond, &_park_mutex, &abstime)) != 0 && errno != ETIMEDOUT && errno != EINTR)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot wait for the park condition variable");
+
+	if((errno = pthread_mutex_unlock(&_park_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the park mutex");
+#endif
+}
+
+/**
+ * @brief Change the sequence number and wake up the thread parked on it
+ * @param seq The sequence number
+ * @return nothing
+ **/
+static inline void _unpark(uint32_t* seq)
+{
+	__sync_fetch_and_add(seq, 1);
+#ifdef __LINUX__
+	if(syscall(SYS_futex, seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0) < 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot wake up the futex");
+#else
+	if((errno = pthread_mutex_lock(&_park_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the park mutex");
+
+	if((errno = pthread_cond_broadcast(&_park_cond)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot notify the parked thread");
+
+	if((errno = pthread_mutex_unlock(&_park_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the park mutex");
+#endif
+}
+
+/**
+ * @brief Find the next queue that contains events of the given types
+ * @note This function should be called from the thread holds the scheduler token. <br/>
+ *       All the stale bits we found during the search will be cleared
+ * @param mask The event mask
+ * @return The queue we found or NULL if all the queues are empty
+ **/
+static inline _queue_t* _find_ready(itc_equeue_event_mask_t mask)
+{
+	uint32_t nqueues = __atomic_load_n(&_nqueues, __ATOMIC_ACQUIRE);
+	if(nqueues == 0) return NULL;
+
+	uint32_t nwords = (nqueues + 63) / 64;
+	uint32_t start = _cursor < nqueues ? _cursor : 0;
+	uint32_t i;
+
+	/* We scan the start word twice, the first time for the bits after the cursor, and the second time for the bits before it */
+	for(i = 0; i <= nwords; i ++)
+	{
+		uint32_t word = (start / 64 + i) % nwords;
+		uint64_t bits = 0;
+		int t;
+		for(t = 0; t < ITC_EQUEUE_EVENT_TYPE_COUNT; t ++)
+			if(ITC_EQUEUE_EVENT_MASK_ALLOWS(mask, t))
+				bits |= _ready[t][word];
+
+		if(i == 0) bits &= ~((1ull << (start % 64)) - 1);
+
+		while(bits != 0)
+		{
+			uint32_t idx = word * 64 + (uint32_t)__builtin_ctzll(bits);
+			bits &= bits - 1;
+
+			_queue_t* queue = _queues[idx];
+
+			if(queue->front != __atomic_load_n(&queue->rear, __ATOMIC_ACQUIRE))
+				return queue;
+
+			/* This is a stale bit, clear it and then check again, because the producer may publish
+			 * a new event right before we clear the bit */
+			__sync_fetch_and_and(&_ready[queue->type][word], ~(1ull << (idx % 64)));
+			if(queue->front != __atomic_load_n(&queue->rear, __ATOMIC_ACQUIRE))
+			{
+				__sync_fetch_and_or(&_ready[queue->type][word], 1ull << (idx % 64));
+				return queue;
+			}
+		}
+	}
+
+	return NULL;
+}
+
 int itc_equeue_init()
 {
-	int stage = 0;
 	if((errno = pthread_mutex_init(&_global_mutex, NULL)) != 0)
-		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot initialize the global mutex");
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot initialize the global mutex");
 
-	stage = 1;
-	/* stage 1 */
-	_next_token = 0;
-	_sched_token_called = 0;
-	_queues = vector_new(sizeof(_queue_t*), ITC_EQUEUE_VEC_INIT_SIZE);
-	if(NULL == _queues)
-		ERROR_LOG_GOTO(ERR, "Cannot create vector for the queue list");
+#ifndef __LINUX__
+	if((errno = pthread_mutex_init(&_park_mutex, NULL)) != 0)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot initialize the park mutex");
 
-	stage = 2;
-	if((errno = pthread_cond_init(&_take_cond, NULL)) != 0)
-		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot initialize the read condition variable");
+	if((errno = pthread_cond_init(&_park_cond, NULL)) != 0)
+	{
+		pthread_mutex_destroy(&_park_mutex);
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot initialize the park condition variable");
+	}
+#endif
 
-	stage = 3;
-	if((errno = pthread_mutex_init(&_take_mutex, NULL)) != 0)
-		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot initialize the read condition mutex");
+	_sched_token_called = 0;
+	_nqueues = 0;
+	_cursor = 0;
+	_sched_waiting = 0;
+	_sched_seq = 0;
+	memset(_queues, 0, sizeof(_queues));
+	memset(_ready, 0, sizeof(_ready));
 
 	LOG_DEBUG("Event Queue has been initialized");
 	return 0;
 
+#ifndef __LINUX__
 ERR:
-	switch(stage)
-	{
-		case 3:
-			pthread_cond_destroy(&_take_cond);
-			FALLTHROUGH();
-		case 2:
-			vector_free(_queues);
-			FALLTHROUGH();
-		case 1:
-			pthread_mutex_destroy(&_global_mutex);
-	}
+	pthread_mutex_destroy(&_global_mutex);
 	return ERROR_CODE(int);
+#endif
 }
 
 int itc_equeue_finalize()
@@ -122,87 +288,71 @@ int itc_equeue_finalize()
 		LOG_ERROR_ERRNO("Cannot lock the global mutex");
 		rc = ERROR_CODE(int);
 	}
+
 	/* Before we actually stop, we should dispose all the tasks which is still in the queue */
-	if(_queues != NULL)
+	uint32_t i;
+	for(i = 0; i < _nqueues; i ++)
 	{
-		size_t i;
-		for(i = 0; i < vector_length(_queues); i ++)
+		_queue_t* queue = _queues[i];
+		if(NULL == queue) continue;
+
+		uint32_t j;
+		for(j = queue->front; j != queue->rear; j ++)
 		{
-			_queue_t* queue = *VECTOR_GET(_queue_t*, _queues, i);
-			if(NULL != queue)
+			itc_equeue_event_t* event = queue->events + (j & (queue->size - 1));
+			switch(event->type)
 			{
-				uint64_t j;
-				for(j = queue->front; j != queue->rear; j ++)
-				{
-					switch(queue->events[j & (queue->size - 1)].type)
+				case ITC_EQUEUE_EVENT_TYPE_IO:
+					if(event->io.in != NULL && itc_module_pipe_deallocate(event->io.in) == ERROR_CODE(int))
 					{
-						case ITC_EQUEUE_EVENT_TYPE_IO:
-						{
-							itc_module_pipe_t* in = queue->events[j & (queue->size - 1)].io.in;
-							itc_module_pipe_t* out = queue->events[j & (queue->size - 1)].io.out;
-
-							if(in != NULL && itc_module_pipe_deallocate(in) == ERROR_CODE(int))
-							{
-								LOG_ERROR("Cannot deallocate the input event pipe");
-								rc = ERROR_CODE(int);
-							}
-							if(out != NULL && itc_module_pipe_deallocate(out) == ERROR_CODE(int))
-							{
-								LOG_ERROR("Cannot deallocate the output event pipe");
-								rc = ERROR_CODE(int);
-							}
-							break;
-						}
-						case ITC_EQUEUE_EVENT_TYPE_TASK:
-						{
-							itc_equeue_task_event_t* event = &queue->events[j & (queue->size - 1)].task;
-
-							/* We don't call the cleanup task at this point for now.
-							 * TODO: do we need a way to make it properly cleaned up */
-
-							if(event->async_handle != NULL && ERROR_CODE(int) == sched_async_handle_dispose(event->async_handle))
-							{
-								LOG_ERROR("Cannot deallocatet the task handle");
-								rc = ERROR_CODE(int);
-							}
-
-							break;
-						}
-						default:
-							rc = ERROR_CODE(int);
-							LOG_ERROR("Invalid type of event");
+						LOG_ERROR("Cannot deallocate the input event pipe");
+						rc = ERROR_CODE(int);
 					}
-				}
-				if((errno = pthread_mutex_destroy(&queue->mutex)) != 0)
-				{
-					LOG_ERROR_ERRNO("Cannot destroy the queue specified mutex");
-					rc = ERROR_CODE(int);
-				}
-				if((errno = pthread_cond_destroy(&queue->put_cond)) != 0)
-				{
-					LOG_ERROR_ERRNO("Cannot destroy the queue specified cond variable");
+					if(event->io.out != NULL && itc_module_pipe_deallocate(event->io.out) == ERROR_CODE(int))
+					{
+						LOG_ERROR("Cannot deallocate the output event pipe");
+						rc = ERROR_CODE(int);
+					}
+					break;
+				case ITC_EQUEUE_EVENT_TYPE_TASK:
+					/* We don't call the cleanup task at this point for now.
+					 * TODO: do we need a way to make it properly cleaned up */
+					if(event->task.async_handle != NULL && ERROR_CODE(int) == sched_async_handle_dispose(event->task.async_handle))
+					{
+						LOG_ERROR("Cannot deallocatet the task handle");
+						rc = ERROR_CODE(int);
+					}
+					break;
+				default:
 					rc = ERROR_CODE(int);
-				}
-				free(queue);
+					LOG_ERROR("Invalid type of event");
 			}
 		}
-		vector_free(_queues);
+		free(queue);
+		_queues[i] = NULL;
 	}
+	_nqueues = 0;
+
 	if((errno = pthread_mutex_unlock(&_global_mutex)) != 0)
 	{
-		LOG_ERROR_ERRNO("Cannot destroy the global mutex");
+		LOG_ERROR_ERRNO("Cannot release the global mutex");
 		rc = ERROR_CODE(int);
 	}
-	if((errno = pthread_mutex_destroy(&_take_mutex)) != 0)
+
+#ifndef __LINUX__
+	if((errno = pthread_mutex_destroy(&_park_mutex)) != 0)
 	{
-		LOG_ERROR_ERRNO("Cannot destroy the read mutex");
+		LOG_ERROR_ERRNO("Cannot destroy the park mutex");
 		rc = ERROR_CODE(int);
 	}
-	if((errno = pthread_cond_destroy(&_take_cond)) != 0)
+
+	if((errno = pthread_cond_destroy(&_park_cond)) != 0)
 	{
-		LOG_ERROR_ERRNO("Cannot destroy the read cond variable");
+		LOG_ERROR_ERRNO("Cannot destroy the park condition variable");
 		rc = ERROR_CODE(int);
 	}
+#endif
+
 	if((errno = pthread_mutex_destroy(&_global_mutex)) != 0)
 	{
 		LOG_ERROR_ERRNO("Cannot destroy the global mutex");
@@ -221,47 +371,34 @@ itc_equeue_token_t itc_equeue_module_token(uint32_t size, itc_equeue_event_type_
 	if(q_size < size) q_size <<= 1;
 	LOG_DEBUG("The actual queue size %u", q_size);
 
-	int stage = 0;
-	_queue_t* queue;
-	vector_t* next;
-	itc_equeue_token_t ret;
 	if((errno = pthread_mutex_lock(&_global_mutex)) != 0)
 		ERROR_RETURN_LOG_ERRNO(itc_equeue_token_t, "Cannot lock the global mutex");
 
-	ret = (_next_token ++);
-	queue = (_queue_t*)calloc(1, sizeof(_queue_t) + sizeof(itc_equeue_event_t) * q_size);
-	if(NULL == queue) ERROR_LOG_GOTO(ERR, "Cannot allocate memory for event queue");
+	_queue_t* queue = NULL;
+	itc_equeue_token_t ret = _nqueues;
 
-	if((errno = pthread_mutex_init(&queue->mutex, NULL)) != 0) ERROR_LOG_GOTO(ERR, "Cannot initialize the queue mutex");
+	if(ret >= ITC_EQUEUE_MAX_NUM_QUEUES)
+		ERROR_LOG_GOTO(ERR, "Too many event queues, the limit is %u", ITC_EQUEUE_MAX_NUM_QUEUES);
 
-	stage = 1;
+	if(NULL == (queue = (_queue_t*)calloc(1, sizeof(_queue_t) + sizeof(itc_equeue_event_t) * q_size)))
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for event queue");
 
-	if((errno = pthread_cond_init(&queue->put_cond, NULL)) != 0) ERROR_LOG_GOTO(ERR, "Cannot initialize the queue cond variable");
+	queue->type = type;
 	queue->size = q_size;
+	queue->token = ret;
+
+	_queues[ret] = queue;
 
-	stage = 2;
-	next = vector_append(_queues, &queue);
-	if(NULL == next) ERROR_LOG_GOTO(ERR, "Cannot append the new queue to the queue list");
+	/* Make sure the queue is fully initialized before anyone can see it */
+	__atomic_store_n(&_nqueues, ret + 1, __ATOMIC_RELEASE);
 
-	_queues = next;
 	if((errno = pthread_mutex_unlock(&_global_mutex)) != 0) LOG_WARNING_ERRNO("Cannot release the global mutex");
 
 	LOG_INFO("New module token in the event queue: Token = %x", ret);
 
-	queue->type = type;
-
 	return ret;
 ERR:
-	switch(stage)
-	{
-		case 2:
-			pthread_cond_destroy(&queue->put_cond);
-			FALLTHROUGH();
-		case 1:
-			pthread_mutex_destroy(&queue->mutex);
-	}
 	pthread_mutex_unlock(&_global_mutex);
-	if(NULL != queue) free(queue);
 	return ERROR_CODE(itc_equeue_token_t);
 }
 
@@ -307,72 +444,59 @@ int itc_equeue_put(itc_equeue_token_t token, itc_equeue_event_t event)
 	else if(event.type != ITC_EQUEUE_EVENT_TYPE_IO && event.type != ITC_EQUEUE_EVENT_TYPE_TASK)
 		ERROR_RETURN_LOG(int, "Invalid event type");
 
-	_queue_t* queue = *VECTOR_GET(_queue_t*, _queues, token);
-	if(NULL == queue)
+	if(token >= ITC_EQUEUE_MAX_NUM_QUEUES || NULL == _queues[token])
 		ERROR_RETURN_LOG(int, "Cannot get the queue for token %u", token);
 
+	_queue_t* queue = _queues[token];
+
 	if(queue->type != event.type)
 		ERROR_RETURN_LOG(int, "Invalid event type, the queue do not accept specified event type");
 
-	LOG_DEBUG("token %u: wait for the queue have space for the new event", token);
+	uint32_t rear = queue->rear;
 
-	struct timespec abstime;
-	struct timeval now;
-	gettimeofday(&now,NULL);
-	abstime.tv_sec = now.tv_sec+1;
-	abstime.tv_nsec = 0;
-
-	if(queue->rear == queue->front + queue->size)
+	if(rear - queue->front_cache == queue->size)
 	{
-		if((errno = pthread_mutex_lock(&queue->mutex)) != 0)
-			ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the queue mutex");
+		LOG_DEBUG("token %u: wait for the queue have space for the new event", token);
 
 		/* If the queue is currently full, we should make the event loop wait until the scheduler consume at least one event in the queue */
-		while(queue->rear == queue->front + queue->size)
+		for(;;)
 		{
-			if((errno = pthread_cond_timedwait(&queue->put_cond, &queue->mutex, &abstime)) != 0 && errno != ETIMEDOUT && errno != EINTR)
-				LOG_WARNING_ERRNO("failed to wait for the cond variable get ready");
+			queue->front_cache = __atomic_load_n(&queue->front, __ATOMIC_ACQUIRE);
+			if(rear - queue->front_cache != queue->size) break;
+
+			uint32_t seq = __atomic_load_n(&queue->space_seq, __ATOMIC_ACQUIRE);
+			queue->put_waiting = 1;
+			__sync_synchronize();
+
+			/* Check again, because the scheduler may have consumed the event before it sees the flag */
+			if(rear - __atomic_load_n(&queue->front, __ATOMIC_ACQUIRE) == queue->size)
+				_park(&queue->space_seq, seq);
+
+			queue->put_waiting = 0;
 
 			if(itc_eloop_thread_killed == 1)
 			{
 				LOG_INFO("event thread gets killed");
-				if((errno = pthread_mutex_unlock(&queue->mutex)) != 0)
-					LOG_WARNING_ERRNO("cannot release the queue mutex");
 				return 0;
 			}
-
-			abstime.tv_sec ++;
 		}
 
-		if((errno = pthread_mutex_unlock(&queue->mutex)) != 0)
-			LOG_WARNING_ERRNO("cannot release the queue mutex");
+		LOG_DEBUG("token %u: now the queue have sufficent space for the new event", token);
 	}
 
-	LOG_DEBUG("token %u: now the queue have sufficent space for the new event", token);
+	queue->events[rear & (queue->size - 1)] = event;
 
-	uint64_t next_position = (queue->rear) & (queue->size - 1);
-	queue->events[next_position] = event;
 	/* make sure that the data get ready first, then inc the pointer */
-	BARRIER();
-	arch_atomic_sw_increment_u32(&queue->rear);
+	__atomic_store_n(&queue->rear, rear + 1, __ATOMIC_RELEASE);
 
-	if(ITC_EQUEUE_EVENT_MASK_ALLOWS(_sched_waiting, queue->type))
-	{
-		_sched_waiting = 0;
+	/* This is also a full barrier, which makes sure the scheduler either sees the bit or we see it's waiting */
+	__sync_fetch_and_or(&_ready[queue->type][token / 64], 1ull << (token % 64));
 
+	uint32_t waiting = _sched_waiting;
+	if(ITC_EQUEUE_EVENT_MASK_ALLOWS(waiting, queue->type) && __sync_bool_compare_and_swap(&_sched_waiting, waiting, 0))
+	{
 		LOG_DEBUG("token %u: notifiying the schduler thread to read this element", token);
-
-		/* Signal the take part */
-		if((errno = pthread_mutex_lock(&_take_mutex)) != 0)
-			LOG_WARNING_ERRNO("cannot acquire the reader mutex");
-
-		if((errno = pthread_cond_signal(&_take_cond)) != 0)
-			LOG_WARNING_ERRNO("cannot send signal to the scheduler thread");
-
-		if((errno = pthread_mutex_unlock(&_take_mutex)) != 0)
-			LOG_WARNING_ERRNO("cannot release the reader mutex");
-
-		LOG_DEBUG("token %u: event message notified", token);
+		_unpark(&_sched_seq);
 	}
 
 	return 0;
@@ -380,57 +504,41 @@ int itc_equeue_put(itc_equeue_token_t token, itc_equeue_event_t event)
 
 uint32_t itc_equeue_take(itc_equeue_token_t token, itc_equeue_event_mask_t type_mask, itc_equeue_event_t* buffer, uint32_t buffer_size)
 {
-	uint32_t ret = 0;
-	size_t i;
-	_queue_t* queue = NULL;
-
 	if(NULL == buffer) ERROR_RETURN_LOG(uint32_t, "Invalid arguments");
 
 	if(token != _SCHED_TOKEN) ERROR_RETURN_LOG(uint32_t, "Cannot call the take method from event thread");
 
-	/* Find the first queue that is not empty */
-	for(i = 0; i < vector_length(_queues); i ++)
-	{
-		queue = *VECTOR_GET(_queue_t*, _queues, i);
-
-		if(NULL == queue)
-		{
-			LOG_WARNING("Invalid queue object at %zu, may be a code bug", i);
-			continue;
-		}
+	_queue_t* queue = _find_ready(type_mask);
 
-		if(ITC_EQUEUE_EVENT_MASK_ALLOWS(type_mask, queue->type) && queue->front != queue->rear)
-		{
-			LOG_DEBUG("found queue %zu contains avalible events", i);
-			break;
-		}
-	}
-
-	if(i == vector_length(_queues))
+	if(NULL == queue)
 		ERROR_RETURN_LOG(uint32_t, "Cannot find the event mask = %x", type_mask);
-	else LOG_DEBUG("Found events in queue #%zu, take the first one", i);
+	else LOG_DEBUG("Found events in queue #%u, take the first one", queue->token);
 
+	uint32_t front = queue->front;
+	uint32_t rear = __atomic_load_n(&queue->rear, __ATOMIC_ACQUIRE);
+	uint32_t ret;
 
-	for(ret = 0; ret < buffer_size && (queue->rear - queue->front - ret) != 0; ret ++)
-		buffer[ret] = queue->events[(queue->front + ret) & (queue->size - 1)];
+	for(ret = 0; ret < buffer_size && front + ret != rear; ret ++)
+		buffer[ret] = queue->events[(front + ret) & (queue->size - 1)];
 
-	BARRIER();
+	__atomic_store_n(&queue->front, front + ret, __ATOMIC_RELEASE);
 
-	queue->front += ret;
+	/* Let the next search starts from the next queue, so that a busy queue can not starve others */
+	_cursor = queue->token + 1;
 
-	BARRIER();
-
-	if((queue->rear - queue->front + ret) == queue->size)
+	/* The queue becomes empty, so we clear the bit, and make sure we don't miss the event published during this */
+	if(front + ret == rear)
 	{
-		LOG_DEBUG("scheduler thread: notifying the more free space in the queue to token %zu", i);
-		if((errno = pthread_mutex_lock(&queue->mutex)) != 0)
-			LOG_WARNING_ERRNO("cannot acquire the queue mutex for token %zu", i);
-
-		if((errno = pthread_cond_signal(&queue->put_cond)) != 0)
-			LOG_WARNING_ERRNO("cannot notify the queue cond variable for token %zu", i);
+		__sync_fetch_and_and(&_ready[queue->type][queue->token / 64], ~(1ull << (queue->token % 64)));
+		if(__atomic_load_n(&queue->rear, __ATOMIC_ACQUIRE) != front + ret)
+			__sync_fetch_and_or(&_ready[queue->type][queue->token / 64], 1ull << (queue->token % 64));
+	}
+	else __sync_synchronize();
 
-		if((errno = pthread_mutex_unlock(&queue->mutex)) != 0)
-			LOG_WARNING_ERRNO("cannot notify release the queue mutex for token %zu", i);
+	if(queue->put_waiting)
+	{
+		LOG_DEBUG("scheduler thread: notifying the more free space in the queue to token %u", queue->token);
+		_unpark(&queue->space_seq);
 	}
 
 	return ret;
@@ -439,16 +547,8 @@ uint32_t itc_equeue_take(itc_equeue_token_t token, itc_equeue_event_mask_t type_
 int itc_equeue_empty(itc_equeue_token_t token)
 {
 	if(token != _SCHED_TOKEN) ERROR_RETURN_LOG(int, "Cannot call this function from the event thread");
-	size_t i;
-	for(i = 0; i < vector_length(_queues); i ++)
-	{
-		_queue_t* queue = *VECTOR_GET(_queue_t*, _queues, i);
-		if(NULL == queue) ERROR_RETURN_LOG(int, "Cannot get the token local queue %zu", i);
-		if(queue->rear != queue->front)
-			return 0;
-	}
-	return 1;
 
+	return NULL == _find_ready((1u << ITC_EQUEUE_EVENT_TYPE_COUNT) - 1);
 }
 
 int itc_equeue_wait(itc_equeue_token_t token, const int* killed, itc_equeue_wait_interrupt_t* interrupt)
@@ -457,56 +557,35 @@ int itc_equeue_wait(itc_equeue_token_t token, const int* killed, itc_equeue_wait
 
 	LOG_DEBUG("The thread is going to be blocked until the queue have at least one event");
 
-	struct timespec abstime;
-	struct timeval now;
-	gettimeofday(&now,NULL);
-	abstime.tv_sec = now.tv_sec+1;
-	abstime.tv_nsec = 0;
-
-	int locked = 0;
-
 	itc_equeue_event_mask_t mask = (1u << ITC_EQUEUE_EVENT_TYPE_COUNT) - 1;
 
 	while(killed == NULL || *killed == 0)
 	{
-		size_t i;
+		uint32_t seq = __atomic_load_n(&_sched_seq, __ATOMIC_ACQUIRE);
 
 		if(interrupt != NULL && ITC_EQUEUE_EVENT_MASK_NONE == (mask = interrupt->func(interrupt->data)))
 			ERROR_RETURN_LOG(int, "The equeue wait interrupt callback returns an error");
 
-		for(i = 0; i < vector_length(_queues); i ++)
-		{
-			_queue_t* queue = *VECTOR_GET(_queue_t*, _queues, i);
-			if(NULL == queue)
-				LOG_WARNING("Cannot get the queue for token %zu", i);
-			else if(ITC_EQUEUE_EVENT_MASK_ALLOWS(mask, queue->type) && queue->rear != queue->front)
-				break;
-		}
-
-		if(i != vector_length(_queues)) break;
+		/* The interrupt callback may ask us to stop waiting */
+		if(killed != NULL && *killed) break;
 
-		if(!locked)
-		{
-			if((errno = pthread_mutex_lock(&_take_mutex)) != 0)
-				ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the reader mutex");
+		if(NULL != _find_ready(mask)) break;
 
-			locked = 1;
+		_sched_waiting = mask;
+		__sync_synchronize();
 
-			continue;
+		/* Check again, the producer may publish the event before it sees we are waiting */
+		if(NULL != _find_ready(mask))
+		{
+			_sched_waiting = 0;
+			break;
 		}
 
-		_sched_waiting = mask;
-
-		if((errno = pthread_cond_timedwait(&_take_cond, &_take_mutex, &abstime)) != 0 && errno != EINTR && errno != ETIMEDOUT)
-			ERROR_RETURN_LOG_ERRNO(int, "Cannot wait for the reader condition variable");
+		_park(&_sched_seq, seq);
 
-		gettimeofday(&now,NULL);
-		abstime.tv_sec = now.tv_sec + 1;
+		_sched_waiting = 0;
 	}
 
-	if(locked && (errno = pthread_mutex_unlock(&_take_mutex)) != 0)
-		LOG_WARNING_ERRNO("cannot release the reader mutex");
-
 	if(killed != NULL && *killed)
 	{
 		LOG_TRACE("Kill message recieved");
@@ -518,14 +597,8 @@ int itc_equeue_wait(itc_equeue_token_t token, const int* killed, itc_equeue_wait
 
 int itc_equeue_wait_interrupt()
 {
-	if((errno = pthread_mutex_lock(&_take_mutex)) != 0)
-		LOG_WARNING_ERRNO("cannot acquire the reader mutex");
-
-	if((errno = pthread_cond_signal(&_take_cond)) != 0)
-		LOG_WARNING_ERRNO("cannot send signal to the scheduler thread");
-
-	if((errno = pthread_mutex_unlock(&_take_mutex)) != 0)
-		LOG_WARNING_ERRNO("cannot release the reader mutex");
-
+	_unpark(&_sched_seq);
 	return 0;
 }
+
+#endif /* !ITC_EQUEUE_LEGACY */
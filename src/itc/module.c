@@ -254,6 +254,9 @@ int itc_module_pipe_allocate(itc_module_type_t type, uint32_t hint,
 	const itc_modtab_instance_t* inst = _get_module_from_type(type);
 	if(NULL == inst) ERROR_RETURN_LOG(int, "Invalid module type code 0x%x", type);
 
+	sched_trace_id_t trace_id = sched_trace_current();
+	uint64_t trace_ts = sched_trace_begin(trace_id);
+
 	const itc_module_t* module = inst->module;
 	void* context = inst->context;
 	mempool_objpool_t* pool = inst->handle_pool;
@@ -304,6 +307,8 @@ int itc_module_pipe_allocate(itc_module_type_t type, uint32_t hint,
 	if(NULL != in_pipe) *in_pipe = in;
 	if(NULL != out_pipe) *out_pipe = out;
 
+	sched_trace_end(trace_id, SCHED_TRACE_SPAN_PIPE_ALLOCATE, type, trace_ts);
+
 	return 0;
 ERR:
 	if(NULL != in) mempool_objpool_dealloc(pool, in);
@@ -416,6 +421,9 @@ int itc_module_pipe_deallocate(itc_module_pipe_t* handle)
 {
 	_GET_MODULE(mod, handle, 0);
 
+	sched_trace_id_t trace_id = sched_trace_current();
+	uint64_t trace_ts = sched_trace_begin(trace_id);
+
 	/* Before we actually do anything yet, we need to make sure if the pipe has been touched and
 	 * have incompleted header, fill 0 to the remaining header */
 	if(handle->stat.type == _PSTAT_TYPE_OUTPUT &&
@@ -489,6 +497,8 @@ int itc_module_pipe_deallocate(itc_module_pipe_t* handle)
 
 	_INVOKE_MODULE(int, rc, mod, deallocate, handle->data, handle->stat.error?1:0, last);
 
+	sched_trace_end(trace_id, SCHED_TRACE_SPAN_PIPE_DEALLOCATE, handle->module_type, trace_ts);
+
 	handle->companion_prev->companion_next = handle->companion_next;
 	handle->companion_next->companion_prev = handle->companion_prev;
 	handle->companion_next->stat.error = (handle->stat.error || handle->companion_next->stat.error);
@@ -654,6 +664,53 @@ static inline int _rls_stream_eos(const void* handle)
 	return sched_rscope_stream_eos((const sched_rscope_stream_t*)handle);
 }
 
+/**
+ * @brief get the file region that holds the remaining data of the RLS stream
+ * @param handle the RLS stream
+ * @param region_buf the buffer used to return the region
+ * @return 1 if the region has been returned, 0 if the stream is not backed by a file region, or error code
+ **/
+static inline int _rls_stream_file_region(void* __restrict handle, itc_module_data_source_region_t* region_buf)
+{
+	runtime_api_scope_file_region_t region;
+
+	int rc = sched_rscope_stream_get_file_region((sched_rscope_stream_t*)handle, &region);
+	if(ERROR_CODE(int) == rc)
+		ERROR_RETURN_LOG(int, "Cannot get the file region of the RLS stream");
+
+	if(rc == 0) return 0;
+
+	region_buf->fd = region.fd;
+	region_buf->offset = region.offset;
+	region_buf->size = region.size;
+
+	return 1;
+}
+
+/**
+ * @brief take the memory that holds the next piece of data of the RLS stream
+ * @param handle the RLS stream
+ * @param page_buf the buffer used to return the memory
+ * @return 1 if the memory has been returned, 0 if the data should be read instead, or error code
+ **/
+static inline int _rls_stream_donate(void* __restrict handle, itc_module_data_source_page_t* page_buf)
+{
+	runtime_api_scope_page_t page;
+
+	int rc = sched_rscope_stream_donate((sched_rscope_stream_t*)handle, &page);
+	if(ERROR_CODE(int) == rc)
+		ERROR_RETURN_LOG(int, "Cannot take the memory of the RLS stream");
+
+	if(rc == 0) return 0;
+
+	page_buf->base = page.base;
+	page_buf->data = page.data;
+	page_buf->size = page.size;
+	page_buf->free_func = page.free_func;
+
+	return 1;
+}
+
 /**
  * @brief close a used RLS stream
  * @param handle the RLS stream
@@ -676,7 +733,9 @@ int itc_module_pipe_write_scope_token(runtime_api_scope_token_t token, const run
 		.data_handle = stream,
 		.read = _rls_stream_read,
 		.eos  = _rls_stream_eos,
-		.close = _rls_stream_close
+		.close = _rls_stream_close,
+		.file_region = _rls_stream_file_region,
+		.donate = _rls_stream_donate
 	};
 
 
@@ -769,10 +828,15 @@ int itc_module_pipe_write_data_source(itc_module_data_source_t data_source, cons
 	}
 DR_END:
 
-	if(mod->module->write_callback == NULL)
+	/* The write_callback module call doesn't know about the typed header, so we need to fill the header first */
+	if(mod->module->write_callback != NULL && handle->processed_header_size < handle->actual_header_size &&
+	   ERROR_CODE(size_t) == _write_impl(buf, 0, handle, mod))
+		ERROR_RETURN_LOG(int, "Cannot fill the pipe header");
+
+	if(mod->module->write_callback == NULL || handle->processed_header_size < handle->actual_header_size)
 	{
-		LOG_DEBUG("The module %s doesn't support write_callback module call, using normal write simulate the API",
-		           mod->path);
+		LOG_DEBUG("The module %s doesn't support write_callback module call or the header is not written, "
+		          "using normal write simulate the API", mod->path);
 		for(;;)
 		{
 			int eos_rc = data_source.eos(data_source.data_handle);
@@ -0,0 +1,1279 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <constants.h>
+#include <error.h>
+#include <utils/log.h>
+
+#include <itc/module_types.h>
+#include <itc/module.h>
+#include <itc/modtab.h>
+
+#include <module/http1/module.h>
+
+/**
+ * @brief The response we send when the request can not be framed
+ **/
+static const char _bad_request[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+/**
+ * @brief The response we send when the request is larger than the limit
+ **/
+static const char _too_large[] = "HTTP/1.1 413 Payload Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+/**
+ * @brief The state of the request framer
+ **/
+typedef enum {
+	_FRAME_HEAD,           /*!< We are reading the request head */
+	_FRAME_BODY,           /*!< We are reading the body with the content length */
+	_FRAME_CHUNK_SIZE,     /*!< We are reading the chunk size line */
+	_FRAME_CHUNK_EXT,      /*!< We are skipping the chunk extension */
+	_FRAME_CHUNK_DATA,     /*!< We are reading the chunk data */
+	_FRAME_CHUNK_DATA_END, /*!< We are expecting the CRLF after the chunk data */
+	_FRAME_TRAILER         /*!< We are reading the trailer fields */
+} _frame_state_t;
+
+/**
+ * @brief The result of framing the buffered data
+ **/
+typedef enum {
+	_FRAME_RESULT_MORE,      /*!< We need more data to complete the request */
+	_FRAME_RESULT_COMPLETE,  /*!< We have got a complete request */
+	_FRAME_RESULT_BAD,       /*!< The request is malformed */
+	_FRAME_RESULT_TOO_LARGE  /*!< The request is larger than the limit */
+} _frame_result_t;
+
+/**
+ * @brief A growable byte buffer
+ **/
+typedef struct {
+	char*        data;    /*!< The data */
+	size_t       size;    /*!< The number of bytes in the buffer */
+	size_t       cap;     /*!< The capacity of the buffer */
+} _buf_t;
+
+/**
+ * @brief The previous definition of the connection
+ **/
+typedef struct _conn_t _conn_t;
+
+/**
+ * @brief A request from the connection
+ **/
+typedef struct _request_t {
+	_conn_t*           conn;               /*!< The connection this request belongs to */
+	struct _request_t* next;               /*!< The next request of the connection, in the order they are received */
+	struct _request_t* queue_next;         /*!< The next request in the ready queue */
+	uint32_t           done:1;             /*!< If the request has been finalized */
+	uint32_t           close:1;            /*!< If the connection should be closed after the response */
+	_buf_t             data;               /*!< The request data */
+	_buf_t             out;                /*!< The response which is blocked by the responses of the previous requests */
+	size_t             read_offset;        /*!< The read pointer in the request */
+	size_t             last_read;          /*!< The read pointer before the last read */
+	void*              user_state;         /*!< The state the servlet pushed to the pipe */
+	itc_module_state_dispose_func_t user_state_dispose;  /*!< The dispose function of the user state */
+} _request_t;
+
+/**
+ * @brief The module context
+ **/
+typedef struct {
+	itc_module_type_t transport_mod;          /*!< The transportation layer module */
+	uint32_t          async_write;            /*!< If we want the async write of the transportation layer */
+	uint32_t          max_pipeline;           /*!< The max number of requests of a connection we dispatch at the same time */
+	uint32_t          max_request_size;       /*!< The max size of a single request */
+	_request_t*       queue;                  /*!< The requests ready to dispatch, only the event loop thread touches this */
+	_request_t*       queue_tail;             /*!< The last request in the ready queue */
+} _module_context_t;
+
+/**
+ * @brief A HTTP/1.1 connection, which is the state we pushed to the transportation layer pipe
+ **/
+struct _conn_t {
+	pthread_mutex_t             mutex;              /*!< The mutex that protects the connection */
+	_module_context_t*          context;            /*!< The module context */
+	itc_module_pipe_t*          trans_in;           /*!< The transportation layer input pipe, only valid when checked out */
+	itc_module_pipe_t*          trans_out;          /*!< The transportation layer output pipe, only valid when checked out */
+	_request_t*                 head;               /*!< The oldest request whose response hasn't been completely written */
+	_request_t*                 tail;               /*!< The latest request */
+	uint32_t                    active;             /*!< The number of requests which is not finalized yet */
+	uint32_t                    closing:1;          /*!< If the connection should be closed once all the requests are done */
+	uint32_t                    discard:1;          /*!< If the responses should be discarded, because an earlier response closes the connection */
+	uint32_t                    broken:1;           /*!< If the transportation layer is broken */
+	uint32_t                    request_line:1;     /*!< If we have seen the request line of current request */
+	uint32_t                    chunked:1;          /*!< If current request uses the chunked transfer encoding */
+	uint32_t                    has_length:1;       /*!< If current request has the content length field */
+	uint32_t                    chunk_digits;       /*!< How many digits of the chunk size we have seen */
+	_frame_state_t              state;              /*!< The state of the request framer */
+	uint64_t                    remaining;          /*!< The remaining bytes of the body or current chunk */
+	size_t                      begin;              /*!< Where current request begins in the input buffer */
+	size_t                      scan;               /*!< How many bytes in the input buffer have been framed */
+	size_t                      line_begin;         /*!< Where current line begins in the input buffer */
+	_buf_t                      in;                 /*!< The data haven't been split into requests */
+};
+
+/**
+ * @brief The type of the pipe handle
+ **/
+typedef enum {
+	_HANDLE_TYPE_IN,     /*!< The input handle, which reads the request */
+	_HANDLE_TYPE_OUT     /*!< The output handle, which writes the response */
+} _handle_type_t;
+
+/**
+ * @brief The pipe handle
+ **/
+typedef struct {
+	_handle_type_t    type;    /*!< The handle type */
+	_request_t*       request; /*!< The request */
+} _handle_t;
+
+/**
+ * @brief the helper function to invoke the pipe_cntl API call
+ * @param pipe the pipe handle
+ * @param opcode the opcode
+ * @return status code
+ **/
+static inline int _invoke_pipe_cntl(itc_module_pipe_t* pipe, uint32_t opcode, ...)
+{
+	va_list ap;
+	va_start(ap, opcode);
+	int rc = itc_module_pipe_cntl(pipe, opcode, ap);
+	va_end(ap);
+	return rc;
+}
+
+/**
+ * @brief Append data to the buffer
+ * @param buf The buffer
+ * @param data The data to append
+ * @param size The size of the data
+ * @return status code
+ **/
+static inline int _buf_append(_buf_t* buf, const void* data, size_t size)
+{
+	if(size == 0) return 0;
+
+	if(buf->size + size > buf->cap)
+	{
+		size_t cap = buf->cap > 0 ? buf->cap : 64;
+		while(cap < buf->size + size) cap *= 2;
+		char* new_data = (char*)realloc(buf->data, cap);
+		if(NULL == new_data) ERROR_RETURN_LOG_ERRNO(int, "Cannot resize the buffer");
+		buf->data = new_data;
+		buf->cap = cap;
+	}
+
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+	return 0;
+}
+
+/**
+ * @brief Release the memory used by the buffer
+ * @param buf The buffer
+ * @return nothing
+ **/
+static inline void _buf_free(_buf_t* buf)
+{
+	if(NULL != buf->data) free(buf->data);
+	buf->data = NULL;
+	buf->size = buf->cap = 0;
+}
+
+/**
+ * @brief Dispose a request
+ * @param request The request to dispose
+ * @return status code
+ **/
+static inline int _request_free(_request_t* request)
+{
+	int rc = 0;
+	if(NULL != request->user_state && NULL != request->user_state_dispose && ERROR_CODE(int) == request->user_state_dispose(request->user_state))
+	{
+		LOG_ERROR("Cannot dispose the user-space state");
+		rc = ERROR_CODE(int);
+	}
+
+	_buf_free(&request->data);
+	_buf_free(&request->out);
+	free(request);
+	return rc;
+}
+
+/**
+ * @brief Append a new request to the connection
+ * @param conn The connection
+ * @param data The request data
+ * @param size The size of the request data
+ * @return The newly created request or NULL on error
+ **/
+static inline _request_t* _request_new(_conn_t* conn, const char* data, size_t size)
+{
+	_request_t* ret = (_request_t*)calloc(1, sizeof(_request_t));
+	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the HTTP request");
+
+	if(ERROR_CODE(int) == _buf_append(&ret->data, data, size))
+	{
+		free(ret);
+		ERROR_PTR_RETURN_LOG("Cannot copy the request data");
+	}
+
+	ret->conn = conn;
+
+	if(NULL == conn->tail) conn->head = ret;
+	else conn->tail->next = ret;
+	conn->tail = ret;
+
+	return ret;
+}
+
+/**
+ * @brief Create a new connection
+ * @param context The module context
+ * @return The newly created connection or NULL on error
+ **/
+static inline _conn_t* _conn_new(_module_context_t* context)
+{
+	_conn_t* ret = (_conn_t*)calloc(1, sizeof(_conn_t));
+	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the HTTP connection");
+
+	if((errno = pthread_mutex_init(&ret->mutex, NULL)) != 0)
+	{
+		free(ret);
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot initialize the connection mutex");
+	}
+
+	ret->context = context;
+	ret->state = _FRAME_HEAD;
+
+	return ret;
+}
+
+/**
+ * @brief Dispose a connection
+ * @note This is the dispose function we push to the transportation layer, thus it may be called
+ *       by any thread once the transportation layer closes the connection
+ * @param data The connection
+ * @return status code
+ **/
+static int _conn_free(void* data)
+{
+	_conn_t* conn = (_conn_t*)data;
+	int rc = 0;
+
+	while(NULL != conn->head)
+	{
+		_request_t* request = conn->head;
+		conn->head = request->next;
+		if(ERROR_CODE(int) == _request_free(request))
+			rc = ERROR_CODE(int);
+	}
+
+	_buf_free(&conn->in);
+
+	if((errno = pthread_mutex_destroy(&conn->mutex)) != 0)
+	{
+		LOG_ERROR_ERRNO("Cannot destroy the connection mutex");
+		rc = ERROR_CODE(int);
+	}
+
+	free(conn);
+	return rc;
+}
+
+/**
+ * @brief Give the connection back to the transportation layer
+ * @details After this function returns, the transportation layer owns the connection, it either puts the
+ *          connection back to the event loop or closes it and disposes the state. So the caller must not
+ *          touch the connection anymore.
+ * @param conn The connection
+ * @note This should be called without the connection mutex
+ * @return status code
+ **/
+static inline int _conn_release(_conn_t* conn)
+{
+	int rc = 0;
+	itc_module_pipe_t* trans_in = conn->trans_in;
+	itc_module_pipe_t* trans_out = conn->trans_out;
+
+	if(conn->closing || conn->broken)
+	{
+		LOG_DEBUG("Closing the HTTP connection");
+		if(ERROR_CODE(int) == _invoke_pipe_cntl(trans_in, RUNTIME_API_PIPE_CNTL_OPCODE_CLR_FLAG, RUNTIME_API_PIPE_PERSIST) ||
+		   ERROR_CODE(int) == _invoke_pipe_cntl(trans_out, RUNTIME_API_PIPE_CNTL_OPCODE_CLR_FLAG, RUNTIME_API_PIPE_PERSIST))
+		{
+			LOG_ERROR("Cannot clear the persist flag of the transportation layer pipe");
+			rc = ERROR_CODE(int);
+		}
+	}
+
+	/* The transportation layer disposes the state when the connection gets closed, so we push it anyway */
+	if(ERROR_CODE(int) == _invoke_pipe_cntl(trans_in, RUNTIME_API_PIPE_CNTL_OPCODE_PUSH_STATE, conn, _conn_free))
+	{
+		LOG_ERROR("Cannot push the connection state to the transportation layer pipe");
+		_conn_free(conn);
+		rc = ERROR_CODE(int);
+	}
+
+	if(ERROR_CODE(int) == itc_module_pipe_deallocate(trans_in))
+	{
+		LOG_ERROR("Cannot deallocate the transportation layer input pipe");
+		rc = ERROR_CODE(int);
+	}
+
+	if(ERROR_CODE(int) == itc_module_pipe_deallocate(trans_out))
+	{
+		LOG_ERROR("Cannot deallocate the transportation layer output pipe");
+		rc = ERROR_CODE(int);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Write the response data to the transportation layer
+ * @param conn The connection
+ * @param data The data to write
+ * @param size The size of the data
+ * @return status code
+ **/
+static inline int _conn_write(_conn_t* conn, const char* data, size_t size)
+{
+	while(size > 0 && !conn->broken && !conn->discard)
+	{
+		size_t rc = itc_module_pipe_write(data, size, conn->trans_out);
+		if(ERROR_CODE(size_t) == rc || rc == 0)
+		{
+			conn->broken = 1;
+			ERROR_RETURN_LOG(int, "Cannot write the response to the transportation layer");
+		}
+		data += rc;
+		size -= rc;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Retire the finalized requests at the head of the connection, and write the buffered response
+ *        of the request which becomes the head
+ * @details Only the head request writes to the transportation layer directly, the other requests buffer
+ *          their responses, thus the client gets the responses in the order of the requests
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_advance(_conn_t* conn)
+{
+	int rc = 0;
+
+	while(NULL != conn->head)
+	{
+		_request_t* request = conn->head;
+
+		if(request->out.size > 0)
+		{
+			if(ERROR_CODE(int) == _conn_write(conn, request->out.data, request->out.size))
+				rc = ERROR_CODE(int);
+			_buf_free(&request->out);
+		}
+
+		if(!request->done) break;
+
+		/* All the responses after this one are never seen by the client */
+		if(request->close) conn->closing = conn->discard = 1;
+
+		if(NULL == (conn->head = request->next))
+			conn->tail = NULL;
+
+		if(ERROR_CODE(int) == _request_free(request))
+			rc = ERROR_CODE(int);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Check if the string of the given length equals the lower case literal, ignoring the case
+ * @param str The string
+ * @param len The length of the string
+ * @param lit The literal
+ * @return The check result
+ **/
+static inline int _is(const char* str, size_t len, const char* lit)
+{
+	return strlen(lit) == len && strncasecmp(str, lit, len) == 0;
+}
+
+/**
+ * @brief Process a line of the request head
+ * @param conn The connection
+ * @param line The line, without the line break
+ * @param len The length of the line
+ * @return The framing result
+ **/
+static inline _frame_result_t _frame_head_line(_conn_t* conn, const char* line, size_t len)
+{
+	if(len == 0)
+	{
+		/* RFC 7230 section 3.5, the empty lines before the request line should be ignored */
+		if(!conn->request_line)
+		{
+			conn->begin = conn->scan;
+			return _FRAME_RESULT_MORE;
+		}
+
+		if(conn->chunked)
+		{
+			conn->state = _FRAME_CHUNK_SIZE;
+			conn->remaining = 0;
+			conn->chunk_digits = 0;
+			return _FRAME_RESULT_MORE;
+		}
+
+		if(conn->remaining > 0)
+		{
+			conn->state = _FRAME_BODY;
+			return _FRAME_RESULT_MORE;
+		}
+
+		return _FRAME_RESULT_COMPLETE;
+	}
+
+	if(!conn->request_line)
+	{
+		conn->request_line = 1;
+		return _FRAME_RESULT_MORE;
+	}
+
+	const char* colon = (const char*)memchr(line, ':', len);
+	if(NULL == colon) return _FRAME_RESULT_BAD;
+
+	size_t name_len = (size_t)(colon - line);
+	const char* value = colon + 1;
+	const char* end = line + len;
+	for(;value < end && (*value == ' ' || *value == '\t'); value ++);
+	for(;end > value && (end[-1] == ' ' || end[-1] == '\t'); end --);
+	size_t value_len = (size_t)(end - value);
+
+	if(_is(line, name_len, "content-length"))
+	{
+		uint64_t length = 0;
+		size_t i;
+		if(value_len == 0) return _FRAME_RESULT_BAD;
+		for(i = 0; i < value_len; i ++)
+		{
+			if(value[i] < '0' || value[i] > '9') return _FRAME_RESULT_BAD;
+			length = length * 10 + (uint64_t)(value[i] - '0');
+			if(length > conn->context->max_request_size) return _FRAME_RESULT_TOO_LARGE;
+		}
+
+		if(conn->has_length && !conn->chunked && conn->remaining != length) return _FRAME_RESULT_BAD;
+
+		conn->has_length = 1;
+		if(!conn->chunked) conn->remaining = length;
+	}
+	else if(_is(line, name_len, "transfer-encoding"))
+	{
+		/* We are not able to determine the size of the body with any other transfer encoding */
+		if(!_is(value, value_len, "chunked")) return _FRAME_RESULT_BAD;
+		conn->chunked = 1;
+		conn->remaining = 0;
+	}
+
+	return _FRAME_RESULT_MORE;
+}
+
+/**
+ * @brief Handle the end of the chunk size line
+ * @param conn The connection
+ * @return The framing result
+ **/
+static inline _frame_result_t _frame_chunk_size_end(_conn_t* conn)
+{
+	if(conn->chunk_digits == 0) return _FRAME_RESULT_BAD;
+
+	if(conn->remaining == 0)
+	{
+		conn->state = _FRAME_TRAILER;
+		conn->line_begin = conn->scan;
+	}
+	else conn->state = _FRAME_CHUNK_DATA;
+
+	return _FRAME_RESULT_MORE;
+}
+
+/**
+ * @brief Scan the buffered data for the end of current request
+ * @details The framer only finds out where the request ends, the request itself is parsed by the servlet
+ * @param conn The connection
+ * @return The framing result, when the request is complete, the scan pointer is the end of the request
+ **/
+static inline _frame_result_t _conn_frame(_conn_t* conn)
+{
+	const char* data = conn->in.data;
+	size_t size = conn->in.size;
+	_frame_result_t rc = _FRAME_RESULT_MORE;
+
+	while(conn->scan < size && rc == _FRAME_RESULT_MORE)
+	{
+		if(conn->scan - conn->begin >= conn->context->max_request_size)
+			return _FRAME_RESULT_TOO_LARGE;
+
+		char ch = data[conn->scan];
+
+		switch(conn->state)
+		{
+			case _FRAME_HEAD:
+			{
+				const char* eol = (const char*)memchr(data + conn->scan, '\n', size - conn->scan);
+				if(NULL == eol)
+				{
+					conn->scan = size;
+					break;
+				}
+
+				size_t len = (size_t)(eol - data) - conn->line_begin;
+				if(len > 0 && eol[-1] == '\r') len --;
+				conn->scan = (size_t)(eol - data) + 1;
+
+				rc = _frame_head_line(conn, data + conn->line_begin, len);
+				conn->line_begin = conn->scan;
+				break;
+			}
+			case _FRAME_BODY:
+			case _FRAME_CHUNK_DATA:
+			{
+				size_t bytes = size - conn->scan;
+				if(bytes > conn->remaining) bytes = (size_t)conn->remaining;
+				conn->scan += bytes;
+				conn->remaining -= bytes;
+
+				if(conn->remaining == 0)
+				{
+					if(conn->state == _FRAME_BODY) rc = _FRAME_RESULT_COMPLETE;
+					else conn->state = _FRAME_CHUNK_DATA_END;
+				}
+				break;
+			}
+			case _FRAME_CHUNK_SIZE:
+				conn->scan ++;
+				if(ch >= '0' && ch <= '9') conn->remaining = conn->remaining * 16 + (uint64_t)(ch - '0');
+				else if(ch >= 'a' && ch <= 'f') conn->remaining = conn->remaining * 16 + (uint64_t)(ch - 'a' + 10);
+				else if(ch >= 'A' && ch <= 'F') conn->remaining = conn->remaining * 16 + (uint64_t)(ch - 'A' + 10);
+				else if(ch == ';' || ch == ' ' || ch == '\t')
+				{
+					conn->state = _FRAME_CHUNK_EXT;
+					break;
+				}
+				else if(ch == '\r') break;
+				else if(ch == '\n')
+				{
+					rc = _frame_chunk_size_end(conn);
+					break;
+				}
+				else return _FRAME_RESULT_BAD;
+
+				conn->chunk_digits ++;
+				if(conn->remaining > conn->context->max_request_size) return _FRAME_RESULT_TOO_LARGE;
+				break;
+			case _FRAME_CHUNK_EXT:
+				conn->scan ++;
+				if(ch == '\n') rc = _frame_chunk_size_end(conn);
+				break;
+			case _FRAME_CHUNK_DATA_END:
+				conn->scan ++;
+				if(ch == '\n')
+				{
+					conn->state = _FRAME_CHUNK_SIZE;
+					conn->chunk_digits = 0;
+				}
+				else if(ch != '\r') return _FRAME_RESULT_BAD;
+				break;
+			case _FRAME_TRAILER:
+			{
+				const char* eol = (const char*)memchr(data + conn->scan, '\n', size - conn->scan);
+				if(NULL == eol)
+				{
+					conn->scan = size;
+					break;
+				}
+
+				size_t len = (size_t)(eol - data) - conn->line_begin;
+				if(len > 0 && eol[-1] == '\r') len --;
+				conn->scan = (size_t)(eol - data) + 1;
+				conn->line_begin = conn->scan;
+
+				if(len == 0) rc = _FRAME_RESULT_COMPLETE;
+				break;
+			}
+		}
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Reset the request framer for the next request
+ * @param conn The connection
+ * @param begin Where the next request begins in the input buffer
+ * @return nothing
+ **/
+static inline void _frame_reset(_conn_t* conn, size_t begin)
+{
+	conn->state = _FRAME_HEAD;
+	conn->request_line = 0;
+	conn->chunked = 0;
+	conn->has_length = 0;
+	conn->chunk_digits = 0;
+	conn->remaining = 0;
+	conn->begin = conn->scan = conn->line_begin = begin;
+}
+
+/**
+ * @brief Split all the complete requests out of the buffered data, and queue them for dispatching
+ * @details The request we can not frame is answered by the module, and then the connection gets closed.
+ *          Also we stop splitting when the pipeline depth limit is reached, the rest is split after the
+ *          requests are done.
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_split(_conn_t* conn)
+{
+	_module_context_t* context = conn->context;
+
+	while(!conn->closing && conn->active < context->max_pipeline)
+	{
+		_frame_result_t result = _conn_frame(conn);
+		if(result == _FRAME_RESULT_MORE) break;
+
+		if(result != _FRAME_RESULT_COMPLETE)
+		{
+			LOG_NOTICE("Cannot frame the HTTP request: %s, closing the connection",
+			           result == _FRAME_RESULT_BAD ? "malformed request" : "request too large");
+
+			const char* response = result == _FRAME_RESULT_BAD ? _bad_request : _too_large;
+			size_t size = result == _FRAME_RESULT_BAD ? sizeof(_bad_request) - 1 : sizeof(_too_large) - 1;
+
+			/* The response goes after the responses of the previous requests */
+			_request_t* request = _request_new(conn, NULL, 0);
+			if(NULL == request || ERROR_CODE(int) == _buf_append(&request->out, response, size))
+				conn->broken = 1;
+			else
+				request->done = request->close = 1;
+
+			conn->closing = 1;
+			conn->in.size = 0;
+			_frame_reset(conn, 0);
+			break;
+		}
+
+		_request_t* request = _request_new(conn, conn->in.data + conn->begin, conn->scan - conn->begin);
+		if(NULL == request) ERROR_RETURN_LOG(int, "Cannot create the request");
+
+		conn->active ++;
+
+		if(NULL == context->queue_tail) context->queue = request;
+		else context->queue_tail->queue_next = request;
+		context->queue_tail = request;
+
+		_frame_reset(conn, conn->scan);
+	}
+
+	/* Move the bytes haven't been split to the beginning of the buffer, once for all the requests split this time */
+	if(conn->begin > 0)
+	{
+		conn->in.size -= conn->begin;
+		memmove(conn->in.data, conn->in.data + conn->begin, conn->in.size);
+		conn->scan -= conn->begin;
+		conn->line_begin -= conn->begin;
+		conn->begin = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Read all the available data from the transportation layer and split the requests
+ * @details When the pipeline depth limit is reached, the bytes of this read which we haven't split are
+ *          given back to the transportation layer, so it knows the connection has data to read when we
+ *          release the connection
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_read(_conn_t* conn)
+{
+	char buf[4096];
+
+	while(!conn->broken && !conn->closing && conn->active < conn->context->max_pipeline)
+	{
+		size_t rc = itc_module_pipe_read(buf, sizeof(buf), conn->trans_in);
+		if(ERROR_CODE(size_t) == rc)
+		{
+			conn->broken = 1;
+			ERROR_RETURN_LOG(int, "Cannot read from the transportation layer");
+		}
+
+		if(rc == 0)
+		{
+			int eof = itc_module_pipe_eof(conn->trans_in);
+			if(ERROR_CODE(int) == eof)
+			{
+				conn->broken = 1;
+				ERROR_RETURN_LOG(int, "Cannot check if the transportation layer has more data");
+			}
+			if(eof)
+			{
+				/* The client may still wait for the responses of the requests it has sent */
+				LOG_DEBUG("The client has closed the HTTP connection");
+				conn->closing = 1;
+			}
+			break;
+		}
+
+		if(ERROR_CODE(int) == _buf_append(&conn->in, buf, rc) || ERROR_CODE(int) == _conn_split(conn))
+		{
+			conn->broken = 1;
+			ERROR_RETURN_LOG(int, "Cannot process the data from the client");
+		}
+
+		if(!conn->closing && conn->active >= conn->context->max_pipeline && conn->in.size > 0 && conn->in.size <= rc)
+		{
+			if(ERROR_CODE(int) == _invoke_pipe_cntl(conn->trans_in, RUNTIME_API_PIPE_CNTL_OPCODE_EOM, buf, rc - conn->in.size))
+			{
+				conn->broken = 1;
+				ERROR_RETURN_LOG(int, "Cannot give the unsplit data back to the transportation layer");
+			}
+			conn->in.size = 0;
+			_frame_reset(conn, 0);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Finalize a dispatched request, and give the connection back to the transportation layer when it's the last one
+ * @param request The request
+ * @param close If the connection should be closed after the response
+ * @return status code
+ **/
+static inline int _request_finalize(_request_t* request, int close)
+{
+	int rc = 0;
+	_conn_t* conn = request->conn;
+
+	pthread_mutex_lock(&conn->mutex);
+
+	request->done = 1;
+	request->close = (close != 0);
+
+	if(ERROR_CODE(int) == _conn_advance(conn))
+		rc = ERROR_CODE(int);
+
+	int release = (0 == --conn->active);
+
+	pthread_mutex_unlock(&conn->mutex);
+
+	if(release && ERROR_CODE(int) == _conn_release(conn))
+		rc = ERROR_CODE(int);
+
+	return rc;
+}
+
+/**
+ * @brief Accept a connection from the transportation layer and split all the available requests
+ * @param context The module context
+ * @param args The accept arguments
+ * @param in_flags The flags of the input pipe
+ * @param out_flags The flags of the output pipe
+ * @return status code
+ **/
+static inline int _conn_serve(_module_context_t* context, const void* args, runtime_api_pipe_flags_t in_flags, runtime_api_pipe_flags_t out_flags)
+{
+	itc_module_pipe_param_t trans_param = {
+		.input_flags = in_flags | RUNTIME_API_PIPE_PERSIST,
+		.output_flags = out_flags | RUNTIME_API_PIPE_PERSIST,
+		.args = args
+	};
+
+	if(context->async_write == 1) trans_param.output_flags |= RUNTIME_API_PIPE_ASYNC;
+
+	itc_module_pipe_t *trans_in = NULL, *trans_out = NULL;
+	_conn_t* conn = NULL;
+
+	if(ERROR_CODE(int) == itc_module_pipe_accept(context->transport_mod, trans_param, &trans_in, &trans_out) ||
+	   NULL == trans_in || NULL == trans_out)
+		ERROR_LOG_GOTO(ERR, "Cannot accept connection from the transportation layer");
+
+	if(ERROR_CODE(int) == _invoke_pipe_cntl(trans_in, RUNTIME_API_PIPE_CNTL_OPCODE_POP_STATE, &conn))
+		ERROR_LOG_GOTO(ERR, "Cannot pop the previous state from the pipe");
+
+	if(NULL == conn && NULL == (conn = _conn_new(context)))
+		ERROR_LOG_GOTO(ERR, "Cannot create the HTTP connection");
+
+	pthread_mutex_lock(&conn->mutex);
+
+	conn->trans_in = trans_in;
+	conn->trans_out = trans_out;
+
+	if(ERROR_CODE(int) == _conn_read(conn))
+		LOG_ERROR("Cannot process the data from the HTTP connection");
+
+	/* The module may answer a request which can not be framed without dispatching it */
+	if(ERROR_CODE(int) == _conn_advance(conn))
+		LOG_ERROR("Cannot write the response");
+
+	int release = (conn->active == 0);
+
+	pthread_mutex_unlock(&conn->mutex);
+
+	/* Otherwise, the last finalized request gives the connection back */
+	if(release) return _conn_release(conn);
+
+	return 0;
+ERR:
+	if(NULL != trans_in) itc_module_pipe_deallocate(trans_in);
+	if(NULL != trans_out) itc_module_pipe_deallocate(trans_out);
+	return ERROR_CODE(int);
+}
+
+/**
+ * @brief the initialization function of the HTTP/1.1 module
+ * @details the initialization argument should look like <br/>
+ *          <code>insmod "http1_pipe pipe.tcp.port_80";</code>
+ * @param ctx the context buffer
+ * @param argc the argument count
+ * @param argv the argument value
+ * @return the status code
+ **/
+static int _init(void* __restrict ctx, uint32_t argc, char const* __restrict const* __restrict argv)
+{
+	if(NULL == ctx) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(argc != 1) ERROR_RETURN_LOG(int, "Invalid module init args, should be http1_pipe <trans-module-path>");
+
+	if(ERROR_CODE(itc_module_type_t) == (context->transport_mod = itc_modtab_get_module_type_from_path(argv[0])))
+		ERROR_RETURN_LOG(int, "Cannot get the transportation layer module instance %s", argv[0]);
+
+	itc_module_flags_t mf = itc_module_get_flags(context->transport_mod);
+	if(ERROR_CODE(itc_module_flags_t) == mf) ERROR_RETURN_LOG(int, "Cannot get the module flags of the module instance %s", argv[0]);
+	if(0 != (mf & ITC_MODULE_FLAGS_EVENT_LOOP)) ERROR_RETURN_LOG(int, "Cannot use an event-accepting module as transprotation module");
+
+	context->async_write = 1;
+	context->max_pipeline = MODULE_HTTP1_MAX_PIPELINE;
+	context->max_request_size = MODULE_HTTP1_MAX_REQUEST_SIZE;
+	context->queue = NULL;
+	context->queue_tail = NULL;
+
+	return 0;
+}
+
+/**
+ * @brief Drop the requests which are split but never dispatched, and give their connections back
+ * @note This is called when the event loop has been stopped, but the transportation layer is still working,
+ *       so we are able to close the connections properly
+ * @param ctx the module context
+ * @return status code
+ **/
+static int _on_exit(void* __restrict ctx)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+	int rc = 0;
+
+	if(NULL != context->queue)
+		LOG_WARNING("There are HTTP requests never dispatched, closing their connections");
+
+	while(NULL != context->queue)
+	{
+		_request_t* request = context->queue;
+		if(NULL == (context->queue = request->queue_next))
+			context->queue_tail = NULL;
+		request->queue_next = NULL;
+
+		/* The last request of the connection gives the connection back to the transportation layer */
+		if(ERROR_CODE(int) == _request_finalize(request, 1))
+			rc = ERROR_CODE(int);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief cleanup the module
+ * @param ctx the module context
+ * @return status code
+ **/
+static int _cleanup(void* __restrict ctx)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(NULL != context->queue)
+		LOG_WARNING("There are HTTP requests never dispatched");
+
+	return 0;
+}
+
+/**
+ * @brief accept the next HTTP request
+ * @param ctx the module context
+ * @param args the accept arguments
+ * @param inbuf the input buffer
+ * @param outbuf the output buffer
+ * @return status code
+ **/
+static int _accept(void* __restrict ctx, const void* __restrict args, void* __restrict inbuf, void* __restrict outbuf)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+	runtime_api_pipe_flags_t in_flags  = itc_module_get_handle_flags(inbuf);
+	runtime_api_pipe_flags_t out_flags = itc_module_get_handle_flags(outbuf);
+
+	while(NULL == context->queue)
+		if(ERROR_CODE(int) == _conn_serve(context, args, in_flags, out_flags))
+			ERROR_RETURN_LOG(int, "Cannot serve the HTTP connection");
+
+	_request_t* request = context->queue;
+	if(NULL == (context->queue = request->queue_next))
+		context->queue_tail = NULL;
+	request->queue_next = NULL;
+
+	_handle_t* in = (_handle_t*)inbuf;
+	_handle_t* out = (_handle_t*)outbuf;
+
+	in->type = _HANDLE_TYPE_IN;
+	in->request = request;
+	out->type = _HANDLE_TYPE_OUT;
+	out->request = request;
+
+	return 0;
+}
+
+/**
+ * @brief deallocate a pipe handle
+ * @note The connection is kept open only if the servlet sets the persist flag, just like what the
+ *       transportation layer does
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @param error if this pipe encoutered an unrecoverable error
+ * @param purge if this is the last handle of the request
+ * @return status code
+ **/
+static int _dealloc(void* __restrict ctx, void* __restrict pipe, int error, int purge)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)pipe;
+
+	if(!purge) return 0;
+
+	runtime_api_pipe_flags_t flags = itc_module_get_handle_flags(pipe);
+
+	/* If the response is incomplete, the client is not able to find where the next response begins */
+	return _request_finalize(handle->request, error || !(flags & RUNTIME_API_PIPE_PERSIST));
+}
+
+/**
+ * @brief read the request
+ * @param ctx the module context
+ * @param buffer the data buffer
+ * @param bytes_to_read the number of bytes to read to buffer
+ * @param in the pipe handle
+ * @return the size has been actually read to the buffer, or error code
+ **/
+static size_t _read(void* __restrict ctx, void* __restrict buffer, size_t bytes_to_read, void* __restrict in)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)in;
+	if(handle->type != _HANDLE_TYPE_IN) ERROR_RETURN_LOG(size_t, "Wrong pipe type: Cannot read from a output HTTP pipe");
+
+	_request_t* request = handle->request;
+	size_t bytes = request->data.size - request->read_offset;
+	if(bytes > bytes_to_read) bytes = bytes_to_read;
+
+	if(bytes > 0) memcpy(buffer, request->data.data + request->read_offset, bytes);
+	request->last_read = request->read_offset;
+	request->read_offset += bytes;
+
+	return bytes;
+}
+
+/**
+ * @brief write the response, it goes to the transportation layer only when all the previous responses are done
+ * @param ctx the module context
+ * @param data the data to write
+ * @param nbytes the number of bytes to write
+ * @param out the pipe handle
+ * @return the number of bytes has been written, or error code
+ **/
+static size_t _write(void* __restrict ctx, const void* __restrict data, size_t nbytes, void* __restrict out)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)out;
+	if(handle->type != _HANDLE_TYPE_OUT) ERROR_RETURN_LOG(size_t, "Wrong pipe type: Cannot write to a input HTTP pipe");
+
+	_request_t* request = handle->request;
+	_conn_t* conn = request->conn;
+	int rc = 0;
+
+	pthread_mutex_lock(&conn->mutex);
+
+	if(conn->head == request)
+		rc = _conn_write(conn, (const char*)data, nbytes);
+	else if(!conn->broken && !conn->discard)
+		rc = _buf_append(&request->out, data, nbytes);
+
+	pthread_mutex_unlock(&conn->mutex);
+
+	if(ERROR_CODE(int) == rc) ERROR_RETURN_LOG(size_t, "Cannot write the response");
+
+	return nbytes;
+}
+
+/**
+ * @brief write the data source to the response
+ * @param ctx the module context
+ * @param source the data source
+ * @param out the pipe handle
+ * @return status code
+ **/
+static int _write_callback(void* __restrict ctx, itc_module_data_source_t source, void* __restrict out)
+{
+	char buf[4096];
+
+	for(;;)
+	{
+		int eos_rc = source.eos(source.data_handle);
+		if(ERROR_CODE(int) == eos_rc)
+			ERROR_RETURN_LOG(int, "Cannot check if the data source has reached the end of stream");
+		if(eos_rc) break;
+
+		size_t bytes = source.read(source.data_handle, buf, sizeof(buf), NULL);
+		if(ERROR_CODE(size_t) == bytes)
+			ERROR_RETURN_LOG(int, "Cannot read the data source");
+
+		if(bytes > 0 && ERROR_CODE(size_t) == _write(ctx, buf, bytes, out))
+			ERROR_RETURN_LOG(int, "Cannot write the data source to the response");
+	}
+
+	/* Once we returns successfully, the data source is owned by the module */
+	if(ERROR_CODE(int) == source.close(source.data_handle))
+	{
+		LOG_ERROR("Cannot close the data source");
+		return ERROR_CODE_OT(int);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief check if the request has unread data
+ * @param ctx the module context
+ * @param pipe the pipe to check
+ * @return the checking result or status code
+ **/
+static int _has_unread(void* __restrict ctx, void* __restrict pipe)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)pipe;
+	if(handle->type != _HANDLE_TYPE_IN) ERROR_RETURN_LOG(int, "Wrong pipe type: _HANDLE_TYPE_IN expected");
+
+	return handle->request->read_offset < handle->request->data.size;
+}
+
+/**
+ * @brief the end of message call
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @param buffer the buffer that has the data recently read
+ * @param offset the offset of the EOM token
+ * @return status code
+ **/
+static int _eom(void* __restrict ctx, void* __restrict pipe, const char* buffer, size_t offset)
+{
+	(void)ctx;
+	(void)buffer;
+	_handle_t* handle = (_handle_t*)pipe;
+	if(handle->type != _HANDLE_TYPE_IN) ERROR_RETURN_LOG(int, "Wrong pipe type: _HANDLE_TYPE_IN expected");
+
+	_request_t* request = handle->request;
+	if(request->last_read + offset > request->read_offset) ERROR_RETURN_LOG(int, "Invalid offset");
+
+	request->read_offset = request->last_read + offset;
+
+	return 0;
+}
+
+/**
+ * @brief push a user-space state to the pipe handle
+ * @note The module has already split the requests, so the state is disposed with the request
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @param state the state to push
+ * @param func the dispose function
+ * @return status code
+ **/
+static int _push_state(void* __restrict ctx, void* __restrict pipe, void* __restrict state, itc_module_state_dispose_func_t func)
+{
+	(void)ctx;
+	_request_t* request = ((_handle_t*)pipe)->request;
+
+	if(NULL != request->user_state && request->user_state != state && NULL != request->user_state_dispose &&
+	   ERROR_CODE(int) == request->user_state_dispose(request->user_state))
+		ERROR_RETURN_LOG(int, "Cannot dispose the previous user-space state");
+
+	request->user_state = state;
+	request->user_state_dispose = func;
+
+	return 0;
+}
+
+/**
+ * @brief pop the previous pushed state from the pipe handle
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @return the previously pushed state
+ **/
+static void* _pop_state(void* __restrict ctx, void* __restrict pipe)
+{
+	(void)ctx;
+	return ((_handle_t*)pipe)->request->user_state;
+}
+
+/**
+ * @brief the callback function used to cleanup when the thread gets killed
+ * @param ctx the module context
+ * @return nothing
+ **/
+static void _event_thread_killed(void* __restrict ctx)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	itc_module_loop_killed(context->transport_mod);
+}
+
+/**
+ * @brief get the path of the module instance
+ * @param ctx the module context
+ * @param buf the buffer used to return the path
+ * @param sz the size of the buffer
+ * @return the result path or NULL on error
+ **/
+static const char* _get_path(void* __restrict ctx, char* buf, size_t sz)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(NULL == itc_module_get_path(context->transport_mod, buf, sz))
+		ERROR_PTR_RETURN_LOG("Cannot get the path to transportation layer module");
+
+	return buf;
+}
+
+/**
+ * @brief get the flags of the module instance
+ * @param ctx the moudle context
+ * @return the flags
+ **/
+static itc_module_flags_t _get_flags(void* __restrict ctx)
+{
+	(void)ctx;
+	return ITC_MODULE_FLAGS_EVENT_LOOP;
+}
+
+/**
+ * @brief the callback function to get the property
+ * @param ctx the mdoule context
+ * @param sym the symbol name
+ * @return the property value
+ **/
+static itc_module_property_value_t _get_prop(void* __restrict ctx, const char* sym)
+{
+	itc_module_property_value_t ret = {
+		.type = ITC_MODULE_PROPERTY_TYPE_NONE
+	};
+	_module_context_t* context = (_module_context_t*)ctx;
+	if(strcmp(sym, "async_write") == 0)
+	{
+		ret.type = ITC_MODULE_PROPERTY_TYPE_INT;
+		ret.num = context->async_write;
+	}
+	else if(strcmp(sym, "max_pipeline") == 0)
+	{
+		ret.type = ITC_MODULE_PROPERTY_TYPE_INT;
+		ret.num = context->max_pipeline;
+	}
+	else if(strcmp(sym, "max_request_size") == 0)
+	{
+		ret.type = ITC_MODULE_PROPERTY_TYPE_INT;
+		ret.num = context->max_request_size;
+	}
+	return ret;
+}
+
+/**
+ * @brief the callback function to set the property
+ * @param ctx the module context
+ * @param sym the symbol name
+ * @param value the value to set
+ * @return the status code
+ **/
+static int _set_prop(void* __restrict ctx, const char* sym, itc_module_property_value_t value)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(value.type != ITC_MODULE_PROPERTY_TYPE_INT) return 0;
+
+	if(strcmp(sym, "async_write") == 0)
+		context->async_write = (value.num != 0);
+	else if(strcmp(sym, "max_pipeline") == 0)
+	{
+		if(value.num <= 0 || value.num > 0x7fffffff) ERROR_RETURN_LOG(int, "Invalid max_pipeline");
+		context->max_pipeline = (uint32_t)value.num;
+	}
+	else if(strcmp(sym, "max_request_size") == 0)
+	{
+		if(value.num <= 0 || value.num > 0x7fffffff) ERROR_RETURN_LOG(int, "Invalid max_request_size");
+		context->max_request_size = (uint32_t)value.num;
+	}
+	else return 0;
+
+	return 1;
+}
+
+/**
+ * @brief the module definition
+ **/
+itc_module_t module_http1_module_def = {
+	.mod_prefix = "pipe.http1",
+	.handle_size = sizeof(_handle_t),
+	.context_size = sizeof(_module_context_t),
+	.module_init = _init,
+	.module_cleanup = _cleanup,
+	.on_exit = _on_exit,
+	.accept = _accept,
+	.deallocate = _dealloc,
+	.read = _read,
+	.write = _write,
+	.write_callback = _write_callback,
+	.eom = _eom,
+	.has_unread_data = _has_unread,
+	.push_state = _push_state,
+	.pop_state = _pop_state,
+	.event_thread_killed = _event_thread_killed,
+	.get_path = _get_path,
+	.get_flags = _get_flags,
+	.get_property = _get_prop,
+	.set_property = _set_prop
+};
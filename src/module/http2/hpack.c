@@ -0,0 +1,609 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <error.h>
+#include <utils/log.h>
+
+#include <module/http2/hpack.h>
+
+/**
+ * @brief The entry of the dynamic table
+ **/
+struct _module_http2_hpack_entry_t {
+	uint32_t   name_len;    /*!< The length of the name */
+	uint32_t   value_len;   /*!< The length of the value */
+	char       data[0];     /*!< The name followed by the value */
+};
+
+/**
+ * @brief The size overhead of each entry in the dynamic table (RFC 7541 section 4.1)
+ **/
+#define _ENTRY_OVERHEAD 32u
+
+/**
+ * @brief The static table entry
+ **/
+typedef struct {
+	const char* name;       /*!< The field name */
+	const char* value;      /*!< The field value */
+} _static_entry_t;
+
+/**
+ * @brief The static table (RFC 7541 Appendix A), the index is 1-based in the protocol
+ **/
+static const _static_entry_t _static_table[] = {
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""}
+};
+
+/**
+ * @brief The number of entries in the static table
+ **/
+#define _STATIC_TABLE_SIZE (sizeof(_static_table) / sizeof(_static_table[0]))
+
+/**
+ * @brief The longest Huffman code in bits
+ **/
+#define _HUFFMAN_MAX_BITS 30
+
+/**
+ * @brief The EOS symbol, which should never appear in the encoded string
+ **/
+#define _HUFFMAN_EOS 256
+
+/**
+ * @brief The number of Huffman codes for each code length
+ * @note The HPACK Huffman code (RFC 7541 Appendix B) is a canonical code, which means the codes with the same
+ *       length are consecutive numbers assigned in the symbol order. So the code lengths and the symbols sorted
+ *       by the code length are enough to decode the string.
+ **/
+static const uint16_t _huffman_count[_HUFFMAN_MAX_BITS + 1] = {
+	0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3,
+	0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4
+};
+
+/**
+ * @brief The symbols sorted by the code length, and then the symbol value
+ **/
+static const uint16_t _huffman_symbol[] = {
+	48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+	52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+	110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+	77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+	119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+	43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+	195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+	179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+	163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+	233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+	158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+	144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+	200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+	212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+	2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+	21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+	256
+};
+
+int module_http2_hpack_table_init(module_http2_hpack_table_t* table, uint32_t limit)
+{
+	if(NULL == table) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	table->size = 0;
+	table->max_size = limit;
+	table->limit = limit;
+	table->count = 0;
+	table->capacity = 0;
+	table->first = 0;
+	table->entries = NULL;
+
+	return 0;
+}
+
+int module_http2_hpack_table_finalize(module_http2_hpack_table_t* table)
+{
+	if(NULL == table) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	uint32_t i;
+	for(i = 0; i < table->count; i ++)
+		free(table->entries[(table->first + i) % table->capacity]);
+
+	if(NULL != table->entries) free(table->entries);
+
+	table->entries = NULL;
+	table->count = table->capacity = table->first = table->size = 0;
+
+	return 0;
+}
+
+/**
+ * @brief Evict the oldest entries until the table size is not larger than the given size
+ * @param table The decoding context
+ * @param size The target size
+ * @return nothing
+ **/
+static inline void _evict(module_http2_hpack_table_t* table, uint32_t size)
+{
+	for(;table->count > 0 && table->size > size;)
+	{
+		module_http2_hpack_entry_t* entry = table->entries[table->first];
+		table->size -= _ENTRY_OVERHEAD + entry->name_len + entry->value_len;
+		free(entry);
+		table->first = (table->first + 1) % table->capacity;
+		table->count --;
+	}
+}
+
+/**
+ * @brief Add a new entry to the dynamic table
+ * @param table The decoding context
+ * @param name The name of the field
+ * @param name_len The length of the name
+ * @param value The value of the field
+ * @param value_len The length of the value
+ * @return status code
+ **/
+static inline int _insert(module_http2_hpack_table_t* table, const char* name, size_t name_len, const char* value, size_t value_len)
+{
+	size_t entry_size = _ENTRY_OVERHEAD + name_len + value_len;
+
+	/* An entry larger than the table empties the table, and it's not an error (RFC 7541 section 4.4) */
+	if(entry_size > table->max_size)
+	{
+		_evict(table, 0);
+		return 0;
+	}
+
+	/* The name may point to a dynamic table entry which is about to be evicted (RFC 7541 section 4.4),
+	 * so the new entry should be built before we evict anything */
+	module_http2_hpack_entry_t* entry = (module_http2_hpack_entry_t*)malloc(sizeof(*entry) + name_len + value_len);
+	if(NULL == entry) ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the dynamic table entry");
+
+	entry->name_len = (uint32_t)name_len;
+	entry->value_len = (uint32_t)value_len;
+	memcpy(entry->data, name, name_len);
+	memcpy(entry->data + name_len, value, value_len);
+
+	_evict(table, (uint32_t)(table->max_size - entry_size));
+
+	if(table->count == table->capacity)
+	{
+		uint32_t new_cap = table->capacity == 0 ? 32 : table->capacity * 2;
+		module_http2_hpack_entry_t** new_entries = (module_http2_hpack_entry_t**)malloc(sizeof(new_entries[0]) * new_cap);
+		if(NULL == new_entries)
+		{
+			free(entry);
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot resize the dynamic table");
+		}
+
+		uint32_t i;
+		for(i = 0; i < table->count; i ++)
+			new_entries[i] = table->entries[(table->first + i) % table->capacity];
+
+		if(NULL != table->entries) free(table->entries);
+		table->entries = new_entries;
+		table->capacity = new_cap;
+		table->first = 0;
+	}
+
+	table->entries[(table->first + table->count) % table->capacity] = entry;
+	table->count ++;
+	table->size += (uint32_t)entry_size;
+
+	return 0;
+}
+
+/**
+ * @brief Look up the table with the HPACK index
+ * @param table The decoding context
+ * @param index The index, the static table and the dynamic table share the same index space
+ * @param name The buffer used to return the name
+ * @param name_len The buffer used to return the name length
+ * @param value The buffer used to return the value, NULL if the value isn't needed
+ * @param value_len The buffer used to return the value length
+ * @return status code
+ **/
+static inline int _lookup(const module_http2_hpack_table_t* table, uint64_t index, const char** name, size_t* name_len, const char** value, size_t* value_len)
+{
+	if(index == 0) ERROR_RETURN_LOG(int, "Invalid HPACK index 0");
+
+	if(index <= _STATIC_TABLE_SIZE)
+	{
+		const _static_entry_t* entry = _static_table + index - 1;
+		*name = entry->name;
+		*name_len = strlen(entry->name);
+		if(NULL != value)
+		{
+			*value = entry->value;
+			*value_len = strlen(entry->value);
+		}
+		return 0;
+	}
+
+	index -= _STATIC_TABLE_SIZE;
+	if(index > table->count) ERROR_RETURN_LOG(int, "HPACK index out of the dynamic table");
+
+	/* The dynamic table is indexed from the newest entry */
+	const module_http2_hpack_entry_t* entry = table->entries[(table->first + table->count - (uint32_t)index) % table->capacity];
+	*name = entry->data;
+	*name_len = entry->name_len;
+	if(NULL != value)
+	{
+		*value = entry->data + entry->name_len;
+		*value_len = entry->value_len;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Decode a HPACK integer with the given prefix size
+ * @param begin The pointer to the reading position, which will be updated
+ * @param end The end of the header block
+ * @param bits The size of the prefix in bits
+ * @param result The buffer used to return the result
+ * @return status code
+ **/
+static inline int _decode_int(const uint8_t** begin, const uint8_t* end, uint32_t bits, uint64_t* result)
+{
+	const uint8_t* ptr = *begin;
+	if(ptr >= end) ERROR_RETURN_LOG(int, "Truncated HPACK integer");
+
+	uint64_t mask = (1u << bits) - 1;
+	uint64_t value = *(ptr++) & mask;
+
+	if(value == mask)
+	{
+		uint32_t shift = 0;
+		for(;;)
+		{
+			if(ptr >= end) ERROR_RETURN_LOG(int, "Truncated HPACK integer");
+			/* No legitimate integer in the header block needs more than 32 bits */
+			if(shift > 28) ERROR_RETURN_LOG(int, "HPACK integer overflow");
+
+			uint8_t byte = *(ptr++);
+			value += (uint64_t)(byte & 0x7f) << shift;
+			shift += 7;
+			if(!(byte & 0x80)) break;
+		}
+	}
+
+	*begin = ptr;
+	*result = value;
+	return 0;
+}
+
+/**
+ * @brief Decode a Huffman encoded string
+ * @param data The encoded data
+ * @param size The size of the encoded data
+ * @param out The output buffer, which should be at least size * 8 / 5 bytes
+ * @return The size of the decoded string or error code
+ **/
+static inline size_t _huffman_decode(const uint8_t* data, size_t size, char* out)
+{
+	size_t ret = 0;
+	uint32_t code = 0, first = 0, index = 0, len = 0, padding = 1;
+	size_t i;
+
+	for(i = 0; i < size; i ++)
+	{
+		int bit;
+		for(bit = 7; bit >= 0; bit --)
+		{
+			code |= (data[i] >> bit) & 1u;
+			padding &= (data[i] >> bit) & 1u;
+			len ++;
+
+			uint32_t count = _huffman_count[len];
+			if(code - first < count)
+			{
+				uint16_t sym = _huffman_symbol[index + code - first];
+				if(sym == _HUFFMAN_EOS) ERROR_RETURN_LOG(size_t, "Unexpected EOS symbol in the Huffman encoded string");
+				out[ret ++] = (char)sym;
+				code = first = index = len = 0;
+				padding = 1;
+				continue;
+			}
+
+			if(len >= _HUFFMAN_MAX_BITS) ERROR_RETURN_LOG(size_t, "Invalid Huffman code");
+
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+	}
+
+	/* The padding should be the most-significant bits of the EOS, which are all ones and shorter than 8 bits */
+	if(len >= 8 || !padding) ERROR_RETURN_LOG(size_t, "Invalid Huffman padding");
+
+	return ret;
+}
+
+/**
+ * @brief Decode a HPACK string literal
+ * @param begin The pointer to the reading position, which will be updated
+ * @param end The end of the header block
+ * @param buf The buffer used to hold the decoded Huffman string
+ * @param result The buffer used to return the string
+ * @param result_len The buffer used to return the length of the string
+ * @return status code
+ **/
+static inline int _decode_str(const uint8_t** begin, const uint8_t* end, char* buf, const char** result, size_t* result_len)
+{
+	if(*begin >= end) ERROR_RETURN_LOG(int, "Truncated HPACK string");
+
+	int huffman = (**begin & 0x80) != 0;
+	uint64_t length;
+	if(ERROR_CODE(int) == _decode_int(begin, end, 7, &length))
+		ERROR_RETURN_LOG(int, "Cannot decode the string length");
+
+	if(length > (uint64_t)(end - *begin)) ERROR_RETURN_LOG(int, "Truncated HPACK string");
+
+	if(huffman)
+	{
+		size_t rc = _huffman_decode(*begin, (size_t)length, buf);
+		if(ERROR_CODE(size_t) == rc) ERROR_RETURN_LOG(int, "Cannot decode the Huffman string");
+		*result = buf;
+		*result_len = rc;
+	}
+	else
+	{
+		*result = (const char*)*begin;
+		*result_len = (size_t)length;
+	}
+
+	*begin += length;
+
+	return 0;
+}
+
+int module_http2_hpack_decode(module_http2_hpack_table_t* table, const uint8_t* data, size_t size, module_http2_hpack_field_func_t func, void* cbdata)
+{
+	if(NULL == table || (NULL == data && size > 0) || NULL == func)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	/* A Huffman code is at least 5 bits, thus the name and the value decoded from the block never exceed this size */
+	char* buf = (char*)malloc(size * 8 / 5 + 1);
+	if(NULL == buf) ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate the string buffer");
+
+	const uint8_t* ptr = data, *end = data + size;
+	int allow_size_update = 1;
+
+	for(;ptr < end;)
+	{
+		uint8_t byte = *ptr;
+		const char* name = NULL, *value = NULL;
+		size_t name_len = 0, value_len = 0;
+		uint64_t index;
+		int indexing = 0;
+
+		if(byte & 0x80)
+		{
+			/* Indexed header field */
+			if(ERROR_CODE(int) == _decode_int(&ptr, end, 7, &index) ||
+			   ERROR_CODE(int) == _lookup(table, index, &name, &name_len, &value, &value_len))
+				ERROR_LOG_GOTO(ERR, "Invalid indexed header field");
+		}
+		else if((byte & 0xe0) == 0x20)
+		{
+			/* Dynamic table size update, which is only allowed at the beginning of the block */
+			if(!allow_size_update) ERROR_LOG_GOTO(ERR, "Unexpected dynamic table size update");
+
+			uint64_t new_size;
+			if(ERROR_CODE(int) == _decode_int(&ptr, end, 5, &new_size))
+				ERROR_LOG_GOTO(ERR, "Cannot decode the dynamic table size update");
+			if(new_size > table->limit)
+				ERROR_LOG_GOTO(ERR, "The dynamic table size %"PRIu64" exceeds the limit", new_size);
+
+			table->max_size = (uint32_t)new_size;
+			_evict(table, table->max_size);
+			continue;
+		}
+		else
+		{
+			/* Literal header field with incremental indexing (01), without indexing (0000) or never indexed (0001) */
+			uint32_t bits = 4;
+			if(byte & 0x40)
+			{
+				indexing = 1;
+				bits = 6;
+			}
+
+			if(ERROR_CODE(int) == _decode_int(&ptr, end, bits, &index))
+				ERROR_LOG_GOTO(ERR, "Cannot decode the name index");
+
+			char* strbuf = buf;
+			if(index > 0)
+			{
+				if(ERROR_CODE(int) == _lookup(table, index, &name, &name_len, NULL, NULL))
+					ERROR_LOG_GOTO(ERR, "Invalid name index");
+			}
+			else
+			{
+				if(ERROR_CODE(int) == _decode_str(&ptr, end, strbuf, &name, &name_len))
+					ERROR_LOG_GOTO(ERR, "Cannot decode the field name");
+				if(name == strbuf) strbuf += name_len;
+			}
+
+			if(ERROR_CODE(int) == _decode_str(&ptr, end, strbuf, &value, &value_len))
+				ERROR_LOG_GOTO(ERR, "Cannot decode the field value");
+		}
+
+		allow_size_update = 0;
+
+		if(ERROR_CODE(int) == func(name, name_len, value, value_len, cbdata))
+			ERROR_LOG_GOTO(ERR, "The header field callback returns an error");
+
+		/* The callback should see the field before the insertion, since the name may point to an entry the insertion evicts */
+		if(indexing && ERROR_CODE(int) == _insert(table, name, name_len, value, value_len))
+			ERROR_LOG_GOTO(ERR, "Cannot insert the field to the dynamic table");
+	}
+
+	free(buf);
+	return 0;
+ERR:
+	free(buf);
+	return ERROR_CODE(int);
+}
+
+/**
+ * @brief Encode a HPACK integer
+ * @param buf The output buffer
+ * @param size The size of the output buffer
+ * @param flags The bits before the prefix
+ * @param bits The size of the prefix
+ * @param value The value to encode
+ * @return The number of bytes has been written or error code
+ **/
+static inline size_t _encode_int(uint8_t* buf, size_t size, uint8_t flags, uint32_t bits, uint64_t value)
+{
+	uint64_t mask = (1u << bits) - 1;
+	size_t ret = 0;
+
+	if(size == 0) return ERROR_CODE(size_t);
+
+	if(value < mask)
+	{
+		buf[ret ++] = (uint8_t)(flags | value);
+		return ret;
+	}
+
+	buf[ret ++] = (uint8_t)(flags | mask);
+	value -= mask;
+
+	for(;value >= 0x80; value >>= 7)
+	{
+		if(ret >= size) return ERROR_CODE(size_t);
+		buf[ret ++] = (uint8_t)((value & 0x7f) | 0x80);
+	}
+
+	if(ret >= size) return ERROR_CODE(size_t);
+	buf[ret ++] = (uint8_t)value;
+
+	return ret;
+}
+
+/**
+ * @brief Encode a string literal without Huffman encoding
+ * @param buf The output buffer
+ * @param size The size of the output buffer
+ * @param str The string
+ * @param len The length of the string
+ * @return The number of bytes has been written or error code
+ **/
+static inline size_t _encode_str(uint8_t* buf, size_t size, const char* str, size_t len)
+{
+	size_t ret = _encode_int(buf, size, 0, 7, len);
+	if(ERROR_CODE(size_t) == ret || size - ret < len) return ERROR_CODE(size_t);
+
+	memcpy(buf + ret, str, len);
+
+	return ret + len;
+}
+
+size_t module_http2_hpack_encode_status(uint8_t* buf, size_t size, uint32_t status)
+{
+	if(NULL == buf || status < 100 || status > 999) ERROR_RETURN_LOG(size_t, "Invalid arguments");
+
+	uint32_t i;
+	char text[3] = {(char)('0' + status / 100), (char)('0' + status / 10 % 10), (char)('0' + status % 10)};
+
+	for(i = 0; i < _STATIC_TABLE_SIZE; i ++)
+		if(strcmp(_static_table[i].name, ":status") == 0 && memcmp(_static_table[i].value, text, 3) == 0)
+			return _encode_int(buf, size, 0x80, 7, i + 1);
+
+	/* The literal without indexing, and the name is the index of any :status entry in the static table */
+	size_t ret = _encode_int(buf, size, 0, 4, 8);
+	if(ERROR_CODE(size_t) == ret) return ERROR_CODE(size_t);
+
+	size_t rc = _encode_str(buf + ret, size - ret, text, 3);
+	if(ERROR_CODE(size_t) == rc) return ERROR_CODE(size_t);
+
+	return ret + rc;
+}
+
+size_t module_http2_hpack_encode_field(uint8_t* buf, size_t size, const char* name, size_t name_len, const char* value, size_t value_len)
+{
+	if(NULL == buf || NULL == name || NULL == value) ERROR_RETURN_LOG(size_t, "Invalid arguments");
+
+	if(size == 0) return ERROR_CODE(size_t);
+
+	/* Literal header field without indexing with a new name */
+	buf[0] = 0;
+	size_t ret = 1, rc;
+
+	if(ERROR_CODE(size_t) == (rc = _encode_str(buf + ret, size - ret, name, name_len)))
+		return ERROR_CODE(size_t);
+	ret += rc;
+
+	if(ERROR_CODE(size_t) == (rc = _encode_str(buf + ret, size - ret, value, value_len)))
+		return ERROR_CODE(size_t);
+
+	return ret + rc;
+}
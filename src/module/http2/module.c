@@ -0,0 +1,2095 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <constants.h>
+#include <error.h>
+#include <utils/log.h>
+
+#include <itc/module_types.h>
+#include <itc/module.h>
+#include <itc/modtab.h>
+
+#include <lang/prop.h>
+
+#include <module/tls/api.h>
+#include <module/http2/module.h>
+#include <module/http2/hpack.h>
+
+/**
+ * @brief The size of the frame header
+ **/
+#define _FRAME_HEADER_SIZE 9
+
+/**
+ * @brief The max frame size, we never advertise a larger SETTINGS_MAX_FRAME_SIZE, so this is the limit on both directions
+ **/
+#define _FRAME_SIZE 16384
+
+/**
+ * @brief The initial flow control window size defined by the RFC
+ **/
+#define _DEFAULT_WINDOW 65535
+
+/**
+ * @brief The max flow control window size
+ **/
+#define _MAX_WINDOW 0x7fffffff
+
+/**
+ * @brief The connection preface the client sends
+ **/
+static const char _preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+/**
+ * @brief The frame types
+ **/
+enum {
+	_FRAME_DATA          = 0x0,  /*!< DATA frame */
+	_FRAME_HEADERS       = 0x1,  /*!< HEADERS frame */
+	_FRAME_PRIORITY      = 0x2,  /*!< PRIORITY frame */
+	_FRAME_RST_STREAM    = 0x3,  /*!< RST_STREAM frame */
+	_FRAME_SETTINGS      = 0x4,  /*!< SETTINGS frame */
+	_FRAME_PUSH_PROMISE  = 0x5,  /*!< PUSH_PROMISE frame */
+	_FRAME_PING          = 0x6,  /*!< PING frame */
+	_FRAME_GOAWAY        = 0x7,  /*!< GOAWAY frame */
+	_FRAME_WINDOW_UPDATE = 0x8,  /*!< WINDOW_UPDATE frame */
+	_FRAME_CONTINUATION  = 0x9   /*!< CONTINUATION frame */
+};
+
+/**
+ * @brief The frame flags
+ **/
+enum {
+	_FLAG_END_STREAM     = 0x1,  /*!< The last frame of the stream */
+	_FLAG_ACK            = 0x1,  /*!< The acknowledge of SETTINGS and PING */
+	_FLAG_END_HEADERS    = 0x4,  /*!< The last frame of the header block */
+	_FLAG_PADDED         = 0x8,  /*!< The frame is padded */
+	_FLAG_PRIORITY       = 0x20  /*!< The HEADERS frame carries the priority fields */
+};
+
+/**
+ * @brief The error codes
+ **/
+enum {
+	_ERR_NO_ERROR            = 0x0,  /*!< Graceful shutdown */
+	_ERR_PROTOCOL_ERROR      = 0x1,  /*!< Protocol error detected */
+	_ERR_INTERNAL_ERROR      = 0x2,  /*!< Implementation fault */
+	_ERR_FLOW_CONTROL_ERROR  = 0x3,  /*!< Flow-control limits exceeded */
+	_ERR_STREAM_CLOSED       = 0x5,  /*!< Frame received for closed stream */
+	_ERR_FRAME_SIZE_ERROR    = 0x6,  /*!< Frame size incorrect */
+	_ERR_REFUSED_STREAM      = 0x7,  /*!< Stream not processed */
+	_ERR_CANCEL              = 0x8,  /*!< Stream cancelled */
+	_ERR_COMPRESSION_ERROR   = 0x9,  /*!< Compression state not updated */
+	_ERR_ENHANCE_YOUR_CALM   = 0xb   /*!< Processing capacity exceeded */
+};
+
+/**
+ * @brief The settings parameters
+ **/
+enum {
+	_SETTINGS_HEADER_TABLE_SIZE      = 0x1, /*!< The HPACK table size */
+	_SETTINGS_ENABLE_PUSH            = 0x2, /*!< If the server push is enabled */
+	_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3, /*!< The max number of concurrent streams */
+	_SETTINGS_INITIAL_WINDOW_SIZE    = 0x4, /*!< The initial stream window size */
+	_SETTINGS_MAX_FRAME_SIZE         = 0x5, /*!< The max frame size */
+	_SETTINGS_MAX_HEADER_LIST_SIZE   = 0x6  /*!< The max header list size */
+};
+
+/**
+ * @brief The state of the response translator
+ **/
+typedef enum {
+	_RESP_HEAD,           /*!< We are collecting the HTTP/1.1 response head */
+	_RESP_BODY,           /*!< We are sending the identity encoded body */
+	_RESP_CHUNK_SIZE,     /*!< We are parsing the chunk size line */
+	_RESP_CHUNK_EXT,      /*!< We are skipping the chunk extension */
+	_RESP_CHUNK_DATA,     /*!< We are sending the chunk data */
+	_RESP_CHUNK_DATA_END, /*!< We are skipping the CRLF after the chunk data */
+	_RESP_CHUNK_TRAILER,  /*!< We are skipping the trailer section */
+	_RESP_DONE            /*!< The response is complete, anything else should be discarded */
+} _resp_state_t;
+
+/**
+ * @brief A growable byte buffer
+ **/
+typedef struct {
+	char*        data;    /*!< The data */
+	size_t       size;    /*!< The number of bytes in the buffer */
+	size_t       cap;     /*!< The capacity of the buffer */
+} _buf_t;
+
+/**
+ * @brief The previous definition of the connection
+ **/
+typedef struct _conn_t _conn_t;
+
+/**
+ * @brief A HTTP/2 stream
+ **/
+typedef struct _stream_t {
+	uint32_t          id;                 /*!< The stream ID */
+	uint32_t          weight;             /*!< The priority weight, which decides the dispatch order */
+	_conn_t*          conn;               /*!< The connection this stream belongs to */
+	struct _stream_t* prev;               /*!< The previous stream in the connection */
+	struct _stream_t* next;               /*!< The next stream in the connection */
+	struct _stream_t* queue_next;         /*!< The next stream in the ready queue */
+	uint32_t          complete:1;         /*!< If the request has been completely received */
+	uint32_t          reset:1;            /*!< If the stream has been reset, all the response data will be discarded */
+	uint32_t          head:1;             /*!< If this is a HEAD request */
+	uint32_t          has_host:1;         /*!< If the request has the host header field */
+	uint32_t          regular_seen:1;     /*!< If we have seen a regular header field */
+	uint32_t          end_sent:1;         /*!< If we have sent the END_STREAM flag */
+	uint32_t          resp_length:1;      /*!< If the response has the content length */
+	uint32_t          pending_end:1;      /*!< If the END_STREAM flag should go with the last pending byte */
+	uint32_t          parked:1;           /*!< If the stream has been finalized, but still has pending data to send */
+	uint32_t          rst_code;           /*!< The error code we should reset the stream with after the header block is decoded */
+	_buf_t            method;             /*!< The :method pseudo field */
+	_buf_t            path;               /*!< The :path pseudo field */
+	_buf_t            authority;          /*!< The :authority pseudo field */
+	_buf_t            fields;             /*!< The regular header fields in HTTP/1.1 format */
+	_buf_t            cookie;             /*!< The cookie crumbs joined by "; " */
+	_buf_t            body;               /*!< The request body */
+	_buf_t            request;            /*!< The synthesized HTTP/1.1 request */
+	_buf_t            resp_head;          /*!< The HTTP/1.1 response head we have seen so far */
+	_buf_t            pending;            /*!< The response body which is blocked by the flow control window */
+	size_t            pending_pos;        /*!< How many bytes of the pending data have been sent */
+	size_t            read_offset;        /*!< The read pointer in the request */
+	size_t            last_read;          /*!< The read pointer before the last read */
+	int64_t           send_window;        /*!< The stream level send window */
+	_resp_state_t     resp_state;         /*!< The state of the response translator */
+	uint64_t          resp_remaining;     /*!< The remaining bytes of the body or current chunk */
+	uint32_t          trailer_line;       /*!< The length of the current trailer line */
+	void*             user_state;         /*!< The state the servlet pushed to the pipe */
+	itc_module_state_dispose_func_t user_state_dispose;  /*!< The dispose function of the user state */
+} _stream_t;
+
+/**
+ * @brief The module context
+ **/
+typedef struct {
+	itc_module_type_t transport_mod;          /*!< The transportation layer module */
+	uint32_t          async_write;            /*!< If we want the async write of the transportation layer */
+	uint32_t          max_concurrent_streams; /*!< The max number of concurrent streams per connection */
+	uint32_t          max_body_size;          /*!< The max size of the request body */
+	_stream_t*        queue;                  /*!< The streams ready to dispatch, only the event loop thread touches this */
+} _module_context_t;
+
+/**
+ * @brief A HTTP/2 connection, which is the state we pushed to the transportation layer pipe
+ **/
+struct _conn_t {
+	pthread_mutex_t             mutex;              /*!< The mutex that protects the connection */
+	_module_context_t*          context;            /*!< The module context */
+	itc_module_pipe_t*          trans_in;           /*!< The transportation layer input pipe, only valid when checked out */
+	itc_module_pipe_t*          trans_out;          /*!< The transportation layer output pipe, only valid when checked out */
+	module_http2_hpack_table_t  hpack;              /*!< The HPACK decoding context */
+	_stream_t*                  streams;            /*!< The list of the open streams */
+	uint32_t                    num_streams;        /*!< The number of open streams */
+	uint32_t                    active;             /*!< The number of dispatched streams which is not finalized yet */
+	uint32_t                    last_stream_id;     /*!< The largest stream ID the client has opened */
+	uint32_t                    preface_pos;        /*!< How many bytes of the client preface we have seen */
+	uint32_t                    settings_sent:1;    /*!< If we have sent the server preface */
+	uint32_t                    accepting:1;        /*!< If the event loop is serving the connection, only then new streams can be dispatched */
+	uint32_t                    closing:1;          /*!< If the connection should be closed once all the streams are done */
+	uint32_t                    goaway_sent:1;      /*!< If we have sent GOAWAY, then no more frames are processed */
+	uint32_t                    broken:1;           /*!< If the transportation layer is broken */
+	uint32_t                    alpn_checked:1;     /*!< If we have checked the protocol the client negotiated with ALPN */
+	uint32_t                    expect_continuation:1; /*!< If we are in the middle of a header block */
+	uint32_t                    block_end_stream:1; /*!< If the HEADERS frame has END_STREAM */
+	uint32_t                    block_sid;          /*!< The stream ID of the header block */
+	uint32_t                    block_weight;       /*!< The weight carried by the HEADERS frame */
+	_buf_t                      block;              /*!< The header block fragments */
+	_buf_t                      out;                /*!< The frames haven't been written to the transportation layer */
+	uint8_t                     header[_FRAME_HEADER_SIZE];  /*!< The frame header */
+	uint32_t                    header_pos;         /*!< How many bytes of the frame header we have seen */
+	uint32_t                    payload_size;       /*!< The payload size of current frame */
+	uint32_t                    payload_pos;        /*!< How many bytes of the payload we have seen */
+	int64_t                     send_window;        /*!< The connection level send window */
+	int64_t                     initial_window;     /*!< The SETTINGS_INITIAL_WINDOW_SIZE of the client */
+	uint8_t                     payload[_FRAME_SIZE];  /*!< The payload of current frame */
+};
+
+/**
+ * @brief The type of the pipe handle
+ **/
+typedef enum {
+	_HANDLE_TYPE_IN,     /*!< The input handle, which reads the request */
+	_HANDLE_TYPE_OUT     /*!< The output handle, which writes the response */
+} _handle_type_t;
+
+/**
+ * @brief The pipe handle
+ **/
+typedef struct {
+	_handle_type_t    type;    /*!< The handle type */
+	_stream_t*        stream;  /*!< The stream */
+} _handle_t;
+
+/**
+ * @brief the helper function to invoke the pipe_cntl API call
+ * @param pipe the pipe handle
+ * @param opcode the opcode
+ * @return status code
+ **/
+static inline int _invoke_pipe_cntl(itc_module_pipe_t* pipe, uint32_t opcode, ...)
+{
+	va_list ap;
+	va_start(ap, opcode);
+	int rc = itc_module_pipe_cntl(pipe, opcode, ap);
+	va_end(ap);
+	return rc;
+}
+
+/**
+ * @brief Append data to the buffer
+ * @param buf The buffer
+ * @param data The data to append
+ * @param size The size of the data
+ * @return status code
+ **/
+static inline int _buf_append(_buf_t* buf, const void* data, size_t size)
+{
+	if(size == 0) return 0;
+
+	if(buf->size + size > buf->cap)
+	{
+		size_t cap = buf->cap > 0 ? buf->cap : 64;
+		while(cap < buf->size + size) cap *= 2;
+		char* new_data = (char*)realloc(buf->data, cap);
+		if(NULL == new_data) ERROR_RETURN_LOG_ERRNO(int, "Cannot resize the buffer");
+		buf->data = new_data;
+		buf->cap = cap;
+	}
+
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+	return 0;
+}
+
+/**
+ * @brief Append a NULL-terminated string to the buffer
+ * @param buf The buffer
+ * @param str The string
+ * @return status code
+ **/
+static inline int _buf_append_str(_buf_t* buf, const char* str)
+{
+	return _buf_append(buf, str, strlen(str));
+}
+
+/**
+ * @brief Release the memory used by the buffer
+ * @param buf The buffer
+ * @return nothing
+ **/
+static inline void _buf_free(_buf_t* buf)
+{
+	if(NULL != buf->data) free(buf->data);
+	buf->data = NULL;
+	buf->size = buf->cap = 0;
+}
+
+/**
+ * @brief Dispose a stream
+ * @param stream The stream to dispose
+ * @return status code
+ **/
+static inline int _stream_free(_stream_t* stream)
+{
+	int rc = 0;
+	if(NULL != stream->user_state && NULL != stream->user_state_dispose && ERROR_CODE(int) == stream->user_state_dispose(stream->user_state))
+	{
+		LOG_ERROR("Cannot dispose the user-space state");
+		rc = ERROR_CODE(int);
+	}
+
+	_buf_free(&stream->method);
+	_buf_free(&stream->path);
+	_buf_free(&stream->authority);
+	_buf_free(&stream->fields);
+	_buf_free(&stream->cookie);
+	_buf_free(&stream->body);
+	_buf_free(&stream->request);
+	_buf_free(&stream->resp_head);
+	_buf_free(&stream->pending);
+	free(stream);
+	return rc;
+}
+
+/**
+ * @brief Remove the stream from the connection and dispose it
+ * @param conn The connection
+ * @param stream The stream
+ * @return status code
+ **/
+static inline int _stream_remove(_conn_t* conn, _stream_t* stream)
+{
+	if(NULL != stream->prev) stream->prev->next = stream->next;
+	else conn->streams = stream->next;
+	if(NULL != stream->next) stream->next->prev = stream->prev;
+	conn->num_streams --;
+
+	return _stream_free(stream);
+}
+
+/**
+ * @brief Find the open stream with the given ID
+ * @param conn The connection
+ * @param id The stream ID
+ * @return The stream or NULL if it's not open
+ **/
+static inline _stream_t* _stream_find(_conn_t* conn, uint32_t id)
+{
+	_stream_t* ret;
+	for(ret = conn->streams; NULL != ret && ret->id != id; ret = ret->next);
+	return ret;
+}
+
+/**
+ * @brief Create a new connection
+ * @param context The module context
+ * @return The newly created connection or NULL on error
+ **/
+static inline _conn_t* _conn_new(_module_context_t* context)
+{
+	_conn_t* ret = (_conn_t*)malloc(sizeof(_conn_t));
+	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the HTTP/2 connection");
+
+	memset(ret, 0, offsetof(_conn_t, payload));
+
+	if(ERROR_CODE(int) == module_http2_hpack_table_init(&ret->hpack, MODULE_HTTP2_HPACK_TABLE_SIZE))
+		ERROR_LOG_GOTO(ERR, "Cannot initialize the HPACK context");
+
+	if((errno = pthread_mutex_init(&ret->mutex, NULL)) != 0)
+	{
+		module_http2_hpack_table_finalize(&ret->hpack);
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot initialize the connection mutex");
+	}
+
+	ret->context = context;
+	ret->send_window = _DEFAULT_WINDOW;
+	ret->initial_window = _DEFAULT_WINDOW;
+
+	return ret;
+ERR:
+	free(ret);
+	return NULL;
+}
+
+/**
+ * @brief Dispose a connection
+ * @note This is the dispose function we push to the transportation layer, thus it may be called
+ *       by any thread once the transportation layer closes the connection
+ * @param data The connection
+ * @return status code
+ **/
+static int _conn_free(void* data)
+{
+	_conn_t* conn = (_conn_t*)data;
+	int rc = 0;
+
+	while(NULL != conn->streams)
+		if(ERROR_CODE(int) == _stream_remove(conn, conn->streams))
+			rc = ERROR_CODE(int);
+
+	if(ERROR_CODE(int) == module_http2_hpack_table_finalize(&conn->hpack))
+	{
+		LOG_ERROR("Cannot finalize the HPACK context");
+		rc = ERROR_CODE(int);
+	}
+
+	_buf_free(&conn->block);
+	_buf_free(&conn->out);
+
+	if((errno = pthread_mutex_destroy(&conn->mutex)) != 0)
+	{
+		LOG_ERROR_ERRNO("Cannot destroy the connection mutex");
+		rc = ERROR_CODE(int);
+	}
+
+	free(conn);
+	return rc;
+}
+
+/**
+ * @brief Give the connection back to the transportation layer
+ * @details After this function returns, the transportation layer owns the connection, it either puts the
+ *          connection back to the event loop or closes it and disposes the state. So the caller must not
+ *          touch the connection anymore.
+ * @param conn The connection
+ * @note This should be called without the connection mutex
+ * @return status code
+ **/
+static inline int _conn_release(_conn_t* conn)
+{
+	int rc = 0;
+	itc_module_pipe_t* trans_in = conn->trans_in;
+	itc_module_pipe_t* trans_out = conn->trans_out;
+
+	if(conn->closing || conn->broken)
+	{
+		LOG_DEBUG("Closing the HTTP/2 connection");
+		if(ERROR_CODE(int) == _invoke_pipe_cntl(trans_in, RUNTIME_API_PIPE_CNTL_OPCODE_CLR_FLAG, RUNTIME_API_PIPE_PERSIST) ||
+		   ERROR_CODE(int) == _invoke_pipe_cntl(trans_out, RUNTIME_API_PIPE_CNTL_OPCODE_CLR_FLAG, RUNTIME_API_PIPE_PERSIST))
+		{
+			LOG_ERROR("Cannot clear the persist flag of the transportation layer pipe");
+			rc = ERROR_CODE(int);
+		}
+	}
+
+	/* The transportation layer disposes the state when the connection gets closed, so we push it anyway */
+	if(ERROR_CODE(int) == _invoke_pipe_cntl(trans_in, RUNTIME_API_PIPE_CNTL_OPCODE_PUSH_STATE, conn, _conn_free))
+	{
+		LOG_ERROR("Cannot push the connection state to the transportation layer pipe");
+		_conn_free(conn);
+		rc = ERROR_CODE(int);
+	}
+
+	if(ERROR_CODE(int) == itc_module_pipe_deallocate(trans_in))
+	{
+		LOG_ERROR("Cannot deallocate the transportation layer input pipe");
+		rc = ERROR_CODE(int);
+	}
+
+	if(ERROR_CODE(int) == itc_module_pipe_deallocate(trans_out))
+	{
+		LOG_ERROR("Cannot deallocate the transportation layer output pipe");
+		rc = ERROR_CODE(int);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Write all the buffered frames to the transportation layer
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_flush(_conn_t* conn)
+{
+	const char* data = conn->out.data;
+	size_t size = conn->out.size;
+
+	conn->out.size = 0;
+
+	while(size > 0 && !conn->broken)
+	{
+		size_t rc = itc_module_pipe_write(data, size, conn->trans_out);
+		if(ERROR_CODE(size_t) == rc || rc == 0)
+		{
+			conn->broken = 1;
+			ERROR_RETURN_LOG(int, "Cannot write the frames to the transportation layer");
+		}
+		data += rc;
+		size -= rc;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Write a frame to the transportation layer
+ * @note The frames are buffered, so that the small frames of a response can go out with a single write. The buffer
+ *       is flushed once it's larger than a frame, or when the caller is going to wait or gives up the connection.
+ * @param conn The connection
+ * @param type The frame type
+ * @param flags The frame flags
+ * @param sid The stream ID
+ * @param payload The payload
+ * @param size The payload size, should not be larger than the max frame size
+ * @return status code
+ **/
+static inline int _write_frame(_conn_t* conn, uint8_t type, uint8_t flags, uint32_t sid, const void* payload, size_t size)
+{
+	if(conn->broken) ERROR_RETURN_LOG(int, "The connection is broken");
+
+	uint8_t header[_FRAME_HEADER_SIZE] = {
+		(uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size,
+		type, flags,
+		(uint8_t)((sid >> 24) & 0x7f), (uint8_t)(sid >> 16), (uint8_t)(sid >> 8), (uint8_t)sid
+	};
+
+	if(ERROR_CODE(int) == _buf_append(&conn->out, header, sizeof(header)) ||
+	   ERROR_CODE(int) == _buf_append(&conn->out, payload, size))
+		ERROR_RETURN_LOG(int, "Cannot append the frame to the output buffer");
+
+	if(conn->out.size >= _FRAME_SIZE) return _conn_flush(conn);
+
+	return 0;
+}
+
+/**
+ * @brief Write a frame with a 32 bit integer payload, i.e. RST_STREAM and WINDOW_UPDATE
+ * @param conn The connection
+ * @param type The frame type
+ * @param sid The stream ID
+ * @param value The value
+ * @return status code
+ **/
+static inline int _write_u32_frame(_conn_t* conn, uint8_t type, uint32_t sid, uint32_t value)
+{
+	uint8_t payload[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+	return _write_frame(conn, type, 0, sid, payload, sizeof(payload));
+}
+
+/**
+ * @brief Raise a connection error, which sends the GOAWAY frame and stops processing anything from the client
+ * @param conn The connection
+ * @param code The error code
+ * @param reason The reason for the log
+ * @return status code
+ **/
+static inline int _conn_error(_conn_t* conn, uint32_t code, const char* reason)
+{
+	(void)reason;
+	LOG_DEBUG("HTTP/2 connection error 0x%x: %s", code, reason);
+
+	uint32_t sid = conn->last_stream_id;
+	uint8_t payload[8] = {
+		(uint8_t)((sid >> 24) & 0x7f), (uint8_t)(sid >> 16), (uint8_t)(sid >> 8), (uint8_t)sid,
+		(uint8_t)(code >> 24), (uint8_t)(code >> 16), (uint8_t)(code >> 8), (uint8_t)code
+	};
+
+	conn->goaway_sent = 1;
+	conn->closing = 1;
+
+	return _write_frame(conn, _FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+}
+
+/**
+ * @brief Send the server connection preface, which is a SETTINGS frame
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_send_settings(_conn_t* conn)
+{
+	uint32_t max_streams = conn->context->max_concurrent_streams;
+	uint32_t max_headers = MODULE_HTTP2_MAX_HEADER_LIST_SIZE;
+	uint8_t payload[12] = {
+		0, _SETTINGS_MAX_CONCURRENT_STREAMS,
+		(uint8_t)(max_streams >> 24), (uint8_t)(max_streams >> 16), (uint8_t)(max_streams >> 8), (uint8_t)max_streams,
+		0, _SETTINGS_MAX_HEADER_LIST_SIZE,
+		(uint8_t)(max_headers >> 24), (uint8_t)(max_headers >> 16), (uint8_t)(max_headers >> 8), (uint8_t)max_headers
+	};
+
+	conn->settings_sent = 1;
+
+	return _write_frame(conn, _FRAME_SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+/**
+ * @brief Compare a string with a NULL-terminated string literal
+ * @param str The string
+ * @param len The length of the string
+ * @param lit The literal
+ * @return If they are the same
+ **/
+static inline int _is(const char* str, size_t len, const char* lit)
+{
+	return strlen(lit) == len && memcmp(str, lit, len) == 0;
+}
+
+/**
+ * @brief The HPACK callback that drops the field, which is used when we only need to keep the HPACK context in sync
+ * @param name The field name
+ * @param name_len The length of the name
+ * @param value The field value
+ * @param value_len The length of the value
+ * @param data The callback data
+ * @return status code
+ **/
+static int _field_discard(const char* name, size_t name_len, const char* value, size_t value_len, void* data)
+{
+	(void)name;
+	(void)name_len;
+	(void)value;
+	(void)value_len;
+	(void)data;
+	return 0;
+}
+
+/**
+ * @brief The HPACK callback that translates the field of a request to the HTTP/1.1 format
+ * @details If the field makes the request malformed, we don't fail the decoding, because the HPACK context
+ *          should be kept in sync. We record the stream error instead.
+ * @param name The field name
+ * @param name_len The length of the name
+ * @param value The field value
+ * @param value_len The length of the value
+ * @param data The stream
+ * @return status code
+ **/
+static int _field_request(const char* name, size_t name_len, const char* value, size_t value_len, void* data)
+{
+	_stream_t* stream = (_stream_t*)data;
+	size_t i;
+
+	if(stream->rst_code != _ERR_NO_ERROR) return 0;
+
+	if(stream->fields.size + stream->cookie.size + name_len + value_len + 32 > MODULE_HTTP2_MAX_HEADER_LIST_SIZE)
+	{
+		stream->rst_code = _ERR_ENHANCE_YOUR_CALM;
+		return 0;
+	}
+
+	for(i = 0; i < value_len; i ++)
+		if(value[i] == '\r' || value[i] == '\n' || value[i] == 0)
+			goto MALFORMED;
+
+	if(name_len > 0 && name[0] == ':')
+	{
+		_buf_t* target = NULL;
+
+		if(stream->regular_seen) goto MALFORMED;
+
+		if(_is(name, name_len, ":method")) target = &stream->method;
+		else if(_is(name, name_len, ":path")) target = &stream->path;
+		else if(_is(name, name_len, ":authority")) target = &stream->authority;
+		else if(!_is(name, name_len, ":scheme")) goto MALFORMED;
+
+		if(NULL == target) return 0;
+
+		/* The pseudo field should not be empty, and it should not appear twice */
+		if(target->size > 0 || value_len == 0) goto MALFORMED;
+		for(i = 0; i < value_len; i ++)
+			if(value[i] == ' ' && target != &stream->authority)
+				goto MALFORMED;
+
+		return _buf_append(target, value, value_len);
+	}
+
+	stream->regular_seen = 1;
+
+	if(name_len == 0) goto MALFORMED;
+	for(i = 0; i < name_len; i ++)
+		if((name[i] >= 'A' && name[i] <= 'Z') || name[i] == ':' || name[i] == '\r' || name[i] == '\n' || name[i] == ' ' || name[i] == 0)
+			goto MALFORMED;
+
+	/* The connection specific fields are not allowed in HTTP/2 */
+	if(_is(name, name_len, "connection") || _is(name, name_len, "keep-alive") || _is(name, name_len, "proxy-connection") ||
+	   _is(name, name_len, "transfer-encoding") || _is(name, name_len, "upgrade"))
+		goto MALFORMED;
+
+	if(_is(name, name_len, "te"))
+	{
+		if(!_is(value, value_len, "trailers")) goto MALFORMED;
+		return 0;
+	}
+
+	/* We always compute the content length from the DATA frames */
+	if(_is(name, name_len, "content-length")) return 0;
+
+	if(_is(name, name_len, "cookie"))
+	{
+		if(stream->cookie.size > 0 && ERROR_CODE(int) == _buf_append(&stream->cookie, "; ", 2))
+			ERROR_RETURN_LOG(int, "Cannot append the cookie separator");
+		return _buf_append(&stream->cookie, value, value_len);
+	}
+
+	if(_is(name, name_len, "host")) stream->has_host = 1;
+
+	if(ERROR_CODE(int) == _buf_append(&stream->fields, name, name_len) ||
+	   ERROR_CODE(int) == _buf_append(&stream->fields, ": ", 2) ||
+	   ERROR_CODE(int) == _buf_append(&stream->fields, value, value_len) ||
+	   ERROR_CODE(int) == _buf_append(&stream->fields, "\r\n", 2))
+		ERROR_RETURN_LOG(int, "Cannot append the header field");
+
+	return 0;
+MALFORMED:
+	LOG_DEBUG("Malformed header field in stream %u", stream->id);
+	stream->rst_code = _ERR_PROTOCOL_ERROR;
+	return 0;
+}
+
+/**
+ * @brief Build the HTTP/1.1 request for a completely received stream
+ * @param stream The stream
+ * @return status code
+ **/
+static inline int _stream_build_request(_stream_t* stream)
+{
+	_buf_t* req = &stream->request;
+	char length[32];
+
+	int need_length = stream->body.size > 0 ||
+	                  _is(stream->method.data, stream->method.size, "POST") ||
+	                  _is(stream->method.data, stream->method.size, "PUT") ||
+	                  _is(stream->method.data, stream->method.size, "PATCH");
+
+	if(ERROR_CODE(int) == _buf_append(req, stream->method.data, stream->method.size) ||
+	   ERROR_CODE(int) == _buf_append(req, " ", 1) ||
+	   ERROR_CODE(int) == _buf_append(req, stream->path.data, stream->path.size) ||
+	   ERROR_CODE(int) == _buf_append_str(req, " HTTP/1.1\r\n"))
+		ERROR_RETURN_LOG(int, "Cannot write the request line");
+
+	if(!stream->has_host && stream->authority.size > 0 &&
+	   (ERROR_CODE(int) == _buf_append_str(req, "host: ") ||
+	    ERROR_CODE(int) == _buf_append(req, stream->authority.data, stream->authority.size) ||
+	    ERROR_CODE(int) == _buf_append(req, "\r\n", 2)))
+		ERROR_RETURN_LOG(int, "Cannot write the host field");
+
+	if(ERROR_CODE(int) == _buf_append(req, stream->fields.data, stream->fields.size))
+		ERROR_RETURN_LOG(int, "Cannot write the header fields");
+
+	if(stream->cookie.size > 0 &&
+	   (ERROR_CODE(int) == _buf_append_str(req, "cookie: ") ||
+	    ERROR_CODE(int) == _buf_append(req, stream->cookie.data, stream->cookie.size) ||
+	    ERROR_CODE(int) == _buf_append(req, "\r\n", 2)))
+		ERROR_RETURN_LOG(int, "Cannot write the cookie field");
+
+	if(need_length)
+	{
+		snprintf(length, sizeof(length), "content-length: %zu\r\n", stream->body.size);
+		if(ERROR_CODE(int) == _buf_append_str(req, length))
+			ERROR_RETURN_LOG(int, "Cannot write the content length field");
+	}
+
+	if(ERROR_CODE(int) == _buf_append(req, "\r\n", 2) ||
+	   ERROR_CODE(int) == _buf_append(req, stream->body.data, stream->body.size))
+		ERROR_RETURN_LOG(int, "Cannot write the request body");
+
+	if(_is(stream->method.data, stream->method.size, "HEAD"))
+		stream->head = 1;
+
+	_buf_free(&stream->method);
+	_buf_free(&stream->path);
+	_buf_free(&stream->authority);
+	_buf_free(&stream->fields);
+	_buf_free(&stream->cookie);
+	_buf_free(&stream->body);
+
+	return 0;
+}
+
+/**
+ * @brief Handle a stream that has been completely received
+ * @details If the event loop is serving the connection, the stream is put into the ready queue ordered by
+ *          the weight. Otherwise, nobody can dispatch the stream, so we refuse it and the client is free to retry.
+ * @param conn The connection
+ * @param stream The stream
+ * @return status code
+ **/
+static inline int _stream_complete(_conn_t* conn, _stream_t* stream)
+{
+	stream->complete = 1;
+
+	if(!conn->accepting)
+	{
+		LOG_DEBUG("Refusing stream %u because the connection is not accepting new requests", stream->id);
+		if(ERROR_CODE(int) == _write_u32_frame(conn, _FRAME_RST_STREAM, stream->id, _ERR_REFUSED_STREAM))
+			LOG_ERROR("Cannot reset the stream");
+		return _stream_remove(conn, stream);
+	}
+
+	if(ERROR_CODE(int) == _stream_build_request(stream))
+	{
+		LOG_ERROR("Cannot build the request for stream %u", stream->id);
+		if(ERROR_CODE(int) == _write_u32_frame(conn, _FRAME_RST_STREAM, stream->id, _ERR_INTERNAL_ERROR))
+			LOG_ERROR("Cannot reset the stream");
+		return _stream_remove(conn, stream);
+	}
+
+	conn->active ++;
+
+	_stream_t** pos;
+	for(pos = &conn->context->queue; NULL != *pos && (*pos)->weight >= stream->weight; pos = &(*pos)->queue_next);
+	stream->queue_next = *pos;
+	*pos = stream;
+
+	LOG_DEBUG("Stream %u with weight %u is ready", stream->id, stream->weight);
+
+	return 0;
+}
+
+/**
+ * @brief Reset a stream that has not been dispatched yet, or mark a dispatched stream reset
+ * @param conn The connection
+ * @param stream The stream
+ * @param code The error code, or ERROR_CODE(uint32_t) if we don't send the RST_STREAM frame
+ * @return status code
+ **/
+static inline int _stream_reset(_conn_t* conn, _stream_t* stream, uint32_t code)
+{
+	int rc = 0;
+
+	if(code != ERROR_CODE(uint32_t) && ERROR_CODE(int) == _write_u32_frame(conn, _FRAME_RST_STREAM, stream->id, code))
+	{
+		LOG_ERROR("Cannot send the RST_STREAM frame");
+		rc = ERROR_CODE(int);
+	}
+
+	if(stream->complete && !stream->parked)
+	{
+		stream->reset = 1;
+		return rc;
+	}
+
+	if(ERROR_CODE(int) == _stream_remove(conn, stream))
+		rc = ERROR_CODE(int);
+
+	return rc;
+}
+
+/**
+ * @brief Process a complete header block
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_header_block(_conn_t* conn)
+{
+	uint32_t sid = conn->block_sid;
+	const uint8_t* block = (const uint8_t*)conn->block.data;
+	size_t size = conn->block.size;
+	_stream_t* stream = _stream_find(conn, sid);
+
+	if(NULL != stream)
+	{
+		if(ERROR_CODE(int) == module_http2_hpack_decode(&conn->hpack, block, size, _field_discard, NULL))
+			return _conn_error(conn, _ERR_COMPRESSION_ERROR, "Cannot decode the header block");
+
+		if(stream->complete)
+			return _stream_reset(conn, stream, _ERR_STREAM_CLOSED);
+
+		/* This is the trailer section, which we don't forward */
+		if(!conn->block_end_stream)
+			return _stream_reset(conn, stream, _ERR_PROTOCOL_ERROR);
+
+		return _stream_complete(conn, stream);
+	}
+
+	if(sid <= conn->last_stream_id || (sid & 1) == 0)
+	{
+		if(ERROR_CODE(int) == module_http2_hpack_decode(&conn->hpack, block, size, _field_discard, NULL))
+			return _conn_error(conn, _ERR_COMPRESSION_ERROR, "Cannot decode the header block");
+		return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Invalid stream ID");
+	}
+
+	conn->last_stream_id = sid;
+
+	if(!conn->accepting || conn->closing || conn->num_streams >= conn->context->max_concurrent_streams)
+	{
+		if(ERROR_CODE(int) == module_http2_hpack_decode(&conn->hpack, block, size, _field_discard, NULL))
+			return _conn_error(conn, _ERR_COMPRESSION_ERROR, "Cannot decode the header block");
+		LOG_DEBUG("Refusing stream %u", sid);
+		return _write_u32_frame(conn, _FRAME_RST_STREAM, sid, _ERR_REFUSED_STREAM);
+	}
+
+	if(NULL == (stream = (_stream_t*)calloc(1, sizeof(_stream_t))))
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the stream");
+
+	stream->id = sid;
+	stream->weight = conn->block_weight;
+	stream->conn = conn;
+	stream->send_window = conn->initial_window;
+	stream->resp_state = _RESP_HEAD;
+
+	if(ERROR_CODE(int) == module_http2_hpack_decode(&conn->hpack, block, size, _field_request, stream))
+	{
+		_stream_free(stream);
+		return _conn_error(conn, _ERR_COMPRESSION_ERROR, "Cannot decode the header block");
+	}
+
+	if(stream->rst_code == _ERR_NO_ERROR && (stream->method.size == 0 || stream->path.size == 0))
+		stream->rst_code = _ERR_PROTOCOL_ERROR;
+
+	if(stream->rst_code != _ERR_NO_ERROR)
+	{
+		uint32_t code = stream->rst_code;
+		_stream_free(stream);
+		return _write_u32_frame(conn, _FRAME_RST_STREAM, sid, code);
+	}
+
+	stream->next = conn->streams;
+	if(NULL != conn->streams) conn->streams->prev = stream;
+	conn->streams = stream;
+	conn->num_streams ++;
+
+	if(conn->block_end_stream)
+		return _stream_complete(conn, stream);
+
+	return 0;
+}
+
+/**
+ * @brief Remove the padding of the frame payload
+ * @param conn The connection
+ * @param flags The frame flags
+ * @param data The payload, it will be updated to the actual data
+ * @param size The payload size, it will be updated to the actual data size
+ * @return 1 if it's successful, 0 if the padding is invalid
+ **/
+static inline int _strip_padding(const _conn_t* conn, uint8_t flags, const uint8_t** data, size_t* size)
+{
+	(void)conn;
+	if(!(flags & _FLAG_PADDED)) return 1;
+
+	if(*size < 1) return 0;
+	size_t pad = (*data)[0];
+	if(pad >= *size) return 0;
+
+	(*data) ++;
+	*size -= pad + 1;
+	return 1;
+}
+
+/**
+ * @brief Send as many DATA frames as the flow control windows allow
+ * @param conn The connection
+ * @param stream The stream
+ * @param data The data to send, it will be updated to the first byte which hasn't been sent
+ * @param size The size of the data, it will be updated to the number of bytes which haven't been sent
+ * @param end If this is the end of the response
+ * @return status code
+ **/
+static inline int _send_window(_conn_t* conn, _stream_t* stream, const char** data, size_t* size, int end)
+{
+	for(;;)
+	{
+		size_t bytes = *size;
+		if(bytes > _FRAME_SIZE) bytes = _FRAME_SIZE;
+		if((int64_t)bytes > conn->send_window) bytes = conn->send_window > 0 ? (size_t)conn->send_window : 0;
+		if((int64_t)bytes > stream->send_window) bytes = stream->send_window > 0 ? (size_t)stream->send_window : 0;
+
+		int last = end && bytes == *size;
+
+		if(bytes == 0 && !last) return 0;
+
+		if(ERROR_CODE(int) == _write_frame(conn, _FRAME_DATA, last ? _FLAG_END_STREAM : 0, stream->id, *data, bytes))
+			ERROR_RETURN_LOG(int, "Cannot write the DATA frame");
+
+		conn->send_window -= (int64_t)bytes;
+		stream->send_window -= (int64_t)bytes;
+		*data += bytes;
+		*size -= bytes;
+
+		if(last)
+		{
+			stream->end_sent = 1;
+			return 0;
+		}
+	}
+}
+
+/**
+ * @brief Send the response body as DATA frames
+ * @details We never wait for the flow control window on the worker thread. The bytes the window doesn't allow
+ *          are kept in the pending buffer of the stream, and they are sent when the client opens the window.
+ * @param conn The connection
+ * @param stream The stream
+ * @param data The data to send
+ * @param size The size of the data
+ * @param end If this is the end of the response
+ * @return status code
+ **/
+static inline int _send_data(_conn_t* conn, _stream_t* stream, const char* data, size_t size, int end)
+{
+	if(end) stream->resp_state = _RESP_DONE;
+
+	if(stream->reset || conn->broken) return 0;
+
+	/* The new data should not overtake the data which is already pending */
+	if(stream->pending.size == 0 && ERROR_CODE(int) == _send_window(conn, stream, &data, &size, end))
+		ERROR_RETURN_LOG(int, "Cannot send the DATA frames");
+
+	if(ERROR_CODE(int) == _buf_append(&stream->pending, data, size))
+		ERROR_RETURN_LOG(int, "Cannot append the data to the pending buffer");
+
+	if(end && !stream->end_sent) stream->pending_end = 1;
+
+	return 0;
+}
+
+/**
+ * @brief Send the pending data of the stream once the client opens the flow control window
+ * @note If the stream has been finalized and everything is sent, the stream is disposed
+ * @param conn The connection, the caller should hold the connection mutex
+ * @param stream The stream
+ * @return status code
+ **/
+static inline int _stream_resume(_conn_t* conn, _stream_t* stream)
+{
+	if(stream->reset || (stream->pending.size == 0 && !stream->pending_end)) return 0;
+
+	const char* data = stream->pending.data + stream->pending_pos;
+	size_t size = stream->pending.size - stream->pending_pos;
+
+	if(ERROR_CODE(int) == _send_window(conn, stream, &data, &size, stream->pending_end))
+		ERROR_RETURN_LOG(int, "Cannot send the pending data of stream %u", stream->id);
+
+	stream->pending_pos = stream->pending.size - size;
+
+	if(size > 0 || (stream->pending_end && !stream->end_sent)) return 0;
+
+	_buf_free(&stream->pending);
+	stream->pending_pos = 0;
+	stream->pending_end = 0;
+
+	if(stream->parked)
+	{
+		LOG_DEBUG("All the pending data of stream %u has been sent", stream->id);
+		return _stream_remove(conn, stream);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Resume all the streams blocked by the flow control window
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_resume(_conn_t* conn)
+{
+	_stream_t *stream, *next;
+	int rc = 0;
+
+	for(stream = conn->streams; NULL != stream && conn->send_window > 0; stream = next)
+	{
+		next = stream->next;
+		if(ERROR_CODE(int) == _stream_resume(conn, stream))
+			rc = ERROR_CODE(int);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Process a complete frame
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_frame(_conn_t* conn)
+{
+	uint8_t type = conn->header[3];
+	uint8_t flags = conn->header[4];
+	uint32_t sid = ((uint32_t)(conn->header[5] & 0x7f) << 24) | ((uint32_t)conn->header[6] << 16) | ((uint32_t)conn->header[7] << 8) | conn->header[8];
+	const uint8_t* data = conn->payload;
+	size_t size = conn->payload_size;
+	_stream_t* stream;
+
+	if(conn->expect_continuation && type != _FRAME_CONTINUATION)
+		return _conn_error(conn, _ERR_PROTOCOL_ERROR, "CONTINUATION frame expected");
+
+	switch(type)
+	{
+		case _FRAME_DATA:
+			if(sid == 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "DATA frame on stream 0");
+			if(size > 0 && ERROR_CODE(int) == _write_u32_frame(conn, _FRAME_WINDOW_UPDATE, 0, (uint32_t)size))
+				ERROR_RETURN_LOG(int, "Cannot update the connection window");
+			if(NULL == (stream = _stream_find(conn, sid)))
+			{
+				if(sid > conn->last_stream_id) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "DATA frame on idle stream");
+				return 0;
+			}
+			if(stream->complete)
+				return _stream_reset(conn, stream, _ERR_STREAM_CLOSED);
+			{
+				size_t received = size;
+				if(!_strip_padding(conn, flags, &data, &size))
+					return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Invalid padding");
+				if(stream->body.size + size > conn->context->max_body_size)
+					return _stream_reset(conn, stream, _ERR_ENHANCE_YOUR_CALM);
+				if(ERROR_CODE(int) == _buf_append(&stream->body, data, size))
+					return _stream_reset(conn, stream, _ERR_INTERNAL_ERROR);
+				if(flags & _FLAG_END_STREAM)
+					return _stream_complete(conn, stream);
+				if(received > 0 && ERROR_CODE(int) == _write_u32_frame(conn, _FRAME_WINDOW_UPDATE, sid, (uint32_t)received))
+					ERROR_RETURN_LOG(int, "Cannot update the stream window");
+			}
+			return 0;
+		case _FRAME_HEADERS:
+			if(sid == 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "HEADERS frame on stream 0");
+			if(!_strip_padding(conn, flags, &data, &size))
+				return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Invalid padding");
+			conn->block_weight = 16;
+			if(flags & _FLAG_PRIORITY)
+			{
+				if(size < 5) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Invalid priority fields");
+				conn->block_weight = (uint32_t)data[4] + 1;
+				data += 5;
+				size -= 5;
+			}
+			conn->block_sid = sid;
+			conn->block_end_stream = ((flags & _FLAG_END_STREAM) != 0);
+			conn->block.size = 0;
+			goto HEADER_BLOCK;
+		case _FRAME_CONTINUATION:
+			if(!conn->expect_continuation || sid != conn->block_sid)
+				return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Unexpected CONTINUATION frame");
+HEADER_BLOCK:
+			if(conn->block.size + size > 2 * MODULE_HTTP2_MAX_HEADER_LIST_SIZE)
+				return _conn_error(conn, _ERR_ENHANCE_YOUR_CALM, "The header block is too large");
+			if(ERROR_CODE(int) == _buf_append(&conn->block, data, size))
+				ERROR_RETURN_LOG(int, "Cannot append the header block fragment");
+			if(!(flags & _FLAG_END_HEADERS))
+			{
+				conn->expect_continuation = 1;
+				return 0;
+			}
+			conn->expect_continuation = 0;
+			return _conn_header_block(conn);
+		case _FRAME_PRIORITY:
+			if(sid == 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "PRIORITY frame on stream 0");
+			if(size != 5) return _conn_error(conn, _ERR_FRAME_SIZE_ERROR, "Invalid PRIORITY frame");
+			/* The weight only matters before the stream is dispatched, and we don't track the dependency tree */
+			if(NULL != (stream = _stream_find(conn, sid)) && !stream->complete)
+				stream->weight = (uint32_t)data[4] + 1;
+			return 0;
+		case _FRAME_RST_STREAM:
+			if(sid == 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "RST_STREAM frame on stream 0");
+			if(size != 4) return _conn_error(conn, _ERR_FRAME_SIZE_ERROR, "Invalid RST_STREAM frame");
+			if(NULL == (stream = _stream_find(conn, sid)))
+			{
+				if(sid > conn->last_stream_id) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "RST_STREAM frame on idle stream");
+				return 0;
+			}
+			LOG_DEBUG("Stream %u has been reset by the client", sid);
+			return _stream_reset(conn, stream, ERROR_CODE(uint32_t));
+		case _FRAME_SETTINGS:
+			if(sid != 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "SETTINGS frame on a stream");
+			if(flags & _FLAG_ACK)
+			{
+				if(size != 0) return _conn_error(conn, _ERR_FRAME_SIZE_ERROR, "Invalid SETTINGS ACK frame");
+				return 0;
+			}
+			if(size % 6 != 0) return _conn_error(conn, _ERR_FRAME_SIZE_ERROR, "Invalid SETTINGS frame");
+			for(; size > 0; data += 6, size -= 6)
+			{
+				uint32_t id = ((uint32_t)data[0] << 8) | data[1];
+				uint32_t value = ((uint32_t)data[2] << 24) | ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 8) | data[5];
+				switch(id)
+				{
+					case _SETTINGS_ENABLE_PUSH:
+						if(value > 1) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Invalid SETTINGS_ENABLE_PUSH");
+						break;
+					case _SETTINGS_INITIAL_WINDOW_SIZE:
+						if(value > _MAX_WINDOW) return _conn_error(conn, _ERR_FLOW_CONTROL_ERROR, "Invalid SETTINGS_INITIAL_WINDOW_SIZE");
+						for(stream = conn->streams; NULL != stream; stream = stream->next)
+						{
+							stream->send_window += (int64_t)value - conn->initial_window;
+							if(stream->send_window > _MAX_WINDOW)
+								return _conn_error(conn, _ERR_FLOW_CONTROL_ERROR, "Stream window overflow");
+						}
+						conn->initial_window = value;
+						if(ERROR_CODE(int) == _conn_resume(conn))
+							ERROR_RETURN_LOG(int, "Cannot resume the streams");
+						break;
+					case _SETTINGS_MAX_FRAME_SIZE:
+						if(value < _FRAME_SIZE || value > 0xffffff)
+							return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Invalid SETTINGS_MAX_FRAME_SIZE");
+						break;
+					default:
+						/* We don't compress with the dynamic table, so the HPACK table size doesn't matter */
+						break;
+				}
+			}
+			return _write_frame(conn, _FRAME_SETTINGS, _FLAG_ACK, 0, NULL, 0);
+		case _FRAME_PUSH_PROMISE:
+			return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Client can not push");
+		case _FRAME_PING:
+			if(sid != 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "PING frame on a stream");
+			if(size != 8) return _conn_error(conn, _ERR_FRAME_SIZE_ERROR, "Invalid PING frame");
+			if(flags & _FLAG_ACK) return 0;
+			return _write_frame(conn, _FRAME_PING, _FLAG_ACK, 0, data, size);
+		case _FRAME_GOAWAY:
+			if(sid != 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "GOAWAY frame on a stream");
+			LOG_DEBUG("The client is going away");
+			conn->closing = 1;
+			return 0;
+		case _FRAME_WINDOW_UPDATE:
+		{
+			if(size != 4) return _conn_error(conn, _ERR_FRAME_SIZE_ERROR, "Invalid WINDOW_UPDATE frame");
+			uint32_t inc = ((uint32_t)(data[0] & 0x7f) << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+			if(sid == 0)
+			{
+				if(inc == 0) return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Zero window increment");
+				if((conn->send_window += inc) > _MAX_WINDOW)
+					return _conn_error(conn, _ERR_FLOW_CONTROL_ERROR, "Connection window overflow");
+				return _conn_resume(conn);
+			}
+			if(NULL == (stream = _stream_find(conn, sid))) return 0;
+			if(inc == 0) return _stream_reset(conn, stream, _ERR_PROTOCOL_ERROR);
+			if((stream->send_window += inc) > _MAX_WINDOW)
+				return _stream_reset(conn, stream, _ERR_FLOW_CONTROL_ERROR);
+			return _stream_resume(conn, stream);
+		}
+		default:
+			/* Unknown frame types must be ignored */
+			return 0;
+	}
+}
+
+/**
+ * @brief Feed the bytes read from the transportation layer to the frame parser
+ * @param conn The connection
+ * @param data The data
+ * @param size The size of the data
+ * @return status code
+ **/
+static inline int _conn_feed(_conn_t* conn, const uint8_t* data, size_t size)
+{
+	while(size > 0 && !conn->goaway_sent && !conn->broken)
+	{
+		if(conn->preface_pos < sizeof(_preface) - 1)
+		{
+			if(data[0] != (uint8_t)_preface[conn->preface_pos])
+			{
+				LOG_DEBUG("Invalid HTTP/2 connection preface");
+				return _conn_error(conn, _ERR_PROTOCOL_ERROR, "Invalid connection preface");
+			}
+			conn->preface_pos ++;
+			data ++;
+			size --;
+			continue;
+		}
+
+		if(conn->header_pos < _FRAME_HEADER_SIZE)
+		{
+			size_t bytes = _FRAME_HEADER_SIZE - conn->header_pos;
+			if(bytes > size) bytes = size;
+			memcpy(conn->header + conn->header_pos, data, bytes);
+			conn->header_pos += (uint32_t)bytes;
+			data += bytes;
+			size -= bytes;
+
+			if(conn->header_pos < _FRAME_HEADER_SIZE) break;
+
+			conn->payload_size = ((uint32_t)conn->header[0] << 16) | ((uint32_t)conn->header[1] << 8) | conn->header[2];
+			conn->payload_pos = 0;
+
+			if(conn->payload_size > _FRAME_SIZE)
+				return _conn_error(conn, _ERR_FRAME_SIZE_ERROR, "Frame is too large");
+		}
+
+		size_t bytes = conn->payload_size - conn->payload_pos;
+		if(bytes > size) bytes = size;
+		memcpy(conn->payload + conn->payload_pos, data, bytes);
+		conn->payload_pos += (uint32_t)bytes;
+		data += bytes;
+		size -= bytes;
+
+		if(conn->payload_pos < conn->payload_size) break;
+
+		conn->header_pos = 0;
+
+		if(ERROR_CODE(int) == _conn_frame(conn))
+			ERROR_RETURN_LOG(int, "Cannot process the frame");
+	}
+
+	return 0;
+}
+
+#if MODULE_TLS_ENABLED
+/**
+ * @brief Make sure the client negotiated HTTP/2 if the transportation layer is a TLS module instance
+ * @note The cntl call is ignored by other transportation layer modules, and the client which doesn't
+ *       use the ALPN extension is assumed to have the prior knowledge
+ * @param conn The connection
+ * @return status code
+ **/
+static inline int _conn_check_alpn(_conn_t* conn)
+{
+	char proto[32] = {};
+	uint32_t opcode = (uint32_t)RUNTIME_API_PIPE_CNTL_MOD_OPCODE(conn->context->transport_mod, MODULE_TLS_CNTL_ALPNPROTO);
+
+	conn->alpn_checked = 1;
+
+	if(ERROR_CODE(int) == _invoke_pipe_cntl(conn->trans_in, opcode, proto, sizeof(proto)))
+		ERROR_RETURN_LOG(int, "Cannot get the ALPN protocol of the connection");
+
+	if(proto[0] != 0 && strcmp(proto, "h2") != 0)
+	{
+		LOG_NOTICE("The client negotiated protocol %s rather than h2, closing the connection", proto);
+		conn->broken = 1;
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * @brief Read all the available data from the transportation layer and process the frames
+ * @param conn The connection
+ * @return 1 if we have read some data, 0 if nothing is available, or error code
+ **/
+static inline int _conn_read(_conn_t* conn)
+{
+	uint8_t buf[4096];
+	int ret = 0;
+
+	for(;!conn->broken;)
+	{
+		size_t rc = itc_module_pipe_read(buf, sizeof(buf), conn->trans_in);
+		if(ERROR_CODE(size_t) == rc)
+		{
+			conn->broken = 1;
+			ERROR_RETURN_LOG(int, "Cannot read from the transportation layer");
+		}
+
+		if(rc == 0)
+		{
+			int eof = itc_module_pipe_eof(conn->trans_in);
+			if(ERROR_CODE(int) == eof)
+			{
+				conn->broken = 1;
+				ERROR_RETURN_LOG(int, "Cannot check if the transportation layer has more data");
+			}
+			if(eof)
+			{
+				LOG_DEBUG("The client has closed the HTTP/2 connection");
+				conn->broken = 1;
+			}
+			break;
+		}
+
+		ret = 1;
+
+#if MODULE_TLS_ENABLED
+		/* The TLS handshake is done once we get the first piece of data */
+		if(!conn->alpn_checked && (ERROR_CODE(int) == _conn_check_alpn(conn) || conn->broken))
+		{
+			conn->broken = 1;
+			break;
+		}
+#endif
+
+		if(ERROR_CODE(int) == _conn_feed(conn, buf, rc))
+		{
+			conn->broken = 1;
+			ERROR_RETURN_LOG(int, "Cannot process the data from the client");
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Translate the HTTP/1.1 response head to the HEADERS frame and send it
+ * @param conn The connection
+ * @param stream The stream
+ * @param size The size of the response head, including the empty line
+ * @return status code
+ **/
+static inline int _send_response_head(_conn_t* conn, _stream_t* stream, size_t size)
+{
+	const char* head = stream->resp_head.data;
+	const char* end = head + size;
+	uint32_t status = 0;
+	int chunked = 0, rc = ERROR_CODE(int);
+	char name[128];
+
+	if(size < 12 || memcmp(head, "HTTP/1.", 7) != 0 || head[8] != ' ')
+		ERROR_RETURN_LOG(int, "Invalid HTTP response status line");
+	if(head[9] < '1' || head[9] > '5' || head[10] < '0' || head[10] > '9' || head[11] < '0' || head[11] > '9')
+		ERROR_RETURN_LOG(int, "Invalid HTTP response status code");
+	status = (uint32_t)(head[9] - '0') * 100 + (uint32_t)(head[10] - '0') * 10 + (uint32_t)(head[11] - '0');
+
+	size_t cap = size * 2 + 64, block_size;
+	uint8_t* block = (uint8_t*)malloc(cap);
+	if(NULL == block) ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate the header block");
+
+	if(ERROR_CODE(size_t) == (block_size = module_http2_hpack_encode_status(block, cap, status)))
+		ERROR_LOG_GOTO(RET, "Cannot encode the status");
+
+	const char* line = (const char*)memchr(head, '\n', size) + 1;
+	while(line < end)
+	{
+		const char* eol = (const char*)memchr(line, '\n', (size_t)(end - line));
+		if(NULL == eol) break;
+		const char* next = eol + 1;
+		if(eol > line && eol[-1] == '\r') eol --;
+		if(eol == line) break;
+
+		const char* colon = (const char*)memchr(line, ':', (size_t)(eol - line));
+		if(NULL == colon || colon == line || (size_t)(colon - line) >= sizeof(name))
+		{
+			LOG_DEBUG("Skipping the invalid response header line");
+			line = next;
+			continue;
+		}
+
+		size_t name_len = (size_t)(colon - line), i;
+		for(i = 0; i < name_len; i ++)
+			name[i] = (line[i] >= 'A' && line[i] <= 'Z') ? (char)(line[i] - 'A' + 'a') : line[i];
+
+		const char* value = colon + 1;
+		const char* value_end = eol;
+		for(; value < value_end && (*value == ' ' || *value == '\t'); value ++);
+		for(; value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'); value_end --);
+		size_t value_len = (size_t)(value_end - value);
+
+		line = next;
+
+		if(_is(name, name_len, "transfer-encoding"))
+		{
+			for(i = 0; i + 7 <= value_len; i ++)
+				if(strncasecmp(value + i, "chunked", 7) == 0)
+					chunked = 1;
+			continue;
+		}
+
+		if(_is(name, name_len, "connection") || _is(name, name_len, "keep-alive") ||
+		   _is(name, name_len, "proxy-connection") || _is(name, name_len, "upgrade"))
+			continue;
+
+		if(_is(name, name_len, "content-length"))
+		{
+			stream->resp_length = 1;
+			stream->resp_remaining = 0;
+			for(i = 0; i < value_len && value[i] >= '0' && value[i] <= '9'; i ++)
+				stream->resp_remaining = stream->resp_remaining * 10 + (uint64_t)(value[i] - '0');
+		}
+
+		size_t bytes = module_http2_hpack_encode_field(block + block_size, cap - block_size, name, name_len, value, value_len);
+		if(ERROR_CODE(size_t) == bytes) ERROR_LOG_GOTO(RET, "Cannot encode the header field");
+		block_size += bytes;
+	}
+
+	if(chunked) stream->resp_length = 0;
+
+	int no_body = stream->head || status == 204 || status == 304 || (stream->resp_length && stream->resp_remaining == 0);
+
+	size_t offset = 0;
+	do {
+		size_t bytes = block_size - offset;
+		if(bytes > _FRAME_SIZE) bytes = _FRAME_SIZE;
+		uint8_t flags = (offset + bytes == block_size) ? _FLAG_END_HEADERS : 0;
+		if(offset == 0 && no_body) flags |= _FLAG_END_STREAM;
+
+		if(ERROR_CODE(int) == _write_frame(conn, offset == 0 ? _FRAME_HEADERS : _FRAME_CONTINUATION, flags, stream->id, block + offset, bytes))
+			ERROR_LOG_GOTO(RET, "Cannot write the header block");
+
+		offset += bytes;
+	} while(offset < block_size);
+
+	if(no_body)
+	{
+		stream->end_sent = 1;
+		stream->resp_state = _RESP_DONE;
+	}
+	else stream->resp_state = chunked ? _RESP_CHUNK_SIZE : _RESP_BODY;
+
+	rc = 0;
+RET:
+	free(block);
+	return rc;
+}
+
+/**
+ * @brief Translate the HTTP/1.1 response bytes written by the servlet to HTTP/2 frames
+ * @param conn The connection, the caller should hold the connection mutex
+ * @param stream The stream
+ * @param data The data
+ * @param size The size of the data
+ * @return status code
+ **/
+static inline int _stream_response(_conn_t* conn, _stream_t* stream, const char* data, size_t size)
+{
+	while(size > 0 && !stream->reset && !conn->broken && stream->resp_state != _RESP_DONE)
+	{
+		size_t bytes = 0;
+		switch(stream->resp_state)
+		{
+			case _RESP_HEAD:
+			{
+				size_t prev = stream->resp_head.size, begin = prev > 3 ? prev - 3 : 0, i;
+				if(ERROR_CODE(int) == _buf_append(&stream->resp_head, data, size))
+					ERROR_RETURN_LOG(int, "Cannot append the response head");
+				bytes = size;
+				for(i = begin; i + 4 <= stream->resp_head.size; i ++)
+					if(memcmp(stream->resp_head.data + i, "\r\n\r\n", 4) == 0)
+						break;
+				if(i + 4 > stream->resp_head.size)
+				{
+					if(stream->resp_head.size > MODULE_HTTP2_MAX_HEADER_LIST_SIZE)
+						ERROR_RETURN_LOG(int, "The response head is too large");
+					break;
+				}
+				bytes = i + 4 - prev;
+				if(ERROR_CODE(int) == _send_response_head(conn, stream, i + 4))
+					ERROR_RETURN_LOG(int, "Cannot send the response head");
+				_buf_free(&stream->resp_head);
+				break;
+			}
+			case _RESP_BODY:
+				bytes = size;
+				if(stream->resp_length && bytes > stream->resp_remaining)
+					bytes = (size_t)stream->resp_remaining;
+				stream->resp_remaining -= bytes;
+				if(ERROR_CODE(int) == _send_data(conn, stream, data, bytes, stream->resp_length && stream->resp_remaining == 0))
+					ERROR_RETURN_LOG(int, "Cannot send the response body");
+				break;
+			case _RESP_CHUNK_SIZE:
+			case _RESP_CHUNK_EXT:
+				bytes = 1;
+				if(data[0] == '\n')
+				{
+					stream->trailer_line = 0;
+					stream->resp_state = stream->resp_remaining > 0 ? _RESP_CHUNK_DATA : _RESP_CHUNK_TRAILER;
+				}
+				else if(stream->resp_state == _RESP_CHUNK_EXT || data[0] == '\r' || data[0] == ' ' || data[0] == '\t')
+					break;
+				else if(data[0] == ';')
+					stream->resp_state = _RESP_CHUNK_EXT;
+				else
+				{
+					int digit;
+					if(data[0] >= '0' && data[0] <= '9') digit = data[0] - '0';
+					else if(data[0] >= 'a' && data[0] <= 'f') digit = data[0] - 'a' + 10;
+					else if(data[0] >= 'A' && data[0] <= 'F') digit = data[0] - 'A' + 10;
+					else ERROR_RETURN_LOG(int, "Invalid chunk size");
+					if(stream->resp_remaining >> 59) ERROR_RETURN_LOG(int, "Chunk size overflow");
+					stream->resp_remaining = stream->resp_remaining * 16 + (uint64_t)digit;
+				}
+				break;
+			case _RESP_CHUNK_DATA:
+				bytes = size;
+				if(bytes > stream->resp_remaining) bytes = (size_t)stream->resp_remaining;
+				if(ERROR_CODE(int) == _send_data(conn, stream, data, bytes, 0))
+					ERROR_RETURN_LOG(int, "Cannot send the response chunk");
+				if(0 == (stream->resp_remaining -= bytes))
+					stream->resp_state = _RESP_CHUNK_DATA_END;
+				break;
+			case _RESP_CHUNK_DATA_END:
+				bytes = 1;
+				if(data[0] == '\n') stream->resp_state = _RESP_CHUNK_SIZE;
+				break;
+			case _RESP_CHUNK_TRAILER:
+				bytes = 1;
+				if(data[0] == '\n')
+				{
+					if(stream->trailer_line == 0 && ERROR_CODE(int) == _send_data(conn, stream, NULL, 0, 1))
+						ERROR_RETURN_LOG(int, "Cannot end the stream");
+					stream->trailer_line = 0;
+				}
+				else if(data[0] != '\r') stream->trailer_line ++;
+				break;
+			case _RESP_DONE:
+				break;
+		}
+		data += bytes;
+		size -= bytes;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Finalize a dispatched stream, and give the connection back to the transportation layer when it's the last one
+ * @param stream The stream
+ * @param error If the pipe is in error state
+ * @return status code
+ **/
+static inline int _stream_finalize(_stream_t* stream, int error)
+{
+	int rc = 0;
+	_conn_t* conn = stream->conn;
+
+	pthread_mutex_lock(&conn->mutex);
+
+	if(!stream->reset && !conn->broken && !stream->end_sent)
+	{
+		if(!error && stream->resp_state == _RESP_BODY && !stream->resp_length)
+			rc = _send_data(conn, stream, NULL, 0, 1);
+		else if(!stream->pending_end)
+		{
+			LOG_DEBUG("The response of stream %u is incomplete, resetting", stream->id);
+			rc = _write_u32_frame(conn, _FRAME_RST_STREAM, stream->id, _ERR_INTERNAL_ERROR);
+		}
+	}
+
+	/* The stream is kept until the client opens the window for the pending data, the event loop will send it */
+	if(ERROR_CODE(int) != rc && !stream->reset && !conn->broken && stream->pending_end)
+	{
+		LOG_DEBUG("Stream %u is blocked by the flow control window, parking", stream->id);
+		stream->parked = 1;
+	}
+	else if(ERROR_CODE(int) == _stream_remove(conn, stream))
+		rc = ERROR_CODE(int);
+
+	if(ERROR_CODE(int) == _conn_flush(conn))
+		rc = ERROR_CODE(int);
+
+	int release = (0 == --conn->active);
+
+	pthread_mutex_unlock(&conn->mutex);
+
+	if(release && ERROR_CODE(int) == _conn_release(conn))
+		rc = ERROR_CODE(int);
+
+	return rc;
+}
+
+/**
+ * @brief Accept a connection from the transportation layer and process all the available frames
+ * @param context The module context
+ * @param args The accept arguments
+ * @param in_flags The flags of the input pipe
+ * @param out_flags The flags of the output pipe
+ * @return status code
+ **/
+static inline int _conn_serve(_module_context_t* context, const void* args, runtime_api_pipe_flags_t in_flags, runtime_api_pipe_flags_t out_flags)
+{
+	itc_module_pipe_param_t trans_param = {
+		.input_flags = in_flags | RUNTIME_API_PIPE_PERSIST,
+		.output_flags = out_flags | RUNTIME_API_PIPE_PERSIST,
+		.args = args
+	};
+
+	if(context->async_write == 1) trans_param.output_flags |= RUNTIME_API_PIPE_ASYNC;
+
+	itc_module_pipe_t *trans_in = NULL, *trans_out = NULL;
+	_conn_t* conn = NULL;
+
+	if(ERROR_CODE(int) == itc_module_pipe_accept(context->transport_mod, trans_param, &trans_in, &trans_out) ||
+	   NULL == trans_in || NULL == trans_out)
+		ERROR_LOG_GOTO(ERR, "Cannot accept connection from the transportation layer");
+
+	if(ERROR_CODE(int) == _invoke_pipe_cntl(trans_in, RUNTIME_API_PIPE_CNTL_OPCODE_POP_STATE, &conn))
+		ERROR_LOG_GOTO(ERR, "Cannot pop the previous state from the pipe");
+
+	if(NULL == conn && NULL == (conn = _conn_new(context)))
+		ERROR_LOG_GOTO(ERR, "Cannot create the HTTP/2 connection");
+
+	pthread_mutex_lock(&conn->mutex);
+
+	conn->trans_in = trans_in;
+	conn->trans_out = trans_out;
+	conn->accepting = 1;
+
+	if(!conn->settings_sent && ERROR_CODE(int) == _conn_send_settings(conn))
+		LOG_ERROR("Cannot send the server connection preface");
+	else if(ERROR_CODE(int) == _conn_read(conn))
+		LOG_ERROR("Cannot process the data from the HTTP/2 connection");
+
+	if(ERROR_CODE(int) == _conn_flush(conn))
+		LOG_ERROR("Cannot flush the frames");
+
+	conn->accepting = 0;
+	int release = (conn->active == 0);
+
+	pthread_mutex_unlock(&conn->mutex);
+
+	/* Otherwise, the last finalized stream gives the connection back */
+	if(release) return _conn_release(conn);
+
+	return 0;
+ERR:
+	if(NULL != trans_in) itc_module_pipe_deallocate(trans_in);
+	if(NULL != trans_out) itc_module_pipe_deallocate(trans_out);
+	return ERROR_CODE(int);
+}
+
+/**
+ * @brief the initialization function of the HTTP/2 module
+ * @details the initialization argument should look like <br/>
+ *          <code>insmod "http2_pipe pipe.tcp.port_80";</code>
+ * @param ctx the context buffer
+ * @param argc the argument count
+ * @param argv the argument value
+ * @return the status code
+ **/
+static int _init(void* __restrict ctx, uint32_t argc, char const* __restrict const* __restrict argv)
+{
+	if(NULL == ctx) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(argc != 1) ERROR_RETURN_LOG(int, "Invalid module init args, should be http2_pipe <trans-module-path>");
+
+	if(ERROR_CODE(itc_module_type_t) == (context->transport_mod = itc_modtab_get_module_type_from_path(argv[0])))
+		ERROR_RETURN_LOG(int, "Cannot get the transportation layer module instance %s", argv[0]);
+
+	itc_module_flags_t mf = itc_module_get_flags(context->transport_mod);
+	if(ERROR_CODE(itc_module_flags_t) == mf) ERROR_RETURN_LOG(int, "Cannot get the module flags of the module instance %s", argv[0]);
+	if(0 != (mf & ITC_MODULE_FLAGS_EVENT_LOOP)) ERROR_RETURN_LOG(int, "Cannot use an event-accepting module as transprotation module");
+
+#if MODULE_TLS_ENABLED
+	const itc_modtab_instance_t* inst = itc_modtab_get_from_module_type(context->transport_mod);
+	if(NULL == inst) ERROR_RETURN_LOG(int, "Cannot get the transportation layer module instance %s", argv[0]);
+
+	/* The clients only speak HTTP/2 over TLS when the server selects h2 with ALPN */
+	if(strcmp(inst->module->mod_prefix, MODULE_TLS_API_MODULE_PREFIX) == 0)
+	{
+		char symbol[1024];
+		lang_prop_value_t value = {
+			.type = LANG_PROP_TYPE_STRING,
+			.str  = (char*)"h2"
+		};
+		snprintf(symbol, sizeof(symbol), "%s.alpn_protos", inst->path);
+		if(1 != lang_prop_set(symbol, value))
+			ERROR_RETURN_LOG(int, "Cannot enable the ALPN extension of the TLS module %s", argv[0]);
+	}
+#endif
+
+	context->async_write = 1;
+	context->max_concurrent_streams = MODULE_HTTP2_MAX_CONCURRENT_STREAMS;
+	context->max_body_size = MODULE_HTTP2_MAX_BODY_SIZE;
+	context->queue = NULL;
+
+	return 0;
+}
+
+/**
+ * @brief cleanup the module
+ * @param ctx the module context
+ * @return status code
+ **/
+static int _cleanup(void* __restrict ctx)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(NULL != context->queue)
+		LOG_WARNING("There are HTTP/2 streams never dispatched");
+
+	return 0;
+}
+
+/**
+ * @brief accept the next HTTP/2 stream
+ * @param ctx the module context
+ * @param args the accept arguments
+ * @param inbuf the input buffer
+ * @param outbuf the output buffer
+ * @return status code
+ **/
+static int _accept(void* __restrict ctx, const void* __restrict args, void* __restrict inbuf, void* __restrict outbuf)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+	runtime_api_pipe_flags_t in_flags  = itc_module_get_handle_flags(inbuf);
+	runtime_api_pipe_flags_t out_flags = itc_module_get_handle_flags(outbuf);
+
+	while(NULL == context->queue)
+		if(ERROR_CODE(int) == _conn_serve(context, args, in_flags, out_flags))
+			ERROR_RETURN_LOG(int, "Cannot serve the HTTP/2 connection");
+
+	_stream_t* stream = context->queue;
+	context->queue = stream->queue_next;
+	stream->queue_next = NULL;
+
+	_handle_t* in = (_handle_t*)inbuf;
+	_handle_t* out = (_handle_t*)outbuf;
+
+	in->type = _HANDLE_TYPE_IN;
+	in->stream = stream;
+	out->type = _HANDLE_TYPE_OUT;
+	out->stream = stream;
+
+	return 0;
+}
+
+/**
+ * @brief deallocate a pipe handle
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @param error if this pipe encoutered an unrecoverable error
+ * @param purge if this is the last handle of the stream
+ * @return status code
+ **/
+static int _dealloc(void* __restrict ctx, void* __restrict pipe, int error, int purge)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)pipe;
+
+	if(!purge) return 0;
+
+	return _stream_finalize(handle->stream, error);
+}
+
+/**
+ * @brief read the synthesized HTTP/1.1 request
+ * @param ctx the module context
+ * @param buffer the data buffer
+ * @param bytes_to_read the number of bytes to read to buffer
+ * @param in the pipe handle
+ * @return the size has been actually read to the buffer, or error code
+ **/
+static size_t _read(void* __restrict ctx, void* __restrict buffer, size_t bytes_to_read, void* __restrict in)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)in;
+	if(handle->type != _HANDLE_TYPE_IN) ERROR_RETURN_LOG(size_t, "Wrong pipe type: Cannot read from a output HTTP/2 pipe");
+
+	_stream_t* stream = handle->stream;
+	size_t bytes = stream->request.size - stream->read_offset;
+	if(bytes > bytes_to_read) bytes = bytes_to_read;
+
+	if(bytes > 0) memcpy(buffer, stream->request.data + stream->read_offset, bytes);
+	stream->last_read = stream->read_offset;
+	stream->read_offset += bytes;
+
+	return bytes;
+}
+
+/**
+ * @brief write the HTTP/1.1 response, which will be translated to the frames of the stream
+ * @param ctx the module context
+ * @param data the data to write
+ * @param nbytes the number of bytes to write
+ * @param out the pipe handle
+ * @return the number of bytes has been written, or error code
+ **/
+static size_t _write(void* __restrict ctx, const void* __restrict data, size_t nbytes, void* __restrict out)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)out;
+	if(handle->type != _HANDLE_TYPE_OUT) ERROR_RETURN_LOG(size_t, "Wrong pipe type: Cannot write to a input HTTP/2 pipe");
+
+	_stream_t* stream = handle->stream;
+	_conn_t* conn = stream->conn;
+
+	pthread_mutex_lock(&conn->mutex);
+	int rc = _stream_response(conn, stream, (const char*)data, nbytes);
+	pthread_mutex_unlock(&conn->mutex);
+
+	if(ERROR_CODE(int) == rc) ERROR_RETURN_LOG(size_t, "Cannot write the response of stream %u", stream->id);
+
+	return nbytes;
+}
+
+/**
+ * @brief write the data source to the stream
+ * @param ctx the module context
+ * @param source the data source
+ * @param out the pipe handle
+ * @return status code
+ **/
+static int _write_callback(void* __restrict ctx, itc_module_data_source_t source, void* __restrict out)
+{
+	char buf[_FRAME_SIZE];
+
+	for(;;)
+	{
+		int eos_rc = source.eos(source.data_handle);
+		if(ERROR_CODE(int) == eos_rc)
+			ERROR_RETURN_LOG(int, "Cannot check if the data source has reached the end of stream");
+		if(eos_rc) break;
+
+		size_t bytes = source.read(source.data_handle, buf, sizeof(buf), NULL);
+		if(ERROR_CODE(size_t) == bytes)
+			ERROR_RETURN_LOG(int, "Cannot read the data source");
+
+		if(bytes > 0 && ERROR_CODE(size_t) == _write(ctx, buf, bytes, out))
+			ERROR_RETURN_LOG(int, "Cannot write the data source to the stream");
+	}
+
+	/* Once we returns successfully, the data source is owned by the module */
+	if(ERROR_CODE(int) == source.close(source.data_handle))
+	{
+		LOG_ERROR("Cannot close the data source");
+		return ERROR_CODE_OT(int);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief check if the request has unread data
+ * @param ctx the module context
+ * @param pipe the pipe to check
+ * @return the checking result or status code
+ **/
+static int _has_unread(void* __restrict ctx, void* __restrict pipe)
+{
+	(void)ctx;
+	_handle_t* handle = (_handle_t*)pipe;
+	if(handle->type != _HANDLE_TYPE_IN) ERROR_RETURN_LOG(int, "Wrong pipe type: _HANDLE_TYPE_IN expected");
+
+	return handle->stream->read_offset < handle->stream->request.size;
+}
+
+/**
+ * @brief the end of message call
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @param buffer the buffer that has the data recently read
+ * @param offset the offset of the EOM token
+ * @return status code
+ **/
+static int _eom(void* __restrict ctx, void* __restrict pipe, const char* buffer, size_t offset)
+{
+	(void)ctx;
+	(void)buffer;
+	_handle_t* handle = (_handle_t*)pipe;
+	if(handle->type != _HANDLE_TYPE_IN) ERROR_RETURN_LOG(int, "Wrong pipe type: _HANDLE_TYPE_IN expected");
+
+	_stream_t* stream = handle->stream;
+	if(stream->last_read + offset > stream->read_offset) ERROR_RETURN_LOG(int, "Invalid offset");
+
+	stream->read_offset = stream->last_read + offset;
+
+	return 0;
+}
+
+/**
+ * @brief push a user-space state to the pipe handle
+ * @note Each stream is a standalone request, so the state is disposed with the stream
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @param state the state to push
+ * @param func the dispose function
+ * @return status code
+ **/
+static int _push_state(void* __restrict ctx, void* __restrict pipe, void* __restrict state, itc_module_state_dispose_func_t func)
+{
+	(void)ctx;
+	_stream_t* stream = ((_handle_t*)pipe)->stream;
+
+	if(NULL != stream->user_state && stream->user_state != state && NULL != stream->user_state_dispose &&
+	   ERROR_CODE(int) == stream->user_state_dispose(stream->user_state))
+		ERROR_RETURN_LOG(int, "Cannot dispose the previous user-space state");
+
+	stream->user_state = state;
+	stream->user_state_dispose = func;
+
+	return 0;
+}
+
+/**
+ * @brief pop the previous pushed state from the pipe handle
+ * @param ctx the module context
+ * @param pipe the pipe handle
+ * @return the previously pushed state
+ **/
+static void* _pop_state(void* __restrict ctx, void* __restrict pipe)
+{
+	(void)ctx;
+	return ((_handle_t*)pipe)->stream->user_state;
+}
+
+/**
+ * @brief the callback function used to cleanup when the thread gets killed
+ * @param ctx the module context
+ * @return nothing
+ **/
+static void _event_thread_killed(void* __restrict ctx)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	itc_module_loop_killed(context->transport_mod);
+}
+
+/**
+ * @brief get the path of the module instance
+ * @param ctx the module context
+ * @param buf the buffer used to return the path
+ * @param sz the size of the buffer
+ * @return the result path or NULL on error
+ **/
+static const char* _get_path(void* __restrict ctx, char* buf, size_t sz)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(NULL == itc_module_get_path(context->transport_mod, buf, sz))
+		ERROR_PTR_RETURN_LOG("Cannot get the path to transportation layer module");
+
+	return buf;
+}
+
+/**
+ * @brief get the flags of the module instance
+ * @param ctx the moudle context
+ * @return the flags
+ **/
+static itc_module_flags_t _get_flags(void* __restrict ctx)
+{
+	(void)ctx;
+	return ITC_MODULE_FLAGS_EVENT_LOOP;
+}
+
+/**
+ * @brief the callback function to get the property
+ * @param ctx the mdoule context
+ * @param sym the symbol name
+ * @return the property value
+ **/
+static itc_module_property_value_t _get_prop(void* __restrict ctx, const char* sym)
+{
+	itc_module_property_value_t ret = {
+		.type = ITC_MODULE_PROPERTY_TYPE_NONE
+	};
+	_module_context_t* context = (_module_context_t*)ctx;
+	if(strcmp(sym, "async_write") == 0)
+	{
+		ret.type = ITC_MODULE_PROPERTY_TYPE_INT;
+		ret.num = context->async_write;
+	}
+	else if(strcmp(sym, "max_concurrent_streams") == 0)
+	{
+		ret.type = ITC_MODULE_PROPERTY_TYPE_INT;
+		ret.num = context->max_concurrent_streams;
+	}
+	else if(strcmp(sym, "max_body_size") == 0)
+	{
+		ret.type = ITC_MODULE_PROPERTY_TYPE_INT;
+		ret.num = context->max_body_size;
+	}
+	return ret;
+}
+
+/**
+ * @brief the callback function to set the property
+ * @param ctx the module context
+ * @param sym the symbol name
+ * @param value the value to set
+ * @return the status code
+ **/
+static int _set_prop(void* __restrict ctx, const char* sym, itc_module_property_value_t value)
+{
+	_module_context_t* context = (_module_context_t*)ctx;
+
+	if(value.type != ITC_MODULE_PROPERTY_TYPE_INT) return 0;
+
+	if(strcmp(sym, "async_write") == 0)
+		context->async_write = (value.num != 0);
+	else if(strcmp(sym, "max_concurrent_streams") == 0)
+	{
+		if(value.num <= 0 || value.num > 0x7fffffff) ERROR_RETURN_LOG(int, "Invalid max_concurrent_streams");
+		context->max_concurrent_streams = (uint32_t)value.num;
+	}
+	else if(strcmp(sym, "max_body_size") == 0)
+	{
+		if(value.num < 0 || value.num > 0x7fffffff) ERROR_RETURN_LOG(int, "Invalid max_body_size");
+		context->max_body_size = (uint32_t)value.num;
+	}
+	else return 0;
+
+	return 1;
+}
+
+/**
+ * @brief the module definition
+ **/
+itc_module_t module_http2_module_def = {
+	.mod_prefix = "pipe.http2",
+	.handle_size = sizeof(_handle_t),
+	.context_size = sizeof(_module_context_t),
+	.module_init = _init,
+	.module_cleanup = _cleanup,
+	.accept = _accept,
+	.deallocate = _dealloc,
+	.read = _read,
+	.write = _write,
+	.write_callback = _write_callback,
+	.eom = _eom,
+	.has_unread_data = _has_unread,
+	.push_state = _push_state,
+	.pop_state = _pop_state,
+	.event_thread_killed = _event_thread_killed,
+	.get_path = _get_path,
+	.get_flags = _get_flags,
+	.get_property = _get_prop,
+	.set_property = _set_prop
+};
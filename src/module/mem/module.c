@@ -34,6 +34,8 @@ typedef enum {
 typedef struct _buffer_page_t {
 	struct _buffer_page_t* next;  /*!< the next page in the mem buffer */
 	uint32_t size;                /*!< the actual data size in this page */
+	uint32_t donated:1;           /*!< if this page holds the memory donated by the writer, the data section is the page description then */
+	const char* begin;            /*!< the beginning of the data, which is the data section unless the page is donated */
 	uintpad_t __padding__[0];
 	char   data[0];               /*!< the data section */
 } _buffer_page_t;
@@ -66,6 +68,8 @@ static _buffer_page_t* __buffer_page_new(void)
 	if(NULL == ret) ERROR_PTR_RETURN_LOG("Cannot allocate memory for the new page");
 	ret->next = NULL;
 	ret->size = 0;
+	ret->donated = 0;
+	ret->begin = ret->data;
 	return ret;
 }
 static inline int __buffer_free(_buffer_page_t* page)
@@ -75,12 +79,97 @@ static inline int __buffer_free(_buffer_page_t* page)
 	{
 		_buffer_page_t* tmp = page;
 		page = page->next;
-		if(ERROR_CODE(int) == mempool_page_dealloc(tmp))
+		if(tmp->donated)
+		{
+			const itc_module_data_source_page_t* donated = (const itc_module_data_source_page_t*)tmp->data;
+			if(NULL != donated->free_func && ERROR_CODE(int) == donated->free_func(donated->base))
+				rc = ERROR_CODE(int);
+			free(tmp);
+		}
+		else if(ERROR_CODE(int) == mempool_page_dealloc(tmp))
 			rc = ERROR_CODE(int);
 	}
 	return rc;
 }
 
+/**
+ * @brief append a new page to the buffer once the current page of the output handle is full
+ * @param handle the output handle
+ * @return status code
+ **/
+static inline int __buffer_page_append(module_handle_t* handle)
+{
+	if(NULL != handle->current_page->next)
+		ERROR_RETURN_LOG(int, "Unexpected current page in a write pipe, code bug!");
+
+	if(NULL == (handle->current_page->next = __buffer_page_new()))
+		ERROR_RETURN_LOG(int, "Cannot create new page for the mempipe");
+
+	handle->page_offset = 0;
+	handle->current_page = handle->current_page->next;
+
+	return 0;
+}
+
+/**
+ * @brief link the memory donated by the writer to the buffer, so that the reader gets the data without any copy
+ * @note the buffer owns the memory after this function is called, even if it returns an error
+ * @param handle the output handle
+ * @param donated the donated memory
+ * @return status code
+ **/
+static inline int __buffer_page_donate(module_handle_t* handle, const itc_module_data_source_page_t* donated)
+{
+	size_t room = _pagedata_limit - handle->page_offset;
+
+	/* For the small piece of data, packing it into current page is cheaper than linking another page */
+	if(donated->size <= room / 2 || donated->size > UINT32_MAX)
+	{
+		int rc = 0;
+		const char* data = donated->data;
+		size_t size;
+		for(size = donated->size; size > 0;)
+		{
+			size_t bytes = size < room ? size : room;
+			memcpy(handle->current_page->data + handle->page_offset, data, bytes);
+			handle->page_offset += (uint32_t)bytes;
+			handle->current_page->size += (uint32_t)bytes;
+			data += bytes;
+			size -= bytes;
+			if(handle->current_page->size == _pagedata_limit && ERROR_CODE(int) == (rc = __buffer_page_append(handle)))
+				break;
+			room = _pagedata_limit - handle->page_offset;
+		}
+
+		if(NULL != donated->free_func && ERROR_CODE(int) == donated->free_func(donated->base))
+			ERROR_RETURN_LOG(int, "Cannot release the donated memory");
+
+		return rc;
+	}
+
+	if(NULL != handle->current_page->next)
+		ERROR_RETURN_LOG(int, "Unexpected current page in a write pipe, code bug!");
+
+	_buffer_page_t* page = (_buffer_page_t*)malloc(sizeof(_buffer_page_t) + sizeof(itc_module_data_source_page_t));
+	if(NULL == page)
+	{
+		if(NULL != donated->free_func) donated->free_func(donated->base);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the donated page");
+	}
+
+	page->next = NULL;
+	page->size = (uint32_t)donated->size;
+	page->donated = 1;
+	page->begin = donated->data;
+	memcpy(page->data, donated, sizeof(itc_module_data_source_page_t));
+
+	handle->current_page->next = page;
+	handle->current_page = page;
+
+	/* The writer never writes to the donated memory, so the following data goes to a new page */
+	return __buffer_page_append(handle);
+}
+
 static int _module_init(void* __restrict ctx, uint32_t argc, char const* __restrict const* __restrict argv)
 {
 	(void) ctx;
@@ -149,35 +238,32 @@ static int _get_internal_buf(void* __restrict ctx, void const** __restrict resul
 	if(handle->type != _INPUT)
 		ERROR_RETURN_LOG(int, "Invalid type of pipe, a output pipe cannot be read");
 
-
-	if(handle->current_page != NULL)
+	/* Skip the pages that have been consumed, the page is lent to the caller, so there's no copy at all */
+	for(;handle->current_page != NULL && handle->current_page->size <= handle->page_offset && handle->current_page->next != NULL;)
 	{
-		actual_size = handle->current_page->size - handle->page_offset;
-
-		if(actual_size == 0 && handle->current_page->next != NULL)
-		{
-			handle->page_offset = 0;
-			handle->current_page = handle->current_page->next;
-			actual_size = handle->current_page->size;
-		}
-
-		if(actual_size < *min_size) goto RET_EMPTY;
-
-		if(actual_size < *max_size) *max_size = actual_size;
+		handle->page_offset = 0;
+		handle->current_page = handle->current_page->next;
 	}
-	else
+
+	if(handle->current_page == NULL ||
+	   (actual_size = handle->current_page->size - handle->page_offset) == 0 ||
+	   actual_size < *min_size)
 	{
-RET_EMPTY:
 		LOG_DEBUG("The size limit cannot satisfied, returning empty");
 		*max_size = *min_size = 0;
-		result = NULL;
+		*result = NULL;
 		return 0;
 	}
 
-	*result = handle->current_page->data + handle->page_offset;
+	if(actual_size < *max_size) *max_size = actual_size;
+
+	*result = handle->current_page->begin + handle->page_offset;
 
 	*min_size = *max_size;
 
+	/* The region size is determined, so we can move the read pointer on right now */
+	handle->page_offset += (uint32_t)*max_size;
+
 	return 1;
 }
 
@@ -207,7 +293,7 @@ static size_t _read(void* __restrict ctx, void* __restrict buffer, size_t nbytes
 
 		if(size > nbytes) size = (uint32_t)nbytes;
 
-		memcpy(b, handle->current_page->data + handle->page_offset, size);
+		memcpy(b, handle->current_page->begin + handle->page_offset, size);
 
 		b += size;
 		nbytes -= size;
@@ -242,18 +328,66 @@ static size_t _write(void* __restrict ctx, const void* __restrict buffer, size_t
 		b += size;
 		nbytes -= size;
 		ret += size;
-		if(handle->current_page->size == _pagedata_limit)
+		if(handle->current_page->size == _pagedata_limit && ERROR_CODE(int) == __buffer_page_append(handle))
+			ERROR_RETURN_LOG(size_t, "Cannot append new page to the mempipe");
+	}
+
+	return ret;
+}
+
+static int _write_callback(void* __restrict ctx, itc_module_data_source_t source, void* __restrict pipe)
+{
+	(void) ctx;
+
+	module_handle_t* handle = (module_handle_t*)pipe;
+
+	if(handle->type != _OUTPUT)
+		ERROR_RETURN_LOG(int, "Invalid type of pipe, a write function cannot take a input pipe");
+
+	/* Instead of reading the data source to a temporary buffer and writing it, we take the memory of the data source
+	 * if it can be donated, otherwise we let the data source fill the pages */
+	for(;;)
+	{
+		int eos_rc = source.eos(source.data_handle);
+		if(ERROR_CODE(int) == eos_rc)
+			ERROR_RETURN_LOG(int, "Cannot check if the data source has reached the end of stream");
+		if(eos_rc) break;
+
+		if(NULL != source.donate)
 		{
-			if(NULL != handle->current_page->next)
-				ERROR_RETURN_LOG(size_t, "Unexpected current page in a write pipe, code bug!");
-			if(NULL == (handle->current_page->next = __buffer_page_new()))
-				ERROR_RETURN_LOG(size_t, "Cannot create new page for the mempipe");
-			handle->page_offset = 0;
-			handle->current_page = handle->current_page->next;
+			itc_module_data_source_page_t donated;
+			int donate_rc = source.donate(source.data_handle, &donated);
+			if(ERROR_CODE(int) == donate_rc)
+				ERROR_RETURN_LOG(int, "Cannot take the memory of the data source");
+
+			if(donate_rc > 0)
+			{
+				if(ERROR_CODE(int) == __buffer_page_donate(handle, &donated))
+					ERROR_RETURN_LOG(int, "Cannot link the donated memory to the mempipe");
+				continue;
+			}
 		}
+
+		size_t bytes_read = source.read(source.data_handle, handle->current_page->data + handle->page_offset,
+		                                _pagedata_limit - handle->page_offset, NULL);
+		if(ERROR_CODE(size_t) == bytes_read || bytes_read > _pagedata_limit - handle->page_offset)
+			ERROR_RETURN_LOG(int, "Cannot read the data source");
+
+		handle->page_offset += (uint32_t)bytes_read;
+		handle->current_page->size += (uint32_t)bytes_read;
+
+		if(handle->current_page->size == _pagedata_limit && ERROR_CODE(int) == __buffer_page_append(handle))
+			ERROR_RETURN_LOG(int, "Cannot append new page to the mempipe");
 	}
 
-	return ret;
+	/* Once we returns successfully, the data source is owned by the module */
+	if(ERROR_CODE(int) == source.close(source.data_handle))
+	{
+		LOG_ERROR("Cannot close the data source");
+		return ERROR_CODE_OT(int);
+	}
+
+	return 0;
 }
 
 static int _fork(void* __restrict ctx, void* __restrict dest, void* __restrict src, const void* __restrict args)
@@ -307,6 +441,7 @@ itc_module_t module_mem_module_def = {
 	.deallocate = _deallocate,
 	.read = _read,
 	.write = _write,
+	.write_callback = _write_callback,
 	.fork = _fork,
 	.has_unread_data = _has_unread_data,
 	.get_path = _get_path,
@@ -10,10 +10,14 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
 
 #include <utils/log.h>
 #include <utils/mempool/objpool.h>
 #include <utils/mempool/page.h>
+#include <utils/mempool/slab.h>
+#include <utils/mempool/acct.h>
 #include <utils/thread.h>
 #include <utils/static_assertion.h>
 
@@ -30,22 +34,12 @@
 #include <sched/service.h>
 #include <sched/loop.h>
 #include <sched/rscope.h>
+#include <sched/trace.h>
 #include <sched/task.h>
 #include <sched/step.h>
 
 #include <module/pssm/module.h>
 
-/**
- * @brief the actual data strcuture for an allocated memory chucnk
- **/
-typedef struct {
-	uint32_t size;            /*!< the size of the memory chunck, this is important, because this indicates which memory pool object should we use */
-	uintpad_t __padding__[0];
-	char     mem[0];          /*!< the actual start point of the memory chunck */
-} _memory_chunck_t;
-STATIC_ASSERTION_LAST(_memory_chunck_t, mem);
-STATIC_ASSERTION_SIZE(_memory_chunck_t, mem, 0);
-
 /**
  * @brief the data struct for a thread local data.
  * @details the reason for why we have this is, some of the servlets actually use the
@@ -86,19 +80,14 @@ typedef struct {
 static int _initialized = 0;
 
 /**
- * @brief the memory pools that allocate the memory chuncks in different sizes
+ * @brief the slab allocator that allocates the memory chuncks in different sizes
  **/
-static mempool_objpool_t** _pools;
+static mempool_slab_t* _slab;
 
 /**
- * @brief the limit of the maximum size the pool can allocate
+ * @brief the accounting entry of the slab allocator
  **/
-static uint32_t _size_limit = 4096;
-
-/**
- * @brief the mutex use to seralize the mempool creation operation
- **/
-static pthread_mutex_t _mempool_mutex;
+static mempool_acct_t* _slab_acct;
 
 /**
  * @brief the actuall callback function that should be called when
@@ -145,6 +134,39 @@ typedef struct _libconf_value_t {
  **/
 static _libconf_value_t* _libconf_map = NULL;
 
+/**
+ * @brief the accounting query function of the slab allocator
+ * @note the chunks allocated from the system allocator are not counted, because we don't know their sizes
+ * @param data not used
+ * @param buf the result buffer
+ * @return status code
+ **/
+static int _pool_acct_query(const void* data, mempool_acct_stat_t* buf)
+{
+	(void)data;
+	uint32_t n = mempool_slab_num_classes(_slab);
+	if(ERROR_CODE(uint32_t) == n)
+		ERROR_RETURN_LOG(int, "Cannot get the number of size classes");
+
+	uint64_t held = 0;
+	uint32_t i;
+	for(i = 0; i < n; i ++)
+	{
+		mempool_slab_class_stat_t stat;
+		if(ERROR_CODE(int) == mempool_slab_class_stat(_slab, i, &stat))
+			ERROR_RETURN_LOG(int, "Cannot get the statistics of size class %u", i);
+
+		buf->allocs += stat.total;
+		buf->frees  += stat.total - stat.in_use;
+		buf->in_use += stat.in_use * stat.size;
+		held += (uint64_t)stat.pages * (uint64_t)getpagesize();
+	}
+
+	buf->cached = held > buf->in_use ? held - buf->in_use : 0;
+
+	return 0;
+}
+
 static int _init(void* __restrict context, uint32_t argc, char const* __restrict const* __restrict argv)
 {
 	if(_initialized) ERROR_RETURN_LOG(int, "cannot initialize the singleton module twice");
@@ -153,15 +175,11 @@ static int _init(void* __restrict context, uint32_t argc, char const* __restrict
 	(void)argv;
 
 	/* Intialize the memory pool */
-	if((errno = pthread_mutex_init(&_mempool_mutex, NULL)) != 0)
-		ERROR_RETURN_LOG_ERRNO(int, "Cannot initialize the mempool module mutex");
+	if(NULL == (_slab = mempool_slab_new()))
+		ERROR_RETURN_LOG(int, "Cannot create the slab allocator");
 
-	_pools = (mempool_objpool_t**)calloc(_size_limit, sizeof(mempool_objpool_t**));
-	if(NULL == _pools)
-	{
-		pthread_mutex_destroy(&_mempool_mutex);
-		ERROR_RETURN_LOG(int, "Cannot allocate memory for the object pool array");
-	}
+	if(NULL == (_slab_acct = mempool_acct_register("pssm.pool", _pool_acct_query, NULL)))
+		ERROR_RETURN_LOG(int, "Cannot register the accounting entry for the slab allocator");
 
 	/* Initialize the on exit list */
 	if((errno = pthread_mutex_init(&_on_exit_mutex, NULL)) != 0)
@@ -196,14 +214,11 @@ static int _cleanup(void* __restrict context)
 
 	int rc = 0;
 
-	uint32_t i;
-	for(i = 0; i < _size_limit; i ++)
-		if(_pools[i] != NULL && mempool_objpool_free(_pools[i]) == ERROR_CODE(int))
-			rc = ERROR_CODE(int);
-
-	free(_pools);
+	if(NULL != _slab_acct && ERROR_CODE(int) == mempool_acct_unregister(_slab_acct))
+		rc = ERROR_CODE(int);
+	_slab_acct = NULL;
 
-	if((errno = pthread_mutex_destroy(&_mempool_mutex)) != 0)
+	if(NULL != _slab && ERROR_CODE(int) == mempool_slab_free(_slab))
 		rc = ERROR_CODE(int);
 
 	if((errno = pthread_mutex_destroy(&_on_exit_mutex)) != 0)
@@ -225,35 +240,6 @@ static int _cleanup(void* __restrict context)
 	return rc;
 }
 
-/**
- * @brief get the memory pool object for the given size
- * @param size the size of the memory chunck
- * @return the memory pool that is used for memory chuncks in this size
- **/
-static inline mempool_objpool_t* _get_pool(uint32_t size)
-{
-	if(size == 0) return NULL;
-	if(size > _size_limit) ERROR_PTR_RETURN_LOG("The memory chunck size limit exceeded");
-
-	uint32_t idx = size - 1;   /* Because actually we do not allow the 0 sized allocation, so the offset should be size - 1 */
-
-	if(_pools[idx] != NULL) return _pools[idx];
-
-	if((errno = pthread_mutex_lock(&_mempool_mutex)) != 0)
-		ERROR_PTR_RETURN_LOG_ERRNO("Cannot acquire the mempool module global mutex");
-
-	if(_pools[idx] == NULL && NULL == (_pools[idx] = mempool_objpool_new(size + (uint32_t)sizeof(_memory_chunck_t))))
-	{
-		if((errno = pthread_mutex_unlock(&_mempool_mutex)) != 0)
-			LOG_WARNING("Cannot release the mempool module global mutex");
-		ERROR_PTR_RETURN_LOG("Cannot allocate new memory pool for the size %u", size);
-	}
-	if((errno = pthread_mutex_unlock(&_mempool_mutex)) != 0)
-		LOG_WARNING("Cannot release the mempool module global mutex");
-
-	return _pools[idx];
-}
-
 static const char* _get_path(void* __restrict ctx, char* buf, size_t sz)
 {
 	(void)ctx;
@@ -272,15 +258,9 @@ static inline int _pool_alloc(uint32_t size, void** retbuf)
 {
 	if(NULL == retbuf) ERROR_RETURN_LOG(int, "Invalid arguments");
 
-	mempool_objpool_t* pool = _get_pool(size);
-	if(NULL == pool) ERROR_RETURN_LOG(int, "Cannot get the memory pool");
-
-	_memory_chunck_t* chunck;
-	if(NULL == (chunck = (_memory_chunck_t*)mempool_objpool_alloc(pool)))
+	if(NULL == ((*retbuf) = mempool_slab_alloc(_slab, size)))
 		ERROR_RETURN_LOG(int, "Cannot allocate memory from the memory pool");
 
-	chunck->size = size;
-	(*retbuf) = (void*)chunck->mem;
 	return 0;
 }
 
@@ -288,12 +268,106 @@ static inline int _pool_dealloc(void* mem)
 {
 	if(NULL == mem) ERROR_RETURN_LOG(int, "Invalid arguments");
 
-	_memory_chunck_t* chunck = (_memory_chunck_t*)&((char*)mem)[-sizeof(_memory_chunck_t)];
+	return mempool_slab_dealloc(_slab, mem);
+}
+
+/**
+ * @brief the allocate function we give the servlet for the direct call
+ * @param size the size of the chunck
+ * @return the allocated memory
+ **/
+static void* _pool_direct_alloc(uint32_t size)
+{
+	return mempool_slab_alloc(_slab, size);
+}
+
+/**
+ * @brief the deallocate function we give the servlet for the direct call
+ * @param mem the memory to deallocate
+ * @return status code
+ **/
+static int _pool_direct_dealloc(void* mem)
+{
+	return mempool_slab_dealloc(_slab, mem);
+}
+
+/**
+ * @brief get the function pointers of the memory pool, so that the servlet can call the allocator directly
+ *        rather than going through the pipe_cntl for each allocation
+ * @param alloc_buf the buffer used to return the allocate function
+ * @param dealloc_buf the buffer used to return the deallocate function
+ * @return status code
+ **/
+static inline int _pool_allocator(void* (**alloc_buf)(uint32_t), int (**dealloc_buf)(void*))
+{
+	if(NULL == alloc_buf || NULL == dealloc_buf)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
 
-	mempool_objpool_t* pool = _get_pool(chunck->size);
-	if(NULL == pool) ERROR_RETURN_LOG(int, "Cannot get the memory pool");
+	*alloc_buf = _pool_direct_alloc;
+	*dealloc_buf = _pool_direct_dealloc;
 
-	return mempool_objpool_dealloc(pool, chunck);
+	return 0;
+}
+
+/**
+ * @brief update the memory accounting counter with the given name
+ * @details This is used by the user-space library which manages its own memory, so that the memory is visible
+ *          in the memory accounting report
+ * @param name the name of the counter
+ * @param nbytes the number of bytes allocated, negative for deallocation
+ * @return status code
+ **/
+static inline int _acct_update(const char* name, int64_t nbytes)
+{
+	if(NULL == name) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	mempool_acct_t* acct = mempool_acct_counter(name);
+	if(NULL == acct)
+		ERROR_RETURN_LOG(int, "Cannot get the accounting counter %s", name);
+
+	return mempool_acct_update(acct, nbytes);
+}
+
+/**
+ * @brief dump the occupancy statistics of the memory pool size classes
+ * @return the newly allocated string which contains one line for each size class in format
+ *         &lt;chunk-size&gt; &lt;object-size&gt; &lt;pages&gt; &lt;in-use&gt; &lt;total&gt;, the chunk size is 0 for the
+ *         chunks which is too large for the pool. NULL on error
+ **/
+static inline char* _pool_stat(void)
+{
+	uint32_t n = mempool_slab_num_classes(_slab);
+	if(ERROR_CODE(uint32_t) == n)
+		ERROR_PTR_RETURN_LOG("Cannot get the number of size classes");
+
+	/* 5 numbers, each of them has 20 digits at most */
+	size_t cap = (size_t)n * 5 * 21 + 1, len = 0;
+	char* ret = (char*)malloc(cap);
+	if(NULL == ret)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the memory pool statistics");
+
+	ret[0] = 0;
+
+	uint32_t i;
+	for(i = 0; i < n; i ++)
+	{
+		mempool_slab_class_stat_t stat;
+		if(ERROR_CODE(int) == mempool_slab_class_stat(_slab, i, &stat))
+		{
+			free(ret);
+			ERROR_PTR_RETURN_LOG("Cannot get the statistics of size class %u", i);
+		}
+
+		int rc = snprintf(ret + len, cap - len, "%u %u %u %"PRIu64" %"PRIu64"\n", stat.size, stat.obj_size, stat.pages, stat.in_use, stat.total);
+		if(rc < 0 || (size_t)rc >= cap - len)
+		{
+			free(ret);
+			ERROR_PTR_RETURN_LOG("Cannot format the statistics of size class %u", i);
+		}
+		len += (size_t)rc;
+	}
+
+	return ret;
 }
 
 static inline void* _thread_local_allocator(uint32_t tid, const void* data)
@@ -458,6 +532,29 @@ static inline int _rscope_get(uint32_t token, const void** result)
 	return 0;
 }
 
+/**
+ * @note if the function is not called from a request (e.g. from the servlet init function), there's no arena
+ *       we can use, in this case we return NULL without an error, so that the caller can fall back to the
+ *       normal memory pool
+ **/
+static inline int _rscope_arena_alloc(size_t size, void** result)
+{
+	if(NULL == result)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	sched_rscope_t* current = sched_step_current_scope();
+	if(NULL == current)
+	{
+		*result = NULL;
+		return 0;
+	}
+
+	if(NULL == (*result = sched_rscope_arena_alloc(current, size)))
+		ERROR_RETURN_LOG(int, "Cannot allocate memory from the request arena");
+
+	return 0;
+}
+
 static inline int _add_on_exit_callback(_on_exit_callback_t callback, void* data)
 {
 	if(NULL == callback)
@@ -690,6 +787,24 @@ static int _invoke(void* __restrict ctx, uint32_t opcode, va_list args)
 				return ERROR_CODE(int);
 			return 0;
 		}
+		case MODULE_PSSM_MODULE_OPCODE_SCOPE_ARENA_ALLOC:
+		{
+			size_t nbytes = va_arg(args, size_t);
+			void** ret = va_arg(args, void**);
+			return _rscope_arena_alloc(nbytes, ret);
+		}
+		case MODULE_PSSM_MODULE_OPCODE_POOL_ALLOCATOR:
+		{
+			void* (**alloc_buf)(uint32_t) = va_arg(args, void* (**)(uint32_t));
+			int (**dealloc_buf)(void*) = va_arg(args, int (**)(void*));
+			return _pool_allocator(alloc_buf, dealloc_buf);
+		}
+		case MODULE_PSSM_MODULE_OPCODE_ACCT_UPDATE:
+		{
+			const char* name = va_arg(args, const char*);
+			int64_t nbytes = va_arg(args, int64_t);
+			return _acct_update(name, nbytes);
+		}
 		default:
 			ERROR_RETURN_LOG(int, "Invalid opcode 0x%x", opcode);
 	}
@@ -716,12 +831,28 @@ static uint32_t _get_opcode(void* __restrict ctx, const char* name)
 	if(strcmp(name, "scope_stream_eof") == 0) return MODULE_PSSM_MODULE_OPCODE_SCOPE_STREAM_EOF;
 	if(strcmp(name, "scope_stream_read") == 0) return MODULE_PSSM_MODULE_OPCODE_SCOPE_STREAM_READ;
 	if(strcmp(name, "scope_stream_ready_event") == 0) return MODULE_PSSM_MODULE_OPCODE_SCOPE_STREAM_READY_EVENT;
+	if(strcmp(name, "scope_arena_alloc") == 0) return MODULE_PSSM_MODULE_OPCODE_SCOPE_ARENA_ALLOC;
+	if(strcmp(name, "pool_allocator") == 0) return MODULE_PSSM_MODULE_OPCODE_POOL_ALLOCATOR;
+	if(strcmp(name, "acct_update") == 0) return MODULE_PSSM_MODULE_OPCODE_ACCT_UPDATE;
 
 	ERROR_RETURN_LOG(uint32_t, "Invalid method name %s", name);
 }
 
 static const char _libconf_prefix[] = "libconf.";
 
+static const char _pool_stat_sym[] = "pool.stat";
+
+static const char _page_backing_sym[] = "pool.page_backing";
+
+/**
+ * @brief the names of the page backings, in the same order of mempool_page_backing_t
+ **/
+static const char* const _page_backing_names[] = {
+	[MEMPOOL_PAGE_BACKING_SYSTEM]  = "system",
+	[MEMPOOL_PAGE_BACKING_THP]     = "thp",
+	[MEMPOOL_PAGE_BACKING_HUGETLB] = "hugetlb"
+};
+
 static itc_module_property_value_t _get_prop(void* __restrict ctx, const char* sym)
 {
 	(void)ctx;
@@ -729,6 +860,21 @@ static itc_module_property_value_t _get_prop(void* __restrict ctx, const char* s
 		.type = ITC_MODULE_PROPERTY_TYPE_ERROR
 	};
 
+	if(strcmp(sym, _pool_stat_sym) == 0)
+	{
+		if(NULL != (ret.str = _pool_stat()))
+			ret.type = ITC_MODULE_PROPERTY_TYPE_STRING;
+		return ret;
+	}
+
+	if(strcmp(sym, _page_backing_sym) == 0)
+	{
+		if(NULL == (ret.str = strdup(_page_backing_names[mempool_page_get_backing()])))
+			ERROR_LOG_ERRNO_GOTO(RET, "Cannot allocate memory for the page backing name");
+		ret.type = ITC_MODULE_PROPERTY_TYPE_STRING;
+		return ret;
+	}
+
 	const char* p = sym, *q = _libconf_prefix;
 	for(;(q + sizeof(_libconf_prefix) - 1) - _libconf_prefix > 0 && *p == *q; p++, q++);
 	if(*q == 0 && _libconf_map != NULL)
@@ -759,6 +905,26 @@ RET:
 static int _set_prop(void* __restrict ctx, const char* sym, itc_module_property_value_t value)
 {
 	(void)ctx;
+
+	if(strcmp(sym, _page_backing_sym) == 0)
+	{
+		if(value.type != ITC_MODULE_PROPERTY_TYPE_STRING)
+			ERROR_RETURN_LOG(int, "Type mismatch: the page backing should be a string");
+
+		uint32_t i;
+		for(i = 0; i < sizeof(_page_backing_names) / sizeof(_page_backing_names[0]); i ++)
+			if(strcmp(value.str, _page_backing_names[i]) == 0)
+				break;
+
+		if(i == sizeof(_page_backing_names) / sizeof(_page_backing_names[0]))
+			ERROR_RETURN_LOG(int, "Invalid page backing %s, expected system, thp or hugetlb", value.str);
+
+		if(ERROR_CODE(int) == mempool_page_set_backing((mempool_page_backing_t)i))
+			ERROR_RETURN_LOG(int, "Cannot change the page backing");
+
+		return 1;
+	}
+
 	const char* p = sym, *q = _libconf_prefix;
 	for(;(q + sizeof(_libconf_prefix) - 1) - _libconf_prefix > 0 && *p == *q; p++, q++);
 	if(*q == 0)
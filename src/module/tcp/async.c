@@ -12,6 +12,8 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <sys/uio.h>
 
 #include <barrier.h>
 
@@ -22,9 +24,22 @@
 #include <utils/mempool/page.h>
 #include <os/os.h>
 
+#ifdef __LINUX__
+#	include <sys/sendfile.h>
+#endif
+
 #include <itc/module_types.h>
 #include <module/tcp/async.h>
 
+/**
+ * @brief the maximum number of IO vectors we pass to a single writev call
+ **/
+#if defined(IOV_MAX) && IOV_MAX < MODULE_TCP_MAX_ASYNC_IOV
+#	define _MAX_IOV IOV_MAX
+#else
+#	define _MAX_IOV MODULE_TCP_MAX_ASYNC_IOV
+#endif
+
 
 /**
  * @brief the state of an async object
@@ -111,6 +126,9 @@ typedef struct {
 	itc_module_data_source_event_t             data_event;    /*!< The data source event description */
 	int                                        data_end;      /*!< indicates if there's no more data ready events */
 	module_tcp_async_write_data_func_t         get_data;      /*!< the data source callback */
+	module_tcp_async_write_gather_func_t       gather;        /*!< the callback that exposes the pending data as IO vectors, NULL if not supported */
+	module_tcp_async_write_consume_func_t      consume;       /*!< the callback that marks the gathered data as written */
+	module_tcp_async_write_file_func_t         file;          /*!< the callback that exposes the pending data as a file region, NULL if not supported */
 	module_tcp_async_write_cleanup_func_t      cleanup;       /*!< the cleanup callback */
 	module_tcp_async_write_error_func_t        onerror;       /*!< the error handler */
 	module_tcp_async_write_empty_func_t        empty;         /*!< The callback function used to check if the handle is empty (No pending bytes to write) */
@@ -404,6 +422,204 @@ static inline _async_obj_t* _async_obj_get_from_index(module_tcp_async_loop_t* l
 
 	return ret;
 }
+/**
+ * @brief the writev call, which uses the mocked write function if it's given
+ * @note the mocked write doesn't support the vectored IO, so we call it for each IO vector
+ *       until we get a short write
+ * @param loop the async loop
+ * @param fd the target FD
+ * @param iov the IO vectors
+ * @param iovcnt the number of IO vectors
+ * @return the number of bytes has been written, or -1 on error
+ **/
+static inline ssize_t _writev(module_tcp_async_loop_t* loop, int fd, const struct iovec* iov, int iovcnt)
+{
+	if(loop->write == NULL) return writev(fd, iov, iovcnt);
+
+	ssize_t ret = 0;
+	int i;
+	for(i = 0; i < iovcnt; i ++)
+	{
+		ssize_t rc = loop->write(fd, iov[i].iov_base, iov[i].iov_len);
+		if(rc <= 0) return ret > 0 ? ret : rc;
+		ret += rc;
+		if((size_t)rc < iov[i].iov_len) break;
+	}
+
+	return ret;
+}
+
+/**
+ * @brief perform the IO operation with the IO vectors exposed by the gather callback
+ * @details the bytes already copied to the IO buffer are written first, and then all the data the
+ *          gather callback exposes
+ * @param loop the async loop
+ * @param obj the async object
+ * @return the new state for this object, or _NUM_OF_STATES if nothing can be gathered and the caller should
+ *         fall back to the data source callback
+ **/
+static inline _async_obj_state_t _io_ops_vectored(module_tcp_async_loop_t* loop, _async_obj_t* obj)
+{
+	struct iovec iov[_MAX_IOV];
+	int iovcnt = 0;
+	size_t buffered = obj->b_end - obj->b_begin;
+
+	if(buffered > 0)
+	{
+		iov[0].iov_base = obj->io_buffer + obj->b_begin;
+		iov[0].iov_len  = buffered;
+		iovcnt = 1;
+	}
+
+	int rc = obj->gather(_async_obj_conn_id(loop, obj), iov + iovcnt, _MAX_IOV - iovcnt, loop);
+	if(ERROR_CODE(int) == rc)
+	{
+		LOG_ERROR("the gather function returns an error code, "
+		          "set the async object %"PRIu32" state to ERROR",
+		          _async_obj_conn_id(loop, obj));
+		return _ST_RAISING;
+	}
+
+	if(rc == 0) return _NUM_OF_STATES;
+
+	iovcnt += rc;
+
+	ssize_t bytes_written = _writev(loop, obj->fd, iov, iovcnt);
+
+	if(-1 == bytes_written || bytes_written == 0)
+	{
+		if(errno == EWOULDBLOCK || errno == EAGAIN)
+		{
+			LOG_DEBUG("connection object %"PRIu32" is busy, "
+			          "update the state to WAIT_FOR_CONNECTION",
+			          _async_obj_conn_id(loop, obj));
+
+			obj->wait_conn = 1;
+			return _ST_WAIT;
+		}
+		else
+		{
+			LOG_ERROR_ERRNO("connection object %"PRIu32" has a write failure, "
+			                "update the state to ERROR",
+			                _async_obj_conn_id(loop, obj));
+			return _ST_RAISING;
+		}
+	}
+
+	LOG_DEBUG("%zd bytes in %d IO vectors has been written to the connection object %"PRIu32, bytes_written, iovcnt, _async_obj_conn_id(loop, obj));
+
+	size_t remaining = (size_t)bytes_written;
+
+	if(buffered > 0)
+	{
+		size_t consumed = remaining < buffered ? remaining : buffered;
+		obj->b_begin += consumed;
+		remaining -= consumed;
+	}
+
+	if(remaining > 0 && ERROR_CODE(int) == obj->consume(_async_obj_conn_id(loop, obj), remaining, loop))
+	{
+		LOG_ERROR("the consume function returns an error code, "
+		          "set the async object %"PRIu32" state to ERROR",
+		          _async_obj_conn_id(loop, obj));
+		return _ST_RAISING;
+	}
+
+	return _ST_READY;
+}
+
+/**
+ * @brief send the file region to the socket
+ * @note if the mocked write function is given, or the platform doesn't support sendfile, we read the file
+ *       and write it to the socket instead
+ * @param loop the async loop
+ * @param fd the target FD
+ * @param region the file region to send
+ * @return the number of bytes has been sent, or -1 on error
+ **/
+static inline ssize_t _sendfile(module_tcp_async_loop_t* loop, int fd, const itc_module_data_source_region_t* region)
+{
+#ifdef __LINUX__
+	if(loop->write == NULL)
+	{
+		off_t offset = (off_t)region->offset;
+		return sendfile(fd, region->fd, &offset, region->size);
+	}
+#endif
+	char buf[4096];
+	size_t count = region->size < sizeof(buf) ? region->size : sizeof(buf);
+
+	ssize_t rc = pread(region->fd, buf, count, (off_t)region->offset);
+	if(rc <= 0) return rc;
+
+	return loop->write == NULL ? write(fd, buf, (size_t)rc) : loop->write(fd, buf, (size_t)rc);
+}
+
+/**
+ * @brief perform the IO operation with the file region exposed by the file callback
+ * @note this should be called only when the IO buffer is empty, otherwise the order of data will be broken
+ * @param loop the async loop
+ * @param obj the async object
+ * @return the new state for this object, or _NUM_OF_STATES if the pending data is not a file region and the
+ *         caller should fall back to the data source callback
+ **/
+static inline _async_obj_state_t _io_ops_file(module_tcp_async_loop_t* loop, _async_obj_t* obj)
+{
+	itc_module_data_source_region_t region;
+
+	int rc = obj->file(_async_obj_conn_id(loop, obj), &region, loop);
+	if(ERROR_CODE(int) == rc)
+	{
+		LOG_ERROR("the file function returns an error code, "
+		          "set the async object %"PRIu32" state to ERROR",
+		          _async_obj_conn_id(loop, obj));
+		return _ST_RAISING;
+	}
+
+	if(rc == 0 || region.size == 0) return _NUM_OF_STATES;
+
+	ssize_t bytes_sent = _sendfile(loop, obj->fd, &region);
+
+	if(bytes_sent == 0)
+	{
+		LOG_ERROR("the file region for connection object %"PRIu32" has been truncated, "
+		          "update the state to ERROR", _async_obj_conn_id(loop, obj));
+		return _ST_RAISING;
+	}
+
+	if(-1 == bytes_sent)
+	{
+		if(errno == EWOULDBLOCK || errno == EAGAIN)
+		{
+			LOG_DEBUG("connection object %"PRIu32" is busy, "
+			          "update the state to WAIT_FOR_CONNECTION",
+			          _async_obj_conn_id(loop, obj));
+
+			obj->wait_conn = 1;
+			return _ST_WAIT;
+		}
+		else
+		{
+			LOG_ERROR_ERRNO("connection object %"PRIu32" has a sendfile failure, "
+			                "update the state to ERROR",
+			                _async_obj_conn_id(loop, obj));
+			return _ST_RAISING;
+		}
+	}
+
+	LOG_DEBUG("%zd bytes of file region has been sent to the connection object %"PRIu32, bytes_sent, _async_obj_conn_id(loop, obj));
+
+	if(ERROR_CODE(int) == obj->consume(_async_obj_conn_id(loop, obj), (size_t)bytes_sent, loop))
+	{
+		LOG_ERROR("the consume function returns an error code, "
+		          "set the async object %"PRIu32" state to ERROR",
+		          _async_obj_conn_id(loop, obj));
+		return _ST_RAISING;
+	}
+
+	return _ST_READY;
+}
+
 /**
  * @brief performe the IO operations
  * @param loop the async loop
@@ -414,6 +630,20 @@ static inline _async_obj_state_t _io_ops(module_tcp_async_loop_t* loop, _async_o
 {
 	if(obj->b_end == obj->b_begin) obj->b_begin = obj->b_end = 0;
 
+	/* If the data can be exposed as IO vectors, we flush all of them with one system call */
+	if(NULL != obj->gather)
+	{
+		_async_obj_state_t ret = _io_ops_vectored(loop, obj);
+		if(_NUM_OF_STATES != ret) return ret;
+	}
+
+	/* If the buffered data has been flushed and the pending data is a file region, let the kernel send it */
+	if(NULL != obj->file && obj->b_end == obj->b_begin)
+	{
+		_async_obj_state_t ret = _io_ops_file(loop, obj);
+		if(_NUM_OF_STATES != ret) return ret;
+	}
+
 	/* before we perform the actual data operation, we want to maximize the number of bytes passed to the system call */
 	if(obj->b_end < obj->b_size)
 	{
@@ -1121,12 +1351,15 @@ ERR:
 int module_tcp_async_write_register(module_tcp_async_loop_t* loop,
                                     uint32_t conn_id, int fd, size_t buf_size,
                                     module_tcp_async_write_data_func_t get_data,
+                                    module_tcp_async_write_gather_func_t gather,
+                                    module_tcp_async_write_consume_func_t consume,
+                                    module_tcp_async_write_file_func_t file,
                                     module_tcp_async_write_empty_func_t empty,
                                     module_tcp_async_write_cleanup_func_t cleanup,
                                     module_tcp_async_write_error_func_t on_error,
                                     void* handle)
 {
-	if(NULL == loop || conn_id >= loop->capacity || fd < 0 || get_data == NULL || cleanup == NULL || on_error == NULL || handle == NULL || empty == NULL)
+	if(NULL == loop || conn_id >= loop->capacity || fd < 0 || get_data == NULL || cleanup == NULL || on_error == NULL || handle == NULL || empty == NULL || ((gather != NULL || file != NULL) && consume == NULL))
 		ERROR_RETURN_LOG(int, "Invalid arguments");
 
 	if(loop->objects[conn_id].index != ERROR_CODE(uint32_t))
@@ -1137,6 +1370,9 @@ int module_tcp_async_write_register(module_tcp_async_loop_t* loop,
 	 * connection, since for each async write operation, data_end must be the last queue message */
 	loop->objects[conn_id].fd = fd;
 	loop->objects[conn_id].get_data = get_data;
+	loop->objects[conn_id].gather = gather;
+	loop->objects[conn_id].consume = consume;
+	loop->objects[conn_id].file = file;
 	loop->objects[conn_id].cleanup = cleanup;
 	loop->objects[conn_id].onerror = on_error;
 	loop->objects[conn_id].empty = empty;
@@ -13,6 +13,8 @@
 #include <inttypes.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <sys/uio.h>
+#include <poll.h>
 
 #include <barrier.h>
 #include <error.h>
@@ -26,6 +28,14 @@
 #include <itc/module.h>
 #include <itc/modtab.h>
 
+#include <sched/trace.h>
+
+#include <os/os.h>
+
+#ifdef __LINUX__
+#	include <sys/sendfile.h>
+#endif
+
 #include <module/tcp/module.h>
 #include <module/tcp/pool.h>
 #include <module/tcp/async.h>
@@ -66,6 +76,15 @@ typedef struct {
 STATIC_ASSERTION_SIZE(_state_t, buffer, 0);
 STATIC_ASSERTION_LAST(_state_t, buffer);
 
+/**
+ * @brief the data source that is held by an async write page
+ **/
+typedef struct {
+	itc_module_data_source_t          source;      /*!< the data source */
+	uint32_t                          has_region:1;/*!< if the remaining data is a file region, which is sent by sendfile rather than read */
+	itc_module_data_source_region_t   region;      /*!< the remaining file region, only valid when has_region is set */
+} _async_data_source_t;
+
 /**
  * @brief the internal async write data buffer page
  **/
@@ -77,7 +96,7 @@ typedef struct _async_buf_page_t {
 	};
 	union {
 		char                      data[0];          /*!< the actual buffer */
-		itc_module_data_source_t  data_source[0];   /*!< the data source buffer, valid only if callback == (uintn32_t)~0u */
+		_async_data_source_t      data_source[0];   /*!< the data source buffer, valid only if callback == (uintn32_t)~0u */
 	};
 } __attribute__((packed)) _async_buf_page_t;
 STATIC_ASSERTION_LAST(_async_buf_page_t, data);
@@ -100,6 +119,8 @@ typedef struct {
 	_state_t*          release_data;   /*!< the data to release */
 	int                error;          /*!< if the handle is in an error state */
 	pthread_mutex_t*   mutex;          /*!< the async mutex used by this async handle */
+	sched_trace_id_t   trace_id;       /*!< the trace id of the request that starts the async write */
+	uint64_t           trace_ts;       /*!< the timestamp when the async write starts */
 } _async_handle_t;
 
 /**
@@ -153,6 +174,9 @@ static mempool_objpool_t* _async_data_source_pool = NULL;
 /** @brief the counter indicates how many instances is initialized */
 static uint32_t _instance_count = 0;
 
+/** @brief the accounting counter for the connection state pages */
+static mempool_acct_t* _state_acct = NULL;
+
 /**
  * @brief dispose a user defined state
  * @param state the state data
@@ -183,6 +207,8 @@ static int _dispose_state(void* data)
 	//free(data);
 	if(ERROR_CODE(int) == mempool_page_dealloc(data))
 		rc = ERROR_CODE(int);
+	else
+		mempool_acct_update(_state_acct, -(int64_t)_pagesize);
 	return rc;
 }
 
@@ -204,9 +230,10 @@ static inline _async_buf_page_t* _async_buf_data_page_new(void)
 /**
  * @brief create a new data source page for the given data source
  * @param data_source the data source we need to create the page for
+ * @param region the file region that holds the remaining data of the data source, NULL if the data source should be read
  * @return the newly created page, NULL on error
  **/
-static inline _async_buf_page_t* _async_buf_data_source_page_new(const itc_module_data_source_t data_source)
+static inline _async_buf_page_t* _async_buf_data_source_page_new(const itc_module_data_source_t data_source, const itc_module_data_source_region_t* region)
 {
 	_async_buf_page_t* ret = (_async_buf_page_t*)mempool_objpool_alloc(_async_data_source_pool);
 	if(NULL == ret)
@@ -214,7 +241,9 @@ static inline _async_buf_page_t* _async_buf_data_source_page_new(const itc_modul
 
 	ret->next = NULL;
 	ret->callback = _DATA_SOURCE_CALLBACK;
-	*ret->data_source = data_source;
+	ret->data_source->source = data_source;
+	ret->data_source->has_region = (region != NULL);
+	if(NULL != region) ret->data_source->region = *region;
 
 	return ret;
 }
@@ -236,6 +265,8 @@ static inline _async_handle_t* _async_handle_new(_module_context_t* ctx)
 	ret->mutex = &_async_mutex.mutex;
 	ret->error = 0;
 	ret->conn_pool = ctx->conn_pool;
+	ret->trace_id = sched_trace_current();
+	ret->trace_ts = sched_trace_begin(ret->trace_id);
 
 	/* Because this is thread local, so no race condition possible at this point */
 	if(_async_mutex.created == 0)
@@ -272,7 +303,7 @@ static inline int _async_buf_page_free(_async_buf_page_t* page)
 {
 	if(_async_buf_page_is_data_source(page))
 	{
-		int rc = page->data_source->close(page->data_source->data_handle);
+		int rc = page->data_source->source.close(page->data_source->source.data_handle);
 
 		if(ERROR_CODE(int) == rc)
 			LOG_ERROR("Cannot close the data source object properly");
@@ -289,6 +320,42 @@ static inline int _async_buf_page_free(_async_buf_page_t* page)
 		return mempool_page_dealloc(page);
 }
 
+/**
+ * @brief move the async handle to the next page, when the first page has been exhausted
+ * @note this function should be called with the async handle mutex held
+ * @param handle the async handle
+ * @param conn the connection id
+ * @param loop the async loop
+ * @return nothing
+ **/
+static inline void _async_handle_page_exhausted(_async_handle_t* handle, uint32_t conn, module_tcp_async_loop_t* loop)
+{
+	/* We should try to reuse the page, however, if the page is either the non-last one, or callback page,
+	 * we will not be able to reuse it */
+	if(handle->page_begin->next != NULL || _async_buf_page_is_data_source(handle->page_begin))
+	{
+		/* because this is not the last page, so we can not reuse the page */
+		_async_buf_page_t* tmp = handle->page_begin;
+
+		handle->page_off = 0;
+		handle->page_begin = handle->page_begin->next;
+		if(ERROR_CODE(int) == module_tcp_async_clear_data_event(loop, conn))
+			LOG_WARNING("Cannot clear the data event");
+		if(ERROR_CODE(int) == _async_buf_page_free(tmp))
+			LOG_WARNING("Cannot deallocate the async buffer page");
+
+		if(handle->page_end == tmp) handle->page_end = NULL;
+
+		LOG_DEBUG("data page disposed");
+	}
+	else
+	{
+		handle->page_off = 0;
+		handle->page_begin->nbytes = 0;
+		LOG_DEBUG("reused the last data page");
+	}
+}
+
 /**
  * @brief the data source callback for the async handle
  * @param conn the connection id
@@ -314,7 +381,11 @@ static inline size_t _async_handle_getdata(uint32_t conn, void* data, size_t siz
 	{
 		if(_async_buf_page_is_data_source(handle->page_begin))
 		{
-			int eos_rc = handle->page_begin->data_source->eos(handle->page_begin->data_source->data_handle);
+			/* The file region is sent by the file callback once the data we have copied is flushed */
+			if(handle->page_begin->data_source->has_region)
+				break;
+
+			int eos_rc = handle->page_begin->data_source->source.eos(handle->page_begin->data_source->source.data_handle);
 
 			if(ERROR_CODE(int) == eos_rc)
 			{
@@ -330,7 +401,7 @@ static inline size_t _async_handle_getdata(uint32_t conn, void* data, size_t siz
 
 			itc_module_data_source_event_t event;
 
-			size_t bytes_read = handle->page_begin->data_source->read(handle->page_begin->data_source->data_handle, buf, size, &event);
+			size_t bytes_read = handle->page_begin->data_source->source.read(handle->page_begin->data_source->source.data_handle, buf, size, &event);
 			if(ERROR_CODE(size_t) == bytes_read || bytes_read > size)
 			{
 				LOG_WARNING("The data source page will be ignored because the read call returns an error");
@@ -395,34 +466,171 @@ static inline size_t _async_handle_getdata(uint32_t conn, void* data, size_t siz
 		continue;
 
 PAGE_EXHAUSTED:
-		/* We should try to reuse the page, however, if the page is either the non-last one, or callback page,
-		 * we will not be able to reuse it */
-		if(handle->page_begin->next != NULL || _async_buf_page_is_data_source(handle->page_begin))
+		_async_handle_page_exhausted(handle, conn, loop);
+	}
+
+	if((errno = pthread_mutex_unlock(handle->mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(size_t, "cannot acquire the async handle mutex");
+
+	return ret;
+}
+
+/**
+ * @brief expose the pending data pages of the async handle as IO vectors
+ * @details we stop at the first data source page, because the data source can only be read by copying.
+ *          The page data is referred without the mutex held after this function returns, this is safe
+ *          because the pages are only disposed by the async loop thread (by the consume callback,
+ *          the data source callback or the cleanup callback), and the writer only appends data after the
+ *          size we take here
+ * @param conn the connection id
+ * @param iov the IO vector buffer
+ * @param iovcnt the size of the IO vector buffer
+ * @param loop the async loop called this function
+ * @return the number of IO vectors filled, or error code
+ **/
+static inline int _async_handle_gather(uint32_t conn, struct iovec* iov, int iovcnt, module_tcp_async_loop_t* loop)
+{
+	_async_handle_t* handle = (_async_handle_t*)module_tcp_async_get_data_handle(loop, conn);
+
+	if(NULL == handle)
+		ERROR_RETURN_LOG(int, "cannot get the data handle for connection object %"PRIu32, conn);
+
+	int ret = 0;
+
+	if((errno = pthread_mutex_lock(handle->mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "cannot acquire the async handle mutex");
+
+	_async_buf_page_t* page;
+	uint32_t offset = handle->page_off;
+	for(page = handle->page_begin; page != NULL && ret < iovcnt && !_async_buf_page_is_data_source(page); page = page->next, offset = 0)
+	{
+		if(page->nbytes <= offset) continue;
+
+		iov[ret].iov_base = page->data + offset;
+		iov[ret].iov_len  = page->nbytes - offset;
+		ret ++;
+	}
+
+	if((errno = pthread_mutex_unlock(handle->mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "cannot release the async handle mutex");
+
+	return ret;
+}
+
+/**
+ * @brief mark the data previously gathered from the async handle as written
+ * @param conn the connection id
+ * @param nbytes the number of bytes that has been written
+ * @param loop the async loop called this function
+ * @return status code
+ **/
+static inline int _async_handle_consume(uint32_t conn, size_t nbytes, module_tcp_async_loop_t* loop)
+{
+	_async_handle_t* handle = (_async_handle_t*)module_tcp_async_get_data_handle(loop, conn);
+
+	if(NULL == handle)
+		ERROR_RETURN_LOG(int, "cannot get the data handle for connection object %"PRIu32, conn);
+
+	if((errno = pthread_mutex_lock(handle->mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "cannot acquire the async handle mutex");
+
+	int rc = 0;
+
+	while(nbytes > 0)
+	{
+		if(handle->page_begin == NULL)
 		{
-			/* because this is not the last page, so we can not reuse the page */
-			_async_buf_page_t* tmp = handle->page_begin;
+			LOG_ERROR("Consuming more bytes than the gathered data");
+			rc = ERROR_CODE(int);
+			break;
+		}
+
+		if(_async_buf_page_is_data_source(handle->page_begin))
+		{
+			if(!handle->page_begin->data_source->has_region || handle->page_begin->data_source->region.size < nbytes)
+			{
+				LOG_ERROR("Consuming more bytes than the file region");
+				rc = ERROR_CODE(int);
+				break;
+			}
 
-			handle->page_off = 0;
-			handle->page_begin = handle->page_begin->next;
-			if(ERROR_CODE(int) == module_tcp_async_clear_data_event(loop, conn))
-				LOG_WARNING("Cannot clear the data event");
-			if(ERROR_CODE(int) == _async_buf_page_free(tmp))
-				LOG_WARNING("Cannot deallocate the async buffer page");
+			handle->page_begin->data_source->region.offset += nbytes;
+			handle->page_begin->data_source->region.size -= nbytes;
 
-			if(handle->page_end == tmp) handle->page_end = NULL;
+			if(handle->page_begin->data_source->region.size == 0)
+			{
+				LOG_DEBUG("The file region has been completely sent");
+				_async_handle_page_exhausted(handle, conn, loop);
+			}
 
-			LOG_DEBUG("data page disposed");
+			break;
 		}
-		else
+
+		size_t avail = handle->page_begin->nbytes - handle->page_off;
+
+		if(avail > nbytes)
+		{
+			handle->page_off += (uint32_t)nbytes;
+			break;
+		}
+
+		nbytes -= avail;
+		handle->page_off = handle->page_begin->nbytes;
+
+		/* The last page is reused rather than disposed, so there's nothing to consume after it */
+		int last_page = (handle->page_begin->next == NULL);
+
+		_async_handle_page_exhausted(handle, conn, loop);
+
+		if(last_page && nbytes > 0)
 		{
-			handle->page_off = 0;
-			handle->page_begin->nbytes = 0;
-			LOG_DEBUG("reused the last data page");
+			LOG_ERROR("Consuming more bytes than the gathered data");
+			rc = ERROR_CODE(int);
+			break;
 		}
 	}
 
 	if((errno = pthread_mutex_unlock(handle->mutex)) != 0)
-		ERROR_RETURN_LOG_ERRNO(size_t, "cannot acquire the async handle mutex");
+		ERROR_RETURN_LOG_ERRNO(int, "cannot release the async handle mutex");
+
+	return rc;
+}
+
+/**
+ * @brief expose the file region at the head of the pending data of the async handle
+ * @details the data pages that are already written before the file region are disposed at this point.
+ *          Similar to the gather callback, the region is used without the mutex held, which is safe because
+ *          only the async loop thread modifies or disposes the page.
+ * @param conn the connection id
+ * @param region the buffer used to return the file region
+ * @param loop the async loop called this function
+ * @return 1 if the region is returned, 0 if the head of the pending data is not a file region, or error code
+ **/
+static inline int _async_handle_file(uint32_t conn, itc_module_data_source_region_t* region, module_tcp_async_loop_t* loop)
+{
+	_async_handle_t* handle = (_async_handle_t*)module_tcp_async_get_data_handle(loop, conn);
+
+	if(NULL == handle)
+		ERROR_RETURN_LOG(int, "cannot get the data handle for connection object %"PRIu32, conn);
+
+	int ret = 0;
+
+	if((errno = pthread_mutex_lock(handle->mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "cannot acquire the async handle mutex");
+
+	while(handle->page_begin != NULL && handle->page_begin->next != NULL &&
+	      !_async_buf_page_is_data_source(handle->page_begin) &&
+	      handle->page_begin->nbytes <= handle->page_off)
+		_async_handle_page_exhausted(handle, conn, loop);
+
+	if(handle->page_begin != NULL && _async_buf_page_is_data_source(handle->page_begin) && handle->page_begin->data_source->has_region)
+	{
+		*region = handle->page_begin->data_source->region;
+		ret = 1;
+	}
+
+	if((errno = pthread_mutex_unlock(handle->mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "cannot release the async handle mutex");
 
 	return ret;
 }
@@ -484,6 +692,8 @@ static inline int _async_handle_dispose(uint32_t conn, module_tcp_async_loop_t*
 	if(NULL == handle)
 		ERROR_RETURN_LOG_ERRNO(int, "cannot get the data handle for the connection object %"PRIu32, conn);
 
+	sched_trace_end(handle->trace_id, SCHED_TRACE_SPAN_MODULE_WRITE, conn, handle->trace_ts);
+
 	if(!handle->error)
 	{
 		if(handle->release_mode != -1 && ERROR_CODE(int) == module_tcp_pool_connection_release(handle->conn_pool, conn, handle->release_data, handle->release_mode))
@@ -593,13 +803,16 @@ static inline int _module_context_init(_module_context_t* ctx, _module_context_t
 		if(NULL == (_async_handle_pool = mempool_objpool_new(sizeof(_async_handle_t))))
 			ERROR_RETURN_LOG(int, "Cannot create async handle object pool");
 
-		if(NULL == (_async_data_source_pool = mempool_objpool_new(sizeof(_async_buf_page_t) + sizeof(itc_module_data_source_t))))
+		if(NULL == (_async_data_source_pool = mempool_objpool_new(sizeof(_async_buf_page_t) + sizeof(_async_data_source_t))))
 			ERROR_RETURN_LOG(int, "Cannot create async data source object pool");
 
 		int pagesize = getpagesize();
 		if(pagesize < 0) ERROR_RETURN_LOG_ERRNO(int, "Cannot get page size");
 
 		_pagesize = (uint32_t)pagesize;
+
+		if(NULL == (_state_acct = mempool_acct_counter("tcp.state")))
+			ERROR_RETURN_LOG(int, "Cannot get the accounting counter for the connection states");
 	}
 
 
@@ -653,9 +866,14 @@ static int _init(void* __restrict ctx, uint32_t argc, char const* __restrict con
 	context->pool_conf.min_timeout  = 1;
 	context->pool_conf.tcp_backlog  = 512;
 	context->pool_conf.reuseaddr    = 0;
+	context->pool_conf.reuseport    = 0;
+	context->pool_conf.nodelay      = 0;
+	context->pool_conf.steer        = MODULE_TCP_POOL_STEER_NONE;
+	context->pool_conf.cpuset       = NULL;
 	context->pool_conf.ipv6         = 0;
 	context->pool_conf.accept_retry_interval = 5;
 	context->pool_conf.dispose_data = _dispose_state;
+	context->pool_conf.time         = NULL;
 	context->slave_mode = 0;
 	context->retry_interval = 1;
 
@@ -748,6 +966,8 @@ static int _accept(void* __restrict ctx, const void* __restrict args, void* __re
 			return ERROR_CODE(int);
 		}
 
+		mempool_acct_update(_state_acct, (int64_t)_pagesize);
+
 		stat->total_bytes = 0;
 		stat->unread_bytes = 0;
 		stat->user_space_data = NULL;
@@ -955,7 +1175,8 @@ static inline int _create_async_handle(_module_context_t* context, _handle_t* ha
 		ERROR_RETURN_LOG(int, "cannot create async handle for the async object");
 
 	if(module_tcp_async_write_register(context->async_loop, handle->idx, handle->fd, context->async_buf_size,
-	                                   _async_handle_getdata, _async_handle_empty, _async_handle_dispose,
+	                                   _async_handle_getdata, _async_handle_gather, _async_handle_consume, _async_handle_file,
+	                                   _async_handle_empty, _async_handle_dispose,
 	                                   _async_handle_onerror, handle->async_handle) == ERROR_CODE(int))
 	{
 		mempool_objpool_dealloc(_async_handle_pool, handle->async_handle);
@@ -1057,6 +1278,160 @@ static inline size_t _ensure_async_handle(_module_context_t* context, _handle_t*
 	else return 0;
 }
 
+/**
+ * @brief get the file region that holds the remaining data of the data source
+ * @note we only use the file region when the platform supports sendfile, otherwise the data source is read as usual
+ * @param data_source the data source
+ * @param region the buffer used to return the file region
+ * @return 1 if the region is returned, 0 if the data source should be read, or error code
+ **/
+static inline int _data_source_file_region(const itc_module_data_source_t* data_source, itc_module_data_source_region_t* region)
+{
+#ifdef __LINUX__
+	if(NULL == data_source->file_region) return 0;
+
+	return data_source->file_region(data_source->data_handle, region);
+#else
+	(void)data_source;
+	(void)region;
+	return 0;
+#endif
+}
+
+/**
+ * @brief send the file region to the socket with the sendfile system call, and advance the region
+ * @param fd the socket FD
+ * @param region the file region
+ * @return the number of bytes has been sent, or -1 on error (errno is set)
+ **/
+static inline ssize_t _send_file_region(int fd, itc_module_data_source_region_t* region)
+{
+#ifdef __LINUX__
+	off_t offset = (off_t)region->offset;
+	ssize_t rc = sendfile(fd, region->fd, &offset, region->size);
+
+	if(rc == 0 && region->size > 0)
+	{
+		errno = EIO;
+		return -1;
+	}
+
+	if(rc > 0)
+	{
+		region->offset += (uint64_t)rc;
+		region->size -= (size_t)rc;
+	}
+
+	return rc;
+#else
+	(void)fd;
+	(void)region;
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+/**
+ * @brief wait until the socket is able to accept more data
+ * @details this is used by the sync write once the socket buffer is full, so that we don't retry the write in a busy loop
+ * @param context the module context
+ * @param fd the socket FD
+ * @return status code, if the socket doesn't become writable within the connection TTL, it's an error
+ **/
+static inline int _wait_writable(const _module_context_t* context, int fd)
+{
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLOUT
+	};
+	int rc;
+
+	while((rc = poll(&pfd, 1, (int)context->pool_conf.ttl * 1000)) < 0 && errno == EINTR);
+
+	if(rc < 0) ERROR_RETURN_LOG_ERRNO(int, "Cannot poll the socket");
+
+	if(rc == 0) ERROR_RETURN_LOG(int, "The socket doesn't accept any data in %d seconds", (int)context->pool_conf.ttl);
+
+	return 0;
+}
+
+/**
+ * @brief append a data source page to the async buffer of the pipe handle
+ * @note this function takes the ownership of the data source unless it returns ERROR_CODE(int)
+ * @param context the module context
+ * @param handle the pipe handle, which should have the async handle created
+ * @param data_source the data source
+ * @param region the file region that holds the remaining data, NULL if the data source should be read
+ * @return status code
+ **/
+static inline int _write_data_source_page(_module_context_t* context, _handle_t* handle, itc_module_data_source_t data_source, const itc_module_data_source_region_t* region)
+{
+	int rc = 0;
+
+	if((errno = pthread_mutex_lock(handle->async_handle->mutex)) != 0)
+		ERROR_RETURN_LOG(int, "cannot acquire the async object mutex for connection %"PRIu32, handle->idx);
+
+	_async_buf_page_t* page = _async_buf_data_source_page_new(data_source, region);
+	if(NULL == page) ERROR_LOG_GOTO(ASYNC_ERR, "Cannot allocate data source page for the data source");
+
+	if(handle->async_handle->page_end != NULL) handle->async_handle->page_end->next = page;
+	handle->async_handle->page_end = page;
+	if(NULL == handle->async_handle->page_begin) handle->async_handle->page_begin = page;
+
+	goto ASYNC_RET;
+ASYNC_ERR:
+	/* In this case we actually toke the onwership */
+	rc = ERROR_CODE_OT(int);
+	data_source.close(data_source.data_handle);
+ASYNC_RET:
+	if((errno = pthread_mutex_unlock(handle->async_handle->mutex)) != 0)
+	{
+		LOG_ERROR("cannot release the async object mutex for connection %"PRIu32, handle->idx);
+		rc = ERROR_CODE_OT(int);
+	}
+	if(rc != ERROR_CODE_OT(int) && module_tcp_async_write_data_ready(context->async_loop, handle->idx) == ERROR_CODE(int))
+		ERROR_RETURN_LOG(int, "cannot notify the async IO loop");
+	return rc;
+}
+
+/**
+ * @brief write the data source whose remaining data is a file region in the async mode
+ * @details if there's no pending async data and the sync write attempt is enabled, we send the region
+ *          synchronously until the socket is not able to accept more, and the remaining part of the region
+ *          is sent by the async loop with sendfile
+ * @param context the module context
+ * @param handle the pipe handle
+ * @param data_source the data source
+ * @param region the file region
+ * @return status code
+ **/
+static inline int _write_file_region_async(_module_context_t* context, _handle_t* handle, itc_module_data_source_t data_source, itc_module_data_source_region_t region)
+{
+	if(handle->async_handle == NULL && context->sync_write_attempt)
+	{
+		while(region.size > 0)
+		{
+			if(_send_file_region(handle->fd, &region) < 0)
+			{
+				if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+				ERROR_RETURN_LOG_ERRNO(int, "Cannot send the file region");
+			}
+		}
+	}
+
+	if(region.size == 0)
+	{
+		LOG_DEBUG("The file region has been sent completely by the sync write attempt");
+		return data_source.close(data_source.data_handle);
+	}
+
+	if(handle->async_handle == NULL && ERROR_CODE(int) == _create_async_handle(context, handle))
+		ERROR_RETURN_LOG(int, "Cannot create async handle for the pipe");
+
+	LOG_DEBUG("The file region is not exhausted, sending the remaining %zu bytes asynchronously", region.size);
+	return _write_data_source_page(context, handle, data_source, &region);
+}
+
 static int _write_callback(void* __restrict ctx, itc_module_data_source_t data_source, void* __restrict out)
 {
 	if(NULL == ctx || NULL == out)
@@ -1078,6 +1453,11 @@ static int _write_callback(void* __restrict ctx, itc_module_data_source_t data_s
 	PREDICT_IMPOSSIBLE(context->async_buf_size > MODULE_TCP_MAX_ASYNC_BUF_SIZE);
 	int8_t sync_buf[context->async_buf_size];
 
+	itc_module_data_source_region_t region;
+	int has_region = _data_source_file_region(&data_source, &region);
+	if(ERROR_CODE(int) == has_region)
+		ERROR_RETURN_LOG(int, "Cannot get the file region of the data source");
+
 	if(flags & RUNTIME_API_PIPE_ASYNC)
 	{
 		LOG_DEBUG("Async write_callback called");
@@ -1085,6 +1465,9 @@ static int _write_callback(void* __restrict ctx, itc_module_data_source_t data_s
 		if(ERROR_CODE(int) == _ensure_async_loop_init(context))
 			ERROR_RETURN_LOG(int, "Cannot initialize the async loop");
 
+		if(has_region)
+			return _write_file_region_async(context, handle, data_source, region);
+
 		int eos_rc = ERROR_CODE(int);
 		size_t sync_data_size = 0; /* How many bytes in the sync_data buffer */
 		const int8_t* sync_data = NULL; /* The pointer for the start address of buffer that haven't been written */
@@ -1159,8 +1542,6 @@ static int _write_callback(void* __restrict ctx, itc_module_data_source_t data_s
 
 
 		/* Finally, let's create a data source page for the data source ! */
-		int rc = 0;
-
 		/* Make sure the eos call has been called at this point */
 		if(eos_rc == ERROR_CODE(int) && ERROR_CODE(int) == (eos_rc = (data_source.eos(data_source.data_handle))))
 			ERROR_RETURN_LOG(int, "data_source.eos returns an error status code");
@@ -1171,35 +1552,24 @@ static int _write_callback(void* __restrict ctx, itc_module_data_source_t data_s
 		}
 
 		LOG_DEBUG("The data source is not exhausted, write it to the async buffer");
-		if((errno = pthread_mutex_lock(handle->async_handle->mutex)) != 0)
-			ERROR_RETURN_LOG(int, "cannot acquire the async object mutex for connection %"PRIu32, handle->idx);
-
-		_async_buf_page_t* page = _async_buf_data_source_page_new(data_source);
-		if(NULL == page) ERROR_LOG_GOTO(ASYNC_ERR, "Cannot allocate data source page for the data source");
-
-		if(handle->async_handle->page_end != NULL) handle->async_handle->page_end->next = page;
-		handle->async_handle->page_end = page;
-		if(NULL == handle->async_handle->page_begin) handle->async_handle->page_begin = page;
-
-		goto ASYNC_RET;
-ASYNC_ERR:
-		/* In this case we actually toke the onwership */
-		rc = ERROR_CODE_OT(int);
-		data_source.close(data_source.data_handle);
-ASYNC_RET:
-		if((errno = pthread_mutex_unlock(handle->async_handle->mutex)) != 0)
-		{
-			LOG_ERROR("cannot release the async object mutex for connection %"PRIu32, handle->idx);
-			rc = ERROR_CODE_OT(int);
-		}
-		if(rc != ERROR_CODE(int) && rc != ERROR_CODE_OT(int) && module_tcp_async_write_data_ready(context->async_loop, handle->idx) == ERROR_CODE(int))
-			ERROR_RETURN_LOG(int, "cannot notify the async IO loop");
-		return rc;
+		return _write_data_source_page(context, handle, data_source, NULL);
 	}
 	else
 	{
 		LOG_DEBUG("Sync write_callback called");
-		for(;;)
+
+		for(;has_region && region.size > 0;)
+		{
+			if(_send_file_region(handle->fd, &region) >= 0) continue;
+
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+				ERROR_RETURN_LOG_ERRNO(int, "Cannot send the file region");
+
+			if(ERROR_CODE(int) == _wait_writable(context, handle->fd))
+				ERROR_RETURN_LOG(int, "Cannot wait for the socket to drain");
+		}
+
+		for(;!has_region;)
 		{
 			int eos_rc = data_source.eos(data_source.data_handle);
 			if(ERROR_CODE(int) == eos_rc)
@@ -1454,6 +1824,8 @@ static itc_module_property_value_t _get_prop(void* __restrict ctx, const char* s
 	else if(strcmp(sym, "backlog") == 0) return _make_num(context->pool_conf.tcp_backlog);
 	else if(strcmp(sym, "ipv6") == 0) return _make_num(context->pool_conf.ipv6);
 	else if(strcmp(sym, "reuseaddr") == 0) return _make_num((long long)context->pool_conf.reuseaddr);
+	else if(strcmp(sym, "reuseport") == 0) return _make_num((long long)context->pool_conf.reuseport);
+	else if(strcmp(sym, "nodelay") == 0) return _make_num((long long)context->pool_conf.nodelay);
 	else if(strcmp(sym, "async_buf_size") == 0) return _make_num((long long)context->async_buf_size);
 	else if(strcmp(sym, "accept_retry_interval") == 0) return _make_num((long long)context->pool_conf.accept_retry_interval);
 	else if(strcmp(sym, "bindaddr") == 0) //*(const char**)data = context->pool_conf.bind_addr;
@@ -1471,6 +1843,25 @@ static itc_module_property_value_t _get_prop(void* __restrict ctx, const char* s
 
 		return ret;
 	}
+	else if(strcmp(sym, "steer") == 0 || strcmp(sym, "cpuset") == 0)
+	{
+		const char* str;
+		if(sym[0] == 's') str = context->pool_conf.steer == MODULE_TCP_POOL_STEER_CPU ? "cpu" : "none";
+		else str = context->pool_conf.cpuset == NULL ? "" : context->pool_conf.cpuset;
+
+		size_t len;
+		if(NULL == (ret.str = (char*)malloc(len = 1 + strlen(str))))
+		{
+			ret.type = ITC_MODULE_PROPERTY_TYPE_ERROR;
+			return ret;
+		}
+
+		memcpy(ret.str, str, len);
+
+		ret.type = ITC_MODULE_PROPERTY_TYPE_STRING;
+
+		return ret;
+	}
 	else if(strcmp(sym, "nforks") == 0)
 		return _make_num((long long)module_tcp_pool_num_forks(context->conn_pool));
 
@@ -1483,6 +1874,7 @@ static int _set_prop(void* __restrict ctx, const char* sym, itc_module_property_
 
 	/* TODO: this is weird, because it sounds like different module actually shares the same configuration */
 	static char bindaddr_buffer[128];
+	static char cpuset_buffer[128];
 	/* For a forked module, we don't allow any property change */
 	if(context->fork_id != 0) return 0;
 	if(value.type == ITC_MODULE_PROPERTY_TYPE_INT)
@@ -1495,6 +1887,8 @@ static int _set_prop(void* __restrict ctx, const char* sym, itc_module_property_
 		else if(strcmp(sym, "backlog") == 0) context->pool_conf.tcp_backlog = (int)value.num;
 		else if(strcmp(sym, "ipv6") == 0) context->pool_conf.ipv6 = (int)value.num;
 		else if(strcmp(sym, "reuseaddr") == 0) context->pool_conf.reuseaddr = (int)value.num;
+		else if(strcmp(sym, "reuseport") == 0) context->pool_conf.reuseport = (int)value.num;
+		else if(strcmp(sym, "nodelay") == 0) context->pool_conf.nodelay = (int)value.num;
 		else if(strcmp(sym, "accept_retry_interval") == 0) context->pool_conf.accept_retry_interval = (uint32_t)value.num;
 		else if(strcmp(sym, "async_buf_size") == 0)
 		{
@@ -1524,6 +1918,20 @@ static int _set_prop(void* __restrict ctx, const char* sym, itc_module_property_
 			bindaddr_buffer[sz] = 0;
 			context->pool_conf.bind_addr = bindaddr_buffer;
 		}
+		else if(strcmp(sym, "steer") == 0)
+		{
+			if(strcmp(value.str, "cpu") == 0) context->pool_conf.steer = MODULE_TCP_POOL_STEER_CPU;
+			else if(strcmp(value.str, "none") == 0) context->pool_conf.steer = MODULE_TCP_POOL_STEER_NONE;
+			else ERROR_RETURN_LOG(int, "Invalid steering program %s", value.str);
+		}
+		else if(strcmp(sym, "cpuset") == 0)
+		{
+			size_t sz = strlen(value.str);
+			if(sz >= sizeof(cpuset_buffer)) sz = sizeof(cpuset_buffer) - 1;
+			memcpy(cpuset_buffer, value.str, sz);
+			cpuset_buffer[sz] = 0;
+			context->pool_conf.cpuset = sz > 0 ? cpuset_buffer : NULL;
+		}
 		else return 0;
 	}
 	else return 0;
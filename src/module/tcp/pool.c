@@ -1,6 +1,7 @@
 /**
  * Copyright (C) 2017, Hao Hou
  **/
+#define _GNU_SOURCE
 
 #include <inttypes.h>
 #include <stdint.h>
@@ -11,6 +12,8 @@
 #include <string.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <pthread.h>
 
@@ -22,6 +25,11 @@
 #include <arch/arch.h>
 #include <os/os.h>
 
+#ifdef __LINUX__
+#	include <sched.h>
+#	include <linux/filter.h>
+#endif
+
 /**
  * @brief the message in the message queue
  **/
@@ -49,8 +57,20 @@ typedef struct {
 	time_t     ts;     /*!< the timestamp when last active */
 } _node_t;
 
+/**
+ * @brief the link of an inactive connection in the timing wheel
+ **/
+typedef struct {
+	uint32_t   prev;   /*!< the previous connection id in the same slot, ERROR_CODE(uint32_t) if this is the first one */
+	uint32_t   next;   /*!< the next connection id in the same slot, ERROR_CODE(uint32_t) if this is the last one */
+	uint32_t   slot;   /*!< the slot where the connection is linked */
+} _timer_t;
+
 /**
  * @brief the internal connection pool
+ * @note the inactive connections are tracked by a timing wheel, each slot of the wheel is the list of connections that
+ *       expires in the same second. Because all the inactive connections share the same TTL, a single level wheel which
+ *       covers the TTL is enough, and insert, remove and expire are all O(1)
  **/
 typedef struct {
 	bitmask_t*               bitmask;  /*!< the bitmask, a id allocator */
@@ -62,18 +82,22 @@ typedef struct {
 	uint32_t                 q_front;  /*!< the next queue message to process */
 	uint32_t                 q_rear;   /*!< the increment interger to identify the queue message */
 	union {
-		uint32_t             heap_limit;  /*!< range [0, heap_limit) in the connection array is used for the inactive heap */
+		uint32_t             inactive_limit;/*!< range [0, inactive_limit) in the connection array is used for the inactive connections */
 		uint32_t             active_start;/*!< this is also the active start */
 	};
 	union {
-		uint32_t             active_limit;/*!< range [heap_limit, active_limit) in the connection is used for the active connections */
+		uint32_t             active_limit;/*!< range [inactive_limit, active_limit) in the connection is used for the active connections */
 		uint32_t             wait_start;  /*!< the head of start list */
 	};
 	union {
-		uint32_t             wait_limit;  /*!< range [active_limit, heap_limit) in the connection is used for the waiting connections */
+		uint32_t             wait_limit;  /*!< range [active_limit, wait_limit) in the connection is used for the waiting connections */
 		uint32_t             nconnections;/*!< the number of connections */
 	};
 	_node_t*                 conn;        /*!< the connection array */
+	_timer_t*                timer;       /*!< the timing wheel links for the inactive connections, indexed by the connection id */
+	uint32_t*                wheel;       /*!< the timing wheel slots, each slot is the first connection id in the slot */
+	uint32_t                 wheel_mask;  /*!< the number of slots in the timing wheel - 1 */
+	time_t                   wheel_time;  /*!< the time of the first slot that hasn't been expired */
 } _conn_info_t;
 
 /**
@@ -86,6 +110,8 @@ struct _module_tcp_pool_t{
 	pthread_mutex_t             master_mutex; /*!< This mutex is used when the pool gets configured. It make sure that the master pool gets configured before forks */
 	pthread_cond_t              master_cond;  /*!< Used with master_mutex for event loop synchronization */
 	int                         num_forks;    /*!< How many forks module it have, master pool only */
+	int                         fork_idx;     /*!< The index of this pool among the master and all its forks, 0 for the master pool */
+	int*                        reuseport_fds;/*!< The listening sockets the master creates for each pool in reuseport mode, master pool only */
 	module_tcp_pool_t*          master;       /*!< The master pool is the onwer of the socket, NULL if this pool is the master */
 	module_tcp_pool_configure_t conf;         /*!< the module confiuration */
 	_conn_info_t                conn_info;    /*!< the connection info object */
@@ -104,9 +130,9 @@ struct _module_tcp_pool_t{
 static inline void _print_stat(const module_tcp_pool_t* pool)
 {
 	(void) pool;
-	LOG_DEBUG("\tHeap:          [%"PRIu32", %"PRIu32")", 0,                            pool->conn_info.heap_limit);
+	LOG_DEBUG("\tInactive:      [%"PRIu32", %"PRIu32")", 0,                            pool->conn_info.inactive_limit);
 	LOG_DEBUG("\tActive:        [%"PRIu32", %"PRIu32")", pool->conn_info.active_start, pool->conn_info.active_limit);
-	LOG_DEBUG("\tInactive:      [%"PRIu32", %"PRIu32")", pool->conn_info.wait_start,   pool->conn_info.wait_limit);
+	LOG_DEBUG("\tWait:          [%"PRIu32", %"PRIu32")", pool->conn_info.wait_start,   pool->conn_info.wait_limit);
 }
 /**
  * @brief release a connection object and close the corresponing FD
@@ -147,6 +173,16 @@ static inline int _release_connection_object(module_tcp_pool_t* pool, uint32_t i
 	LOG_INFO("Connection object %"PRIu32" has been closed", idx);
 	return rc;
 }
+/**
+ * @brief get the current timestamp
+ * @param pool the connection pool instance object
+ * @return the timestamp, which comes from the mocked time function if it's given
+ **/
+static inline time_t _now(const module_tcp_pool_t* pool)
+{
+	return NULL == pool->conf.time ? time(NULL) : pool->conf.time(NULL);
+}
+
 /**
  * @brief initialize the internal connection buffer
  * @param capacity the capacity (max number of connection can support simultaneously) of the pool
@@ -179,10 +215,26 @@ static inline int _init_conn_info(module_tcp_pool_t* pool, uint32_t capacity)
 
 	pool->conn_info.q_mask = q_size - 1;
 
+	/* The wheel should cover the entire TTL, so that every connection expires within one round */
+	uint32_t w_size = 1;
+	for(;w_size < MODULE_TCP_POOL_MAX_TIMER_WHEEL_SIZE && (time_t)w_size <= pool->conf.ttl; w_size <<= 1);
+
+	if(NULL == (pool->conn_info.timer = (_timer_t*)malloc(sizeof(_timer_t) * capacity)))
+		ERROR_RETURN_LOG(int, "cannot allocate the timer array for the connection pool");
+
+	if(NULL == (pool->conn_info.wheel = (uint32_t*)malloc(sizeof(uint32_t) * w_size)))
+		ERROR_RETURN_LOG(int, "cannot allocate the timing wheel");
+	else
+		LOG_DEBUG("allocate the timing wheel with %"PRIu32" slots", w_size);
+
+	memset(pool->conn_info.wheel, 0xff, sizeof(uint32_t) * w_size);
+	pool->conn_info.wheel_mask = w_size - 1;
+	pool->conn_info.wheel_time = _now(pool);
+
 	if((errno = pthread_mutex_init(&pool->conn_info.q_mutex, NULL)) != 0)
 		ERROR_RETURN_LOG_ERRNO(int, "cannot initialize the message queue mutex");
 
-	pool->conn_info.heap_limit = pool->conn_info.active_limit = pool->conn_info.wait_limit = 0;
+	pool->conn_info.inactive_limit = pool->conn_info.active_limit = pool->conn_info.wait_limit = 0;
 
 	return 0;
 
@@ -208,12 +260,18 @@ static inline int _finalize_conn_info(module_tcp_pool_t* pool)
 
 	if(NULL != pool->conn_info.queue) free(pool->conn_info.queue);
 
+	if(NULL != pool->conn_info.timer) free(pool->conn_info.timer);
+
+	if(NULL != pool->conn_info.wheel) free(pool->conn_info.wheel);
+
 	pthread_mutex_destroy(&pool->conn_info.q_mutex);
 
 	pool->conn_info.conn = NULL;
 	pool->conn_info.bitmask = NULL;
 	pool->conn_info.index = NULL;
 	pool->conn_info.queue = NULL;
+	pool->conn_info.timer = NULL;
+	pool->conn_info.wheel = NULL;
 
 	return rc;
 }
@@ -255,6 +313,7 @@ static inline module_tcp_pool_t* _pool_new(int master)
 
 	ret->poll_obj = NULL;
 	ret->event_fd = ERROR_CODE(int);
+	ret->socket_fd = ERROR_CODE(int);
 
 	/* Create the poll object  */
 	if(NULL == (ret->poll_obj = os_event_poll_new()))
@@ -298,7 +357,7 @@ module_tcp_pool_t* module_tcp_pool_fork(module_tcp_pool_t* pool)
 
 	ret->master = pool;
 
-	ret->master->num_forks ++;
+	ret->fork_idx = ++ ret->master->num_forks;
 
 	return ret;
 }
@@ -309,7 +368,17 @@ int module_tcp_pool_free(module_tcp_pool_t* pool)
 
 	int rc = _finalize_conn_info(pool);
 
-	if(pool->socket_fd >= 0 && pool->master == NULL) close(pool->socket_fd);
+	if(pool->socket_fd >= 0 && (pool->master == NULL || pool->conf.reuseport)) close(pool->socket_fd);
+
+	if(NULL != pool->reuseport_fds)
+	{
+		/* Close the sockets that haven't been taken by any forked pool */
+		int i;
+		for(i = 0; i <= pool->num_forks; i ++)
+			if(pool->reuseport_fds[i] >= 0)
+				close(pool->reuseport_fds[i]);
+		free(pool->reuseport_fds);
+	}
 
 	if(pool->event_fd >= 0) close(pool->event_fd);
 
@@ -335,8 +404,113 @@ int module_tcp_pool_num_forks(const module_tcp_pool_t* pool)
 	return pool->num_forks;
 }
 
+/**
+ * @brief create a listening socket based on the pool configuration
+ * @param pool the master pool object
+ * @return the socket FD or error code
+ **/
+static inline int _listen_socket(module_tcp_pool_t* pool)
+{
+	struct sockaddr* sockaddr;
+	socklen_t sockaddr_size;
+	int fd;
+
+	if(!pool->conf.ipv6)
+	{
+		if((fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot create socket for TCP pipe module");
+
+		pool->saddr.sin_family = AF_INET;
+		pool->saddr.sin_addr.s_addr = inet_addr(pool->conf.bind_addr);
+		pool->saddr.sin_port = htons(pool->conf.port);
+		sockaddr = (struct sockaddr*)&pool->saddr;
+		sockaddr_size = sizeof(struct sockaddr_in);
+	}
+	else
+	{
+		if(strcmp(pool->conf.bind_addr, "0.0.0.0") == 0)
+			pool->conf.bind_addr = "::";
+
+		if((fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP)) < 0)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot create socket for TCP pipe module");
+		pool->saddr6.sin6_family = AF_INET6;
+		pool->saddr6.sin6_port   = htons(pool->conf.port);
+		if(inet_pton(AF_INET6, pool->conf.bind_addr, &pool->saddr6.sin6_addr) < 0)
+			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot parse the ipv6 address %s", pool->conf.bind_addr);
+		sockaddr = (struct sockaddr*)&pool->saddr6;
+		sockaddr_size = sizeof(struct sockaddr_in6);
+	}
+
+	if(pool->conf.reuseaddr &&
+	   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char*)&pool->conf.reuseaddr, sizeof(pool->conf.reuseaddr)) < 0)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot set the reuseaddr option");
+
+	if(pool->conf.reuseport)
+	{
+#ifdef SO_REUSEPORT
+		int one = 1;
+		if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (char*)&one, sizeof(one)) < 0)
+			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot set the reuseport option");
+#else
+		ERROR_LOG_GOTO(ERR, "SO_REUSEPORT is not supported on this platform");
+#endif
+	}
+
+	if(_set_nonblock(fd) == ERROR_CODE(int))
+		ERROR_LOG_GOTO(ERR, "Cannot set the socket FD to non-blocking mode");
+
+	if(bind(fd, sockaddr, sockaddr_size) < 0)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot bind address");
+
+	if(listen(fd, pool->conf.tcp_backlog) < 0)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot listen TCP port %"PRIu16, pool->conf.port);
+
+	return fd;
+ERR:
+	close(fd);
+	return ERROR_CODE(int);
+}
+
+/**
+ * @brief attach the steering program to the reuseport group
+ * @param pool the master pool
+ * @param fd any socket in the reuseport group
+ * @return status code
+ **/
+static inline int _attach_steer_program(const module_tcp_pool_t* pool, int fd)
+{
+	if(pool->conf.steer == MODULE_TCP_POOL_STEER_NONE) return 0;
+
+#if defined(__LINUX__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	if(pool->conf.steer == MODULE_TCP_POOL_STEER_CPU)
+	{
+		/* The program returns the index of the socket in the group: cpu % number_of_sockets */
+		struct sock_filter code[] = {
+			{ BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+			{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)(pool->num_forks + 1) },
+			{ BPF_RET | BPF_A,           0, 0, 0 }
+		};
+		struct sock_fprog prog = {
+			.len    = sizeof(code) / sizeof(code[0]),
+			.filter = code
+		};
+
+		if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot attach the steering program to the reuseport group");
+
+		LOG_DEBUG("CPU steering program has been attached to the reuseport group of port %"PRIu16, pool->conf.port);
+		return 0;
+	}
+#endif
+
+	ERROR_RETURN_LOG(int, "Unsupported steering program %d", pool->conf.steer);
+}
+
 /**
  * @brief initialize the socket so that the connection pool will start listing to the socket
+ * @details In the reuseport mode, the master creates the sockets for all the forks in the order of
+ *          the fork index, so that the index of the socket in the reuseport group is the same as the
+ *          fork index, which is what the steering program relies on
  * @param pool the target pool object
  * @return status code
  **/
@@ -344,46 +518,29 @@ static inline int _init_socket(module_tcp_pool_t* pool)
 {
 	if(pool->master == NULL)
 	{
-		struct sockaddr* sockaddr;
-		socklen_t sockaddr_size;
-		if(!pool->conf.ipv6)
-		{
-			if((pool->socket_fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
-				ERROR_LOG_ERRNO_GOTO(ERR, "Cannot create socket for TCP pipe module");
-
-			pool->saddr.sin_family = AF_INET;
-			pool->saddr.sin_addr.s_addr = inet_addr(pool->conf.bind_addr);
-			pool->saddr.sin_port = htons(pool->conf.port);
-			sockaddr = (struct sockaddr*)&pool->saddr;
-			sockaddr_size = sizeof(struct sockaddr_in);
-		}
-		else
+		if(pool->conf.reuseport)
 		{
-			if(strcmp(pool->conf.bind_addr, "0.0.0.0") == 0)
-				pool->conf.bind_addr = "::";
-
-			if((pool->socket_fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP)) < 0)
-				ERROR_LOG_ERRNO_GOTO(ERR, "Cannot create socket for TCP pipe module");
-			pool->saddr6.sin6_family = AF_INET6;
-			pool->saddr6.sin6_port   = htons(pool->conf.port);
-			if(inet_pton(AF_INET6, pool->conf.bind_addr, &pool->saddr6.sin6_addr) < 0)
-				ERROR_LOG_ERRNO_GOTO(ERR, "Cannot parse the ipv6 address %s", pool->conf.bind_addr);
-			sockaddr = (struct sockaddr*)&pool->saddr6;
-			sockaddr_size = sizeof(struct sockaddr_in6);
-		}
+			int i;
+			if(NULL == (pool->reuseport_fds = (int*)malloc(sizeof(int) * (size_t)(pool->num_forks + 1))))
+				ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the reuseport socket list");
+
+			for(i = 0; i <= pool->num_forks; i ++)
+				pool->reuseport_fds[i] = ERROR_CODE(int);
 
-		if(pool->conf.reuseaddr &&
-		   setsockopt(pool->socket_fd, SOL_SOCKET, SO_REUSEADDR, (char*)&pool->conf.reuseaddr, sizeof(pool->conf.reuseaddr)) < 0)
-			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot set the reuseaddr option");
+			for(i = 0; i <= pool->num_forks; i ++)
+				if(ERROR_CODE(int) == (pool->reuseport_fds[i] = _listen_socket(pool)))
+					ERROR_LOG_GOTO(ERR, "Cannot create the listening socket for event loop #%d", i);
 
-		if(_set_nonblock(pool->socket_fd) == ERROR_CODE(int))
-			ERROR_LOG_GOTO(ERR, "Cannot set the socket FD to non-blocking mode");
+			if(ERROR_CODE(int) == _attach_steer_program(pool, pool->reuseport_fds[0]))
+				ERROR_LOG_GOTO(ERR, "Cannot attach the steering program");
 
-		if(bind(pool->socket_fd, sockaddr, sockaddr_size) < 0)
-			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot bind address");
+			pool->socket_fd = pool->reuseport_fds[0];
+			pool->reuseport_fds[0] = ERROR_CODE(int);
 
-		if(listen(pool->socket_fd, pool->conf.tcp_backlog) < 0)
-			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot listen TCP port %"PRIu16, pool->conf.port);
+			LOG_INFO("%d SO_REUSEPORT listening sockets have been created on port %"PRIu16, pool->num_forks + 1, pool->conf.port);
+		}
+		else if(ERROR_CODE(int) == (pool->socket_fd = _listen_socket(pool)))
+			ERROR_LOG_GOTO(ERR, "Cannot create the listening socket");
 	}
 	else
 	{
@@ -391,7 +548,14 @@ static inline int _init_socket(module_tcp_pool_t* pool)
 			pool->saddr6 = pool->master->saddr6;
 		else
 			pool->saddr = pool->master->saddr;
-		pool->socket_fd = pool->master->socket_fd;
+
+		if(pool->conf.reuseport)
+		{
+			/* Each fork has its own slot, so we don't need any lock at this point */
+			pool->socket_fd = pool->master->reuseport_fds[pool->fork_idx];
+			pool->master->reuseport_fds[pool->fork_idx] = ERROR_CODE(int);
+		}
+		else pool->socket_fd = pool->master->socket_fd;
 	}
 
 	os_event_desc_t event = {
@@ -409,11 +573,78 @@ static inline int _init_socket(module_tcp_pool_t* pool)
 	LOG_DEBUG("TCP Socket has been initialized on %s:%"PRIu16, pool->conf.bind_addr, pool->conf.port);
 	return 0;
 ERR:
-	if(pool->socket_fd >= 0 && pool->master == NULL) close(pool->socket_fd);
+	if(pool->socket_fd >= 0 && (pool->master == NULL || pool->conf.reuseport)) close(pool->socket_fd);
 	pool->socket_fd = ERROR_CODE(int);
+	if(pool->master == NULL && NULL != pool->reuseport_fds)
+	{
+		int i;
+		for(i = 0; i <= pool->num_forks; i ++)
+			if(pool->reuseport_fds[i] >= 0)
+				close(pool->reuseport_fds[i]);
+		free(pool->reuseport_fds);
+		pool->reuseport_fds = NULL;
+	}
 	return ERROR_CODE(int);
 }
 
+/**
+ * @brief pin the caller event loop to the CPU assigned to this pool
+ * @details The cpuset is a list of CPU ids or ranges, e.g. "0-3,8". The pool with fork index N
+ *          is pinned to the N-th CPU in the list (wrapping around if there are more event loops
+ *          than CPUs)
+ * @param pool the pool object
+ * @return status code
+ **/
+static inline int _pin_event_loop(const module_tcp_pool_t* pool)
+{
+	if(NULL == pool->conf.cpuset) return 0;
+
+	uint32_t cpus[1024];
+	uint32_t ncpus = 0;
+	const char* ptr = pool->conf.cpuset;
+
+	while(*ptr)
+	{
+		char* end;
+		unsigned long begin = strtoul(ptr, &end, 10);
+		unsigned long last = begin;
+		if(end == ptr) ERROR_RETURN_LOG(int, "Invalid cpuset %s", pool->conf.cpuset);
+		ptr = end;
+
+		if(*ptr == '-')
+		{
+			last = strtoul(ptr + 1, &end, 10);
+			if(end == ptr + 1 || last < begin) ERROR_RETURN_LOG(int, "Invalid cpuset %s", pool->conf.cpuset);
+			ptr = end;
+		}
+
+		if(*ptr == ',') ptr ++;
+		else if(*ptr != 0) ERROR_RETURN_LOG(int, "Invalid cpuset %s", pool->conf.cpuset);
+
+		for(; begin <= last && ncpus < sizeof(cpus) / sizeof(cpus[0]); begin ++)
+			cpus[ncpus ++] = (uint32_t)begin;
+	}
+
+	if(ncpus == 0) return 0;
+
+	uint32_t cpu = cpus[(uint32_t)pool->fork_idx % ncpus];
+
+#ifdef __LINUX__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	if((errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot pin the event loop #%d to CPU %u", pool->fork_idx, cpu);
+
+	LOG_INFO("The event loop #%d of port %"PRIu16" has been pinned to CPU %u", pool->fork_idx, pool->conf.port, cpu);
+#else
+	LOG_WARNING("CPU affinity is not supported on this platform, ignore the cpuset (CPU %u)", cpu);
+#endif
+
+	return 0;
+}
+
 int module_tcp_pool_configure(module_tcp_pool_t* pool, const module_tcp_pool_configure_t* conf)
 {
 	if(NULL == pool || (NULL == conf && pool->master == NULL))
@@ -481,6 +712,10 @@ SLAVE_ERR:
 
 CONT:
 
+	/* This is called from the event loop thread, so it's the right place to set the affinity */
+	if(_pin_event_loop(pool) == ERROR_CODE(int))
+		LOG_WARNING("Cannot pin the event loop to the CPU, continue without CPU affinity");
+
 	if(_init_conn_info(pool, pool->conf.size) == ERROR_CODE(int)) goto ERR;
 
 	return 0;
@@ -508,39 +743,67 @@ static inline void _swap(module_tcp_pool_t* pool, uint32_t a, uint32_t b)
 	pool->conn_info.index[pool->conn_info.conn[b].id] = b;
 }
 /**
- * @brief adjustment to keep the heap property in the heap
- * @param idx the index in the *connection list*
+ * @brief link the inactive connection to the timing wheel
  * @param pool the connection pool instance object
+ * @param id the connection object id
+ * @param expire the time when the connection expires
  * @return nothing
  **/
-static inline void _heapify(module_tcp_pool_t* pool, uint32_t idx)
+static inline void _timer_add(module_tcp_pool_t* pool, uint32_t id, time_t expire)
 {
-	for(;idx < pool->conn_info.heap_limit;)
-	{
-		uint32_t min_idx = idx;
-		if(idx * 2 + 1 < pool->conn_info.heap_limit && pool->conn_info.conn[idx * 2 + 1].ts < pool->conn_info.conn[min_idx].ts)
-			min_idx = idx * 2 + 1;
-		if(idx * 2 + 2 < pool->conn_info.heap_limit && pool->conn_info.conn[idx * 2 + 2].ts < pool->conn_info.conn[min_idx].ts)
-			min_idx = idx * 2 + 2;
-		if(idx == min_idx) break;
-		_swap(pool, idx, min_idx);
-		idx = min_idx;
-	}
+	/* The slots before wheel_time has been expired already, so put it in the next slot to expire */
+	if(expire < pool->conn_info.wheel_time)
+		expire = pool->conn_info.wheel_time;
+
+	uint32_t slot = (uint32_t)expire & pool->conn_info.wheel_mask;
+	uint32_t head = pool->conn_info.wheel[slot];
+
+	pool->conn_info.timer[id].prev = ERROR_CODE(uint32_t);
+	pool->conn_info.timer[id].next = head;
+	pool->conn_info.timer[id].slot = slot;
+
+	if(ERROR_CODE(uint32_t) != head)
+		pool->conn_info.timer[head].prev = id;
+
+	pool->conn_info.wheel[slot] = id;
 }
 
 /**
- * @brief upward adjustment for heap
- * @param idx the index in the *connectin list*
+ * @brief unlink the connection from the timing wheel
  * @param pool the connection pool instance object
+ * @param id the connection object id
  * @return nothing
  **/
-static inline void _decrease(module_tcp_pool_t* pool, uint32_t idx)
+static inline void _timer_remove(module_tcp_pool_t* pool, uint32_t id)
 {
-	for(;idx > 0 && pool->conn_info.conn[(idx - 1) / 2].ts > pool->conn_info.conn[idx].ts; idx = (idx - 1) / 2)
-		_swap(pool, idx, (idx - 1) / 2);
+	const _timer_t* timer = pool->conn_info.timer + id;
+
+	if(ERROR_CODE(uint32_t) != timer->prev)
+		pool->conn_info.timer[timer->prev].next = timer->next;
+	else
+		pool->conn_info.wheel[timer->slot] = timer->next;
+
+	if(ERROR_CODE(uint32_t) != timer->next)
+		pool->conn_info.timer[timer->next].prev = timer->prev;
 }
 
-//TODO: remodel this
+/**
+ * @brief get the time of the first non-empty slot in the timing wheel
+ * @note this should be called only when there's inactive connection
+ * @param pool the connection pool instance object
+ * @return the time of the slot
+ **/
+static inline time_t _timer_next_expire(const module_tcp_pool_t* pool)
+{
+	time_t ret = pool->conn_info.wheel_time;
+	uint32_t i;
+
+	for(i = 0; i <= pool->conn_info.wheel_mask; i ++, ret ++)
+		if(ERROR_CODE(uint32_t) != pool->conn_info.wheel[(uint32_t)ret & pool->conn_info.wheel_mask])
+			break;
+
+	return ret;
+}
 
 /**
  * @brief close a connection and release the connection object in the connection list
@@ -560,10 +823,11 @@ static inline int _connection_close(module_tcp_pool_t* pool, uint32_t idx)
 	if(bitmask_dealloc(pool->conn_info.bitmask, pool->conn_info.conn[idx].id) == ERROR_CODE(int))
 		LOG_WARNING("Cannot deallocate the used connection object index %"PRIu32, pool->conn_info.conn[idx].id);
 
-	/* If this index is in the range of inactive heap, remove it from the inactive heap first */
-	if(idx < pool->conn_info.heap_limit)
+	/* If this index is in the range of inactive list, remove it from the inactive list and the timing wheel first */
+	if(idx < pool->conn_info.inactive_limit)
 	{
-		pool->conn_info.conn[idx] = pool->conn_info.conn[--pool->conn_info.heap_limit];
+		_timer_remove(pool, pool->conn_info.conn[idx].id);
+		pool->conn_info.conn[idx] = pool->conn_info.conn[--pool->conn_info.inactive_limit];
 		/**
 		 * We actually do not swap the connection objects. Instead we override the released
 		 * connection object with the list item in this segment.
@@ -577,22 +841,20 @@ static inline int _connection_close(module_tcp_pool_t* pool, uint32_t idx)
 		 * actually a place holder). If this is true, the data in the connection object is not defined, so
 		 * we just ignore it.
 		 *
-		 * It's Ok to perform heapify in this case, because the place hold is out of the range of heap.
-		 *
 		 * Here's an example for a bug senario if we do not check this:
-		 * 		Heap         [1,2,3]
+		 * 		Inactive     [1,2,3]
 		 * 		Active       []
-		 * 		Inactive     [4,5]
+		 * 		Wait         [4,5]
 		 * 		Index        [1,2,3,4,5]
 		 *
 		 * And we are going to delete 2
-		 * * Step 1: delete 3 from the heap
-		 *     Heap          [1,3]
+		 * * Step 1: delete 3 from the inactive list
+		 *     Inactive      [1,3]
 		 *     Active        [3]
-		 *     Inactive      [5]
+		 *     Wait          [5]
 		 *     Index         [1,2,2,4,5]
-		 * * Step 2: delete "3" from the Inactive
-		 *     Heap          [1,3]
+		 * * Step 2: delete "3" from the Wait
+		 *     Inactive      [1,3]
 		 *     Active        []
 		 *     Index         [3,5]
 		 *     Index         [1,2,3,4,5]   //Bug here, because we set index[idx], which is actually the place holder
@@ -600,12 +862,11 @@ static inline int _connection_close(module_tcp_pool_t* pool, uint32_t idx)
 		 * But this only happens we we do not fully swap the connection object, so we need check if the place holder is
 		 * in this place
 		 **/
-		if(pool->conn_info.heap_limit > idx) pool->conn_info.index[pool->conn_info.conn[idx].id] = idx;
-		_heapify(pool, idx);
+		if(pool->conn_info.inactive_limit > idx) pool->conn_info.index[pool->conn_info.conn[idx].id] = idx;
 		idx = pool->conn_info.active_start;
 	}
 
-	/* At this point, we are able to assume that the index to delete is out of the range of inactive heap,
+	/* At this point, we are able to assume that the index to delete is out of the range of inactive list,
 	 * If this index is in the range of active list, remove it from the active list */
 	if(idx < pool->conn_info.active_limit)
 	{
@@ -624,26 +885,64 @@ static inline int _connection_close(module_tcp_pool_t* pool, uint32_t idx)
 	return 0;
 }
 /**
- * @brief activate means move the connection from inactive heap to wait list
+ * @brief close all the inactive connections that has been expired
+ * @details we walk through all the slots that hasn't been expired up to now, since the slot may contain the connection
+ *          that expires in the later round of the wheel, we should check the timestamp before we close the connection
+ * @param pool the connection pool instance object
+ * @param now the current timestamp
+ * @return nothing
+ **/
+static inline void _timer_expire(module_tcp_pool_t* pool, time_t now)
+{
+	time_t t = pool->conn_info.wheel_time;
+
+	/* If we haven't expire any slot for more than one round, we only need to walk through the wheel once */
+	if(now - t > (time_t)pool->conn_info.wheel_mask)
+		t = now - (time_t)pool->conn_info.wheel_mask;
+
+	for(; t <= now; t ++)
+	{
+		uint32_t id = pool->conn_info.wheel[(uint32_t)t & pool->conn_info.wheel_mask];
+		while(ERROR_CODE(uint32_t) != id)
+		{
+			uint32_t next = pool->conn_info.timer[id].next;
+			uint32_t idx = pool->conn_info.index[id];
+
+			if(pool->conn_info.conn[idx].ts + pool->conf.ttl <= now)
+			{
+				LOG_DEBUG("closing timed out connection %d", pool->conn_info.conn[idx].fd);
+				_connection_close(pool, idx);
+			}
+
+			id = next;
+		}
+	}
+
+	if(pool->conn_info.wheel_time <= now)
+		pool->conn_info.wheel_time = now + 1;
+}
+
+/**
+ * @brief activate means move the connection from inactive list to wait list
  * @param idx the index in the *connection list*
  * @param pool the connection pool instance object
  * @return status code
  **/
 static inline int _connection_activate(module_tcp_pool_t* pool, uint32_t idx)
 {
-	if(idx >= pool->conn_info.heap_limit)
+	if(idx >= pool->conn_info.inactive_limit)
 	{
 		_print_stat(pool);
-		ERROR_RETURN_LOG(int, "Invalid argument connection object index %"PRIu32" is out of the heap_limit", idx);
+		ERROR_RETURN_LOG(int, "Invalid argument connection object index %"PRIu32" is out of the inactive_limit", idx);
 	}
 
 	/** Remove it from the poll_obj's list, so that it won't trigger poll awake since then */
 	if(ERROR_CODE(int) == os_event_poll_del(pool->poll_obj, pool->conn_info.conn[idx].fd, 1))
 		ERROR_RETURN_LOG(int, "Cannot remove the connection object %"PRIu32" from the poll object list", pool->conn_info.conn[idx].id);
 
-	/* Remove it from the inactive heap */
-	_swap(pool, idx, --pool->conn_info.heap_limit);
-	_heapify(pool, idx);
+	/* Remove it from the inactive list */
+	_timer_remove(pool, pool->conn_info.conn[idx].id);
+	_swap(pool, idx, --pool->conn_info.inactive_limit);
 
 	/* Swap it to the wait list */
 	_swap(pool, pool->conn_info.active_start, --pool->conn_info.active_limit);
@@ -684,7 +983,7 @@ static inline int _connection_checkin(module_tcp_pool_t* pool, uint32_t idx)
 	return 0;
 }
 /**
- * @brief deactivate means we move the connection from atcive list to inactive heap
+ * @brief deactivate means we move the connection from atcive list to inactive list
  * @param idx the index in the *connection list*
  * @param now the current timestamp
  * @param pool the connection pool instance object
@@ -726,9 +1025,9 @@ static inline int _connection_deactivate(module_tcp_pool_t* pool, uint32_t idx,
 
 	pool->conn_info.conn[idx].ts = now;
 
-	_swap(pool, idx, pool->conn_info.active_start ++);
+	_timer_add(pool, pool->conn_info.conn[idx].id, now + pool->conf.ttl);
 
-	_decrease(pool, pool->conn_info.heap_limit - 1);
+	_swap(pool, idx, pool->conn_info.active_start ++);
 
 	return rc;
 }
@@ -804,6 +1103,9 @@ static inline int _accpet_request(module_tcp_pool_t* pool, time_t now)
 			goto ERR;
 		}
 
+		if(pool->conf.nodelay && setsockopt(data_fd, IPPROTO_TCP, TCP_NODELAY, (char*)&pool->conf.nodelay, sizeof(pool->conf.nodelay)) < 0)
+			LOG_WARNING_ERRNO("cannot disable the Nagle's algorithm for the incoming FD");
+
 		/* Make a new connection object */
 		pool->conn_info.conn[pool->conn_info.nconnections].ts = now;
 		pool->conn_info.conn[pool->conn_info.nconnections].fd = data_fd;
@@ -813,12 +1115,12 @@ static inline int _accpet_request(module_tcp_pool_t* pool, time_t now)
 		pool->conn_info.wait_limit ++;
 
 		/* The new incoming request should not be in waiting list, because it may connect but no data
-		 * The sane way to handle this is adding it to heap and let next poll wake it up */
+		 * The sane way to handle this is adding it to inactive list and let next poll wake it up */
 		_swap(pool, pool->conn_info.wait_limit - 1, pool->conn_info.wait_start ++);
 		_swap(pool, pool->conn_info.active_limit - 1, pool->conn_info.active_start ++);
-		_decrease(pool, pool->conn_info.heap_limit - 1);
+		_timer_add(pool, id, now + pool->conf.ttl);
 
-		/* Because it should be in the heap, so add it to poll queue */
+		/* Because it should be in the inactive list, so add it to poll queue */
 		os_event_desc_t event = {
 			.type = OS_EVENT_TYPE_KERNEL,
 			.kernel = {
@@ -967,18 +1269,19 @@ static inline int _queue_message_exec(module_tcp_pool_t* pool, time_t now)
 }
 /**
  * @brief this function poll the event, and check out all the
- *        active connections and move them at the end of the heap
+ *        active connections and move them at the end of the inactive list
  **/
 static inline int _poll_event(module_tcp_pool_t* pool)
 {
 	/* Determine the max time for this poll call to wait */
-	time_t   now = time(NULL);
+	time_t   now = _now(pool);
 	time_t   time_to_sleep = 0;
-	if(pool->conn_info.heap_limit > 0)
+	if(pool->conn_info.inactive_limit > 0)
 	{
+		time_t next_expire = _timer_next_expire(pool);
 		time_to_sleep = pool->conf.min_timeout;
-		if(pool->conn_info.conn[0].ts + pool->conf.ttl >= now + time_to_sleep)
-			time_to_sleep = pool->conn_info.conn[0].ts + pool->conf.ttl - now;
+		if(next_expire >= now + time_to_sleep)
+			time_to_sleep = next_expire - now;
 	}
 
 	int timeout = (time_to_sleep > 0) ? (int)time_to_sleep * 1000 : -1;
@@ -999,6 +1302,9 @@ static inline int _poll_event(module_tcp_pool_t* pool)
 
 	if(pool->unaccepted_conn) incoming = 1;
 
+	/* The poll may have been blocked for a while, so the timestamps of the connections should use the time after the wait */
+	now = _now(pool);
+
 	if(result == ERROR_CODE(int))
 		ERROR_RETURN_LOG_ERRNO(int, "Cannot poll event");
 	else
@@ -1032,8 +1338,7 @@ static inline int _poll_event(module_tcp_pool_t* pool)
 	}
 
 	/* kick the timeout client out */
-	for(;pool->conn_info.heap_limit > 0 && pool->conn_info.conn[0].ts + pool->conf.ttl <= now; _connection_close(pool, 0))
-		LOG_DEBUG("closing timed out connection %d", pool->conn_info.conn[0].fd);
+	_timer_expire(pool, now);
 
 	/* Process incoming request */
 	if(incoming)
@@ -1109,7 +1414,7 @@ static inline int _init_connection_release_message(module_tcp_pool_t* pool, _que
 	switch(mode)
 	{
 		case MODULE_TCP_POOL_RELEASE_MODE_WAIT_FOR_DATA:
-			LOG_DEBUG("QM#%"PRIu32": deactivate the connection object %"PRIu32" from active list to inactive heap", pool->conn_info.q_rear, id);
+			LOG_DEBUG("QM#%"PRIu32": deactivate the connection object %"PRIu32" from active list to inactive list", pool->conn_info.q_rear, id);
 			msg->type = _QM_DEACTIVATE;
 			msg->id   = id;
 			msg->data = data;
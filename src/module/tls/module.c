@@ -125,6 +125,7 @@ struct _module_context_t{
 #endif
 	itc_module_type_t              transport_mod; /*!< the transportation layer module type */
 	uint32_t                       async_write;   /*!< indicates if we want to enable the asnyc write in the transportation layer */
+	uint32_t                       slave_mode;    /*!< the slave mode, which means the module doesn't start the event loop */
 	mempool_objpool_t*             tls_pool;      /*!< the SSL context pool */
 };
 
@@ -252,7 +253,7 @@ static inline int _thread_finalize(void)
 /**
  * @brief the initialization function of the TLS module
  * @details the initialization argument should look like <br/>
- *          <code>insmod "tls_pipe cert=cert.pem key=key.pem module.tcp.port_433";</code>
+ *          <code>insmod "tls_pipe [--slave] cert=cert.pem key=key.pem module.tcp.port_433";</code>
  * @param ctx the context buffer
  * @param argc the argument count
  * @param argv the argument value
@@ -271,11 +272,15 @@ static int _init(void* __restrict ctx, uint32_t argc, char const* __restrict con
 	static const char cert_prefix[] = "cert=";
 	static const char pkey_prefix[] = "key=";
 
+	context->slave_mode = 0;
+
 	uint32_t i;
 	for(i = 0; i < argc; i ++)
 	{
 		char const* param = argv[i];
-		if(_match(param, cert_prefix))
+		if(strcmp(param, "--slave") == 0)
+			context->slave_mode = 1;
+		else if(_match(param, cert_prefix))
 			cert_file = param + sizeof(cert_prefix) - 1;
 		else if(_match(param, pkey_prefix))
 			pkey_file = param + sizeof(pkey_prefix) - 1;
@@ -285,7 +290,7 @@ static int _init(void* __restrict ctx, uint32_t argc, char const* __restrict con
 	LOG_DEBUG("Initialize OpenSSL with Certification %s and Private Key %s", cert_file, pkey_file);
 
 	if(argc - i != 1) ERROR_RETURN_LOG(int, "Invalid module init args, should be"
-		                                    "tls_pipe [cert=<CERT>] [key=<PKEY>] <trans-module-path>");
+		                                    "tls_pipe [--slave] [cert=<CERT>] [key=<PKEY>] <trans-module-path>");
 
 	/* Find the transportation layer module */
 	if(ERROR_CODE(itc_module_type_t) == (context->transport_mod = itc_modtab_get_module_type_from_path(argv[i])))
@@ -1084,7 +1089,8 @@ static const char* _get_path(void* __restrict ctx, char* buf, size_t sz)
  **/
 static itc_module_flags_t _get_flags(void* __restrict ctx)
 {
-	(void)ctx;
+	_module_context_t* context = (_module_context_t*)ctx;
+	if(context->slave_mode) return 0;
 	return ITC_MODULE_FLAGS_EVENT_LOOP;
 }
 
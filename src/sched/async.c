@@ -45,6 +45,7 @@
 
 #include <sched/rscope.h>
 #include <sched/service.h>
+#include <sched/trace.h>
 #include <sched/task.h>
 #include <sched/async.h>
 
@@ -329,12 +330,16 @@ UNLOCK:
 		if(thread_data->task == NULL) continue;
 
 		LOG_DEBUG("Staring the async exec task");
+		sched_trace_id_t trace_id = thread_data->task->sched_task->trace_id;
+		sched_service_node_id_t trace_node = thread_data->task->sched_task->node;
+		uint64_t trace_ts = sched_trace_begin(trace_id);
 		if(ERROR_CODE(int) == runtime_task_start(thread_data->task->exec_task))
 		{
 			thread_data->task->status_code = ERROR_CODE(int);;
 			LOG_ERROR("The async exec task returns an error");
 		}
 		else thread_data->task->status_code = 0;
+		sched_trace_end(trace_id, SCHED_TRACE_SPAN_ASYNC_EXEC, trace_node, trace_ts);
 
 		if(thread_data->task->await_id == ERROR_CODE(uint32_t))
 			thread_data->task->state = _STATE_DONE;
@@ -657,13 +662,20 @@ int sched_async_task_post(sched_loop_t* loop, sched_task_t* task)
 
 	task->exec_task->async_handle = (runtime_api_async_handle_t*)handle;
 
+	uint64_t trace_ts = sched_trace_begin(task->trace_id);
+
 	/* After that we need to call the async_setup function to get this initialized */
 #ifdef FULL_OPTIMIZATION
 	if(ERROR_CODE(int) == runtime_task_start_async_setup_fast(task->exec_task))
 #else
 		if(ERROR_CODE(int) == runtime_task_start(task->exec_task))
 #endif
+		{
+			sched_trace_end(task->trace_id, SCHED_TRACE_SPAN_ASYNC_SETUP, task->node, trace_ts);
 			ERROR_LOG_GOTO(ERR, "The async setup task returns an error code");
+		}
+
+	sched_trace_end(task->trace_id, SCHED_TRACE_SPAN_ASYNC_SETUP, task->node, trace_ts);
 
 	/* Ok it seems the task has been successfully setup, construct its continuation at this point */
 	if(ERROR_CODE(int) == runtime_task_async_companions(task->exec_task, &async_exec, &async_cleanup))
@@ -25,6 +25,7 @@
 #include <utils/log.h>
 #include <utils/static_assertion.h>
 #include <utils/thread.h>
+#include <utils/mempool/acct.h>
 
 #include <itc/module_types.h>
 #include <itc/module.h>
@@ -39,6 +40,7 @@
 #include <sched/service.h>
 #include <sched/loop.h>
 #include <sched/daemon.h>
+#include <sched/prof.h>
 
 /**
  * @brief The actual data strcuture for the daemon info iterator
@@ -54,6 +56,8 @@ typedef enum {
 	_DAEMON_PING,    /*!< Ping a daemon */
 	_DAEMON_STOP,    /*!< Stop current daemon */
 	_DAEMON_RELOAD,  /*!< Reload current daemon */
+	_DAEMON_MEMORY,  /*!< Get the memory accounting report of current daemon */
+	_DAEMON_PROFILE, /*!< Get the profiler histogram report of current daemon */
 	_DAEMON_OP_COUNT /*!< The number of deamon operations */
 } _daemon_op_t;
 
@@ -63,7 +67,9 @@ typedef enum {
 static const size_t _daemon_op_data_size[_DAEMON_OP_COUNT] = {
 	[_DAEMON_STOP] = 0,
 	[_DAEMON_PING] = 0,
-	[_DAEMON_RELOAD] = 0
+	[_DAEMON_RELOAD] = 0,
+	[_DAEMON_MEMORY] = sizeof(uint32_t),
+	[_DAEMON_PROFILE] = 0
 };
 
 
@@ -244,6 +250,179 @@ static lang_prop_value_t _get_prop(const char* symbol, const void* param)
 	return ret;
 }
 
+/**
+ * @brief get the memory accounting properties
+ * @details the symbol "snapshot" and "delta" returns the report string, and "<pool>.<field>" returns the
+ *          field of the statistics of the pool, the field can be in_use, cached, high_watermark, allocs and frees
+ * @param symbol the symbol
+ * @param param not used
+ * @return the property value
+ **/
+static lang_prop_value_t _get_memory_prop(const char* symbol, const void* param)
+{
+	(void)param;
+	lang_prop_value_t ret = {
+		.type = LANG_PROP_TYPE_NONE
+	};
+
+	if(strcmp(symbol, "snapshot") == 0 || strcmp(symbol, "delta") == 0)
+	{
+		if(NULL == (ret.str = mempool_acct_report(strcmp(symbol, "delta") == 0)))
+		{
+			LOG_ERROR("Cannot produce the memory accounting report");
+			ret.type = LANG_PROP_TYPE_ERROR;
+			return ret;
+		}
+		ret.type = LANG_PROP_TYPE_STRING;
+		return ret;
+	}
+
+	const char* field = strrchr(symbol, '.');
+	if(NULL == field) return ret;
+
+	char name[128];
+	if((size_t)(field - symbol) >= sizeof(name)) return ret;
+	memcpy(name, symbol, (size_t)(field - symbol));
+	name[field - symbol] = 0;
+	field ++;
+
+	mempool_acct_stat_t stat;
+	int rc = mempool_acct_query(name, &stat);
+	if(ERROR_CODE(int) == rc)
+	{
+		LOG_ERROR("Cannot query the memory accounting entry %s", name);
+		ret.type = LANG_PROP_TYPE_ERROR;
+		return ret;
+	}
+	if(rc == 0) return ret;
+
+	uint64_t value;
+	if(strcmp(field, "in_use") == 0) value = stat.in_use;
+	else if(strcmp(field, "cached") == 0) value = stat.cached;
+	else if(strcmp(field, "high_watermark") == 0) value = stat.high_watermark;
+	else if(strcmp(field, "allocs") == 0) value = stat.allocs;
+	else if(strcmp(field, "frees") == 0) value = stat.frees;
+	else return ret;
+
+	ret.type = LANG_PROP_TYPE_INTEGER;
+	ret.num = (int64_t)value;
+	return ret;
+}
+
+/**
+ * @brief the names of the asynchronous logging policies
+ **/
+static const char* const _log_async_policy_name[] = {
+	[LOG_ASYNC_OFF]   = "off",
+	[LOG_ASYNC_DROP]  = "drop",
+	[LOG_ASYNC_BLOCK] = "block"
+};
+
+/**
+ * @brief set the logging properties
+ * @param symbol the symbol
+ * @param value the value
+ * @param data not used
+ * @return 1 if the property is set, 0 if the symbol is not recognized, or error code
+ **/
+static int _set_log_prop(const char* symbol, lang_prop_value_t value, const void* data)
+{
+	(void)data;
+	if(strcmp(symbol, "async") == 0)
+	{
+		if(value.type != LANG_PROP_TYPE_STRING) ERROR_RETURN_LOG(int, "Type mismatch");
+
+		uint32_t i;
+		for(i = 0; i < sizeof(_log_async_policy_name) / sizeof(_log_async_policy_name[0]); i ++)
+			if(strcmp(value.str, _log_async_policy_name[i]) == 0)
+				break;
+
+		if(i == sizeof(_log_async_policy_name) / sizeof(_log_async_policy_name[0]))
+			ERROR_RETURN_LOG(int, "Invalid asynchronous logging policy %s", value.str);
+
+		if(ERROR_CODE(int) == log_set_async((log_async_policy_t)i))
+			ERROR_RETURN_LOG(int, "Cannot set the asynchronous logging policy");
+	}
+	else return 0;
+	return 1;
+}
+
+/**
+ * @brief get the logging properties
+ * @param symbol the symbol
+ * @param param not used
+ * @return the property value
+ **/
+static lang_prop_value_t _get_log_prop(const char* symbol, const void* param)
+{
+	(void)param;
+	lang_prop_value_t ret = {
+		.type = LANG_PROP_TYPE_NONE
+	};
+
+	if(strcmp(symbol, "async") == 0)
+	{
+		if(NULL == (ret.str = strdup(_log_async_policy_name[log_get_async()])))
+		{
+			LOG_ERROR_ERRNO("Cannot allocate memory for the policy name");
+			ret.type = LANG_PROP_TYPE_ERROR;
+			return ret;
+		}
+		ret.type = LANG_PROP_TYPE_STRING;
+		return ret;
+	}
+
+	log_async_stat_t stat;
+	if(ERROR_CODE(int) == log_async_stat(&stat))
+	{
+		LOG_ERROR("Cannot get the asynchronous logging counters");
+		ret.type = LANG_PROP_TYPE_ERROR;
+		return ret;
+	}
+
+	if(strcmp(symbol, "written") == 0) ret.num = (int64_t)stat.written;
+	else if(strcmp(symbol, "dropped") == 0) ret.num = (int64_t)stat.dropped;
+	else if(strcmp(symbol, "blocked") == 0) ret.num = (int64_t)stat.blocked;
+	else return ret;
+
+	ret.type = LANG_PROP_TYPE_INTEGER;
+	return ret;
+}
+
+/**
+ * @brief send the report string to the client
+ * @details the response is the status code, followed by the length of the report and the report string
+ * @param fd the client socket
+ * @param report the report string, which will be disposed by this function
+ * @return status code
+ **/
+static inline int _send_report(int fd, char* report)
+{
+	if(NULL == report)
+		ERROR_RETURN_LOG(int, "Cannot produce the report");
+
+	int rc = ERROR_CODE(int);
+	int status = 0;
+	uint32_t size = (uint32_t)strlen(report);
+	size_t off;
+
+	if(write(fd, &status, sizeof(status)) < 0 || write(fd, &size, sizeof(size)) < 0)
+		ERROR_LOG_ERRNO_GOTO(RET, "Cannot send the response header to client");
+
+	for(off = 0; off < size;)
+	{
+		ssize_t bytes = write(fd, report + off, size - off);
+		if(bytes < 0)
+			ERROR_LOG_ERRNO_GOTO(RET, "Cannot send the report to client");
+		off += (size_t)bytes;
+	}
+
+	rc = 0;
+RET:
+	free(report);
+	return rc;
+}
+
 static _daemon_cmd_t* _read_cmd(int fd)
 {
 	_daemon_cmd_t header;
@@ -376,6 +555,27 @@ int sched_daemon_read_control_sock()
 				ERROR_LOG_GOTO(ERR, "Cannot create reload thread");
 			LOG_NOTICE("Starting reload process");
 			goto RET;
+		case _DAEMON_MEMORY:
+			LOG_NOTICE("Got DAEMON_MEMORY Command");
+			if(ERROR_CODE(int) == _send_report(client_fd, mempool_acct_report(*(uint32_t*)cmd->data != 0)))
+			{
+				LOG_ERROR("Cannot send the memory accounting report");
+				/* We may have sent the status code, so the only thing we can do is closing the connection */
+				close(client_fd);
+				free(cmd);
+				return ERROR_CODE(int);
+			}
+			break;
+		case _DAEMON_PROFILE:
+			LOG_NOTICE("Got DAEMON_PROFILE Command");
+			if(ERROR_CODE(int) == _send_report(client_fd, sched_prof_report()))
+			{
+				LOG_ERROR("Cannot send the profiler report");
+				close(client_fd);
+				free(cmd);
+				return ERROR_CODE(int);
+			}
+			break;
 		default:
 			ERROR_LOG_GOTO(ERR, "Invalid opcode");
 	}
@@ -419,6 +619,26 @@ int sched_daemon_init()
 	if(ERROR_CODE(int) == lang_prop_register_callback(&cb))
 		ERROR_RETURN_LOG(int, "Cannot register callback for the runtime prop callback");
 
+	lang_prop_callback_t memory_cb = {
+		.param = NULL,
+		.get   = _get_memory_prop,
+		.set   = NULL,
+		.symbol_prefix = "runtime.memory"
+	};
+
+	if(ERROR_CODE(int) == lang_prop_register_callback(&memory_cb))
+		ERROR_RETURN_LOG(int, "Cannot register callback for the memory accounting prop callback");
+
+	lang_prop_callback_t log_cb = {
+		.param = NULL,
+		.get   = _get_log_prop,
+		.set   = _set_log_prop,
+		.symbol_prefix = "runtime.log"
+	};
+
+	if(ERROR_CODE(int) == lang_prop_register_callback(&log_cb))
+		ERROR_RETURN_LOG(int, "Cannot register callback for the logging prop callback");
+
 	return 0;
 }
 
@@ -756,3 +976,75 @@ ERR:
 	return ERROR_CODE(int);
 }
 
+/**
+ * @brief read the report string the daemon sends back, see _send_report for the format
+ * @param fd the command socket connection, which will be closed by this function
+ * @param result the buffer used to return the report string
+ * @return status code
+ **/
+static inline int _read_report(int fd, char** result)
+{
+	char* buf = NULL;
+	uint32_t size;
+	int status;
+
+	if(read(fd, &status, sizeof(status)) < 0)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot read the response from the socket connection");
+
+	if(status < 0)
+		ERROR_LOG_GOTO(ERR,  "The daemon returns an error");
+
+	if(read(fd, &size, sizeof(size)) != sizeof(size))
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot read the size of the report");
+
+	if(NULL == (buf = (char*)malloc(size + 1)))
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the report");
+
+	uint32_t off;
+	for(off = 0; off < size;)
+	{
+		ssize_t bytes = read(fd, buf + off, size - off);
+		if(bytes <= 0)
+			ERROR_LOG_ERRNO_GOTO(ERR, "Cannot read the report");
+		off += (uint32_t)bytes;
+	}
+
+	buf[size] = 0;
+	*result = buf;
+	close(fd);
+	return 0;
+ERR:
+	if(NULL != buf) free(buf);
+	close(fd);
+	return ERROR_CODE(int);
+}
+
+int sched_daemon_memory(const char* daemon_name, int delta, char** result)
+{
+	if(NULL == result) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	int fd = _simple_daemon_command(daemon_name, _DAEMON_MEMORY, 0, 1);
+	if(ERROR_CODE(int) == fd)
+		return ERROR_CODE(int);
+
+	uint32_t flag = (delta != 0);
+
+	if(write(fd, &flag, sizeof(flag)) < 0)
+	{
+		close(fd);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot write the command data to the command socket connection");
+	}
+
+	return _read_report(fd, result);
+}
+
+int sched_daemon_profile(const char* daemon_name, char** result)
+{
+	if(NULL == result) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	int fd = _simple_daemon_command(daemon_name, _DAEMON_PROFILE, 0, 1);
+	if(ERROR_CODE(int) == fd)
+		return ERROR_CODE(int);
+
+	return _read_report(fd, result);
+}
@@ -50,6 +50,19 @@ static uint32_t _queue_size = SCHED_LOOP_EVENT_QUEUE_SIZE;
  **/
 static uint32_t _round_robin_move_threshold = 0;
 
+/**
+ * @brief The strategy we used to distribute the events to the worker threads
+ **/
+typedef enum {
+	_MODE_DISPATCH,    /*!< A single dispatcher thread takes all the events and round-robin them to the workers */
+	_MODE_STEAL        /*!< The workers take the events from the equeue by themselves and steal the IO events from the busy peers */
+} _mode_t;
+
+/**
+ * @brief The current worker mode
+ **/
+static _mode_t _mode = _MODE_DISPATCH;
+
 /**
  * @brief a scheduler loop context
  **/
@@ -66,6 +79,12 @@ struct _sched_loop_t {
 	uint32_t   num_running_reqs;     /*!< How many requests are currently running by this worker */
 	uint32_t   pending_reqs_id_begin;/*!< The begining ID of the pending request */
 	uint32_t   pending_reqs_id_end;  /*!< The ending ID of the pending request */
+	const sched_service_t* service;  /*!< The service graph this worker is currently using */
+	uint32_t   idle;                 /*!< If the worker is blocked because it doesn't have anything to do (steal mode only) */
+	pthread_mutex_t     io_mutex;    /*!< The mutex protects the IO event deque (steal mode only) */
+	uint32_t            io_front;    /*!< The front pointer of the IO event deque, where the owner takes the oldest event */
+	uint32_t            io_rear;     /*!< The rear pointer of the IO event deque, where the poller pushes and the thieves steal from */
+	itc_equeue_event_t* io_events;   /*!< The IO event deque, which is stealable by other workers (steal mode only) */
 	uintpad_t __padding__[0];
 	itc_equeue_event_t events[0];    /*!< the actual event queue */
 };
@@ -102,6 +121,13 @@ typedef struct {
  **/
 static sched_loop_t* _scheds = NULL;
 
+/**
+ * @brief the mutex prevents the scheduler list from being disposed while sched_loop_kill is walking through it
+ * @note sched_loop_kill may be called from another thread, for example an embedding application which stops the
+ *       service after its own work is done
+ **/
+static pthread_mutex_t _kill_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @brief indicate if the dispatcher is waiting for scheduler gets  ready
  **/
@@ -137,6 +163,31 @@ static itc_equeue_event_mask_t _last_mask;
  **/
 static itc_module_type_t _mod_mem = ERROR_CODE(itc_module_type_t);
 
+/**
+ * @brief The mutex that makes sure only one worker is taking events from the equeue at the same time (steal mode only)
+ **/
+static pthread_mutex_t _poll_mutex;
+
+/**
+ * @brief Indicates if the equeue is currently being polled by some thread (steal mode only)
+ **/
+static uint32_t _poller_active = 0;
+
+/**
+ * @brief Indicates the polling worker should stop waiting for the equeue and go back to work (steal mode only)
+ **/
+static int _poll_leave = 0;
+
+/**
+ * @brief The scheduler token shared by the polling workers (steal mode only)
+ **/
+static itc_equeue_token_t _sched_token = ERROR_CODE(itc_equeue_token_t);
+
+/**
+ * @brief The events that cannot be delivered by the poller currently, only the poller can access this (steal mode only)
+ **/
+static _pending_list_t _steal_pending;
+
 /**
  * @brief decide if the scheduler is saturated
  * @param scheduler The scheduler to check
@@ -157,7 +208,10 @@ static inline int _scheduler_saturated(sched_loop_t* scheduler)
 static inline sched_loop_t* _context_new(uint32_t tid)
 {
 	LOG_DEBUG("Creating thread context for scheduler #%d", tid);
-	sched_loop_t* ret = (sched_loop_t*)calloc(1, sizeof(sched_loop_t) + sizeof(itc_equeue_event_t) * _queue_size);
+
+	/* In steal mode, the IO event deque is allocated right after the event queue */
+	size_t nslots = _mode == _MODE_STEAL ? 2u * _queue_size : _queue_size;
+	sched_loop_t* ret = (sched_loop_t*)calloc(1, sizeof(sched_loop_t) + sizeof(itc_equeue_event_t) * nslots);
 
 	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the shceduler thread context");
 	ret->started = 0;
@@ -165,14 +219,20 @@ static inline sched_loop_t* _context_new(uint32_t tid)
 	ret->front = ret->rear = 0;
 	ret->size = _queue_size;
 	ret->thread = NULL;
+	ret->io_front = ret->io_rear = 0;
+	ret->io_events = _mode == _MODE_STEAL ? ret->events + _queue_size : NULL;
 
 	if((errno = pthread_mutex_init(&ret->mutex, NULL)) != 0) ERROR_LOG_ERRNO_GOTO(MUTEX_ERR, "Cannot initialize the shceduler local mutex");
 	if((errno = pthread_cond_init(&ret->cond, NULL)) != 0) ERROR_LOG_ERRNO_GOTO(COND_ERR, "Cannot initialize the scheduler local condvar");
+	if((errno = pthread_mutex_init(&ret->io_mutex, NULL)) != 0) ERROR_LOG_ERRNO_GOTO(IO_MUTEX_ERR, "Cannot initialize the IO deque mutex");
 
 	ret->next = _scheds;
 	_scheds = ret;
 
 	return ret;
+IO_MUTEX_ERR:
+	if((errno = pthread_cond_destroy(&ret->cond)) != 0)
+		LOG_WARNING_ERRNO("Cannot dispose the pthread condvar");
 COND_ERR:
 	if((errno = pthread_mutex_destroy(&ret->mutex)) != 0)
 		LOG_WARNING_ERRNO("Cannot dispose the pthread mutex");
@@ -181,6 +241,48 @@ MUTEX_ERR:
 	return NULL;
 }
 
+/**
+ * @brief Dispose an event that is never going to be processed
+ * @param event The event to dispose
+ * @return status code
+ **/
+static inline int _event_dispose(const itc_equeue_event_t* event)
+{
+	int rc = 0;
+	switch(event->type)
+	{
+		case ITC_EQUEUE_EVENT_TYPE_IO:
+		{
+			if(itc_module_pipe_deallocate(event->io.in) == ERROR_CODE(int))
+			{
+				LOG_ERROR("Cannot deallocate the input pipe");
+				rc = ERROR_CODE(int);
+			}
+			if(itc_module_pipe_deallocate(event->io.out) == ERROR_CODE(int))
+			{
+				LOG_ERROR("Cannot deallocate the output pipe");
+				rc = ERROR_CODE(int);
+			}
+			break;
+		}
+		case ITC_EQUEUE_EVENT_TYPE_TASK:
+		{
+			/* We don't call the cleanup task at this point for now.
+			 * TODO: do we need a way to make it properly cleaned up */
+			if(NULL != event->task.async_handle && ERROR_CODE(int) == sched_async_handle_dispose(event->task.async_handle))
+			{
+				LOG_ERROR("Cannot dispose the unprocessed async handle");
+				rc = ERROR_CODE(int);
+			}
+			break;
+		}
+		default:
+			LOG_WARNING("Invalid event type in the queue, may indicates code bug");
+	}
+
+	return rc;
+}
+
 /**
  * @brief Dispose the scheduler context
  * @param ctx The context
@@ -201,46 +303,405 @@ static inline int _context_free(sched_loop_t* ctx)
 		rc = ERROR_CODE(int);
 	}
 
+	if((errno = pthread_mutex_destroy(&ctx->io_mutex)) != 0)
+	{
+		LOG_ERROR_ERRNO("Cannot dispose the IO deque mutex");
+		rc = ERROR_CODE(int);
+	}
+
 	uint32_t i;
 	for(i = ctx->front; i != ctx->rear; i ++)
+		if(ERROR_CODE(int) == _event_dispose(ctx->events + (i & (ctx->size - 1))))
+			rc = ERROR_CODE(int);
+
+	if(NULL != ctx->io_events)
+		for(i = ctx->io_front; i != ctx->io_rear; i ++)
+			if(ERROR_CODE(int) == _event_dispose(ctx->io_events + (i & (ctx->size - 1))))
+				rc = ERROR_CODE(int);
+
+	free(ctx);
+
+	return rc;
+}
+
+/**
+ * @brief Notify the worker thread that it may have something to do
+ * @param ctx The worker context
+ * @return nothing
+ **/
+static inline void _notify_worker(sched_loop_t* ctx)
+{
+	if((errno = pthread_mutex_lock(&ctx->mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the thread local mutex");
+
+	if((errno = pthread_cond_signal(&ctx->cond)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot notify new incoming event for the scheduler thread %u", ctx->thread_id);
+
+	if((errno = pthread_mutex_unlock(&ctx->mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the thread local mutex");
+}
+
+/**
+ * @brief Check if the worker has some event in its own queues
+ * @note This doesn't acquire any lock, so the result is only a hint
+ * @param ctx The worker context
+ * @return The result
+ **/
+static inline int _has_event(const sched_loop_t* ctx)
+{
+	return ctx->front != ctx->rear || (NULL != ctx->io_events && ctx->io_front != ctx->io_rear);
+}
+
+/**
+ * @brief Check if there's any IO event that can be stolen from the peers of the worker
+ * @param ctx The worker context
+ * @return The result
+ **/
+static inline int _has_stealable_event(const sched_loop_t* ctx)
+{
+	const sched_loop_t* peer;
+	for(peer = _scheds; peer != NULL; peer = peer->next)
+		if(peer != ctx && peer->io_front != peer->io_rear)
+			return 1;
+	return 0;
+}
+
+/**
+ * @brief Push an IO event to the rear of the IO event deque of the worker
+ * @param ctx The worker context
+ * @param event The event to push
+ * @return If the event has been pushed, 0 indicates the deque is full
+ **/
+static inline int _io_deque_push(sched_loop_t* ctx, const itc_equeue_event_t* event)
+{
+	int rc = 0;
+
+	if((errno = pthread_mutex_lock(&ctx->io_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the IO deque mutex");
+
+	if(ctx->io_rear - ctx->io_front < ctx->size)
+	{
+		ctx->io_events[ctx->io_rear & (ctx->size - 1)] = *event;
+		ctx->io_rear ++;
+		arch_atomic_sw_increment_u32(&ctx->pending_reqs_id_end);
+		rc = 1;
+	}
+
+	if((errno = pthread_mutex_unlock(&ctx->io_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the IO deque mutex");
+
+	return rc;
+}
+
+/**
+ * @brief Pop an IO event from the IO event deque of the worker
+ * @details The owner consumes the deque from the front, so that the requests are served in the
+ *          order they arrived. The thieves take the most recent event from the rear instead.
+ * @param ctx The worker context
+ * @param steal If the caller is a thief
+ * @param buf The buffer used to return the event
+ * @return If we got an event
+ **/
+static inline int _io_deque_pop(sched_loop_t* ctx, int steal, itc_equeue_event_t* buf)
+{
+	int rc = 0;
+
+	if(ctx->io_front == ctx->io_rear) return 0;
+
+	if((errno = pthread_mutex_lock(&ctx->io_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the IO deque mutex");
+
+	if(ctx->io_front != ctx->io_rear)
 	{
-		uint32_t p = i & (ctx->size - 1);
+		if(steal)
+			*buf = ctx->io_events[(-- ctx->io_rear) & (ctx->size - 1)];
+		else
+			*buf = ctx->io_events[(ctx->io_front ++) & (ctx->size - 1)];
+		arch_atomic_sw_increment_u32(&ctx->pending_reqs_id_begin);
+		rc = 1;
+	}
+
+	if((errno = pthread_mutex_unlock(&ctx->io_mutex)) != 0)
+		LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the IO deque mutex");
 
-		switch(ctx->events[p].type)
+	return rc;
+}
+
+/**
+ * @brief Wake up the idle workers
+ * @param self The caller, which shouldn't be waken up
+ * @param n The maximum number of workers we want to wake up
+ * @return nothing
+ **/
+static inline void _wake_idle_workers(const sched_loop_t* self, uint32_t n)
+{
+	sched_loop_t* ctx;
+	for(ctx = _scheds; ctx != NULL && n > 0; ctx = ctx->next)
+		if(ctx != self && ctx->idle)
 		{
-			case ITC_EQUEUE_EVENT_TYPE_IO:
-			{
-				if(itc_module_pipe_deallocate(ctx->events[p].io.in) == ERROR_CODE(int))
-				{
-					LOG_ERROR("Cannot deallocate the input pipe");
-					rc = ERROR_CODE(int);
-				}
-				if(itc_module_pipe_deallocate(ctx->events[p].io.out) == ERROR_CODE(int))
-				{
-					LOG_ERROR("Cannot deallocate the output pipe");
-					rc = ERROR_CODE(int);
-				}
-				break;
-			}
-			case ITC_EQUEUE_EVENT_TYPE_TASK:
+			_notify_worker(ctx);
+			n --;
+		}
+}
+
+/**
+ * @brief Deliver an event taken from the equeue to the worker that should handle it
+ * @details The task event always goes to the worker which owns the task. The IO event
+ *          prefers the poller itself, so that the event doesn't travel between threads,
+ *          unless the poller is saturated.
+ * @note This function should be called by the poller only
+ * @param poller The worker currently polling the equeue
+ * @param event The event to deliver
+ * @return If the event has been delivered, 0 indicates there's no worker can accept the event currently
+ **/
+static inline int _steal_deliver(sched_loop_t* poller, const itc_equeue_event_t* event)
+{
+	sched_loop_t* target;
+
+	if(event->type == ITC_EQUEUE_EVENT_TYPE_TASK)
+	{
+		target = event->task.loop;
+
+		if(target->rear - target->front >= target->size) return 0;
+
+		target->events[target->rear & (target->size - 1)] = *event;
+		BARRIER();
+		arch_atomic_sw_increment_u32(&target->rear);
+	}
+	else
+	{
+		target = poller;
+		if(_scheduler_saturated(target) || !_io_deque_push(target, event))
+		{
+			for(target = _scheds; target != NULL; target = target->next)
+				if(target != poller && !_scheduler_saturated(target) && _io_deque_push(target, event))
+					break;
+			if(NULL == target) return 0;
+		}
+	}
+
+	/* Make sure the event is visible before we check if the target is sleeping,
+	 * the target does the same thing in the reversed order */
+	__sync_synchronize();
+
+	if(target != poller && target->idle)
+		_notify_worker(target);
+
+	return 1;
+}
+
+/**
+ * @brief Try to deliver the pending events in steal mode
+ * @param poller The worker currently polling the equeue
+ * @return nothing
+ **/
+static inline void _steal_flush_pending(sched_loop_t* poller)
+{
+	_pending_event_t* next_event, *prev_event = NULL;
+	for(next_event = _steal_pending.list; next_event != NULL;)
+	{
+		_pending_event_t* this_event = next_event;
+		next_event = this_event->next;
+
+		if(!_steal_deliver(poller, &this_event->event))
+		{
+			prev_event = this_event;
+			continue;
+		}
+
+		if(NULL != prev_event) prev_event->next = next_event;
+		else _steal_pending.list = next_event;
+
+		free(this_event);
+		_steal_pending.size --;
+	}
+}
+
+/**
+ * @brief The equeue wait interrupt callback used by the poller in steal mode
+ * @param data The poller context
+ * @return The event mask for the next wait iteration
+ **/
+static itc_equeue_event_mask_t _steal_interrupt_handler(void* data)
+{
+	sched_loop_t* poller = (sched_loop_t*)data;
+
+	_steal_flush_pending(poller);
+
+	itc_equeue_event_mask_t ret = ITC_EQUEUE_EVENT_MASK_NONE;
+	ITC_EQUEUE_EVENT_MASK_ADD(ret, ITC_EQUEUE_EVENT_TYPE_TASK);
+
+	sched_loop_t* sched;
+	for(sched = _scheds; sched != NULL; sched = sched->next)
+		if(!_scheduler_saturated(sched))
+		{
+			ITC_EQUEUE_EVENT_MASK_ADD(ret, ITC_EQUEUE_EVENT_TYPE_IO);
+			break;
+		}
+
+	_last_mask = ret;
+
+	/* If the poller has something to do other than waiting, stop polling */
+	if(_killed || _has_event(poller) ||
+	   (_deploying_service != NULL && poller->service != _deploying_service) ||
+	   (!_scheduler_saturated(poller) && _has_stealable_event(poller)))
+		_poll_leave = 1;
+
+	return ret;
+}
+
+/**
+ * @brief Wait for the equeue and deliver the events to the workers
+ * @note The caller must hold the poll mutex
+ * @param poller The worker context
+ * @return nothing
+ **/
+static inline void _steal_poll(sched_loop_t* poller)
+{
+	itc_equeue_wait_interrupt_t ir = {
+		.func = _steal_interrupt_handler,
+		.data = poller
+	};
+
+	_poll_leave = 0;
+	_dispatcher_waiting_event = 1;
+
+	BARRIER();
+
+	int rc = itc_equeue_wait(_sched_token, &_poll_leave, &ir);
+
+	BARRIER();
+
+	_dispatcher_waiting_event = 0;
+
+	if(ERROR_CODE(int) == rc)
+	{
+		LOG_WARNING("Cannot wait for the the event queue gets ready");
+		return;
+	}
+
+	if(_poll_leave || _killed) return;
+
+	itc_equeue_event_t events[32];
+	uint32_t n_events, i;
+
+	if((n_events = itc_equeue_take(_sched_token, _last_mask, events, sizeof(events) / sizeof(events[0]))) == ERROR_CODE(uint32_t))
+	{
+		LOG_ERROR("Cannot take next event from the event queue");
+		return;
+	}
+
+	for(i = 0; i < n_events; i ++)
+	{
+		if(_steal_deliver(poller, events + i)) continue;
+
+		LOG_DEBUG("No worker can accept the event currently, add the event to the pending list");
+
+		_pending_event_t* pe = NULL;
+		if(_steal_pending.size >= SCHED_LOOP_MAX_PENDING_TASKS || NULL == (pe = (_pending_event_t*)malloc(sizeof(*pe))))
+		{
+			LOG_ERROR("Cannot add the event to the pending list, dropping the event");
+			if(ERROR_CODE(int) == _event_dispose(events + i))
+				LOG_WARNING("Cannot dispose the dropped event");
+			continue;
+		}
+
+		pe->next = _steal_pending.list;
+		pe->event = events[i];
+		_steal_pending.list = pe;
+		_steal_pending.size ++;
+	}
+}
+
+/**
+ * @brief Get the next event for the worker in steal mode
+ * @details The worker checks its own queues first, then it tries to steal an IO event from its peers.
+ *          If there's nothing to steal and no one is polling the equeue, the worker becomes the poller
+ *          and takes the events from the equeue directly
+ * @param context The worker context
+ * @param buf The buffer used to return the event
+ * @return If we got an event
+ **/
+static inline int _steal_next_event(sched_loop_t* context, itc_equeue_event_t* buf)
+{
+	if(context->front != context->rear)
+	{
+		*buf = context->events[context->front & (context->size - 1)];
+
+		BARRIER();
+
+		arch_atomic_sw_increment_u32(&context->front);
+
+		/* The poller may have some pending task for us which is blocked by the full queue */
+		if(_dispatcher_waiting_event && _steal_pending.size > 0 && ERROR_CODE(int) == itc_equeue_wait_interrupt())
+			LOG_WARNING("Cannot invoke the wait interrupt callback");
+
+		return 1;
+	}
+
+	if(_io_deque_pop(context, 0, buf)) return 1;
+
+	if(!_scheduler_saturated(context))
+	{
+		sched_loop_t* peer;
+		for(peer = context->next == NULL ? _scheds : context->next; peer != context; peer = peer->next == NULL ? _scheds : peer->next)
+			if(_io_deque_pop(peer, 1, buf))
 			{
-				/* We don't call the cleanup task at this point for now.
-				 * TODO: do we need a way to make it properly cleaned up */
-				if(NULL != ctx->events[p].task.async_handle && ERROR_CODE(int) == sched_async_handle_dispose(ctx->events[p].task.async_handle))
-				{
-					LOG_ERROR("Cannot dispose the unprocessed async handle");
-					rc = ERROR_CODE(int);
-				}
-				break;
+				LOG_DEBUG("Scheduler %u: stole an IO event from scheduler %u", context->thread_id, peer->thread_id);
+				return 1;
 			}
-			default:
-				LOG_WARNING("Invalid event type in the queue, may indicates code bug");
-		}
 	}
 
-	free(ctx);
+	if(0 == pthread_mutex_trylock(&_poll_mutex))
+	{
+		arch_atomic_sw_assignment_u32(&_poller_active, 1);
 
-	return rc;
+		_steal_poll(context);
+
+		arch_atomic_sw_assignment_u32(&_poller_active, 0);
+
+		if((errno = pthread_mutex_unlock(&_poll_mutex)) != 0)
+			LOG_WARNING_ERRNO("Cannot release the poll mutex");
+
+		__sync_synchronize();
+
+		/* Someone else should take over the poller role, and the events we can not handle
+		 * by ourselves should be stolen by the idle workers */
+		uint32_t backlog = context->io_rear - context->io_front;
+		_wake_idle_workers(context, backlog > 0 ? backlog : 1);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Check if there's a new service graph is being deployed and switch to the new service graph
+ * @note This function should be called when the worker is idle
+ * @param context The worker context
+ * @param stc The scheduler task context
+ * @param old_service_refcnt The number of requests that is still using the old service graph
+ * @return nothing
+ **/
+static inline void _check_deployment(sched_loop_t* context, sched_task_context_t* stc, uint32_t* old_service_refcnt)
+{
+	if(_deploying_service == NULL || context->service == _deploying_service) return;
+
+	LOG_DEBUG("Switching the service graph from %p to %p", context->service, _deploying_service);
+	context->service = _deploying_service;
+	if(ERROR_CODE(uint32_t) == (*old_service_refcnt = sched_task_num_concurrent_requests(stc)))
+		LOG_ERROR("Cannot get the number of old service refcount");
+	else
+		LOG_DEBUG("Num of request that using old service graph: %u", *old_service_refcnt);
+
+	if(*old_service_refcnt == 0)
+	{
+		LOG_DEBUG("The old service isn't in use, mark the deployment as finished");
+		uint32_t current;
+		do {
+			current = _deployed_count;
+		} while(!__sync_bool_compare_and_swap(&_deployed_count, current, current + 1));
+		LOG_NOTICE("Deployment process compelted for scheduler #%u", context->thread_id);
+	}
 }
 
 /**
@@ -265,88 +726,107 @@ static inline void* _sched_main(void* data)
 
 	LOG_DEBUG("Scheduler %u: loop started", context->thread_id);
 
-	const sched_service_t* current_service = _service;
+	context->service = _service;
 
 	uint32_t old_service_refcnt = 0;
 
 	for(;!_killed;)
 	{
-		if(context->front == context->rear)
+		itc_equeue_event_t current;
+
+		if(_mode == _MODE_STEAL)
 		{
-			struct timespec abstime;
-			struct timeval now;
-			gettimeofday(&now,NULL);
-			abstime.tv_sec = now.tv_sec+1;
-			abstime.tv_nsec = 0;
+			if(!_steal_next_event(context, &current))
+			{
+				struct timespec abstime;
+				struct timeval now;
+				gettimeofday(&now,NULL);
+				abstime.tv_sec = now.tv_sec+1;
+				abstime.tv_nsec = 0;
 
-			if((errno = pthread_mutex_lock(&context->mutex)) != 0) LOG_WARNING_ERRNO("Cannot acquire the scheduler event mutex");
-			for(;;)
+				if((errno = pthread_mutex_lock(&context->mutex)) != 0) LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the scheduler event mutex");
+
+				context->idle = 1;
+
+				/* Make sure the idle flag is visible before we check the queues */
+				__sync_synchronize();
+
+				_check_deployment(context, stc, &old_service_refcnt);
+
+				/* We only sleep when someone else is polling the equeue, otherwise we should take the poller role */
+				if(!_killed && !_has_event(context) && _poller_active &&
+				   (_scheduler_saturated(context) || !_has_stealable_event(context)) &&
+				   (errno = pthread_cond_timedwait(&context->cond, &context->mutex, &abstime)) != 0 && errno != ETIMEDOUT && errno != EINTR)
+					LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot finish pthread_cond_timedwait");
+
+				context->idle = 0;
+
+				if((errno = pthread_mutex_unlock(&context->mutex)) != 0) LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the scheduler event mutex");
+
+				continue;
+			}
+		}
+		else
+		{
+			if(context->front == context->rear)
 			{
-				if(_deploying_service != NULL && current_service != _deploying_service)
+				struct timespec abstime;
+				struct timeval now;
+				gettimeofday(&now,NULL);
+				abstime.tv_sec = now.tv_sec+1;
+				abstime.tv_nsec = 0;
+
+				if((errno = pthread_mutex_lock(&context->mutex)) != 0) LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the scheduler event mutex");
+				for(;;)
 				{
-					LOG_DEBUG("Switching the service graph from %p to %p", _service, current_service);
-					current_service = _deploying_service;
-					if(ERROR_CODE(uint32_t) == (old_service_refcnt = sched_task_num_concurrent_requests(stc)))
-						LOG_ERROR("Cannot get the number of old service refcount");
-					else
-						LOG_DEBUG("Num of request that using old service graph: %u", old_service_refcnt);
-
-					if(old_service_refcnt == 0)
+					_check_deployment(context, stc, &old_service_refcnt);
+					if(context->rear != context->front) break;
+					if((errno = pthread_cond_timedwait(&context->cond, &context->mutex, &abstime)) != 0 && errno != ETIMEDOUT && errno != EINTR)
+						LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot finish pthread_cond_timedwait");
+					if(_killed)
 					{
-						LOG_DEBUG("The old service isn't in use, mark the deployment as finished");
-						uint32_t current;
-						do {
-							current = _deployed_count;
-						} while(!__sync_bool_compare_and_swap(&_deployed_count, current, current + 1));
-						LOG_NOTICE("Deployment process compelted for scheduler #%u", context->thread_id);
+						if((errno = pthread_mutex_unlock(&context->mutex)) != 0)
+							LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the scheduler event mutex");
+						goto KILLED;
 					}
+					abstime.tv_sec ++;
 				}
-				if(context->rear != context->front) break;
-				if((errno = pthread_cond_timedwait(&context->cond, &context->mutex, &abstime)) != 0 && errno != ETIMEDOUT && errno != EINTR)
-					LOG_WARNING_ERRNO("Cannot finish pthread_cond_timedwait");
-				if(_killed)
-				{
-					if((errno = pthread_mutex_unlock(&context->mutex)) != 0)
-						LOG_WARNING_ERRNO("Cannot release the scheduler event mutex");
-					goto KILLED;
-				}
-				abstime.tv_sec ++;
-			}
-
-			if((errno = pthread_mutex_unlock(&context->mutex)) != 0) LOG_WARNING_ERRNO("Cannot release the scheduler event mutex");
-		}
 
-		LOG_TRACE("Scheduler Thread %u: new event acquired", context->thread_id);
+				if((errno = pthread_mutex_unlock(&context->mutex)) != 0) LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the scheduler event mutex");
+			}
 
-		uint32_t position = context->front & (context->size - 1);
-		itc_equeue_event_t current = context->events[position];
+			uint32_t position = context->front & (context->size - 1);
+			current = context->events[position];
 
-		BARRIER();
+			BARRIER();
 
-		arch_atomic_sw_increment_u32(&context->front);
+			arch_atomic_sw_increment_u32(&context->front);
 
-		BARRIER();
+			BARRIER();
 
-		/* At this point, we have at least one empty slot for the next event, so we need to
-		 * check if the dispatcher is waiting for event, then we need to activate the pending
-		 * task resolve callback when the scheduler queue is previously full */
-		if(_dispatcher_waiting_event &&
-		   (context->rear - context->front == context->size - 1) &&
-		   ERROR_CODE(int) == itc_equeue_wait_interrupt())
-			LOG_WARNING("Cannot invoke the wait interrupt callback");
+			/* At this point, we have at least one empty slot for the next event, so we need to
+			 * check if the dispatcher is waiting for event, then we need to activate the pending
+			 * task resolve callback when the scheduler queue is previously full */
+			if(_dispatcher_waiting_event &&
+			   (context->rear - context->front == context->size - 1) &&
+			   ERROR_CODE(int) == itc_equeue_wait_interrupt())
+				LOG_WARNING("Cannot invoke the wait interrupt callback");
 
-		if(_dispatcher_waiting)
-		{
-			if((errno = pthread_mutex_lock(&_dispatcher_mutex)) != 0)
-				LOG_WARNING_ERRNO("Cannot lock the dispatcher mutex");
+			if(_dispatcher_waiting)
+			{
+				if((errno = pthread_mutex_lock(&_dispatcher_mutex)) != 0)
+					LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot lock the dispatcher mutex");
 
-			if((errno = pthread_cond_signal(&_dispatcher_cond)) != 0)
-				LOG_WARNING_ERRNO("Cannot notify the dispatcher for the avaliable space");
+				if((errno = pthread_cond_signal(&_dispatcher_cond)) != 0)
+					LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot notify the dispatcher for the avaliable space");
 
-			if((errno = pthread_mutex_unlock(&_dispatcher_mutex)) != 0)
-				LOG_WARNING_ERRNO("Cannot unlock the dispatcher mutex");
+				if((errno = pthread_mutex_unlock(&_dispatcher_mutex)) != 0)
+					LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot unlock the dispatcher mutex");
+			}
 		}
 
+		LOG_TRACE("Scheduler Thread %u: new event acquired", context->thread_id);
+
 		int old_service = 0;
 
 		switch(current.type)
@@ -361,10 +841,12 @@ static inline void* _sched_main(void* data)
 
 				BARRIER();
 
-				arch_atomic_sw_increment_u32(&context->pending_reqs_id_begin);
+				/* In steal mode, the pending request counter has been updated when the event is poped from the deque */
+				if(_mode != _MODE_STEAL)
+					arch_atomic_sw_increment_u32(&context->pending_reqs_id_begin);
 
 
-				if(sched_task_new_request(stc, current_service, current.io.in, current.io.out) == ERROR_CODE(sched_task_request_t))
+				if(sched_task_new_request(stc, context->service, current.io.in, current.io.out) == ERROR_CODE(sched_task_request_t))
 					LOG_ERROR("Cannot add the incoming request to scheduler");
 
 				uint32_t concurrency = sched_task_num_concurrent_requests(stc);
@@ -378,7 +860,7 @@ static inline void* _sched_main(void* data)
 				arch_atomic_sw_assignment_u32(&context->num_running_reqs, concurrency);
 				break;
 			case ITC_EQUEUE_EVENT_TYPE_TASK:
-				if(old_service_refcnt > 0 && current.task.task->service != current_service)
+				if(old_service_refcnt > 0 && current.task.task->service != context->service)
 					old_service = 1;
 				if(sched_task_async_completed(current.task.task) == ERROR_CODE(int))
 					LOG_ERROR("Cannot notify the scheduler about the task completion");
@@ -408,13 +890,13 @@ static inline void* _sched_main(void* data)
 		if(_dispatcher_waiting)
 		{
 			if((errno = pthread_mutex_lock(&_dispatcher_mutex)) != 0)
-				LOG_WARNING_ERRNO("Cannot lock the dispatcher mutex");
+				LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot lock the dispatcher mutex");
 
 			if((errno = pthread_cond_signal(&_dispatcher_cond)) != 0)
-				LOG_WARNING_ERRNO("Cannot notify the dispatcher for the avaliable space");
+				LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot notify the dispatcher for the avaliable space");
 
 			if((errno = pthread_mutex_unlock(&_dispatcher_mutex)) != 0)
-				LOG_WARNING_ERRNO("Cannot unlock the dispatcher mutex");
+				LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot unlock the dispatcher mutex");
 		}
 
 		if(old_service && concurrency < prev_concurrency)
@@ -510,13 +992,13 @@ static itc_equeue_event_mask_t _interrupt_handler(void* pl)
 		if(needs_notify)
 		{
 			if((errno = pthread_mutex_lock(&target_loop->mutex)) != 0)
-				LOG_WARNING_ERRNO("Cannot acquire the thread local mutex");
+				LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the thread local mutex");
 
 			if((errno = pthread_cond_signal(&target_loop->cond)) != 0)
-				LOG_WARNING_ERRNO("Cannot notify new incoming event for the target_loop thread %u", target_loop->thread_id);
+				LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot notify new incoming event for the target_loop thread %u", target_loop->thread_id);
 
 			if((errno = pthread_mutex_unlock(&target_loop->mutex)) != 0)
-				LOG_WARNING_ERRNO("Cannot release the thread local mutex");
+				LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the thread local mutex");
 		}
 
 		/* Finally we remove the event from the list */
@@ -653,7 +1135,7 @@ static inline int _dispatcher_main(void)
 						_pending_event_t* pe = (_pending_event_t*)malloc(sizeof(*pe));
 						if(NULL == pe)
 						{
-							LOG_WARNING_ERRNO("Cannot allocate memory for the pending event, waiting for the scheduler");
+							LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot allocate memory for the pending event, waiting for the scheduler");
 							goto SCHED_WAIT;
 						}
 
@@ -678,14 +1160,14 @@ SCHED_WAIT:
 					int need_lock = !_dispatcher_waiting;
 					arch_atomic_sw_assignment_u32(&_dispatcher_waiting, 1);
 					if(need_lock && (errno = pthread_mutex_lock(&_dispatcher_mutex)) != 0)
-						LOG_WARNING_ERRNO("Cannot acquire the dispatcher mutex");
+						LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the dispatcher mutex");
 				}
 
 				if(scheduler->rear - scheduler->front >= scheduler->size ||
 				   (event.type == ITC_EQUEUE_EVENT_TYPE_IO && _scheduler_saturated(scheduler)))
 				{
 					if((errno = pthread_cond_timedwait(&_dispatcher_cond, &_dispatcher_mutex, &abstime)) != 0 && errno != ETIMEDOUT && errno != EINTR)
-						LOG_WARNING_ERRNO("Cannot complete pthread_cond_timewait");
+						LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot complete pthread_cond_timewait");
 
 					abstime.tv_sec ++;
 
@@ -698,7 +1180,7 @@ EXIT_LOOP:
 					{
 						arch_atomic_sw_assignment_u32(&_dispatcher_waiting, 0);
 						if((errno = pthread_mutex_unlock(&_dispatcher_mutex)) != 0)
-							LOG_WARNING_ERRNO("Cannot rlease the dispatcher mutex");
+							LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot rlease the dispatcher mutex");
 					}
 
 					break;
@@ -723,13 +1205,13 @@ EXIT_LOOP:
 			if(needs_notify)
 			{
 				if((errno = pthread_mutex_lock(&scheduler->mutex)) != 0)
-					LOG_WARNING_ERRNO("Cannot acquire the thread local mutex");
+					LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot acquire the thread local mutex");
 
 				if((errno = pthread_cond_signal(&scheduler->cond)) != 0)
-					LOG_WARNING_ERRNO("Cannot notify new incoming event for the scheduler thread %u", scheduler->thread_id);
+					LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot notify new incoming event for the scheduler thread %u", scheduler->thread_id);
 
 				if((errno = pthread_mutex_unlock(&scheduler->mutex)) != 0)
-					LOG_WARNING_ERRNO("Cannot release the thread local mutex");
+					LOG_WARNING_RATE_ERRNO(LOG_RATE_LIMIT, "Cannot release the thread local mutex");
 			}
 NEXT_ITER:
 			(void)0;
@@ -759,6 +1241,71 @@ NEXT_ITER:
 	return 0;
 }
 
+/**
+ * @brief The main function of the supervisor thread in steal mode
+ * @details In steal mode, the workers take the events from the equeue by themselves, so the
+ *          thread only starts the async processor, then opens the gate for the workers and keeps
+ *          serving the daemon control socket until the scheduler gets killed
+ * @return status code
+ **/
+static inline int _steal_main(void)
+{
+	thread_set_name("PbSupervisor");
+
+	if(ERROR_CODE(int) == sched_async_start())
+	{
+		LOG_ERROR("Cannot start the async task processor");
+		/* Make sure the workers can exit, because nobody is going to feed them */
+		_killed = 1;
+		if((errno = pthread_mutex_unlock(&_poll_mutex)) != 0)
+			LOG_WARNING_ERRNO("Cannot release the poll mutex");
+		return ERROR_CODE(int);
+	}
+
+	LOG_DEBUG("Supervisor: loop started, allow the workers to poll the event queue");
+
+	/* The poll mutex is held by us since the loop started, release it so that the workers can poll */
+	arch_atomic_sw_assignment_u32(&_poller_active, 0);
+
+	if((errno = pthread_mutex_unlock(&_poll_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the poll mutex");
+
+	__sync_synchronize();
+
+	_wake_idle_workers(NULL, 1);
+
+	if((errno = pthread_mutex_lock(&_dispatcher_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the dispatcher mutex");
+
+	for(;!_killed;)
+	{
+		if(ERROR_CODE(int) == sched_daemon_read_control_sock())
+			LOG_ERROR("Cannot read the control socket");
+
+		struct timespec abstime;
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		abstime.tv_sec = now.tv_sec+1;
+		abstime.tv_nsec = 0;
+
+		if((errno = pthread_cond_timedwait(&_dispatcher_cond, &_dispatcher_mutex, &abstime)) != 0 && errno != ETIMEDOUT && errno != EINTR)
+			LOG_WARNING_ERRNO("Cannot complete pthread_cond_timewait");
+	}
+
+	if((errno = pthread_mutex_unlock(&_dispatcher_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the dispatcher mutex");
+
+	/* Make sure the poller gives up waiting */
+	itc_equeue_wait_interrupt();
+
+	if(ERROR_CODE(int) == sched_async_kill())
+		ERROR_RETURN_LOG(int, "Cannot kill the async processor");
+
+	LOG_INFO("Supervisor gets killed");
+
+	return 0;
+}
+
 int sched_loop_start(sched_service_t** service, int fork_twice)
 {
 
@@ -800,6 +1347,21 @@ int sched_loop_start(sched_service_t** service, int fork_twice)
 	if((errno = pthread_cond_init(&_dispatcher_cond, NULL)) != 0)
 		ERROR_RETURN_LOG_ERRNO(int, "Cannot init the dispatcher condvar");
 
+	if(_mode == _MODE_STEAL)
+	{
+		/* The workers shouldn't poll the equeue until everything is ready, so we hold the
+		 * poll mutex until the supervisor starts */
+		if((errno = pthread_mutex_init(&_poll_mutex, NULL)) != 0)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot init the poll mutex");
+
+		if((errno = pthread_mutex_lock(&_poll_mutex)) != 0)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the poll mutex");
+
+		_poller_active = 1;
+
+		if(ERROR_CODE(itc_equeue_token_t) == (_sched_token = itc_equeue_scheduler_token()))
+			ERROR_RETURN_LOG(int, "Cannot acquire the scheduler token");
+	}
 
 	for(ptr = _scheds; ptr != NULL; ptr = ptr->next)
 	{
@@ -831,10 +1393,16 @@ int sched_loop_start(sched_service_t** service, int fork_twice)
 		ERROR_RETURN_LOG(int, "Cannot set the accept param");
 
 
-	_dispatcher_main();
+	if(_mode == _MODE_STEAL)
+		rc = _steal_main();
+	else
+		_dispatcher_main();
 
 CLEANUP_CTX:
 
+	if((errno = pthread_mutex_lock(&_kill_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot acquire the kill mutex");
+
 	for(ptr = _scheds; ptr != NULL;)
 	{
 		sched_loop_t* cur = ptr;
@@ -854,6 +1422,41 @@ CLEANUP_CTX:
 		}
 	}
 
+	_scheds = NULL;
+
+	if((errno = pthread_mutex_unlock(&_kill_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the kill mutex");
+
+	if(_mode == _MODE_STEAL && _sched_token != ERROR_CODE(itc_equeue_token_t))
+	{
+		/* All the workers are gone, so we can safely clean up the events nobody takes */
+		for(;_steal_pending.list != NULL;)
+		{
+			_pending_event_t* this = _steal_pending.list;
+			_steal_pending.list = _steal_pending.list->next;
+
+			if(ERROR_CODE(int) == _event_dispose(&this->event))
+				LOG_WARNING("Cannot dispose the unprocessed pending event");
+
+			free(this);
+		}
+		_steal_pending.size = 0;
+
+		if((errno = pthread_mutex_destroy(&_poll_mutex)) != 0)
+		{
+			LOG_ERROR_ERRNO("Cannot dispose the poll mutex");
+			rc = ERROR_CODE(int);
+		}
+
+		if(ERROR_CODE(int) == itc_equeue_release_scheduler_token(_sched_token))
+		{
+			LOG_ERROR("Cannot release the scheduler token");
+			rc = ERROR_CODE(int);
+		}
+
+		_sched_token = ERROR_CODE(itc_equeue_token_t);
+	}
+
 	/* Finally, we could copy the current service back to the caller, since the original
 	 * service might be disposed before this */
 	if(_service != NULL)
@@ -866,8 +1469,6 @@ CLEANUP_CTX:
 		rc = ERROR_CODE(int);
 	}
 
-	_scheds = NULL;
-
 	_killed = 0;
 
 	return rc;
@@ -875,8 +1476,18 @@ CLEANUP_CTX:
 
 int sched_loop_kill(int no_error)
 {
+	/* If we can not get the mutex, the scheduler loop is either being killed or being disposed.
+	 * We don't block here, since this function is also called from the signal handler */
+	if((errno = pthread_mutex_trylock(&_kill_mutex)) != 0)
+	{
+		if(errno == EBUSY) return 0;
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the kill mutex");
+	}
+
 	if(NULL == _scheds)
 	{
+		if((errno = pthread_mutex_unlock(&_kill_mutex)) != 0)
+			LOG_WARNING_ERRNO("Cannot release the kill mutex");
 		if(no_error) return 0;
 		ERROR_RETURN_LOG(int, "Scheduler loops are not started yet");
 	}
@@ -899,7 +1510,8 @@ int sched_loop_kill(int no_error)
 			LOG_WARNING_ERRNO("Cannot unlock the scheduler mutex");
 	}
 
-
+	if((errno = pthread_mutex_unlock(&_kill_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the kill mutex");
 
 	return 0;
 }
@@ -964,6 +1576,17 @@ static inline int _set_prop(const char* symbol, lang_prop_value_t value, const v
 		if(value.type != LANG_PROP_TYPE_INTEGER) ERROR_RETURN_LOG(int, "Type mismatch");
 		_round_robin_move_threshold = (uint32_t)value.num;
 	}
+	else if(strcmp(symbol, "mode") == 0)
+	{
+		if(value.type != LANG_PROP_TYPE_STRING) ERROR_RETURN_LOG(int, "Type mismatch");
+		if(NULL != _scheds) ERROR_RETURN_LOG(int, "Cannot change the worker mode after the loop started");
+		if(strcmp(value.str, "dispatch") == 0)
+			_mode = _MODE_DISPATCH;
+		else if(strcmp(value.str, "steal") == 0)
+			_mode = _MODE_STEAL;
+		else
+			ERROR_RETURN_LOG(int, "Invalid worker mode %s, expected either dispatch or steal", value.str);
+	}
 	else
 	{
 		LOG_WARNING("Unrecognized symbol name %s", symbol);
@@ -1023,6 +1646,16 @@ static lang_prop_value_t _get_prop(const char* symbol, const void* param)
 		ret.type = LANG_PROP_TYPE_INTEGER;
 		ret.num = _round_robin_move_threshold;
 	}
+	else if(strcmp(symbol, "mode") == 0)
+	{
+		ret.type = LANG_PROP_TYPE_STRING;
+		if(NULL == (ret.str = strdup(_mode == _MODE_STEAL ? "steal" : "dispatch")))
+		{
+			LOG_WARNING_ERRNO("Cannot allocate memory for the mode string");
+			ret.type = LANG_PROP_TYPE_ERROR;
+			return ret;
+		}
+	}
 
 	return ret;
 }
@@ -9,6 +9,7 @@
 #include <pthread.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include <constants.h>
 #include <error.h>
@@ -32,12 +33,40 @@
 #include <utils/static_assertion.h>
 #include <utils/thread.h>
 
+/**
+ * @brief the number of sub-buckets for each power of two range in the histogram
+ **/
+#define _HIST_SUB_BUCKETS (1u << SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * @brief the percentiles we exported to the histogram file, in 1/1000
+ **/
+static const uint32_t _percentiles[] = {500, 990, 999};
+
+/**
+ * @brief the column names of the percentiles in the histogram file
+ **/
+static const char* const _percentile_names[] = {"p50", "p99", "p999"};
+STATIC_ASSERTION_EQ_ID(percentile_names, sizeof(_percentiles) / sizeof(_percentiles[0]), sizeof(_percentile_names) / sizeof(_percentile_names[0]));
+
+/**
+ * @brief the log-linear histogram of the time in ns
+ * @note each histogram is only written by its owner thread, so the counter doesn't need a locked increment.
+ *       But the aggregator may read it from another thread, so we use the atomic load/store to access the counters
+ **/
+typedef struct {
+	uint64_t count[SCHED_PROF_HIST_NUM_BUCKETS];   /*!< the sample counters for each bucket */
+} _hist_t;
+
 /**
  * @brief the time accumulator
  **/
 typedef struct {
 	uint64_t total_time;   /*!< the total time elapsed on this node in ns */
 	uint64_t exec_count;   /*!< the number of executions during the time */
+	_hist_t  wall_time;    /*!< the histogram of the wall time of each execution */
+	_hist_t  cpu_time;     /*!< the histogram of the CPU time the thread spent on each execution */
+	_hist_t  queue_time;   /*!< the histogram of the time the task waits in the ready queue before it gets executed */
 } _accu_t;
 
 /**
@@ -45,7 +74,8 @@ typedef struct {
  **/
 typedef struct {
 	sched_service_node_id_t cur_node; /*!< the current node that is being measured */
-	struct timespec start_time;       /*!< the timestamp when the timer started */
+	struct timespec start_time;       /*!< the thread CPU time when the timer started */
+	uint64_t        start_ts;         /*!< the wall clock timestamp when the timer started */
 	uintpad_t __padding__[0];
 	_accu_t  data[0];                 /*!< the actual array */
 } _prof_array_t;
@@ -56,8 +86,12 @@ STATIC_ASSERTION_LAST(_prof_array_t, data);
  * @brief the actual data structure for a profiler
  **/
 struct _sched_prof_t {
+	const sched_service_t*  service;     /*!< the service that is being profiled */
 	sched_service_node_id_t serv_size;   /*!< the size of the service graph */
 	thread_pset_t*          thread_data; /*!< the thread data */
+	time_t                  last_export; /*!< the last time we exported the histogram file */
+	sched_prof_t*           prev;        /*!< the previous profiler in the active profiler list */
+	sched_prof_t*           next;        /*!< the next profiler in the active profiler list */
 };
 
 /**
@@ -70,6 +104,117 @@ static uint32_t _prof_enabled = 0;
  **/
 static FILE* _prof_output;
 
+/**
+ * @brief the path to the histogram file, NULL if we do not export the histograms
+ **/
+static char* _hist_path;
+
+/**
+ * @brief the list of the profilers which are not disposed yet, the most recently created one comes first
+ * @note the list is used by sched_prof_report, which may be called from the daemon control thread
+ **/
+static sched_prof_t* _active;
+
+/**
+ * @brief the mutex protects the active profiler list
+ **/
+static pthread_mutex_t _active_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t sched_prof_hist_bucket(uint64_t value)
+{
+	if(value < _HIST_SUB_BUCKETS) return (uint32_t)value;
+
+	uint32_t msb = 63u - (uint32_t)__builtin_clzll(value);
+
+	if(msb >= SCHED_PROF_HISTOGRAM_MAX_BITS) return SCHED_PROF_HIST_NUM_BUCKETS - 1;
+
+	uint32_t sub = (uint32_t)(value >> (msb - SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS)) & (_HIST_SUB_BUCKETS - 1);
+
+	return (msb - SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS + 1) * _HIST_SUB_BUCKETS + sub;
+}
+
+uint64_t sched_prof_hist_bucket_value(uint32_t bucket)
+{
+	if(bucket >= SCHED_PROF_HIST_NUM_BUCKETS) bucket = SCHED_PROF_HIST_NUM_BUCKETS - 1;
+
+	if(bucket < _HIST_SUB_BUCKETS) return bucket;
+
+	uint32_t shift = bucket / _HIST_SUB_BUCKETS - 1;
+	uint64_t low = ((uint64_t)(_HIST_SUB_BUCKETS + bucket % _HIST_SUB_BUCKETS)) << shift;
+
+	return low + (1ull << shift) - 1;
+}
+
+/**
+ * @brief add a sample to the histogram owned by current thread
+ * @param hist the histogram
+ * @param value the value in ns
+ * @return nothing
+ **/
+static inline void _hist_add(_hist_t* hist, uint64_t value)
+{
+	uint64_t* cell = hist->count + sched_prof_hist_bucket(value);
+	__atomic_store_n(cell, *cell + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief merge the histogram to the result histogram
+ * @param result the result histogram
+ * @param hist the histogram to merge, which may be written by other thread at the same time
+ * @return nothing
+ **/
+static inline void _hist_merge(_hist_t* result, const _hist_t* hist)
+{
+	uint32_t i;
+	for(i = 0; i < SCHED_PROF_HIST_NUM_BUCKETS; i ++)
+		result->count[i] += __atomic_load_n(hist->count + i, __ATOMIC_RELAXED);
+}
+
+uint64_t sched_prof_hist_percentile(const uint64_t* count, uint64_t total, uint32_t permille)
+{
+	if(NULL == count || total == 0 || permille > 1000) return 0;
+
+	uint64_t rank = (total * permille + 999) / 1000, seen = 0;
+	uint32_t i;
+
+	if(rank == 0) rank = 1;
+
+	for(i = 0; i < SCHED_PROF_HIST_NUM_BUCKETS; i ++)
+		if((seen += count[i]) >= rank)
+			return sched_prof_hist_bucket_value(i);
+
+	return sched_prof_hist_bucket_value(SCHED_PROF_HIST_NUM_BUCKETS - 1);
+}
+
+/**
+ * @brief get the number of samples in the histogram
+ * @param hist the histogram
+ * @return the number of samples
+ **/
+static inline uint64_t _hist_total(const _hist_t* hist)
+{
+	uint64_t ret = 0;
+	uint32_t i;
+	for(i = 0; i < SCHED_PROF_HIST_NUM_BUCKETS; i ++)
+		ret += hist->count[i];
+	return ret;
+}
+
+/**
+ * @brief write the percentiles of the histogram to the file
+ * @param fp the file
+ * @param hist the histogram
+ * @return nothing
+ **/
+static inline void _hist_write(FILE* fp, const _hist_t* hist)
+{
+	uint64_t total = _hist_total(hist);
+	uint32_t i;
+
+	for(i = 0; i < sizeof(_percentiles) / sizeof(_percentiles[0]); i ++)
+		fprintf(fp, "\t%"PRIu64, sched_prof_hist_percentile(hist->count, total, _percentiles[i]));
+}
+
 /**
  * @brief create a new profiler array with n slots
  * @param tid the thread id
@@ -85,10 +230,10 @@ static inline void* _prof_array_new(uint32_t tid, const void* caller)
 
 	_prof_array_t* ret = (_prof_array_t*)calloc(1, size);
 
-	ret->cur_node = ERROR_CODE(sched_service_node_id_t);
-
 	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allcoate memory for the profiler array");
 
+	ret->cur_node = ERROR_CODE(sched_service_node_id_t);
+
 	return ret;
 }
 
@@ -106,6 +251,107 @@ static inline int _prof_array_free(void* arr, const void* caller)
 	return 0;
 }
 
+/**
+ * @brief merge the histograms of all the threads and write the percentiles of each node as a TSV table
+ * @details the first line is the column names, which starts with '#', and then a line for each node
+ * @param fp the output file
+ * @param prof the profiler, NULL if we only write the column names
+ * @return status code
+ **/
+static inline int _write_histogram(FILE* fp, const sched_prof_t* prof)
+{
+	static const char* const metrics[] = {"wall", "cpu", "queue"};
+	sched_service_node_id_t i;
+	uint32_t j, k;
+
+	fputs("#node\tservlet\tcount", fp);
+	for(j = 0; j < sizeof(metrics) / sizeof(metrics[0]); j ++)
+		for(k = 0; k < sizeof(_percentiles) / sizeof(_percentiles[0]); k ++)
+			fprintf(fp, "\t%s_%s", metrics[j], _percentile_names[k]);
+	fputs("\n", fp);
+
+	if(NULL == prof) return 0;
+
+	_accu_t* merged = (_accu_t*)calloc(prof->serv_size, sizeof(_accu_t));
+	if(NULL == merged) ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the merged histogram");
+
+	/* The old pointer arrays are kept until the pointer set is disposed, so the array we read is always valid */
+	if((errno = pthread_mutex_lock(&prof->thread_data->resize_lock)) != 0)
+	{
+		free(merged);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the resize lock of the thread data");
+	}
+
+	const thread_pointer_array_t* arr = prof->thread_data->array;
+
+	if((errno = pthread_mutex_unlock(&prof->thread_data->resize_lock)) != 0)
+	{
+		free(merged);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the resize lock of the thread data");
+	}
+
+	for(j = 0; j < arr->size; j ++)
+	{
+		const _prof_array_t* acc = (const _prof_array_t*)arr->ptr[j];
+		if(NULL == acc) continue;
+		for(i = 0; i < prof->serv_size; i ++)
+		{
+			_hist_merge(&merged[i].wall_time, &acc->data[i].wall_time);
+			_hist_merge(&merged[i].cpu_time, &acc->data[i].cpu_time);
+			_hist_merge(&merged[i].queue_time, &acc->data[i].queue_time);
+		}
+	}
+
+	for(i = 0; i < prof->serv_size; i ++)
+	{
+		uint32_t argc = 0;
+		char const* const* argv = sched_service_get_node_args(prof->service, i, &argc);
+
+		fprintf(fp, "%u\t%s\t%"PRIu64, i, (NULL != argv && argc > 0) ? argv[0] : "-", _hist_total(&merged[i].wall_time));
+		_hist_write(fp, &merged[i].wall_time);
+		_hist_write(fp, &merged[i].cpu_time);
+		_hist_write(fp, &merged[i].queue_time);
+		fputs("\n", fp);
+	}
+
+	free(merged);
+	return 0;
+}
+
+/**
+ * @brief write the histogram table of the profiler to the histogram file
+ * @note the file is written to a temporary file first and then renamed, so the reader never sees a partial file
+ * @param prof the profiler
+ * @return status code
+ **/
+static inline int _export_histogram(sched_prof_t* prof)
+{
+	if(NULL == _hist_path) return 0;
+
+	char tmp_path[PATH_MAX];
+	FILE* fp;
+
+	if(snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _hist_path) >= (int)sizeof(tmp_path))
+		ERROR_RETURN_LOG(int, "The histogram file path is too long");
+
+	if(NULL == (fp = fopen(tmp_path, "w")))
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot open the histogram file %s", tmp_path);
+
+	if(ERROR_CODE(int) == _write_histogram(fp, prof))
+	{
+		fclose(fp);
+		ERROR_RETURN_LOG(int, "Cannot write the histogram file");
+	}
+
+	if(fclose(fp) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot close the histogram file");
+
+	if(rename(tmp_path, _hist_path) < 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot rename the histogram file to %s", _hist_path);
+
+	return 0;
+}
+
 int sched_prof_new(const sched_service_t* service, sched_prof_t** result)
 {
 	if(NULL == service || NULL == result) ERROR_RETURN_LOG(int, "Invalid arguments");
@@ -125,12 +371,25 @@ int sched_prof_new(const sched_service_t* service, sched_prof_t** result)
 
 	sched_prof_t* ret = NULL;
 	ret = (sched_prof_t*)malloc(sizeof(sched_prof_t));
-	ret->thread_data = NULL;
 
 	if(NULL == ret) ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the profiler");
+	ret->thread_data = NULL;
+	ret->service = service;
 	ret->serv_size = serv_size;
+	ret->last_export = 0;
+	ret->prev = NULL;
 	if(NULL == (ret->thread_data = thread_pset_new(SCHED_PROF_INIT_THREAD_CAPACITY, _prof_array_new, _prof_array_free, ret)))
 		ERROR_LOG_GOTO(ERR, "Cannot create thread data array");
+
+	if((errno = pthread_mutex_lock(&_active_mutex)) != 0)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot acquire the active profiler list mutex");
+
+	if(NULL != (ret->next = _active)) _active->prev = ret;
+	_active = ret;
+
+	if((errno = pthread_mutex_unlock(&_active_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the active profiler list mutex");
+
 	*result = ret;
 	return 0;
 ERR:
@@ -144,13 +403,71 @@ int sched_prof_free(sched_prof_t* prof)
 	if(NULL == prof) ERROR_RETURN_LOG(int, "Invalid arguments");
 
 	int rc = 0;
-	rc = thread_pset_free(prof->thread_data);
+
+	/* Make sure nobody is reading the histograms, since we are going to dispose them */
+	if((errno = pthread_mutex_lock(&_active_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the active profiler list mutex");
+
+	if(NULL != prof->prev) prof->prev->next = prof->next;
+	else _active = prof->next;
+	if(NULL != prof->next) prof->next->prev = prof->prev;
+
+	if((errno = pthread_mutex_unlock(&_active_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the active profiler list mutex");
+
+	if(ERROR_CODE(int) == _export_histogram(prof))
+	{
+		LOG_WARNING("Cannot export the profiler histogram");
+		rc = ERROR_CODE(int);
+	}
+
+	if(ERROR_CODE(int) == thread_pset_free(prof->thread_data))
+		rc = ERROR_CODE(int);
 	free(prof);
 
 	return rc;
 }
 
-int sched_prof_start_timer(sched_prof_t* prof, sched_service_node_id_t node)
+char* sched_prof_report(void)
+{
+	char* ret = NULL;
+	size_t size = 0;
+	int rc = ERROR_CODE(int);
+
+	FILE* fp = open_memstream(&ret, &size);
+	if(NULL == fp) ERROR_PTR_RETURN_LOG_ERRNO("Cannot open the memory stream for the report");
+
+	if((errno = pthread_mutex_lock(&_active_mutex)) != 0)
+		ERROR_LOG_ERRNO_GOTO(RET, "Cannot acquire the active profiler list mutex");
+
+	rc = _write_histogram(fp, _active);
+
+	if((errno = pthread_mutex_unlock(&_active_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the active profiler list mutex");
+RET:
+	if(fclose(fp) != 0)
+	{
+		LOG_ERROR_ERRNO("Cannot close the memory stream");
+		rc = ERROR_CODE(int);
+	}
+
+	if(ERROR_CODE(int) == rc)
+	{
+		free(ret);
+		ERROR_PTR_RETURN_LOG("Cannot produce the profiler report");
+	}
+
+	return ret;
+}
+
+uint64_t sched_prof_timestamp(void)
+{
+	struct timespec ts;
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0) return 0;
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int sched_prof_start_timer(sched_prof_t* prof, sched_service_node_id_t node, uint64_t ready_ts)
 {
 	if(NULL == prof || ERROR_CODE(sched_service_node_id_t) == node || node >= prof->serv_size)
 		ERROR_RETURN_LOG(int, "Invalid arguments");
@@ -163,9 +480,14 @@ int sched_prof_start_timer(sched_prof_t* prof, sched_service_node_id_t node)
 		ERROR_RETURN_LOG(int, "Previous profiler session is not closed yet");
 
 	acc->cur_node = node;
-	if(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &acc->start_time) < 0)
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &acc->start_time) < 0)
 		ERROR_RETURN_LOG_ERRNO(int, "Cannot get the start timestamp");
 
+	acc->start_ts = sched_prof_timestamp();
+
+	if(ready_ts > 0 && acc->start_ts >= ready_ts)
+		_hist_add(&acc->data[node].queue_time, acc->start_ts - ready_ts);
+
 	return 0;
 }
 
@@ -184,9 +506,11 @@ int sched_prof_stop_timer(sched_prof_t* prof)
 	acc->cur_node = ERROR_CODE(sched_service_node_id_t);
 
 	struct timespec end_time;
-	if(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end_time) < 0)
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end_time) < 0)
 		ERROR_RETURN_LOG_ERRNO(int, "Cannot get the end timestamp");
 
+	uint64_t end_ts = sched_prof_timestamp();
+
 
 	uint64_t time = ((uint64_t)(end_time.tv_sec - acc->start_time.tv_sec) * 1000000000ull);
 
@@ -198,6 +522,9 @@ int sched_prof_stop_timer(sched_prof_t* prof)
 	cell->exec_count ++;
 	cell->total_time += time;
 
+	_hist_add(&cell->cpu_time, time);
+	_hist_add(&cell->wall_time, end_ts >= acc->start_ts ? end_ts - acc->start_ts : 0);
+
 	return 0;
 }
 
@@ -235,7 +562,17 @@ int sched_prof_flush(sched_prof_t* prof)
 		funlockfile(_prof_output);
 	}
 
-	memset(acc->data, 0, sizeof(_accu_t) * size);
+	for(i = 0; i < size; i ++)
+		acc->data[i].total_time = acc->data[i].exec_count = 0;
+
+	time_t now = time(NULL);
+	time_t last = __atomic_load_n(&prof->last_export, __ATOMIC_RELAXED);
+
+	/* Only one thread can win the race, so the histogram file is written by one thread at a time */
+	if(NULL != _hist_path && now - last >= SCHED_PROF_HISTOGRAM_EXPORT_INTERVAL &&
+	   __atomic_compare_exchange_n(&prof->last_export, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED) &&
+	   ERROR_CODE(int) == _export_histogram(prof))
+		LOG_WARNING("Cannot export the profiler histogram");
 
 	return 0;
 }
@@ -272,6 +609,18 @@ static inline int _set_prop(const char* symbol, lang_prop_value_t value, const v
 			if(NULL == _prof_output) ERROR_RETURN_LOG(int, "Cannot open the output file");
 		}
 	}
+	else if(strcmp(symbol, "histogram") == 0)
+	{
+		if(value.type != LANG_PROP_TYPE_STRING) ERROR_RETURN_LOG(int, "Type mistach");
+		const char* path = value.str;
+		if(NULL == path) ERROR_RETURN_LOG(int, "Cannot get the string value");
+
+		if(NULL != _hist_path) free(_hist_path);
+		_hist_path = NULL;
+
+		if(path[0] != 0 && NULL == (_hist_path = strdup(path)))
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot duplicate the histogram file path");
+	}
 	else
 	{
 		LOG_WARNING("Unrecognized symbol name %s", symbol);
@@ -281,11 +630,39 @@ static inline int _set_prop(const char* symbol, lang_prop_value_t value, const v
 	return 1;
 }
 
+static inline lang_prop_value_t _get_prop(const char* symbol, const void* data)
+{
+	(void) data;
+	lang_prop_value_t ret = {
+		.type = LANG_PROP_TYPE_NONE
+	};
+
+	if(NULL == symbol)
+	{
+		LOG_ERROR("Invalid arguments");
+		ret.type = LANG_PROP_TYPE_ERROR;
+		return ret;
+	}
+
+	if(strcmp(symbol, "report") == 0)
+	{
+		if(NULL == (ret.str = sched_prof_report()))
+		{
+			LOG_ERROR("Cannot produce the profiler report");
+			ret.type = LANG_PROP_TYPE_ERROR;
+			return ret;
+		}
+		ret.type = LANG_PROP_TYPE_STRING;
+	}
+
+	return ret;
+}
+
 int sched_prof_init()
 {
 	lang_prop_callback_t cb = {
 		.param = NULL,
-		.get   = NULL,
+		.get   = _get_prop,
 		.set   = _set_prop,
 		.symbol_prefix = "profiler"
 	};
@@ -300,5 +677,8 @@ int sched_prof_finalize()
 {
 	if(NULL != _prof_output) fclose(_prof_output);
 
+	if(NULL != _hist_path) free(_hist_path);
+	_hist_path = NULL;
+
 	return 0;
 }
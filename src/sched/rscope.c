@@ -7,22 +7,61 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include <error.h>
 #include <utils/log.h>
+#include <utils/static_assertion.h>
 #include <utils/mempool/objpool.h>
+#include <utils/mempool/page.h>
 
 #include <runtime/api.h>
 #include <sched/rscope.h>
 
 #define _NULL_ENTRY ERROR_CODE(runtime_api_scope_token_t)
 
+/**
+ * @brief the header of a page owned by the request arena
+ **/
+typedef struct _arena_page_t {
+	struct _arena_page_t*     next;     /*!< the next page in the arena */
+	uintpad_t                 __padding__[0];
+	char                      data[0];  /*!< the memory for the allocations */
+} _arena_page_t;
+STATIC_ASSERTION_LAST(_arena_page_t, data);
+STATIC_ASSERTION_SIZE(_arena_page_t, data, 0);
+
+/**
+ * @brief the header of a large allocation which doesn't fit in an arena page
+ **/
+typedef struct _arena_large_t {
+	struct _arena_large_t*    next;     /*!< the next large allocation */
+	uintpad_t                 __padding__[0];
+	char                      data[0];  /*!< the allocated memory */
+} _arena_large_t;
+STATIC_ASSERTION_LAST(_arena_large_t, data);
+STATIC_ASSERTION_SIZE(_arena_large_t, data, 0);
+
+/**
+ * @brief the request arena, the memory allocated from the arena is released all at once when the arena is gone
+ * @note  Normally the arena dies with the request scope. But if an entity of the scope is still being streamed by
+ *        the async loop when the scope is disposed, the entity holds a reference to the arena, because the entity
+ *        data may be allocated from the arena
+ **/
+typedef struct {
+	uint32_t                  refcnt;   /*!< the reference counter */
+	size_t                    used;     /*!< the number of bytes used in the first page */
+	_arena_page_t*            pages;    /*!< the page list, the first page is the one we are currently allocating from */
+	_arena_large_t*           large;    /*!< the large allocation list */
+} _arena_t;
+
 /**
  * @brief the actual data type for the request local scope
  **/
 struct _sched_rscope_t {
 	uint64_t                  id;       /*!< the identifier for current scope */
 	runtime_api_scope_token_t head;     /*!< the head of the linked list */
+	_arena_t*                 arena;    /*!< the request arena, NULL if nothing has been allocated from it */
 };
 
 /**
@@ -31,6 +70,7 @@ struct _sched_rscope_t {
 typedef struct {
 	runtime_api_scope_entity_t    entity;   /*!< the scope entity */
 	uint32_t                      refcnt;   /*!< the reference counter, this is needed because when the token is taken by the async loop, we want it alive until the stream dead */
+	_arena_t*                     arena;    /*!< the arena this entity keeps alive, only set when the entity outlives its scope */
 } _scope_entity_t;
 
 /**
@@ -55,19 +95,51 @@ struct _sched_rscope_stream_t {
 };
 
 /**
- * @brief this is the actual thread local data storage for each scheduler loop
+ * @brief the header of a page in the scope entry table
  * @note We distinuish the concept of cached and unused. When the entry is assigned to one request, it will be in use
- *       however, once the entry is deallocated, the entry will be added to the cached list and will be in cached state
- *       rather than unused.
- *       The only case we have unused entry is after memory is allocated and the entry is either in use or cached. <br/>
+ *       however, once the entry is deallocated, the entry will be added to the free list of the page and will be in
+ *       cached state rather than unused.
+ *       The only case we have unused entry is after the page is allocated and the entry is either in use or cached. <br/>
+ *       Each page has its own free list, thus once all the entries of the page are released, the page can be returned
+ *       to the page pool without touching any other page.
+ **/
+typedef struct {
+	uint32_t                  used;     /*!< how many entries in this page are currently in use */
+	uint32_t                  unused;   /*!< the range [unused, entries per page) is the unused entries */
+	uint32_t                  cached;   /*!< the offset of the first cached entry in this page, _NULL_ENTRY if none */
+	uint32_t                  prev;     /*!< the previous page in the available page list */
+	uint32_t                  next;     /*!< the next page in the available page list */
+	uintpad_t                 __padding__[0];
+	_entry_t                  entries[0]; /*!< the entries in this page */
+} _entry_page_t;
+STATIC_ASSERTION_LAST(_entry_page_t, entries);
+STATIC_ASSERTION_SIZE(_entry_page_t, entries, 0);
+
+/**
+ * @brief this is the actual thread local data storage for each scheduler loop
+ * @details The table is a two level structure, the page directory and the entry pages. The token is the index of the
+ *          page in the directory followed by the offset of the entry in the page. The directory is allocated at its
+ *          full size (SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT entries) when the thread starts, so growing the table
+ *          only means appending a new page, and the existing entries are never moved. <br/>
+ *          The pages which have at least one free entry are linked in the available page list, and the allocation
+ *          always takes the entry from the head of this list.
  **/
 static __thread struct {
-	uint32_t                  capacity;   /*!< how many items in the table */
-	runtime_api_scope_token_t cached;     /*!< the head of cached unused token list */
-	runtime_api_scope_token_t unused;     /*!< the range [unused, capacity) is the unused list */
-	_entry_t*                 data;       /*!< the actual entry table */
+	_entry_page_t**           pages;      /*!< the page directory, NULL if the slot is not allocated */
+	uint32_t                  avail;      /*!< the head of the available page list, _NULL_ENTRY if the list is empty */
+	uint32_t                  hole;       /*!< all the directory slots before this index are occupied */
 } _entry_table;
 
+/**
+ * @brief log2 of the number of entries in each page of the scope entry table
+ **/
+static uint32_t _entry_page_shift;
+
+/**
+ * @brief the number of slots in the page directory
+ **/
+static uint32_t _entry_dir_size;
+
 /**
  * @brief the memory pool that is used to allocate the request local scope object
  **/
@@ -83,6 +155,26 @@ static mempool_objpool_t* _entity_pool;
  **/
 static mempool_objpool_t* _stream_pool;
 
+/**
+ * @brief the memory pool that is used to allocate the request arena object
+ **/
+static mempool_objpool_t* _arena_pool;
+
+/**
+ * @brief the size of a page from the page pool, which is used by both the entry table and the arena
+ **/
+static size_t _page_size;
+
+/**
+ * @brief the accounting counter for the scope entry tables of all the scheduler threads
+ **/
+static mempool_acct_t* _table_acct;
+
+/**
+ * @brief the accounting counter for the pages owned by the request arenas
+ **/
+static mempool_acct_t* _arena_acct;
+
 int sched_rscope_init()
 {
 	if(NULL == (_rscope_pool = mempool_objpool_new(sizeof(sched_rscope_t))))
@@ -94,6 +186,27 @@ int sched_rscope_init()
 	if(NULL == (_entity_pool = mempool_objpool_new(sizeof(_scope_entity_t))))
 		ERROR_RETURN_LOG(int, "Cannot allocate scope entity object pool");
 
+	if(NULL == (_arena_pool = mempool_objpool_new(sizeof(_arena_t))))
+		ERROR_RETURN_LOG(int, "Cannot allocate request arena object pool");
+
+	int page_size = getpagesize();
+	if(page_size < 0 || (size_t)page_size <= sizeof(_arena_page_t) || (size_t)page_size < sizeof(_entry_page_t) + sizeof(_entry_t))
+		ERROR_RETURN_LOG(int, "Invalid page size");
+
+	_page_size = (size_t)page_size;
+
+	/* Use the largest power of 2 which fits in the page, so that the token can be split with shift and mask */
+	size_t entries_per_page = (_page_size - sizeof(_entry_page_t)) / sizeof(_entry_t);
+	for(_entry_page_shift = 0; ((size_t)2 << _entry_page_shift) <= entries_per_page; _entry_page_shift ++);
+
+	_entry_dir_size = (SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT + (1u << _entry_page_shift) - 1) >> _entry_page_shift;
+
+	if(NULL == (_table_acct = mempool_acct_counter("rscope.entry_table")))
+		ERROR_RETURN_LOG(int, "Cannot get the accounting counter for the scope entry table");
+
+	if(NULL == (_arena_acct = mempool_acct_counter("rscope.arena")))
+		ERROR_RETURN_LOG(int, "Cannot get the accounting counter for the request arena");
+
 	return 0;
 }
 
@@ -118,6 +231,55 @@ int sched_rscope_finalize()
 		LOG_ERROR("Cannot dispose the object pool for scope entities");
 	}
 
+	if(NULL != _arena_pool && ERROR_CODE(int) == mempool_objpool_free(_arena_pool))
+	{
+		rc = ERROR_CODE(int);
+		LOG_ERROR("Cannot dispose the object pool for request arenas");
+	}
+
+	return rc;
+}
+
+/**
+ * @brief release a reference to the arena, and dispose the arena when this is the last reference
+ * @note this may be called from the async loop if the arena is kept alive by a stream
+ * @param arena the arena
+ * @return status code
+ **/
+static inline int _arena_release(_arena_t* arena)
+{
+	if(__sync_sub_and_fetch(&arena->refcnt, 1) > 0)
+		return 0;
+
+	int rc = 0;
+
+	_arena_page_t* page;
+	for(page = arena->pages; NULL != page;)
+	{
+		_arena_page_t* cur = page;
+		page = page->next;
+		if(ERROR_CODE(int) == mempool_page_dealloc(cur))
+		{
+			LOG_ERROR("Cannot deallocate the arena page");
+			rc = ERROR_CODE(int);
+		}
+		else mempool_acct_update(_arena_acct, -(int64_t)_page_size);
+	}
+
+	_arena_large_t* large;
+	for(large = arena->large; NULL != large;)
+	{
+		_arena_large_t* cur = large;
+		large = large->next;
+		free(cur);
+	}
+
+	if(ERROR_CODE(int) == mempool_objpool_dealloc(_arena_pool, arena))
+	{
+		LOG_ERROR("Cannot deallocate the arena object");
+		rc = ERROR_CODE(int);
+	}
+
 	return rc;
 }
 
@@ -142,12 +304,21 @@ static inline int _dispose_scope_entity(_scope_entity_t* entity)
 			LOG_ERROR("The entity free callback returns an error code");
 			rc = ERROR_CODE(int);
 		}
+		/* The entity data may live in the arena, so we can only release the arena after the data is disposed */
+		_arena_t* arena = entity->arena;
+
 		if(ERROR_CODE(int) == mempool_objpool_dealloc(_entity_pool, entity))
 		{
 			LOG_ERROR("Cannot dispose the entity object");
 			rc = ERROR_CODE(int);
 		}
 
+		if(NULL != arena && ERROR_CODE(int) == _arena_release(arena))
+		{
+			LOG_ERROR("Cannot release the request arena");
+			rc = ERROR_CODE(int);
+		}
+
 		return rc;
 	}
 
@@ -156,13 +327,14 @@ static inline int _dispose_scope_entity(_scope_entity_t* entity)
 
 int sched_rscope_init_thread()
 {
-	_entry_table.capacity = SCHED_RSCOPE_ENTRY_TABLE_INIT_SIZE;
-	_entry_table.cached   = _NULL_ENTRY;
-	_entry_table.unused   = 0;
-	_entry_table.data     = (_entry_t*)malloc(sizeof(_entry_table.data[0]) * _entry_table.capacity);
+	_entry_table.avail = _NULL_ENTRY;
+	_entry_table.hole  = 0;
+	_entry_table.pages = (_entry_page_t**)calloc(_entry_dir_size, sizeof(_entry_table.pages[0]));
 
-	if(NULL == _entry_table.data)
-		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the scope entry table");
+	if(NULL == _entry_table.pages)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the scope entry page directory");
+
+	mempool_acct_update(_table_acct, (int64_t)(sizeof(_entry_table.pages[0]) * _entry_dir_size));
 
 	return 0;
 }
@@ -171,66 +343,190 @@ int sched_rscope_finalize_thread()
 {
 	int rc = 0;
 
-	if(NULL != _entry_table.data)
+	if(NULL != _entry_table.pages)
 	{
-		runtime_api_scope_token_t i;
-		for(i = 0; i < _entry_table.unused; i ++)
-			if(_entry_table.data[i].data != NULL && ERROR_CODE(int) == _dispose_scope_entity(_entry_table.data[i].data))
+		uint32_t i, j;
+		for(i = 0; i < _entry_dir_size; i ++)
+		{
+			_entry_page_t* page = _entry_table.pages[i];
+			if(NULL == page) continue;
+
+			for(j = 0; j < page->unused; j ++)
+				if(page->entries[j].data != NULL && ERROR_CODE(int) == _dispose_scope_entity(page->entries[j].data))
+					rc = ERROR_CODE(int);
+
+			if(ERROR_CODE(int) == mempool_page_dealloc(page))
+			{
+				LOG_ERROR("Cannot deallocate the scope entry page");
 				rc = ERROR_CODE(int);
-		free(_entry_table.data);
+			}
+			else mempool_acct_update(_table_acct, -(int64_t)_page_size);
+		}
+
+		free(_entry_table.pages);
+		mempool_acct_update(_table_acct, -(int64_t)(sizeof(_entry_table.pages[0]) * _entry_dir_size));
+		_entry_table.pages = NULL;
 	}
 
 	return rc;
 }
 
+/**
+ * @brief get the entry for the given token
+ * @param token the token
+ * @return the entry, NULL if the token is not a valid token
+ **/
+static inline _entry_t* _entry_get(runtime_api_scope_token_t token)
+{
+	uint32_t page_idx = token >> _entry_page_shift;
+	uint32_t offset = token & ((1u << _entry_page_shift) - 1);
+
+	if(page_idx >= _entry_dir_size || NULL == _entry_table.pages[page_idx] || offset >= _entry_table.pages[page_idx]->unused)
+		return NULL;
+
+	return _entry_table.pages[page_idx]->entries + offset;
+}
+
+/**
+ * @brief add the page to the head of the available page list
+ * @param page_idx the index of the page
+ * @return nothing
+ **/
+static inline void _avail_push(uint32_t page_idx)
+{
+	_entry_page_t* page = _entry_table.pages[page_idx];
+
+	page->prev = _NULL_ENTRY;
+	page->next = _entry_table.avail;
+	if(_NULL_ENTRY != _entry_table.avail)
+		_entry_table.pages[_entry_table.avail]->prev = page_idx;
+	_entry_table.avail = page_idx;
+}
+
+/**
+ * @brief remove the page from the available page list
+ * @param page_idx the index of the page
+ * @return nothing
+ **/
+static inline void _avail_remove(uint32_t page_idx)
+{
+	_entry_page_t* page = _entry_table.pages[page_idx];
+
+	if(_NULL_ENTRY == page->prev)
+		_entry_table.avail = page->next;
+	else
+		_entry_table.pages[page->prev]->next = page->next;
+
+	if(_NULL_ENTRY != page->next)
+		_entry_table.pages[page->next]->prev = page->prev;
+}
+
+/**
+ * @brief append a new page to the entry table
+ * @return status code
+ **/
+static inline int _entry_page_new(void)
+{
+	uint32_t page_idx;
+	for(page_idx = _entry_table.hole; page_idx < _entry_dir_size && NULL != _entry_table.pages[page_idx]; page_idx ++);
+
+	if(page_idx >= _entry_dir_size)
+		ERROR_RETURN_LOG(int, "The entry table size reach the limit (SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT), which is %u",
+		                 SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT);
+
+	_entry_page_t* page = (_entry_page_t*)mempool_page_alloc();
+	if(NULL == page)
+		ERROR_RETURN_LOG(int, "Cannot allocate new page for the scope entry table");
+
+	mempool_acct_update(_table_acct, (int64_t)_page_size);
+
+	page->used   = 0;
+	page->unused = 0;
+	page->cached = _NULL_ENTRY;
+
+	_entry_table.pages[page_idx] = page;
+	_entry_table.hole = page_idx + 1;
+	_avail_push(page_idx);
+
+	LOG_DEBUG("Request local scope entry page %u has been allocated", page_idx);
+
+	return 0;
+}
+
 /**
  * @brief allocate a new entry object from the entry table
  * @return the entry table that has been allocated, or error code
  **/
 static inline runtime_api_scope_token_t _entry_alloc(void)
 {
-	runtime_api_scope_token_t ret = _NULL_ENTRY;
-
-	/* First, we need to check if there's an cached entry */
-	if(_entry_table.cached != _NULL_ENTRY)
-	{
-		ret = _entry_table.cached;
-		_entry_table.cached = _entry_table.data[ret].next;
+	if(_NULL_ENTRY == _entry_table.avail && ERROR_CODE(int) == _entry_page_new())
+		ERROR_RETURN_LOG(runtime_api_scope_token_t, "Cannot grow the entry table");
 
-		if(NULL == (_entry_table.data[ret].data = mempool_objpool_alloc(_entity_pool)))
-			ERROR_RETURN_LOG_ERRNO(runtime_api_scope_token_t, "Cannot allocate memory for the entity data pool");
-		else
-			memset(_entry_table.data[ret].data, 0, sizeof(*_entry_table.data[ret].data));
+	uint32_t page_idx = _entry_table.avail;
+	_entry_page_t* page = _entry_table.pages[page_idx];
 
-		return ret;
+	/* First, we need to check if there's an cached entry, otherwise we must have at least one unused entry */
+	uint32_t offset;
+	if(_NULL_ENTRY != page->cached)
+	{
+		offset = page->cached;
+		page->cached = page->entries[offset].next;
 	}
+	else offset = page->unused ++;
+
+	_entry_t* entry = page->entries + offset;
 
-	/* Then we must have at least one unused entry, otherwise we fail */
-	if(_entry_table.unused >= _entry_table.capacity)
+	if(NULL == (entry->data = mempool_objpool_alloc(_entity_pool)))
 	{
-		if(_entry_table.capacity * 2 > SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT)
-			ERROR_RETURN_LOG(runtime_api_scope_token_t,
-			                 "The entry table size reach the limit "
-			                 "(SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT), which is %u",
-			                 SCHED_RSCOPE_ENTRY_TABLE_SIZE_LIMIT);
-		LOG_DEBUG("Request local scope entry table needs to be resized to %u", _entry_table.capacity * 2);
-		_entry_t* new_table = (_entry_t*)realloc(_entry_table.data, sizeof(_entry_table.data[0]) * _entry_table.capacity * 2);
-		if(NULL == new_table)
-			ERROR_RETURN_LOG_ERRNO(runtime_api_scope_token_t, "Cannot resize the entry table");
-		_entry_table.data = new_table;
-		_entry_table.capacity *= 2;
+		entry->next = page->cached;
+		page->cached = offset;
+		ERROR_RETURN_LOG_ERRNO(runtime_api_scope_token_t, "Cannot allocate memory for the entity data pool");
 	}
 
-	ret = _entry_table.unused;
-	if(NULL == (_entry_table.data[ret].data = mempool_objpool_alloc(_entity_pool)))
-		ERROR_RETURN_LOG_ERRNO(runtime_api_scope_token_t, "Cannot allocate memory for the entity data pool");
-	else
-		memset(_entry_table.data[ret].data, 0, sizeof(*_entry_table.data[ret].data));
+	memset(entry->data, 0, sizeof(*entry->data));
+	entry->next = _NULL_ENTRY;
 
-	_entry_table.data[ret].next = _NULL_ENTRY;
-	_entry_table.unused ++;
+	if(++ page->used == (1u << _entry_page_shift))
+		_avail_remove(page_idx);
 
-	return ret;
+	return (page_idx << _entry_page_shift) | offset;
+}
+
+/**
+ * @brief return the entry to the entry table
+ * @note  If all the entries in the page are released, the page will be returned to the page pool, unless this is the
+ *        only available page, which prevents the table from allocating and releasing the same page repeatedly
+ * @param token the token of the entry
+ * @return status code
+ **/
+static inline int _entry_dealloc(runtime_api_scope_token_t token)
+{
+	uint32_t page_idx = token >> _entry_page_shift;
+	uint32_t offset = token & ((1u << _entry_page_shift) - 1);
+	_entry_page_t* page = _entry_table.pages[page_idx];
+
+	page->entries[offset].data = NULL;
+	page->entries[offset].next = page->cached;
+	page->cached = offset;
+
+	if(page->used -- == (1u << _entry_page_shift))
+		_avail_push(page_idx);
+
+	if(page->used > 0 || (_entry_table.avail == page_idx && _NULL_ENTRY == page->next))
+		return 0;
+
+	_avail_remove(page_idx);
+	_entry_table.pages[page_idx] = NULL;
+	if(page_idx < _entry_table.hole) _entry_table.hole = page_idx;
+
+	if(ERROR_CODE(int) == mempool_page_dealloc(page))
+		ERROR_RETURN_LOG(int, "Cannot deallocate the scope entry page");
+
+	mempool_acct_update(_table_acct, -(int64_t)_page_size);
+
+	LOG_DEBUG("Request local scope entry page %u has been released", page_idx);
+
+	return 0;
 }
 
 sched_rscope_t* sched_rscope_new()
@@ -242,8 +538,9 @@ sched_rscope_t* sched_rscope_new()
 	if(NULL == ret)
 		ERROR_PTR_RETURN_LOG("Cannot allocate memory for the request local scope");
 
-	ret->head = _NULL_ENTRY;
-	ret->id   = next_scope_id ++;
+	ret->head  = _NULL_ENTRY;
+	ret->id    = next_scope_id ++;
+	ret->arena = NULL;
 
 	LOG_DEBUG("Request local scope %"PRIu64" has been created", ret->id);
 
@@ -260,14 +557,28 @@ int sched_rscope_free(sched_rscope_t* scope)
 	for(tok = scope->head; tok != _NULL_ENTRY;)
 	{
 		runtime_api_scope_token_t cur_tok = tok;
-		_entry_t* entry = _entry_table.data + tok;
-		tok = _entry_table.data[tok].next;
+		_entry_t* entry = _entry_get(tok);
+		tok = entry->next;
+
+		/* Streams are only opened from the worker thread, so if the entity isn't referenced by any stream at this
+		 * point, it can not be referenced later. Otherwise the entity should keep the arena alive */
+		if(NULL != scope->arena && entry->data->refcnt > 1)
+		{
+			entry->data->arena = scope->arena;
+			__sync_fetch_and_add(&scope->arena->refcnt, 1);
+		}
+
 		if(ERROR_CODE(int) == _dispose_scope_entity(entry->data))
 			rc = ERROR_CODE(int);
 
-		entry->next = _entry_table.cached;
-		entry->data = NULL;
-		_entry_table.cached = cur_tok;
+		if(ERROR_CODE(int) == _entry_dealloc(cur_tok))
+			rc = ERROR_CODE(int);
+	}
+
+	if(NULL != scope->arena && ERROR_CODE(int) == _arena_release(scope->arena))
+	{
+		LOG_ERROR("Cannot release the request arena");
+		rc = ERROR_CODE(int);
 	}
 #ifdef LOG_ERROR_ENABLED
 	uint64_t scope_id = scope->id;
@@ -284,6 +595,62 @@ int sched_rscope_free(sched_rscope_t* scope)
 	return rc;
 }
 
+void* sched_rscope_arena_alloc(sched_rscope_t* scope, size_t size)
+{
+	if(NULL == scope || 0 == size || ERROR_CODE(size_t) == size)
+		ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	size = (size + sizeof(uintpad_t) - 1) & ~(sizeof(uintpad_t) - 1);
+
+	_arena_t* arena = scope->arena;
+
+	if(NULL == arena)
+	{
+		if(NULL == (arena = (_arena_t*)mempool_objpool_alloc(_arena_pool)))
+			ERROR_PTR_RETURN_LOG("Cannot allocate the request arena object");
+
+		arena->refcnt = 1;
+		arena->pages  = NULL;
+		arena->large  = NULL;
+		arena->used   = 0;
+
+		scope->arena = arena;
+	}
+
+	size_t capacity = _page_size - sizeof(_arena_page_t);
+
+	/* The large allocation doesn't go to the page, otherwise we may waste most of the page */
+	if(size > capacity / 4)
+	{
+		_arena_large_t* large = (_arena_large_t*)malloc(sizeof(_arena_large_t) + size);
+		if(NULL == large)
+			ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the large arena allocation");
+
+		large->next = arena->large;
+		arena->large = large;
+
+		return large->data;
+	}
+
+	if(NULL == arena->pages || arena->used + size > capacity)
+	{
+		_arena_page_t* page = (_arena_page_t*)mempool_page_alloc();
+		if(NULL == page)
+			ERROR_PTR_RETURN_LOG("Cannot allocate new page for the request arena");
+
+		mempool_acct_update(_arena_acct, (int64_t)_page_size);
+
+		page->next = arena->pages;
+		arena->pages = page;
+		arena->used = 0;
+	}
+
+	void* ret = arena->pages->data + arena->used;
+	arena->used += size;
+
+	return ret;
+}
+
 runtime_api_scope_token_t sched_rscope_add(sched_rscope_t* scope, const runtime_api_scope_entity_t* pointer)
 {
 	if(NULL == scope || NULL == pointer || NULL == pointer->data || NULL == pointer->free_func)
@@ -295,7 +662,7 @@ runtime_api_scope_token_t sched_rscope_add(sched_rscope_t* scope, const runtime_
 
 	LOG_DEBUG("The pointer has new entry token %u", ret);
 
-	_entry_t* entry = _entry_table.data + ret;
+	_entry_t* entry = _entry_get(ret);
 	entry->data->entity = *pointer;
 	entry->data->refcnt = 1;
 	entry->next = scope->head;
@@ -309,10 +676,12 @@ runtime_api_scope_token_t sched_rscope_add(sched_rscope_t* scope, const runtime_
 
 int sched_rscope_copy(sched_rscope_t* scope, runtime_api_scope_token_t token, sched_rscope_copy_result_t* result)
 {
-	if(NULL == scope || _NULL_ENTRY == token || token >= _entry_table.capacity || NULL == result)
+	if(NULL == scope || _NULL_ENTRY == token || NULL == result)
 		ERROR_RETURN_LOG(int, "Invalid arguments");
 
-	const _entry_t* source = _entry_table.data + token;
+	const _entry_t* source = _entry_get(token);
+	if(NULL == source || NULL == source->data)
+		ERROR_RETURN_LOG(int, "Invalid token id %u", token);
 
 	if(NULL == source->data->entity.copy_func)
 		ERROR_RETURN_LOG(int, "This entry doesn't support copy");
@@ -339,22 +708,23 @@ ERR:
 
 const void* sched_rscope_get(const sched_rscope_t* scope, runtime_api_scope_token_t token)
 {
-	if(NULL == scope || _NULL_ENTRY == token || token >= _entry_table.capacity)
+	if(NULL == scope || _NULL_ENTRY == token)
 		ERROR_PTR_RETURN_LOG("Invalid arguments");
 
-	if(_entry_table.data[token].data->entity.data == NULL ||
-	   _entry_table.data[token].scope_id != scope->id)
+	const _entry_t* entry = _entry_get(token);
+
+	if(NULL == entry || NULL == entry->data || entry->data->entity.data == NULL || entry->scope_id != scope->id)
 		ERROR_PTR_RETURN_LOG("Invalid token id, %u does not belong to scope %"PRIu64, token, scope->id);
 
-	return _entry_table.data[token].data->entity.data;
+	return entry->data->entity.data;
 }
 
 sched_rscope_stream_t* sched_rscope_stream_open(runtime_api_scope_token_t token)
 {
-	if(_NULL_ENTRY == token || token >= _entry_table.capacity || _entry_table.data[token].data == NULL)
-		ERROR_PTR_RETURN_LOG("Invalid arguments");
+	const _entry_t* target = _entry_get(token);
 
-	const _entry_t* target = _entry_table.data + token;
+	if(_NULL_ENTRY == token || NULL == target || NULL == target->data)
+		ERROR_PTR_RETURN_LOG("Invalid arguments");
 
 	if(target->data->entity.open_func == NULL || target->data->entity.close_func == NULL ||
 	   target->data->entity.read_func == NULL || target->data->entity.eos_func == NULL)
@@ -456,3 +826,29 @@ int sched_rscope_stream_get_event(sched_rscope_stream_t* stream, runtime_api_sco
 	return ent->entity.event_func(stream->handle, buf);
 }
 
+int sched_rscope_stream_get_file_region(sched_rscope_stream_t* stream, runtime_api_scope_file_region_t* buf)
+{
+	if(NULL == stream || NULL == buf)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	_scope_entity_t* ent = stream->entity;
+
+	if(ent->entity.file_region_func == NULL)
+		return 0;
+
+	return ent->entity.file_region_func(stream->handle, buf);
+}
+
+int sched_rscope_stream_donate(sched_rscope_stream_t* stream, runtime_api_scope_page_t* buf)
+{
+	if(NULL == stream || NULL == buf)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	_scope_entity_t* ent = stream->entity;
+
+	if(ent->entity.donate_func == NULL)
+		return 0;
+
+	return ent->entity.donate_func(stream->handle, buf);
+}
+
@@ -13,6 +13,7 @@ INIT_VEC(modules) = {
 	INIT_MODULE(sched_task),
 	INIT_MODULE(sched_loop),
 	INIT_MODULE(sched_prof),
+	INIT_MODULE(sched_trace),
 	INIT_MODULE(sched_rscope),
 	INIT_MODULE(sched_async),
 	INIT_MODULE(sched_daemon)
@@ -51,6 +51,7 @@ typedef struct {
 	size_t*  pipe_header_size;                  /*!< the size of pipe header */
 	runtime_task_flags_t flags;                 /*!< the additional task flags */
 	sched_service_pipe_descriptor_t* outgoing;  /*!< outgoing list */
+	const sched_service_pipe_wiring_t* wiring;  /*!< the precompiled wiring of the outgoing list, points to the service wiring table */
 	uintpad_t __padding__[0];
 	sched_service_pipe_descriptor_t incoming[0];/*!< the incoming list */
 } _node_t;
@@ -74,6 +75,7 @@ struct _sched_service_t {
 	sched_cnode_info_t*   c_nodes;        /*!< the critical node */
 	size_t node_count;                    /*!< how many nodes in this service */
 	sched_prof_t*         profiler;       /*!< the profiler for this service */
+	sched_service_pipe_wiring_t* wiring;  /*!< the flat wiring table for all the outgoing pipes, grouped by the source node */
 	uintpad_t __padding__[0];
 	_node_t*  nodes[0];                   /*!< the node list */
 };
@@ -107,6 +109,7 @@ static inline sched_service_t* _create_service(size_t num_nodes)
 	ret->node_count = num_nodes;
 	memset(ret->nodes, 0, size - sizeof(sched_service_t));
 	ret->c_nodes = NULL;
+	ret->wiring = NULL;
 	return ret;
 }
 
@@ -126,6 +129,7 @@ static inline _node_t* _create_node(runtime_stab_entry_t servlet, runtime_task_f
 	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for service node");
 
 	ret->outgoing = ret->incoming + incoming_count;
+	ret->wiring = NULL;
 	ret->incoming_count = ret->outgoing_count = 0;
 	ret->servlet_id = servlet;
 	ret->flags = flags;
@@ -477,6 +481,54 @@ static inline int _compare_src_pipe(const void* l, const void* r)
 	return 0;
 }
 
+/**
+ * @brief build the wiring table of the service
+ * @details The pipe flags and the header sizes are fixed once the type checker finishes, so
+ *          we compute the pipe param for each outgoing pipe here, rather than query them every
+ *          time the scheduler initializes the pipes for a task
+ * @param service the service to build
+ * @param num_edges the total number of edges in the service
+ * @return status code
+ **/
+static inline int _build_wiring(sched_service_t* service, size_t num_edges)
+{
+	/* Even if there's no edge at all, we still want a valid table, so that an empty table is distinguishable with an error */
+	if(NULL == (service->wiring = (sched_service_pipe_wiring_t*)malloc(sizeof(sched_service_pipe_wiring_t) * (num_edges > 0 ? num_edges : 1))))
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the wiring table");
+
+	sched_service_pipe_wiring_t* wiring = service->wiring;
+	size_t i;
+	for(i = 0; i < service->node_count; i ++)
+	{
+		_node_t* node = service->nodes[i];
+		node->wiring = wiring;
+
+		uint32_t j;
+		for(j = 0; j < node->outgoing_count; j ++, wiring ++)
+		{
+			const sched_service_pipe_descriptor_t* pd = node->outgoing + j;
+			const _node_t* dest = service->nodes[pd->destination_node_id];
+
+			runtime_api_pipe_flags_t out_flags = runtime_stab_get_pipe_flags(node->servlet_id, pd->source_pipe_desc);
+			if(ERROR_CODE(runtime_api_pipe_flags_t) == out_flags)
+				ERROR_RETURN_LOG(int, "Cannot get output pipe flags");
+
+			runtime_api_pipe_flags_t in_flags = runtime_stab_get_pipe_flags(dest->servlet_id, pd->destination_pipe_desc);
+			if(ERROR_CODE(runtime_api_pipe_flags_t) == in_flags)
+				ERROR_RETURN_LOG(int, "Cannot get input pipe flags");
+
+			wiring->desc = *pd;
+			wiring->param.output_flags  = out_flags;
+			wiring->param.output_header = node->pipe_header_size[pd->source_pipe_desc];
+			wiring->param.input_flags   = in_flags;
+			wiring->param.input_header  = dest->pipe_header_size[pd->destination_pipe_desc];
+			wiring->param.args = NULL;
+		}
+	}
+
+	return 0;
+}
+
 sched_service_t* sched_service_from_buffer(const sched_service_buffer_t* buffer)
 {
 	uint32_t i;
@@ -583,6 +635,9 @@ sched_service_t* sched_service_from_buffer(const sched_service_buffer_t* buffer)
 	if(ERROR_CODE(int) == sched_type_check(ret))
 		ERROR_LOG_GOTO(ERR, "Service type checker failed");
 
+	if(ERROR_CODE(int) == _build_wiring(ret, vector_length(buffer->pipes)))
+		ERROR_LOG_GOTO(ERR, "Cannot build the wiring table for the service");
+
 	return ret;
 ERR:
 	if(ret != NULL)
@@ -591,6 +646,7 @@ ERR:
 			if(ret->nodes[i] != NULL)
 				_dispose_node(ret->nodes[i]);
 		if(ret->c_nodes != NULL) sched_cnode_info_free(ret->c_nodes);
+		if(ret->wiring != NULL) free(ret->wiring);
 		free(ret);
 	}
 	if(incoming_count != NULL) free(incoming_count);
@@ -605,6 +661,12 @@ int sched_service_free(sched_service_t* service)
 
 	if(NULL == service) return ERROR_CODE(int);
 
+#ifdef ENABLE_PROFILER
+	/* The profiler exports the node names when it gets disposed, so it should be disposed before the nodes */
+	if(NULL != service->profiler && ERROR_CODE(int) == sched_prof_free(service->profiler))
+		rc = ERROR_CODE(int);
+#endif
+
 	for(i = 0; i < service->node_count; i ++)
 		if(service->nodes[i] != NULL && ERROR_CODE(int) == _dispose_node(service->nodes[i]))
 			rc = ERROR_CODE(int);
@@ -612,10 +674,7 @@ int sched_service_free(sched_service_t* service)
 	if(NULL != service->c_nodes && ERROR_CODE(int) == sched_cnode_info_free(service->c_nodes))
 		rc = ERROR_CODE(int);
 
-#ifdef ENABLE_PROFILER
-	if(NULL != service->profiler && ERROR_CODE(int) == sched_prof_free(service->profiler))
-		rc = ERROR_CODE(int);
-#endif
+	if(NULL != service->wiring) free(service->wiring);
 
 	free(service);
 	return rc;
@@ -658,6 +717,20 @@ const sched_service_pipe_descriptor_t* sched_service_get_outgoing_pipes(const sc
 	return node->outgoing;
 }
 
+const sched_service_pipe_wiring_t* sched_service_get_outgoing_wiring(const sched_service_t* service, sched_service_node_id_t nid, uint32_t* nresult)
+{
+	if(NULL == service || nid == ERROR_CODE(sched_service_node_id_t) || nid >= service->node_count || NULL == nresult)
+		ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	const _node_t* node = service->nodes[nid];
+
+	if(NULL == node) ERROR_PTR_RETURN_LOG("Invalid service def, node #%d is NULL", nid);
+	if(NULL == node->wiring) ERROR_PTR_RETURN_LOG("The wiring table of node #%d hasn't been built yet", nid);
+
+	*nresult = node->outgoing_count;
+	return node->wiring;
+}
+
 char const* const* sched_service_get_node_args(const sched_service_t* service, sched_service_node_id_t nid, uint32_t* argc)
 {
 	if(NULL == service || nid == ERROR_CODE(sched_service_node_id_t) || nid >= service->node_count || NULL == argc)
@@ -705,13 +778,13 @@ const sched_cnode_info_t* sched_service_get_cnode_info(const sched_service_t* se
 	return service->c_nodes;
 }
 
-int sched_service_profiler_timer_start(const sched_service_t* service, sched_service_node_id_t node)
+int sched_service_profiler_timer_start(const sched_service_t* service, sched_service_node_id_t node, uint64_t ready_ts)
 {
 	if(NULL == service || node == ERROR_CODE(sched_service_node_id_t)) ERROR_RETURN_LOG(int, "Invlaid arguments");
 
 	if(service->profiler == NULL) return 0;
 
-	return sched_prof_start_timer(service->profiler, node);
+	return sched_prof_start_timer(service->profiler, node, ready_ts);
 }
 
 int sched_service_profiler_timer_stop(const sched_service_t* service)
@@ -24,7 +24,7 @@ int sched_step_next(sched_task_context_t* stc, itc_module_type_t type)
 {
 	sched_task_t* task = NULL;
 	uint32_t size, i;
-	const sched_service_pipe_descriptor_t* result;
+	const sched_service_pipe_wiring_t* wiring;
 	itc_module_pipe_t *pipes[2];
 	int async_post_rc;
 
@@ -35,11 +35,15 @@ START_OVER:
 	if(NULL == task)
 	{
 		LOG_DEBUG("No task is ready");
+		sched_trace_set_current(0);
 		return 0;
 	}
 
-	if(NULL == (result = sched_service_get_outgoing_pipes(task->service, task->node, &size)))
-		ERROR_LOG_GOTO(LERR, "Cannot get outgoing pipes");
+	/* Let the pipe operations know which request they are working for */
+	sched_trace_set_current(task->trace_id);
+
+	if(NULL == (wiring = sched_service_get_outgoing_wiring(task->service, task->node, &size)))
+		ERROR_LOG_GOTO(LERR, "Cannot get the wiring table of the outgoing pipes");
 
 	/* We should initialize the pipes only for the sync request and the async init */
 	int pipe_init = (!runtime_task_is_async(task->exec_task)) || !(task->exec_task->flags & (RUNTIME_TASK_FLAG_ACTION_UNLOAD | RUNTIME_TASK_FLAG_ACTION_EXEC));
@@ -49,58 +53,31 @@ START_OVER:
 	{
 		if(pipe_init)
 		{
-			runtime_api_pipe_flags_t out_flags = 0, in_flags = 0;
-
-			out_flags = sched_service_get_pipe_flags(task->service, result[i].source_node_id, result[i].source_pipe_desc);
-			if(ERROR_CODE(runtime_api_pipe_flags_t) == out_flags)
-				ERROR_LOG_GOTO(LERR, "Cannot get output pipe flags");
-
-			in_flags = sched_service_get_pipe_flags(task->service, result[i].destination_node_id, result[i].destination_pipe_desc);
-			if(ERROR_CODE(runtime_api_pipe_flags_t) == in_flags)
-				ERROR_LOG_GOTO(LERR, "Cannot get input pipe flags");
-
-			size_t input_header_size, output_header_size;
-
-			if(ERROR_CODE(size_t) == (output_header_size = sched_service_get_pipe_type_size(task->service,
-			                                                                                result[i].source_node_id,
-			                                                                                result[i].source_pipe_desc)))
-				ERROR_LOG_GOTO(LERR, "Cannot get the size of output header size");
-
-			if(ERROR_CODE(size_t) == (input_header_size = sched_service_get_pipe_type_size(task->service,
-			                                                                               result[i].destination_node_id,
-			                                                                               result[i].destination_pipe_desc)))
-				ERROR_LOG_GOTO(LERR, "Cannot get the size of output header size");
-
-			itc_module_pipe_param_t param = {
-				.output_flags  = out_flags,
-				.output_header = output_header_size,
-				.input_flags   = in_flags,
-				.input_header  = input_header_size,
-				.args = NULL
-			};
+			const itc_module_pipe_param_t* param = &wiring[i].param;
+			runtime_api_pipe_flags_t out_flags = param->output_flags;
 
 			if(out_flags & RUNTIME_API_PIPE_SHADOW)
 			{
 				runtime_api_pipe_id_t target_pid = RUNTIME_API_PIPE_GET_TARGET(out_flags);
 				runtime_api_pipe_flags_t disabled = (out_flags & RUNTIME_API_PIPE_DISABLED);
 				pipes[0] = NULL;
-				pipes[1] = itc_module_pipe_fork(task->exec_task->pipes[target_pid], in_flags | RUNTIME_API_PIPE_SHADOW | target_pid | disabled, input_header_size, NULL);
+				pipes[1] = itc_module_pipe_fork(task->exec_task->pipes[target_pid], param->input_flags | RUNTIME_API_PIPE_SHADOW | target_pid | disabled, param->input_header, NULL);
 
-				if(ERROR_CODE(int) == sched_task_output_shadow(task, result[i].source_pipe_desc, pipes[1]))
+				if(ERROR_CODE(int) == sched_task_output_shadow(task, wiring[i].desc.source_pipe_desc, pipes[1]))
 					ERROR_LOG_GOTO(LERR, "Cannot add the forked pipe as shadow");
 			}
-			else if(itc_module_pipe_allocate(type, 0, param, pipes + 0, pipes + 1) < 0)
+			else if(itc_module_pipe_allocate(type, 0, *param, pipes + 0, pipes + 1) < 0)
 				ERROR_LOG_GOTO(LERR, "Cannot allocate pipe from <NID = %d, PID = %d> -> <NID = %d, PID = %d>",
-				                     result[i].source_node_id, result[i].source_pipe_desc,
-				                     result[i].destination_node_id, result[i].destination_pipe_desc);
+				                     wiring[i].desc.source_node_id, wiring[i].desc.source_pipe_desc,
+				                     wiring[i].desc.destination_node_id, wiring[i].desc.destination_pipe_desc);
 
-			if(pipes[0] != NULL && sched_task_output_pipe(task, result[i].source_pipe_desc, pipes[0]) == ERROR_CODE(int))
+			if(pipes[0] != NULL && sched_task_output_pipe(task, wiring[i].desc.source_pipe_desc, pipes[0]) == ERROR_CODE(int))
 				ERROR_LOG_GOTO(LERR, "Cannot assign output pipe to the task");
 
-			if(sched_task_input_pipe(stc, task->service, task->request, result[i].destination_node_id, result[i].destination_pipe_desc, pipes[1], async_init) == ERROR_CODE(int))
+			if(sched_task_input_pipe(stc, task->service, task->request, wiring[i].desc.destination_node_id, wiring[i].desc.destination_pipe_desc, pipes[1], async_init) == ERROR_CODE(int))
 				ERROR_LOG_GOTO(LERR, "Cannot assign the input pipe to the downstream task");
 		}
-		else if(ERROR_CODE(int) == sched_task_input_pipe(stc, task->service, task->request, result[i].destination_node_id, result[i].destination_pipe_desc, NULL, 1))
+		else if(ERROR_CODE(int) == sched_task_input_pipe(stc, task->service, task->request, wiring[i].desc.destination_node_id, wiring[i].desc.destination_pipe_desc, NULL, 1))
 			ERROR_LOG_GOTO(LERR, "Cannot set the async task pipe to ready state");
 	}
 
@@ -110,11 +87,12 @@ START_OVER:
 #ifdef ENABLE_PROFILER
 		static __thread int counter = 0;
 
-		if(sched_service_profiler_timer_start(task->service, task->node) == ERROR_CODE(int))
+		if(sched_service_profiler_timer_start(task->service, task->node, task->ready_ts) == ERROR_CODE(int))
 			LOG_WARNING("Cannot start the profiler");
 		counter ++;
 #endif
 		_current_request_scope = task->scope;
+		uint64_t trace_ts = sched_trace_begin(task->trace_id);
 		/* TODO: what should we do for the async task ? */
 #ifdef FULL_OPTIMIZATION
 		if(_run_task_fast(task->exec_task) == ERROR_CODE(int))
@@ -122,12 +100,17 @@ START_OVER:
 			if(runtime_task_start(task->exec_task) == ERROR_CODE(int))
 #endif
 			{
+				_current_request_scope = NULL;
 #ifdef ENABLE_PROFILER
 				if(sched_service_profiler_timer_stop(task->service) == ERROR_CODE(int))
 					LOG_WARNING("Cannot stop the profiler");
 #endif
+				sched_trace_end(task->trace_id, pipe_init ? SCHED_TRACE_SPAN_EXEC : SCHED_TRACE_SPAN_ASYNC_CLEANUP, task->node, trace_ts);
 				ERROR_LOG_GOTO(TASK_FAILED, "Task failed");
 			}
+		/* The scope may be disposed after the task, so make sure nobody can reach it outside of the task */
+		_current_request_scope = NULL;
+		sched_trace_end(task->trace_id, pipe_init ? SCHED_TRACE_SPAN_EXEC : SCHED_TRACE_SPAN_ASYNC_CLEANUP, task->node, trace_ts);
 #ifdef ENABLE_PROFILER
 		if(sched_service_profiler_timer_stop(task->service) == ERROR_CODE(int))
 			LOG_WARNING("Cannot stop the profiler");
@@ -156,9 +139,9 @@ START_OVER:
 			for(i = 0; i < size; i ++)
 			{
 				int touched = 0;
-				if(result[i].source_pipe_desc != task->exec_task->servlet->sig_null &&
-				   result[i].source_pipe_desc != task->exec_task->servlet->sig_error &&
-				   ERROR_CODE(int) == (touched = itc_module_pipe_is_touched(task->exec_task->pipes[RUNTIME_API_PIPE_TO_PID(result[i].source_pipe_desc)])))
+				if(wiring[i].desc.source_pipe_desc != task->exec_task->servlet->sig_null &&
+				   wiring[i].desc.source_pipe_desc != task->exec_task->servlet->sig_error &&
+				   ERROR_CODE(int) == (touched = itc_module_pipe_is_touched(task->exec_task->pipes[RUNTIME_API_PIPE_TO_PID(wiring[i].desc.source_pipe_desc)])))
 					ERROR_LOG_GOTO(LERR, "Cannot check if the pipe has been touched");
 				if(touched) break;
 			}
@@ -171,17 +154,22 @@ START_OVER:
 			}
 		}
 	}
-	else if(ERROR_CODE(int) == (async_post_rc = sched_task_launch_async(task)))
-	{
-		/* In this case, we cannot start the async task, so we need notify the downstream right now */
-		for(i = 0; i < size; i ++)
-			sched_task_input_pipe(stc, task->service, task->request, result[i].destination_node_id, result[i].destination_pipe_desc, NULL, 1);
-
-		ERROR_LOG_GOTO(TASK_FAILED, "Cannot launch the async task");
-	}
 	else
 	{
-		if(async_post_rc == 0)
+		/* The async setup function runs in the worker thread, so it's able to use the request scope as well */
+		_current_request_scope = task->scope;
+		async_post_rc = sched_task_launch_async(task);
+		_current_request_scope = NULL;
+
+		if(ERROR_CODE(int) == async_post_rc)
+		{
+			/* In this case, we cannot start the async task, so we need notify the downstream right now */
+			for(i = 0; i < size; i ++)
+				sched_task_input_pipe(stc, task->service, task->request, wiring[i].desc.destination_node_id, wiring[i].desc.destination_pipe_desc, NULL, 1);
+
+			ERROR_LOG_GOTO(TASK_FAILED, "Cannot launch the async task");
+		}
+		else if(async_post_rc == 0)
 		{
 			/* This indicates the task has been cancelled during the async init is running */
 			LOG_DEBUG("Async task has been cancelled, call cleanup directly");
@@ -201,9 +189,9 @@ TASK_FAILED:
 	/* First, the error code means all the output is not reliable */
 	for(i = 0; i < size; i ++)
 	{
-		if(result[i].source_pipe_desc != task->exec_task->servlet->sig_null &&
-		   result[i].source_pipe_desc != task->exec_task->servlet->sig_error &&
-		   ERROR_CODE(int) == itc_module_pipe_set_error(task->exec_task->pipes[RUNTIME_API_PIPE_TO_PID(result[i].source_pipe_desc)]))
+		if(wiring[i].desc.source_pipe_desc != task->exec_task->servlet->sig_null &&
+		   wiring[i].desc.source_pipe_desc != task->exec_task->servlet->sig_error &&
+		   ERROR_CODE(int) == itc_module_pipe_set_error(task->exec_task->pipes[RUNTIME_API_PIPE_TO_PID(wiring[i].desc.source_pipe_desc)]))
 			ERROR_LOG_GOTO(LERR, "Cannot set the error state to all the output pipes");
 	}
 
@@ -221,9 +209,11 @@ CLEANUP:
 	if(sched_task_free(task) == ERROR_CODE(int)) LOG_WARNING("Cannot dispose task");
 
 RETURN:
+	sched_trace_set_current(0);
 
 	return 1;
 LERR:
 	if(task) sched_task_free(task);
+	sched_trace_set_current(0);
 	return ERROR_CODE(int);
 }
@@ -22,8 +22,8 @@ typedef struct _task_entry_t{
 	uint32_t              num_required_inputs;   /*!< how many inputs this task required */
 	uint32_t              num_cancelled_inputs;  /*!< how many inputs has already been cancelled so far */
 	uint32_t              num_awaiting_inputs;   /*!< how many inputs that is still in awaiting state, which means either unassigned or not ready */
-	struct _task_entry_t* prev;                  /*!< the previous item in the list */
-	struct _task_entry_t* next;                  /*!< the previous item in the list */
+	struct _task_entry_t* prev;                  /*!< the previous item in the async pending list */
+	struct _task_entry_t* next;                  /*!< the next item in the async pending list */
 } _task_entry_t;
 STATIC_ASSERTION_FIRST(_task_entry_t, task);
 
@@ -31,22 +31,58 @@ typedef struct _request_entry_t {
 	sched_task_request_t request_id; /*!< the request id for this request */
 	uint32_t num_pending_tasks;      /*!< the number of pending tasks has been created for this request */
 	sched_rscope_t* scope;           /*!< the request local scope */
-	struct _request_entry_t* next;   /*!< the next pointer for the request hash table */
+	sched_trace_id_t trace_id;       /*!< the trace id of this request, 0 if the request is not traced */
+	uint64_t trace_ts;               /*!< the timestamp when the traced request starts */
 } _request_entry_t;
 
+/**
+ * @brief a slot in the open addressing hash table
+ * @note the hash code is kept inline, so that probing the table only touches the slot array, and the entry
+ *       itself is accessed only when the hash code matches
+ **/
+typedef struct {
+	uint32_t              hash;                 /*!< the hash code of the key of the entry */
+	void*                 data;                 /*!< the entry in this slot, NULL if the slot is empty */
+} _slot_t;
+
+/**
+ * @brief an open addressing hash table with Robin Hood hashing
+ * @details The entry is placed at the first slot after its home slot (hash &amp; mask) where it's more far away
+ *          from its home slot than the entry occupying that slot, and the occupying entry is moved forward.
+ *          So the probe sequence is sorted by the distance from the home slot, and the lookup can stop as soon
+ *          as it sees an entry closer to home than the one we are looking for. The deletion shifts the
+ *          following entries backward, so there's no tombstone.
+ **/
+typedef struct {
+	_slot_t*              slots;                /*!< the slot array */
+	uint32_t              mask;                 /*!< the capacity minus one, the capacity is always a power of 2 */
+	uint32_t              count;                /*!< the number of entries in the table */
+} _table_t;
+
+/**
+ * @brief an array backed ring queue of tasks
+ **/
+typedef struct {
+	_task_entry_t**       data;                 /*!< the task array */
+	uint32_t              capacity;             /*!< the capacity of the queue, always a power of 2 */
+	uint32_t              head;                 /*!< the index of the first task */
+	uint32_t              size;                 /*!< the number of tasks in the queue */
+} _queue_t;
+
+STATIC_ASSERTION_EQ_ID(task_table_pow2, SCHED_TASK_TABLE_INIT_SIZE & (SCHED_TASK_TABLE_INIT_SIZE - 1), 0);
+STATIC_ASSERTION_EQ_ID(request_table_pow2, SCHED_TASK_REQUEST_TABLE_INIT_SIZE & (SCHED_TASK_REQUEST_TABLE_INIT_SIZE - 1), 0);
+STATIC_ASSERTION_EQ_ID(task_queue_pow2, SCHED_TASK_QUEUE_INIT_SIZE & (SCHED_TASK_QUEUE_INIT_SIZE - 1), 0);
+
 /**
  * @brief The context used by a task table
  **/
 struct _sched_task_context_t {
 	sched_loop_t*         thread_handle;        /*!< The thread handle which creates this scheduler task context */
-	_task_entry_t**       task_table;           /*!< The hash table used to organize tasks */
-	_request_entry_t**    request_table;        /*!< The requet information table, maps the request id to the request entry */
-	_task_entry_t*        queue_head;           /*!< The ready queue head */
-	_task_entry_t*        queue_tail;           /*!< The ready queue tail */
+	_table_t              task_table;           /*!< The hash table used to organize tasks, keyed by (service, request, node) */
+	_table_t              request_table;        /*!< The requet information table, maps the request id to the request entry */
+	_queue_t              ready_queue;          /*!< The ready queue */
+	_queue_t              async_completed;      /*!< The completed async task queue */
 	_task_entry_t*        async_pending;        /*!< The pending async task list */
-	_task_entry_t*        async_completed_head; /*!< The head of completed async task queue */
-	_task_entry_t*        async_completed_tail; /*!< The tail of completed async task queue */
-	uint32_t              queue_size;           /*!< The size of the queue */
 	uint32_t              num_reqs;             /*!< The number of request is going on */
 };
 
@@ -55,17 +91,213 @@ static mempool_objpool_t* _task_pool = NULL;
 /** @brief the memory pool used for the request entrt */
 static mempool_objpool_t* _request_pool = NULL;
 
+/**
+ * @brief the finalizer of the 64 bit MurmurHash3, which gives us a well mixed 32 bit hash code
+ * @param x the value to mix
+ * @return the hash code
+ **/
+static inline uint32_t _mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return (uint32_t)x;
+}
+
+static inline uint32_t _hash(const sched_service_t* service, sched_task_request_t request_id, sched_service_node_id_t node_id)
+{
+	return _mix((uint64_t)(uintptr_t)service ^ (request_id * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)node_id * 0xc2b2ae3d27d4eb4full));
+}
+
+static inline uint32_t _request_hash(sched_task_request_t request_id)
+{
+	return _mix(request_id);
+}
+
+/**
+ * @brief initialize a new hash table
+ * @param table the table to initialize
+ * @param capacity the initial capacity, must be a power of 2
+ * @return status code
+ **/
+static inline int _table_init(_table_t* table, uint32_t capacity)
+{
+	if(NULL == (table->slots = (_slot_t*)calloc(capacity, sizeof(table->slots[0]))))
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the hash table slots");
+	table->mask = capacity - 1;
+	table->count = 0;
+	return 0;
+}
+
+/**
+ * @brief get the distance between the slot and the home slot of the entry in the slot
+ * @param table the hash table
+ * @param idx the slot index
+ * @return the distance
+ **/
+static inline uint32_t _table_dist(const _table_t* table, uint32_t idx)
+{
+	return (idx - table->slots[idx].hash) & table->mask;
+}
+
+/**
+ * @brief put the entry to the slot array without checking the capacity
+ * @param table the hash table
+ * @param hash the hash code of the entry
+ * @param data the entry
+ * @return nothing
+ **/
+static inline void _table_place(_table_t* table, uint32_t hash, void* data)
+{
+	_slot_t cur = {.hash = hash, .data = data};
+	uint32_t idx, dist;
+	for(idx = hash & table->mask, dist = 0; NULL != table->slots[idx].data; idx = (idx + 1) & table->mask, dist ++)
+	{
+		uint32_t occupied_dist = _table_dist(table, idx);
+		if(occupied_dist < dist)
+		{
+			_slot_t tmp = table->slots[idx];
+			table->slots[idx] = cur;
+			cur = tmp;
+			dist = occupied_dist;
+		}
+	}
+	table->slots[idx] = cur;
+	table->count ++;
+}
+
+/**
+ * @brief insert a new entry to the hash table, the table will be resized if needed
+ * @note this do not guarantee the uniqueness of the key in the table
+ * @param table the hash table
+ * @param hash the hash code of the entry
+ * @param data the entry
+ * @return status code
+ **/
+static inline int _table_insert(_table_t* table, uint32_t hash, void* data)
+{
+	/* Keep the load factor under 3/4 */
+	if(PREDICT_FALSE((uint64_t)(table->count + 1) * 4 > (uint64_t)(table->mask + 1) * 3))
+	{
+		uint32_t capacity = (table->mask + 1) * 2;
+		if(capacity == 0)
+			ERROR_RETURN_LOG(int, "The hash table is too large");
+
+		LOG_DEBUG("Scheduler hash table needs to be resized to %u", capacity);
+
+		_table_t new_table;
+		if(ERROR_CODE(int) == _table_init(&new_table, capacity))
+			ERROR_RETURN_LOG(int, "Cannot resize the hash table");
+
+		uint32_t i;
+		for(i = 0; i <= table->mask; i ++)
+			if(NULL != table->slots[i].data)
+				_table_place(&new_table, table->slots[i].hash, table->slots[i].data);
+
+		free(table->slots);
+		*table = new_table;
+	}
+
+	_table_place(table, hash, data);
+	return 0;
+}
+
+/**
+ * @brief remove the entry in the given slot from the hash table
+ * @param table the hash table
+ * @param idx the slot index
+ * @return nothing
+ **/
+static inline void _table_remove_at(_table_t* table, uint32_t idx)
+{
+	uint32_t next;
+	for(next = (idx + 1) & table->mask;
+	    NULL != table->slots[next].data && _table_dist(table, next) > 0;
+	    idx = next, next = (next + 1) & table->mask)
+		table->slots[idx] = table->slots[next];
+	table->slots[idx].data = NULL;
+	table->count --;
+}
+
+/**
+ * @brief initialize a ring queue
+ * @param queue the queue
+ * @param capacity the initial capacity, must be a power of 2
+ * @return status code
+ **/
+static inline int _queue_init(_queue_t* queue, uint32_t capacity)
+{
+	if(NULL == (queue->data = (_task_entry_t**)malloc(sizeof(queue->data[0]) * capacity)))
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the task queue");
+	queue->capacity = capacity;
+	queue->head = 0;
+	queue->size = 0;
+	return 0;
+}
+
+/**
+ * @brief append a task to the end of the queue, the queue will be expanded if needed
+ * @param queue the queue
+ * @param task the task
+ * @return status code
+ **/
+static inline int _queue_push(_queue_t* queue, _task_entry_t* task)
+{
+	if(PREDICT_FALSE(queue->size == queue->capacity))
+	{
+		uint32_t capacity = queue->capacity * 2;
+		if(capacity == 0)
+			ERROR_RETURN_LOG(int, "The task queue is too large");
+
+		LOG_DEBUG("Scheduler task queue needs to be resized to %u", capacity);
+
+		_task_entry_t** data = (_task_entry_t**)malloc(sizeof(data[0]) * capacity);
+		if(NULL == data)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot resize the task queue");
+
+		uint32_t i;
+		for(i = 0; i < queue->size; i ++)
+			data[i] = queue->data[(queue->head + i) & (queue->capacity - 1)];
+
+		free(queue->data);
+		queue->data = data;
+		queue->capacity = capacity;
+		queue->head = 0;
+	}
+
+	queue->data[(queue->head + queue->size) & (queue->capacity - 1)] = task;
+	queue->size ++;
+	return 0;
+}
+
+/**
+ * @brief remove the first task from the queue
+ * @param queue the queue
+ * @return the task, NULL if the queue is empty
+ **/
+static inline _task_entry_t* _queue_pop(_queue_t* queue)
+{
+	if(queue->size == 0) return NULL;
+	_task_entry_t* ret = queue->data[queue->head];
+	queue->head = (queue->head + 1) & (queue->capacity - 1);
+	queue->size --;
+	return ret;
+}
+
 /**
  * @brief enqlueue a task to the async completed task queue
  * @param task The task to insert
  * @param ctx The scheduler context
+ * @return status code
  **/
-static inline void _async_comp_enqueue(sched_task_context_t* ctx, _task_entry_t* task)
+static inline int _async_comp_enqueue(sched_task_context_t* ctx, _task_entry_t* task)
 {
-	if(NULL != ctx->async_completed_tail) ctx->async_completed_tail->next = task;
-	else ctx->async_completed_head = task;
-	ctx->async_completed_tail = task;
-	task->next = NULL;
+#ifdef ENABLE_PROFILER
+	task->task.ready_ts = sched_prof_timestamp();
+#endif
+	return _queue_push(&ctx->async_completed, task);
 }
 
 /**
@@ -75,11 +307,7 @@ static inline void _async_comp_enqueue(sched_task_context_t* ctx, _task_entry_t*
  **/
 static inline _task_entry_t* _async_comp_dequeue(sched_task_context_t* ctx)
 {
-	if(NULL == ctx->async_completed_head) return NULL;
-	_task_entry_t* ret = ctx->async_completed_head;
-	if(NULL == (ctx->async_completed_head = ret->next))
-		ctx->async_completed_tail = NULL;
-	return ret;
+	return _queue_pop(&ctx->async_completed);
 }
 
 /**
@@ -118,14 +346,14 @@ static inline void _async_pending_remove(sched_task_context_t* ctx, _task_entry_
  * @brief enqueue a task to the ready quee
  * @param task the task to insert
  * @param ctx The scheduler context
- * @return nothing
+ * @return status code
  **/
-static inline void _enqueue(sched_task_context_t* ctx, _task_entry_t* task)
+static inline int _enqueue(sched_task_context_t* ctx, _task_entry_t* task)
 {
-	if(NULL != ctx->queue_tail) ctx->queue_tail->next = task;
-	else ctx->queue_head = task;
-	ctx->queue_tail = task;
-	ctx->queue_size ++;
+#ifdef ENABLE_PROFILER
+	task->task.ready_ts = sched_prof_timestamp();
+#endif
+	return _queue_push(&ctx->ready_queue, task);
 }
 
 /**
@@ -135,12 +363,7 @@ static inline void _enqueue(sched_task_context_t* ctx, _task_entry_t* task)
  **/
 static inline _task_entry_t* _dequeue(sched_task_context_t* ctx)
 {
-	if(ctx->queue_size == 0) return NULL;
-	_task_entry_t* ret = ctx->queue_head;
-	if(NULL == (ctx->queue_head = ctx->queue_head->next))
-		ctx->queue_tail = NULL;
-	ctx->queue_size --;
-	return ret;
+	return _queue_pop(&ctx->ready_queue);
 }
 
 /**
@@ -162,7 +385,8 @@ static inline _request_entry_t* _request_entry_new(sched_task_request_t request)
 	}
 	ret->num_pending_tasks = 0;
 	ret->request_id = request;
-	ret->next = NULL;
+	ret->trace_id = sched_trace_sample();
+	ret->trace_ts = sched_trace_begin(ret->trace_id);
 
 	return ret;
 }
@@ -175,6 +399,9 @@ static inline _request_entry_t* _request_entry_new(sched_task_request_t request)
 static inline int _request_entry_free(_request_entry_t* entry)
 {
 	int rc = 0;
+
+	sched_trace_end(entry->trace_id, SCHED_TRACE_SPAN_REQUEST, entry->request_id, entry->trace_ts);
+
 	if(NULL != entry->scope && sched_rscope_free(entry->scope) == ERROR_CODE(int))
 		rc = ERROR_CODE(int);
 
@@ -184,6 +411,25 @@ static inline int _request_entry_free(_request_entry_t* entry)
 	return rc;
 }
 
+/**
+ * @brief find the slot of the request entry object for the given request id
+ * @param request the request id we want to look for
+ * @param ctx The scheduler task context
+ * @return the slot index, or ERROR_CODE(uint32_t) if not found
+ **/
+static inline uint32_t _request_slot_find(const sched_task_context_t* ctx, sched_task_request_t request)
+{
+	const _table_t* table = &ctx->request_table;
+	uint32_t hash = _request_hash(request);
+	uint32_t idx, dist;
+	for(idx = hash & table->mask, dist = 0;
+	    NULL != table->slots[idx].data && _table_dist(table, idx) >= dist;
+	    idx = (idx + 1) & table->mask, dist ++)
+		if(table->slots[idx].hash == hash && ((const _request_entry_t*)table->slots[idx].data)->request_id == request)
+			return idx;
+	return ERROR_CODE(uint32_t);
+}
+
 /**
  * @brief find the request entry object for the given request id
  * @param request the request id we want to look for
@@ -192,10 +438,9 @@ static inline int _request_entry_free(_request_entry_t* entry)
  **/
 static inline _request_entry_t* _request_entry_find(const sched_task_context_t* ctx, sched_task_request_t request)
 {
-	uint32_t slot = (uint32_t)(request % SCHED_TASK_TABLE_SLOT_SIZE);
-	_request_entry_t* ret;
-	for(ret = ctx->request_table[slot]; NULL != ret && request != ret->request_id; ret = ret->next);
-	return ret;
+	uint32_t idx = _request_slot_find(ctx, request);
+	if(ERROR_CODE(uint32_t) == idx) return NULL;
+	return (_request_entry_t*)ctx->request_table.slots[idx].data;
 }
 /**
  * @brief inset a new request entry with the given request id to the request table
@@ -206,13 +451,17 @@ static inline _request_entry_t* _request_entry_find(const sched_task_context_t*
  **/
 static inline _request_entry_t* _request_entry_insert(sched_task_context_t* ctx, sched_task_request_t request)
 {
-	uint32_t slot = (uint32_t)(request % SCHED_TASK_TABLE_SLOT_SIZE);
 	_request_entry_t* ret = _request_entry_new(request);
 	if(NULL == ret) ERROR_PTR_RETURN_LOG("Canont create new request node for the request");
 
+	if(ERROR_CODE(int) == _table_insert(&ctx->request_table, _request_hash(request), ret))
+	{
+		_request_entry_free(ret);
+		ERROR_PTR_RETURN_LOG("Cannot insert the request entry to the request table");
+	}
+
 	ctx->num_reqs ++;
-	ret->next = ctx->request_table[slot];
-	return ctx->request_table[slot] = ret;
+	return ret;
 }
 
 /**
@@ -223,21 +472,11 @@ static inline _request_entry_t* _request_entry_insert(sched_task_context_t* ctx,
  **/
 static inline int _request_entry_delete(sched_task_context_t* ctx, sched_task_request_t request)
 {
-	uint32_t slot = (uint32_t)(request % SCHED_TASK_TABLE_SLOT_SIZE);
-	_request_entry_t* prev = NULL;
-
-	/* if the request we are looking for is not the first */
-	if(ctx->request_table[slot] == NULL || ctx->request_table[slot]->request_id != request)
-	{
-		for(prev = ctx->request_table[slot];
-		    prev != NULL && prev->next != NULL && prev->next->request_id != request;
-		    prev = prev->next);
-		if(prev == NULL || prev->next == NULL) return 0;
-	}
+	uint32_t idx = _request_slot_find(ctx, request);
+	if(ERROR_CODE(uint32_t) == idx) return 0;
 
-	_request_entry_t* to_delete = NULL == prev ? ctx->request_table[slot] : prev->next;
-	if(prev == NULL) ctx->request_table[slot] = to_delete->next;
-	else prev->next = to_delete->next;
+	_request_entry_t* to_delete = (_request_entry_t*)ctx->request_table.slots[idx].data;
+	_table_remove_at(&ctx->request_table, idx);
 
 	if(ERROR_CODE(int) == _request_entry_free(to_delete))
 		ERROR_RETURN_LOG(int, "Cannot dispose the request entry");
@@ -246,16 +485,6 @@ static inline int _request_entry_delete(sched_task_context_t* ctx, sched_task_re
 	return 1;
 }
 
-static inline uint32_t _hash(const sched_service_t* service, sched_task_request_t request_id, sched_service_node_id_t node_id)
-{
-	uintptr_t service_id = (uintptr_t)service;
-	uint64_t hash = ((uint64_t)service_id << (8 * (sizeof(uint64_t) - sizeof(uintptr_t)))) +
-	                ((uint64_t)service_id << 32) +
-	                (request_id << 16) +
-	                node_id;
-	return (uint32_t)(hash % SCHED_TASK_TABLE_SLOT_SIZE);
-}
-
 /**
  * @brief this function is used to make sure that the runtime task is instantiated
  * @note the purpose of this function is allowing lazy instantiation of a runtime task. If the
@@ -286,6 +515,7 @@ static inline _task_entry_t* _task_entry_new(sched_task_context_t* ctx, const sc
 	ret->prev = ret->next = NULL;
 
 	ret->task.scope = req->scope;
+	ret->task.trace_id = req->trace_id;
 
 	if(NULL == sched_service_get_incoming_pipes(service, node, &ret->num_required_inputs))
 		ERROR_LOG_GOTO(ERR, "Cannot get the incoming pipe list");
@@ -311,13 +541,20 @@ ERR:
 
 static inline _task_entry_t* _task_table_find(const sched_task_context_t* ctx, const sched_service_t* service, sched_task_request_t request, sched_service_node_id_t node)
 {
-	uint32_t h = _hash(service, request, node);
+	const _table_t* table = &ctx->task_table;
+	uint32_t hash = _hash(service, request, node);
+	uint32_t idx, dist;
+	for(idx = hash & table->mask, dist = 0;
+	    NULL != table->slots[idx].data && _table_dist(table, idx) >= dist;
+	    idx = (idx + 1) & table->mask, dist ++)
+	{
+		if(PREDICT_FALSE(table->slots[idx].hash != hash)) continue;
 
-	_task_entry_t* ret;
-	for(ret = ctx->task_table[h];
-	    NULL != ret && PREDICT_FALSE(ret->task.service != service || ret->task.request != request || ret->task.node != node);
-	    ret = ret->next);
-	return ret;
+		_task_entry_t* ret = (_task_entry_t*)table->slots[idx].data;
+		if(PREDICT_TRUE(ret->task.service == service && ret->task.request == request && ret->task.node == node))
+			return ret;
+	}
+	return NULL;
 }
 
 static inline _task_entry_t* _task_table_insert(sched_task_context_t* ctx, const sched_service_t* service, sched_task_request_t request, sched_service_node_id_t node)
@@ -326,11 +563,11 @@ static inline _task_entry_t* _task_table_insert(sched_task_context_t* ctx, const
 
 	if(NULL == ret) ERROR_PTR_RETURN_LOG("Cannot create new task for service");
 
-	uint32_t h = _hash(service, request, node);
-
-	ret->next = ctx->task_table[h];
-	if(NULL != ctx->task_table[h]) ctx->task_table[h]->prev = ret;
-	ctx->task_table[h] = ret;
+	if(ERROR_CODE(int) == _table_insert(&ctx->task_table, _hash(service, request, node), ret))
+	{
+		sched_task_free(&ret->task);
+		ERROR_PTR_RETURN_LOG("Cannot insert the task to the task table");
+	}
 
 	return ret;
 }
@@ -338,13 +575,17 @@ static inline _task_entry_t* _task_table_insert(sched_task_context_t* ctx, const
 
 static inline void _task_table_delete(sched_task_context_t* ctx, _task_entry_t* task)
 {
-	uint32_t h = _hash(task->task.service, task->task.request, task->task.node);
-
-	if(task->prev != NULL) task->prev->next = task->next;
-	else ctx->task_table[h] = task->next;
-	if(task->next != NULL) task->next->prev = task->prev;
-
-	task->prev = task->next = NULL;
+	_table_t* table = &ctx->task_table;
+	uint32_t hash = _hash(task->task.service, task->task.request, task->task.node);
+	uint32_t idx, dist;
+	for(idx = hash & table->mask, dist = 0;
+	    NULL != table->slots[idx].data && _table_dist(table, idx) >= dist;
+	    idx = (idx + 1) & table->mask, dist ++)
+		if(table->slots[idx].data == task)
+		{
+			_table_remove_at(table, idx);
+			return;
+		}
 }
 
 int sched_task_init()
@@ -359,12 +600,20 @@ int sched_task_init()
 sched_task_context_t* sched_task_context_new(sched_loop_t* thread_ctx)
 {
 	sched_task_context_t* ret = (sched_task_context_t*)calloc(1, sizeof(*ret));
+	if(NULL == ret)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the scheduler task context");
 
-	if(NULL == (ret->task_table = (_task_entry_t**)calloc(SCHED_TASK_TABLE_SLOT_SIZE, sizeof(ret->task_table[0]))))
-		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the task hash table");
+	if(ERROR_CODE(int) == _table_init(&ret->task_table, SCHED_TASK_TABLE_INIT_SIZE))
+		ERROR_LOG_GOTO(ERR, "Cannot allocate memory for the task hash table");
 
-	if(NULL == (ret->request_table = (_request_entry_t**)calloc(SCHED_TASK_TABLE_SLOT_SIZE, sizeof(ret->request_table[0]))))
-		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the request hash table");
+	if(ERROR_CODE(int) == _table_init(&ret->request_table, SCHED_TASK_REQUEST_TABLE_INIT_SIZE))
+		ERROR_LOG_GOTO(ERR, "Cannot allocate memory for the request hash table");
+
+	if(ERROR_CODE(int) == _queue_init(&ret->ready_queue, SCHED_TASK_QUEUE_INIT_SIZE))
+		ERROR_LOG_GOTO(ERR, "Cannot allocate memory for the ready queue");
+
+	if(ERROR_CODE(int) == _queue_init(&ret->async_completed, SCHED_TASK_QUEUE_INIT_SIZE))
+		ERROR_LOG_GOTO(ERR, "Cannot allocate memory for the async completion queue");
 
 	ret->thread_handle = thread_ctx;
 
@@ -373,83 +622,78 @@ sched_task_context_t* sched_task_context_new(sched_loop_t* thread_ctx)
 	return ret;
 
 ERR:
-	if(NULL != ret->task_table) free(ret->task_table);
-	if(NULL != ret->request_table) free(ret->request_table);
+	if(NULL != ret->task_table.slots) free(ret->task_table.slots);
+	if(NULL != ret->request_table.slots) free(ret->request_table.slots);
+	if(NULL != ret->ready_queue.data) free(ret->ready_queue.data);
 	free(ret);
 	return NULL;
 }
 
+/**
+ * @brief dispose a task entry which is still owned by the task context
+ * @param task the task entry
+ * @return status code
+ **/
+static inline int _task_entry_dispose(_task_entry_t* task)
+{
+	int rc = 0;
+	if(task->task.exec_task != NULL && runtime_task_free(task->task.exec_task) == ERROR_CODE(int))
+	{
+		LOG_WARNING("Cannot dispose the servlet task");
+		rc = ERROR_CODE(int);
+	}
+
+	if(mempool_objpool_dealloc(_task_pool, task) == ERROR_CODE(int))
+	{
+		LOG_WARNING("Cannot dispose the scheduler task");
+		rc = ERROR_CODE(int);
+	}
+
+	return rc;
+}
+
 int sched_task_context_free(sched_task_context_t* ctx)
 {
 	if(NULL == ctx)
 		ERROR_RETURN_LOG(int, "Invalid arguments");
 
-	int i = 0;
+	uint32_t i = 0;
 	int rc = 0;
 
 	/* dispose the task table first */
-	if(ctx->task_table != NULL)
+	if(ctx->task_table.slots != NULL)
 	{
-		for(i = 0; i < SCHED_TASK_TABLE_SLOT_SIZE; i ++)
-		{
-			_task_entry_t* ptr;
-			for(ptr = ctx->task_table[i]; NULL != ptr;)
-			{
-				_task_entry_t* cur = ptr;
-				ptr = ptr->next;
-				if(cur->task.exec_task != NULL && runtime_task_free(cur->task.exec_task) == ERROR_CODE(int))
-				{
-					LOG_WARNING("Cannot dispose the servlet task from the table");
-					rc = ERROR_CODE(int);
-				}
+		for(i = 0; i <= ctx->task_table.mask; i ++)
+			if(NULL != ctx->task_table.slots[i].data && ERROR_CODE(int) == _task_entry_dispose((_task_entry_t*)ctx->task_table.slots[i].data))
+				rc = ERROR_CODE(int);
 
-				if(mempool_objpool_dealloc(_task_pool, cur) == ERROR_CODE(int))
-				{
-					LOG_WARNING("Cannot dispose the scheduler task from the table");
-					rc = ERROR_CODE(int);
-				}
-			}
-		}
+		free(ctx->task_table.slots);
+	}
 
+	if(NULL != ctx->ready_queue.data)
+	{
 		_task_entry_t *ptr;
-		for(ptr = ctx->queue_head; ptr;)
-		{
-			_task_entry_t* cur = ptr;
-			ptr = ptr->next;
-			if(cur->task.exec_task != NULL && runtime_task_free(cur->task.exec_task) == ERROR_CODE(int))
-			{
-				LOG_WARNING("Cannot dispose the servlet task from the qeueue");
+		while(NULL != (ptr = _queue_pop(&ctx->ready_queue)))
+			if(ERROR_CODE(int) == _task_entry_dispose(ptr))
 				rc = ERROR_CODE(int);
-			}
 
-			if(mempool_objpool_dealloc(_task_pool, cur) == ERROR_CODE(int))
-			{
-				LOG_WARNING("Cannot dispose the schuler task from the ready list");
-				rc = ERROR_CODE(int);
-			}
-		}
-		free(ctx->task_table);
+		free(ctx->ready_queue.data);
 	}
 
+	if(NULL != ctx->async_completed.data)
+		free(ctx->async_completed.data);
+
 	/* then dispose the request table */
-	if(NULL != ctx->request_table)
+	if(NULL != ctx->request_table.slots)
 	{
-		for(i = 0; i < SCHED_TASK_TABLE_SLOT_SIZE; i ++)
-		{
-			_request_entry_t* req;
-			for(req = ctx->request_table[i]; NULL != req;)
+		for(i = 0; i <= ctx->request_table.mask; i ++)
+			if(NULL != ctx->request_table.slots[i].data && ERROR_CODE(int) == _request_entry_free((_request_entry_t*)ctx->request_table.slots[i].data))
 			{
-				_request_entry_t* cur = req;
-				req = req->next;
-				if(ERROR_CODE(int) == _request_entry_free(cur))
-				{
-					LOG_WARNING("Cannot dispose the memory used by the request entry in the request table");
-					rc = ERROR_CODE(int);
-				}
+				LOG_WARNING("Cannot dispose the memory used by the request entry in the request table");
+				rc = ERROR_CODE(int);
 			}
-		}
 
-		free(ctx->request_table);
+		free(ctx->request_table.slots);
 	}
 
 	free(ctx);
@@ -520,7 +764,8 @@ int sched_task_pipe_ready(sched_task_t* task)
 		          "remove it from the task table and add it to ready queue",
 		          task->request, task->node);
 		_task_table_delete(task->ctx, task_internal);
-		_enqueue(task->ctx, task_internal);
+		if(ERROR_CODE(int) == _enqueue(task->ctx, task_internal))
+			ERROR_RETURN_LOG(int, "Cannot add the task to the ready queue");
 	}
 
 	return 0;
@@ -564,7 +809,8 @@ sched_task_request_t sched_task_new_request(sched_task_context_t* ctx, const sch
 	((itc_module_pipe_ownership_t*)output_pipe)->owner = out_task;
 
 	_task_table_delete(ctx, in_task);
-	_enqueue(ctx, in_task);
+	if(ERROR_CODE(int) == _enqueue(ctx, in_task))
+		ERROR_LOG_GOTO(ERR, "Cannot add the input task to the ready queue");
 
 	LOG_INFO("Request object #%"PRIu64" has been created", ret);
 	return ret ++;
@@ -618,9 +864,8 @@ int sched_task_async_completed(sched_task_t* task)
 	_task_entry_t* task_internal = (_task_entry_t*)task;
 
 	_async_pending_remove(task->ctx, task_internal);
-	_async_comp_enqueue(task->ctx, task_internal);
 
-	return 0;
+	return _async_comp_enqueue(task->ctx, task_internal);
 }
 
 int sched_task_output_pipe(sched_task_t* task, runtime_api_pipe_id_t pipe, itc_module_pipe_t* handle)
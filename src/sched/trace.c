@@ -0,0 +1,333 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include <constants.h>
+#include <error.h>
+#include <predict.h>
+
+#include <sched/trace.h>
+
+#include <lang/prop.h>
+
+#include <utils/log.h>
+#include <utils/static_assertion.h>
+#include <utils/thread.h>
+
+/**
+ * @brief a span record
+ **/
+typedef struct {
+	sched_trace_id_t   id;      /*!< the trace id */
+	uint64_t           begin;   /*!< the begin timestamp */
+	uint64_t           end;     /*!< the end timestamp */
+	uint64_t           arg;     /*!< the argument of the span */
+	sched_trace_span_t type;    /*!< the type of the span */
+} _record_t;
+
+/**
+ * @brief the per-thread ring buffer of the span records
+ * @note the ring buffer is only written by its owner thread, when the ring buffer is full, the oldest record will be
+ *       overwritten
+ **/
+typedef struct _ring_t {
+	struct _ring_t* next;        /*!< the next ring buffer in the ring buffer list */
+	uint32_t        tid;         /*!< the thread id of the owner thread */
+	uint64_t        count;       /*!< the number of records has been written to this ring buffer */
+	uintpad_t       __padding__[0];
+	_record_t       data[0];     /*!< the actual records */
+} _ring_t;
+STATIC_ASSERTION_SIZE(_ring_t, data, 0);
+STATIC_ASSERTION_LAST(_ring_t, data);
+
+/**
+ * @brief the name and the category of each span type in the trace file
+ **/
+static const struct {
+	const char* name;       /*!< the name of the span */
+	const char* category;   /*!< the category of the span */
+	const char* arg;        /*!< the name of the argument */
+} _span_desc[] = {
+	[SCHED_TRACE_SPAN_REQUEST]         = {"request",         "sched",   "request"},
+	[SCHED_TRACE_SPAN_EXEC]            = {"exec",            "servlet", "node"},
+	[SCHED_TRACE_SPAN_ASYNC_SETUP]     = {"async_setup",     "servlet", "node"},
+	[SCHED_TRACE_SPAN_ASYNC_EXEC]      = {"async_exec",      "servlet", "node"},
+	[SCHED_TRACE_SPAN_ASYNC_CLEANUP]   = {"async_cleanup",   "servlet", "node"},
+	[SCHED_TRACE_SPAN_PIPE_ALLOCATE]   = {"pipe_allocate",   "itc",     "module"},
+	[SCHED_TRACE_SPAN_PIPE_DEALLOCATE] = {"pipe_deallocate", "itc",     "module"},
+	[SCHED_TRACE_SPAN_MODULE_WRITE]    = {"module_write",    "module",  "arg"}
+};
+STATIC_ASSERTION_EQ_ID(span_desc, sizeof(_span_desc) / sizeof(_span_desc[0]), SCHED_TRACE_SPAN_COUNT);
+
+/**
+ * @brief the global tracer context
+ **/
+static struct {
+	uint32_t         sample_rate;   /*!< trace one request out of sample_rate requests, 0 means the tracer is disabled */
+	uint32_t         finalized;     /*!< indicates the tracer has been finalized, and no more records should be written */
+	uint32_t         writers;       /*!< the number of threads which are currently writing their ring buffers */
+	uint32_t         epoch;         /*!< how many times the tracer has been initialized, which invalidates the rings of previous run */
+	char*            output;        /*!< the path to the trace file */
+	sched_trace_id_t next_id;       /*!< the next trace id */
+	pthread_mutex_t  mutex;         /*!< the mutex used to protect the ring buffer list */
+	_ring_t*         rings;         /*!< the list of all the ring buffers */
+} _ctx;
+
+/**
+ * @brief the ring buffer of current thread
+ **/
+static __thread _ring_t* _ring = NULL;
+
+/**
+ * @brief the epoch when the ring buffer of current thread is allocated
+ * @note the rings are released by the finalization, thus the ring buffer from previous epoch is dangling
+ **/
+static __thread uint32_t _ring_epoch = 0;
+
+/**
+ * @brief the number of requests current thread has seen, which is used to sample the requests
+ **/
+static __thread uint32_t _request_counter = 0;
+
+/**
+ * @brief the trace id of the request current thread is working on
+ **/
+static __thread sched_trace_id_t _current = 0;
+
+/**
+ * @brief allocate the ring buffer for current thread
+ * @return the ring buffer, NULL on error
+ **/
+static inline _ring_t* _ring_new(void)
+{
+	_ring_t* ret = (_ring_t*)malloc(sizeof(_ring_t) + sizeof(_record_t) * SCHED_TRACE_RING_SIZE);
+	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the trace ring buffer");
+
+	ret->tid = thread_get_id();
+	ret->count = 0;
+	_ring_epoch = _ctx.epoch;
+
+	if((errno = pthread_mutex_lock(&_ctx.mutex)) != 0)
+	{
+		free(ret);
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot acquire the tracer mutex");
+	}
+
+	ret->next = _ctx.rings;
+	_ctx.rings = ret;
+
+	if((errno = pthread_mutex_unlock(&_ctx.mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the tracer mutex");
+
+	return ret;
+}
+
+/**
+ * @brief dump all the ring buffers to the output file in Chrome trace-event JSON format
+ * @return status code
+ **/
+static inline int _dump(void)
+{
+	if(NULL == _ctx.rings) return 0;
+
+	if(NULL == _ctx.output)
+	{
+		LOG_WARNING("Spans has been recorded, but tracer.output is not set, discarding the spans");
+		return 0;
+	}
+
+	FILE* fp = fopen(_ctx.output, "w");
+	if(NULL == fp) ERROR_RETURN_LOG_ERRNO(int, "Cannot open the trace file %s", _ctx.output);
+
+	const _ring_t* ring;
+	int first = 1;
+	fputs("{\"traceEvents\":[", fp);
+	for(ring = _ctx.rings; NULL != ring; ring = ring->next)
+	{
+		uint64_t i = ring->count > SCHED_TRACE_RING_SIZE ? ring->count - SCHED_TRACE_RING_SIZE : 0;
+		for(; i < ring->count; i ++)
+		{
+			const _record_t* rec = ring->data + (i & (SCHED_TRACE_RING_SIZE - 1));
+			uint64_t dur = rec->end > rec->begin ? rec->end - rec->begin : 0;
+			fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%"PRIu64",\"tid\":%u,"
+			            "\"ts\":%"PRIu64".%03u,\"dur\":%"PRIu64".%03u,\"args\":{\"%s\":%"PRIu64"}}",
+			        first ? "" : ",", _span_desc[rec->type].name, _span_desc[rec->type].category, rec->id, ring->tid,
+			        rec->begin / 1000, (unsigned)(rec->begin % 1000), dur / 1000, (unsigned)(dur % 1000),
+			        _span_desc[rec->type].arg, rec->arg);
+			first = 0;
+		}
+	}
+	fputs("\n]}\n", fp);
+
+	if(fclose(fp) != 0) ERROR_RETURN_LOG_ERRNO(int, "Cannot close the trace file");
+
+	LOG_NOTICE("The request traces has been dumped to %s", _ctx.output);
+
+	return 0;
+}
+
+sched_trace_id_t sched_trace_sample(void)
+{
+	if(PREDICT_TRUE(_ctx.sample_rate == 0)) return 0;
+
+	if(++ _request_counter < _ctx.sample_rate) return 0;
+
+	_request_counter = 0;
+
+	return __sync_add_and_fetch(&_ctx.next_id, 1);
+}
+
+uint64_t sched_trace_timestamp(void)
+{
+	struct timespec ts;
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0) return 0;
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int sched_trace_record(sched_trace_id_t id, sched_trace_span_t type, uint64_t arg, uint64_t begin)
+{
+	if(0 == id || type >= SCHED_TRACE_SPAN_COUNT) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	int rc = 0;
+
+	/* The finalization waits for all the writers before it releases the ring buffers, and the writers should
+	 * announce themselves before they check the finalized flag. Both of the operations are full barriers */
+	__sync_fetch_and_add(&_ctx.writers, 1);
+
+	/* The module may still complete the write after the scheduler has been finalized, ignore them */
+	if(_ctx.finalized) goto RET;
+
+	if(PREDICT_FALSE(NULL == _ring || _ring_epoch != _ctx.epoch) && NULL == (_ring = _ring_new()))
+	{
+		LOG_ERROR("Cannot create the trace ring buffer for current thread");
+		rc = ERROR_CODE(int);
+		goto RET;
+	}
+
+	_record_t* rec = _ring->data + (_ring->count & (SCHED_TRACE_RING_SIZE - 1));
+
+	rec->id = id;
+	rec->type = type;
+	rec->arg = arg;
+	rec->begin = begin;
+	rec->end = sched_trace_timestamp();
+
+	_ring->count ++;
+
+RET:
+	__sync_fetch_and_sub(&_ctx.writers, 1);
+	return rc;
+}
+
+void sched_trace_set_current(sched_trace_id_t id)
+{
+	_current = id;
+}
+
+sched_trace_id_t sched_trace_current(void)
+{
+	return _current;
+}
+
+static inline int _set_prop(const char* symbol, lang_prop_value_t value, const void* data)
+{
+	(void) data;
+	if(NULL == symbol || LANG_PROP_TYPE_ERROR == value.type || LANG_PROP_TYPE_NONE == value.type)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+	if(strcmp(symbol, "sample_rate") == 0)
+	{
+		if(value.type != LANG_PROP_TYPE_INTEGER) ERROR_RETURN_LOG(int, "Type mismatch");
+		if(value.num < 0) ERROR_RETURN_LOG(int, "Invalid sample rate");
+		_ctx.sample_rate = (uint32_t)value.num;
+		if(_ctx.sample_rate) LOG_TRACE("Tracer is enabled, sampling one request out of %u", _ctx.sample_rate);
+		else LOG_TRACE("Tracer is disabled");
+	}
+	else if(strcmp(symbol, "output") == 0)
+	{
+		if(value.type != LANG_PROP_TYPE_STRING) ERROR_RETURN_LOG(int, "Type mistach");
+		const char* path = value.str;
+		if(NULL == path) ERROR_RETURN_LOG(int, "Cannot get the string value");
+
+		if(NULL != _ctx.output) free(_ctx.output);
+		_ctx.output = NULL;
+
+		if(path[0] != 0 && NULL == (_ctx.output = strdup(path)))
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot duplicate the trace file path");
+	}
+	else
+	{
+		LOG_WARNING("Unrecognized symbol name %s", symbol);
+		return 0;
+	}
+
+	return 1;
+}
+
+int sched_trace_init()
+{
+	lang_prop_callback_t cb = {
+		.param = NULL,
+		.get   = NULL,
+		.set   = _set_prop,
+		.symbol_prefix = "tracer"
+	};
+
+	if((errno = pthread_mutex_init(&_ctx.mutex, NULL)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot initialize the tracer mutex");
+
+	_ctx.epoch ++;
+	_ctx.finalized = 0;
+
+	if(ERROR_CODE(int) == lang_prop_register_callback(&cb))
+		ERROR_RETURN_LOG(int, "Cannot register callback for the runtime prop callback");
+
+	return 0;
+}
+
+int sched_trace_finalize()
+{
+	int rc = 0;
+
+	/* Stop recording before we read the ring buffers. The TCP async loop lives longer than the scheduler,
+	 * so there may be a thread which is writing its ring buffer right now, wait for it */
+	_ctx.sample_rate = 0;
+	__sync_fetch_and_or(&_ctx.finalized, 1);
+	while(__sync_fetch_and_add(&_ctx.writers, 0) > 0)
+		sched_yield();
+
+	if(ERROR_CODE(int) == _dump())
+	{
+		LOG_ERROR("Cannot dump the request traces");
+		rc = ERROR_CODE(int);
+	}
+
+	_ring_t* ring;
+	for(ring = _ctx.rings; NULL != ring;)
+	{
+		_ring_t* cur = ring;
+		ring = ring->next;
+		free(cur);
+	}
+	_ctx.rings = NULL;
+	_ring = NULL;
+
+	if(NULL != _ctx.output) free(_ctx.output);
+	_ctx.output = NULL;
+
+	if((errno = pthread_mutex_destroy(&_ctx.mutex)) != 0)
+	{
+		LOG_ERROR_ERRNO("Cannot dispose the tracer mutex");
+		rc = ERROR_CODE(int);
+	}
+
+	return rc;
+}
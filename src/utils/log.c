@@ -6,18 +6,21 @@
 #include <utils/log.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 #include <pthread.h>
 #include <limits.h>
 #include <unistd.h>
+#include <sched.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 
 #include <error.h>
 #include <barrier.h>
+#include <utils/static_assertion.h>
 
 
 __attribute__((used)) /* make sure clang won't complain about unused variables */
@@ -35,6 +38,490 @@ static pthread_mutex_t _log_mutex;
 
 static int _log_mutex_active = 0;
 
+static const char _level_char[] = "FEWNITD";
+
+/**
+ * @brief the header of a record in the log ring buffer, followed by the formatted text
+ **/
+typedef struct {
+	uint32_t                size;     /*!< the size of the text */
+	uint32_t                level;    /*!< the log level */
+} _record_t;
+
+/**
+ * @brief the size of the ring buffer a record with given text size occupies
+ **/
+#define _RECORD_SIZE(size) ((sizeof(_record_t) + (size) + 7) & ~(size_t)7)
+
+STATIC_ASSERTION_EQ_ID(__log_ring_size_power_of_2__, LOG_ASYNC_RING_SIZE & (LOG_ASYNC_RING_SIZE - 1), 0);
+STATIC_ASSERTION_EQ_ID(__log_record_fits_in_ring__, LOG_ASYNC_RECORD_SIZE_LIMIT * 2 <= LOG_ASYNC_RING_SIZE, 1);
+
+/**
+ * @brief the per-thread log ring buffer
+ * @details Each thread formats its log records into its own ring buffer, and the flusher thread is the only consumer,
+ *          so the ring is a single producer single consumer queue which doesn't need any lock. <br/>
+ *          The rings are linked in a list, new rings are pushed to the head of the list with CAS, and only the flusher
+ *          removes the ring from the list once the owner thread has exited and all the records are written
+ **/
+typedef struct _ring_t {
+	uint64_t                head;     /*!< the write position, only modified by the owner thread */
+	uint64_t                tail;     /*!< the read position, only modified by the flusher thread */
+	int                     orphan;   /*!< if the owner thread has exited */
+	struct _ring_t*         next;     /*!< the next ring in the ring list */
+	char                    data[LOG_ASYNC_RING_SIZE];  /*!< the ring buffer */
+} _ring_t;
+
+/**
+ * @brief the ring buffer list
+ **/
+static _ring_t* _rings = NULL;
+
+/**
+ * @brief the ring buffer of current thread
+ **/
+static __thread _ring_t* _thread_ring = NULL;
+
+/**
+ * @brief the generation of the ring buffer list, the ring buffers are disposed when the log is finalized, so the
+ *        thread local ring buffer is only valid when it's created in current generation
+ **/
+static uint32_t _ring_gen = 0;
+
+/**
+ * @brief the generation in which the ring buffer of current thread is created
+ **/
+static __thread uint32_t _thread_ring_gen = 0;
+
+/**
+ * @brief the key we use to get notified when the thread exits
+ **/
+static pthread_key_t _ring_key;
+
+/**
+ * @brief the asynchronous logging policy
+ **/
+static log_async_policy_t _async_policy = LOG_ASYNC_OFF;
+
+/**
+ * @brief the counters for the asynchronous logging
+ **/
+static log_async_stat_t _async_stat;
+
+/**
+ * @brief if the flusher thread is running in this process
+ **/
+static int _flusher_running = 0;
+
+/**
+ * @brief if the flusher thread should stop
+ **/
+static int _flusher_stop = 0;
+
+/**
+ * @brief the flusher thread
+ **/
+static pthread_t _flusher;
+
+/**
+ * @brief the last flush request and the last completed flush request
+ **/
+static uint64_t _flush_requested = 0, _flush_completed = 0;
+
+
+/**
+ * @brief check if the log file has been deleted
+ * @param level the level of the log message
+ * @return status code
+ **/
+static inline int _check_log_file(int level)
+{
+	if(_log_fp[level] == &_fp_off || _log_fp[level] == NULL)
+		return 0;
+
+	int fd = fileno(_log_fp[level]);
+
+	if(-1 == fd) return ERROR_CODE(int);
+
+	if(fd == STDIN_FILENO || fd == STDOUT_FILENO || fd == STDERR_FILENO)
+		return 0;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0) return ERROR_CODE(int);
+
+	int reopen = 0;
+	if(st.st_nlink == 0) reopen = 1;
+	else if(access(_log_path[level], F_OK) != 0) reopen = 1;
+
+	if(reopen)
+	{
+		FILE* prev = _log_fp[level];
+		fclose(_log_fp[level]);
+		if(NULL == (_log_fp[level] = fopen(_log_path[level], _log_mode[level])))
+		{
+			_log_fp[level] = &_fp_off;
+			return ERROR_CODE(int);
+		}
+
+		int i;
+		for(i = 0; i < 8; i ++)
+			if(_log_fp[i] == prev) _log_fp[i] = _log_fp[level];
+	}
+
+	return 0;
+}
+
+/**
+ * @brief check if the filename is in the plumber code base
+ * @param filename the filename to check
+ * @return the result
+ * @note this function do not check for the null pointer
+ **/
+static inline int _is_framework_code(const char* filename)
+{
+	const char* ptr = _src_root;
+	for(;*ptr && *ptr == *filename; ptr ++, filename ++);
+	return !*ptr;
+}
+
+/**
+ * @brief get the ring buffer of current thread, create a new one if it doesn't have one
+ * @return the ring buffer or NULL on error
+ **/
+static inline _ring_t* _ring_get(void)
+{
+	if(NULL != _thread_ring && _thread_ring_gen == _ring_gen)
+		return _thread_ring;
+
+	_ring_t* ring = (_ring_t*)malloc(sizeof(_ring_t));
+	if(NULL == ring) return NULL;
+
+	ring->head = ring->tail = 0;
+	ring->orphan = 0;
+
+	if((errno = pthread_setspecific(_ring_key, ring)) != 0)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	do {
+		ring->next = _rings;
+	} while(!__sync_bool_compare_and_swap(&_rings, ring->next, ring));
+
+	_thread_ring = ring;
+	_thread_ring_gen = _ring_gen;
+
+	return ring;
+}
+
+/**
+ * @brief the callback when the thread owns a ring buffer exits
+ * @param data the ring buffer
+ * @return nothing
+ **/
+static void _ring_release(void* data)
+{
+	_ring_t* ring = (_ring_t*)data;
+
+	if(ring == _thread_ring) _thread_ring = NULL;
+
+	/* The flusher will dispose the ring once all the records are written */
+	__atomic_store_n(&ring->orphan, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief copy the data to the ring buffer
+ * @param ring the ring buffer
+ * @param pos the position in the ring buffer
+ * @param data the data to copy
+ * @param size the size of the data
+ * @return nothing
+ **/
+static inline void _ring_copy(_ring_t* ring, uint64_t pos, const void* data, size_t size)
+{
+	size_t offset = (size_t)(pos & (LOG_ASYNC_RING_SIZE - 1));
+	size_t first = LOG_ASYNC_RING_SIZE - offset;
+
+	if(first > size) first = size;
+
+	memcpy(ring->data + offset, data, first);
+	memcpy(ring->data, (const char*)data + first, size - first);
+}
+
+/**
+ * @brief write the records in the ring buffer to the log files
+ * @note this should be called by the flusher thread with the log mutex held
+ * @param ring the ring buffer
+ * @param checked the bitmap of the log levels which have been checked in this pass
+ * @return the number of records has been written
+ **/
+static inline uint64_t _ring_drain(_ring_t* ring, uint32_t* checked)
+{
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t ret = 0;
+
+	for(;ring->tail < head; ret ++)
+	{
+		size_t offset = (size_t)(ring->tail & (LOG_ASYNC_RING_SIZE - 1));
+		const _record_t* rec = (const _record_t*)(ring->data + offset);
+		int level = (int)rec->level;
+
+		offset += sizeof(_record_t);
+		if(offset >= LOG_ASYNC_RING_SIZE) offset -= LOG_ASYNC_RING_SIZE;
+
+		size_t first = LOG_ASYNC_RING_SIZE - offset;
+		if(first > rec->size) first = rec->size;
+
+		/* The log file is checked once for each pass, since checking it for each record is expensive */
+		if(!(*checked & (1u << level)))
+		{
+			*checked |= (1u << level);
+			if(_check_log_file(level) == ERROR_CODE(int))
+				perror("logging error");
+		}
+
+		FILE* fp = _log_fp[level];
+		if(fp != &_fp_off && fp != NULL)
+		{
+			fwrite(ring->data + offset, 1, first, fp);
+			fwrite(ring->data, 1, rec->size - first, fp);
+			if(fp != stderr && _log_stderr[level])
+			{
+				fwrite(ring->data + offset, 1, first, stderr);
+				fwrite(ring->data, 1, rec->size - first, stderr);
+			}
+		}
+
+		__atomic_store_n(&ring->tail, ring->tail + _RECORD_SIZE(rec->size), __ATOMIC_RELEASE);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief run one pass of the flusher, which writes all the records that are currently in the ring buffers
+ * @return the number of records has been written
+ **/
+static inline uint64_t _flusher_pass(void)
+{
+	uint64_t request = __atomic_load_n(&_flush_requested, __ATOMIC_ACQUIRE);
+	uint64_t ret = 0;
+	uint32_t checked = 0;
+
+	if((errno = pthread_mutex_lock(&_log_mutex)) != 0)
+	{
+		perror("mutex error");
+		return 0;
+	}
+
+	_ring_t* prev = NULL, *ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE);
+	for(;NULL != ring;)
+	{
+		/* Read the orphan flag first, so that we know there's no more record once the ring is empty */
+		int orphan = __atomic_load_n(&ring->orphan, __ATOMIC_ACQUIRE);
+
+		ret += _ring_drain(ring, &checked);
+
+		_ring_t* next = ring->next;
+
+		/* Only the flusher removes the ring, but the new ring may be pushed to the list head concurrently */
+		if(orphan && (NULL != prev || __sync_bool_compare_and_swap(&_rings, ring, next)))
+		{
+			if(NULL != prev) prev->next = next;
+			free(ring);
+		}
+		else prev = ring;
+
+		ring = next;
+	}
+
+	int i;
+	for(i = 0; i < 8; i ++)
+		if(checked & (1u << i) && _log_fp[i] != &_fp_off && _log_fp[i] != NULL)
+			fflush(_log_fp[i]);
+	if(checked) fflush(stderr);
+
+	if((errno = pthread_mutex_unlock(&_log_mutex)) != 0)
+		perror("mutex error");
+
+	_async_stat.written += ret;
+	__atomic_store_n(&_flush_completed, request, __ATOMIC_RELEASE);
+
+	return ret;
+}
+
+/**
+ * @brief the main function of the flusher thread
+ * @param data unused
+ * @return nothing
+ **/
+static void* _flusher_main(void* data)
+{
+	(void)data;
+
+	struct timespec interval = {
+		.tv_sec  = LOG_ASYNC_FLUSH_INTERVAL / 1000,
+		.tv_nsec = (LOG_ASYNC_FLUSH_INTERVAL % 1000) * 1000000
+	};
+
+	for(;!__atomic_load_n(&_flusher_stop, __ATOMIC_ACQUIRE);)
+		if(0 == _flusher_pass() && __atomic_load_n(&_flush_requested, __ATOMIC_ACQUIRE) == _flush_completed)
+			nanosleep(&interval, NULL);
+
+	_flusher_pass();
+
+	return NULL;
+}
+
+/**
+ * @brief make sure the flusher thread is running in this process
+ * @return status code
+ **/
+static inline int _flusher_ensure(void)
+{
+	if(__atomic_load_n(&_flusher_running, __ATOMIC_ACQUIRE) == 1) return 0;
+
+	if(!__sync_bool_compare_and_swap(&_flusher_running, 0, 2))
+	{
+		/* Another thread is starting the flusher */
+		for(;__atomic_load_n(&_flusher_running, __ATOMIC_ACQUIRE) == 2;)
+			sched_yield();
+		return __atomic_load_n(&_flusher_running, __ATOMIC_ACQUIRE) == 1 ? 0 : ERROR_CODE(int);
+	}
+
+	if((errno = pthread_create(&_flusher, NULL, _flusher_main, NULL)) != 0)
+	{
+		perror("cannot start the log flusher thread");
+		__atomic_store_n(&_flusher_running, 0, __ATOMIC_RELEASE);
+		return ERROR_CODE(int);
+	}
+
+	__atomic_store_n(&_flusher_running, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**
+ * @brief put a log record to the ring buffer of current thread
+ * @param level the log level
+ * @param text the formatted text
+ * @param size the size of the text
+ * @return 1 if the record has been queued, 0 if the record is dropped, error code if the record should be written
+ *         synchronously
+ **/
+static inline int _ring_put(int level, const char* text, size_t size)
+{
+	_ring_t* ring = _ring_get();
+
+	if(NULL == ring || ERROR_CODE(int) == _flusher_ensure())
+		return ERROR_CODE(int);
+
+	size_t rec_size = _RECORD_SIZE(size);
+
+	for(;LOG_ASYNC_RING_SIZE - (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) < rec_size;)
+	{
+		if(_async_policy != LOG_ASYNC_BLOCK)
+		{
+			__sync_fetch_and_add(&_async_stat.dropped, 1);
+			return 0;
+		}
+
+		__sync_fetch_and_add(&_async_stat.blocked, 1);
+		sched_yield();
+	}
+
+	_record_t rec = {
+		.size  = (uint32_t)size,
+		.level = (uint32_t)level
+	};
+
+	/* The record header never wraps, because the position is always 8 bytes aligned */
+	_ring_copy(ring, ring->head, &rec, sizeof(rec));
+	_ring_copy(ring, ring->head + sizeof(rec), text, size);
+
+	__atomic_store_n(&ring->head, ring->head + rec_size, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+int log_flush(void)
+{
+	if(__atomic_load_n(&_flusher_running, __ATOMIC_ACQUIRE) != 1)
+		return 0;
+
+	uint64_t request = __sync_add_and_fetch(&_flush_requested, 1);
+
+	for(;__atomic_load_n(&_flush_completed, __ATOMIC_ACQUIRE) < request;)
+		sched_yield();
+
+	return 0;
+}
+
+int log_set_async(log_async_policy_t policy)
+{
+	if(policy != LOG_ASYNC_OFF && policy != LOG_ASYNC_DROP && policy != LOG_ASYNC_BLOCK)
+		return ERROR_CODE(int);
+
+	/* Make sure the queued records are written before the synchronous ones */
+	if(policy == LOG_ASYNC_OFF && _async_policy != LOG_ASYNC_OFF)
+	{
+		_async_policy = LOG_ASYNC_OFF;
+		return log_flush();
+	}
+
+	_async_policy = policy;
+
+	return 0;
+}
+
+log_async_policy_t log_get_async(void)
+{
+	return _async_policy;
+}
+
+int log_async_stat(log_async_stat_t* buf)
+{
+	if(NULL == buf) return ERROR_CODE(int);
+
+	buf->written = __atomic_load_n(&_async_stat.written, __ATOMIC_RELAXED);
+	buf->dropped = __atomic_load_n(&_async_stat.dropped, __ATOMIC_RELAXED);
+	buf->blocked = __atomic_load_n(&_async_stat.blocked, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/**
+ * @brief make sure the flusher doesn't hold any lock when we fork
+ * @return nothing
+ **/
+static void _atfork_prepare(void)
+{
+	log_flush();
+	pthread_mutex_lock(&_log_mutex);
+}
+
+static void _atfork_parent(void)
+{
+	pthread_mutex_unlock(&_log_mutex);
+}
+
+/**
+ * @brief the flusher thread doesn't exist in the child process, so it will be started on demand.
+ *        And the threads other than current one are gone as well.
+ * @return nothing
+ **/
+static void _atfork_child(void)
+{
+	pthread_mutex_unlock(&_log_mutex);
+
+	_flusher_running = 0;
+	_flusher_stop = 0;
+	_flush_requested = _flush_completed = 0;
+
+	_ring_t* ring;
+	for(ring = _rings; NULL != ring; ring = ring->next)
+		if(ring != _thread_ring) ring->orphan = 1;
+}
 
 int log_init()
 {
@@ -55,6 +542,27 @@ int log_init()
 		return ERROR_CODE(int);
 	}
 
+	static int async_initialized = 0;
+	if(!async_initialized)
+	{
+		if((errno = pthread_key_create(&_ring_key, _ring_release)) != 0)
+		{
+			perror("cannot create the log ring key");
+			return ERROR_CODE(int);
+		}
+
+		if((errno = pthread_atfork(_atfork_prepare, _atfork_parent, _atfork_child)) != 0)
+		{
+			perror("cannot register the fork handlers for logging");
+			return ERROR_CODE(int);
+		}
+
+		async_initialized = 1;
+	}
+
+	_async_policy = LOG_ASYNC_OFF;
+	memset(&_async_stat, 0, sizeof(_async_stat));
+
 	if(NULL == conf_path || 0 == strlen(conf_path))
 		conf_path = CONFIG_PATH "/" LOG_DEFAULT_CONFIG_FILE;
 	FILE* fp = fopen(conf_path, "r");
@@ -100,6 +608,15 @@ int log_init()
 
 			*q = 0;
 
+			if(strcmp(type, "async") == 0)
+			{
+				if(strcmp(path, "off") == 0) _async_policy = LOG_ASYNC_OFF;
+				else if(strcmp(path, "drop") == 0) _async_policy = LOG_ASYNC_DROP;
+				else if(strcmp(path, "block") == 0) _async_policy = LOG_ASYNC_BLOCK;
+				else fprintf(stderr, "warning: invalid asynchronous logging policy %s\n", path);
+				continue;
+			}
+
 			int level;
 #define     _STR_TO_ID(name) else if(strcmp(type, #name) == 0) level = name
 			if(0);
@@ -177,6 +694,28 @@ int log_init()
 int log_finalize()
 {
 	int i, j;
+
+	_async_policy = LOG_ASYNC_OFF;
+
+	if(_flusher_running)
+	{
+		_flusher_stop = 1;
+		if((errno = pthread_join(_flusher, NULL)) != 0)
+			perror("cannot join the log flusher thread");
+		_flusher_running = 0;
+		_flusher_stop = 0;
+	}
+
+	/* At this point, all the records has been written by the flusher */
+	for(;NULL != _rings;)
+	{
+		_ring_t* ring = _rings;
+		_rings = ring->next;
+		free(ring);
+	}
+	_thread_ring = NULL;
+	_ring_gen ++;
+
 	for(i = 0; i < 8; i ++)
 		if(_log_fp[i] != NULL &&
 		   _log_fp[i] != stdin &&
@@ -219,9 +758,9 @@ int log_redirect(int level, const char* dest, const char* mode)
 
 	int i, using = 0;
 	for(i = 0; i < 8 && prev != NULL; i ++)
-		if(prev == _log_fp[level])
+		if(prev == _log_fp[i])
 			using ++;
-	if(using == 1 && prev != &_fp_off)
+	if(using == 1 && prev != &_fp_off && prev != stdin && prev != stdout && prev != stderr)
 		fclose(prev);
 
 	_log_fp[level] = fp;
@@ -247,62 +786,69 @@ ERR:
 }
 
 /**
- * @brief check if the log file has been deleted
- * @param level the level of the log message
- * @return status code
+ * @brief format the log record and put it to the ring buffer of current thread
+ * @param level the log level
+ * @param file the source file
+ * @param function the function name
+ * @param line the line number
+ * @param fmt the format string
+ * @param ap the arguments
+ * @return 1 if the record is queued, 0 if the record is dropped, error code if the record should be written synchronously
  **/
-static inline int _check_log_file(int level)
+static inline int _async_write(int level, const char* file, const char* function, int line, const char* fmt, va_list ap)
 {
-	if(_log_fp[level] == &_fp_off || _log_fp[level] == NULL)
-		return 0;
+	char buf[LOG_ASYNC_RECORD_SIZE_LIMIT];
 
-	int fd = fileno(_log_fp[level]);
+	if(_is_framework_code(file))
+		file += _src_root_length;
 
-	if(-1 == fd) return ERROR_CODE(int);
+	struct timespec time;
 
-	if(fd == STDIN_FILENO || fd == STDOUT_FILENO || fd == STDERR_FILENO)
-		return 0;
+	clock_gettime(CLOCK_REALTIME, &time);
 
-	struct stat st;
-	if(fstat(fd, &st) != 0) return ERROR_CODE(int);
+	double ts = (double)time.tv_sec + (double)time.tv_nsec / 1e+9;
 
-	int reopen = 0;
-	if(st.st_nlink == 0) reopen = 1;
-	else if(access(_log_path[level], F_OK) != 0) reopen = 1;
+	/* Leave one byte for the line break, the record is truncated if it's too long */
+	size_t limit = sizeof(buf) - 1;
+	int rc = snprintf(buf, limit, "%c[%16.6lf|%s@%s:%d] ", _level_char[level], ts, function, file, line);
+	if(rc < 0) return ERROR_CODE(int);
 
-	if(reopen)
-	{
-		FILE* prev = _log_fp[level];
-		fclose(_log_fp[level]);
-		if(NULL == (_log_fp[level] = fopen(_log_path[level], _log_mode[level])))
-		{
-			_log_fp[level] = &_fp_off;
-			return ERROR_CODE(int);
-		}
+	size_t size = (size_t)rc < limit ? (size_t)rc : limit - 1;
 
-		int i;
-		for(i = 0; i < 8; i ++)
-			if(_log_fp[i] == prev) _log_fp[i] = _log_fp[level];
-	}
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+#endif
+	rc = vsnprintf(buf + size, limit - size, fmt, ap);
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+	if(rc < 0) return ERROR_CODE(int);
 
-	return 0;
-}
+	size += (size_t)rc < limit - size ? (size_t)rc : limit - size - 1;
+	buf[size ++] = '\n';
 
-/**
- * @brief check if the filename is in the plumber code base
- * @param filename the filename to check
- * @return the result
- * @note this function do not check for the null pointer
- **/
-static inline int _is_framework_code(const char* filename)
-{
-	const char* ptr = _src_root;
-	for(;*ptr && *ptr == *filename; ptr ++, filename ++);
-	return !*ptr;
+	return _ring_put(level, buf, size);
 }
 
 void log_write_va(int level, const char* file, const char* function, int line, const char* fmt, va_list ap)
 {
+	if(_async_policy != LOG_ASYNC_OFF && _log_fp[level] != &_fp_off)
+	{
+		if(level != FATAL)
+		{
+			va_list ap_copy;
+			va_copy(ap_copy, ap);
+			int rc = _async_write(level, file, function, line, fmt, ap_copy);
+			va_end(ap_copy);
+			if(ERROR_CODE(int) != rc) return;
+		}
+
+		/* The fatal record is written synchronously, since the process may die right after this. But the queued
+		 * records should be written before it */
+		log_flush();
+	}
+
 	int locked = 0;
 	if(_log_mutex_active)
 	{
@@ -322,7 +868,6 @@ void log_write_va(int level, const char* file, const char* function, int line, c
 		goto UNLOCK;
 	}
 
-	static const char level_char[] = "FEWNITD";
 	FILE* fp = _log_fp[level];
 
 	if(_is_framework_code(file))
@@ -339,7 +884,7 @@ void log_write_va(int level, const char* file, const char* function, int line, c
 		va_list ap_copy;
 		va_copy(ap_copy, ap);
 		flockfile(stderr);
-		fprintf(stderr,"%c[%16.6lf|%s@%s:%d] ", level_char[level], ts, function, file, line);
+		fprintf(stderr,"%c[%16.6lf|%s@%s:%d] ", _level_char[level], ts, function, file, line);
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wformat-nonliteral"
@@ -354,7 +899,7 @@ void log_write_va(int level, const char* file, const char* function, int line, c
 	}
 
 	flockfile(fp);
-	fprintf(fp,"%c[%16.6lf|%s@%s:%d] ", level_char[level], ts, function, file, line);
+	fprintf(fp,"%c[%16.6lf|%s@%s:%d] ", _level_char[level], ts, function, file, line);
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wformat-nonliteral"
@@ -0,0 +1,324 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <error.h>
+#include <utils/log.h>
+#include <utils/mempool/objpool.h>
+#include <utils/mempool/page.h>
+#include <utils/mempool/acct.h>
+
+/**
+ * @brief the max length of the pool name
+ **/
+#define _NAME_MAX 64
+
+/**
+ * @brief an accounting entry
+ **/
+struct _mempool_acct_t {
+	char                       name[_NAME_MAX];  /*!< the name of the pool */
+	mempool_acct_query_func_t  query;            /*!< the query function, NULL for the counter entry */
+	const void*                data;             /*!< the additional data for the query function */
+	mempool_acct_stat_t        counter;          /*!< the counters of the counter entry */
+	uint64_t                   peak;             /*!< the max in_use we have seen when we query a query entry */
+	mempool_acct_stat_t        last;             /*!< the statistics at the time of the previous delta report */
+	double                     last_time;        /*!< the time of the previous delta report */
+	struct _mempool_acct_t*    next;             /*!< the next entry in the registry */
+};
+
+/**
+ * @brief the registered entries
+ **/
+static mempool_acct_t* _entries = NULL;
+
+/**
+ * @brief the mutex protects the entry list
+ **/
+static pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief the builtin entries
+ **/
+static mempool_acct_t* _objpool_acct = NULL, *_page_acct = NULL;
+
+static inline double _now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief find the entry with the given name
+ * @note the caller should hold the mutex
+ * @param name the name
+ * @return the entry or NULL if not found
+ **/
+static inline mempool_acct_t* _find(const char* name)
+{
+	mempool_acct_t* ret;
+	for(ret = _entries; NULL != ret && strcmp(ret->name, name) != 0; ret = ret->next);
+	return ret;
+}
+
+/**
+ * @brief create a new entry and add it to the registry
+ * @note the caller should hold the mutex
+ * @param name the name of the entry
+ * @param query the query function
+ * @param data the additional data
+ * @return the new entry or NULL on error
+ **/
+static inline mempool_acct_t* _create(const char* name, mempool_acct_query_func_t query, const void* data)
+{
+	if(strlen(name) >= _NAME_MAX)
+		ERROR_PTR_RETURN_LOG("The pool name %s is too long", name);
+
+	if(NULL != _find(name))
+		ERROR_PTR_RETURN_LOG("The pool name %s has been already registered", name);
+
+	mempool_acct_t* ret = (mempool_acct_t*)calloc(1, sizeof(mempool_acct_t));
+	if(NULL == ret)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the accounting entry");
+
+	snprintf(ret->name, sizeof(ret->name), "%s", name);
+	ret->query = query;
+	ret->data  = data;
+	ret->last_time = _now();
+	ret->next = _entries;
+	_entries = ret;
+
+	return ret;
+}
+
+/**
+ * @brief read the statistics of the entry
+ * @param acct the entry
+ * @param buf the result buffer
+ * @return status code
+ **/
+static inline int _stat(mempool_acct_t* acct, mempool_acct_stat_t* buf)
+{
+	if(NULL == acct->query)
+	{
+		buf->in_use = acct->counter.in_use;
+		buf->cached = acct->counter.cached;
+		buf->high_watermark = acct->counter.high_watermark;
+		buf->allocs = acct->counter.allocs;
+		buf->frees = acct->counter.frees;
+		return 0;
+	}
+
+	memset(buf, 0, sizeof(*buf));
+	if(ERROR_CODE(int) == acct->query(acct->data, buf))
+		ERROR_RETURN_LOG(int, "Cannot query the statistics of pool %s", acct->name);
+
+	/* If the pool doesn't track the high watermark, we use the max value we have seen */
+	if(acct->peak < buf->in_use) acct->peak = buf->in_use;
+	if(buf->high_watermark < acct->peak) buf->high_watermark = acct->peak;
+
+	return 0;
+}
+
+int mempool_acct_init(void)
+{
+	if(NULL == (_objpool_acct = mempool_acct_register("objpool", mempool_objpool_acct_query, NULL)))
+		ERROR_RETURN_LOG(int, "Cannot register the object pool accounting entry");
+
+	if(NULL == (_page_acct = mempool_acct_register("page", mempool_page_acct_query, NULL)))
+		ERROR_RETURN_LOG(int, "Cannot register the page pool accounting entry");
+
+	return 0;
+}
+
+int mempool_acct_finalize(void)
+{
+	mempool_acct_t* tmp;
+	for(;NULL != _entries;)
+	{
+		tmp = _entries;
+		_entries = _entries->next;
+		if(NULL != tmp->query && tmp != _objpool_acct && tmp != _page_acct)
+			LOG_DEBUG("Accounting entry %s is not unregistered", tmp->name);
+		free(tmp);
+	}
+
+	_objpool_acct = _page_acct = NULL;
+
+	return 0;
+}
+
+mempool_acct_t* mempool_acct_register(const char* name, mempool_acct_query_func_t query, const void* data)
+{
+	if(NULL == name || NULL == query)
+		ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	if((errno = pthread_mutex_lock(&_mutex)) != 0)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot acquire the registry mutex");
+
+	mempool_acct_t* ret = _create(name, query, data);
+
+	if((errno = pthread_mutex_unlock(&_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the registry mutex");
+
+	return ret;
+}
+
+int mempool_acct_unregister(mempool_acct_t* acct)
+{
+	if(NULL == acct || NULL == acct->query)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	if((errno = pthread_mutex_lock(&_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the registry mutex");
+
+	int rc = ERROR_CODE(int);
+	mempool_acct_t** ptr;
+	for(ptr = &_entries; NULL != *ptr && *ptr != acct; ptr = &(*ptr)->next);
+
+	if(NULL != *ptr)
+	{
+		*ptr = acct->next;
+		free(acct);
+		rc = 0;
+	}
+	else LOG_ERROR("The accounting entry is not registered");
+
+	if((errno = pthread_mutex_unlock(&_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the registry mutex");
+
+	return rc;
+}
+
+mempool_acct_t* mempool_acct_counter(const char* name)
+{
+	if(NULL == name)
+		ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	if((errno = pthread_mutex_lock(&_mutex)) != 0)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot acquire the registry mutex");
+
+	mempool_acct_t* ret = _find(name);
+
+	if(NULL != ret && NULL != ret->query)
+	{
+		LOG_ERROR("The pool %s is not a counter entry", name);
+		ret = NULL;
+	}
+	else if(NULL == ret)
+		ret = _create(name, NULL, NULL);
+
+	if((errno = pthread_mutex_unlock(&_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the registry mutex");
+
+	return ret;
+}
+
+int mempool_acct_update(mempool_acct_t* acct, int64_t bytes)
+{
+	if(NULL == acct || NULL != acct->query)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	if(bytes >= 0)
+	{
+		uint64_t in_use = __sync_add_and_fetch(&acct->counter.in_use, (uint64_t)bytes);
+		__sync_fetch_and_add(&acct->counter.allocs, 1);
+
+		uint64_t peak;
+		while((peak = acct->counter.high_watermark) < in_use &&
+		      !__sync_bool_compare_and_swap(&acct->counter.high_watermark, peak, in_use));
+	}
+	else
+	{
+		__sync_fetch_and_sub(&acct->counter.in_use, (uint64_t)-bytes);
+		__sync_fetch_and_add(&acct->counter.frees, 1);
+	}
+
+	return 0;
+}
+
+int mempool_acct_query(const char* name, mempool_acct_stat_t* buf)
+{
+	if(NULL == name || NULL == buf)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	if((errno = pthread_mutex_lock(&_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the registry mutex");
+
+	int rc = 0;
+	mempool_acct_t* acct = _find(name);
+	if(NULL != acct)
+		rc = (ERROR_CODE(int) == _stat(acct, buf)) ? ERROR_CODE(int) : 1;
+
+	if((errno = pthread_mutex_unlock(&_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the registry mutex");
+
+	return rc;
+}
+
+char* mempool_acct_report(int delta)
+{
+	if((errno = pthread_mutex_lock(&_mutex)) != 0)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot acquire the registry mutex");
+
+	size_t n = 0, len = 0;
+	mempool_acct_t* acct;
+	for(acct = _entries; NULL != acct; acct = acct->next, n ++);
+
+	/* The name and 5 numbers, each of them has 21 chars at most */
+	size_t cap = n * (_NAME_MAX + 5 * 22) + 1;
+	char* ret = (char*)malloc(cap);
+	if(NULL == ret)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the memory accounting report");
+
+	ret[0] = 0;
+
+	double now = _now();
+
+	for(acct = _entries; NULL != acct; acct = acct->next)
+	{
+		mempool_acct_stat_t stat;
+		if(ERROR_CODE(int) == _stat(acct, &stat))
+			ERROR_LOG_GOTO(ERR, "Cannot read the statistics of pool %s", acct->name);
+
+		int rc;
+		if(delta)
+		{
+			double elapsed = now - acct->last_time;
+			if(elapsed <= 0) elapsed = 1e-9;
+			rc = snprintf(ret + len, cap - len, "%s %"PRId64" %"PRId64" %"PRIu64" %.1f %.1f\n", acct->name,
+			              (int64_t)(stat.in_use - acct->last.in_use), (int64_t)(stat.cached - acct->last.cached),
+			              stat.high_watermark,
+			              (double)(stat.allocs - acct->last.allocs) / elapsed, (double)(stat.frees - acct->last.frees) / elapsed);
+			acct->last = stat;
+			acct->last_time = now;
+		}
+		else
+			rc = snprintf(ret + len, cap - len, "%s %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64"\n", acct->name,
+			              stat.in_use, stat.cached, stat.high_watermark, stat.allocs, stat.frees);
+
+		if(rc < 0 || (size_t)rc >= cap - len)
+			ERROR_LOG_GOTO(ERR, "Cannot format the statistics of pool %s", acct->name);
+
+		len += (size_t)rc;
+	}
+
+	goto RET;
+ERR:
+	if(NULL != ret) free(ret);
+	ret = NULL;
+RET:
+	if((errno = pthread_mutex_unlock(&_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the registry mutex");
+
+	return ret;
+}
@@ -19,6 +19,7 @@
 
 #include <utils/mempool/objpool.h>
 #include <utils/mempool/page.h>
+#include <utils/mempool/depot.h>
 
 #include <utils/thread.h>
 
@@ -35,6 +36,8 @@ typedef struct _page_t {
 
 /**
  * @brief represent a allocated object from the pool
+ * @note when a batch of objects is in the global depot, the objects are linked with the next pointer, and the prev
+ *       pointer of the first object is used as the link between batches
  **/
 typedef struct _cached_object_t {
 	struct _cached_object_t* next;   /*!< the next object in the list */
@@ -48,16 +51,19 @@ struct _mempool_objpool_t {
 	uint32_t                     page_count;                     /*!< the number of pages */
 	uint32_t                     obj_size;                       /*!< the size of each object in the pool */
 	_page_t*                     pages;                          /*!< the pages used by the pool */
-	_cached_object_t*            cached;                         /*!< the cahced object list */
-	pthread_mutex_t              mutex;                          /*!< the mutex use for the multi-thread pool */
+	mempool_depot_t              depot;                          /*!< the batches of the objects returned by the threads */
+	pthread_mutex_t              mutex;                          /*!< the mutex used when we carve objects from pages */
 	thread_pset_t                local_pool;                     /*!< the thread local object pool */
 	mempool_objpool_tlp_policy_t policy[THREAD_NUM_TYPES];       /*!< the allocation policy for each type of thread */
+	struct _mempool_objpool_t*   next_pool;                      /*!< the next pool in the pool list */
 };
 
 /**
  * @brief the thread local pool
  **/
 typedef struct {
+	uint64_t            allocs;  /*!< the number of objects allocated by this thread */
+	uint64_t            frees;   /*!< the number of objects deallocated by this thread */
 	uint32_t            count;   /*!< the number of object cahced */
 	_cached_object_t*   begin;   /*!< the cached objects list begin */
 	_cached_object_t*   exceeded;/*!< the point that the cached object is more than the maximum value allowed */
@@ -71,6 +77,16 @@ typedef struct {
  **/
 static int _pool_disabled = 0;
 
+/**
+ * @brief the list of all the object pools, which is used for the memory accounting
+ **/
+static mempool_objpool_t* _pools = NULL;
+
+/**
+ * @brief the mutex protects the pool list
+ **/
+static pthread_mutex_t _pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @brief we have 65536 thread local cache at most
  **/
@@ -194,6 +210,7 @@ static inline void* _thread_pool_alloc(uint32_t tid, const void* data)
 	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the thread local pool");
 	ret->begin = ret->exceeded = ret->end = 0;
 	ret->count = 0;
+	ret->allocs = ret->frees = 0;
 	return ret;
 }
 
@@ -227,7 +244,7 @@ mempool_objpool_t* mempool_objpool_new(uint32_t size)
 
 	ret->obj_size = size;
 	ret->pages = NULL;
-	ret->cached = NULL;
+	mempool_depot_init(&ret->depot);
 	ret->page_count = 0;
 
 	if(NULL == thread_pset_new(1, _thread_pool_alloc , _thread_pool_free, ret, &ret->local_pool))
@@ -243,6 +260,13 @@ mempool_objpool_t* mempool_objpool_new(uint32_t size)
 		ret->policy[i].alloc_unit = 1;
 	}
 
+	if((errno = pthread_mutex_lock(&_pools_mutex)) != 0)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot acquire the pool list mutex");
+	ret->next_pool = _pools;
+	_pools = ret;
+	if((errno = pthread_mutex_unlock(&_pools_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the pool list mutex");
+
 	goto RET;
 ERR:
 	thread_pset_free(&ret->local_pool);
@@ -256,6 +280,15 @@ int mempool_objpool_free(mempool_objpool_t* pool)
 {
 	int rc = 0;
 	if(NULL == pool) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	if((errno = pthread_mutex_lock(&_pools_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the pool list mutex");
+	mempool_objpool_t** ptr;
+	for(ptr = &_pools; NULL != *ptr && *ptr != pool; ptr = &(*ptr)->next_pool);
+	if(NULL != *ptr) *ptr = pool->next_pool;
+	if((errno = pthread_mutex_unlock(&_pools_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the pool list mutex");
+
 	if((errno = pthread_mutex_destroy(&pool->mutex)) != 0)
 	{
 		LOG_ERROR_ERRNO("Cannot dispose the pool mutex");
@@ -281,14 +314,51 @@ int mempool_objpool_free(mempool_objpool_t* pool)
 	return rc;
 }
 
+/**
+ * @brief try to take a batch of objects from the global depot
+ * @note the batch is the exceeded part of some thread local pool, so we take the entire batch and it's possible that
+ *       the batch is larger than the cache limit of current thread, in this case we need to set the exceeded pointer,
+ *       so that the next local deallocation can return the extra objects to the depot
+ * @param pool the memory pool
+ * @param tlp the thread local pool we want to store the result
+ * @param cache_limit the cache limit of current thread
+ * @return the number of objects we got, 0 if the depot is empty
+ **/
+static inline uint32_t _depot_alloc(mempool_objpool_t* pool, _thread_local_pool_t* tlp, uint32_t cache_limit)
+{
+	_cached_object_t* begin = (_cached_object_t*)mempool_depot_pop(&pool->depot, offsetof(_cached_object_t, prev));
+	if(NULL == begin) return 0;
+
+	_cached_object_t* end = begin;
+	uint32_t count = 1;
+
+	begin->prev = NULL;
+	tlp->exceeded = NULL;
+
+	for(; end->next != NULL; count ++)
+	{
+		_cached_object_t* current = end;
+		end = end->next;
+		end->prev = current;
+		if(count == cache_limit) tlp->exceeded = end;
+	}
+
+	tlp->begin = begin;
+	tlp->end = end;
+	tlp->count = count;
+
+	LOG_DEBUG("%u memory objects has been allocated from the global depot", count);
+
+	return count;
+}
+
 __attribute__((noinline))
 /**
  * @brief perform a global allocation from the global object memory pool
- * @note  this function will get min(alloc_unit, 2 * cache_limit - local_count) memory objects from the global pool.
- *        This means we we get at most alloc_unit memory objects, otherwise, we want to fill the local buffer as much
- *        as possible. <br/>
- *        However, if we used up all the cached object, then we allocate objects at most one page, because otherwise
- *        we actually waste our time on meaningless things.
+ * @note  this function first tries to take a batch that has been returned by other threads from the lock-free depot.
+ *        Only when the depot is empty we lock the pool and carve min(alloc_unit, cache_limit) new objects from the
+ *        pages, and we allocate objects at most one page, because otherwise we actually waste our time on meaningless
+ *        things.
  * @param pool the memory pool to allocate
  * @param tlp the thread local pool we want to store the result
  * @return the number of objects that has been allocated, or error code
@@ -297,79 +367,53 @@ static uint32_t _global_alloc(mempool_objpool_t* pool, _thread_local_pool_t* tlp
 {
 	uint32_t ret = ERROR_CODE(uint32_t);
 
-	if((errno = pthread_mutex_lock(&pool->mutex)) != 0)
-		ERROR_RETURN_LOG_ERRNO(uint32_t, "Cannot acquire the pool mutex");
-
 	uint32_t to_alloc = _get_current_global_alloc_unit(pool);
 	uint32_t cache_limit = _get_current_thread_cache_limit(pool);
 	to_alloc = to_alloc > cache_limit ? cache_limit : to_alloc;
 
-	_cached_object_t *begin = NULL, *end = NULL;
-	uint32_t count = 0;
+	if((ret = _depot_alloc(pool, tlp, cache_limit)) > 0)
+		return ret;
 
-	if(NULL != pool->cached)
-	{
-		LOG_DEBUG("The global object pool has cached objects, reuse them first");
-
-		end = begin = pool->cached;
+	ret = ERROR_CODE(uint32_t);
 
-		for(count = 1; count < to_alloc && end->next != NULL; count ++)
-		{
-			_cached_object_t* current = end;
-			end = end->next;
-			end->prev = current;
-		}
+	if((errno = pthread_mutex_lock(&pool->mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(uint32_t, "Cannot acquire the pool mutex");
 
-		pool->cached = end->next;
-		end->next = NULL;
-		begin->prev = NULL;
+	_cached_object_t *begin = NULL, *end = NULL;
+	uint32_t count = 0;
 
-		LOG_DEBUG("%u memory objects has been allocated from the global pool cache", count);
+	LOG_DEBUG("The global depot is empty, but the local pool is asking for %u more objects", to_alloc);
+	if(NULL == pool->pages || _pagesize - pool->pages->unused_start < pool->obj_size)
+	{
+		LOG_DEBUG("The memory pool has no page for the new object, allocate a new page");
+		_page_t* new_page = _page_new();
+		if(NULL == new_page)
+			ERROR_LOG_ERRNO_GOTO(RET, "Cannot allocate new page for the new allocation");
+
+		new_page->next = pool->pages;
+		pool->pages = new_page;
+		pool->page_count ++;
+		LOG_DEBUG("Allocated one more page in the object memory pool");
 	}
 
-	if(count < to_alloc)
+	for(;count < to_alloc && _pagesize - pool->pages->unused_start >= pool->obj_size;)
 	{
-		LOG_DEBUG("The pool cache has been used up, but the local pool is still asking for %u more objects", to_alloc - count);
-		if(NULL == pool->pages || _pagesize - pool->pages->unused_start < pool->obj_size)
-		{
-			LOG_DEBUG("The memory pool has no page for the new object, allocate a new page");
-			_page_t* new_page = _page_new();
-			if(NULL == new_page)
-				ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate new page for the new allocation");
-
-			new_page->next = pool->pages;
-			pool->pages = new_page;
-			pool->page_count ++;
-			LOG_DEBUG("Allocated one more page in the object memory pool");
-		}
-
-		for(;count < to_alloc && _pagesize - pool->pages->unused_start >= pool->obj_size;)
-		{
-			_cached_object_t* new_obj = (_cached_object_t*)(((uint8_t*)pool->pages->page) + pool->pages->unused_start);
-			pool->pages->unused_start += pool->obj_size;
-			new_obj->next = NULL;
-			new_obj->prev = end;
-			if(begin == NULL)
-				begin = end = new_obj;
-			else
-				end->next = new_obj, end = new_obj;
-			count ++;
-		}
-		if(NULL != end) end->next = NULL;
+		_cached_object_t* new_obj = (_cached_object_t*)(((uint8_t*)pool->pages->page) + pool->pages->unused_start);
+		pool->pages->unused_start += pool->obj_size;
+		new_obj->next = NULL;
+		new_obj->prev = end;
+		if(begin == NULL)
+			begin = end = new_obj;
+		else
+			end->next = new_obj, end = new_obj;
+		count ++;
 	}
 
 	tlp->begin = begin;
 	tlp->end = end;
+	tlp->exceeded = NULL;
 	ret = tlp->count = count;
 
-	goto RET;
-ERR:
-	if(begin != NULL)
-	{
-		LOG_DEBUG("Allocation failure, release all the involved memory object to global pool");
-		end->next = pool->cached;
-		pool->cached = begin;
-	}
 RET:
 	if((errno = pthread_mutex_unlock(&pool->mutex)) != 0)
 		ERROR_RETURN_LOG_ERRNO(uint32_t, "Cannot release the pool mutex");
@@ -408,6 +452,7 @@ static void* _mempool_objpool_alloc_no_check(mempool_objpool_t* pool)
 		tlp->exceeded = NULL;
 
 	tlp->count --;
+	tlp->allocs ++;
 
 #ifndef FULL_OPTIMIZATION
 	if(PREDICT_FALSE(NULL == ret))
@@ -438,7 +483,8 @@ int mempool_objpool_disabled(int val)
 }
 
 /**
- * @brief return a list of cached object to the global pool
+ * @brief return a list of cached object to the global depot
+ * @note the list is pushed to the depot as a single batch, so no matter how many objects we return, it's only one CAS
  * @param begin the begin pointer of the list
  * @param end the end pointer of the list
  * @param pool the target memory pool
@@ -446,16 +492,8 @@ int mempool_objpool_disabled(int val)
  **/
 static inline int _global_dealloc(mempool_objpool_t* pool, _cached_object_t* begin, _cached_object_t* end)
 {
-	if((errno = pthread_mutex_lock(&pool->mutex)) != 0)
-		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the pool mutex");
-
-	end->next = pool->cached;
-	if(NULL != pool->cached) pool->cached->prev = end;
-	pool->cached = begin;
-	begin->prev = NULL;
-
-	if((errno = pthread_mutex_unlock(&pool->mutex)) != 0)
-		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the pool mutex");
+	end->next = NULL;
+	mempool_depot_push(&pool->depot, begin, begin, offsetof(_cached_object_t, prev));
 
 	return 0;
 }
@@ -496,6 +534,7 @@ static int _mempool_objpool_dealloc_no_check(mempool_objpool_t* pool, void* mem)
 		tlp->begin = cur;
 
 	tlp->end = cur;
+	tlp->frees ++;
 
 	uint32_t cache_limit = _get_current_thread_cache_limit(pool);
 
@@ -565,3 +604,45 @@ int mempool_objpool_set_thread_policy(mempool_objpool_t* pool, unsigned thread_m
 
 	return 0;
 }
+
+int mempool_objpool_acct_query(const void* data, mempool_acct_stat_t* buf)
+{
+	(void)data;
+	if(NULL == buf) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	if((errno = pthread_mutex_lock(&_pools_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the pool list mutex");
+
+	uint64_t held = 0, in_use = 0;
+	buf->allocs = buf->frees = 0;
+
+	const mempool_objpool_t* pool;
+	for(pool = _pools; NULL != pool; pool = pool->next_pool)
+	{
+		/* The pointer array is never disposed until the pool is freed, so we can read a stale one safely */
+		const thread_pointer_array_t* array = pool->local_pool.array;
+		uint64_t allocs = 0, frees = 0;
+		uint32_t i;
+		for(i = 0; i < array->size; i ++)
+		{
+			const _thread_local_pool_t* tlp = (const _thread_local_pool_t*)array->ptr[i];
+			if(NULL == tlp) continue;
+			allocs += tlp->allocs;
+			frees += tlp->frees;
+		}
+
+		held += (uint64_t)pool->page_count * _pagesize;
+		if(allocs > frees) in_use += (allocs - frees) * pool->obj_size;
+		buf->allocs += allocs;
+		buf->frees += frees;
+	}
+
+	buf->in_use = in_use;
+	buf->cached = held > in_use ? held - in_use : 0;
+	buf->high_watermark = 0;
+
+	if((errno = pthread_mutex_unlock(&_pools_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the pool list mutex");
+
+	return 0;
+}
@@ -9,12 +9,18 @@
 #include <string.h>
 #include <barrier.h>
 #include <errno.h>
+#include <sys/mman.h>
 
 #include <pthread.h>
 
+#ifdef __LINUX__
+#	include <sys/syscall.h>
+#endif
+
 #include <error.h>
 #include <arch/arch.h>
 #include <utils/mempool/page.h>
+#include <utils/mempool/depot.h>
 #include <utils/log.h>
 
 #include <constants.h>
@@ -34,9 +40,18 @@ typedef struct _page_t {
 } _page_t;
 
 /**
- * @brief the free page list
+ * @brief the free page list, the pages are linked with the next pointer
+ **/
+static mempool_depot_t _free_list;
+
+/**
+ * @brief the mutex that serializes the pops from the free page list
+ * @details Unlike the huge pages, the system pages beyond the free page limit are returned to the system allocator.
+ *          The depot requires a popped node to stay readable, because a concurrent pop may still read its link field.
+ *          With the pops serialized, no other thread can hold a reference to a page once it has been popped, so it's
+ *          safe to free it. The push side is still lock-free.
  **/
-static _page_t* _free_list;
+static pthread_mutex_t _free_list_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * @brief the number of free pages
@@ -59,6 +74,9 @@ static size_t _max_thread_cached_pages = 0x1000;
  **/
 typedef struct _thread_page_pool_t{
 	uint32_t page_count;      /*!< how many pages in the thread pool */
+	uint32_t node;            /*!< the NUMA node of the thread */
+	uint64_t allocs;          /*!< the number of pages allocated by this thread */
+	uint64_t frees;           /*!< the number of pages deallocated by this thread */
 	_page_t* page_list_begin; /*!< the first page in the free list */
 	_page_t* exceeded;        /*!< the first element that exceeded the thread pool size limit */
 	_page_t* page_list_end;   /*!< the last element */
@@ -71,11 +89,227 @@ static _thread_page_pool_t* _local_page_pool_list = NULL;
 
 static int _pool_disabled = 0;
 
-pthread_mutex_t mutex;
+/**
+ * @brief the number of pages allocated from the system allocator and not returned yet
+ **/
+static size_t _num_system_pages = 0;
+
+/**
+ * @brief get the size of each page
+ **/
+static inline size_t _get_page_size(void)
+{
+	int ret = getpagesize();
+	if(ret < 0) return 0;
+	return (size_t) ret;
+}
+
+/**
+ * @brief the free list of the huge page chunks on one NUMA node
+ * @note the free lists are modified by all the threads on the node, so we make each of them occupy a cache line
+ **/
+typedef union {
+	mempool_depot_t  pages;             /*!< the free pages */
+	char             __padding__[64];
+} _node_free_list_t;
+
+/**
+ * @brief the huge page region
+ **/
+static struct {
+	char*              base;            /*!< the base address of the reserved region, NULL if it's not reserved yet */
+	uint32_t           num_chunks;      /*!< the number of chunks in this region */
+	uint32_t           next_chunk;      /*!< the index of the next chunk to carve */
+	uint8_t*           chunk_node;      /*!< the NUMA node of each chunk */
+	_node_free_list_t  free_list[UTILS_MEMPOOL_PAGE_MAX_NUMA_NODES];   /*!< the free lists for each NUMA node */
+} _huge;
+
+/**
+ * @brief the backing used to allocate new pages
+ **/
+static mempool_page_backing_t _backing = MEMPOOL_PAGE_BACKING_SYSTEM;
+
+/**
+ * @brief the mutex used to reserve the huge page region
+ **/
+static pthread_mutex_t _huge_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief check if the page is carved from a huge page chunk
+ * @param page the page to check
+ * @return check result
+ **/
+static inline int _is_huge_page(const void* page)
+{
+	const char* p = (const char*)page;
+	return NULL != _huge.base && p >= _huge.base && p < _huge.base + (size_t)_huge.num_chunks * UTILS_MEMPOOL_PAGE_CHUNK_SIZE;
+}
+
+/**
+ * @brief get the NUMA node of a huge page
+ * @param page the page, must be a page carved from a huge page chunk
+ * @return the node id
+ **/
+static inline uint32_t _huge_page_node(const void* page)
+{
+	return _huge.chunk_node[(size_t)((const char*)page - _huge.base) / UTILS_MEMPOOL_PAGE_CHUNK_SIZE];
+}
+
+/**
+ * @brief get the NUMA node current thread is running on
+ * @note we only query this once per thread, since the worker threads are not expected to migrate between nodes
+ * @return the node id
+ **/
+static inline uint32_t _current_node(void)
+{
+#if defined(__LINUX__) && defined(SYS_getcpu)
+	unsigned cpu, node;
+	if(syscall(SYS_getcpu, &cpu, &node, NULL) < 0)
+	{
+		LOG_WARNING_ERRNO("Cannot get the NUMA node of current thread, assume node 0");
+		return 0;
+	}
+	return node % UTILS_MEMPOOL_PAGE_MAX_NUMA_NODES;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief carve a new huge page chunk for the given NUMA node
+ * @details the first page of the chunk is returned and the remaining pages are pushed to the free list of the node.
+ *          We rely on the first-touch policy of the kernel to place the chunk on the node, since the chunk is faulted
+ *          by the thread which carves it.
+ * @param node the NUMA node
+ * @return the first page of the chunk, NULL if the region is used up or error
+ **/
+static inline _page_t* _huge_carve(uint32_t node)
+{
+	uint32_t idx = __sync_fetch_and_add(&_huge.next_chunk, 1);
+	if(idx >= _huge.num_chunks)
+	{
+		if(idx == _huge.num_chunks)
+			LOG_WARNING("The huge page region has been used up, fall back to the system pages");
+		__sync_fetch_and_sub(&_huge.next_chunk, 1);
+		return NULL;
+	}
+
+	char* chunk = _huge.base + (size_t)idx * UTILS_MEMPOOL_PAGE_CHUNK_SIZE;
+	int mapped = 0;
+
+#ifdef MAP_HUGETLB
+	if(_backing == MEMPOOL_PAGE_BACKING_HUGETLB)
+	{
+		if(MAP_FAILED == mmap(chunk, UTILS_MEMPOOL_PAGE_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+		                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0))
+			LOG_DEBUG_ERRNO("Cannot map the chunk from hugetlbfs, use transparent huge page instead");
+		else
+			mapped = 1;
+	}
+#endif
+
+	if(!mapped)
+	{
+		if(mprotect(chunk, UTILS_MEMPOOL_PAGE_CHUNK_SIZE, PROT_READ | PROT_WRITE) < 0)
+		{
+			/* The index is consumed anyway, since other threads may have carved the chunks after it */
+			ERROR_PTR_RETURN_LOG_ERRNO("Cannot make the huge page chunk accessible");
+		}
+#ifdef MADV_HUGEPAGE
+		if(madvise(chunk, UTILS_MEMPOOL_PAGE_CHUNK_SIZE, MADV_HUGEPAGE) < 0)
+			LOG_DEBUG_ERRNO("Cannot advise the kernel to use transparent huge page");
+#endif
+	}
+
+	_huge.chunk_node[idx] = (uint8_t)node;
+
+	size_t page_size = _get_page_size();
+	size_t i, n = UTILS_MEMPOOL_PAGE_CHUNK_SIZE / page_size;
+	_page_t* first = (_page_t*)(chunk + page_size);
+	_page_t* last = (_page_t*)(chunk + (n - 1) * page_size);
+
+	for(i = 1; i < n - 1; i ++)
+		((_page_t*)(chunk + i * page_size))->next = (_page_t*)(chunk + (i + 1) * page_size);
+
+	mempool_depot_push(&_huge.free_list[node].pages, first, last, offsetof(_page_t, next));
+
+	LOG_DEBUG("Huge page chunk #%u has been carved for NUMA node %u", idx, node);
+
+	return (_page_t*)chunk;
+}
+
+/**
+ * @brief reserve the virtual memory region for the huge page chunks
+ * @return status code
+ **/
+static inline int _huge_reserve(void)
+{
+	int rc = 0;
+	if((errno = pthread_mutex_lock(&_huge_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot acquire the huge page region mutex");
+
+	if(NULL != _huge.base) goto RET;
+
+	if(UTILS_MEMPOOL_PAGE_CHUNK_SIZE % _get_page_size() != 0)
+		ERROR_LOG_GOTO(ERR, "The huge page chunk size is not a multiple of the page size");
+
+	uint32_t num_chunks = (uint32_t)(UTILS_MEMPOOL_PAGE_HUGE_REGION_SIZE / UTILS_MEMPOOL_PAGE_CHUNK_SIZE);
+	size_t size = (size_t)num_chunks * UTILS_MEMPOOL_PAGE_CHUNK_SIZE;
+
+	/* Reserve one more chunk, so that we can align the region to the chunk size */
+	char* mem = (char*)mmap(NULL, size + UTILS_MEMPOOL_PAGE_CHUNK_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(MAP_FAILED == mem)
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot reserve the huge page region");
+
+	char* base = (char*)(((uintptr_t)mem + UTILS_MEMPOOL_PAGE_CHUNK_SIZE - 1) & ~(uintptr_t)(UTILS_MEMPOOL_PAGE_CHUNK_SIZE - 1));
+	if(base > mem && munmap(mem, (size_t)(base - mem)) < 0)
+		LOG_WARNING_ERRNO("Cannot release the unaligned head of the huge page region");
+	if(base + size < mem + size + UTILS_MEMPOOL_PAGE_CHUNK_SIZE && munmap(base + size, (size_t)(mem + UTILS_MEMPOOL_PAGE_CHUNK_SIZE - base)) < 0)
+		LOG_WARNING_ERRNO("Cannot release the unaligned tail of the huge page region");
+
+	if(NULL == (_huge.chunk_node = (uint8_t*)calloc(num_chunks, 1)))
+	{
+		munmap(base, size);
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate the chunk node table");
+	}
+
+	_huge.next_chunk = 0;
+	_huge.num_chunks = num_chunks;
+	BARRIER();
+	_huge.base = base;
+
+	LOG_INFO("Huge page region of %zu bytes has been reserved at %p", size, base);
+
+	goto RET;
+ERR:
+	rc = ERROR_CODE(int);
+RET:
+	if((errno = pthread_mutex_unlock(&_huge_mutex)) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot release the huge page region mutex");
+	return rc;
+}
+
+int mempool_page_set_backing(mempool_page_backing_t backing)
+{
+	if(backing != MEMPOOL_PAGE_BACKING_SYSTEM && backing != MEMPOOL_PAGE_BACKING_THP && backing != MEMPOOL_PAGE_BACKING_HUGETLB)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	if(backing != MEMPOOL_PAGE_BACKING_SYSTEM && ERROR_CODE(int) == _huge_reserve())
+		ERROR_RETURN_LOG(int, "Cannot reserve the huge page region");
+
+	_backing = backing;
+
+	return 0;
+}
+
+mempool_page_backing_t mempool_page_get_backing(void)
+{
+	return _backing;
+}
 
 int mempool_page_init()
 {
-	_free_list = NULL;
+	mempool_depot_init(&_free_list);
 	_num_free_pages = 0;
 	return 0;
 }
@@ -83,12 +317,15 @@ int mempool_page_init()
 int mempool_page_finalize()
 {
 	_page_t* tmp;
-	for(;_free_list != NULL;)
+	_page_t* list = (_page_t*)mempool_depot_take_all(&_free_list);
+	for(;list != NULL;)
 	{
-		tmp = _free_list;
-		_free_list = _free_list->next;
+		tmp = list;
+		list = list->next;
 		__free__(tmp);
 	}
+	_num_free_pages = 0;
+	_num_system_pages = 0;
 
 	_thread_page_pool_t* curpool;
 	for(;NULL != _local_page_pool_list;)
@@ -100,11 +337,21 @@ int mempool_page_finalize()
 		{
 			curpage = curpool->page_list_begin;
 			curpool->page_list_begin = curpool->page_list_begin->next;
-			__free__(curpage);
+			if(!_is_huge_page(curpage))
+				__free__(curpage);
 		}
 		free(curpool);
 	}
 
+	if(NULL != _huge.base)
+	{
+		if(munmap(_huge.base, (size_t)_huge.num_chunks * UTILS_MEMPOOL_PAGE_CHUNK_SIZE) < 0)
+			LOG_WARNING_ERRNO("Cannot release the huge page region");
+		free(_huge.chunk_node);
+		memset(&_huge, 0, sizeof(_huge));
+		_backing = MEMPOOL_PAGE_BACKING_SYSTEM;
+	}
+
 	return 0;
 }
 
@@ -115,16 +362,6 @@ int mempool_page_set_free_page_limit(size_t npages)
 	return 0;
 }
 
-/**
- * @brief get the size of each page
- **/
-static inline size_t _get_page_size(void)
-{
-	int ret = getpagesize();
-	if(ret < 0) return 0;
-	return (size_t) ret;
-}
-
 /**
  * @brief allocate n contiguous pages
  * @param n the number of pages to allocate
@@ -136,28 +373,32 @@ static inline void* _page_alloc(int n)
 	if(posix_memalign(&ret, _get_page_size(), _get_page_size() * (size_t)n) < 0)
 		ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate a full page");
 
+	__sync_fetch_and_add(&_num_system_pages, (size_t)n);
+
 	return ret;
 }
 
-static inline _page_t* _global_alloc(void)
+static inline _page_t* _global_alloc(uint32_t node)
 {
-	_page_t* claimed = NULL;
+	_page_t* claimed;
 
-	/* try to claim one */
-	for(;_free_list;)
+	if(NULL != _huge.base)
 	{
-		_page_t* candidate = _free_list;
-		_page_t* new_head = candidate->next;
-
-		BARRIER();
+		if(NULL != (claimed = (_page_t*)mempool_depot_pop(&_huge.free_list[node].pages, offsetof(_page_t, next))))
+			return claimed;
 
-		if(__sync_bool_compare_and_swap(&_free_list, candidate, new_head))
-		{
-			claimed = candidate;
-			break;
-		}
+		if(_backing != MEMPOOL_PAGE_BACKING_SYSTEM && NULL != (claimed = _huge_carve(node)))
+			return claimed;
 	}
 
+	if((errno = pthread_mutex_lock(&_free_list_mutex)) != 0)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot acquire the free page list mutex");
+
+	claimed = (_page_t*)mempool_depot_pop(&_free_list, offsetof(_page_t, next));
+
+	if((errno = pthread_mutex_unlock(&_free_list_mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the free page list mutex");
+
 	if(NULL == claimed)
 	{
 		LOG_DEBUG("the page pool do not have page for current allocation, ask the system for a new one");
@@ -165,17 +406,45 @@ static inline _page_t* _global_alloc(void)
 	}
 	else LOG_DEBUG("Use cached page %p", claimed);
 
+	__sync_fetch_and_sub(&_num_free_pages, 1);
+
 	return claimed;
 }
 
 static inline int _global_dealloc(_page_t* begin, _page_t* end, size_t n)
 {
+	if(NULL != _huge.base)
+	{
+		/* The huge pages goes back to the free list of its node, and we only keep the system pages in the list */
+		_page_t *cur, *next, *new_begin = NULL, *new_end = NULL;
+		for(cur = begin; cur != NULL; cur = next)
+		{
+			next = cur->next;
+			if(_is_huge_page(cur))
+			{
+				mempool_depot_push(&_huge.free_list[_huge_page_node(cur)].pages, cur, cur, offsetof(_page_t, next));
+				n --;
+			}
+			else
+			{
+				if(NULL == new_begin) new_begin = cur;
+				else new_end->next = cur;
+				new_end = cur;
+			}
+		}
+		if(NULL == new_begin) return 0;
+		begin = new_begin;
+		end = new_end;
+		end->next = NULL;
+	}
+
 	for(;begin != NULL && _max_cached_pages <= _num_free_pages + n;)
 	{
 		LOG_DEBUG("The number of free pages is larger than the free page limit, free the page directly");
 		_page_t* tmp = begin;
 		begin = begin->next;
 		__free__(tmp);
+		__sync_fetch_and_sub(&_num_system_pages, 1);
 		n--;
 	}
 
@@ -183,16 +452,7 @@ static inline int _global_dealloc(_page_t* begin, _page_t* end, size_t n)
 
 	__sync_fetch_and_add(&_num_free_pages, n);
 	BARRIER();
-	for(;;)
-	{
-		_page_t* old_head = _free_list;
-		end->next = old_head;
-
-		BARRIER();
-
-		if(__sync_bool_compare_and_swap(&_free_list, old_head, begin))
-			break;
-	}
+	mempool_depot_push(&_free_list, begin, end, offsetof(_page_t, next));
 
 	LOG_DEBUG("%zu pages has been return to the global pool", n);
 
@@ -207,8 +467,12 @@ static inline int _check_local_pool(void)
 			ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate the thread local page pool");
 		_local_page_pool->page_list_begin = _local_page_pool->page_list_end = _local_page_pool->exceeded = NULL;
 		_local_page_pool->page_count = 0;
-		_local_page_pool->next = _local_page_pool_list;
-		_local_page_pool_list = _local_page_pool;
+		_local_page_pool->node = _current_node();
+		_local_page_pool->allocs = _local_page_pool->frees = 0;
+		/* Multiple threads may initialize their local pool at the same time */
+		do {
+			_local_page_pool->next = _local_page_pool_list;
+		} while(!__sync_bool_compare_and_swap(&_local_page_pool_list, _local_page_pool->next, _local_page_pool));
 		LOG_DEBUG("Thread local page pool has been initialized");
 	}
 
@@ -240,7 +504,10 @@ void* mempool_page_alloc()
 			_local_page_pool->page_list_end = NULL;
 	}
 
-	if(NULL == ret) return _global_alloc();
+	if(NULL == ret && NULL == (ret = _global_alloc(_local_page_pool->node)))
+		return NULL;
+
+	_local_page_pool->allocs ++;
 
 	return ret;
 }
@@ -258,6 +525,19 @@ int mempool_page_dealloc(void* mem)
 
 	_page_t* page = (_page_t*)mem;
 
+	_local_page_pool->frees ++;
+
+	if(_is_huge_page(page))
+	{
+		uint32_t node = _huge_page_node(page);
+		if(node != _local_page_pool->node)
+		{
+			/* Do not let the page from other node stay in the local cache, otherwise it will be reused remotely */
+			mempool_depot_push(&_huge.free_list[node].pages, page, page, offsetof(_page_t, next));
+			return 0;
+		}
+	}
+
 	page->next = _local_page_pool->page_list_begin;
 	page->prev = NULL;
 	if(_local_page_pool->page_list_begin != NULL)
@@ -290,6 +570,41 @@ int mempool_page_dealloc(void* mem)
 	return rc;
 }
 
+int mempool_page_acct_query(const void* data, mempool_acct_stat_t* buf)
+{
+	(void)data;
+	if(NULL == buf) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	uint64_t page_size = _get_page_size();
+	uint64_t held = _num_system_pages;
+
+	if(NULL != _huge.base)
+	{
+		uint32_t chunks = _huge.next_chunk;
+		if(chunks > _huge.num_chunks) chunks = _huge.num_chunks;
+		held += (uint64_t)chunks * (UTILS_MEMPOOL_PAGE_CHUNK_SIZE / page_size);
+	}
+
+	/* The thread local pools are never disposed until the allocator is finalized */
+	uint64_t allocs = 0, frees = 0;
+	const _thread_page_pool_t* pool;
+	for(pool = _local_page_pool_list; NULL != pool; pool = pool->next)
+	{
+		allocs += pool->allocs;
+		frees += pool->frees;
+	}
+
+	uint64_t in_use = allocs > frees ? allocs - frees : 0;
+
+	buf->in_use = in_use * page_size;
+	buf->cached = held > in_use ? (held - in_use) * page_size : 0;
+	buf->high_watermark = 0;
+	buf->allocs = allocs;
+	buf->frees = frees;
+
+	return 0;
+}
+
 void mempool_page_disable(int val)
 {
 	_pool_disabled = val;
@@ -0,0 +1,229 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <error.h>
+#include <utils/log.h>
+#include <utils/static_assertion.h>
+#include <utils/mempool/objpool.h>
+#include <utils/mempool/slab.h>
+
+/**
+ * @brief the header of each memory chunk
+ **/
+typedef struct {
+	uint32_t  class_idx;     /*!< which size class this chunk belongs to */
+	uintpad_t __padding__[0];
+	char      mem[0];        /*!< the actual memory of the chunk */
+} _chunk_t;
+STATIC_ASSERTION_LAST(_chunk_t, mem);
+STATIC_ASSERTION_SIZE(_chunk_t, mem, 0);
+
+/**
+ * @brief a size class
+ * @note the counters are updated by all the threads, so we make each size class occupy a cache line,
+ *       to avoid the counters of different size classes bouncing the same line
+ **/
+typedef union {
+	struct {
+		mempool_objpool_t*   pool;     /*!< the object pool for this size class, NULL for the system allocated chunks */
+		uint32_t             size;     /*!< the chunk size of this class */
+		uint64_t             alloc;    /*!< how many chunks has been allocated */
+		uint64_t             dealloc;  /*!< how many chunks has been deallocated */
+	};
+	char                     __padding__[64];
+} _class_t;
+
+/**
+ * @brief the actual data structure for the slab allocator
+ **/
+struct _mempool_slab_t {
+	uint32_t   num_classes;   /*!< the number of pooled size classes */
+	uint32_t   max_size;      /*!< the max chunk size we can allocate from the pool */
+	_class_t*  classes;       /*!< the size classes, classes[num_classes] is the system allocated chunks */
+};
+
+/**
+ * @brief get the index of the size class for the given size
+ * @param size the size, must be positive
+ * @return the size class index
+ **/
+static inline uint32_t _size_class(uint32_t size)
+{
+	if(size <= 8) return 0;
+	if(size <= 128) return (size + 15) >> 4;
+
+	uint32_t x = size - 1;
+	uint32_t bits = 31u - (uint32_t)__builtin_clz(x);
+
+	return 9 + (bits - 7) * 4 + ((x >> (bits - 2)) & 3);
+}
+
+/**
+ * @brief get the chunk size of the size class
+ * @param idx the size class index
+ * @return the chunk size
+ **/
+static inline uint32_t _class_size(uint32_t idx)
+{
+	if(idx == 0) return 8;
+	if(idx <= 8) return idx << 4;
+
+	uint32_t group = (idx - 9) / 4;
+	uint32_t step  = (idx - 9) % 4 + 1;
+
+	return (128u << group) + step * (32u << group);
+}
+
+mempool_slab_t* mempool_slab_new(void)
+{
+	int page_size = getpagesize();
+	if(page_size <= 0)
+		ERROR_PTR_RETURN_LOG("Invalid page size");
+
+	mempool_slab_t* ret = (mempool_slab_t*)malloc(sizeof(mempool_slab_t));
+	if(NULL == ret)
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the slab allocator");
+
+	/* We only pool the chunks that at least two of them can fit in one page, otherwise the waste is too much */
+	uint32_t n;
+	for(n = 0; 2 * (_class_size(n) + sizeof(_chunk_t)) <= (uint32_t)page_size; n ++);
+
+	ret->num_classes = n;
+	ret->max_size = n > 0 ? _class_size(n - 1) : 0;
+
+	uint32_t i = 0;
+	if(NULL == (ret->classes = (_class_t*)calloc(n + 1, sizeof(_class_t))))
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the size class array");
+
+	for(i = 0; i < n; i ++)
+	{
+		ret->classes[i].size = _class_size(i);
+		if(NULL == (ret->classes[i].pool = mempool_objpool_new(ret->classes[i].size + (uint32_t)sizeof(_chunk_t))))
+			ERROR_LOG_GOTO(ERR, "Cannot create the object pool for the size class %u", ret->classes[i].size);
+	}
+
+	LOG_DEBUG("Slab allocator has been created with %u size classes, max pooled chunk size %u", n, ret->max_size);
+
+	return ret;
+ERR:
+	if(NULL != ret->classes)
+	{
+		for(i = 0; i < n; i ++)
+			if(NULL != ret->classes[i].pool)
+				mempool_objpool_free(ret->classes[i].pool);
+		free(ret->classes);
+	}
+	free(ret);
+	return NULL;
+}
+
+int mempool_slab_free(mempool_slab_t* slab)
+{
+	if(NULL == slab)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	int rc = 0;
+	uint32_t i;
+	for(i = 0; i < slab->num_classes; i ++)
+	{
+		if(slab->classes[i].alloc != slab->classes[i].dealloc)
+			LOG_DEBUG("%"PRIu64" chunks in size class %u are not returned", slab->classes[i].alloc - slab->classes[i].dealloc, slab->classes[i].size);
+
+		if(ERROR_CODE(int) == mempool_objpool_free(slab->classes[i].pool))
+			rc = ERROR_CODE(int);
+	}
+
+	free(slab->classes);
+	free(slab);
+
+	return rc;
+}
+
+void* mempool_slab_alloc(mempool_slab_t* slab, uint32_t size)
+{
+	if(NULL == slab || 0 == size || ERROR_CODE(uint32_t) == size)
+		ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	uint32_t idx = size > slab->max_size ? slab->num_classes : _size_class(size);
+	_class_t* sc = slab->classes + idx;
+	_chunk_t* chunk;
+
+	if(NULL != sc->pool)
+	{
+		if(NULL == (chunk = (_chunk_t*)mempool_objpool_alloc(sc->pool)))
+			ERROR_PTR_RETURN_LOG("Cannot allocate memory from the object pool of size class %u", sc->size);
+	}
+	else if(NULL == (chunk = (_chunk_t*)malloc(sizeof(_chunk_t) + size)))
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the large chunk");
+
+	__sync_fetch_and_add(&sc->alloc, 1);
+
+	chunk->class_idx = idx;
+
+	return chunk->mem;
+}
+
+int mempool_slab_dealloc(mempool_slab_t* slab, void* mem)
+{
+	if(NULL == slab || NULL == mem)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	_chunk_t* chunk = (_chunk_t*)((char*)mem - sizeof(_chunk_t));
+
+	if(chunk->class_idx > slab->num_classes)
+		ERROR_RETURN_LOG(int, "Invalid memory chunk");
+
+	_class_t* sc = slab->classes + chunk->class_idx;
+
+	__sync_fetch_and_add(&sc->dealloc, 1);
+
+	if(NULL == sc->pool)
+	{
+		free(chunk);
+		return 0;
+	}
+
+	return mempool_objpool_dealloc(sc->pool, chunk);
+}
+
+uint32_t mempool_slab_num_classes(const mempool_slab_t* slab)
+{
+	if(NULL == slab)
+		ERROR_RETURN_LOG(uint32_t, "Invalid arguments");
+
+	return slab->num_classes + 1;
+}
+
+int mempool_slab_class_stat(const mempool_slab_t* slab, uint32_t idx, mempool_slab_class_stat_t* buf)
+{
+	if(NULL == slab || idx > slab->num_classes || NULL == buf)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	const _class_t* sc = slab->classes + idx;
+
+	uint64_t alloc = sc->alloc;
+	uint64_t dealloc = sc->dealloc;
+
+	buf->size = sc->size;
+	buf->total = alloc;
+	buf->in_use = alloc > dealloc ? alloc - dealloc : 0;
+
+	if(NULL != sc->pool)
+	{
+		if(ERROR_CODE(uint32_t) == (buf->obj_size = mempool_objpool_get_obj_size(sc->pool)))
+			ERROR_RETURN_LOG(int, "Cannot get the object size of the size class");
+
+		if(ERROR_CODE(uint32_t) == (buf->pages = mempool_objpool_get_page_count(sc->pool)))
+			ERROR_RETURN_LOG(int, "Cannot get the page count of the size class");
+	}
+	else buf->obj_size = buf->pages = 0;
+
+	return 0;
+}
@@ -6,10 +6,12 @@
 #include <utils/utils.h>
 #include <utils/log.h>
 #include <utils/mempool/page.h>
+#include <utils/mempool/acct.h>
 #include <utils/init.h>
 
 INIT_VEC(modules) = {
 	INIT_MODULE(log),
+	INIT_MODULE(mempool_acct),
 	INIT_MODULE(mempool_page)
 };
 
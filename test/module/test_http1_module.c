@@ -0,0 +1,439 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <testenv.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <itc/module_types.h>
+#include <itc/modtab.h>
+#include <lang/prop.h>
+#include <module/tcp/module.h>
+#include <module/http1/module.h>
+#include <itc/module.h>
+#include <sys/wait.h>
+
+itc_module_type_t mod_http1;
+uint16_t port;
+char prop_prefix[64];
+
+static const char* const requests[] = {
+	"GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n",
+	"POST /hello HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 5\r\n\r\nworld",
+	"POST /chunked HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n5;ext=1\r\nHello\r\n0\r\nTrailer: yes\r\n\r\n",
+	"GET /last HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n",
+	"GET /discarded HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+};
+
+static const char* const responses[] = {
+	"HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n0",
+	"HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n1",
+	"HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n2",
+	"HTTP/1.1 200 OK\r\nContent-Length: 1\r\nConnection: close\r\n\r\n3",
+	"HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n4"
+};
+
+#define N (sizeof(requests) / sizeof(requests[0]))
+
+static const char bad_request[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+static int _cntl(itc_module_pipe_t* pipe, uint32_t opcode, ...)
+{
+	va_list ap;
+	va_start(ap, opcode);
+	int rc = itc_module_pipe_cntl(pipe, opcode, ap);
+	va_end(ap);
+	return rc;
+}
+
+static int _set_max_pipeline(int64_t value)
+{
+	char symbol[128];
+	lang_prop_value_t prop = {
+		.type = LANG_PROP_TYPE_INTEGER,
+		.num  = value
+	};
+	snprintf(symbol, sizeof(symbol), "%s.max_pipeline", prop_prefix);
+	return lang_prop_set(symbol, prop);
+}
+
+static int _connect(void)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	if(sock == -1)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("connect");
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/**
+ * @brief Send all the given requests with a single write
+ **/
+static int _send_requests(int sock, const char* const* reqs, int n)
+{
+	static char buffer[4096];
+	size_t size = 0;
+	int i;
+	for(i = 0; i < n; i ++)
+	{
+		size_t len = strlen(reqs[i]);
+		memcpy(buffer + size, reqs[i], len);
+		size += len;
+	}
+
+	if(send(sock, buffer, size, 0) != (ssize_t)size)
+	{
+		perror("send");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Receive the expected data, and make sure nothing follows it
+ * @note The server closes the connection when the TCP module polls the next time, so we only check there's no more data
+ **/
+static int _recv_responses(int sock, const char* expected)
+{
+	static char buffer[4096];
+	size_t ptr = 0, size = strlen(expected);
+	ssize_t rc;
+
+	while(ptr < size && (rc = recv(sock, buffer + ptr, size - ptr, 0)) > 0)
+		ptr += (size_t)rc;
+
+	if(ptr != size || memcmp(buffer, expected, ptr) != 0)
+	{
+		fprintf(stderr, "Unexpected response: %.*s\n", (int)ptr, buffer);
+		return -1;
+	}
+
+	struct timeval tv = {
+		.tv_sec = 0,
+		.tv_usec = 500000
+	};
+	if(setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 || recv(sock, buffer, 1, 0) > 0)
+	{
+		fprintf(stderr, "Unexpected data after the responses\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Accept the next request, and check it's the expected one
+ **/
+static int _accept(itc_module_pipe_t** in, itc_module_pipe_t** out, const char* expected)
+{
+	itc_module_pipe_param_t param = {
+		.input_flags = RUNTIME_API_PIPE_INPUT,
+		.output_flags = RUNTIME_API_PIPE_OUTPUT,
+		.args = NULL
+	};
+	static char buffer[4096];
+	size_t size = 0, rc;
+
+	ASSERT_OK(itc_module_pipe_accept(mod_http1, param, in, out), CLEANUP_NOP);
+
+	while(0 != (rc = itc_module_pipe_read(buffer + size, sizeof(buffer) - size, *in)))
+	{
+		ASSERT_RETOK(size_t, rc, CLEANUP_NOP);
+		size += rc;
+	}
+
+	ASSERT(size == strlen(expected) && memcmp(buffer, expected, size) == 0, CLEANUP_NOP);
+
+	return 0;
+}
+
+/**
+ * @brief Write the response and finalize the request
+ **/
+static int _respond(itc_module_pipe_t** in, itc_module_pipe_t** out, const char* response, int persist)
+{
+	if(persist) ASSERT_OK(_cntl(*in, RUNTIME_API_PIPE_CNTL_OPCODE_SET_FLAG, RUNTIME_API_PIPE_PERSIST), CLEANUP_NOP);
+
+	ASSERT_RETOK(size_t, itc_module_pipe_write(response, strlen(response), *out), CLEANUP_NOP);
+
+	ASSERT_OK(itc_module_pipe_deallocate(*in), CLEANUP_NOP);
+	*in = NULL;
+	ASSERT_OK(itc_module_pipe_deallocate(*out), CLEANUP_NOP);
+	*out = NULL;
+
+	return 0;
+}
+
+static int _cleanup(itc_module_pipe_t** in, itc_module_pipe_t** out, int n)
+{
+	int i;
+	for(i = 0; i < n; i ++)
+	{
+		if(NULL != in[i]) itc_module_pipe_deallocate(in[i]);
+		if(NULL != out[i]) itc_module_pipe_deallocate(out[i]);
+	}
+	return -1;
+}
+
+int do_pipelined_request(void)
+{
+	int sock = _connect();
+	if(sock < 0) return -1;
+
+	/* All the requests are in a single write, and the response of the one after the closing one should be discarded */
+	if(_send_requests(sock, requests, N) < 0) goto ERR;
+
+	char expected[1024];
+	snprintf(expected, sizeof(expected), "%s%s%s%s", responses[0], responses[1], responses[2], responses[3]);
+
+	if(_recv_responses(sock, expected) < 0) goto ERR;
+
+	close(sock);
+	return 0;
+ERR:
+	close(sock);
+	return -1;
+}
+
+int pipeline_test(void)
+{
+	pid_t pid;
+	itc_module_pipe_t *in[N] = {}, *out[N] = {};
+	int status, i;
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		plumber_finalize();
+		exit(do_pipelined_request());
+		return 0;
+	}
+
+	/* All the requests in the buffer are dispatched before any of them is done */
+	for(i = 0; i < (int)N; i ++)
+		ASSERT_OK(_accept(in + i, out + i, requests[i]), goto ERR);
+
+	/* And the responses are written in the reverse order, the client should get them in the request order */
+	for(i = (int)N - 1; i >= 0; i --)
+		ASSERT_OK(_respond(in + i, out + i, responses[i], i != 3), goto ERR);
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	return 0;
+ERR:
+	return _cleanup(in, out, N);
+}
+
+int pipeline_limit_test(void)
+{
+	pid_t pid;
+	itc_module_pipe_t *in[2] = {}, *out[2] = {};
+	int status, i, j;
+
+	ASSERT(1 == _set_max_pipeline(2), CLEANUP_NOP);
+
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		plumber_finalize();
+		exit(do_pipelined_request());
+		return 0;
+	}
+
+	/* Only two requests are dispatched at the same time, the rest are split once the first two are done.
+	 * And the last request is never dispatched, since the connection is closed before we split it */
+	for(i = 0; i < 4; i += 2)
+	{
+		for(j = 0; j < 2; j ++)
+			ASSERT_OK(_accept(in + j, out + j, requests[i + j]), goto ERR);
+		for(j = 1; j >= 0; j --)
+			ASSERT_OK(_respond(in + j, out + j, responses[i + j], i + j != 3), goto ERR);
+	}
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	ASSERT(1 == _set_max_pipeline(MODULE_HTTP1_MAX_PIPELINE), CLEANUP_NOP);
+
+	return 0;
+ERR:
+	_set_max_pipeline(MODULE_HTTP1_MAX_PIPELINE);
+	return _cleanup(in, out, 2);
+}
+
+int do_bad_request(void)
+{
+	static const char* const reqs[] = {
+		"GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n",
+		"GET /bad HTTP/1.1\r\nNo colon here\r\n\r\n"
+	};
+	int sock = _connect();
+	if(sock < 0) return -1;
+
+	if(_send_requests(sock, reqs, 2) < 0) goto ERR;
+
+	char expected[1024];
+	snprintf(expected, sizeof(expected), "%s%s", responses[0], bad_request);
+
+	if(_recv_responses(sock, expected) < 0) goto ERR;
+
+	close(sock);
+	return 0;
+ERR:
+	close(sock);
+	return -1;
+}
+
+int bad_request_test(void)
+{
+	pid_t pid;
+	itc_module_pipe_t *in = NULL, *out = NULL;
+	int status;
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		plumber_finalize();
+		exit(do_bad_request());
+		return 0;
+	}
+
+	/* The malformed request is answered by the module after the response of the valid one */
+	ASSERT_OK(_accept(&in, &out, requests[0]), goto ERR);
+	ASSERT_OK(_respond(&in, &out, responses[0], 1), goto ERR);
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	return 0;
+ERR:
+	return _cleanup(&in, &out, 1);
+}
+
+int do_undispatched_request(void)
+{
+	int sock = _connect();
+	if(sock < 0) return -1;
+
+	if(_send_requests(sock, requests, 3) < 0) goto ERR;
+
+	/* Only the first request is answered, the rest are dropped when the module exits */
+	if(_recv_responses(sock, responses[0]) < 0) goto ERR;
+
+	close(sock);
+	return 0;
+ERR:
+	close(sock);
+	return -1;
+}
+
+int undispatched_test(void)
+{
+	pid_t pid;
+	itc_module_pipe_t *in = NULL, *out = NULL;
+	int status;
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		plumber_finalize();
+		exit(do_undispatched_request());
+		return 0;
+	}
+
+	ASSERT_OK(_accept(&in, &out, requests[0]), goto ERR);
+	ASSERT_OK(_respond(&in, &out, responses[0], 1), goto ERR);
+
+	/* The requests still in the queue should be disposed and the connection should be given back, otherwise they leak */
+	ASSERT_OK(itc_module_on_exit(mod_http1), goto ERR);
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	return 0;
+ERR:
+	return _cleanup(&in, &out, 1);
+}
+
+/**
+ * @brief Ask the kernel for a free port, so that we don't collide with the other tests running at the same time
+ **/
+static int _pick_port(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT(sock >= 0, CLEANUP_NOP);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = 0;
+
+	ASSERT(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0, close(sock));
+	ASSERT(getsockname(sock, (struct sockaddr*)&addr, &len) == 0, close(sock));
+
+	port = ntohs(addr.sin_port);
+	close(sock);
+
+	return 0;
+}
+
+int setup(void)
+{
+	char path[64], port_text[16];
+	ASSERT_OK(_pick_port(), CLEANUP_NOP);
+	snprintf(port_text, sizeof(port_text), "%u", port);
+	snprintf(path, sizeof(path), "pipe.tcp.port_%u", port);
+
+	/* The transportation layer module should not run the event loop by itself */
+	char const* tcp_args[] = {"--slave", port_text};
+	ASSERT_OK(itc_modtab_insmod(&module_tcp_module_def, 2, tcp_args), CLEANUP_NOP);
+
+	char const* args[] = {path};
+	ASSERT_OK(itc_modtab_insmod(&module_http1_module_def, 1, args), CLEANUP_NOP);
+
+	snprintf(prop_prefix, sizeof(prop_prefix), "pipe.http1.pipe.tcp.port_%u", port);
+	mod_http1 = itc_modtab_get_module_type_from_path(prop_prefix);
+	ASSERT(ERROR_CODE(itc_module_type_t) != mod_http1, CLEANUP_NOP);
+
+	/* Because a GLIBC bug, the TLS of the threads may leak */
+	expected_memory_leakage();
+	return 0;
+}
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(pipeline_test),
+    TEST_CASE(pipeline_limit_test),
+    TEST_CASE(bad_request_test),
+    TEST_CASE(undispatched_test)
+TEST_LIST_END;
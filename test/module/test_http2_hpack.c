@@ -0,0 +1,212 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <testenv.h>
+#include <module/http2/hpack.h>
+
+static char result[1024];
+static size_t result_size;
+
+static int _collect(const char* name, size_t name_len, const char* value, size_t value_len, void* data)
+{
+	(void)data;
+	int rc = snprintf(result + result_size, sizeof(result) - result_size, "%.*s: %.*s\n", (int)name_len, name, (int)value_len, value);
+	if(rc < 0 || (size_t)rc >= sizeof(result) - result_size) return ERROR_CODE(int);
+	result_size += (size_t)rc;
+	return 0;
+}
+
+static int _decode(module_http2_hpack_table_t* table, const uint8_t* data, size_t size)
+{
+	result_size = 0;
+	result[0] = 0;
+	return module_http2_hpack_decode(table, data, size, _collect, NULL);
+}
+
+/**
+ * @brief The request examples from RFC 7541 C.3 (without Huffman) and C.4 (with Huffman)
+ **/
+static const uint8_t c3_1[] = {0x82, 0x86, 0x84, 0x41, 0x0f, 0x77, 0x77, 0x77, 0x2e, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d};
+static const uint8_t c3_2[] = {0x82, 0x86, 0x84, 0xbe, 0x58, 0x08, 0x6e, 0x6f, 0x2d, 0x63, 0x61, 0x63, 0x68, 0x65};
+static const uint8_t c3_3[] = {0x82, 0x87, 0x85, 0xbf, 0x40, 0x0a, 0x63, 0x75, 0x73, 0x74, 0x6f, 0x6d, 0x2d, 0x6b, 0x65, 0x79,
+                               0x0c, 0x63, 0x75, 0x73, 0x74, 0x6f, 0x6d, 0x2d, 0x76, 0x61, 0x6c, 0x75, 0x65};
+static const uint8_t c4_1[] = {0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff};
+static const uint8_t c4_2[] = {0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf};
+static const uint8_t c4_3[] = {0x82, 0x87, 0x85, 0xbf, 0x40, 0x88, 0x25, 0xa8, 0x49, 0xe9, 0x5b, 0xa9, 0x7d, 0x7f,
+                               0x89, 0x25, 0xa8, 0x49, 0xe9, 0x5b, 0xb8, 0xe8, 0xb4, 0xbf};
+
+static const char expected_1[] = ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n";
+static const char expected_2[] = ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n";
+static const char expected_3[] = ":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n";
+
+static int _request_sequence(const uint8_t* r1, size_t s1, const uint8_t* r2, size_t s2, const uint8_t* r3, size_t s3)
+{
+	module_http2_hpack_table_t table;
+	ASSERT_OK(module_http2_hpack_table_init(&table, 4096), CLEANUP_NOP);
+
+	ASSERT_OK(_decode(&table, r1, s1), goto ERR);
+	ASSERT_STREQ(result, expected_1, goto ERR);
+	ASSERT(table.count == 1 && table.size == 57, goto ERR);
+
+	ASSERT_OK(_decode(&table, r2, s2), goto ERR);
+	ASSERT_STREQ(result, expected_2, goto ERR);
+	ASSERT(table.count == 2 && table.size == 110, goto ERR);
+
+	ASSERT_OK(_decode(&table, r3, s3), goto ERR);
+	ASSERT_STREQ(result, expected_3, goto ERR);
+	ASSERT(table.count == 3 && table.size == 164, goto ERR);
+
+	ASSERT_OK(module_http2_hpack_table_finalize(&table), CLEANUP_NOP);
+	return 0;
+ERR:
+	module_http2_hpack_table_finalize(&table);
+	return ERROR_CODE(int);
+}
+
+int plain_request(void)
+{
+	return _request_sequence(c3_1, sizeof(c3_1), c3_2, sizeof(c3_2), c3_3, sizeof(c3_3));
+}
+
+int huffman_request(void)
+{
+	return _request_sequence(c4_1, sizeof(c4_1), c4_2, sizeof(c4_2), c4_3, sizeof(c4_3));
+}
+
+int eviction(void)
+{
+	module_http2_hpack_table_t table;
+	/* Each entry takes 32 + 1 + 1 = 34 bytes, so the table holds at most 2 entries */
+	static const uint8_t data[] = {0x3f, 0x25,  /* Dynamic table size update to 68 */
+	                               0x40, 0x01, 'a', 0x01, '1',
+	                               0x40, 0x01, 'b', 0x01, '2',
+	                               0x40, 0x01, 'c', 0x01, '3',
+	                               0xbe, 0xbf};
+	static const uint8_t evicted[] = {0xc0};
+
+	ASSERT_OK(module_http2_hpack_table_init(&table, 4096), CLEANUP_NOP);
+
+	ASSERT_OK(_decode(&table, data, sizeof(data)), goto ERR);
+	ASSERT_STREQ(result, "a: 1\nb: 2\nc: 3\nc: 3\nb: 2\n", goto ERR);
+	ASSERT(table.count == 2 && table.size == 68, goto ERR);
+
+	ASSERT(ERROR_CODE(int) == _decode(&table, evicted, sizeof(evicted)), goto ERR);
+
+	ASSERT_OK(module_http2_hpack_table_finalize(&table), CLEANUP_NOP);
+	return 0;
+ERR:
+	module_http2_hpack_table_finalize(&table);
+	return ERROR_CODE(int);
+}
+
+int evict_indexed_name(void)
+{
+	module_http2_hpack_table_t table;
+	/* The table is full with 2 entries, and the third field takes its name from the oldest entry, which
+	 * is evicted by the insertion of the field itself */
+	static const uint8_t data[] = {0x3f, 0x25,  /* Dynamic table size update to 68 */
+	                               0x40, 0x01, 'a', 0x01, '1',
+	                               0x40, 0x01, 'b', 0x01, '2',
+	                               0x7f, 0x00, 0x01, '9',  /* Literal with indexing, name index 63 */
+	                               0xbe, 0xbf};
+
+	ASSERT_OK(module_http2_hpack_table_init(&table, 4096), CLEANUP_NOP);
+
+	ASSERT_OK(_decode(&table, data, sizeof(data)), goto ERR);
+	ASSERT_STREQ(result, "a: 1\nb: 2\na: 9\na: 9\nb: 2\n", goto ERR);
+	ASSERT(table.count == 2 && table.size == 68, goto ERR);
+
+	ASSERT_OK(module_http2_hpack_table_finalize(&table), CLEANUP_NOP);
+	return 0;
+ERR:
+	module_http2_hpack_table_finalize(&table);
+	return ERROR_CODE(int);
+}
+
+int invalid_input(void)
+{
+	module_http2_hpack_table_t table;
+	/* The size update exceeds the limit we advertised */
+	static const uint8_t oversized[] = {0x3f, 0xe2, 0x1f};
+	/* The string is longer than the block */
+	static const uint8_t truncated[] = {0x40, 0x05, 'a', 'b'};
+	/* The index 0 is never valid */
+	static const uint8_t zero_index[] = {0x80};
+	/* The Huffman padding which is longer than 7 bits */
+	static const uint8_t padding[] = {0x40, 0x81, 0x1f, 0x81, 0xff};
+
+	ASSERT_OK(module_http2_hpack_table_init(&table, 4096), CLEANUP_NOP);
+
+	ASSERT(ERROR_CODE(int) == _decode(&table, oversized, sizeof(oversized)), goto ERR);
+	ASSERT(ERROR_CODE(int) == _decode(&table, truncated, sizeof(truncated)), goto ERR);
+	ASSERT(ERROR_CODE(int) == _decode(&table, zero_index, sizeof(zero_index)), goto ERR);
+	ASSERT(ERROR_CODE(int) == _decode(&table, padding, sizeof(padding)), goto ERR);
+
+	ASSERT_OK(module_http2_hpack_table_finalize(&table), CLEANUP_NOP);
+	return 0;
+ERR:
+	module_http2_hpack_table_finalize(&table);
+	return ERROR_CODE(int);
+}
+
+int encode_roundtrip(void)
+{
+	module_http2_hpack_table_t table;
+	uint8_t buf[1024];
+	size_t size = 0, rc;
+	static const uint32_t status[] = {200, 204, 206, 304, 400, 404, 500, 302, 418};
+	static char long_value[300];
+	static char expected[1024];
+	unsigned i;
+
+	memset(long_value, 'x', sizeof(long_value) - 1);
+
+	ASSERT_OK(module_http2_hpack_table_init(&table, 4096), CLEANUP_NOP);
+
+	for(i = 0; i < sizeof(status) / sizeof(status[0]); i ++)
+	{
+		ASSERT_RETOK(size_t, rc = module_http2_hpack_encode_status(buf, sizeof(buf), status[i]), goto ERR);
+		ASSERT_OK(_decode(&table, buf, rc), goto ERR);
+		snprintf(expected, sizeof(expected), ":status: %u\n", status[i]);
+		ASSERT_STREQ(result, expected, goto ERR);
+	}
+
+	ASSERT_RETOK(size_t, rc = module_http2_hpack_encode_field(buf + size, sizeof(buf) - size, "content-type", 12, "text/html", 9), goto ERR);
+	size += rc;
+	ASSERT_RETOK(size_t, rc = module_http2_hpack_encode_field(buf + size, sizeof(buf) - size, "x-long", 6, long_value, sizeof(long_value) - 1), goto ERR);
+	size += rc;
+	ASSERT_RETOK(size_t, rc = module_http2_hpack_encode_field(buf + size, sizeof(buf) - size, "x-empty", 7, "", 0), goto ERR);
+	size += rc;
+
+	ASSERT_OK(_decode(&table, buf, size), goto ERR);
+	snprintf(expected, sizeof(expected), "content-type: text/html\nx-long: %s\nx-empty: \n", long_value);
+	ASSERT_STREQ(result, expected, goto ERR);
+
+	/* The encoder never touches the dynamic table */
+	ASSERT(table.count == 0, goto ERR);
+
+	/* The encoder should report the buffer is too small */
+	ASSERT(ERROR_CODE(size_t) == module_http2_hpack_encode_field(buf, 16, "x-long", 6, long_value, sizeof(long_value) - 1), goto ERR);
+
+	ASSERT_OK(module_http2_hpack_table_finalize(&table), CLEANUP_NOP);
+	return 0;
+ERR:
+	module_http2_hpack_table_finalize(&table);
+	return ERROR_CODE(int);
+}
+
+DEFAULT_SETUP;
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(plain_request),
+    TEST_CASE(huffman_request),
+    TEST_CASE(eviction),
+    TEST_CASE(evict_indexed_name),
+    TEST_CASE(invalid_input),
+    TEST_CASE(encode_roundtrip)
+TEST_LIST_END;
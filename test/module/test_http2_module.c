@@ -0,0 +1,497 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <testenv.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <itc/module_types.h>
+#include <itc/modtab.h>
+#include <module/tcp/module.h>
+#include <module/http2/module.h>
+#include <module/http2/hpack.h>
+#include <itc/module.h>
+#include <sys/wait.h>
+
+itc_module_type_t mod_http2;
+uint16_t port;
+
+static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+static const char* const paths[] = {"/index.html", "/hello"};
+
+static const char* const requests[] = {
+	"GET /index.html HTTP/1.1\r\nhost: 127.0.0.1\r\nuser-agent: test\r\n\r\n",
+	"POST /hello HTTP/1.1\r\nhost: 127.0.0.1\r\nuser-agent: test\r\ncontent-length: 5\r\n\r\nworld"
+};
+
+static const char* const responses[] = {
+	"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: keep-alive\r\nContent-Length: 11\r\n\r\nHello World",
+	"HTTP/1.1 404 Not Found\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nHello\r\n6\r\n World\r\n0\r\n\r\n"
+};
+
+static const char* const expected_headers[] = {
+	":status: 200\ncontent-type: text/html\ncontent-length: 11\n",
+	":status: 404\n"
+};
+
+static const char expected_body[] = "Hello World";
+
+/**
+ * @brief The client side state of a stream
+ **/
+typedef struct {
+	char   headers[1024];   /*!< The decoded header fields */
+	size_t headers_size;    /*!< The size of the decoded header fields */
+	char   body[1024];      /*!< The response body */
+	size_t body_size;       /*!< The size of the response body */
+	int    done;            /*!< If we have seen the END_STREAM flag */
+} client_stream_t;
+
+static int _collect(const char* name, size_t name_len, const char* value, size_t value_len, void* data)
+{
+	client_stream_t* stream = (client_stream_t*)data;
+	size_t left = sizeof(stream->headers) - stream->headers_size;
+	int rc = snprintf(stream->headers + stream->headers_size, left, "%.*s: %.*s\n", (int)name_len, name, (int)value_len, value);
+	if(rc < 0 || (size_t)rc >= left) return ERROR_CODE(int);
+	stream->headers_size += (size_t)rc;
+	return 0;
+}
+
+static size_t _frame(uint8_t* buf, uint8_t type, uint8_t flags, uint32_t sid, const void* payload, size_t size)
+{
+	buf[0] = (uint8_t)(size >> 16);
+	buf[1] = (uint8_t)(size >> 8);
+	buf[2] = (uint8_t)size;
+	buf[3] = type;
+	buf[4] = flags;
+	buf[5] = (uint8_t)(sid >> 24);
+	buf[6] = (uint8_t)(sid >> 16);
+	buf[7] = (uint8_t)(sid >> 8);
+	buf[8] = (uint8_t)sid;
+	if(size > 0) memcpy(buf + 9, payload, size);
+	return size + 9;
+}
+
+static size_t _request_block(uint8_t* buf, size_t size, const char* method, const char* path)
+{
+	const char* fields[][2] = {
+		{":method", method},
+		{":scheme", "http"},
+		{":path", path},
+		{":authority", "127.0.0.1"},
+		{"user-agent", "test"}
+	};
+	size_t ret = 0, i;
+	for(i = 0; i < sizeof(fields) / sizeof(fields[0]); i ++)
+	{
+		size_t rc = module_http2_hpack_encode_field(buf + ret, size - ret, fields[i][0], strlen(fields[i][0]), fields[i][1], strlen(fields[i][1]));
+		if(ERROR_CODE(size_t) == rc) return ERROR_CODE(size_t);
+		ret += rc;
+	}
+	return ret;
+}
+
+static int _recv_all(int sock, void* buf, size_t size)
+{
+	size_t ptr = 0;
+	while(ptr < size)
+	{
+		ssize_t rc = recv(sock, (char*)buf + ptr, size - ptr, 0);
+		if(rc <= 0)
+		{
+			perror("recv");
+			return -1;
+		}
+		ptr += (size_t)rc;
+	}
+	return 0;
+}
+
+/**
+ * @brief Read a frame from the server, and collect the response of the stream
+ * @return The frame type, or -1 on error
+ **/
+static int _recv_frame(int sock, module_http2_hpack_table_t* table, client_stream_t* streams, uint32_t* sid)
+{
+	static uint8_t buf[4096];
+	uint8_t header[9];
+	if(_recv_all(sock, header, sizeof(header)) < 0) return -1;
+
+	size_t length = ((size_t)header[0] << 16) | ((size_t)header[1] << 8) | header[2];
+	*sid = ((uint32_t)(header[5] & 0x7f) << 24) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 8) | header[8];
+
+	if(length > sizeof(buf) || _recv_all(sock, buf, length) < 0) return -1;
+
+	if(header[3] == 0x4 || header[3] == 0x8) return header[3];
+
+	ASSERT(*sid == 1 || *sid == 3, return -1);
+
+	client_stream_t* stream = streams + *sid / 2;
+
+	if(header[3] == 0x1)
+	{
+		if((header[4] & 0x4) == 0 || module_http2_hpack_decode(table, buf, length, _collect, stream) == ERROR_CODE(int))
+			return -1;
+	}
+	else if(header[3] == 0x0)
+	{
+		if(stream->body_size + length > sizeof(stream->body)) return -1;
+		memcpy(stream->body + stream->body_size, buf, length);
+		stream->body_size += length;
+	}
+	else
+	{
+		LOG_ERROR("Unexpected frame type %u on stream %u", header[3], *sid);
+		return -1;
+	}
+
+	if(header[4] & 0x1) stream->done = 1;
+
+	return header[3];
+}
+
+static int _connect(void)
+{
+	struct sockaddr_in addr;
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+	if(sock == -1)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("connect");
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+int do_request(void)
+{
+	static uint8_t buf[4096], block[1024];
+	static client_stream_t streams[2];
+	module_http2_hpack_table_t table;
+	size_t size = 0, block_size;
+	int sock, rc = -1;
+	uint32_t sid;
+
+	if(module_http2_hpack_table_init(&table, 4096) == ERROR_CODE(int))
+		return -1;
+
+	if((sock = _connect()) < 0)
+	{
+		module_http2_hpack_table_finalize(&table);
+		return -1;
+	}
+
+	/* The connection preface, an empty SETTINGS frame and the first request without body */
+	memcpy(buf, preface, sizeof(preface) - 1);
+	size += sizeof(preface) - 1;
+	size += _frame(buf + size, 0x4, 0, 0, NULL, 0);
+	if(ERROR_CODE(size_t) == (block_size = _request_block(block, sizeof(block), "GET", paths[0]))) goto RET;
+	size += _frame(buf + size, 0x1, 0x5, 1, block, block_size);
+
+	/* The second request has a body */
+	if(ERROR_CODE(size_t) == (block_size = _request_block(block, sizeof(block), "POST", paths[1]))) goto RET;
+	size += _frame(buf + size, 0x1, 0x4, 3, block, block_size);
+	size += _frame(buf + size, 0x0, 0x1, 3, "world", 5);
+
+	if(send(sock, buf, size, 0) < 0)
+	{
+		perror("send");
+		goto RET;
+	}
+
+	while(!streams[0].done || !streams[1].done)
+		if(_recv_frame(sock, &table, streams, &sid) < 0)
+			goto RET;
+
+	int i;
+	for(i = 0; i < 2; i ++)
+	{
+		streams[i].headers[streams[i].headers_size] = 0;
+		ASSERT_STREQ(streams[i].headers, expected_headers[i], goto RET);
+		ASSERT(streams[i].body_size == sizeof(expected_body) - 1, goto RET);
+		ASSERT(memcmp(streams[i].body, expected_body, streams[i].body_size) == 0, goto RET);
+	}
+
+	rc = 0;
+RET:
+	module_http2_hpack_table_finalize(&table);
+	shutdown(sock, 2);
+	close(sock);
+	return rc;
+}
+
+/**
+ * @brief The client which only allows 4 bytes of the response body at the beginning, then opens the window
+ *        of the first stream with the second request
+ **/
+int do_flow_control_request(void)
+{
+	static uint8_t buf[4096], block[1024];
+	static client_stream_t streams[2];
+	static const uint8_t settings[] = {0, 0x4, 0, 0, 0, 4};
+	static const uint8_t increment[] = {0, 0, 0, sizeof(expected_body) - 1 - 4};
+	module_http2_hpack_table_t table;
+	size_t size = 0, block_size;
+	int sock, rc = -1;
+	uint32_t sid;
+
+	if(module_http2_hpack_table_init(&table, 4096) == ERROR_CODE(int))
+		return -1;
+
+	if((sock = _connect()) < 0)
+	{
+		module_http2_hpack_table_finalize(&table);
+		return -1;
+	}
+
+	memcpy(buf, preface, sizeof(preface) - 1);
+	size += sizeof(preface) - 1;
+	size += _frame(buf + size, 0x4, 0, 0, settings, sizeof(settings));
+	if(ERROR_CODE(size_t) == (block_size = _request_block(block, sizeof(block), "GET", paths[0]))) goto RET;
+	size += _frame(buf + size, 0x1, 0x5, 1, block, block_size);
+
+	if(send(sock, buf, size, 0) < 0)
+	{
+		perror("send");
+		goto RET;
+	}
+
+	/* The server should stop at the window boundary, rather than waiting for the window */
+	while(streams[0].body_size < 4)
+		if(_recv_frame(sock, &table, streams, &sid) < 0)
+			goto RET;
+
+	ASSERT(streams[0].body_size == 4 && !streams[0].done, goto RET);
+
+	size = 0;
+	size += _frame(buf + size, 0x8, 0, 1, increment, sizeof(increment));
+	if(ERROR_CODE(size_t) == (block_size = _request_block(block, sizeof(block), "GET", paths[1]))) goto RET;
+	size += _frame(buf + size, 0x1, 0x5, 3, block, block_size);
+
+	if(send(sock, buf, size, 0) < 0)
+	{
+		perror("send");
+		goto RET;
+	}
+
+	while(!streams[0].done || !streams[1].done)
+		if(_recv_frame(sock, &table, streams, &sid) < 0)
+			goto RET;
+
+	streams[0].headers[streams[0].headers_size] = 0;
+	ASSERT_STREQ(streams[0].headers, expected_headers[0], goto RET);
+	ASSERT(streams[0].body_size == sizeof(expected_body) - 1, goto RET);
+	ASSERT(memcmp(streams[0].body, expected_body, streams[0].body_size) == 0, goto RET);
+	ASSERT(streams[1].body_size == 4, goto RET);
+	ASSERT(memcmp(streams[1].body, "Done", 4) == 0, goto RET);
+
+	rc = 0;
+RET:
+	module_http2_hpack_table_finalize(&table);
+	shutdown(sock, 2);
+	close(sock);
+	return rc;
+}
+
+int accept_test(void)
+{
+	itc_module_pipe_param_t param = {
+		.input_flags = RUNTIME_API_PIPE_INPUT,
+		.output_flags = RUNTIME_API_PIPE_OUTPUT,
+		.args = NULL
+	};
+
+	pid_t pid;
+	itc_module_pipe_t *in[2] = {}, *out[2] = {};
+	int status, i;
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		plumber_finalize();
+		exit(do_request());
+		return 0;
+	}
+
+	/* Both of the streams should be dispatched before any of them is done */
+	for(i = 0; i < 2; i ++)
+	{
+		static char buffer[4096];
+		size_t rc, size = 0;
+		ASSERT_OK(itc_module_pipe_accept(mod_http2, param, in + i, out + i), goto ERR);
+
+		while(0 != (rc = itc_module_pipe_read(buffer + size, sizeof(buffer) - size - 1, in[i])))
+		{
+			ASSERT_RETOK(size_t, rc, goto ERR);
+			size += rc;
+		}
+		buffer[size] = 0;
+
+		ASSERT_STREQ(buffer, requests[i], goto ERR);
+		ASSERT(itc_module_pipe_eof(in[i]) > 0, goto ERR);
+	}
+
+	/* Then we respond in the reversed order */
+	for(i = 1; i >= 0; i --)
+	{
+		/* The response may be written in pieces */
+		const char* data = responses[i];
+		size_t left = strlen(data);
+		while(left > 0)
+		{
+			size_t bytes = left > 7 ? 7 : left;
+			ASSERT_RETOK(size_t, itc_module_pipe_write(data, bytes, out[i]), goto ERR);
+			data += bytes;
+			left -= bytes;
+		}
+
+		ASSERT_OK(itc_module_pipe_deallocate(in[i]), goto ERR);
+		in[i] = NULL;
+		ASSERT_OK(itc_module_pipe_deallocate(out[i]), goto ERR);
+		out[i] = NULL;
+	}
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	return 0;
+ERR:
+	for(i = 0; i < 2; i ++)
+	{
+		if(NULL != in[i]) itc_module_pipe_deallocate(in[i]);
+		if(NULL != out[i]) itc_module_pipe_deallocate(out[i]);
+	}
+	return -1;
+}
+
+int flow_control_test(void)
+{
+	itc_module_pipe_param_t param = {
+		.input_flags = RUNTIME_API_PIPE_INPUT,
+		.output_flags = RUNTIME_API_PIPE_OUTPUT,
+		.args = NULL
+	};
+
+	static const char* const flow_responses[] = {
+		"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 11\r\n\r\nHello World",
+		"HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nDone"
+	};
+
+	pid_t pid;
+	itc_module_pipe_t *in = NULL, *out = NULL;
+	int status, i;
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		plumber_finalize();
+		exit(do_flow_control_request());
+		return 0;
+	}
+
+	/* The second stream can only be dispatched after the first one is done, and the worker doesn't wait for the window */
+	for(i = 0; i < 2; i ++)
+	{
+		static char buffer[4096];
+		size_t rc;
+		ASSERT_OK(itc_module_pipe_accept(mod_http2, param, &in, &out), goto ERR);
+
+		while(0 != (rc = itc_module_pipe_read(buffer, sizeof(buffer), in)))
+			ASSERT_RETOK(size_t, rc, goto ERR);
+
+		ASSERT_RETOK(size_t, itc_module_pipe_write(flow_responses[i], strlen(flow_responses[i]), out), goto ERR);
+
+		ASSERT_OK(itc_module_pipe_deallocate(in), goto ERR);
+		in = NULL;
+		ASSERT_OK(itc_module_pipe_deallocate(out), goto ERR);
+		out = NULL;
+	}
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	return 0;
+ERR:
+	if(NULL != in) itc_module_pipe_deallocate(in);
+	if(NULL != out) itc_module_pipe_deallocate(out);
+	return -1;
+}
+
+/**
+ * @brief Ask the kernel for a free port, so that we don't collide with the other tests running at the same time
+ **/
+static int _pick_port(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT(sock >= 0, CLEANUP_NOP);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = 0;
+
+	ASSERT(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0, close(sock));
+	ASSERT(getsockname(sock, (struct sockaddr*)&addr, &len) == 0, close(sock));
+
+	port = ntohs(addr.sin_port);
+	close(sock);
+
+	return 0;
+}
+
+int setup(void)
+{
+	char path[64], port_text[16];
+	ASSERT_OK(_pick_port(), CLEANUP_NOP);
+	snprintf(port_text, sizeof(port_text), "%u", port);
+	snprintf(path, sizeof(path), "pipe.tcp.port_%u", port);
+
+	/* The transportation layer module should not run the event loop by itself */
+	char const* tcp_args[] = {"--slave", port_text};
+	ASSERT_OK(itc_modtab_insmod(&module_tcp_module_def, 2, tcp_args), CLEANUP_NOP);
+
+	char const* args[] = {path};
+	ASSERT_OK(itc_modtab_insmod(&module_http2_module_def, 1, args), CLEANUP_NOP);
+
+	snprintf(path, sizeof(path), "pipe.http2.pipe.tcp.port_%u", port);
+	mod_http2 = itc_modtab_get_module_type_from_path(path);
+	ASSERT(ERROR_CODE(itc_module_type_t) != mod_http2, CLEANUP_NOP);
+
+	expected_memory_leakage();
+	/* The connection object and its two buffers are kept by the TCP pool as the state of the persistent connection */
+	expected_memory_leakage();
+	expected_memory_leakage();
+	expected_memory_leakage();
+	return 0;
+}
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(accept_test),
+    TEST_CASE(flow_control_test)
+TEST_LIST_END;
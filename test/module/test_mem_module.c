@@ -0,0 +1,239 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <testenv.h>
+#include <itc/module_types.h>
+#include <itc/module.h>
+
+#define DATA_SIZE (getpagesize() * 3 + 100)
+
+static itc_module_type_t mod_mem;
+
+typedef struct {
+	size_t   offset;
+	size_t   size;
+	int      closed;
+	uint32_t calls;          /*!< how many times the donate callback has been called */
+	uint32_t given;          /*!< how many memory blocks have been donated */
+	uint32_t donated;        /*!< how many large memory blocks have been donated */
+	uint32_t freed;          /*!< how many donated memory blocks have been freed */
+	const uint8_t* blocks[64]; /*!< the large memory blocks that have been donated */
+} source_t;
+
+static source_t* _current_source;
+
+static void _source_fill(const source_t* source, uint8_t* buffer, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; i ++)
+		buffer[i] = (uint8_t)((source->offset + i) % 251);
+}
+
+static size_t _source_read(void* __restrict handle, void* __restrict buffer, size_t count, itc_module_data_source_event_t* event_buf)
+{
+	(void)event_buf;
+	source_t* source = (source_t*)handle;
+
+	/* Return the data in small pieces, so that we can see how the module fills the page */
+	if(count > 777) count = 777;
+	if(count > source->size - source->offset) count = source->size - source->offset;
+
+	_source_fill(source, (uint8_t*)buffer, count);
+
+	source->offset += count;
+
+	return count;
+}
+
+static int _source_free(void* base)
+{
+	_current_source->freed ++;
+	free(base);
+	return 0;
+}
+
+static int _source_donate(void* __restrict handle, itc_module_data_source_page_t* page_buf)
+{
+	source_t* source = (source_t*)handle;
+
+	/* Donate a large block, a small block and then let the module read the next piece */
+	size_t size;
+	switch(source->calls ++ % 3)
+	{
+		case 0: size = 3000; break;
+		case 1: size = 10; break;
+		default: return 0;
+	}
+
+	if(size > source->size - source->offset) size = source->size - source->offset;
+
+	uint8_t* mem = (uint8_t*)malloc(size + 16);
+	if(NULL == mem) return ERROR_CODE(int);
+
+	/* The data doesn't need to start at the beginning of the memory */
+	_source_fill(source, mem + 16, size);
+	source->offset += size;
+	source->given ++;
+
+	if(size == 3000) source->blocks[source->donated ++] = mem + 16;
+
+	page_buf->base = mem;
+	page_buf->data = (const char*)mem + 16;
+	page_buf->size = size;
+	page_buf->free_func = _source_free;
+
+	return 1;
+}
+
+static int _source_eos(const void* __restrict handle)
+{
+	const source_t* source = (const source_t*)handle;
+	return source->offset >= source->size;
+}
+
+static int _source_close(void* __restrict handle)
+{
+	source_t* source = (source_t*)handle;
+	source->closed ++;
+	return 0;
+}
+
+static int _cntl(itc_module_pipe_t* pipe, uint32_t opcode, ...)
+{
+	va_list ap;
+	va_start(ap, opcode);
+	int rc = itc_module_pipe_cntl(pipe, opcode, ap);
+	va_end(ap);
+	return rc;
+}
+
+/**
+ * @brief write the data source to a new mem pipe with the given header size, and check the data by borrowing the pages
+ **/
+static int _run(size_t header_size, int donate)
+{
+	itc_module_pipe_t* out = NULL, *in = NULL;
+	itc_module_pipe_param_t param = {
+		.input_flags = RUNTIME_API_PIPE_INPUT,
+		.output_flags = RUNTIME_API_PIPE_OUTPUT,
+		.input_header = header_size,
+		.output_header = header_size,
+		.args = NULL
+	};
+
+	source_t source = {
+		.size = (size_t)DATA_SIZE * (donate ? 4 : 1)
+	};
+
+	itc_module_data_source_t data_source = {
+		.data_handle = &source,
+		.read = _source_read,
+		.eos = _source_eos,
+		.close = _source_close,
+		.donate = donate ? _source_donate : NULL
+	};
+
+	_current_source = &source;
+
+	ASSERT_OK(itc_module_pipe_allocate(mod_mem, 0, param, &out, &in), CLEANUP_NOP);
+
+	/* The module takes the ownership of the data source */
+	ASSERT(1 == itc_module_pipe_write_data_source(data_source, NULL, out), goto ERR);
+	ASSERT(source.closed == 1, goto ERR);
+	ASSERT(source.offset == source.size, goto ERR);
+	ASSERT_OK(itc_module_pipe_deallocate(out), goto ERR);
+	out = NULL;
+
+	if(header_size > 0)
+	{
+		const uint8_t* header;
+		ASSERT_OK(_cntl(in, RUNTIME_API_PIPE_CNTL_OPCODE_GET_HDR_BUF, header_size, (void const**)&header), goto ERR);
+		ASSERT_PTR(header, goto ERR);
+
+		size_t i;
+		for(i = 0; i < header_size; i ++)
+			ASSERT(header[i] == 0, goto ERR);
+	}
+
+	size_t offset = 0;
+	uint32_t borrowed = 0;
+	for(;;)
+	{
+		const uint8_t* buf;
+		size_t min_size, max_size;
+		ASSERT_OK(_cntl(in, RUNTIME_API_PIPE_CNTL_OPCODE_GET_DATA_BUF, (size_t)1000, (void const**)&buf, &min_size, &max_size), goto ERR);
+
+		if(NULL == buf) break;
+
+		ASSERT(min_size == max_size && max_size <= 1000 && max_size > 0, goto ERR);
+
+		size_t i;
+		for(i = 0; i < max_size; i ++)
+			ASSERT(buf[i] == (uint8_t)((offset + i) % 251), goto ERR);
+
+		/* The large donated block should be lent to the reader as it is */
+		if(borrowed < source.donated && buf == source.blocks[borrowed])
+			borrowed ++;
+
+		offset += max_size;
+
+		ASSERT_OK(_cntl(in, RUNTIME_API_PIPE_CNTL_OPCODE_PUT_DATA_BUF, buf, max_size), goto ERR);
+	}
+
+	ASSERT(offset == source.size, goto ERR);
+	ASSERT(borrowed == source.donated, goto ERR);
+	ASSERT(!donate || source.donated > 0, goto ERR);
+
+	char tmp[16];
+	ASSERT(0 == itc_module_pipe_read(tmp, sizeof(tmp), in), goto ERR);
+
+	ASSERT_OK(itc_module_pipe_deallocate(in), CLEANUP_NOP);
+
+	/* The small blocks are copied and released right away, and the large ones are released with the pipe */
+	ASSERT(source.freed == source.given, CLEANUP_NOP);
+
+	return 0;
+ERR:
+	if(NULL != out) itc_module_pipe_deallocate(out);
+	if(NULL != in) itc_module_pipe_deallocate(in);
+	return ERROR_CODE(int);
+}
+
+int write_data_source(void)
+{
+	return _run(0, 0);
+}
+
+int write_data_source_typed(void)
+{
+	return _run(24, 0);
+}
+
+int write_donated_data_source(void)
+{
+	return _run(0, 1);
+}
+
+int write_donated_data_source_typed(void)
+{
+	return _run(24, 1);
+}
+
+int setup(void)
+{
+	mod_mem = itc_modtab_get_module_type_from_path("pipe.mem");
+	ASSERT(ERROR_CODE(itc_module_type_t) != mod_mem, CLEANUP_NOP);
+	return 0;
+}
+
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(write_data_source),
+    TEST_CASE(write_data_source_typed),
+    TEST_CASE(write_donated_data_source),
+    TEST_CASE(write_donated_data_source_typed)
+TEST_LIST_END;
@@ -12,6 +12,7 @@
 #endif
 #include <unistd.h>
 #include <errno.h>
+#include <sys/uio.h>
 /**
  * @brief a mocked TCP connection
  **/
@@ -23,6 +24,7 @@ typedef struct {
 	int busy;           /*!< if this socket is currently busy */
 	int block;          /*!< indicates if the write should block the async thread */
 	int mocked_err;     /*!< force the write function return an mocked error */
+	int append;         /*!< append the written data to the buffer rather than overwrite it */
 	ssize_t bytes_to_accept; /*!< indicates how many bytes we want the socket to accept this time */
 	pthread_mutex_t mutex;   /*!< the mutex used to synchronize the async loop and the main thread */
 	pthread_cond_t  cond;     /*!< the conditional variable used for sync */
@@ -137,7 +139,13 @@ ssize_t test_write(int fd, const void* data, size_t sz)
 
 	if(ret > c->bytes_to_accept) ret = c->bytes_to_accept;
 
-	memcpy(c->buf, data, (size_t)ret);
+	if(c->append)
+	{
+		if((size_t)ret > sizeof(c->buf) - c->buffer_used) ret = (ssize_t)(sizeof(c->buf) - c->buffer_used);
+		memcpy(c->buf + c->buffer_used, data, (size_t)ret);
+		c->buffer_used += (size_t)ret;
+	}
+	else memcpy(c->buf, data, (size_t)ret);
 
 
 	LOG_DEBUG("test_write succeeded");
@@ -264,7 +272,7 @@ int single_async_write(void)
 	uint32_t data;
 	/* Because the initial data state is wait, so nothing should happen here, so we can block every thing at this point */
 	_set_block_bits(0, 0xffffffffu);
-	ASSERT_OK(module_tcp_async_write_register(loop, 0, conn[0].efd, 16, _get_data_1, _handler_empty_1, _dispose_handler_1, _error_handler_1, dh + 0), CLEANUP_NOP);
+	ASSERT_OK(module_tcp_async_write_register(loop, 0, conn[0].efd, 16, _get_data_1, NULL, NULL, NULL, _handler_empty_1, _dispose_handler_1, _error_handler_1, dh + 0), CLEANUP_NOP);
 	/* C:R D:W */
 	ASSERT_OK(module_tcp_async_write_data_ready(loop, 0), CLEANUP_NOP);
 	/* after we send this, the get data function should be called first */
@@ -352,7 +360,7 @@ static inline int _parallel_write(uint32_t n)
 	for(i = 0; i < n; i ++)
 	{
 		_set_block_bits(i, 0xffffffff);
-		ASSERT_OK(module_tcp_async_write_register(loop, i, conn[i].efd, 16, _get_data_1, _handler_empty_1, _dispose_handler_1, _error_handler_1, dh + i), CLEANUP_NOP);
+		ASSERT_OK(module_tcp_async_write_register(loop, i, conn[i].efd, 16, _get_data_1, NULL, NULL, NULL, _handler_empty_1, _dispose_handler_1, _error_handler_1, dh + i), CLEANUP_NOP);
 	}
 
 	usleep(1000); /* make sure we do not have no operations, if this is not true, async thread will blocked */
@@ -564,6 +572,112 @@ int parallel_write(void)
 	return 0;
 }
 
+/**
+ * @brief the queued buffers exposed by the gather callback
+ **/
+static const char* gather_bufs[] = {"hello, ", "vectored ", "world"};
+static const char gather_expected[] = "hello, vectored world";
+/** @brief how many bytes has been consumed */
+static size_t gather_consumed;
+/** @brief how many times the consume callback gets called with a write which ends in the middle of a buffer */
+static uint32_t gather_partial;
+/** @brief how many times the consume callback gets called with a write which crosses the buffer boundary */
+static uint32_t gather_crossed;
+/** @brief if we have seen something unexpected in the callbacks */
+static int gather_error;
+
+int _gather_1(uint32_t id, struct iovec* iov, int iovcnt, module_tcp_async_loop_t* loop)
+{
+	(void)loop;
+	(void)id;
+	size_t skip = gather_consumed;
+	int ret = 0;
+	unsigned i;
+	for(i = 0; i < sizeof(gather_bufs) / sizeof(*gather_bufs) && ret < iovcnt; i ++)
+	{
+		size_t len = strlen(gather_bufs[i]);
+		if(skip >= len)
+		{
+			skip -= len;
+			continue;
+		}
+		iov[ret].iov_base = (void*)(gather_bufs[i] + skip);
+		iov[ret].iov_len  = len - skip;
+		skip = 0;
+		ret ++;
+	}
+
+	return ret;
+}
+
+int _consume_1(uint32_t id, size_t nbytes, module_tcp_async_loop_t* loop)
+{
+	(void)loop;
+	(void)id;
+	size_t begin = gather_consumed, end = gather_consumed + nbytes, offset = 0;
+	if(end > sizeof(gather_expected) - 1)
+	{
+		gather_error = 1;
+		ERROR_RETURN_LOG(int, "consuming more bytes than the gathered ones");
+	}
+
+	unsigned i;
+	for(i = 0; i < sizeof(gather_bufs) / sizeof(*gather_bufs); i ++)
+	{
+		offset += strlen(gather_bufs[i]);
+		if(begin < offset && offset < end) gather_crossed ++;
+		if(offset > end && begin < offset)
+		{
+			gather_partial ++;
+			break;
+		}
+	}
+
+	gather_consumed = end;
+	return 0;
+}
+
+int _gather_empty_1(uint32_t id, module_tcp_async_loop_t* loop)
+{
+	(void)id;
+	(void)loop;
+	return gather_consumed == sizeof(gather_expected) - 1;
+}
+
+int gather_write(void)
+{
+	uint32_t cid = 127, i;
+
+	_set_block_bits(cid, 0);
+	dh[cid].stage = 1;   /* The data source is never ready, everything should go through the gather callback */
+	conn[cid].append = 1;
+	conn[cid].bytes_to_accept = 4;   /* Each write call takes at most 4 bytes, so we have partial writes */
+
+	ASSERT_OK(module_tcp_async_write_register(loop, cid, conn[cid].efd, 16, _get_data_1, _gather_1, _consume_1, NULL, _gather_empty_1, _dispose_handler_1, _error_handler_1, dh + cid), CLEANUP_NOP);
+	_set_connction_busy(cid, 0);
+	ASSERT_OK(module_tcp_async_write_data_ready(loop, cid), CLEANUP_NOP);
+	ASSERT_OK(module_tcp_async_write_data_ends(loop, cid), CLEANUP_NOP);
+
+	for(i = 0; i < 1000 && !dh[cid].disposed; i ++)
+		usleep(1000);
+
+	ASSERT(1 == dh[cid].disposed, CLEANUP_NOP);
+	ASSERT(0 == dh[cid].error, CLEANUP_NOP);
+	ASSERT(0 == gather_error, CLEANUP_NOP);
+
+	/* All the queued buffers should be written in order, and each of them exactly once */
+	ASSERT(conn[cid].buffer_used == sizeof(gather_expected) - 1, CLEANUP_NOP);
+	ASSERT(0 == memcmp(conn[cid].buf, gather_expected, sizeof(gather_expected) - 1), CLEANUP_NOP);
+	ASSERT(gather_consumed == sizeof(gather_expected) - 1, CLEANUP_NOP);
+
+	/* The partial writes should be consumed, both the ones ends in the middle of a buffer and the ones crossing
+	 * the buffer boundary */
+	ASSERT(gather_partial > 0, CLEANUP_NOP);
+	ASSERT(gather_crossed > 0, CLEANUP_NOP);
+
+	return 0;
+}
+
 int setup(void)
 {
 	expected_memory_leakage();
@@ -610,6 +724,7 @@ int teardown(void)
 TEST_LIST_BEGIN
     TEST_CASE(create_loop),
     TEST_CASE(single_async_write),
+    TEST_CASE(gather_write),
     TEST_CASE(parallel_write),
     TEST_CASE(cleanup_loop)
 TEST_LIST_END;
@@ -2,6 +2,7 @@
  * Copyright (C) 2017, Hao Hou
  **/
 
+#include <stdarg.h>
 #include <testenv.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -12,12 +13,18 @@
 #include <itc/module_types.h>
 #include <module/tcp/pool.h>
 #include <module/tcp/module.h>
+#include <itc/module.h>
+#include <sched/rscope.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 itc_module_type_t mod_tcp;
 struct {
 	module_tcp_pool_configure_t pool_conf;            /*!< the TCP pool configuration */
+	int                         retry_interval;       /*!< When the TCP pool cannot be configured, how much time we want to sleep before retry */
 	int                         pool_initialized;     /*!< indicates if the pool has been initialized */
 	int                         sync_write_attempt;   /*!< If do a synchronized write attempt before initialize a async operation */
+	int                         slave_mode;           /*!< The slave working mode, which means the module should not start the event loop */
+	int                         fork_id;              /*!< The id used to identify the TCP module instance that listen to the same port */
 	uint32_t                    async_buf_size;       /*!< The size of the async write buffer */
 	module_tcp_pool_t*          conn_pool;            /*!< The TCP connection pool object */
 } *context;
@@ -87,6 +94,85 @@ int do_request(void)
 	return 0;
 }
 
+/**
+ * @brief receive the given number of responses from the socket
+ * @param sock the socket
+ * @param n the number of responses
+ * @return status code
+ **/
+static int _recv_responses(int sock, int n)
+{
+	static char buffer[4096];
+	size_t expected = (sizeof(response) - 1) * (size_t)n, ptr = 0;
+
+	for(;ptr < expected;)
+	{
+		ssize_t rc = recv(sock, buffer + ptr, expected - ptr, 0);
+		if(rc <= 0)
+		{
+			perror("recv");
+			return -1;
+		}
+		ptr += (size_t)rc;
+	}
+
+	int i;
+	for(i = 0; i < n; i ++)
+		if(memcmp(buffer + (sizeof(response) - 1) * (size_t)i, response, sizeof(response) - 1) != 0)
+			return -1;
+
+	return 0;
+}
+
+int do_pipelined_request(void)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	if(sock == -1)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("connect");
+		goto ERR;
+	}
+
+	/* The first two requests are sent at once */
+	static char requests[sizeof(request) * 2];
+	memcpy(requests, request, sizeof(request) - 1);
+	memcpy(requests + sizeof(request) - 1, request, sizeof(request) - 1);
+
+	if(send(sock, requests, 2 * (sizeof(request) - 1), 0) < 0)
+	{
+		perror("send");
+		goto ERR;
+	}
+
+	if(_recv_responses(sock, 2) < 0) goto ERR;
+
+	/* Then the third one is sent before the server finishes the second request */
+	if(send(sock, request, sizeof(request) - 1, 0) < 0)
+	{
+		perror("send");
+		goto ERR;
+	}
+
+	if(_recv_responses(sock, 1) < 0) goto ERR;
+
+	shutdown(sock, 2);
+	return 0;
+ERR:
+	shutdown(sock, 2);
+	return -1;
+}
+
 int accept_test(void)
 {
 	srand((unsigned)time(NULL));
@@ -144,6 +230,310 @@ ERR:
 	return -1;
 }
 
+static int _cntl(itc_module_pipe_t* pipe, uint32_t opcode, ...)
+{
+	va_list ap;
+	va_start(ap, opcode);
+	int rc = itc_module_pipe_cntl(pipe, opcode, ap);
+	va_end(ap);
+	return rc;
+}
+
+int pipeline_test(void)
+{
+	itc_module_pipe_param_t param = {
+		.input_flags = RUNTIME_API_PIPE_INPUT,
+		.output_flags = RUNTIME_API_PIPE_OUTPUT | RUNTIME_API_PIPE_ASYNC,
+		.args = NULL
+	};
+
+	pid_t pid;
+	itc_module_pipe_t *in = NULL, *out = NULL;
+	int status;
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		port = context->pool_conf.port;
+		plumber_finalize();
+		exit(do_pipelined_request());
+		return 0;
+	}
+
+	int i;
+	for(i = 0; i < 3; i ++)
+	{
+		static char buffer[4096];
+		ASSERT_OK(itc_module_pipe_accept(mod_tcp, param, &in, &out), goto ERR);
+
+		size_t rc = itc_module_pipe_read(buffer, sizeof(buffer), in);
+		ASSERT(rc >= sizeof(request) - 1, goto ERR);
+		ASSERT(memcmp(buffer, request, sizeof(request) - 1) == 0, goto ERR);
+
+		/* Like what the protocol parser does, the bytes after the request are returned to the connection */
+		ASSERT_OK(_cntl(in, RUNTIME_API_PIPE_CNTL_OPCODE_EOM, buffer, sizeof(request) - 1), goto ERR);
+
+		ASSERT_OK(_cntl(in, RUNTIME_API_PIPE_CNTL_OPCODE_SET_FLAG, RUNTIME_API_PIPE_PERSIST), goto ERR);
+
+		ASSERT_RETOK(size_t, itc_module_pipe_write(response, sizeof(response) - 1, out), goto ERR);
+
+		/* Give the client some time to send the third request before we release the connection */
+		if(i == 1) sleep(1);
+
+		ASSERT_OK(itc_module_pipe_deallocate(in), goto ERR);
+		in = NULL;
+		ASSERT_OK(itc_module_pipe_deallocate(out), goto ERR);
+		out = NULL;
+	}
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	return 0;
+ERR:
+	if(NULL != in) itc_module_pipe_deallocate(in);
+	if(NULL != out) itc_module_pipe_deallocate(out);
+	return -1;
+}
+
+/**
+ * @brief the file backed stream, which exposes the file region and counts the reads
+ **/
+#define FILE_SIZE   (8 * 1024 * 1024)
+#define FILE_OFFSET 1234
+static char file_path[] = "/tmp/plumber-tcp-file-region-test";
+static int file_fd = -1;
+static int file_reads = 0;
+static int client_delay = 0;   /*!< how many seconds the client waits before it reads the response */
+typedef struct {
+	uint64_t offset;
+} file_stream_t;
+
+static uint8_t _file_byte(size_t offset)
+{
+	return (uint8_t)((offset * 7 + offset / 251) % 256);
+}
+
+static int _file_obj_free(void* obj)
+{
+	(void)obj;
+	return 0;
+}
+
+static void* _file_obj_open(const void* obj)
+{
+	(void)obj;
+	file_stream_t* ret = (file_stream_t*)malloc(sizeof(file_stream_t));
+	if(NULL != ret) ret->offset = FILE_OFFSET;
+	return ret;
+}
+
+static int _file_obj_close(void* handle)
+{
+	free(handle);
+	return 0;
+}
+
+static int _file_obj_eos(const void* handle)
+{
+	return ((const file_stream_t*)handle)->offset >= FILE_SIZE;
+}
+
+static size_t _file_obj_read(void* __restrict handle, void* __restrict buffer, size_t bufsize)
+{
+	file_stream_t* stream = (file_stream_t*)handle;
+	file_reads ++;
+	ssize_t rc = pread(file_fd, buffer, bufsize, (off_t)stream->offset);
+	if(rc < 0) return ERROR_CODE(size_t);
+	stream->offset += (uint64_t)rc;
+	return (size_t)rc;
+}
+
+static int _file_obj_region(void* __restrict handle, runtime_api_scope_file_region_t* region_buf)
+{
+	file_stream_t* stream = (file_stream_t*)handle;
+	region_buf->fd = file_fd;
+	region_buf->offset = stream->offset;
+	region_buf->size = FILE_SIZE - stream->offset;
+	stream->offset = FILE_SIZE;
+	return 1;
+}
+
+int do_file_request(void)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	if(sock == -1)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("connect");
+		goto ERR;
+	}
+
+	if(send(sock, request, sizeof(request) - 1, 0) < 0)
+	{
+		perror("send");
+		goto ERR;
+	}
+
+	/* The file is larger than the socket buffer, so the server has to wait for us */
+	if(client_delay > 0) sleep((unsigned)client_delay);
+
+	static char buffer[sizeof(response) - 1 + FILE_SIZE - FILE_OFFSET];
+	size_t ptr = 0;
+	for(;ptr < sizeof(buffer);)
+	{
+		ssize_t rc = recv(sock, buffer + ptr, sizeof(buffer) - ptr, 0);
+		if(rc <= 0)
+		{
+			perror("recv");
+			goto ERR;
+		}
+		ptr += (size_t)rc;
+	}
+
+	/* The bytes written before the token should be followed by the file content from the region offset */
+	if(memcmp(buffer, response, sizeof(response) - 1) != 0) goto ERR;
+
+	size_t i;
+	for(i = 0; i < FILE_SIZE - FILE_OFFSET; i ++)
+		if((uint8_t)buffer[sizeof(response) - 1 + i] != _file_byte(FILE_OFFSET + i))
+			goto ERR;
+
+	shutdown(sock, 2);
+	return 0;
+ERR:
+	shutdown(sock, 2);
+	return -1;
+}
+
+static int _file_region_test(int async)
+{
+	itc_module_pipe_param_t param = {
+		.input_flags = RUNTIME_API_PIPE_INPUT,
+		.output_flags = RUNTIME_API_PIPE_OUTPUT | (async ? RUNTIME_API_PIPE_ASYNC : 0),
+		.args = NULL
+	};
+
+	struct timespec cpu_begin, cpu_end;
+	pid_t pid;
+	itc_module_pipe_t *in = NULL, *out = NULL;
+	sched_rscope_t* scope = NULL;
+	int status;
+
+	static uint8_t content[FILE_SIZE];
+	size_t i;
+	for(i = 0; i < FILE_SIZE; i ++)
+		content[i] = _file_byte(i);
+
+	ASSERT((file_fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0600)) >= 0, CLEANUP_NOP);
+	ASSERT(FILE_SIZE == write(file_fd, content, FILE_SIZE), goto ERR);
+
+	pid = fork();
+
+	if(pid == 0)
+	{
+		sleep(1);
+		port = context->pool_conf.port;
+		plumber_finalize();
+		exit(do_file_request());
+		return 0;
+	}
+
+	/* Make sure the region is sent by the async loop as well */
+	context->sync_write_attempt = 0;
+	file_reads = 0;
+
+	ASSERT_PTR(scope = sched_rscope_new(), goto ERR);
+
+	runtime_api_scope_entity_t ent = {
+		.data = &file_fd,
+		.free_func = _file_obj_free,
+		.open_func = _file_obj_open,
+		.close_func = _file_obj_close,
+		.eos_func = _file_obj_eos,
+		.read_func = _file_obj_read,
+		.file_region_func = _file_obj_region
+	};
+	runtime_api_scope_token_t token;
+	ASSERT_RETOK(runtime_api_scope_token_t, token = sched_rscope_add(scope, &ent), goto ERR);
+
+	static char buffer[4096];
+	for(;;)
+	{
+		size_t rc;
+		ASSERT_OK(itc_module_pipe_accept(mod_tcp, param, &in, &out), goto ERR);
+		ASSERT_RETOK(size_t, rc = itc_module_pipe_read(buffer, sizeof(buffer), in), goto ERR);
+		if(rc > 0) break;
+
+		/* The persistent connection from the previous test case is closed by the client */
+		ASSERT_OK(itc_module_pipe_deallocate(in), goto ERR);
+		in = NULL;
+		ASSERT_OK(itc_module_pipe_deallocate(out), goto ERR);
+		out = NULL;
+	}
+
+	ASSERT_OK(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_begin), goto ERR);
+
+	ASSERT_RETOK(size_t, itc_module_pipe_write(response, sizeof(response) - 1, out), goto ERR);
+	ASSERT_OK(itc_module_pipe_write_scope_token(token, NULL, out), goto ERR);
+
+	ASSERT_OK(itc_module_pipe_deallocate(in), goto ERR);
+	in = NULL;
+	ASSERT_OK(itc_module_pipe_deallocate(out), goto ERR);
+	out = NULL;
+
+	ASSERT_OK(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end), goto ERR);
+
+	ASSERT(pid == waitpid(pid, &status, 0), goto ERR);
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, goto ERR);
+
+	/* While the client doesn't read, the sync write should wait for the socket rather than spinning */
+	double cpu_time = (double)(cpu_end.tv_sec - cpu_begin.tv_sec) + (double)(cpu_end.tv_nsec - cpu_begin.tv_nsec) * 1e-9;
+	ASSERT(cpu_time < client_delay * 0.5 || client_delay == 0, goto ERR);
+
+	/* The content should go through the file region rather than the read callback */
+	ASSERT(file_reads == 0, goto ERR);
+
+	ASSERT_OK(sched_rscope_free(scope), CLEANUP_NOP);
+	close(file_fd);
+	unlink(file_path);
+
+	return 0;
+ERR:
+	if(NULL != in) itc_module_pipe_deallocate(in);
+	if(NULL != out) itc_module_pipe_deallocate(out);
+	if(NULL != scope) sched_rscope_free(scope);
+	close(file_fd);
+	unlink(file_path);
+	return -1;
+}
+
+int file_region_test(void)
+{
+	client_delay = 0;
+	return _file_region_test(1);
+}
+
+int file_region_sync_test(void)
+{
+	client_delay = 2;
+	int rc = _file_region_test(0);
+	client_delay = 0;
+	return rc;
+}
+
 int setup(void)
 {
 	mod_tcp = itc_modtab_get_module_type_from_path("pipe.tcp.port_8888");
@@ -151,10 +541,18 @@ int setup(void)
 
 	context = itc_module_get_context(mod_tcp);
 	expected_memory_leakage();
-	return 0;
+	return sched_rscope_init_thread();
+}
+
+int teardown(void)
+{
+	return sched_rscope_finalize_thread();
 }
-DEFAULT_TEARDOWN;
+
 
 TEST_LIST_BEGIN
-    TEST_CASE(accept_test)
+    TEST_CASE(accept_test),
+    TEST_CASE(pipeline_test),
+    TEST_CASE(file_region_test),
+    TEST_CASE(file_region_sync_test)
 TEST_LIST_END;
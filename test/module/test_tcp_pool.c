@@ -0,0 +1,508 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#define _GNU_SOURCE
+#include <constants.h>
+#include <testenv.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <poll.h>
+#include <module/tcp/pool.h>
+
+#define NUM_CLIENTS 64
+
+/**
+ * @brief the TTL of the connections in the timing wheel tests, which makes a wheel with 16 slots
+ **/
+#define TIMER_TTL 8
+
+static uint16_t port;
+
+static char cpuset[32];
+
+static module_tcp_pool_configure_t pool_conf = {
+	.bind_addr   = "127.0.0.1",
+	.size        = 128,
+	.ttl         = 240,
+	.event_size  = 64,
+	.min_timeout = 1,
+	.tcp_backlog = 128,
+	.reuseaddr   = 1,
+	.reuseport   = 1,
+	.steer       = MODULE_TCP_POOL_STEER_NONE,
+	.accept_retry_interval = 5
+};
+
+/**
+ * @brief the event loop that serves a connection pool
+ **/
+typedef struct {
+	module_tcp_pool_t* pool;         /*!< the pool this loop serves */
+	volatile int       configured;   /*!< 1 if the pool is configured, -1 if it cannot be configured */
+	volatile int       accepted;     /*!< how many requests has been served by this loop */
+	volatile uint32_t  held;         /*!< the connection this loop holds, which is used to wake up the loop when we stop it */
+	int                pinned;       /*!< if the loop thread has been pinned to the cpuset */
+	int                rc;           /*!< the status code of the loop */
+} event_loop_t;
+
+static int _check_pinned(void)
+{
+#ifdef __LINUX__
+	cpu_set_t set;
+	if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) return 0;
+	return CPU_COUNT(&set) == 1 && CPU_ISSET((size_t)atoi(cpuset), &set);
+#else
+	return 1;
+#endif
+}
+
+static void* _event_loop(void* data)
+{
+	event_loop_t* loop = (event_loop_t*)data;
+
+	if(ERROR_CODE(int) == module_tcp_pool_configure(loop->pool, &pool_conf))
+	{
+		loop->configured = -1;
+		return NULL;
+	}
+
+	loop->pinned = _check_pinned();
+	loop->configured = 1;
+
+	module_tcp_pool_conninfo_t info;
+	while(ERROR_CODE(int) != module_tcp_pool_connection_get(loop->pool, &info))
+	{
+		char ch;
+		if(recv(info.fd, &ch, 1, 0) != 1)
+			loop->rc = ERROR_CODE(int);
+
+		/* The first connection is held until the loop gets killed, the others go back to the inactive list */
+		int hold = (loop->held == ERROR_CODE(uint32_t));
+		if(hold) loop->held = info.idx;
+
+		__sync_fetch_and_add(&loop->accepted, 1);
+
+		if(send(info.fd, &ch, 1, 0) != 1)
+			loop->rc = ERROR_CODE(int);
+
+		if(!hold && ERROR_CODE(int) == module_tcp_pool_connection_release(loop->pool, info.idx, NULL, MODULE_TCP_POOL_RELEASE_MODE_WAIT_FOR_DATA))
+			loop->rc = ERROR_CODE(int);
+	}
+
+	return NULL;
+}
+
+static int _connect(void)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	if(sock < 0) return -1;
+
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = inet_addr("127.0.0.1")
+	};
+
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("connect");
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/**
+ * @brief check if there's still any socket listening to the port
+ * @return 1 if the port is in use, 0 if it's free
+ **/
+static int _port_in_use(void)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0), one = 1, rc = 1;
+	if(sock < 0) return -1;
+
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = inet_addr("127.0.0.1")
+	};
+
+	/* The closed connections may be in TIME_WAIT, but they don't prevent us from listening with reuseaddr */
+	if(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+	   bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+	   listen(sock, 1) == 0)
+		rc = 0;
+
+	close(sock);
+	return rc;
+}
+
+/**
+ * @brief run the master pool and its forks with their own event loops, and send requests until all of them have served some
+ * @param nforks the number of forks
+ * @param steer the steering program
+ * @return status code
+ **/
+static int _run_reuseport(int nforks, int steer)
+{
+	int clients[NUM_CLIENTS], nclients = 0, started = 0, nloops = nforks + 1, i, rc = -1;
+	pthread_t threads[2];
+	event_loop_t loops[2] = {};
+
+	pool_conf.steer = steer;
+
+	for(i = 0; i < nloops; i ++)
+	{
+		loops[i].held = ERROR_CODE(uint32_t);
+		if(i == 0) ASSERT_PTR(loops[i].pool = module_tcp_pool_new(), goto ERR);
+		else ASSERT_PTR(loops[i].pool = module_tcp_pool_fork(loops[0].pool), goto ERR);
+	}
+	ASSERT(module_tcp_pool_num_forks(loops[0].pool) == nforks, goto ERR);
+
+	for(; started < nloops; started ++)
+		ASSERT(pthread_create(threads + started, NULL, _event_loop, loops + started) == 0, goto ERR);
+
+	for(i = 0; i < nloops; i ++)
+	{
+		while(loops[i].configured == 0) usleep(1000);
+		ASSERT(loops[i].configured == 1, goto ERR);
+		ASSERT(loops[i].pinned, goto ERR);
+	}
+
+	/* The kernel hashes the connections, so all the loops should get some of them */
+	while(nclients < NUM_CLIENTS && (loops[0].accepted == 0 || (nloops > 1 && loops[1].accepted == 0)))
+	{
+		char ch = 'x';
+		int sock;
+		ASSERT((sock = _connect()) >= 0, goto ERR);
+		clients[nclients ++] = sock;
+		ASSERT(send(sock, &ch, 1, 0) == 1, goto ERR);
+		ASSERT(recv(sock, &ch, 1, 0) == 1, goto ERR);
+		ASSERT(ch == 'x', goto ERR);
+	}
+
+	ASSERT(loops[0].accepted + loops[1].accepted == nclients, goto ERR);
+	for(i = 0; i < nloops; i ++)
+		ASSERT(loops[i].accepted > 0, goto ERR);
+
+	rc = 0;
+ERR:
+	/* The loop may block until the next connection expires, so we close the held connection to wake it up */
+	for(i = 0; i < started; i ++)
+	{
+		module_tcp_pool_loop_killed(loops[i].pool);
+		if(ERROR_CODE(uint32_t) != loops[i].held &&
+		   ERROR_CODE(int) == module_tcp_pool_connection_release(loops[i].pool, loops[i].held, NULL, MODULE_TCP_POOL_RELEASE_MODE_PURGE))
+			rc = -1;
+	}
+
+	for(i = 0; i < started; i ++)
+		pthread_join(threads[i], NULL);
+
+	for(i = 0; i < nloops; i ++)
+	{
+		if(NULL != loops[i].pool && ERROR_CODE(int) == module_tcp_pool_free(loops[i].pool)) rc = -1;
+		if(loops[i].rc == ERROR_CODE(int)) rc = -1;
+	}
+
+	for(i = 0; i < nclients; i ++)
+		close(clients[i]);
+
+	ASSERT(_port_in_use() == 0, CLEANUP_NOP);
+
+	return rc;
+}
+
+int reuseport_accept(void)
+{
+	return _run_reuseport(1, MODULE_TCP_POOL_STEER_NONE);
+}
+
+int reuseport_steer(void)
+{
+#if defined(__LINUX__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	/* Which listener gets the connection depends on the CPU, so we only have one event loop to make sure it's served */
+	return _run_reuseport(0, MODULE_TCP_POOL_STEER_CPU);
+#else
+	return 0;
+#endif
+}
+
+int reuseport_unclaimed_socket(void)
+{
+	module_tcp_pool_t *master, *forks[2] = {};
+	int rc = -1;
+
+	pool_conf.steer = MODULE_TCP_POOL_STEER_NONE;
+
+	ASSERT_PTR(master = module_tcp_pool_new(), goto ERR);
+	ASSERT_PTR(forks[0] = module_tcp_pool_fork(master), goto ERR);
+	ASSERT_PTR(forks[1] = module_tcp_pool_fork(master), goto ERR);
+
+	/* The forks are never started, so the sockets the master created for them are never taken */
+	ASSERT_OK(module_tcp_pool_configure(master, &pool_conf), goto ERR);
+	ASSERT(_port_in_use() == 1, goto ERR);
+
+	int sock;
+	ASSERT((sock = _connect()) >= 0, goto ERR);
+	close(sock);
+
+	rc = 0;
+ERR:
+	if(NULL != forks[0] && ERROR_CODE(int) == module_tcp_pool_free(forks[0])) rc = -1;
+	if(NULL != forks[1] && ERROR_CODE(int) == module_tcp_pool_free(forks[1])) rc = -1;
+	if(NULL != master && ERROR_CODE(int) == module_tcp_pool_free(master)) rc = -1;
+
+	ASSERT(_port_in_use() == 0, CLEANUP_NOP);
+
+	return rc;
+}
+
+/**
+ * @brief the pool driven by the fake clock
+ **/
+static module_tcp_pool_t* timer_pool;
+
+/**
+ * @brief the connection that is always checked out, we release it to wake up the pool
+ **/
+static uint32_t pinger;
+static int pinger_sock = -1;
+
+static time_t fake_now = 1000;
+
+static time_t _fake_time(time_t* t)
+{
+	if(NULL != t) *t = fake_now;
+	return fake_now;
+}
+
+/**
+ * @brief poll the pool at the given time
+ * @details The pool is waked up by the pinger connection, so that it expires the connections with the time
+ *          and accepts the pending connections. Then all the connections which becomes ready are checked out
+ * @param now the current time
+ * @param nready how many connections other than the pinger should be ready
+ * @param ready the buffer used to return the ready connections
+ * @return status code
+ **/
+static int _tick(time_t now, int nready, module_tcp_pool_conninfo_t* ready)
+{
+	fake_now = now;
+
+	ASSERT_OK(module_tcp_pool_connection_release(timer_pool, pinger, NULL, MODULE_TCP_POOL_RELEASE_MODE_WAIT_FOR_READ), CLEANUP_NOP);
+	ASSERT_OK(module_tcp_pool_poll_event(timer_pool), CLEANUP_NOP);
+
+	int got_pinger = 0, got = 0;
+	while(!got_pinger || got < nready)
+	{
+		module_tcp_pool_conninfo_t info;
+		ASSERT_OK(module_tcp_pool_connection_get(timer_pool, &info), CLEANUP_NOP);
+		if(info.idx == pinger) got_pinger = 1;
+		else
+		{
+			ASSERT(got < nready, CLEANUP_NOP);
+			ready[got ++] = info;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief check if the server side of the connection has been closed
+ * @param sock the client socket
+ * @return 1 if the connection is closed, 0 if it's still open, -1 on error
+ **/
+static int _closed(int sock)
+{
+	struct pollfd pfd = {
+		.fd = sock,
+		.events = POLLIN
+	};
+
+	/* The FIN should be there already, but we still give it some time */
+	if(poll(&pfd, 1, 10) < 0) return -1;
+
+	char ch;
+	ssize_t rc = recv(sock, &ch, 1, MSG_DONTWAIT);
+	if(rc == 0) return 1;
+	if(rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+
+	return -1;
+}
+
+static int _timer_pool_new(void)
+{
+	module_tcp_pool_configure_t conf = pool_conf;
+	conf.reuseport = 0;
+	conf.cpuset = NULL;
+	conf.ttl = TIMER_TTL;
+	conf.time = _fake_time;
+
+	ASSERT_PTR(timer_pool = module_tcp_pool_new(), CLEANUP_NOP);
+	ASSERT_OK(module_tcp_pool_configure(timer_pool, &conf), CLEANUP_NOP);
+
+	/* The pinger is accepted and activated by its request, and it's never returned to the inactive list */
+	char ch = 'p';
+	module_tcp_pool_conninfo_t info;
+	ASSERT((pinger_sock = _connect()) >= 0, CLEANUP_NOP);
+	ASSERT(send(pinger_sock, &ch, 1, 0) == 1, CLEANUP_NOP);
+	ASSERT_OK(module_tcp_pool_connection_get(timer_pool, &info), CLEANUP_NOP);
+	ASSERT(recv(info.fd, &ch, 1, 0) == 1, CLEANUP_NOP);
+	pinger = info.idx;
+
+	return 0;
+}
+
+static int _timer_pool_free(int* clients, int nclients)
+{
+	int i, rc = 0;
+	for(i = 0; i < nclients; i ++)
+		if(clients[i] >= 0) close(clients[i]);
+
+	if(NULL != timer_pool && ERROR_CODE(int) == module_tcp_pool_free(timer_pool)) rc = -1;
+	timer_pool = NULL;
+
+	if(pinger_sock >= 0) close(pinger_sock);
+	pinger_sock = -1;
+
+	return rc;
+}
+
+int timer_expire(void)
+{
+	int clients[2] = {-1, -1}, rc = -1;
+	time_t start = fake_now;
+
+	ASSERT_OK(_timer_pool_new(), goto ERR);
+
+	ASSERT((clients[0] = _connect()) >= 0, goto ERR);
+	ASSERT_OK(_tick(start, 0, NULL), goto ERR);
+
+	ASSERT((clients[1] = _connect()) >= 0, goto ERR);
+	ASSERT_OK(_tick(start + 3, 0, NULL), goto ERR);
+
+	ASSERT_OK(_tick(start + TIMER_TTL - 1, 0, NULL), goto ERR);
+	ASSERT(_closed(clients[0]) == 0, goto ERR);
+
+	ASSERT_OK(_tick(start + TIMER_TTL, 0, NULL), goto ERR);
+	ASSERT(_closed(clients[0]) == 1, goto ERR);
+	ASSERT(_closed(clients[1]) == 0, goto ERR);
+
+	/* Skip the slot when the second connection expires */
+	ASSERT_OK(_tick(start + TIMER_TTL + 5, 0, NULL), goto ERR);
+	ASSERT(_closed(clients[1]) == 1, goto ERR);
+
+	rc = 0;
+ERR:
+	if(ERROR_CODE(int) == _timer_pool_free(clients, 2)) rc = -1;
+	return rc;
+}
+
+int timer_reinsert(void)
+{
+	int clients[1] = {-1}, rc = -1;
+	time_t start = fake_now;
+	char ch = 'a';
+	module_tcp_pool_conninfo_t info;
+
+	ASSERT_OK(_timer_pool_new(), goto ERR);
+
+	ASSERT((clients[0] = _connect()) >= 0, goto ERR);
+	ASSERT_OK(_tick(start, 0, NULL), goto ERR);
+
+	/* The activity moves the connection out of the timing wheel */
+	ASSERT(send(clients[0], &ch, 1, 0) == 1, goto ERR);
+	ASSERT_OK(_tick(start + 5, 1, &info), goto ERR);
+	ASSERT(recv(info.fd, &ch, 1, 0) == 1, goto ERR);
+
+	/* And it's inserted back when the connection becomes inactive again */
+	ASSERT_OK(module_tcp_pool_connection_release(timer_pool, info.idx, NULL, MODULE_TCP_POOL_RELEASE_MODE_WAIT_FOR_DATA), goto ERR);
+	ASSERT_OK(_tick(start + 5, 0, NULL), goto ERR);
+
+	ASSERT_OK(_tick(start + TIMER_TTL, 0, NULL), goto ERR);
+	ASSERT(_closed(clients[0]) == 0, goto ERR);
+
+	ASSERT_OK(_tick(start + 5 + TIMER_TTL - 1, 0, NULL), goto ERR);
+	ASSERT(_closed(clients[0]) == 0, goto ERR);
+
+	ASSERT_OK(_tick(start + 5 + TIMER_TTL, 0, NULL), goto ERR);
+	ASSERT(_closed(clients[0]) == 1, goto ERR);
+
+	rc = 0;
+ERR:
+	if(ERROR_CODE(int) == _timer_pool_free(clients, 1)) rc = -1;
+	return rc;
+}
+
+int timer_wraparound(void)
+{
+	int clients[40], nclients = 0, rc = -1, i;
+	time_t start = fake_now;
+
+	ASSERT_OK(_timer_pool_new(), goto ERR);
+
+	/* A new connection every second, which walks through the wheel more than twice */
+	while(nclients < (int)(sizeof(clients) / sizeof(clients[0])))
+	{
+		time_t now = start + nclients;
+		int sock;
+		ASSERT((sock = _connect()) >= 0, goto ERR);
+		clients[nclients ++] = sock;
+		ASSERT_OK(_tick(now, 0, NULL), goto ERR);
+
+		for(i = 0; i < nclients; i ++)
+			ASSERT(_closed(clients[i]) == (start + i + TIMER_TTL <= now), goto ERR);
+	}
+
+	/* If the pool hasn't been waked up for more than a round of the wheel, all the connections should expire */
+	ASSERT_OK(_tick(fake_now + 100, 0, NULL), goto ERR);
+	for(i = 0; i < nclients; i ++)
+		ASSERT(_closed(clients[i]) == 1, goto ERR);
+
+	rc = 0;
+ERR:
+	if(ERROR_CODE(int) == _timer_pool_free(clients, nclients)) rc = -1;
+	return rc;
+}
+
+int setup(void)
+{
+	srand((unsigned)time(NULL) ^ (unsigned)getpid());
+	port = pool_conf.port = (uint16_t)(rand() % (0xffff - 10000) + 10000);
+
+	/* Pin the event loops to a CPU we are allowed to run on */
+	int cpu = 0;
+#ifdef __LINUX__
+	cpu_set_t set;
+	ASSERT(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0, CLEANUP_NOP);
+	for(; cpu < CPU_SETSIZE && !CPU_ISSET((size_t)cpu, &set); cpu ++);
+#endif
+	snprintf(cpuset, sizeof(cpuset), "%d", cpu);
+	pool_conf.cpuset = cpuset;
+
+	/* Because a GLIBC bug, the TLS of the threads may leak, and we have at most 2 event loop threads at the same time */
+	expected_memory_leakage();
+	expected_memory_leakage();
+	return 0;
+}
+
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(reuseport_accept),
+    TEST_CASE(reuseport_steer),
+    TEST_CASE(reuseport_unclaimed_socket),
+    TEST_CASE(timer_expire),
+    TEST_CASE(timer_reinsert),
+    TEST_CASE(timer_wraparound)
+TEST_LIST_END;
@@ -0,0 +1,59 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+
+#include <pservlet.h>
+#include <stdlib.h>
+#include <error.h>
+
+typedef struct {
+	pipe_t input;
+	pipe_t output;
+} context_t;
+
+static int init(uint32_t argc, char const* const* argv, void* mem)
+{
+	(void) argc;
+	(void) argv;
+
+	context_t* ctx = (context_t*)mem;
+
+	ctx->input = pipe_define("in", PIPE_INPUT, NULL);
+	ctx->output = pipe_define("out", PIPE_OUTPUT, NULL);
+
+	if(ERROR_CODE(pipe_t) == ctx->input || ERROR_CODE(pipe_t) == ctx->output)
+		ERROR_RETURN_LOG(int, "Cannot define the pipes");
+
+	return 0;
+}
+
+static int exec(void* mem)
+{
+	context_t* ctx = (context_t*)mem;
+
+	char buf[16];
+	size_t size = 0;
+
+	for(;size < sizeof(buf) - 1;)
+	{
+		size_t rc = pipe_read(ctx->input, buf + size, sizeof(buf) - 1 - size);
+		if(ERROR_CODE(size_t) == rc || 0 == rc) break;
+		size += rc;
+	}
+	buf[size] = 0;
+
+	pipe_write(ctx->output, buf, size);
+
+	/* Report which event this task is created for */
+	trap(atoi(buf));
+
+	return 0;
+}
+
+SERVLET_DEF = {
+	.desc = "Reports the event number it reads from the input",
+	.version = 0,
+	.size = sizeof(context_t),
+	.init = init,
+	.exec = exec
+};
@@ -0,0 +1,130 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <testenv.h>
+#include <lang/prop.h>
+#include <module/simulate/module.h>
+
+#define NEVENTS 256
+
+static char input_file[] = "/tmp/plumber-loop-test.in";
+
+static runtime_stab_entry_t serv;
+static sched_service_buffer_t* serv_buf;
+
+/**
+ * @brief How many times the task for each event has been executed
+ **/
+static uint32_t counts[NEVENTS];
+static uint32_t ndone;
+
+static void trap_func(int trap)
+{
+	if(trap < 0 || trap >= NEVENTS) return;
+	if(0 == __sync_fetch_and_add(counts + trap, 1))
+		__sync_fetch_and_add(&ndone, 1);
+}
+
+/**
+ * @brief Wait until all the events are consumed, and then give the loop a little more time
+ *        so that a duplicated event can show up, before the loop gets killed
+ **/
+static void* _killer_main(void* data)
+{
+	(void)data;
+	int i;
+	for(i = 0; i < 1000 && ndone < NEVENTS; i ++)
+		usleep(10000);
+	usleep(100000);
+	sched_loop_kill(0);
+	return NULL;
+}
+
+int steal_consume_once(void)
+{
+	pthread_t killer;
+	sched_service_t* service = NULL;
+	int i;
+
+	/* Because a GLIBC bug, the TLS of the threads may leak */
+	for(i = 0; i < 8; i ++)
+		expected_memory_leakage();
+
+	ASSERT_PTR(service = sched_service_from_buffer(serv_buf), CLEANUP_NOP);
+
+	runtime_servlet_set_trap(trap_func);
+
+	ASSERT(0 == pthread_create(&killer, NULL, _killer_main, NULL), sched_service_free(service));
+	ASSERT_OK(sched_loop_start(&service, 0), pthread_join(killer, NULL); sched_service_free(service));
+	ASSERT(0 == pthread_join(killer, NULL), sched_service_free(service));
+
+	runtime_servlet_set_trap(NULL);
+
+	ASSERT_OK(sched_service_free(service), CLEANUP_NOP);
+
+	ASSERT(ndone == NEVENTS, CLEANUP_NOP);
+	for(i = 0; i < NEVENTS; i ++)
+		ASSERT(counts[i] == 1, CLEANUP_NOP);
+
+	return 0;
+}
+
+int setup(void)
+{
+	FILE* fp = fopen(input_file, "w");
+	ASSERT_PTR(fp, CLEANUP_NOP);
+	int i;
+	for(i = 0; i < NEVENTS; i ++)
+		fprintf(fp, ".TEXT event_%d\n%d\n.END\n", i, i);
+	fclose(fp);
+
+	/* We only care about how many times the task is executed, so the outputs are discarded */
+	char input_arg[64];
+	snprintf(input_arg, sizeof(input_arg), "input=%s", input_file);
+	const char* mod_args[] = {input_arg, "output=/dev/null", "label=loop_test"};
+	ASSERT_OK(itc_modtab_insmod(&module_simulate_module_def, 3, mod_args), CLEANUP_NOP);
+
+	lang_prop_value_t mode = {
+		.type = LANG_PROP_TYPE_STRING,
+		.str  = "steal"
+	};
+	ASSERT(1 == lang_prop_set("scheduler.worker.mode", mode), CLEANUP_NOP);
+
+	lang_prop_value_t nthreads = {
+		.type = LANG_PROP_TYPE_INTEGER,
+		.num  = 4
+	};
+	ASSERT(1 == lang_prop_set("scheduler.worker.nthreads", nthreads), CLEANUP_NOP);
+
+	const char* argv[] = {"serv_steal"};
+	ASSERT_OK(runtime_servlet_append_search_path(TESTDIR), CLEANUP_NOP);
+	expected_memory_leakage();
+	ASSERT_RETOK(runtime_stab_entry_t, serv = runtime_stab_load(1, argv, NULL), CLEANUP_NOP);
+
+	runtime_api_pipe_id_t in, out;
+	ASSERT_RETOK(runtime_api_pipe_id_t, in = runtime_stab_get_pipe(serv, "in"), CLEANUP_NOP);
+	ASSERT_RETOK(runtime_api_pipe_id_t, out = runtime_stab_get_pipe(serv, "out"), CLEANUP_NOP);
+
+	sched_service_node_id_t node;
+	ASSERT_PTR(serv_buf = sched_service_buffer_new(), CLEANUP_NOP);
+	ASSERT_RETOK(sched_service_node_id_t, node = sched_service_buffer_add_node(serv_buf, serv), CLEANUP_NOP);
+	ASSERT_OK(sched_service_buffer_set_input(serv_buf, node, in), CLEANUP_NOP);
+	ASSERT_OK(sched_service_buffer_set_output(serv_buf, node, out), CLEANUP_NOP);
+
+	return 0;
+}
+
+int teardown(void)
+{
+	unlink(input_file);
+	ASSERT_OK(sched_service_buffer_free(serv_buf), CLEANUP_NOP);
+	return 0;
+}
+
+TEST_LIST_BEGIN
+    TEST_CASE(steal_consume_once)
+TEST_LIST_END;
@@ -0,0 +1,218 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <testenv.h>
+#include <lang/prop.h>
+#include <sched/prof.h>
+
+#define SUB_BUCKETS ((uint64_t)1 << SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS)
+#define MAX_VALUE (((uint64_t)1 << SCHED_PROF_HISTOGRAM_MAX_BITS) - 1)
+
+static uint64_t count[SCHED_PROF_HIST_NUM_BUCKETS];
+
+/**
+ * @brief Check the bucket of the value is the smallest bucket which covers it, and the error is bounded
+ **/
+static int _check_value(uint64_t value)
+{
+	uint32_t bucket = sched_prof_hist_bucket(value);
+	ASSERT(bucket < SCHED_PROF_HIST_NUM_BUCKETS, CLEANUP_NOP);
+
+	uint64_t upper = sched_prof_hist_bucket_value(bucket);
+	ASSERT(upper >= value, CLEANUP_NOP);
+	ASSERT(bucket == 0 || sched_prof_hist_bucket_value(bucket - 1) < value, CLEANUP_NOP);
+
+	/* The width of the bucket is at most 1/SUB_BUCKETS of the value */
+	ASSERT(upper - value <= value / SUB_BUCKETS, CLEANUP_NOP);
+
+	return 0;
+}
+
+static void _reset(void)
+{
+	memset(count, 0, sizeof(count));
+}
+
+static void _add(uint64_t value, uint64_t n)
+{
+	count[sched_prof_hist_bucket(value)] += n;
+}
+
+static uint64_t _expected(uint64_t value)
+{
+	return sched_prof_hist_bucket_value(sched_prof_hist_bucket(value));
+}
+
+int bucket_small_values(void)
+{
+	uint64_t i;
+	for(i = 0; i < SUB_BUCKETS; i ++)
+	{
+		ASSERT(sched_prof_hist_bucket(i) == i, CLEANUP_NOP);
+		ASSERT(sched_prof_hist_bucket_value((uint32_t)i) == i, CLEANUP_NOP);
+	}
+
+	/* The first power of two range is still exact */
+	for(; i < 2 * SUB_BUCKETS; i ++)
+		ASSERT(sched_prof_hist_bucket_value(sched_prof_hist_bucket(i)) == i, CLEANUP_NOP);
+
+	return 0;
+}
+
+int bucket_placement(void)
+{
+	uint64_t i, prev = 0;
+	for(i = 0; i < 65536; i ++)
+	{
+		ASSERT_OK(_check_value(i), CLEANUP_NOP);
+
+		/* The bucket index is monotonic and never skips a bucket */
+		uint32_t bucket = sched_prof_hist_bucket(i);
+		ASSERT(bucket == prev || bucket == prev + 1, CLEANUP_NOP);
+		prev = bucket;
+	}
+
+	uint32_t k;
+	for(k = SCHED_PROF_HISTOGRAM_SUB_BUCKET_BITS; k < SCHED_PROF_HISTOGRAM_MAX_BITS; k ++)
+	{
+		uint64_t base = (uint64_t)1 << k;
+		ASSERT_OK(_check_value(base - 1), CLEANUP_NOP);
+		ASSERT_OK(_check_value(base), CLEANUP_NOP);
+		ASSERT_OK(_check_value(base + 1), CLEANUP_NOP);
+		ASSERT_OK(_check_value(base + base / 2), CLEANUP_NOP);
+		ASSERT_OK(_check_value(2 * base - 1), CLEANUP_NOP);
+
+		/* Each power of two range starts a new bucket */
+		ASSERT(sched_prof_hist_bucket(base) == sched_prof_hist_bucket(base - 1) + 1, CLEANUP_NOP);
+	}
+
+	srand(1);
+	for(i = 0; i < 100000; i ++)
+		ASSERT_OK(_check_value((((uint64_t)rand() << 31) ^ (uint64_t)rand()) & MAX_VALUE), CLEANUP_NOP);
+
+	return 0;
+}
+
+int bucket_saturation(void)
+{
+	uint32_t last = SCHED_PROF_HIST_NUM_BUCKETS - 1;
+
+	ASSERT(sched_prof_hist_bucket(MAX_VALUE) == last, CLEANUP_NOP);
+	ASSERT(sched_prof_hist_bucket(MAX_VALUE + 1) == last, CLEANUP_NOP);
+	ASSERT(sched_prof_hist_bucket(UINT64_MAX) == last, CLEANUP_NOP);
+
+	ASSERT(sched_prof_hist_bucket_value(last) == MAX_VALUE, CLEANUP_NOP);
+	ASSERT(sched_prof_hist_bucket_value(last + 1) == MAX_VALUE, CLEANUP_NOP);
+
+	return 0;
+}
+
+int percentile_empty(void)
+{
+	_reset();
+	ASSERT(sched_prof_hist_percentile(count, 0, 500) == 0, CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(NULL, 1, 500) == 0, CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1, 1001) == 0, CLEANUP_NOP);
+	return 0;
+}
+
+int percentile_single_sample(void)
+{
+	_reset();
+	_add(12345, 1);
+
+	ASSERT(sched_prof_hist_percentile(count, 1, 0) == _expected(12345), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1, 500) == _expected(12345), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1, 999) == _expected(12345), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1, 1000) == _expected(12345), CLEANUP_NOP);
+
+	return 0;
+}
+
+int percentile_uniform(void)
+{
+	uint64_t i;
+	_reset();
+	for(i = 1; i <= 1000; i ++)
+		_add(i, 1);
+
+	/* The sample with rank ceil(N * p) is the percentile, so it's the value itself */
+	ASSERT(sched_prof_hist_percentile(count, 1000, 500) == _expected(500), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 900) == _expected(900), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 990) == _expected(990), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 999) == _expected(999), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 1000) == _expected(1000), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 1) == _expected(1), CLEANUP_NOP);
+
+	return 0;
+}
+
+int percentile_rank_rounding(void)
+{
+	_reset();
+	_add(100, 1);
+	_add(10000, 1);
+	_add(1000000, 1);
+
+	/* 3 * 0.5 = 1.5, so the median is the second sample */
+	ASSERT(sched_prof_hist_percentile(count, 3, 500) == _expected(10000), CLEANUP_NOP);
+	/* 3 * 0.333 = 0.999, which is rounded up to the first sample */
+	ASSERT(sched_prof_hist_percentile(count, 3, 333) == _expected(100), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 3, 334) == _expected(10000), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 3, 667) == _expected(1000000), CLEANUP_NOP);
+
+	return 0;
+}
+
+int percentile_tail(void)
+{
+	_reset();
+	_add(20, 998);
+	_add(5000, 1);
+	_add(3000000, 1);
+
+	ASSERT(sched_prof_hist_percentile(count, 1000, 500) == _expected(20), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 990) == _expected(20), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 998) == _expected(20), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 999) == _expected(5000), CLEANUP_NOP);
+	ASSERT(sched_prof_hist_percentile(count, 1000, 1000) == _expected(3000000), CLEANUP_NOP);
+
+	/* The saturated samples are reported as the largest value the histogram can represent */
+	_reset();
+	_add(UINT64_MAX, 10);
+	ASSERT(sched_prof_hist_percentile(count, 10, 500) == MAX_VALUE, CLEANUP_NOP);
+
+	return 0;
+}
+
+int report_without_profiler(void)
+{
+	lang_prop_value_t value = lang_prop_get("profiler.report");
+	ASSERT(value.type == LANG_PROP_TYPE_STRING, CLEANUP_NOP);
+	ASSERT_PTR(value.str, CLEANUP_NOP);
+
+	static const char expected[] = "#node\tservlet\tcount\twall_p50\twall_p99\twall_p999\tcpu_p50\tcpu_p99\tcpu_p999"
+	                               "\tqueue_p50\tqueue_p99\tqueue_p999\n";
+	ASSERT_STREQ(value.str, expected, free(value.str));
+	free(value.str);
+
+	return 0;
+}
+
+DEFAULT_SETUP;
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(bucket_small_values),
+    TEST_CASE(bucket_placement),
+    TEST_CASE(bucket_saturation),
+    TEST_CASE(percentile_empty),
+    TEST_CASE(percentile_single_sample),
+    TEST_CASE(percentile_uniform),
+    TEST_CASE(percentile_rank_rounding),
+    TEST_CASE(percentile_tail),
+    TEST_CASE(report_without_profiler)
+TEST_LIST_END;
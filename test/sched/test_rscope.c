@@ -3,6 +3,7 @@
  **/
 
 #include <testenv.h>
+#include <utils/mempool/acct.h>
 
 #define N 10240
 static int status[N];
@@ -148,6 +149,13 @@ static inline size_t _stream_obj_read(void* handle, void* buffer, size_t sz)
 	return ret;
 }
 
+static inline int _arena_obj_free(void* ptr)
+{
+	/* The memory is owned by the request arena */
+	if(NULL == ptr) return ERROR_CODE(int);
+	return 0;
+}
+
 int test_stream_interface(void)
 {
 	runtime_api_scope_token_t t1, t2;
@@ -317,6 +325,137 @@ int test_stream_interface(void)
 	return 0;
 }
 
+int test_arena(void)
+{
+	sched_rscope_t* scope = sched_rscope_new();
+	ASSERT_PTR(scope, CLEANUP_NOP);
+
+	uint32_t i;
+	uint32_t* small[1024];
+	for(i = 0; i < sizeof(small) / sizeof(small[0]); i ++)
+	{
+		ASSERT_PTR(small[i] = (uint32_t*)sched_rscope_arena_alloc(scope, (i % 7 + 1) * sizeof(uint32_t)), goto ERR);
+		ASSERT(((uintptr_t)small[i]) % sizeof(uintpad_t) == 0, goto ERR);
+		small[i][0] = i;
+	}
+
+	char* large = (char*)sched_rscope_arena_alloc(scope, 65536);
+	ASSERT_PTR(large, goto ERR);
+	memset(large, 'x', 65536);
+
+	for(i = 0; i < sizeof(small) / sizeof(small[0]); i ++)
+		ASSERT(small[i][0] == i, goto ERR);
+
+	/* The arena should be kept alive by the opened stream */
+	stream_object_t* obj = (stream_object_t*)sched_rscope_arena_alloc(scope, sizeof(stream_object_t));
+	ASSERT_PTR(obj, goto ERR);
+	obj->begin = 'a';
+	obj->end = 'z' + 1;
+	runtime_api_scope_entity_t ent = {
+		.data = obj,
+		.copy_func = _stream_obj_copy,
+		.free_func = _arena_obj_free,
+		.open_func = _stream_obj_open,
+		.close_func = _stream_obj_close,
+		.eos_func = _stream_obj_eos,
+		.read_func = _stream_obj_read
+	};
+	runtime_api_scope_token_t tok;
+	ASSERT_RETOK(runtime_api_scope_token_t, tok = sched_rscope_add(scope, &ent), goto ERR);
+	sched_rscope_stream_t* stream = sched_rscope_stream_open(tok);
+	ASSERT_PTR(stream, goto ERR);
+
+	ASSERT_OK(sched_rscope_free(scope), CLEANUP_NOP);
+
+	char buf[27] = {};
+	ASSERT(26 == sched_rscope_stream_read(stream, buf, 26), CLEANUP_NOP);
+	ASSERT(0 == strcmp(buf, "abcdefghijklmnopqrstuvwxyz"), CLEANUP_NOP);
+	ASSERT_OK(sched_rscope_stream_close(stream), CLEANUP_NOP);
+
+	return 0;
+ERR:
+	sched_rscope_free(scope);
+	return ERROR_CODE(int);
+}
+
+#define NUM_PAGED_ENTRIES 4096
+static int paged_values[2][NUM_PAGED_ENTRIES];
+
+static int _paged_free(void* ptr)
+{
+	*(int*)ptr = -1;
+	return 0;
+}
+
+static int _paged_fill(sched_rscope_t* scope, int* values, runtime_api_scope_token_t* tokens)
+{
+	uint32_t i;
+	for(i = 0; i < NUM_PAGED_ENTRIES; i ++)
+	{
+		runtime_api_scope_entity_t ent = {
+			.data = values + i,
+			.free_func = _paged_free
+		};
+		values[i] = (int)i;
+		ASSERT_RETOK(runtime_api_scope_token_t, tokens[i] = sched_rscope_add(scope, &ent), CLEANUP_NOP);
+	}
+	return 0;
+}
+
+int test_paged_table(void)
+{
+	static runtime_api_scope_token_t tokens[2][NUM_PAGED_ENTRIES];
+	sched_rscope_t* scope[2] = {};
+	uint32_t i;
+	mempool_acct_stat_t before, after;
+
+	ASSERT_PTR(scope[0] = sched_rscope_new(), goto ERR);
+	ASSERT_PTR(scope[1] = sched_rscope_new(), goto ERR);
+
+	/* The table grows several times, but the earlier tokens should still point to the same entity */
+	ASSERT_OK(_paged_fill(scope[0], paged_values[0], tokens[0]), goto ERR);
+	ASSERT_OK(_paged_fill(scope[1], paged_values[1], tokens[1]), goto ERR);
+
+	for(i = 0; i < NUM_PAGED_ENTRIES; i ++)
+	{
+		ASSERT(sched_rscope_get(scope[0], tokens[0][i]) == paged_values[0] + i, goto ERR);
+		ASSERT(sched_rscope_get(scope[1], tokens[1][i]) == paged_values[1] + i, goto ERR);
+	}
+
+	/* Once all the entries of a page are released, the page should go back to the page pool */
+	ASSERT(1 == mempool_acct_query("rscope.entry_table", &before), goto ERR);
+	ASSERT_OK(sched_rscope_free(scope[0]), CLEANUP_NOP);
+	scope[0] = NULL;
+	ASSERT(1 == mempool_acct_query("rscope.entry_table", &after), goto ERR);
+	ASSERT(after.in_use < before.in_use, goto ERR);
+
+	for(i = 0; i < NUM_PAGED_ENTRIES; i ++)
+	{
+		ASSERT(paged_values[0][i] == -1, goto ERR);
+		ASSERT(sched_rscope_get(scope[1], tokens[1][i]) == paged_values[1] + i, goto ERR);
+	}
+
+	/* The released slots should be reused */
+	ASSERT_PTR(scope[0] = sched_rscope_new(), goto ERR);
+	ASSERT_OK(_paged_fill(scope[0], paged_values[0], tokens[0]), goto ERR);
+	ASSERT(1 == mempool_acct_query("rscope.entry_table", &after), goto ERR);
+	ASSERT(after.in_use <= before.in_use, goto ERR);
+	for(i = 0; i < NUM_PAGED_ENTRIES; i ++)
+		ASSERT(sched_rscope_get(scope[0], tokens[0][i]) == paged_values[0] + i, goto ERR);
+
+	ASSERT_OK(sched_rscope_free(scope[0]), CLEANUP_NOP);
+	ASSERT_OK(sched_rscope_free(scope[1]), CLEANUP_NOP);
+
+	for(i = 0; i < NUM_PAGED_ENTRIES; i ++)
+		ASSERT(paged_values[0][i] == -1 && paged_values[1][i] == -1, CLEANUP_NOP);
+
+	return 0;
+ERR:
+	if(NULL != scope[0]) sched_rscope_free(scope[0]);
+	if(NULL != scope[1]) sched_rscope_free(scope[1]);
+	return ERROR_CODE(int);
+}
+
 int setup(void)
 {
 	return sched_rscope_init_thread();
@@ -329,5 +468,7 @@ int teardown(void)
 
 TEST_LIST_BEGIN
     TEST_CASE(test_multiple_request),
-    TEST_CASE(test_stream_interface)
+    TEST_CASE(test_stream_interface),
+    TEST_CASE(test_arena),
+    TEST_CASE(test_paged_table)
 TEST_LIST_END;
@@ -216,6 +216,7 @@ int service_getters(void)
 
 	sched_service_t* serv;
 	const sched_service_pipe_descriptor_t* pds;
+	const sched_service_pipe_wiring_t* wiring;
 	uint32_t n;
 	ASSERT_PTR(serv = sched_service_from_buffer(buffer), FB);
 #define FBS sched_service_free(serv); sched_service_buffer_free(buffer);
@@ -231,8 +232,19 @@ int service_getters(void)
 	ASSERT(nodes[0] == pds[0].source_node_id, FBS);
 	ASSERT(nodes[0] == pds[1].source_node_id, FBS);
 	ASSERT(pds[0].source_pipe_desc != pds[1].source_pipe_desc, FBS);
+	ASSERT_PTR(wiring = sched_service_get_outgoing_wiring(serv, nodes[0], &n), FBS);
+	ASSERT(2 == n, FBS);
+	ASSERT(0 == memcmp(&wiring[0].desc, pds + 0, sizeof(*pds)), FBS);
+	ASSERT(0 == memcmp(&wiring[1].desc, pds + 1, sizeof(*pds)), FBS);
+	ASSERT(wiring[0].param.output_flags == sched_service_get_pipe_flags(serv, nodes[0], pds[0].source_pipe_desc), FBS);
+	ASSERT(wiring[0].param.input_flags == sched_service_get_pipe_flags(serv, nodes[1], pds[0].destination_pipe_desc), FBS);
+	ASSERT(wiring[1].param.output_header == sched_service_get_pipe_type_size(serv, nodes[0], pds[1].source_pipe_desc), FBS);
+	ASSERT(wiring[1].param.input_header == sched_service_get_pipe_type_size(serv, nodes[1], pds[1].destination_pipe_desc), FBS);
+	ASSERT(NULL == wiring[0].param.args, FBS);
 	ASSERT_PTR(pds = sched_service_get_outgoing_pipes(serv, nodes[1], &n), FBS);
 	ASSERT(0 == n, FBS);
+	ASSERT_PTR(wiring = sched_service_get_outgoing_wiring(serv, nodes[1], &n), FBS);
+	ASSERT(0 == n, FBS);
 
 	ASSERT_OK(sched_service_buffer_free(buffer), FBS);
 	ASSERT_OK(sched_service_free(serv), FBS);
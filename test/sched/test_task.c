@@ -274,6 +274,89 @@ int do_request_test(void)
 		ASSERT_OK(request_test(i), CLEANUP_NOP);
 	return 0;
 }
+/**
+ * @brief the number of requests in the concurrent request test, which is large enough to make the task table,
+ *        the request table and the ready queue grow
+ **/
+#define NUM_CONCURRENT_REQUESTS 1024
+
+int concurrent_requests(void)
+#if DO_NOT_COMPILE_ITC_MODULE_TEST == 0
+{
+	int rc = -1, i;
+	static itc_module_pipe_t* out[NUM_CONCURRENT_REQUESTS];
+	static sched_task_request_t reqs[NUM_CONCURRENT_REQUESTS];
+	itc_module_pipe_t *sp[2] = {}, *tmp = NULL;
+	sched_task_t* task = NULL;
+
+	itc_module_pipe_param_t param = {
+		.input_flags = RUNTIME_API_PIPE_INPUT,
+		.output_flags = RUNTIME_API_PIPE_OUTPUT,
+		.args = NULL
+	};
+
+	memset(out, 0, sizeof(out));
+
+	for(i = 0; i < NUM_CONCURRENT_REQUESTS; i ++)
+	{
+		ASSERT_OK(itc_module_pipe_allocate(mod_test, 0, param, sp + 0, sp + 1), goto ERR);
+		ASSERT_OK(itc_module_pipe_allocate(mod_test, 0, param, &tmp, out + i), goto ERR);
+		ASSERT_RETOK(size_t, itc_module_pipe_write(&i, sizeof(int), sp[0]), goto ERR);
+		ASSERT_OK(itc_module_pipe_deallocate(sp[0]), goto ERR);
+		sp[0] = NULL;
+		ASSERT_RETOK(sched_task_request_t, reqs[i] = sched_task_new_request(stc, service, sp[1], tmp), goto ERR);
+		sp[1] = tmp = NULL;
+	}
+
+	ASSERT(NUM_CONCURRENT_REQUESTS == sched_task_num_concurrent_requests(stc), goto ERR);
+
+	/* All the requests are running concurrently, since the task is picked up in the FIFO order */
+	while(NULL != (task = sched_task_next_ready_task(stc)))
+	{
+		uint32_t size, j;
+		const sched_service_pipe_descriptor_t* result;
+		itc_module_pipe_t *pipes[2];
+
+		ASSERT_PTR(result = sched_service_get_outgoing_pipes(task->service, task->node, &size), goto ERR);
+		for(j = 0; j < size; j ++)
+		{
+			ASSERT_OK(itc_module_pipe_allocate(mod_test, 0, param, pipes + 0, pipes + 1), goto ERR);
+			ASSERT_OK(sched_task_output_pipe(task, result[j].source_pipe_desc, pipes[0]), goto ERR);
+			ASSERT_OK(sched_task_input_pipe(stc, task->service, task->request, result[j].destination_node_id, result[j].destination_pipe_desc, pipes[1], 0), goto ERR);
+		}
+
+		ASSERT_OK(runtime_task_start(task->exec_task), goto ERR);
+		ASSERT_OK(sched_task_free(task), goto ERR);
+		task = NULL;
+	}
+
+	ASSERT(0 == sched_task_num_concurrent_requests(stc), goto ERR);
+
+	for(i = 0; i < NUM_CONCURRENT_REQUESTS; i ++)
+	{
+		int outval;
+		ASSERT(0 == sched_task_request_status(stc, reqs[i]), goto ERR);
+		ASSERT_RETOK(size_t, itc_module_pipe_read(&outval, sizeof(int), out[i]), goto ERR);
+		ASSERT(outval == 18 * i, goto ERR);
+	}
+
+	rc = 0;
+ERR:
+	if(NULL != task) sched_task_free(task);
+	if(NULL != sp[0]) itc_module_pipe_deallocate(sp[0]);
+	if(NULL != sp[1]) itc_module_pipe_deallocate(sp[1]);
+	if(NULL != tmp) itc_module_pipe_deallocate(tmp);
+	for(i = 0; i < NUM_CONCURRENT_REQUESTS; i ++)
+		if(NULL != out[i]) itc_module_pipe_deallocate(out[i]);
+	return rc;
+}
+#else
+{
+	LOG_WARNING("Skip concurrent request test, because testing ITC module is disabled");
+	return 0;
+}
+#endif /*DO_NOT_COMPILE_ITC_MODULE_TEST */
+
 int build_service(void)
 {
 	ASSERT_PTR(service = sched_service_from_buffer(buffer), CLEANUP_NOP);
@@ -517,6 +600,7 @@ TEST_LIST_BEGIN
     TEST_CASE(build_buffer),
     TEST_CASE(build_service),
     TEST_CASE(do_request_test),
+    TEST_CASE(concurrent_requests),
     TEST_CASE(task_cancel),
     TEST_CASE(pipe_disable)
 TEST_LIST_END;
@@ -0,0 +1,232 @@
+/**
+ * Copyright (C) 2018, Hao Hou
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <testenv.h>
+#include <lang/prop.h>
+#include <sched/trace.h>
+
+static char trace_file[] = "/tmp/plumber-trace-test.json";
+
+static int _set_int(const char* symbol, int64_t num)
+{
+	lang_prop_value_t value = {
+		.type = LANG_PROP_TYPE_INTEGER,
+		.num  = num
+	};
+	return lang_prop_set(symbol, value);
+}
+
+static int _set_output(const char* path)
+{
+	lang_prop_value_t value = {
+		.type = LANG_PROP_TYPE_STRING,
+		.str  = (char*)path
+	};
+	return lang_prop_set("tracer.output", value);
+}
+
+/**
+ * @brief Read the trace file, and count how many spans with the given name it contains
+ **/
+static int _count_spans(const char* name)
+{
+	static char buf[1 << 20];
+	char pattern[64];
+	FILE* fp = fopen(trace_file, "r");
+	if(NULL == fp) return -1;
+	size_t size = fread(buf, 1, sizeof(buf) - 1, fp);
+	fclose(fp);
+	buf[size] = 0;
+
+	snprintf(pattern, sizeof(pattern), "\"name\":\"%s\"", name);
+
+	int ret = 0;
+	const char* ptr;
+	for(ptr = strstr(buf, pattern); NULL != ptr; ptr = strstr(ptr + 1, pattern))
+		ret ++;
+
+	return ret;
+}
+
+/**
+ * @brief Finalize the tracer, which dumps the spans, and start a new tracer run
+ **/
+static int _restart(void)
+{
+	if(ERROR_CODE(int) == sched_trace_finalize()) return ERROR_CODE(int);
+	if(ERROR_CODE(int) == sched_trace_init()) return ERROR_CODE(int);
+	return 0;
+}
+
+int sampling(void)
+{
+	int i;
+	ASSERT(1 == _set_int("tracer.sample_rate", 3), CLEANUP_NOP);
+
+	for(i = 1; i <= 9; i ++)
+	{
+		sched_trace_id_t id = sched_trace_sample();
+		ASSERT((i % 3 == 0) == (id != 0), CLEANUP_NOP);
+	}
+
+	ASSERT(1 == _set_int("tracer.sample_rate", 0), CLEANUP_NOP);
+	for(i = 0; i < 10; i ++)
+		ASSERT(0 == sched_trace_sample(), CLEANUP_NOP);
+
+	return 0;
+}
+
+int record_and_dump(void)
+{
+	int i;
+	unlink(trace_file);
+	ASSERT(1 == _set_output(trace_file), CLEANUP_NOP);
+
+	/* The untraced request doesn't produce anything */
+	sched_trace_end(0, SCHED_TRACE_SPAN_EXEC, 0, sched_trace_begin(0));
+
+	for(i = 0; i < 3; i ++)
+	{
+		uint64_t ts = sched_trace_begin(1);
+		ASSERT(ts > 0, CLEANUP_NOP);
+		sched_trace_end(1, SCHED_TRACE_SPAN_EXEC, (uint64_t)i, ts);
+	}
+	ASSERT_OK(sched_trace_record(1, SCHED_TRACE_SPAN_REQUEST, 0, sched_trace_timestamp()), CLEANUP_NOP);
+	ASSERT(ERROR_CODE(int) == sched_trace_record(1, SCHED_TRACE_SPAN_COUNT, 0, 0), CLEANUP_NOP);
+
+	ASSERT_OK(_restart(), CLEANUP_NOP);
+
+	ASSERT(3 == _count_spans("exec"), CLEANUP_NOP);
+	ASSERT(1 == _count_spans("request"), CLEANUP_NOP);
+
+	unlink(trace_file);
+	return 0;
+}
+
+/**
+ * @brief The ring buffers are released by the finalization, so a thread which survives the previous run
+ *        should not write to the ring buffer from the previous run
+ **/
+static pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  _cond  = PTHREAD_COND_INITIALIZER;
+static int _step = 0;
+
+static void _wait_step(int step)
+{
+	pthread_mutex_lock(&_mutex);
+	while(_step < step) pthread_cond_wait(&_cond, &_mutex);
+	pthread_mutex_unlock(&_mutex);
+}
+
+static void _next_step(void)
+{
+	pthread_mutex_lock(&_mutex);
+	_step ++;
+	pthread_cond_broadcast(&_cond);
+	pthread_mutex_unlock(&_mutex);
+}
+
+static void* _survivor_main(void* data)
+{
+	(void)data;
+	sched_trace_record(2, SCHED_TRACE_SPAN_EXEC, 0, sched_trace_timestamp());
+	_next_step();
+	_wait_step(2);
+	sched_trace_record(2, SCHED_TRACE_SPAN_MODULE_WRITE, 0, sched_trace_timestamp());
+	_next_step();
+	return NULL;
+}
+
+int ring_across_runs(void)
+{
+	pthread_t thread;
+	unlink(trace_file);
+
+	/* Because a GLIBC bug, the TLS of the threads may leak */
+	expected_memory_leakage();
+
+	ASSERT(1 == _set_output(trace_file), CLEANUP_NOP);
+	ASSERT(0 == pthread_create(&thread, NULL, _survivor_main, NULL), CLEANUP_NOP);
+
+	_wait_step(1);
+	ASSERT_OK(_restart(), goto ERR);
+	ASSERT(1 == _count_spans("exec"), goto ERR);
+	unlink(trace_file);
+
+	ASSERT(1 == _set_output(trace_file), goto ERR);
+	_next_step();
+	_wait_step(3);
+	ASSERT(0 == pthread_join(thread, NULL), CLEANUP_NOP);
+
+	ASSERT_OK(_restart(), CLEANUP_NOP);
+	ASSERT(1 == _count_spans("module_write"), CLEANUP_NOP);
+	ASSERT(0 == _count_spans("exec"), CLEANUP_NOP);
+
+	unlink(trace_file);
+	return 0;
+ERR:
+	_next_step();
+	pthread_join(thread, NULL);
+	return ERROR_CODE(int);
+}
+
+/**
+ * @brief The finalization should wait for the writers, rather than releasing the ring buffers under them
+ **/
+static volatile int _stop = 0;
+static void* _writer_main(void* data)
+{
+	(void)data;
+	while(!_stop)
+		sched_trace_record(3, SCHED_TRACE_SPAN_MODULE_WRITE, 0, sched_trace_timestamp());
+	return NULL;
+}
+
+int finalize_with_writers(void)
+{
+	pthread_t threads[4];
+	unsigned i, j;
+
+	/* Because a GLIBC bug, the TLS of the threads may leak */
+	for(i = 0; i < sizeof(threads) / sizeof(threads[0]); i ++)
+		expected_memory_leakage();
+
+	/* No output file, the spans are discarded */
+	ASSERT(1 == _set_output(""), CLEANUP_NOP);
+
+	_stop = 0;
+	for(i = 0; i < sizeof(threads) / sizeof(threads[0]); i ++)
+		ASSERT(0 == pthread_create(threads + i, NULL, _writer_main, NULL), goto ERR);
+
+	for(j = 0; j < 20; j ++)
+	{
+		usleep(1000);
+		ASSERT_OK(_restart(), goto ERR);
+	}
+
+	_stop = 1;
+	for(j = 0; j < i; j ++)
+		ASSERT(0 == pthread_join(threads[j], NULL), CLEANUP_NOP);
+
+	return 0;
+ERR:
+	_stop = 1;
+	for(j = 0; j < i; j ++)
+		pthread_join(threads[j], NULL);
+	return ERROR_CODE(int);
+}
+
+DEFAULT_SETUP;
+DEFAULT_TEARDOWN;
+
+TEST_LIST_BEGIN
+    TEST_CASE(sampling),
+    TEST_CASE(record_and_dump),
+    TEST_CASE(ring_across_runs),
+    TEST_CASE(finalize_with_writers)
+TEST_LIST_END;
@@ -0,0 +1,169 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdio.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <testenv.h>
+
+#define NUM_THREADS 4
+#define NUM_RECORDS 20000
+
+static char log_file[] = "/tmp/plumber-test-log-XXXXXX";
+
+static void* thread_main(void* data)
+{
+	uint32_t tid = (uint32_t)(uintptr_t)data;
+	uint32_t i;
+	for(i = 0; i < NUM_RECORDS; i ++)
+		log_write(INFO, __FILE__, __FUNCTION__, __LINE__, "async record %u %u", tid, i);
+	return NULL;
+}
+
+/**
+ * @brief run the threads with the given policy, and check the records in the log file
+ * @param policy the asynchronous logging policy
+ * @param dropped the buffer used to return the number of dropped records
+ * @return status code
+ **/
+static int _run(log_async_policy_t policy, uint64_t* dropped)
+{
+	pthread_t threads[NUM_THREADS];
+	uint32_t i;
+	log_async_stat_t before, after;
+	FILE* fp = NULL;
+
+	/* Because a GLIBC bug, the TLS of the threads may leak */
+	for(i = 0; i < NUM_THREADS; i ++)
+		expected_memory_leakage();
+
+	ASSERT_OK(log_redirect(INFO, log_file, "w"), CLEANUP_NOP);
+	ASSERT_OK(log_set_async(policy), CLEANUP_NOP);
+	ASSERT(log_get_async() == policy, CLEANUP_NOP);
+	ASSERT_OK(log_async_stat(&before), CLEANUP_NOP);
+
+	for(i = 0; i < NUM_THREADS; i ++)
+		ASSERT(0 == pthread_create(threads + i, NULL, thread_main, (void*)(uintptr_t)i), CLEANUP_NOP);
+	for(i = 0; i < NUM_THREADS; i ++)
+		pthread_join(threads[i], NULL);
+
+	ASSERT_OK(log_flush(), CLEANUP_NOP);
+	ASSERT_OK(log_async_stat(&after), CLEANUP_NOP);
+	ASSERT_OK(log_set_async(LOG_ASYNC_OFF), CLEANUP_NOP);
+
+	*dropped = after.dropped - before.dropped;
+
+	uint32_t next[NUM_THREADS] = {};
+	uint64_t count = 0;
+	char buf[1024];
+	ASSERT_PTR(fp = fopen(log_file, "r"), CLEANUP_NOP);
+	for(;NULL != fgets(buf, sizeof(buf), fp);)
+	{
+		const char* rec = strstr(buf, "async record ");
+		if(NULL == rec) continue;
+
+		uint32_t tid, seq;
+		ASSERT(2 == sscanf(rec, "async record %u %u", &tid, &seq), goto ERR);
+		ASSERT(tid < NUM_THREADS, goto ERR);
+
+		/* The records of the same thread should be in order */
+		ASSERT(seq >= next[tid], goto ERR);
+		next[tid] = seq + 1;
+		count ++;
+	}
+
+	ASSERT(count + *dropped == NUM_THREADS * NUM_RECORDS, goto ERR);
+	ASSERT(after.written - before.written >= count, goto ERR);
+
+	fclose(fp);
+
+	return 0;
+ERR:
+	fclose(fp);
+	return ERROR_CODE(int);
+}
+
+int async_block(void)
+{
+	uint64_t dropped;
+	ASSERT_OK(_run(LOG_ASYNC_BLOCK, &dropped), CLEANUP_NOP);
+	ASSERT(dropped == 0, CLEANUP_NOP);
+	return 0;
+}
+
+int async_drop(void)
+{
+	uint64_t dropped;
+	ASSERT_OK(_run(LOG_ASYNC_DROP, &dropped), CLEANUP_NOP);
+	LOG_NOTICE("%"PRIu64" records are dropped", dropped);
+	return 0;
+}
+
+static void _rate_limited_site(uint32_t i)
+{
+	LOG_NOTICE_RATE(5, "rate limited record %u", i);
+}
+
+int rate_limit(void)
+{
+	FILE* fp = NULL;
+	uint32_t i;
+
+	ASSERT_OK(log_redirect(NOTICE, log_file, "w"), CLEANUP_NOP);
+
+	for(i = 0; i < 1000; i ++)
+		_rate_limited_site(i);
+
+	/* The next message in the new second carries the number of suppressed messages */
+	sleep(1);
+	_rate_limited_site(i);
+
+	uint32_t count = 0, suppressed = 0, n;
+	int last_has_summary = 0;
+	char buf[1024];
+	ASSERT_PTR(fp = fopen(log_file, "r"), CLEANUP_NOP);
+	for(;NULL != fgets(buf, sizeof(buf), fp);)
+	{
+		const char* rec = strstr(buf, "rate limited record ");
+		if(NULL == rec) continue;
+		count ++;
+		const char* summary = strstr(rec, " (");
+		if((last_has_summary = (NULL != summary)))
+		{
+			ASSERT(1 == sscanf(summary, " (%u similar messages suppressed)", &n), goto ERR);
+			suppressed += n;
+		}
+	}
+
+	/* The loop may cross the second boundary, so we might see two windows before the last message */
+	ASSERT(count <= 11, goto ERR);
+	ASSERT(last_has_summary, goto ERR);
+	ASSERT(count + suppressed == 1001, goto ERR);
+
+	fclose(fp);
+	return 0;
+ERR:
+	fclose(fp);
+	return ERROR_CODE(int);
+}
+
+int setup(void)
+{
+	int fd = mkstemp(log_file);
+	if(fd < 0) return ERROR_CODE(int);
+	close(fd);
+	return 0;
+}
+
+int teardown(void)
+{
+	unlink(log_file);
+	return 0;
+}
+
+TEST_LIST_BEGIN
+    TEST_CASE(async_block),
+    TEST_CASE(async_drop),
+    TEST_CASE(rate_limit)
+TEST_LIST_END;
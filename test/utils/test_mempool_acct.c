@@ -0,0 +1,144 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdio.h>
+#include <testenv.h>
+#include <utils/mempool/objpool.h>
+#include <utils/mempool/acct.h>
+
+static mempool_acct_stat_t query_result;
+
+static int _query(const void* data, mempool_acct_stat_t* buf)
+{
+	ASSERT(data == &query_result, CLEANUP_NOP);
+	*buf = query_result;
+	return 0;
+}
+
+int counter_entry(void)
+{
+	mempool_acct_t* acct = mempool_acct_counter("test.counter");
+	ASSERT_PTR(acct, CLEANUP_NOP);
+	ASSERT(acct == mempool_acct_counter("test.counter"), CLEANUP_NOP);
+
+	ASSERT_OK(mempool_acct_update(acct, 4096), CLEANUP_NOP);
+	ASSERT_OK(mempool_acct_update(acct, 1024), CLEANUP_NOP);
+	ASSERT_OK(mempool_acct_update(acct, -4096), CLEANUP_NOP);
+
+	mempool_acct_stat_t stat;
+	ASSERT(1 == mempool_acct_query("test.counter", &stat), CLEANUP_NOP);
+	ASSERT(stat.in_use == 1024, CLEANUP_NOP);
+	ASSERT(stat.high_watermark == 5120, CLEANUP_NOP);
+	ASSERT(stat.allocs == 2, CLEANUP_NOP);
+	ASSERT(stat.frees == 1, CLEANUP_NOP);
+
+	ASSERT(0 == mempool_acct_query("test.nonexist", &stat), CLEANUP_NOP);
+
+	return 0;
+}
+
+int query_entry(void)
+{
+	mempool_acct_t* acct = mempool_acct_register("test.query", _query, &query_result);
+	ASSERT_PTR(acct, CLEANUP_NOP);
+
+	ASSERT(NULL == mempool_acct_register("test.query", _query, &query_result), CLEANUP_NOP);
+	ASSERT(NULL == mempool_acct_counter("test.query"), CLEANUP_NOP);
+
+	mempool_acct_stat_t stat;
+	query_result.in_use = 300;
+	query_result.cached = 100;
+	ASSERT(1 == mempool_acct_query("test.query", &stat), CLEANUP_NOP);
+	ASSERT(stat.in_use == 300 && stat.cached == 100, CLEANUP_NOP);
+
+	/* The high watermark is the max value we have seen, since the pool doesn't track it */
+	query_result.in_use = 200;
+	ASSERT(1 == mempool_acct_query("test.query", &stat), CLEANUP_NOP);
+	ASSERT(stat.in_use == 200 && stat.high_watermark == 300, CLEANUP_NOP);
+
+	ASSERT_OK(mempool_acct_unregister(acct), CLEANUP_NOP);
+	ASSERT(0 == mempool_acct_query("test.query", &stat), CLEANUP_NOP);
+
+	return 0;
+}
+
+int builtin_pools(void)
+{
+	mempool_objpool_t* pool = mempool_objpool_new(64);
+	ASSERT_PTR(pool, CLEANUP_NOP);
+
+	mempool_acct_stat_t before, after;
+	ASSERT(1 == mempool_acct_query("objpool", &before), goto ERR);
+
+	void* objs[128];
+	uint32_t i;
+	for(i = 0; i < 128; i ++)
+		ASSERT_PTR(objs[i] = mempool_objpool_alloc(pool), goto ERR);
+
+	ASSERT(1 == mempool_acct_query("objpool", &after), goto ERR);
+	ASSERT(after.in_use - before.in_use == 128 * mempool_objpool_get_obj_size(pool), goto ERR);
+	ASSERT(after.allocs - before.allocs == 128, goto ERR);
+
+	for(i = 0; i < 128; i ++)
+		ASSERT_OK(mempool_objpool_dealloc(pool, objs[i]), goto ERR);
+
+	ASSERT(1 == mempool_acct_query("objpool", &after), goto ERR);
+	ASSERT(after.in_use == before.in_use, goto ERR);
+	ASSERT(after.frees - before.frees == 128, goto ERR);
+
+	ASSERT(1 == mempool_acct_query("page", &after), goto ERR);
+
+	ASSERT_OK(mempool_objpool_free(pool), CLEANUP_NOP);
+
+	return 0;
+ERR:
+	mempool_objpool_free(pool);
+	return ERROR_CODE(int);
+}
+
+int report(void)
+{
+	mempool_acct_t* acct = mempool_acct_counter("test.report");
+	ASSERT_PTR(acct, CLEANUP_NOP);
+
+	char* result = mempool_acct_report(1);
+	ASSERT_PTR(result, CLEANUP_NOP);
+	free(result);
+
+	ASSERT_OK(mempool_acct_update(acct, 100), CLEANUP_NOP);
+
+	ASSERT_PTR(result = mempool_acct_report(0), CLEANUP_NOP);
+	ASSERT_PTR(strstr(result, "test.report 100 0 100 1 0\n"), free(result));
+	ASSERT_PTR(strstr(result, "objpool "), free(result));
+	ASSERT_PTR(strstr(result, "page "), free(result));
+	free(result);
+
+	ASSERT_OK(mempool_acct_update(acct, -50), CLEANUP_NOP);
+
+	ASSERT_PTR(result = mempool_acct_report(1), CLEANUP_NOP);
+	char* line = strstr(result, "test.report ");
+	ASSERT_PTR(line, free(result));
+	long change;
+	ASSERT(1 == sscanf(line, "test.report %ld", &change), free(result));
+	ASSERT(change == 50, free(result));
+	free(result);
+
+	return 0;
+}
+
+int setup(void)
+{
+	return mempool_objpool_disabled(0);
+}
+
+int teardown(void)
+{
+	return 0;
+}
+
+TEST_LIST_BEGIN
+    TEST_CASE(counter_entry),
+    TEST_CASE(query_entry),
+    TEST_CASE(builtin_pools),
+    TEST_CASE(report)
+TEST_LIST_END;
@@ -0,0 +1,213 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <time.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <testenv.h>
+#include <utils/thread.h>
+#include <utils/mempool/objpool.h>
+#include <utils/mempool/depot.h>
+
+typedef struct _node_t {
+	uint32_t        value;
+	struct _node_t* link;
+} node_t;
+
+int depot_operations(void)
+{
+	mempool_depot_t depot;
+	node_t nodes[16];
+	uint32_t i;
+
+	mempool_depot_init(&depot);
+	ASSERT(NULL == mempool_depot_pop(&depot, offsetof(node_t, link)), CLEANUP_NOP);
+
+	for(i = 0; i < 8; i ++)
+	{
+		nodes[i].value = i;
+		mempool_depot_push(&depot, nodes + i, nodes + i, offsetof(node_t, link));
+	}
+
+	/* Push the remaining nodes as a single list */
+	for(i = 8; i < 16; i ++)
+	{
+		nodes[i].value = i;
+		nodes[i].link = i > 8 ? nodes + i - 1 : NULL;
+	}
+	mempool_depot_push(&depot, nodes + 15, nodes + 8, offsetof(node_t, link));
+
+	for(i = 0; i < 4; i ++)
+	{
+		node_t* node = (node_t*)mempool_depot_pop(&depot, offsetof(node_t, link));
+		ASSERT_PTR(node, CLEANUP_NOP);
+		ASSERT(node->value == 15 - i, CLEANUP_NOP);
+	}
+
+	node_t* list = (node_t*)mempool_depot_take_all(&depot);
+	ASSERT(NULL == mempool_depot_pop(&depot, offsetof(node_t, link)), CLEANUP_NOP);
+	for(i = 0; i < 12; i ++, list = list->link)
+	{
+		ASSERT_PTR(list, CLEANUP_NOP);
+		ASSERT(list->value == 11 - i, CLEANUP_NOP);
+	}
+	ASSERT(NULL == list, CLEANUP_NOP);
+
+	return 0;
+}
+
+/**
+ * @brief the max number of threads in the benchmark
+ **/
+#define MAX_THREADS 64
+/**
+ * @brief the number of objects each thread holds
+ **/
+#define NUM_OBJECTS 64
+/**
+ * @brief the number of allocations each thread performs
+ **/
+#define NUM_ROUNDS 20000
+
+typedef struct {
+	uintptr_t  self;
+	uint32_t   owner;
+} object_t;
+
+static mempool_objpool_t* pool;
+
+/**
+ * @brief the objects are passed between threads through these slots, so most of the objects are freed by the thread
+ *        other than the one allocated it
+ **/
+static object_t* volatile slots[MAX_THREADS * NUM_OBJECTS];
+
+static uint32_t num_threads;
+
+static volatile uint32_t failures;
+
+static void* thread_main(void* data)
+{
+	uint32_t tid = (uint32_t)(uintptr_t)data;
+	uint32_t i;
+	uint32_t seed = tid;
+
+	for(i = 0; i < NUM_ROUNDS; i ++)
+	{
+		object_t* obj = (object_t*)mempool_objpool_alloc(pool);
+		if(NULL == obj)
+		{
+			__sync_fetch_and_add(&failures, 1);
+			return NULL;
+		}
+
+		obj->self = (uintptr_t)obj;
+		obj->owner = tid;
+
+		seed = seed * 1103515245u + 12345u;
+		uint32_t slot = (seed >> 8) % (num_threads * NUM_OBJECTS);
+
+		object_t* old = __sync_lock_test_and_set(slots + slot, obj);
+
+		if(NULL == old) continue;
+
+		if(old->self != (uintptr_t)old || old->owner >= num_threads)
+			__sync_fetch_and_add(&failures, 1);
+
+		old->self = 0;
+
+		if(ERROR_CODE(int) == mempool_objpool_dealloc(pool, old))
+			__sync_fetch_and_add(&failures, 1);
+	}
+
+	return NULL;
+}
+
+static inline double _now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int _run(uint32_t n)
+{
+	thread_t* threads[MAX_THREADS];
+	uint32_t i;
+	int rc = ERROR_CODE(int);
+
+	mempool_objpool_tlp_policy_t policy = {
+		.cache_limit = 32,
+		.alloc_unit  = 32
+	};
+
+	if(NULL == (pool = mempool_objpool_new(sizeof(object_t))))
+		return ERROR_CODE(int);
+	if(ERROR_CODE(int) == mempool_objpool_set_thread_policy(pool, THREAD_TYPE_WORKER, policy))
+		goto ERR;
+
+	num_threads = n;
+	failures = 0;
+	memset((void*)slots, 0, sizeof(slots));
+
+	double begin = _now();
+
+	for(i = 0; i < n; i ++)
+		if(NULL == (threads[i] = thread_new(thread_main, (void*)(uintptr_t)i, THREAD_TYPE_WORKER)))
+			break;
+
+	uint32_t started = i;
+	for(i = 0; i < started; i ++)
+		thread_free(threads[i], NULL);
+
+	double elapsed = _now() - begin;
+
+	if(started != n || failures > 0) goto ERR;
+
+	LOG_NOTICE("%2u threads: %.2f M alloc/dealloc pairs per second, %u pages used",
+	           n, (double)n * NUM_ROUNDS / elapsed * 1e-6, mempool_objpool_get_page_count(pool));
+
+	/* The pages are never released, so the number of pages should be bounded by the number of the live objects */
+	if(mempool_objpool_get_page_count(pool) * ((uint32_t)getpagesize() / mempool_objpool_get_obj_size(pool)) >
+	   n * NUM_OBJECTS + n * 3 * policy.cache_limit + 4096)
+	{
+		LOG_ERROR("Too many pages are used");
+		goto ERR;
+	}
+
+	rc = 0;
+ERR:
+	for(i = 0; i < MAX_THREADS * NUM_OBJECTS; i ++)
+		if(NULL != slots[i])
+			mempool_objpool_dealloc(pool, slots[i]), slots[i] = NULL;
+	mempool_objpool_free(pool);
+	pool = NULL;
+	return rc;
+}
+
+int cross_thread_scaling(void)
+{
+	uint32_t n;
+	/* Because a GLIBC bug, the TLS of the threads with user provided stack may leak */
+	for(n = 0; n < 4; n ++)
+		expected_memory_leakage();
+	for(n = 1; n <= MAX_THREADS; n *= 2)
+		ASSERT_OK(_run(n), CLEANUP_NOP);
+
+	return 0;
+}
+
+int setup(void)
+{
+	return mempool_objpool_disabled(0);
+}
+
+int teardown(void)
+{
+	return 0;
+}
+
+TEST_LIST_BEGIN
+    TEST_CASE(depot_operations),
+    TEST_CASE(cross_thread_scaling)
+TEST_LIST_END;
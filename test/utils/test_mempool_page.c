@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <unistd.h>
+#include <testenv.h>
+#include <utils/mempool/page.h>
+
+#define N 2048
+
+static void* pages[N];
+
+int compare(const void* a, const void* b)
+{
+	uintptr_t l = *(const uintptr_t*)a, r = *(const uintptr_t*)b;
+	return l < r ? -1 : (l > r);
+}
+
+static int _check_pages(void)
+{
+	uintptr_t page_size = (uintptr_t)getpagesize();
+	uint32_t i;
+	void* sorted[N];
+
+	for(i = 0; i < N; i ++)
+	{
+		ASSERT(((uintptr_t)pages[i] & (page_size - 1)) == 0, CLEANUP_NOP);
+		memset(pages[i], (int)i, page_size);
+	}
+
+	memcpy(sorted, pages, sizeof(pages));
+	qsort(sorted, N, sizeof(void*), compare);
+	for(i = 1; i < N; i ++)
+		ASSERT((uintptr_t)sorted[i] - (uintptr_t)sorted[i - 1] >= page_size, CLEANUP_NOP);
+
+	for(i = 0; i < N; i ++)
+		ASSERT(((uint8_t*)pages[i])[page_size - 1] == (uint8_t)i, CLEANUP_NOP);
+
+	return 0;
+}
+
+int system_pages(void)
+{
+	uint32_t i;
+	ASSERT(mempool_page_get_backing() == MEMPOOL_PAGE_BACKING_SYSTEM, CLEANUP_NOP);
+
+	for(i = 0; i < N; i ++)
+		ASSERT_PTR(pages[i] = mempool_page_alloc(), CLEANUP_NOP);
+
+	ASSERT_OK(_check_pages(), CLEANUP_NOP);
+
+	for(i = 0; i < N; i ++)
+		ASSERT_OK(mempool_page_dealloc(pages[i]), CLEANUP_NOP);
+
+	return 0;
+}
+
+int huge_pages(void)
+{
+	uint32_t i;
+	ASSERT_OK(mempool_page_set_backing(MEMPOOL_PAGE_BACKING_THP), CLEANUP_NOP);
+	ASSERT(mempool_page_get_backing() == MEMPOOL_PAGE_BACKING_THP, CLEANUP_NOP);
+
+	/* Drain the pages cached by previous case, then the new pages should be carved from the chunks */
+	for(i = 0; i < N; i ++)
+		ASSERT_PTR(pages[i] = mempool_page_alloc(), CLEANUP_NOP);
+	ASSERT_OK(_check_pages(), CLEANUP_NOP);
+
+	void* huge[N];
+	for(i = 0; i < N; i ++)
+		ASSERT_PTR(huge[i] = mempool_page_alloc(), CLEANUP_NOP);
+
+	/* The pages of one chunk are contiguous */
+	uintptr_t page_size = (uintptr_t)getpagesize();
+	uint32_t contiguous = 0;
+	for(i = 1; i < N; i ++)
+		if((uintptr_t)huge[i] - (uintptr_t)huge[i - 1] == page_size) contiguous ++;
+	ASSERT(contiguous > N / 2, CLEANUP_NOP);
+
+	for(i = 0; i < N; i ++)
+	{
+		ASSERT_OK(mempool_page_dealloc(pages[i]), CLEANUP_NOP);
+		pages[i] = huge[i];
+	}
+	ASSERT_OK(_check_pages(), CLEANUP_NOP);
+
+	for(i = 0; i < N; i ++)
+		ASSERT_OK(mempool_page_dealloc(pages[i]), CLEANUP_NOP);
+
+	/* The huge pages should be reused even if we switch back to system pages */
+	ASSERT_OK(mempool_page_set_backing(MEMPOOL_PAGE_BACKING_SYSTEM), CLEANUP_NOP);
+	for(i = 0; i < N; i ++)
+		ASSERT_PTR(pages[i] = mempool_page_alloc(), CLEANUP_NOP);
+	ASSERT_OK(_check_pages(), CLEANUP_NOP);
+	for(i = 0; i < N; i ++)
+		ASSERT_OK(mempool_page_dealloc(pages[i]), CLEANUP_NOP);
+
+	return 0;
+}
+
+int setup(void)
+{
+	return mempool_page_init();
+}
+
+int teardown(void)
+{
+	return mempool_page_finalize();
+}
+
+TEST_LIST_BEGIN
+    TEST_CASE(system_pages),
+    TEST_CASE(huge_pages)
+TEST_LIST_END;
@@ -0,0 +1,101 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <testenv.h>
+#include <utils/mempool/slab.h>
+
+mempool_slab_t* slab;
+
+int slab_creation(void)
+{
+	ASSERT_PTR(slab = mempool_slab_new(), CLEANUP_NOP);
+	ASSERT(mempool_slab_num_classes(slab) > 1, CLEANUP_NOP);
+	return 0;
+}
+
+int size_classes(void)
+{
+	uint32_t n = mempool_slab_num_classes(slab), i;
+	uint32_t prev = 0;
+
+	for(i = 0; i + 1 < n; i ++)
+	{
+		mempool_slab_class_stat_t stat;
+		ASSERT_OK(mempool_slab_class_stat(slab, i, &stat), CLEANUP_NOP);
+		ASSERT(stat.size > prev, CLEANUP_NOP);
+		/* The internal fragmentation should be at most 25% after the first few classes */
+		if(prev >= 128) ASSERT(stat.size - prev <= prev / 4, CLEANUP_NOP);
+		ASSERT(stat.obj_size > stat.size, CLEANUP_NOP);
+		ASSERT(stat.in_use == 0, CLEANUP_NOP);
+		prev = stat.size;
+	}
+
+	mempool_slab_class_stat_t stat;
+	ASSERT_OK(mempool_slab_class_stat(slab, n - 1, &stat), CLEANUP_NOP);
+	ASSERT(stat.size == 0, CLEANUP_NOP);
+	ASSERT(ERROR_CODE(int) == mempool_slab_class_stat(slab, n, &stat), CLEANUP_NOP);
+
+	return 0;
+}
+
+int allocation(void)
+{
+	static const uint32_t sizes[] = {1, 7, 8, 9, 16, 17, 100, 128, 129, 160, 161, 255, 256, 257, 1000, 1800, 4000, 10000, 100000};
+	void* mem[sizeof(sizes) / sizeof(sizes[0])][16];
+	uint32_t i, j;
+
+	for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i ++)
+		for(j = 0; j < 16; j ++)
+		{
+			ASSERT_PTR(mem[i][j] = mempool_slab_alloc(slab, sizes[i]), CLEANUP_NOP);
+			ASSERT((((uintptr_t)mem[i][j]) & (sizeof(uintptr_t) - 1)) == 0, CLEANUP_NOP);
+			memset(mem[i][j], (int)(i * 16 + j), sizes[i]);
+		}
+
+	uint64_t in_use = 0;
+	uint32_t n = mempool_slab_num_classes(slab);
+	for(i = 0; i < n; i ++)
+	{
+		mempool_slab_class_stat_t stat;
+		ASSERT_OK(mempool_slab_class_stat(slab, i, &stat), CLEANUP_NOP);
+		in_use += stat.in_use;
+	}
+	ASSERT(in_use == 16 * sizeof(sizes) / sizeof(sizes[0]), CLEANUP_NOP);
+
+	for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i ++)
+		for(j = 0; j < 16; j ++)
+		{
+			const uint8_t* p = (const uint8_t*)mem[i][j];
+			uint32_t k;
+			for(k = 0; k < sizes[i]; k ++)
+				ASSERT(p[k] == (uint8_t)(i * 16 + j), CLEANUP_NOP);
+			ASSERT_OK(mempool_slab_dealloc(slab, mem[i][j]), CLEANUP_NOP);
+		}
+
+	for(i = 0; i < n; i ++)
+	{
+		mempool_slab_class_stat_t stat;
+		ASSERT_OK(mempool_slab_class_stat(slab, i, &stat), CLEANUP_NOP);
+		ASSERT(stat.in_use == 0, CLEANUP_NOP);
+	}
+
+	return 0;
+}
+
+int setup(void)
+{
+	slab = NULL;
+	return 0;
+}
+
+int teardown(void)
+{
+	if(NULL != slab) return mempool_slab_free(slab);
+	return 0;
+}
+
+TEST_LIST_BEGIN
+    TEST_CASE(slab_creation),
+    TEST_CASE(size_classes),
+    TEST_CASE(allocation)
+TEST_LIST_END;
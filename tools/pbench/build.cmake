@@ -0,0 +1,7 @@
+set(TYPE binary)
+# The graph scripts are executed with the pscript builtins
+set(SOURCE ${SOURCE_PATH}/../pscript/builtin.c ${SOURCE_PATH}/../pscript/module.c)
+list(APPEND LOCAL_INCLUDE "${SOURCE_PATH}/../pscript/include")
+set(LOCAL_LIBS plumber dl pss)
+set(INSTALL yes)
+install_includes("${SOURCE_PATH}/graphs" "lib/plumber/pbench" "*.pss")
@@ -0,0 +1,243 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <plumber.h>
+#include <error.h>
+#include <utils/log.h>
+#include <pss.h>
+
+#include <module.h>
+#include <builtin.h>
+#include <graph.h>
+
+/**
+ * @brief the code which starts the service graph defined by the graph script
+ **/
+static const char _start_code[] = "Service.start(benchmark[\"graph\"]);";
+
+/**
+ * @brief the actual data structure for a graph
+ **/
+struct _graph_t {
+	pss_vm_t*        vm;         /*!< the virtual machine which runs the graph script */
+	char*            name;       /*!< the name of the graph */
+	graph_protocol_t protocol;   /*!< the response framing protocol */
+	char*            request;    /*!< the request payload */
+	size_t           req_size;   /*!< the size of the request payload */
+};
+
+static void _print_bt(pss_vm_backtrace_t* bt)
+{
+	if(NULL == bt) return;
+	_print_bt(bt->next);
+	LOG_ERROR("\tfunc: %s, line: %u", bt->func, bt->line);
+}
+
+/**
+ * @brief run the module in the virtual machine of the graph and log the exception if there's any
+ * @param graph the graph
+ * @param module the module to run
+ * @return status code
+ **/
+static inline int _run_module(graph_t* graph, const pss_bytecode_module_t* module)
+{
+	if(ERROR_CODE(int) != pss_vm_run_module(graph->vm, module, NULL))
+		return 0;
+
+	pss_vm_exception_t* exception = pss_vm_last_exception(graph->vm);
+	if(NULL == exception) ERROR_RETURN_LOG(int, "Cannot get the PSS VM exception");
+
+	LOG_ERROR("PSS VM Exception: %s", exception->message);
+	LOG_ERROR("======Stack backtrace begin ========");
+	_print_bt(exception->backtrace);
+	LOG_ERROR("======Stack backtrace end   ========");
+
+	pss_vm_exception_free(exception);
+
+	return ERROR_CODE(int);
+}
+
+/**
+ * @brief make the argv dictionary for the graph script
+ * @param argc the number of arguments
+ * @param argv the arguments
+ * @return the dictionary value, an error value on error
+ **/
+static inline pss_value_t _make_argv(int argc, char** argv)
+{
+	pss_value_t ret = pss_value_ref_new(PSS_VALUE_REF_TYPE_DICT, NULL);
+	if(ret.kind == PSS_VALUE_KIND_ERROR)
+	{
+		LOG_ERROR("Cannot create argv value");
+		return ret;
+	}
+
+	pss_dict_t* dict = (pss_dict_t*)pss_value_get_data(ret);
+	if(NULL == dict) ERROR_LOG_GOTO(ERR, "Cannot get the dictionary object from the dictionary value");
+
+	int i;
+	for(i = 0; i < argc; i ++)
+	{
+		char keybuf[32];
+		snprintf(keybuf, sizeof(keybuf), "%d", i);
+
+		char* buf = strdup(argv[i]);
+		if(NULL == buf) ERROR_LOG_ERRNO_GOTO(ERR, "Cannot allocate memory for the argument value");
+
+		pss_value_t val = pss_value_ref_new(PSS_VALUE_REF_TYPE_STRING, buf);
+		if(val.kind == PSS_VALUE_KIND_ERROR)
+		{
+			free(buf);
+			ERROR_LOG_GOTO(ERR, "Cannot create value for argv[%d]", i);
+		}
+
+		if(ERROR_CODE(int) == pss_dict_set(dict, keybuf, val))
+		{
+			pss_value_decref(val);
+			ERROR_LOG_GOTO(ERR, "Cannot insert the argument to the dictionary");
+		}
+	}
+
+	return ret;
+ERR:
+	pss_value_decref(ret);
+	ret.kind = PSS_VALUE_KIND_ERROR;
+	return ret;
+}
+
+/**
+ * @brief get a string field from the benchmark dictionary
+ * @param dict the benchmark dictionary
+ * @param key the field name
+ * @return the string, NULL if the field is not defined or not a string
+ **/
+static inline const char* _get_string(const pss_dict_t* dict, const char* key)
+{
+	pss_value_t value = pss_dict_get(dict, key);
+	if(value.kind != PSS_VALUE_KIND_REF || pss_value_ref_type(value) != PSS_VALUE_REF_TYPE_STRING)
+		return NULL;
+
+	return (const char*)pss_value_get_data(value);
+}
+
+graph_t* graph_load(const char* path, int argc, char** argv)
+{
+	if(NULL == path || argc < 0 || (argc > 0 && NULL == argv))
+		ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	graph_t* ret = (graph_t*)calloc(1, sizeof(graph_t));
+	if(NULL == ret) ERROR_PTR_RETURN_LOG_ERRNO("Cannot allocate memory for the graph");
+
+	if(NULL == (ret->vm = pss_vm_new()) || ERROR_CODE(int) == builtin_init(ret->vm))
+		ERROR_LOG_GOTO(ERR, "Cannot create the PSS virtual machine");
+
+	pss_value_t argv_obj = _make_argv(argc, argv);
+	if(argv_obj.kind == PSS_VALUE_KIND_ERROR)
+		ERROR_LOG_GOTO(ERR, "Cannot create the argv object");
+
+	if(ERROR_CODE(int) == pss_vm_set_global(ret->vm, "argv", argv_obj))
+	{
+		pss_value_decref(argv_obj);
+		ERROR_LOG_GOTO(ERR, "Cannot inject the argv to the virtual machine");
+	}
+
+	/* The module is owned by the module list, which is disposed by module_unload_all */
+	pss_bytecode_module_t* module = module_from_file(path, 0, 0, 1, NULL);
+	if(NULL == module) ERROR_LOG_GOTO(ERR, "Cannot load the graph script %s", path);
+
+	if(ERROR_CODE(int) == _run_module(ret, module))
+		ERROR_LOG_GOTO(ERR, "Cannot run the graph script %s", path);
+
+	pss_value_t bench = pss_vm_get_global(ret->vm, "benchmark");
+	if(bench.kind != PSS_VALUE_KIND_REF || pss_value_ref_type(bench) != PSS_VALUE_REF_TYPE_DICT)
+		ERROR_LOG_GOTO(ERR, "The graph script %s doesn't define the benchmark dictionary", path);
+
+	const pss_dict_t* dict = (const pss_dict_t*)pss_value_get_data(bench);
+	if(NULL == dict) ERROR_LOG_GOTO(ERR, "Cannot get the benchmark dictionary");
+
+	pss_value_t serv = pss_dict_get(dict, "graph");
+	if(serv.kind != PSS_VALUE_KIND_REF || pss_value_ref_type(serv) != PSS_VALUE_REF_TYPE_DICT)
+		ERROR_LOG_GOTO(ERR, "The graph script %s doesn't define the service graph", path);
+
+	const char* name = _get_string(dict, "name");
+	if(NULL == (ret->name = strdup(NULL == name ? path : name)))
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot duplicate the graph name");
+
+	const char* protocol = _get_string(dict, "protocol");
+	if(NULL == protocol || strcmp(protocol, "close") == 0)
+		ret->protocol = GRAPH_PROTOCOL_CLOSE;
+	else if(strcmp(protocol, "http") == 0)
+		ret->protocol = GRAPH_PROTOCOL_HTTP;
+	else
+		ERROR_LOG_GOTO(ERR, "Invalid protocol %s", protocol);
+
+	const char* request = _get_string(dict, "request");
+	if(NULL == request || 0 == (ret->req_size = strlen(request)))
+		ERROR_LOG_GOTO(ERR, "The graph script %s doesn't define any request", path);
+
+	if(NULL == (ret->request = strdup(request)))
+		ERROR_LOG_ERRNO_GOTO(ERR, "Cannot duplicate the request");
+
+	return ret;
+ERR:
+	graph_free(ret);
+	return NULL;
+}
+
+int graph_free(graph_t* graph)
+{
+	if(NULL == graph) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	int rc = 0;
+
+	if(NULL != graph->vm && ERROR_CODE(int) == pss_vm_free(graph->vm))
+		rc = ERROR_CODE(int);
+
+	if(ERROR_CODE(int) == module_unload_all())
+		rc = ERROR_CODE(int);
+
+	if(NULL != graph->name) free(graph->name);
+	if(NULL != graph->request) free(graph->request);
+	free(graph);
+
+	return rc;
+}
+
+const char* graph_name(const graph_t* graph)
+{
+	if(NULL == graph) ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	return graph->name;
+}
+
+graph_protocol_t graph_protocol(const graph_t* graph)
+{
+	return NULL == graph ? GRAPH_PROTOCOL_CLOSE : graph->protocol;
+}
+
+const char* graph_request(const graph_t* graph, size_t* size)
+{
+	if(NULL == graph || NULL == size) ERROR_PTR_RETURN_LOG("Invalid arguments");
+
+	*size = graph->req_size;
+	return graph->request;
+}
+
+int graph_start(graph_t* graph)
+{
+	if(NULL == graph) ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	/* The code size includes the trailing 0, just like the module loaded from file */
+	pss_bytecode_module_t* module = module_from_buffer(_start_code, sizeof(_start_code), 1, 0);
+	if(NULL == module) ERROR_RETURN_LOG(int, "Cannot compile the service start code");
+
+	if(ERROR_CODE(int) == _run_module(graph, module))
+		ERROR_RETURN_LOG(int, "Cannot start the service graph");
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+/**
+ * @brief The benchmark graph
+ * @details The benchmark graph file is a regular PSS service script, which is executed with the same virtual machine
+ *          and builtins pscript uses. Instead of starting the service, the script defines the global dictionary
+ *          "benchmark", which has the following fields:
+ *          - name  The name of the graph, the path of the script is used if it's not defined
+ *          - protocol  "close" or "http", how the load generator frames the response, see graph_protocol_t
+ *          - request  The request the load generator sends
+ *          - graph  The service graph under test, which is passed to Service.start once the load generator is ready
+ *          The arguments after the graph file on the command line are passed to the script as argv, just like pscript.
+ * @file pbench/include/graph.h
+ **/
+#ifndef __GRAPH_H__
+#define __GRAPH_H__
+
+/**
+ * @brief how the load generator decides the response is complete
+ **/
+typedef enum {
+	GRAPH_PROTOCOL_CLOSE,   /*!< A connection per request, the client shuts down the write side after the request is sent
+	                         *   and the response ends when the server closes the connection */
+	GRAPH_PROTOCOL_HTTP     /*!< HTTP/1.1 with keep-alive, the response is framed by Content-Length or chunked encoding */
+} graph_protocol_t;
+
+/**
+ * @brief the loaded benchmark graph
+ **/
+typedef struct _graph_t graph_t;
+
+/**
+ * @brief load the benchmark graph by running the graph script
+ * @note the PSS module search path should be set before the graph gets loaded
+ * @param path the path to the graph script
+ * @param argc the number of arguments passed to the script
+ * @param argv the arguments passed to the script, argv[0] is the script itself
+ * @return the loaded graph, NULL on error
+ **/
+graph_t* graph_load(const char* path, int argc, char** argv);
+
+/**
+ * @brief dispose a used graph
+ * @param graph the graph to dispose
+ * @return status code
+ **/
+int graph_free(graph_t* graph);
+
+/**
+ * @brief get the name of the graph
+ * @param graph the graph
+ * @return the name, NULL on error
+ **/
+const char* graph_name(const graph_t* graph);
+
+/**
+ * @brief get the response framing protocol of the graph
+ * @param graph the graph
+ * @return the protocol
+ **/
+graph_protocol_t graph_protocol(const graph_t* graph);
+
+/**
+ * @brief get the request payload
+ * @param graph the graph
+ * @param size the buffer used to return the size of the payload
+ * @return the payload, NULL on error
+ **/
+const char* graph_request(const graph_t* graph, size_t* size);
+
+/**
+ * @brief start the service graph with Service.start
+ * @note this should be called after all the modules are installed, and it blocks until the scheduler loop is killed
+ * @param graph the graph
+ * @return status code
+ **/
+int graph_start(graph_t* graph);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+/**
+ * @brief The loopback TCP load generator
+ * @details Each connection is driven by its own client thread. In closed-loop mode, a client sends the next request as
+ *          soon as the previous response is received. In open-loop mode, the requests are sent on a fixed schedule
+ *          which is evenly distributed among the connections, and the latency is measured from the time the request
+ *          was scheduled, so a stalled server can not hide its queueing delay by slowing down the clients.
+ * @file pbench/include/loadgen.h
+ **/
+#ifndef __LOADGEN_H__
+#define __LOADGEN_H__
+
+/**
+ * @brief the number of latency percentiles reported by the load generator
+ **/
+#define LOADGEN_NUM_PERCENTILES 4
+
+/**
+ * @brief the names of the reported percentiles, in the same order of loadgen_result_t::latency
+ **/
+extern const char* const loadgen_percentile_names[LOADGEN_NUM_PERCENTILES];
+
+/**
+ * @brief the load generator parameters
+ **/
+typedef struct {
+	uint16_t          port;          /*!< the loopback port the service is listening */
+	uint32_t          connections;   /*!< the number of concurrent connections */
+	uint32_t          rate;          /*!< the target request rate per second, 0 for closed-loop mode */
+	uint64_t          requests;      /*!< the maximum number of measured requests, 0 means bounded by duration only */
+	double            duration;      /*!< the length of the measurement in seconds */
+	double            warmup;        /*!< the warm up time in seconds, the requests sent during warm up are not counted */
+	graph_protocol_t  protocol;      /*!< the response framing protocol */
+	const char*       request;       /*!< the request payload */
+	size_t            request_size;  /*!< the size of the request payload */
+} loadgen_param_t;
+
+/**
+ * @brief the load generator result
+ * @note all the time are in nanoseconds
+ **/
+typedef struct {
+	uint64_t requests;                          /*!< the number of completed requests */
+	uint64_t errors;                            /*!< the number of failed requests */
+	uint64_t bytes;                             /*!< the number of response bytes received */
+	uint64_t elapsed;                           /*!< the length of the measurement window */
+	uint64_t latency_mean;                      /*!< the mean latency */
+	uint64_t latency_max;                       /*!< the max latency */
+	uint64_t latency[LOADGEN_NUM_PERCENTILES];  /*!< the latency percentiles */
+} loadgen_result_t;
+
+/**
+ * @brief run the load generator and wait until all the clients are done
+ * @param param the load generator parameter
+ * @param result the buffer used to return the result
+ * @return status code
+ **/
+int loadgen_run(const loadgen_param_t* param, loadgen_result_t* result);
+
+/**
+ * @brief ask the running load generator to stop as soon as possible
+ * @note this is async-signal-safe
+ * @return nothing
+ **/
+void loadgen_stop(void);
+
+#endif
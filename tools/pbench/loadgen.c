@@ -0,0 +1,573 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <plumber.h>
+#include <error.h>
+#include <utils/log.h>
+
+#include <graph.h>
+#include <loadgen.h>
+
+/**
+ * @brief the number of bits used for the sub-buckets of the latency histogram, which gives about 3% relative error
+ **/
+#define _HIST_SUB_BITS 5
+
+/**
+ * @brief the latency larger than 2^_HIST_MAX_BITS ns will be put into the last bucket
+ **/
+#define _HIST_MAX_BITS 40
+
+/**
+ * @brief the number of buckets in the latency histogram
+ **/
+#define _HIST_NUM_BUCKETS ((_HIST_MAX_BITS - _HIST_SUB_BITS + 1) << _HIST_SUB_BITS)
+
+/**
+ * @brief the size of the receive buffer of each connection
+ **/
+#define _RECV_BUF_SIZE 65536
+
+/**
+ * @brief how long a client keeps retrying when the service refuses the connection
+ **/
+#define _CONNECT_TIMEOUT 5000000000ull
+
+const char* const loadgen_percentile_names[LOADGEN_NUM_PERCENTILES] = {"p50", "p90", "p99", "p999"};
+
+/**
+ * @brief the percentiles in 1/1000
+ **/
+static const uint32_t _percentiles[LOADGEN_NUM_PERCENTILES] = {500, 900, 990, 999};
+
+/**
+ * @brief the log-linear latency histogram
+ **/
+typedef struct {
+	uint64_t count;                       /*!< the number of samples */
+	uint64_t sum;                         /*!< the sum of all the samples */
+	uint64_t max;                         /*!< the max sample */
+	uint64_t bucket[_HIST_NUM_BUCKETS];   /*!< the buckets */
+} _hist_t;
+
+/**
+ * @brief the state shared by all the client threads
+ **/
+typedef struct {
+	const loadgen_param_t* param;      /*!< the parameters */
+	uint64_t               start;      /*!< the time the load generator starts */
+	uint64_t               measure;    /*!< the time the measurement starts */
+	uint64_t               deadline;   /*!< the time the clients should stop */
+	uint64_t               issued;     /*!< the number of measured requests has been issued */
+	uint64_t               last_done;  /*!< the latest completion time among all the clients */
+	pthread_mutex_t        mutex;      /*!< the mutex protects the merged result */
+	_hist_t                hist;       /*!< the merged latency histogram */
+	uint64_t               requests;   /*!< the merged number of completed requests */
+	uint64_t               errors;     /*!< the merged number of failed requests */
+	uint64_t               bytes;      /*!< the merged number of bytes received */
+} _shared_t;
+
+/**
+ * @brief a client connection
+ **/
+typedef struct {
+	_shared_t* shared;                 /*!< the shared state */
+	uint32_t   index;                  /*!< the index of this client */
+	int        fd;                     /*!< the socket, -1 if not connected */
+	int        closed;                 /*!< if the server has closed the connection */
+	size_t     begin;                  /*!< the first unconsumed byte in the buffer */
+	size_t     end;                    /*!< the end of the data in the buffer */
+	uint64_t   bytes;                  /*!< the number of bytes received for current response */
+	_hist_t    hist;                   /*!< the latency histogram of this client */
+	uint64_t   requests;               /*!< the number of completed requests */
+	uint64_t   errors;                 /*!< the number of failed requests */
+	uint64_t   total_bytes;            /*!< the number of bytes received */
+	char       buf[_RECV_BUF_SIZE];    /*!< the receive buffer */
+} _client_t;
+
+/**
+ * @brief the flag indicates the load generator should stop
+ **/
+static volatile int _stopped = 0;
+
+static inline uint64_t _now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void _sleep_until(uint64_t ts)
+{
+	struct timespec abs = {
+		.tv_sec  = (time_t)(ts / 1000000000ull),
+		.tv_nsec = (long)(ts % 1000000000ull)
+	};
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &abs, NULL) == EINTR && !_stopped);
+}
+
+static inline uint32_t _hist_index(uint64_t value)
+{
+	if(value < (1ull << _HIST_SUB_BITS)) return (uint32_t)value;
+	if(value >= (1ull << _HIST_MAX_BITS)) return _HIST_NUM_BUCKETS - 1;
+
+	uint32_t exp = 63u - (uint32_t)__builtin_clzll(value);
+	uint32_t sub = (uint32_t)(value >> (exp - _HIST_SUB_BITS)) & ((1u << _HIST_SUB_BITS) - 1);
+
+	return ((exp - _HIST_SUB_BITS + 1) << _HIST_SUB_BITS) + sub;
+}
+
+static inline uint64_t _hist_value(uint32_t index)
+{
+	if(index < (1u << _HIST_SUB_BITS)) return index;
+
+	uint32_t exp = (index >> _HIST_SUB_BITS) + _HIST_SUB_BITS - 1;
+	uint64_t sub = index & ((1u << _HIST_SUB_BITS) - 1);
+	uint64_t width = 1ull << (exp - _HIST_SUB_BITS);
+
+	/* Use the middle of the bucket */
+	return (((1ull << _HIST_SUB_BITS) + sub) << (exp - _HIST_SUB_BITS)) + width / 2;
+}
+
+static inline void _hist_add(_hist_t* hist, uint64_t value)
+{
+	hist->bucket[_hist_index(value)] ++;
+	hist->count ++;
+	hist->sum += value;
+	if(hist->max < value) hist->max = value;
+}
+
+static inline void _hist_merge(_hist_t* to, const _hist_t* from)
+{
+	uint32_t i;
+	for(i = 0; i < _HIST_NUM_BUCKETS; i ++)
+		to->bucket[i] += from->bucket[i];
+	to->count += from->count;
+	to->sum += from->sum;
+	if(to->max < from->max) to->max = from->max;
+}
+
+static inline uint64_t _hist_percentile(const _hist_t* hist, uint32_t permille)
+{
+	if(hist->count == 0) return 0;
+
+	uint64_t rank = (hist->count * permille + 999) / 1000, seen = 0;
+	uint32_t i;
+	for(i = 0; i < _HIST_NUM_BUCKETS; i ++)
+		if((seen += hist->bucket[i]) >= rank)
+		{
+			uint64_t ret = _hist_value(i);
+			return ret > hist->max ? hist->max : ret;
+		}
+
+	return hist->max;
+}
+
+/**
+ * @brief connect the client to the service
+ * @param client the client
+ * @return status code
+ **/
+static inline int _connect(_client_t* client)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port   = htons(client->shared->param->port),
+		.sin_addr   = {
+			.s_addr = htonl(INADDR_LOOPBACK)
+		}
+	};
+
+	uint64_t deadline = _now() + _CONNECT_TIMEOUT;
+
+	for(;;)
+	{
+		if((client->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot create the client socket");
+
+		int one = 1;
+		if(setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0)
+			LOG_WARNING_ERRNO("Cannot set TCP_NODELAY for the client socket");
+
+		if(connect(client->fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) break;
+
+		int err = errno;
+		close(client->fd);
+		client->fd = -1;
+
+		if(err != ECONNREFUSED || _stopped || _now() > deadline)
+		{
+			errno = err;
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot connect to the service at port %u", client->shared->param->port);
+		}
+
+		usleep(10000);
+	}
+
+	client->closed = 0;
+	client->begin = client->end = 0;
+
+	return 0;
+}
+
+static inline void _disconnect(_client_t* client)
+{
+	if(client->fd >= 0) close(client->fd);
+	client->fd = -1;
+}
+
+/**
+ * @brief read more data from the connection to the receive buffer
+ * @param client the client
+ * @return the number of bytes read, 0 if the connection has been closed, or error code
+ **/
+static inline size_t _fill(_client_t* client)
+{
+	if(client->begin > 0)
+	{
+		memmove(client->buf, client->buf + client->begin, client->end - client->begin);
+		client->end -= client->begin;
+		client->begin = 0;
+	}
+
+	if(client->end == sizeof(client->buf))
+		ERROR_RETURN_LOG(size_t, "The response line is too long");
+
+	ssize_t rc;
+	while((rc = read(client->fd, client->buf + client->end, sizeof(client->buf) - client->end)) < 0 && errno == EINTR);
+	if(rc < 0) ERROR_RETURN_LOG_ERRNO(size_t, "Cannot read from the connection");
+
+	if(rc == 0) client->closed = 1;
+
+	client->end += (size_t)rc;
+	client->bytes += (size_t)rc;
+
+	return (size_t)rc;
+}
+
+/**
+ * @brief consume bytes from the connection
+ * @param client the client
+ * @param nbytes the number of bytes to consume, (uint64_t)-1 means until the connection is closed
+ * @return status code
+ **/
+static inline int _skip(_client_t* client, uint64_t nbytes)
+{
+	int until_close = (nbytes == (uint64_t)-1);
+
+	for(;;)
+	{
+		size_t avail = client->end - client->begin;
+		if(!until_close && avail >= nbytes)
+		{
+			client->begin += (size_t)nbytes;
+			return 0;
+		}
+
+		if(!until_close) nbytes -= avail;
+		client->begin = client->end = 0;
+
+		size_t rc = _fill(client);
+		if(ERROR_CODE(size_t) == rc) return ERROR_CODE(int);
+		if(rc == 0)
+		{
+			if(until_close) return 0;
+			ERROR_RETURN_LOG(int, "Unexpected EOF");
+		}
+	}
+}
+
+/**
+ * @brief read a CRLF terminated line from the connection
+ * @param client the client
+ * @return the line without CRLF, which is valid until next read, NULL on error
+ **/
+static inline const char* _readline(_client_t* client)
+{
+	size_t scanned = client->begin;
+	for(;;)
+	{
+		char* nl = (char*)memchr(client->buf + scanned, '\n', client->end - scanned);
+		if(NULL != nl)
+		{
+			char* ret = client->buf + client->begin;
+			client->begin = (size_t)(nl - client->buf) + 1;
+			if(nl > ret && nl[-1] == '\r') nl --;
+			*nl = 0;
+			return ret;
+		}
+
+		scanned = client->end - client->begin;
+		size_t rc = _fill(client);
+		if(ERROR_CODE(size_t) == rc) return NULL;
+		if(rc == 0) ERROR_PTR_RETURN_LOG("Unexpected EOF");
+	}
+}
+
+/**
+ * @brief read a HTTP response
+ * @param client the client
+ * @param status the buffer used to return the status code
+ * @return status code
+ **/
+static inline int _read_http_response(_client_t* client, int* status)
+{
+	const char* line = _readline(client);
+	if(NULL == line) ERROR_RETURN_LOG(int, "Cannot read the status line");
+
+	if(strncmp(line, "HTTP/1.", 7) != 0 || line[8] != ' ')
+		ERROR_RETURN_LOG(int, "Invalid status line: %s", line);
+
+	*status = atoi(line + 9);
+
+	uint64_t content_length = (uint64_t)-1;
+	int chunked = 0, keep_alive = (line[7] == '1');
+
+	while(NULL != (line = _readline(client)) && line[0] != 0)
+	{
+		const char* colon = strchr(line, ':');
+		if(NULL == colon) continue;
+
+		size_t name_len = (size_t)(colon - line);
+		const char* value = colon + 1;
+		for(;*value == ' ' || *value == '\t'; value ++);
+
+		if(name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0)
+			content_length = strtoull(value, NULL, 10);
+		else if(name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0)
+			chunked = (strncasecmp(value, "chunked", 7) == 0);
+		else if(name_len == 10 && strncasecmp(line, "Connection", 10) == 0)
+			keep_alive = (strncasecmp(value, "close", 5) != 0);
+	}
+
+	if(NULL == line) ERROR_RETURN_LOG(int, "Cannot read the response header");
+
+	if(chunked)
+	{
+		for(;;)
+		{
+			if(NULL == (line = _readline(client)))
+				ERROR_RETURN_LOG(int, "Cannot read the chunk size");
+
+			uint64_t size = strtoull(line, NULL, 16);
+			if(size == 0) break;
+
+			if(ERROR_CODE(int) == _skip(client, size + 2))
+				ERROR_RETURN_LOG(int, "Cannot read the chunk");
+		}
+
+		/* Skip the trailers */
+		while(NULL != (line = _readline(client)) && line[0] != 0);
+		if(NULL == line) ERROR_RETURN_LOG(int, "Cannot read the chunk trailer");
+	}
+	else if(ERROR_CODE(int) == _skip(client, content_length))
+		ERROR_RETURN_LOG(int, "Cannot read the response body");
+
+	if(!keep_alive || content_length == (uint64_t)-1) client->closed = 1;
+
+	return 0;
+}
+
+/**
+ * @brief send one request and wait for the response
+ * @param client the client
+ * @return status code
+ **/
+static inline int _request(_client_t* client)
+{
+	const loadgen_param_t* param = client->shared->param;
+
+	if(client->fd < 0 && ERROR_CODE(int) == _connect(client))
+		return ERROR_CODE(int);
+
+	client->bytes = 0;
+
+	const char* data = param->request;
+	size_t size = param->request_size;
+	while(size > 0)
+	{
+		ssize_t rc = write(client->fd, data, size);
+		if(rc < 0 && errno == EINTR) continue;
+		if(rc <= 0) ERROR_RETURN_LOG_ERRNO(int, "Cannot send the request");
+		data += rc;
+		size -= (size_t)rc;
+	}
+
+	if(param->protocol == GRAPH_PROTOCOL_HTTP)
+	{
+		int status = 0;
+		if(ERROR_CODE(int) == _read_http_response(client, &status))
+			return ERROR_CODE(int);
+		if(status >= 400)
+			ERROR_RETURN_LOG(int, "Service responded with status code %d", status);
+	}
+	else
+	{
+		if(shutdown(client->fd, SHUT_WR) < 0)
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot shutdown the write side of the connection");
+		if(ERROR_CODE(int) == _skip(client, (uint64_t)-1))
+			return ERROR_CODE(int);
+		client->closed = 1;
+	}
+
+	return 0;
+}
+
+static void* _client_main(void* data)
+{
+	_client_t* client = (_client_t*)data;
+	_shared_t* shared = client->shared;
+	const loadgen_param_t* param = shared->param;
+	uint64_t k, last_done = 0;
+
+	for(k = 0; !_stopped; k ++)
+	{
+		uint64_t send_ts;
+		if(param->rate > 0)
+		{
+			/* The i-th request of the whole schedule is sent by the client i % connections */
+			send_ts = shared->start + (k * param->connections + client->index) * 1000000000ull / param->rate;
+			if(send_ts >= shared->deadline) break;
+			_sleep_until(send_ts);
+		}
+		else if((send_ts = _now()) >= shared->deadline) break;
+
+		/* Only the measured requests are limited, the warm up requests are bounded by the warm up time */
+		if(param->requests > 0 && send_ts >= shared->measure && __sync_fetch_and_add(&shared->issued, 1) >= param->requests)
+			break;
+
+		int rc = _request(client);
+		uint64_t done_ts = _now();
+
+		if(send_ts >= shared->measure)
+		{
+			if(ERROR_CODE(int) == rc) client->errors ++;
+			else
+			{
+				_hist_add(&client->hist, done_ts - send_ts);
+				client->requests ++;
+				client->total_bytes += client->bytes;
+			}
+			last_done = done_ts;
+		}
+
+		if(ERROR_CODE(int) == rc || client->closed)
+			_disconnect(client);
+	}
+
+	_disconnect(client);
+
+	if((errno = pthread_mutex_lock(&shared->mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot acquire the result mutex");
+
+	_hist_merge(&shared->hist, &client->hist);
+	shared->requests += client->requests;
+	shared->errors += client->errors;
+	shared->bytes += client->total_bytes;
+	if(shared->last_done < last_done) shared->last_done = last_done;
+
+	if((errno = pthread_mutex_unlock(&shared->mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot release the result mutex");
+
+	return NULL;
+}
+
+int loadgen_run(const loadgen_param_t* param, loadgen_result_t* result)
+{
+	if(NULL == param || NULL == result || param->connections == 0 || NULL == param->request || param->duration <= 0)
+		ERROR_RETURN_LOG(int, "Invalid arguments");
+
+	int rc = ERROR_CODE(int);
+	uint32_t i, started = 0;
+	_client_t** clients = NULL;
+	pthread_t* threads = NULL;
+	_shared_t* shared = (_shared_t*)calloc(1, sizeof(*shared));
+	if(NULL == shared) ERROR_RETURN_LOG_ERRNO(int, "Cannot allocate memory for the shared state");
+
+	shared->param = param;
+
+	if((errno = pthread_mutex_init(&shared->mutex, NULL)) != 0)
+	{
+		free(shared);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot initialize the result mutex");
+	}
+
+	if(NULL == (clients = (_client_t**)calloc(param->connections, sizeof(clients[0]))))
+		ERROR_LOG_ERRNO_GOTO(EXIT, "Cannot allocate memory for the client list");
+
+	if(NULL == (threads = (pthread_t*)calloc(param->connections, sizeof(threads[0]))))
+		ERROR_LOG_ERRNO_GOTO(EXIT, "Cannot allocate memory for the thread list");
+
+	for(i = 0; i < param->connections; i ++)
+	{
+		if(NULL == (clients[i] = (_client_t*)calloc(1, sizeof(_client_t))))
+			ERROR_LOG_ERRNO_GOTO(EXIT, "Cannot allocate memory for the client");
+		clients[i]->shared = shared;
+		clients[i]->index = i;
+		clients[i]->fd = -1;
+	}
+
+	shared->start = _now();
+	shared->measure = shared->start + (uint64_t)(param->warmup * 1e9);
+	shared->deadline = shared->measure + (uint64_t)(param->duration * 1e9);
+
+	for(; started < param->connections; started ++)
+		if((errno = pthread_create(threads + started, NULL, _client_main, clients[started])) != 0)
+		{
+			LOG_ERROR_ERRNO("Cannot start the client thread");
+			_stopped = 1;
+			break;
+		}
+
+	for(i = 0; i < started; i ++)
+		if((errno = pthread_join(threads[i], NULL)) != 0)
+			LOG_WARNING_ERRNO("Cannot join the client thread");
+
+	if(started < param->connections) goto EXIT;
+
+	memset(result, 0, sizeof(*result));
+	result->requests = shared->requests;
+	result->errors = shared->errors;
+	result->bytes = shared->bytes;
+	result->elapsed = shared->last_done > shared->measure ? shared->last_done - shared->measure : 0;
+	result->latency_mean = shared->hist.count > 0 ? shared->hist.sum / shared->hist.count : 0;
+	result->latency_max = shared->hist.max;
+	for(i = 0; i < LOADGEN_NUM_PERCENTILES; i ++)
+		result->latency[i] = _hist_percentile(&shared->hist, _percentiles[i]);
+
+	rc = 0;
+EXIT:
+	if(NULL != clients)
+	{
+		for(i = 0; i < param->connections; i ++)
+			if(NULL != clients[i]) free(clients[i]);
+		free(clients);
+	}
+
+	if(NULL != threads) free(threads);
+
+	if((errno = pthread_mutex_destroy(&shared->mutex)) != 0)
+		LOG_WARNING_ERRNO("Cannot dispose the result mutex");
+
+	free(shared);
+
+	return rc;
+}
+
+void loadgen_stop(void)
+{
+	_stopped = 1;
+}
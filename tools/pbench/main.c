@@ -0,0 +1,694 @@
+/**
+ * Copyright (C) 2017-2018, Hao Hou
+ **/
+
+#include <plumber.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <utils/log.h>
+#include <error.h>
+#include <module/builtins.h>
+#include <utils/thread.h>
+#include <version.h>
+#include <constants.h>
+#include <proto.h>
+#include <pss.h>
+
+#include <module.h>
+#include <graph.h>
+#include <loadgen.h>
+
+/**
+ * @brief the label of the simulate module instance
+ **/
+#define SIMULATE_LABEL "pbench"
+
+static const char* servlet_path = NULL;
+static const char* proto_db_root = NULL;
+static const char* output_path = NULL;
+static uint32_t    nthreads = 0;
+static int         simulate = 0;
+static uint32_t    nmodule_paths = 0;
+static char        events_path[] = "/tmp/pbench-events-XXXXXX";
+static char        payload_path[] = "/tmp/pbench-payload-XXXXXX";
+static char        histogram_path[] = "/tmp/pbench-histogram-XXXXXX";
+
+static loadgen_param_t param = {
+	.port        = 18080,
+	.connections = 16,
+	.rate        = 0,
+	.requests    = 0,
+	.duration    = 10,
+	.warmup      = 1
+};
+
+static loadgen_result_t result;
+
+/**
+ * @brief the PSS module search path, the graph script is searched in the same way as pscript does
+ **/
+char const* * module_paths = NULL;
+
+/**
+ * @brief emit the debug info when the PSS modules are compiled, required by the pscript builtins
+ **/
+uint32_t debug = 1;
+
+/**
+ * @brief the exit code set by the exit builtin, required by the pscript builtins
+ **/
+int exit_code = 0;
+
+/**
+ * @brief the status of the load generator thread
+ **/
+static volatile int loadgen_rc = ERROR_CODE(int);
+
+/**
+ * @brief indicates the benchmark is finished and the signal thread should exit
+ **/
+static volatile int finished = 0;
+
+static struct option _options[] = {
+	{"help",        no_argument,        0,  'h'},
+	{"version",     no_argument,        0,  'v'},
+	{"path",        required_argument,  0,  's'},
+	{"proto-db",    required_argument,  0,  'P'},
+	{"module-path", required_argument,  0,  'M'},
+	{"port",        required_argument,  0,  'p'},
+	{"connections", required_argument,  0,  'c'},
+	{"rate",        required_argument,  0,  'r'},
+	{"requests",    required_argument,  0,  'n'},
+	{"duration",    required_argument,  0,  'd'},
+	{"warmup",      required_argument,  0,  'w'},
+	{"threads",     required_argument,  0,  't'},
+	{"output",      required_argument,  0,  'o'},
+	{"simulate",    no_argument,        0,  'S'},
+	{NULL,          0,                  0,   0 }
+};
+
+__attribute__((noreturn)) static void display_help(int exitcode)
+{
+	fprintf(stderr,  "Plumber service graph benchmark tool. Starts the graph in-process, drives it with the load generator\n"
+	                 "and reports the throughput, the latency percentiles and the per-node profiler data in JSON.\n"
+	                 "Usage: pbench [options] graph-script [arguments-to-script]\n");
+	fprintf(stderr,  "  -h  --help             Display this usage information.\n"
+	                 "  -v  --version          Show the version of the program\n"
+	                 "  -s  --path             The servlet search path, separated by ':'\n"
+	                 "  -P  --proto-db         The protocol database root\n"
+	                 "  -M  --module-path      Append the PSS module search path, where the graph script is searched\n"
+	                 "  -p  --port             The loopback port the service listens (Default: 18080)\n"
+	                 "  -c  --connections      The number of concurrent connections (Default: 16)\n"
+	                 "  -r  --rate             The target requests per second, 0 for closed-loop mode (Default: 0)\n"
+	                 "  -n  --requests         Stop after this number of requests, required in simulate mode\n"
+	                 "  -d  --duration         The length of the measurement in seconds (Default: 10)\n"
+	                 "  -w  --warmup           The warm up time in seconds, which isn't measured (Default: 1)\n"
+	                 "  -t  --threads          The number of scheduler worker threads\n"
+	                 "  -o  --output           Write the JSON result to the file instead of stdout\n"
+	                 "  -S  --simulate         Feed the requests from the simulate module instead of the TCP clients,\n"
+	                 "                         only the throughput is measured in this mode\n"
+	       );
+	exit(exitcode);
+}
+
+__attribute__((noreturn)) static void show_version(int exitcode)
+{
+	fprintf(stderr, "Program Version:          %s\n"
+	                "Libplumber Version:       %s\n",
+	                PLUMBER_VERSION,
+	                plumber_version());
+	exit(exitcode);
+}
+
+static void add_search_path(const char* paths)
+{
+	char buffer[4096];
+	size_t size = 0;
+	for(;;paths ++)
+	{
+		if(*paths == ':' || *paths == 0)
+		{
+			buffer[size] = 0;
+			if(size > 0 && runtime_servlet_append_search_path(buffer) == ERROR_CODE(int))
+				LOG_WARNING("Cannot append servlet search path %s", buffer);
+			size = 0;
+			if(*paths == 0) break;
+		}
+		else if(size < sizeof(buffer) - 1)
+			buffer[size++] = *paths;
+	}
+}
+
+static double parse_number(const char* str, const char* name)
+{
+	char* end;
+	double ret = strtod(str, &end);
+	if(*end != 0 || ret < 0)
+	{
+		fprintf(stderr, "Invalid %s: %s\n", name, str);
+		display_help(EXIT_FAILURE);
+	}
+	return ret;
+}
+
+static uint64_t parse_integer(const char* str, const char* name)
+{
+	char* end;
+	errno = 0;
+	unsigned long long ret = strtoull(str, &end, 10);
+	if(*end != 0 || errno != 0 || str[0] == '-')
+	{
+		fprintf(stderr, "Invalid %s: %s\n", name, str);
+		display_help(EXIT_FAILURE);
+	}
+	return ret;
+}
+
+static int parse_args(int argc, char** argv)
+{
+	int opt_idx, c;
+
+	/* At most argc paths from the command line, plus the current directory, the root, the graph and PSS directory */
+	if(NULL == (module_paths = (char const**)calloc((size_t)argc + 5, sizeof(module_paths[0]))))
+	{
+		perror("Cannot allocate memory for the module search path");
+		exit(EXIT_FAILURE);
+	}
+	module_paths[nmodule_paths ++] = ".";
+	module_paths[nmodule_paths ++] = "/";
+
+	/* Stop at the graph script, the remaining arguments are passed to the script */
+	for(;(c = getopt_long(argc, argv, "+hvs:P:M:p:c:r:n:d:w:t:o:S", _options, &opt_idx)) >= 0;)
+	{
+		switch(c)
+		{
+			case 's':
+				servlet_path = optarg;
+				break;
+			case 'P':
+				proto_db_root = optarg;
+				break;
+			case 'M':
+				module_paths[nmodule_paths ++] = optarg;
+				break;
+			case 'p':
+				param.port = (uint16_t)parse_integer(optarg, "port");
+				break;
+			case 'c':
+				param.connections = (uint32_t)parse_integer(optarg, "number of connections");
+				break;
+			case 'r':
+				param.rate = (uint32_t)parse_integer(optarg, "rate");
+				break;
+			case 'n':
+				param.requests = parse_integer(optarg, "number of requests");
+				break;
+			case 'd':
+				param.duration = parse_number(optarg, "duration");
+				break;
+			case 'w':
+				param.warmup = parse_number(optarg, "warm up time");
+				break;
+			case 't':
+				nthreads = (uint32_t)parse_integer(optarg, "number of threads");
+				break;
+			case 'o':
+				output_path = optarg;
+				break;
+			case 'S':
+				simulate = 1;
+				break;
+			case 'h':
+				display_help(EXIT_SUCCESS);
+			case 'v':
+				show_version(EXIT_SUCCESS);
+			default:
+				fprintf(stderr, "Invalid argument %c\n", c);
+				display_help(EXIT_FAILURE);
+		}
+	}
+
+	module_paths[nmodule_paths ++] = PBENCH_GRAPH_PATH;
+	module_paths[nmodule_paths ++] = PSCRIPT_GLOBAL_MODULE_PATH;
+
+	if(optind >= argc)
+	{
+		fprintf(stderr, "The graph script is required.\n");
+		display_help(EXIT_FAILURE);
+	}
+
+	if(param.connections == 0 || param.duration <= 0)
+	{
+		fprintf(stderr, "Invalid load generator parameters\n");
+		display_help(EXIT_FAILURE);
+	}
+
+	if(simulate && param.requests == 0)
+	{
+		fprintf(stderr, "The number of requests is required in simulate mode\n");
+		display_help(EXIT_FAILURE);
+	}
+
+	return optind;
+}
+
+/**
+ * @brief the thread handles SIGINT, which is sent either by user or the simulate module when all the events are done
+ * @note SIGINT is blocked in all the other threads, so the scheduler is never interrupted while holding its locks
+ **/
+static void* signal_main(void* data)
+{
+	sigset_t* mask = (sigset_t*)data;
+	int signo;
+
+	for(;;)
+	{
+		if((errno = sigwait(mask, &signo)) != 0)
+			ERROR_PTR_RETURN_LOG_ERRNO("Cannot wait for the signal");
+
+		if(finished) return NULL;
+
+		LOG_DEBUG("SIGINT Caught!");
+
+		/* The load generator stops the service once all the clients are done */
+		loadgen_stop();
+		if(simulate) sched_loop_kill(1);
+	}
+}
+
+static int set_prop(const char* symbol, int64_t num, const char* str)
+{
+	lang_prop_value_t value = {};
+	if(NULL != str)
+	{
+		value.type = LANG_PROP_TYPE_STRING;
+		if(NULL == (value.str = strdup(str)))
+			ERROR_RETURN_LOG_ERRNO(int, "Cannot duplicate the property value");
+	}
+	else
+	{
+		value.type = LANG_PROP_TYPE_INTEGER;
+		value.num  = num;
+	}
+
+	int rc = lang_prop_set(symbol, value);
+	if(NULL != str) free(value.str);
+	if(ERROR_CODE(int) == rc) ERROR_RETURN_LOG(int, "Cannot set property %s", symbol);
+
+	return 0;
+}
+
+/**
+ * @brief create a temporary file
+ * @param path the path template, which will be replaced by the actual path
+ * @return the file opened for writing, NULL on error
+ **/
+static FILE* create_temp_file(char* path)
+{
+	int fd = mkstemp(path);
+	if(fd < 0) ERROR_PTR_RETURN_LOG_ERRNO("Cannot create the temporary file %s", path);
+
+	FILE* fp = fdopen(fd, "w");
+	if(NULL == fp)
+	{
+		close(fd);
+		ERROR_PTR_RETURN_LOG_ERRNO("Cannot open the temporary file %s", path);
+	}
+
+	return fp;
+}
+
+/**
+ * @brief write the simulate event file which contains param.requests events carrying the request payload
+ * @note the payload is referred by a FILE event, because the simulate module can not parse a TEXT event which
+ *       ends with a blank line, and most of the requests does
+ * @param graph the graph
+ * @return status code
+ **/
+static int write_events(const graph_t* graph)
+{
+	size_t size;
+	const char* request = graph_request(graph, &size);
+	if(NULL == request) ERROR_RETURN_LOG(int, "Cannot get the request payload");
+
+	FILE* fp = create_temp_file(payload_path);
+	if(NULL == fp) ERROR_RETURN_LOG(int, "Cannot create the payload file");
+
+	if(fwrite(request, 1, size, fp) != size)
+	{
+		fclose(fp);
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot write the payload file");
+	}
+
+	if(fclose(fp) != 0) ERROR_RETURN_LOG_ERRNO(int, "Cannot write the payload file");
+
+	if(NULL == (fp = create_temp_file(events_path)))
+		ERROR_RETURN_LOG(int, "Cannot create the event file");
+
+	uint64_t i;
+	for(i = 0; i < param.requests; i ++)
+		fprintf(fp, ".FILE request_%"PRIu64"\n%s\n.END\n", i, payload_path);
+	fputs(".STOP\n", fp);
+
+	if(fclose(fp) != 0) ERROR_RETURN_LOG_ERRNO(int, "Cannot write the event file");
+
+	return 0;
+}
+
+/**
+ * @brief install the modules which are required before the graph script runs, so that the script is able to
+ *        change the properties of them
+ * @return status code
+ **/
+static int load_modules(void)
+{
+	if(!simulate)
+	{
+		char buf[4096];
+		char port[16];
+		snprintf(port, sizeof(port), "%u", param.port);
+		char const* args[] = {port};
+
+		if(ERROR_CODE(int) == itc_modtab_insmod(&module_tcp_module_def, 1, args))
+			ERROR_RETURN_LOG(int, "Cannot install the TCP module");
+
+		snprintf(buf, sizeof(buf), "pipe.tcp.port_%u.reuseaddr", param.port);
+		if(ERROR_CODE(int) == set_prop(buf, 1, NULL))
+			ERROR_RETURN_LOG(int, "Cannot set the reuseaddr flag");
+	}
+
+	if(ERROR_CODE(int) == itc_modtab_insmod(&module_mem_module_def, 0, NULL))
+		ERROR_RETURN_LOG(int, "Cannot install the memory pipe module");
+
+	if(ERROR_CODE(int) == itc_modtab_insmod(&module_pssm_module_def, 0, NULL))
+		ERROR_RETURN_LOG(int, "Cannot install the PSSM module");
+
+	if(ERROR_CODE(int) == set_prop("scheduler.worker.default_itc_pipe", 0, "pipe.mem"))
+		ERROR_RETURN_LOG(int, "Cannot set the default ITC pipe");
+
+	return 0;
+}
+
+/**
+ * @brief set up the request feeder and the profiler once the graph script has defined the benchmark
+ * @param graph the graph
+ * @return status code
+ **/
+static int setup_benchmark(const graph_t* graph)
+{
+	if(simulate)
+	{
+		if(ERROR_CODE(int) == write_events(graph))
+			ERROR_RETURN_LOG(int, "Cannot write the simulated events");
+
+		char input_arg[128];
+		snprintf(input_arg, sizeof(input_arg), "input=%s", events_path);
+		char const* args[] = {input_arg, "output=/dev/null", "label="SIMULATE_LABEL};
+
+		if(ERROR_CODE(int) == itc_modtab_insmod(&module_simulate_module_def, 3, args))
+			ERROR_RETURN_LOG(int, "Cannot install the simulate module");
+
+		if(ERROR_CODE(int) == set_prop("pipe.simulate."SIMULATE_LABEL".events_per_sec", param.rate, NULL))
+			ERROR_RETURN_LOG(int, "Cannot set the event rate");
+	}
+
+	if(nthreads > 0 && ERROR_CODE(int) == set_prop("scheduler.worker.nthreads", nthreads, NULL))
+		ERROR_RETURN_LOG(int, "Cannot set the number of worker threads");
+
+#ifdef ENABLE_PROFILER
+	int fd = mkstemp(histogram_path);
+	if(fd < 0) ERROR_RETURN_LOG_ERRNO(int, "Cannot create the histogram file");
+	close(fd);
+
+	if(ERROR_CODE(int) == set_prop("profiler.enabled", 1, NULL) ||
+	   ERROR_CODE(int) == set_prop("profiler.histogram", 0, histogram_path))
+		ERROR_RETURN_LOG(int, "Cannot enable the profiler");
+#else
+	histogram_path[0] = 0;
+	LOG_NOTICE("Plumber is built without profiler, the per-node data is not available");
+#endif
+
+	return 0;
+}
+
+static void* loadgen_main(void* data)
+{
+	(void)data;
+
+	loadgen_rc = loadgen_run(&param, &result);
+
+	if(sched_loop_kill(1) == ERROR_CODE(int))
+		LOG_ERROR("Cannot stop the service");
+
+	return NULL;
+}
+
+/**
+ * @brief write the per-node profiler histogram as a JSON array
+ * @details The histogram file is a TSV file, the first line is the column names
+ * @param fp the output file
+ * @return nothing
+ **/
+static void write_nodes(FILE* fp)
+{
+	char header[4096], line[4096];
+	char* columns[64];
+	uint32_t ncolumns = 0, i;
+
+	fputs("[", fp);
+
+	FILE* in = histogram_path[0] ? fopen(histogram_path, "r") : NULL;
+	if(NULL == in || NULL == fgets(header, sizeof(header), in) || header[0] != '#')
+		goto EXIT;
+
+	char* saveptr = NULL;
+	char* col;
+	for(col = strtok_r(header + 1, "\t\n", &saveptr); NULL != col && ncolumns < sizeof(columns) / sizeof(columns[0]);
+	    col = strtok_r(NULL, "\t\n", &saveptr))
+		columns[ncolumns ++] = col;
+
+	int first = 1;
+	while(NULL != fgets(line, sizeof(line), in))
+	{
+		fprintf(fp, "%s\n\t\t{", first ? "" : ",");
+		first = 0;
+		saveptr = NULL;
+		for(i = 0, col = strtok_r(line, "\t\n", &saveptr); NULL != col && i < ncolumns;
+		    i ++, col = strtok_r(NULL, "\t\n", &saveptr))
+		{
+			/* The servlet name is the only string column */
+			if(strcmp(columns[i], "servlet") == 0)
+				fprintf(fp, "%s\"%s\": \"%s\"", i ? ", " : "", columns[i], col);
+			else
+				fprintf(fp, "%s\"%s\": %s", i ? ", " : "", columns[i], col);
+		}
+		fputs("}", fp);
+	}
+
+	if(!first) fputs("\n\t", fp);
+EXIT:
+	if(NULL != in) fclose(in);
+	fputs("]", fp);
+}
+
+static int write_result(const char* name, uint64_t elapsed)
+{
+	FILE* fp = stdout;
+	if(NULL != output_path && NULL == (fp = fopen(output_path, "w")))
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot open the output file %s", output_path);
+
+	if(simulate)
+	{
+		/* The simulate module doesn't report the completion time, so all we know is the total time */
+		memset(&result, 0, sizeof(result));
+		result.requests = param.requests;
+		result.elapsed = elapsed;
+	}
+
+	double seconds = (double)result.elapsed / 1e9;
+	double throughput = seconds > 0 ? (double)result.requests / seconds : 0;
+	uint32_t i;
+
+	fprintf(fp, "{\n"
+	            "\t\"graph\": \"%s\",\n"
+	            "\t\"feeder\": \"%s\",\n"
+	            "\t\"mode\": \"%s\",\n"
+	            "\t\"connections\": %u,\n"
+	            "\t\"target_rate\": %u,\n"
+	            "\t\"elapsed\": %.6f,\n"
+	            "\t\"requests\": %"PRIu64",\n"
+	            "\t\"errors\": %"PRIu64",\n"
+	            "\t\"bytes\": %"PRIu64",\n"
+	            "\t\"throughput\": %.2f,\n",
+	            name, simulate ? "simulate" : "tcp", (simulate || param.rate > 0) ? "open" : "closed",
+	            simulate ? 0 : param.connections, param.rate, seconds, result.requests, result.errors, result.bytes,
+	            throughput);
+
+	fprintf(fp, "\t\"latency_us\": {\"mean\": %.3f", (double)result.latency_mean / 1e3);
+	for(i = 0; i < LOADGEN_NUM_PERCENTILES; i ++)
+		fprintf(fp, ", \"%s\": %.3f", loadgen_percentile_names[i], (double)result.latency[i] / 1e3);
+	fprintf(fp, ", \"max\": %.3f},\n", (double)result.latency_max / 1e3);
+
+	fputs("\t\"nodes\": ", fp);
+	write_nodes(fp);
+	fputs("\n}\n", fp);
+
+	if(fp != stdout && fclose(fp) != 0)
+		ERROR_RETURN_LOG_ERRNO(int, "Cannot close the output file");
+
+	fprintf(stderr, "%s: %"PRIu64" requests in %.3fs, %"PRIu64" errors, %.2f req/s",
+	        name, result.requests, seconds, result.errors, throughput);
+	if(!simulate)
+		fprintf(stderr, ", latency p50 %.3fms p99 %.3fms p999 %.3fms",
+		        (double)result.latency[0] / 1e6, (double)result.latency[2] / 1e6, (double)result.latency[3] / 1e6);
+	fputs("\n", stderr);
+
+	return 0;
+}
+
+#ifndef STACK_SIZE
+int main(int argc, char** argv)
+#else
+int _program(int argc, char** argv);
+
+int main(int argc, char** argv)
+{
+	return thread_start_with_aligned_stack(_program, argc, argv);
+}
+
+int _program(int argc, char** argv)
+#endif
+{
+	int rc = 1, loadgen_started = 0;
+	pthread_t loadgen_thread, signal_thread;
+	graph_t* graph = NULL;
+	char* name = NULL;
+	sigset_t mask;
+
+	int begin = parse_args(argc, argv);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	if((errno = pthread_sigmask(SIG_BLOCK, &mask, NULL)) != 0 ||
+	   (errno = pthread_create(&signal_thread, NULL, signal_main, &mask)) != 0)
+	{
+		perror("Cannot start the signal handling thread");
+		return 1;
+	}
+
+	if(plumber_init() == ERROR_CODE(int))
+	{
+		LOG_FATAL("Cannot initialize libplumber");
+		finished = 1;
+		pthread_kill(signal_thread, SIGINT);
+		pthread_join(signal_thread, NULL);
+		free(module_paths);
+		return 1;
+	}
+
+	if(pss_init() == ERROR_CODE(int) || pss_log_set_write_callback(log_write_va) == ERROR_CODE(int))
+		ERROR_LOG_GOTO(EXIT, "Cannot initialize libpss");
+
+	if(module_set_search_path(module_paths) == ERROR_CODE(int))
+		ERROR_LOG_GOTO(EXIT, "Cannot set the PSS module search path");
+
+	if(proto_db_root != NULL && ERROR_CODE(int) == proto_cache_set_root(proto_db_root))
+		ERROR_LOG_GOTO(EXIT, "Cannot set the protocol database root");
+
+	if(NULL != servlet_path) add_search_path(servlet_path);
+	add_search_path(RUNTIME_SERVLET_DEFAULT_SEARCH_PATH);
+
+	if(ERROR_CODE(int) == load_modules())
+		ERROR_LOG_GOTO(EXIT, "Cannot initialize the modules");
+
+	if(NULL == (graph = graph_load(argv[begin], argc - begin, argv + begin)))
+		ERROR_LOG_GOTO(EXIT, "Cannot load the graph script %s", argv[begin]);
+
+	if(NULL == (name = strdup(graph_name(graph))))
+		ERROR_LOG_ERRNO_GOTO(EXIT, "Cannot duplicate the graph name");
+
+	param.protocol = graph_protocol(graph);
+	if(NULL == (param.request = graph_request(graph, &param.request_size)))
+		ERROR_LOG_GOTO(EXIT, "Cannot get the request payload");
+
+	if(ERROR_CODE(int) == setup_benchmark(graph))
+		ERROR_LOG_GOTO(EXIT, "Cannot set up the benchmark");
+
+	if(!simulate)
+	{
+		if((errno = pthread_create(&loadgen_thread, NULL, loadgen_main, NULL)) != 0)
+			ERROR_LOG_ERRNO_GOTO(EXIT, "Cannot start the load generator thread");
+		loadgen_started = 1;
+	}
+
+	struct timespec start_ts, end_ts;
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+	if(ERROR_CODE(int) == graph_start(graph))
+	{
+		loadgen_stop();
+		ERROR_LOG_GOTO(EXIT, "Cannot start the service");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end_ts);
+
+	if(loadgen_started)
+	{
+		loadgen_started = 0;
+		if((errno = pthread_join(loadgen_thread, NULL)) != 0)
+			LOG_WARNING_ERRNO("Cannot join the load generator thread");
+		if(loadgen_rc == ERROR_CODE(int))
+			ERROR_LOG_GOTO(EXIT, "The load generator failed");
+	}
+
+	/* Dispose the graph first, so that the service is disposed and the profiler exports the histogram */
+	if(ERROR_CODE(int) == graph_free(graph))
+		LOG_WARNING("Cannot dispose the graph");
+	graph = NULL;
+
+	uint64_t elapsed = (uint64_t)(end_ts.tv_sec - start_ts.tv_sec) * 1000000000ull + (uint64_t)end_ts.tv_nsec - (uint64_t)start_ts.tv_nsec;
+
+	if(ERROR_CODE(int) == write_result(name, elapsed))
+		ERROR_LOG_GOTO(EXIT, "Cannot write the benchmark result");
+
+	rc = 0;
+EXIT:
+	if(loadgen_started)
+	{
+		loadgen_stop();
+		pthread_join(loadgen_thread, NULL);
+	}
+
+	if(NULL != graph) graph_free(graph);
+	if(NULL != name) free(name);
+
+	if(pss_finalize() == ERROR_CODE(int))
+		LOG_WARNING("Cannot finalize libpss");
+
+	finished = 1;
+	if((errno = pthread_kill(signal_thread, SIGINT)) != 0 || (errno = pthread_join(signal_thread, NULL)) != 0)
+		LOG_WARNING_ERRNO("Cannot stop the signal handling thread");
+
+	if(plumber_finalize() == ERROR_CODE(int))
+	{
+		fprintf(stderr, "error: Cannot finalize libplumber\n");
+		rc = 1;
+	}
+
+	if(simulate) unlink(events_path), unlink(payload_path);
+	if(histogram_path[0] != 0) unlink(histogram_path);
+
+	free(module_paths);
+
+	return rc;
+}
@@ -879,6 +879,69 @@ static pss_value_t _pscript_builtin_daemon_reload(pss_vm_t* vm, uint32_t argc, p
 	return ret;
 }
 
+static pss_value_t _pscript_builtin_daemon_memory(pss_vm_t* vm, uint32_t argc, pss_value_t* argv)
+{
+	(void)vm;
+	pss_value_t ret = {.kind = PSS_VALUE_KIND_ERROR, .num = PSS_VM_ERROR_ARGUMENT};
+
+	if(argc != 2) return ret;
+
+	if(argv[0].kind != PSS_VALUE_KIND_REF || pss_value_ref_type(argv[0]) != PSS_VALUE_REF_TYPE_STRING)
+		return ret;
+
+	if(argv[1].kind != PSS_VALUE_KIND_NUM)
+		return ret;
+
+	const char* daemon = (const char*)pss_value_get_data(argv[0]);
+	char* report;
+	ret.num = PSS_VM_ERROR_INTERNAL;
+
+	if(ERROR_CODE(int) == sched_daemon_memory(daemon, argv[1].num != 0, &report))
+	{
+		LOG_ERROR("Cannot get the memory accounting report from the daemon");
+		return ret;
+	}
+
+	ret = pss_value_ref_new(PSS_VALUE_REF_TYPE_STRING, report);
+	if(ret.kind == PSS_VALUE_KIND_ERROR)
+	{
+		LOG_ERROR("Cannot create new string value for the memory accounting report");
+		free(report);
+	}
+
+	return ret;
+}
+
+static pss_value_t _pscript_builtin_daemon_profile(pss_vm_t* vm, uint32_t argc, pss_value_t* argv)
+{
+	(void)vm;
+	pss_value_t ret = {.kind = PSS_VALUE_KIND_ERROR, .num = PSS_VM_ERROR_ARGUMENT};
+
+	if(argc != 1) return ret;
+
+	if(argv[0].kind != PSS_VALUE_KIND_REF || pss_value_ref_type(argv[0]) != PSS_VALUE_REF_TYPE_STRING)
+		return ret;
+
+	const char* daemon = (const char*)pss_value_get_data(argv[0]);
+	char* report;
+	ret.num = PSS_VM_ERROR_INTERNAL;
+
+	if(ERROR_CODE(int) == sched_daemon_profile(daemon, &report))
+	{
+		LOG_ERROR("Cannot get the profiler report from the daemon");
+		return ret;
+	}
+
+	ret = pss_value_ref_new(PSS_VALUE_REF_TYPE_STRING, report);
+	if(ret.kind == PSS_VALUE_KIND_ERROR)
+	{
+		LOG_ERROR("Cannot create new string value for the profiler report");
+		free(report);
+	}
+
+	return ret;
+}
+
 static pss_value_t _pscript_builtin_typeof(pss_vm_t* vm, uint32_t argc, pss_value_t* argv)
 {
 	(void)vm;
@@ -1373,6 +1436,8 @@ static struct {
 	_B(split, "(str [, sep])", "Split the given string str by seperator sep, if sep is not given, split the string by white space '\" \"'"),
 	_B(parse_int, "(str)", "Parse the integer form the string"),
 	_B(version, "()", "Get the version string of current Plumber system"),
+	_P(daemon_memory, "(daemon, delta)", "Get the memory accounting report of the daemon, delta: if we want the changes since the last delta report"),
+	_P(daemon_profile, "(daemon)", "Get the profiler histogram report of the daemon"),
 	_P(daemon_ping, "(daemon_ping)", "Ping a daemon, test if the daemon is responding"),
 	_P(daemon_reload, "(daemon, service)", "Reload the daemon with the graph"),
 	_P(daemon_stop, "(daemon_id)", "Stop the daemon with the given name"),